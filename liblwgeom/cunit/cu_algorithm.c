@@ -16,6 +16,7 @@
 #include "CUnit/Basic.h"
 
 #include "liblwgeom_internal.h"
+#include "lwitree.h"
 #include "cu_tester.h"
 
 /*
@@ -878,6 +879,84 @@ static void test_isclosed(void)
 	lwgeom_free(geom);
 }
 
+static void test_itree(void)
+{
+	const char *wkt[] =
+	{
+		"POLYGON((0 0,0 10,10 10,10 0,0 0),(2 2,4 2,4 4,2 4,2 2))",
+		"MULTIPOLYGON(((0 0,0 10,10 10,10 0,0 0),(2 2,4 2,4 4,2 4,2 2)),((20 0,20 10,30 10,20 0)),((2.5 2.5,2.5 3.5,3.5 3.5,3.5 2.5,2.5 2.5)))",
+		"POLYGON((0 0,0 0,0 10,5 5,10 10,10 0,5 0,5 0,0 0))",
+		"MULTIPOLYGON(((1 1,1 9,9 9,9 1,1 1)),((12 1,12 9,19 9,12 1)))"
+	};
+	LWGEOM *geom;
+	GSERIALIZED *g;
+	ITREE *itree;
+	POINTARRAY *pa;
+	POINTARRAY **rings;
+	POINT4D p4d;
+	POINT2D pt;
+	int i, x, y;
+
+	/* Every answer agrees with the plain ring walk, boundaries included */
+	for ( i = 0; i < 4; i++ )
+	{
+		geom = lwgeom_from_wkt(wkt[i], LW_PARSER_CHECK_NONE);
+		g = gserialized_from_lwgeom(geom, 0, 0);
+		itree = itree_from_lwgeom(geom);
+		for ( x = -2; x <= 64; x++ )
+		{
+			for ( y = -2; y <= 24; y++ )
+			{
+				pt.x = x / 2.0;
+				pt.y = y / 2.0;
+				CU_ASSERT_EQUAL(itree_point_in_multipolygon(itree, &pt), gserialized_point_in_polygon(g, &pt));
+			}
+		}
+		itree_free(itree);
+		lwfree(g);
+		lwgeom_free(geom);
+	}
+
+	/* A ring long enough for a deep tree: star with 2000 spikes */
+	pa = ptarray_construct_empty(0, 0, 4001);
+	for ( i = 0; i < 4000; i++ )
+	{
+		double a = 2.0 * M_PI * i / 4000;
+		double r = (i % 2) ? 10.0 : 9.0;
+		p4d.x = r * cos(a);
+		p4d.y = r * sin(a);
+		ptarray_append_point(pa, &p4d, LW_TRUE);
+	}
+	p4d.x = 9.0;
+	p4d.y = 0.0;
+	ptarray_append_point(pa, &p4d, LW_TRUE);
+	rings = lwalloc(sizeof(POINTARRAY*));
+	rings[0] = pa;
+	geom = lwpoly_as_lwgeom(lwpoly_construct(SRID_UNKNOWN, NULL, 1, rings));
+	g = gserialized_from_lwgeom(geom, 0, 0);
+	itree = itree_from_lwgeom(geom);
+	CU_ASSERT_EQUAL(itree->rings[0].nsegs, 4000);
+	CU_ASSERT_EQUAL(itree->rings[0].nlevels, 13);
+	for ( i = 0; i < 2000; i++ )
+	{
+		pt.x = -10.5 + 21.0 * (i % 50) / 49.0;
+		pt.y = -10.5 + 21.0 * (i / 50) / 39.0;
+		CU_ASSERT_EQUAL(itree_point_in_multipolygon(itree, &pt), gserialized_point_in_polygon(g, &pt));
+	}
+	pt.x = pt.y = 0.0;
+	CU_ASSERT_EQUAL(itree_point_in_multipolygon(itree, &pt), 1);
+	pt.x = 9.0;
+	CU_ASSERT_EQUAL(itree_point_in_multipolygon(itree, &pt), 0);
+	itree_free(itree);
+	lwfree(g);
+	lwgeom_free(geom);
+
+	/* Only areal types get a tree */
+	geom = lwgeom_from_wkt("LINESTRING(0 0,1 1)", LW_PARSER_CHECK_NONE);
+	CU_ASSERT(itree_from_lwgeom(geom) == NULL);
+	lwgeom_free(geom);
+}
+
 /*
 ** Used by test harness to register the tests in this file.
 */
@@ -898,6 +977,7 @@ CU_TestInfo algorithms_tests[] =
 	PG_TEST(test_geohash_precision),
 	PG_TEST(test_geohash),
 	PG_TEST(test_isclosed),
+	PG_TEST(test_itree),
 	CU_TEST_INFO_NULL
 };
 CU_SuiteInfo algorithms_suite = {"PostGIS Computational Geometry Suite",  init_cg_suite,  clean_cg_suite, algorithms_tests};
@@ -16,6 +16,7 @@
 #include "CUnit/Basic.h"
 
 #include "lwgeodetic.h"
+#include "lwgeodetic_tree.h"
 #include "cu_tester.h"
 
 #define RANDOM_TEST 0
@@ -954,6 +955,292 @@ static void test_spheroid_area(void)
 }
 
 
+/*
+** Build a wiggly line of npoints vertices, starting at (lon, lat) and
+** heading east.
+*/
+static LWGEOM* wiggly_line(double lon, double lat, int npoints, double amplitude)
+{
+	POINTARRAY *pa = ptarray_construct_empty(LW_FALSE, LW_FALSE, npoints);
+	POINT4D pt;
+	int i;
+
+	pt.z = pt.m = 0.0;
+	for ( i = 0; i < npoints; i++ )
+	{
+		pt.x = lon + 60.0 * i / npoints;
+		pt.y = lat + amplitude * sin(i * 0.37) * cos(i * 0.011);
+		ptarray_append_point(pa, &pt, LW_TRUE);
+	}
+	return lwline_as_lwgeom(lwline_construct(SRID_UNKNOWN, NULL, pa));
+}
+
+/*
+** Pairwise edge walk, for reference.
+*/
+static double brute_distance(const POINTARRAY *pa1, const POINTARRAY *pa2)
+{
+	GEOGRAPHIC_EDGE e1, e2;
+	GEOGRAPHIC_POINT g;
+	POINT2D p;
+	double d, distance = MAXFLOAT;
+	int i, j;
+
+	for ( i = 1; i < pa1->npoints; i++ )
+	{
+		getPoint2d_p(pa1, i-1, &p);
+		geographic_point_init(p.x, p.y, &(e1.start));
+		getPoint2d_p(pa1, i, &p);
+		geographic_point_init(p.x, p.y, &(e1.end));
+		for ( j = 1; j < pa2->npoints; j++ )
+		{
+			getPoint2d_p(pa2, j-1, &p);
+			geographic_point_init(p.x, p.y, &(e2.start));
+			getPoint2d_p(pa2, j, &p);
+			geographic_point_init(p.x, p.y, &(e2.end));
+			if ( edge_intersection(&e1, &e2, &g) )
+				return 0.0;
+			d = edge_distance_to_edge(&e1, &e2, NULL, NULL);
+			if ( d < distance )
+				distance = d;
+		}
+	}
+	return distance;
+}
+
+static void test_lwmpoint_calculate_gbox_geodetic(void)
+{
+	LWGEOM *mpoint;
+	LWPOINT *point;
+	GBOX gbox, pbox, expected;
+	char wkt[32];
+	int i;
+
+	/* More points than fit in a single conversion batch */
+	mpoint = lwgeom_from_wkt("MULTIPOINT EMPTY", LW_PARSER_CHECK_NONE);
+	for ( i = 0; i < 600; i++ )
+	{
+		snprintf(wkt, sizeof(wkt), "POINT(%d %g)", (i * 7) % 360 - 180, (i % 179) - 89.5);
+		point = (LWPOINT*)lwgeom_from_wkt(wkt, LW_PARSER_CHECK_NONE);
+		lwmpoint_add_lwpoint((LWMPOINT*)mpoint, point);
+
+		pbox.flags = gflags(0, 0, 1);
+		lwgeom_calculate_gbox_geodetic((LWGEOM*)point, &pbox);
+		if ( i == 0 )
+			gbox_duplicate(&pbox, &expected);
+		else
+			gbox_merge(&pbox, &expected);
+	}
+
+	CU_ASSERT_EQUAL(lwgeom_calculate_gbox_geodetic(mpoint, &gbox), LW_SUCCESS);
+	CU_ASSERT_DOUBLE_EQUAL(gbox.xmin, expected.xmin, 0.0000001);
+	CU_ASSERT_DOUBLE_EQUAL(gbox.xmax, expected.xmax, 0.0000001);
+	CU_ASSERT_DOUBLE_EQUAL(gbox.ymin, expected.ymin, 0.0000001);
+	CU_ASSERT_DOUBLE_EQUAL(gbox.ymax, expected.ymax, 0.0000001);
+	CU_ASSERT_DOUBLE_EQUAL(gbox.zmin, expected.zmin, 0.0000001);
+	CU_ASSERT_DOUBLE_EQUAL(gbox.zmax, expected.zmax, 0.0000001);
+	lwgeom_free(mpoint);
+
+	/* Nothing to bound */
+	mpoint = lwgeom_from_wkt("MULTIPOINT EMPTY", LW_PARSER_CHECK_NONE);
+	CU_ASSERT_EQUAL(lwgeom_calculate_gbox_geodetic(mpoint, &gbox), LW_FAILURE);
+	lwgeom_free(mpoint);
+}
+
+static void test_circ_tree_new(void)
+{
+	LWGEOM *lwg;
+	CIRC_NODE *c;
+	GEOGRAPHIC_POINT g;
+
+	/* Single edge, circle centered on the mid-point */
+	lwg = lwgeom_from_wkt("LINESTRING(0 0, 0 10)", LW_PARSER_CHECK_NONE);
+	c = circ_tree_new(((LWLINE*)lwg)->points);
+	CU_ASSERT(c != NULL);
+	CU_ASSERT_EQUAL(c->num_nodes, 0);
+	CU_ASSERT_DOUBLE_EQUAL(c->radius, 5.0 * M_PI / 180.0, 0.000001);
+	CU_ASSERT_DOUBLE_EQUAL(c->center.lat, 5.0 * M_PI / 180.0, 0.000001);
+	CU_ASSERT_DOUBLE_EQUAL(c->center.lon, 0.0, 0.000001);
+	circ_tree_free(c);
+	lwgeom_free(lwg);
+
+	/* Zero length edges are dropped */
+	lwg = lwgeom_from_wkt("LINESTRING(0 0, 0 0, 0 0)", LW_PARSER_CHECK_NONE);
+	c = circ_tree_new(((LWLINE*)lwg)->points);
+	CU_ASSERT(c != NULL);
+	CU_ASSERT_EQUAL(c->num_nodes, 0);
+	CU_ASSERT_DOUBLE_EQUAL(c->radius, 0.0, 0.000001);
+	circ_tree_free(c);
+	lwgeom_free(lwg);
+
+	/* Two edges, the parent covers both */
+	lwg = lwgeom_from_wkt("LINESTRING(-10 0, 0 0, 10 0)", LW_PARSER_CHECK_NONE);
+	c = circ_tree_new(((LWLINE*)lwg)->points);
+	CU_ASSERT_EQUAL(c->num_nodes, 2);
+	CU_ASSERT_DOUBLE_EQUAL(c->radius, 10.0 * M_PI / 180.0, 0.000001);
+	CU_ASSERT_DOUBLE_EQUAL(c->center.lon, 0.0, 0.000001);
+	point_set(-10.0, 0.0, &g);
+	CU_ASSERT(sphere_distance(&(c->center), &g) <= c->radius + 0.000001);
+	circ_tree_free(c);
+	lwgeom_free(lwg);
+
+	/* Many edges, every vertex inside the root circle */
+	lwg = wiggly_line(-30.0, 10.0, 1000, 5.0);
+	c = lwgeom_calculate_circ_tree(lwg);
+	CU_ASSERT_EQUAL(c->geom_type, LINETYPE);
+	CU_ASSERT(c->num_nodes <= CIRC_NODE_SIZE);
+	point_set(-30.0, 10.0, &g);
+	CU_ASSERT(sphere_distance(&(c->center), &g) <= c->radius);
+	circ_tree_free(c);
+	lwgeom_free(lwg);
+
+	/* Empty */
+	lwg = lwgeom_from_wkt("POLYGON EMPTY", LW_PARSER_CHECK_NONE);
+	c = lwgeom_calculate_circ_tree(lwg);
+	CU_ASSERT(c == NULL);
+	lwgeom_free(lwg);
+}
+
+static void test_circ_tree_covers_point(void)
+{
+	const char *polys[] =
+	{
+		"POLYGON((1.0 1.0, 1.0 1.1, 1.1 1.1, 1.1 1.0, 1.0 1.0))",
+		"POLYGON((0 0, 0 2, 1 2, 0 3, 2 3, 0 4, 3 5, 0 6, 6 10, 6 1, 0 0))",
+		"POLYGON((-4 -4, -4 4, 4 4, 4 -4, -4 -4), (-2 -2, -2 2, 2 2, 2 -2, -2 -2))",
+		"POLYGON((-40.0 52.0, 102.0 -6.0, -67.0 -29.0, -40.0 52.0))",
+		"POLYGON((170 -5, 170 5, -170 5, -170 -5, 170 -5))"
+	};
+	LWGEOM *lwg;
+	CIRC_NODE *c;
+	POINT2D pt;
+	int i, x, y;
+
+	for ( i = 0; i < 5; i++ )
+	{
+		lwg = lwgeom_from_wkt(polys[i], LW_PARSER_CHECK_NONE);
+		c = lwgeom_calculate_circ_tree(lwg);
+		CU_ASSERT_EQUAL(c->geom_type, POLYGONTYPE);
+
+		/* Grid over the polygon, off the vertex lines */
+		for ( x = -20; x <= 20; x++ )
+		{
+			for ( y = -20; y <= 20; y++ )
+			{
+				pt.x = (i == 4 ? 180.0 : 0.0) + (x + 0.013) * (i == 0 ? 0.1 : (i == 3 ? 5.0 : 0.5));
+				pt.y = (y + 0.007) * (i == 0 ? 0.1 : (i == 3 ? 5.0 : 0.5));
+				if ( pt.x > 180.0 ) pt.x -= 360.0;
+				CU_ASSERT_EQUAL(circ_tree_covers_point(c, &pt), lwpoly_covers_point2d((LWPOLY*)lwg, &pt));
+			}
+		}
+		circ_tree_free(c);
+		lwgeom_free(lwg);
+	}
+
+	/* On the shell and on vertices is covered, on the hole is not */
+	lwg = lwgeom_from_wkt(polys[2], LW_PARSER_CHECK_NONE);
+	c = lwgeom_calculate_circ_tree(lwg);
+	pt.x = -4.0; pt.y = 0.0;
+	CU_ASSERT_EQUAL(circ_tree_covers_point(c, &pt), LW_TRUE);
+	pt.x = 4.0; pt.y = 4.0;
+	CU_ASSERT_EQUAL(circ_tree_covers_point(c, &pt), LW_TRUE);
+	pt.x = 2.0; pt.y = 0.0;
+	CU_ASSERT_EQUAL(circ_tree_covers_point(c, &pt), LW_FALSE);
+	pt.x = 0.0; pt.y = 0.0;
+	CU_ASSERT_EQUAL(circ_tree_covers_point(c, &pt), LW_FALSE);
+	pt.x = 3.0; pt.y = 0.0;
+	CU_ASSERT_EQUAL(circ_tree_covers_point(c, &pt), LW_TRUE);
+	circ_tree_free(c);
+	lwgeom_free(lwg);
+
+	/* Multipolygon covers a point of either part */
+	lwg = lwgeom_from_wkt("MULTIPOLYGON(((0 0, 0 1, 1 1, 1 0, 0 0)),((5 5, 5 6, 6 6, 6 5, 5 5)))", LW_PARSER_CHECK_NONE);
+	c = lwgeom_calculate_circ_tree(lwg);
+	pt.x = 5.5; pt.y = 5.5;
+	CU_ASSERT_EQUAL(circ_tree_covers_point(c, &pt), LW_TRUE);
+	pt.x = 0.5; pt.y = 0.5;
+	CU_ASSERT_EQUAL(circ_tree_covers_point(c, &pt), LW_TRUE);
+	pt.x = 3.0; pt.y = 3.0;
+	CU_ASSERT_EQUAL(circ_tree_covers_point(c, &pt), LW_FALSE);
+	circ_tree_free(c);
+	lwgeom_free(lwg);
+}
+
+static void test_circ_tree_distance_tree(void)
+{
+	const char *pairs[][2] =
+	{
+		{"LINESTRING(-30 10, -20 5, -10 3, 0 1)", "LINESTRING(-10 -5, -5 0, 5 0, 10 -5)"},
+		{"LINESTRING(-30 10, -20 5, -10 3, 0 1)", "LINESTRING(-10 -5, -5 20, 5 0, 10 -5)"},
+		{"POINT(-4 1)", "LINESTRING(-10 -5, -5 0, 5 0, 10 -5)"},
+		{"POINT(-4 1)", "POINT(-4 -1)"},
+		{"POLYGON((-4 1, -3 5, 1 2, 1.5 -5, -4 1))", "POINT(-1 -1)"},
+		{"POLYGON((-4 -4, -4 4, 4 4, 4 -4, -4 -4), (-2 -2, -2 2, 2 2, 2 -2, -2 -2))", "POINT(-1 -1)"},
+		{"POLYGON((-4 -4, -4 4, 4 4, 4 -4, -4 -4), (-2 -2, -2 2, 2 2, 2 -2, -2 -2))", "POINT(2 2)"},
+		{"POLYGON((0 0, 0 10, 10 10, 10 0, 0 0))", "LINESTRING(2 2, 3 3)"},
+		{"POLYGON((0 0, 0 10, 10 10, 10 0, 0 0))", "POLYGON((20 0, 20 10, 30 10, 30 0, 20 0))"},
+		{"MULTIPOINT(30 30, 5 5)", "POLYGON((0 0, 0 10, 10 10, 10 0, 0 0))"},
+		{"GEOMETRYCOLLECTION(POINT(30 30), LINESTRING(40 40, 50 50))", "MULTIPOLYGON(((0 0, 0 10, 10 10, 10 0, 0 0)),((60 60, 60 61, 61 61, 61 60, 60 60)))"}
+	};
+	LWGEOM *lwg1, *lwg2;
+	CIRC_NODE *c1, *c2;
+	SPHEROID s;
+	double d1, d2;
+	int i;
+
+	/* Init to WGS84 */
+	spheroid_init(&s, 6378137.0, 6356752.314245179498);
+
+	/* Small cases go through the brute force path in lwgeom_distance_spheroid */
+	for ( i = 0; i < 11; i++ )
+	{
+		lwg1 = lwgeom_from_wkt(pairs[i][0], LW_PARSER_CHECK_NONE);
+		lwg2 = lwgeom_from_wkt(pairs[i][1], LW_PARSER_CHECK_NONE);
+		c1 = lwgeom_calculate_circ_tree(lwg1);
+		c2 = lwgeom_calculate_circ_tree(lwg2);
+		d1 = lwgeom_distance_spheroid(lwg1, lwg2, &s, 0.0);
+		d2 = circ_tree_distance_tree(c1, c2, &s, 0.0);
+		CU_ASSERT_DOUBLE_EQUAL(d1, d2, 0.0001);
+		circ_tree_free(c1);
+		circ_tree_free(c2);
+		lwgeom_free(lwg1);
+		lwgeom_free(lwg2);
+	}
+
+	/* Force spherical */
+	s.a = s.b = s.radius;
+
+	/* Long lines, against the pairwise walk */
+	lwg1 = wiggly_line(-30.0, 10.0, 2000, 3.0);
+	lwg2 = wiggly_line(-25.0, 17.0, 1500, 3.0);
+	c1 = lwgeom_calculate_circ_tree(lwg1);
+	c2 = lwgeom_calculate_circ_tree(lwg2);
+	d1 = s.radius * brute_distance(((LWLINE*)lwg1)->points, ((LWLINE*)lwg2)->points);
+	d2 = circ_tree_distance_tree(c1, c2, &s, 0.0);
+	CU_ASSERT(d1 > 0.0);
+	CU_ASSERT_DOUBLE_EQUAL(d1, d2, 0.0001);
+	/* Stop at the threshold */
+	d2 = circ_tree_distance_tree(c1, c2, &s, 2.0 * d1);
+	CU_ASSERT(d2 < 2.0 * d1);
+	/* lwgeom_distance_spheroid uses the tree for these */
+	d2 = lwgeom_distance_spheroid(lwg1, lwg2, &s, 0.0);
+	CU_ASSERT_DOUBLE_EQUAL(d1, d2, 0.0001);
+	circ_tree_free(c1);
+	circ_tree_free(c2);
+	lwgeom_free(lwg2);
+
+	/* Crossing long lines */
+	lwg2 = wiggly_line(-25.0, 10.0, 1500, 3.0);
+	c1 = lwgeom_calculate_circ_tree(lwg1);
+	c2 = lwgeom_calculate_circ_tree(lwg2);
+	d2 = circ_tree_distance_tree(c1, c2, &s, 0.0);
+	CU_ASSERT_DOUBLE_EQUAL(d2, 0.0, 0.0001);
+	circ_tree_free(c1);
+	circ_tree_free(c2);
+	lwgeom_free(lwg1);
+	lwgeom_free(lwg2);
+}
+
 /*
 ** Used by test harness to register the tests in this file.
 */
@@ -973,6 +1260,10 @@ CU_TestInfo geodetic_tests[] =
 	PG_TEST(test_spheroid_area),
 	PG_TEST(test_lwpoly_covers_point2d),
 	PG_TEST(test_ptarray_point_in_ring),
+	PG_TEST(test_lwmpoint_calculate_gbox_geodetic),
+	PG_TEST(test_circ_tree_new),
+	PG_TEST(test_circ_tree_covers_point),
+	PG_TEST(test_circ_tree_distance_tree),
 	CU_TEST_INFO_NULL
 };
 CU_SuiteInfo geodetic_suite = {"Geodetic Suite",  NULL,  NULL, geodetic_tests};
@@ -221,6 +221,34 @@ static void test_lwgeom_calculate_gbox(void)
 	lwgeom_calculate_gbox_cartesian(g, &b);
 	CU_ASSERT(isnan(b.ymax));
 	lwgeom_free(g);	
+
+	/* Every ordinate lands in the right slot of the box */
+	g = lwgeom_from_wkt("LINESTRING(1 -2 3,-4 5 -6,7 8 9)", LW_PARSER_CHECK_NONE);
+	lwgeom_calculate_gbox_cartesian(g, &b);
+	CU_ASSERT_DOUBLE_EQUAL(b.xmin, -4.0, 0.0000001);
+	CU_ASSERT_DOUBLE_EQUAL(b.xmax, 7.0, 0.0000001);
+	CU_ASSERT_DOUBLE_EQUAL(b.ymin, -2.0, 0.0000001);
+	CU_ASSERT_DOUBLE_EQUAL(b.ymax, 8.0, 0.0000001);
+	CU_ASSERT_DOUBLE_EQUAL(b.zmin, -6.0, 0.0000001);
+	CU_ASSERT_DOUBLE_EQUAL(b.zmax, 9.0, 0.0000001);
+	lwgeom_free(g);
+
+	g = lwgeom_from_wkt("LINESTRINGM(1 -2 3,-4 5 -6,7 8 9)", LW_PARSER_CHECK_NONE);
+	lwgeom_calculate_gbox_cartesian(g, &b);
+	CU_ASSERT(! FLAGS_GET_Z(b.flags));
+	CU_ASSERT_DOUBLE_EQUAL(b.mmin, -6.0, 0.0000001);
+	CU_ASSERT_DOUBLE_EQUAL(b.mmax, 9.0, 0.0000001);
+	lwgeom_free(g);
+
+	g = lwgeom_from_wkt("LINESTRING(1 -2 3 -10,-4 5 -6 20,7 8 9 5)", LW_PARSER_CHECK_NONE);
+	lwgeom_calculate_gbox_cartesian(g, &b);
+	CU_ASSERT_DOUBLE_EQUAL(b.xmin, -4.0, 0.0000001);
+	CU_ASSERT_DOUBLE_EQUAL(b.ymax, 8.0, 0.0000001);
+	CU_ASSERT_DOUBLE_EQUAL(b.zmin, -6.0, 0.0000001);
+	CU_ASSERT_DOUBLE_EQUAL(b.zmax, 9.0, 0.0000001);
+	CU_ASSERT_DOUBLE_EQUAL(b.mmin, -10.0, 0.0000001);
+	CU_ASSERT_DOUBLE_EQUAL(b.mmax, 20.0, 0.0000001);
+	lwgeom_free(g);
 	
 }
 
@@ -242,6 +270,40 @@ static void test_gbox_serialized_size(void)
 
 
 
+static void test_gbox_get_sortable_hash(void)
+{
+	GBOX g1, g2, g3, g4;
+	uint64_t h1, h2, h3, h4;
+
+	g1.flags = g2.flags = g3.flags = g4.flags = 0;
+
+	/* Quadrants come in curve order: lower left, upper left, upper right, lower right */
+	g1.xmin = g1.xmax = -1.0; g1.ymin = g1.ymax = -1.0;
+	g2.xmin = g2.xmax = -1.0; g2.ymin = g2.ymax = 1.0;
+	g3.xmin = g3.xmax = 1.0; g3.ymin = g3.ymax = 1.0;
+	g4.xmin = g4.xmax = 1.0; g4.ymin = g4.ymax = -1.0;
+	h1 = gbox_get_sortable_hash(&g1);
+	h2 = gbox_get_sortable_hash(&g2);
+	h3 = gbox_get_sortable_hash(&g3);
+	h4 = gbox_get_sortable_hash(&g4);
+	CU_ASSERT(h1 < h2);
+	CU_ASSERT(h2 < h3);
+	CU_ASSERT(h3 < h4);
+
+	/* Only the center counts */
+	g2.xmin = 0.0; g2.xmax = 2.0; g2.ymin = 0.0; g2.ymax = 2.0;
+	CU_ASSERT_EQUAL(gbox_get_sortable_hash(&g2), h3);
+
+	/* Neighbours are closer on the curve than far away boxes */
+	g1.xmin = g1.xmax = 10.0; g1.ymin = g1.ymax = 10.0;
+	g2.xmin = g2.xmax = 10.001; g2.ymin = g2.ymax = 10.0;
+	g3.xmin = g3.xmax = 1000.0; g3.ymin = g3.ymax = 10.0;
+	h1 = gbox_get_sortable_hash(&g1);
+	h2 = gbox_get_sortable_hash(&g2);
+	h3 = gbox_get_sortable_hash(&g3);
+	CU_ASSERT((h1 > h2 ? h1 - h2 : h2 - h1) < (h1 > h3 ? h1 - h3 : h3 - h1));
+}
+
 static void test_lwgeom_from_gserialized(void)
 {
 	LWGEOM *geom;
@@ -307,6 +369,75 @@ static void test_lwgeom_from_gserialized(void)
 
 }
 
+static int gserialized_point_in_polygon_wkt(const char *wkt, double x, double y)
+{
+	LWGEOM *geom = lwgeom_from_wkt(wkt, LW_PARSER_CHECK_NONE);
+	GSERIALIZED *g;
+	POINT2D pt;
+	int result;
+
+	lwgeom_add_bbox(geom);
+	g = gserialized_from_lwgeom(geom, 0, 0);
+	pt.x = x;
+	pt.y = y;
+	result = gserialized_point_in_polygon(g, &pt);
+	lwgeom_free(geom);
+	lwfree(g);
+	return result;
+}
+
+static void test_gserialized_point_in_polygon(void)
+{
+	const char *poly = "POLYGON((0 0,0 10,10 10,10 0,0 0),(2 2,4 2,4 4,2 4,2 2))";
+	const char *polyz = "POLYGON((0 0 1,0 10 1,10 10 1,10 0 1,0 0 1),(2 2 1,4 2 1,4 4 1,2 4 1,2 2 1))";
+	const char *mpoly = "MULTIPOLYGON(((0 0,0 10,10 10,10 0,0 0),(2 2,4 2,4 4,2 4,2 2)),((20 0,20 10,30 10,20 0)),((2.5 2.5,2.5 3.5,3.5 3.5,3.5 2.5,2.5 2.5)))";
+	LWGEOM *geom;
+	GSERIALIZED *g;
+	POINT2D pt;
+
+	/* Inside, outside, on the shell, in the hole, on the hole */
+	CU_ASSERT_EQUAL(gserialized_point_in_polygon_wkt(poly, 5, 5), 1);
+	CU_ASSERT_EQUAL(gserialized_point_in_polygon_wkt(poly, 11, 5), -1);
+	CU_ASSERT_EQUAL(gserialized_point_in_polygon_wkt(poly, 0, 5), 0);
+	CU_ASSERT_EQUAL(gserialized_point_in_polygon_wkt(poly, 10, 10), 0);
+	CU_ASSERT_EQUAL(gserialized_point_in_polygon_wkt(poly, 3, 3), -1);
+	CU_ASSERT_EQUAL(gserialized_point_in_polygon_wkt(poly, 4, 3), 0);
+
+	/* Extra ordinates are skipped over */
+	CU_ASSERT_EQUAL(gserialized_point_in_polygon_wkt(polyz, 5, 5), 1);
+	CU_ASSERT_EQUAL(gserialized_point_in_polygon_wkt(polyz, 3, 3), -1);
+	CU_ASSERT_EQUAL(gserialized_point_in_polygon_wkt(polyz, 2, 3), 0);
+
+	/* Later polygons of a multipolygon are found past the earlier ones */
+	CU_ASSERT_EQUAL(gserialized_point_in_polygon_wkt(mpoly, 5, 5), 1);
+	CU_ASSERT_EQUAL(gserialized_point_in_polygon_wkt(mpoly, 25, 8), 1);
+	CU_ASSERT_EQUAL(gserialized_point_in_polygon_wkt(mpoly, 25, 2), -1);
+	CU_ASSERT_EQUAL(gserialized_point_in_polygon_wkt(mpoly, 3, 3), 1);
+	CU_ASSERT_EQUAL(gserialized_point_in_polygon_wkt(mpoly, 2.2, 2.2), -1);
+	CU_ASSERT_EQUAL(gserialized_point_in_polygon_wkt(mpoly, 20, 5), 0);
+
+	/* Points are read in place, empty points are refused */
+	geom = lwgeom_from_wkt("POINT(1.5 -2)", LW_PARSER_CHECK_NONE);
+	g = gserialized_from_lwgeom(geom, 0, 0);
+	CU_ASSERT_EQUAL(gserialized_peek_point_2d(g, &pt), LW_SUCCESS);
+	CU_ASSERT_DOUBLE_EQUAL(pt.x, 1.5, 0.0);
+	CU_ASSERT_DOUBLE_EQUAL(pt.y, -2, 0.0);
+	lwgeom_free(geom);
+	lwfree(g);
+
+	geom = lwgeom_from_wkt("POINT EMPTY", LW_PARSER_CHECK_NONE);
+	g = gserialized_from_lwgeom(geom, 0, 0);
+	CU_ASSERT_EQUAL(gserialized_peek_point_2d(g, &pt), LW_FAILURE);
+	lwgeom_free(geom);
+	lwfree(g);
+
+	geom = lwgeom_from_wkt("LINESTRING(0 0,1 1)", LW_PARSER_CHECK_NONE);
+	g = gserialized_from_lwgeom(geom, 0, 0);
+	CU_ASSERT_EQUAL(gserialized_peek_point_2d(g, &pt), LW_FAILURE);
+	lwgeom_free(geom);
+	lwfree(g);
+}
+
 static void test_geometry_type_from_string(void)
 {
 	int rv;
@@ -884,6 +1015,7 @@ CU_TestInfo libgeom_tests[] =
 	PG_TEST(test_gserialized_from_lwgeom_size),
 	PG_TEST(test_gbox_serialized_size),
 	PG_TEST(test_lwgeom_from_gserialized),
+	PG_TEST(test_gserialized_point_in_polygon),
 	PG_TEST(test_lwgeom_count_vertices),
 	PG_TEST(test_on_gser_lwgeom_count_vertices),
 	PG_TEST(test_geometry_type_from_string),
@@ -894,6 +1026,7 @@ CU_TestInfo libgeom_tests[] =
 	PG_TEST(test_lwgeom_clone),
 	PG_TEST(test_lwgeom_force_clockwise),
 	PG_TEST(test_lwgeom_calculate_gbox),
+	PG_TEST(test_gbox_get_sortable_hash),
 	PG_TEST(test_lwgeom_is_empty),
 	PG_TEST(test_lwgeom_same),
 	CU_TEST_INFO_NULL
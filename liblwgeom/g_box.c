@@ -12,6 +12,9 @@
 #include "liblwgeom_internal.h"
 #include "lwgeom_log.h"
 #include <stdlib.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 GBOX* gbox_new(uint8_t flags)
 {
@@ -399,10 +402,82 @@ static int lwcircle_calculate_gbox_cartesian(const POINT4D *p1, const POINT4D *p
 	return LW_SUCCESS;
 }
 
+/*
+* Minimum and maximum of every ordinate over npoints points of ndims
+* ordinates each, stored one after the other from d. With SSE2 the X/Y
+* pair (and the Z/M pair of 4D points) is reduced in a single register.
+* Comparisons are done accumulator first, like FP_MIN/FP_MAX.
+*/
+static void ptarray_minmax_ordinates(const double *d, int npoints, int ndims, double *min, double *max)
+{
+	const double *end = d + (size_t)npoints * ndims;
+#if defined(__SSE2__)
+	__m128d xy_min, xy_max, zm_min, zm_max, v;
+
+	xy_min = xy_max = _mm_loadu_pd(d);
+
+	if ( ndims == 2 )
+	{
+		for ( d += 2; d < end; d += 2 )
+		{
+			v = _mm_loadu_pd(d);
+			xy_min = _mm_min_pd(xy_min, v);
+			xy_max = _mm_max_pd(xy_max, v);
+		}
+	}
+	else if ( ndims == 3 )
+	{
+		zm_min = zm_max = _mm_load_sd(d + 2);
+		for ( d += 3; d < end; d += 3 )
+		{
+			v = _mm_loadu_pd(d);
+			xy_min = _mm_min_pd(xy_min, v);
+			xy_max = _mm_max_pd(xy_max, v);
+			v = _mm_load_sd(d + 2);
+			zm_min = _mm_min_sd(zm_min, v);
+			zm_max = _mm_max_sd(zm_max, v);
+		}
+		_mm_store_sd(min + 2, zm_min);
+		_mm_store_sd(max + 2, zm_max);
+	}
+	else
+	{
+		zm_min = zm_max = _mm_loadu_pd(d + 2);
+		for ( d += 4; d < end; d += 4 )
+		{
+			v = _mm_loadu_pd(d);
+			xy_min = _mm_min_pd(xy_min, v);
+			xy_max = _mm_max_pd(xy_max, v);
+			v = _mm_loadu_pd(d + 2);
+			zm_min = _mm_min_pd(zm_min, v);
+			zm_max = _mm_max_pd(zm_max, v);
+		}
+		_mm_storeu_pd(min + 2, zm_min);
+		_mm_storeu_pd(max + 2, zm_max);
+	}
+
+	_mm_storeu_pd(min, xy_min);
+	_mm_storeu_pd(max, xy_max);
+#else
+	int j;
+
+	for ( j = 0; j < ndims; j++ )
+		min[j] = max[j] = d[j];
+
+	for ( d += ndims; d < end; d += ndims )
+	{
+		for ( j = 0; j < ndims; j++ )
+		{
+			min[j] = FP_MIN(min[j], d[j]);
+			max[j] = FP_MAX(max[j], d[j]);
+		}
+	}
+#endif
+}
+
 int ptarray_calculate_gbox_cartesian(const POINTARRAY *pa, GBOX *gbox )
 {
-	int i;
-	POINT4D p;
+	double min[4], max[4];
 	int has_z, has_m;
 
 	if ( ! pa ) return LW_FAILURE;
@@ -414,31 +489,24 @@ int ptarray_calculate_gbox_cartesian(const POINTARRAY *pa, GBOX *gbox )
 	gbox->flags = gflags(has_z, has_m, 0);
 	LWDEBUGF(4, "ptarray_calculate_gbox Z: %d M: %d", has_z, has_m);
 
-	getPoint4d_p(pa, 0, &p);
-	gbox->xmin = gbox->xmax = p.x;
-	gbox->ymin = gbox->ymax = p.y;
+	/* Work straight on the serialized ordinates, no per-point copies */
+	ptarray_minmax_ordinates((const double*)getPoint_internal(pa, 0), pa->npoints,
+	                         FLAGS_NDIMS(pa->flags), min, max);
+
+	gbox->xmin = min[0];
+	gbox->xmax = max[0];
+	gbox->ymin = min[1];
+	gbox->ymax = max[1];
 	if ( has_z )
-		gbox->zmin = gbox->zmax = p.z;
+	{
+		gbox->zmin = min[2];
+		gbox->zmax = max[2];
+	}
 	if ( has_m )
-		gbox->mmin = gbox->mmax = p.m;
-
-	for ( i = 1 ; i < pa->npoints; i++ )
 	{
-		getPoint4d_p(pa, i, &p);
-		gbox->xmin = FP_MIN(gbox->xmin, p.x);
-		gbox->xmax = FP_MAX(gbox->xmax, p.x);
-		gbox->ymin = FP_MIN(gbox->ymin, p.y);
-		gbox->ymax = FP_MAX(gbox->ymax, p.y);
-		if ( has_z )
-		{
-			gbox->zmin = FP_MIN(gbox->zmin, p.z);
-			gbox->zmax = FP_MAX(gbox->zmax, p.z);
-		}
-		if ( has_m )
-		{
-			gbox->mmin = FP_MIN(gbox->mmin, p.m);
-			gbox->mmax = FP_MAX(gbox->mmax, p.m);
-		}
+		/* M is the last ordinate, after Z if there is one */
+		gbox->mmin = min[2 + has_z];
+		gbox->mmax = max[2 + has_z];
 	}
 	return LW_SUCCESS;
 }
@@ -569,6 +637,57 @@ int lwgeom_calculate_gbox_cartesian(const LWGEOM *lwgeom, GBOX *gbox)
 	return LW_FAILURE;
 }
 
+/**
+* Map a float onto an unsigned integer that sorts in the same order,
+* negative numbers included.
+*/
+static uint32_t float_to_sortable_uint32(float f)
+{
+	union { float f; uint32_t u; } v;
+	v.f = f;
+	/* Negatives count down from the middle, positives count up */
+	if ( v.u & 0x80000000 )
+		return ~v.u;
+	return v.u | 0x80000000;
+}
+
+/**
+* Distance along a Hilbert curve covering the full 32-bit grid of the
+* cell (x, y). Neighbours on the curve are neighbours on the grid.
+*/
+static uint64_t hilbert_xy2d(uint32_t x, uint32_t y)
+{
+	uint64_t d = 0;
+	uint32_t s, rx, ry, t;
+
+	for ( s = 0x80000000; s > 0; s >>= 1 )
+	{
+		rx = (x & s) ? 1 : 0;
+		ry = (y & s) ? 1 : 0;
+		d += (uint64_t)s * s * ((3 * rx) ^ ry);
+		/* Rotate the quadrant so the curve stays continuous */
+		if ( ry == 0 )
+		{
+			if ( rx == 1 )
+			{
+				x = ~x;
+				y = ~y;
+			}
+			t = x;
+			x = y;
+			y = t;
+		}
+	}
+	return d;
+}
+
+uint64_t gbox_get_sortable_hash(const GBOX *g)
+{
+	float x = (g->xmin + g->xmax) / 2.0;
+	float y = (g->ymin + g->ymax) / 2.0;
+	return hilbert_xy2d(float_to_sortable_uint32(x), float_to_sortable_uint32(y));
+}
+
 void gbox_float_round(GBOX *gbox)
 {
 	gbox->xmin = next_float_down(gbox->xmin);
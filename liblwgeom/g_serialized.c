@@ -266,6 +266,150 @@ int gserialized_get_gbox_p(const GSERIALIZED *geom, GBOX *box)
 }
 
 
+/***********************************************************************
+* Point in polygon directly on the serialization.
+*/
+
+/* Pointer to the first byte of geometry data, past the box if there is one */
+static uint8_t* gserialized_get_geometry_data(const GSERIALIZED *g)
+{
+	uint8_t *data_ptr = (uint8_t*)(g->data);
+	if ( FLAGS_GET_BBOX(g->flags) )
+		data_ptr += gbox_serialized_size(g->flags);
+	return data_ptr;
+}
+
+int gserialized_peek_point_2d(const GSERIALIZED *g, POINT2D *pt)
+{
+	uint8_t *data_ptr = gserialized_get_geometry_data(g);
+	double *dptr;
+
+	if ( lw_get_uint32_t(data_ptr) != POINTTYPE )
+		return LW_FAILURE;
+
+	/* Zero points => empty point */
+	if ( lw_get_uint32_t(data_ptr + 4) == 0 )
+		return LW_FAILURE;
+
+	dptr = (double*)(data_ptr + 8);
+	pt->x = dptr[0];
+	pt->y = dptr[1];
+	return LW_SUCCESS;
+}
+
+/*
+* Winding number of a ring of npoints vertices with ndims ordinates each.
+* Same rules as the point_in_ring() of the backend, so the answers do not
+* change when this path is taken.
+* Returns -1 outside, 0 on the ring and 1 inside.
+*/
+static int ring_contains_point_2d(const double *dptr, int ndims, uint32_t npoints, const POINT2D *pt)
+{
+	int wn = 0;
+	int on_segment;
+	uint32_t i;
+
+	for ( i = 0; i + 1 < npoints; i++ )
+	{
+		/* The x and y ordinates lead every vertex, whatever the dimensions */
+		const POINT2D *s1 = (const POINT2D*)(dptr + i * ndims);
+		const POINT2D *s2 = (const POINT2D*)(dptr + (i + 1) * ndims);
+
+		wn += lw_segment_winding(s1, s2, pt, &on_segment);
+		if ( on_segment )
+			return 0;
+	}
+
+	return wn == 0 ? -1 : 1;
+}
+
+/*
+* Locate the point against the polygon serialized at *data_ptr and
+* move *data_ptr past it.
+*/
+static int polygon_buffer_contains_point_2d(uint8_t **data_ptr, int ndims, const POINT2D *pt)
+{
+	uint8_t *ptr = *data_ptr;
+	uint32_t nrings, i;
+	uint8_t *npoints_ptr;
+	double *dptr;
+	int result = -1;
+	int done = LW_FALSE;
+
+	ptr += 4; /* Skip past the polygontype. */
+	nrings = lw_get_uint32_t(ptr);
+	ptr += 4;
+
+	npoints_ptr = ptr;
+	ptr += nrings * 4;
+	if ( nrings % 2 ) /* Padding */
+		ptr += 4;
+	dptr = (double*)ptr;
+
+	for ( i = 0; i < nrings; i++ )
+	{
+		uint32_t npoints = lw_get_uint32_t(npoints_ptr + 4 * i);
+
+		if ( ! done )
+		{
+			int in_ring = ring_contains_point_2d(dptr, ndims, npoints, pt);
+			if ( i == 0 )
+			{
+				/* Outside the shell or on it, no need to look at the holes */
+				result = in_ring;
+				done = (in_ring != 1);
+			}
+			else if ( in_ring == 1 )
+			{
+				/* Inside a hole */
+				result = -1;
+				done = LW_TRUE;
+			}
+			else if ( in_ring == 0 )
+			{
+				/* On the boundary of a hole */
+				result = 0;
+				done = LW_TRUE;
+			}
+		}
+		dptr += ndims * npoints;
+	}
+
+	*data_ptr = (uint8_t*)dptr;
+	return result;
+}
+
+int gserialized_point_in_polygon(const GSERIALIZED *g, const POINT2D *pt)
+{
+	uint8_t *data_ptr = gserialized_get_geometry_data(g);
+	int ndims = FLAGS_NDIMS(g->flags);
+	uint32_t type = lw_get_uint32_t(data_ptr);
+	uint32_t ngeoms, i;
+
+	if ( type == POLYGONTYPE )
+		return polygon_buffer_contains_point_2d(&data_ptr, ndims, pt);
+
+	if ( type != MULTIPOLYGONTYPE )
+	{
+		lwerror("gserialized_point_in_polygon: unsupported type %s", lwtype_name(type));
+		return -1;
+	}
+
+	ngeoms = lw_get_uint32_t(data_ptr + 4);
+	data_ptr += 8;
+
+	for ( i = 0; i < ngeoms; i++ )
+	{
+		/* First polygon the point is not outside of decides */
+		int in_poly = polygon_buffer_contains_point_2d(&data_ptr, ndims, pt);
+		if ( in_poly != -1 )
+			return in_poly;
+	}
+
+	return -1;
+}
+
+
 /***********************************************************************
 * Calculate the GSERIALIZED size for an LWGEOM.
 */
@@ -205,6 +205,12 @@ int lw_segment_intersects(const POINT2D *p1, const POINT2D *p2, const POINT2D *q
 */
 double lw_segment_side(const POINT2D *p1, const POINT2D *p2, const POINT2D *q);
 
+/*
+* Winding number contribution of segment p1-p2 for point q, flagging
+* the case where q is on the segment.
+*/
+int lw_segment_winding(const POINT2D *p1, const POINT2D *p2, const POINT2D *q, int *on_segment);
+
 /* 
 * Do the envelopes of the the segments intersect?
 */
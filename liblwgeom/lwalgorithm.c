@@ -40,6 +40,45 @@ double lw_segment_side(const POINT2D *p1, const POINT2D *p2, const POINT2D *q)
 		return side;
 }
 
+/**
+** lw_segment_winding()
+**
+** Contribution of segment P to the winding number of point Q, with the
+** rules of the backend point_in_ring(): 1 for a rising segment with Q on
+** its left, -1 for a falling segment with Q on its right, 0 otherwise.
+** Zero length segments are ignored. Sets *on_segment when Q is on P.
+*/
+int lw_segment_winding(const POINT2D *p1, const POINT2D *p2, const POINT2D *q, int *on_segment)
+{
+	double side;
+
+	*on_segment = LW_FALSE;
+
+	/* Zero length segments are ignored. */
+	if ( ((p2->x-p1->x)*(p2->x-p1->x) + (p2->y-p1->y)*(p2->y-p1->y)) < 1e-12*1e-12 )
+		return 0;
+
+	side = (p2->x-p1->x)*(q->y-p1->y) - (q->x-p1->x)*(p2->y-p1->y);
+
+	/* On the line of the segment and inside its extent */
+	if ( side == 0.0 &&
+	     q->x >= FP_MIN(p1->x, p2->x) && q->x <= FP_MAX(p1->x, p2->x) &&
+	     q->y >= FP_MIN(p1->y, p2->y) && q->y <= FP_MAX(p1->y, p2->y) )
+	{
+		*on_segment = LW_TRUE;
+		return 0;
+	}
+
+	/* Rising edge with Q on the left */
+	if ( FP_CONTAINS_BOTTOM(p1->y, q->y, p2->y) && side > 0 )
+		return 1;
+	/* Falling edge with Q on the right */
+	if ( FP_CONTAINS_BOTTOM(p2->y, q->y, p1->y) && side < 0 )
+		return -1;
+
+	return 0;
+}
+
 
 int lw_segment_envelope_intersects(const POINT2D *p1, const POINT2D *p2, const POINT2D *q1, const POINT2D *q2)
 {
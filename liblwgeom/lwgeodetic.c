@@ -11,6 +11,7 @@
  **********************************************************************/
 
 #include "lwgeodetic.h"
+#include "lwgeodetic_tree.h"
 #include "lwgeom_log.h"
 
 /**
@@ -248,7 +249,7 @@ void cart2geog(const POINT3D *p, GEOGRAPHIC_POINT *g)
 * Calculate the dot product of two unit vectors
 * (-1 == opposite, 0 == orthogonal, 1 == identical)
 */
-static double dot_product(const POINT3D *p1, const POINT3D *p2)
+double dot_product(const POINT3D *p1, const POINT3D *p2)
 {
 	return (p1->x*p2->x) + (p1->y*p2->y) + (p1->z*p2->z);
 }
@@ -267,7 +268,7 @@ static void cross_product(const POINT3D *a, const POINT3D *b, POINT3D *n)
 /**
 * Calculate the sum of two vectors
 */
-static void vector_sum(const POINT3D *a, const POINT3D *b, POINT3D *n)
+void vector_sum(const POINT3D *a, const POINT3D *b, POINT3D *n)
 {
 	n->x = a->x + b->x;
 	n->y = a->y + b->y;
@@ -289,7 +290,7 @@ static void vector_difference(const POINT3D *a, const POINT3D *b, POINT3D *n)
 /**
 * Scale a vector out by a factor
 */
-static void vector_scale(POINT3D *n, double scale)
+void vector_scale(POINT3D *n, double scale)
 {
 	n->x *= scale;
 	n->y *= scale;
@@ -300,7 +301,7 @@ static void vector_scale(POINT3D *n, double scale)
 /**
 * Normalize to a unit vector.
 */
-static void normalize(POINT3D *p)
+void normalize(POINT3D *p)
 {
 	double d = sqrt(p->x*p->x + p->y*p->y + p->z*p->z);
 	if (FP_IS_ZERO(d))
@@ -1882,6 +1883,18 @@ double lwgeom_azumith_spheroid(const LWPOINT *r, const LWPOINT *s, const SPHEROI
 	return spheroid_direction(&g1, &g2, spheroid);
 }
 
+/**
+* Edge trees pay off when the number of edge pairs to compare clearly
+* outweighs the number of edges to index. A point against a long line
+* is better served by a single walk of the line.
+*/
+static int lwgeom_distance_spheroid_use_tree(const LWGEOM *lwgeom1, const LWGEOM *lwgeom2)
+{
+	double n1 = lwgeom_count_vertices(lwgeom1);
+	double n2 = lwgeom_count_vertices(lwgeom2);
+	return n1 * n2 > 4.0 * (n1 + n2);
+}
+
 /**
 * Calculate the distance between two LWGEOMs, using the coordinates are
 * longitude and latitude. Return immediately when the calulated distance drops
@@ -1909,6 +1922,18 @@ double lwgeom_distance_spheroid(const LWGEOM *lwgeom1, const LWGEOM *lwgeom2, co
 		return -1.0;
 	}
 
+	/* Index both sides and search the trees instead of every edge pair */
+	if ( lwgeom_distance_spheroid_use_tree(lwgeom1, lwgeom2) )
+	{
+		double distance;
+		CIRC_NODE *tree1 = lwgeom_calculate_circ_tree(lwgeom1);
+		CIRC_NODE *tree2 = lwgeom_calculate_circ_tree(lwgeom2);
+		distance = circ_tree_distance_tree(tree1, tree2, spheroid, tolerance);
+		circ_tree_free(tree1);
+		circ_tree_free(tree2);
+		return distance;
+	}
+
 	type1 = lwgeom1->type;
 	type2 = lwgeom2->type;
 
@@ -2151,6 +2176,28 @@ int lwgeom_covers_lwgeom_sphere(const LWGEOM *lwgeom1, const LWGEOM *lwgeom2)
 		return lwpoly_covers_point2d((LWPOLY*)lwgeom1, &pt_to_test);
 	}
 
+	/* Many points against one polygon, index the polygon edges once */
+	if ( type1 == POLYGONTYPE && type2 == MULTIPOINTTYPE && ((LWMPOINT*)lwgeom2)->ngeoms > 1 )
+	{
+		int i;
+		int result = LW_TRUE;
+		POINT2D pt_to_test;
+		LWMPOINT *mpoint = (LWMPOINT*)lwgeom2;
+		CIRC_NODE *tree = lwgeom_calculate_circ_tree(lwgeom1);
+
+		for ( i = 0; i < mpoint->ngeoms; i++ )
+		{
+			getPoint2d_p(mpoint->geoms[i]->point, 0, &pt_to_test);
+			if ( ! circ_tree_covers_point(tree, &pt_to_test) )
+			{
+				result = LW_FALSE;
+				break;
+			}
+		}
+		circ_tree_free(tree);
+		return result;
+	}
+
 	/* If any of the first argument parts covers the second argument, it's true */
 	if ( lwtype_is_collection( type1 ) )
 	{
@@ -2313,10 +2360,13 @@ int ptarray_calculate_gbox_geodetic(const POINTARRAY *pa, GBOX *gbox)
 		return LW_SUCCESS;
 	}
 
+	getPoint2d_p(pa, 0, &start_pt);
+	geographic_point_init(start_pt.x, start_pt.y, &(edge.end));
+
 	for ( i = 1; i < pa->npoints; i++ )
 	{
-		getPoint2d_p(pa, i-1, &start_pt);
-		geographic_point_init(start_pt.x, start_pt.y, &(edge.start));
+		/* The end of the last edge is the start of this one */
+		edge.start = edge.end;
 
 		getPoint2d_p(pa, i, &end_pt);
 		geographic_point_init(end_pt.x, end_pt.y, &(edge.end));
@@ -2351,6 +2401,85 @@ static int lwpoint_calculate_gbox_geodetic(const LWPOINT *point, GBOX *gbox)
 	return ptarray_calculate_gbox_geodetic(point->point, gbox);
 }
 
+/* Number of vertices converted to the unit sphere in one go */
+#define GEODETIC_BATCH_SIZE 256
+
+/*
+* Expand a geocentric box with a batch of lon/lat vertices (in radians).
+* The conversion to the unit sphere is geog2cart() unrolled over flat
+* arrays, so the loop has no calls or branches besides the trigonometry.
+*/
+static void geodetic_batch_gbox(const double *lon, const double *lat, int n, GBOX *gbox, int *first)
+{
+	double x[GEODETIC_BATCH_SIZE], y[GEODETIC_BATCH_SIZE], z[GEODETIC_BATCH_SIZE];
+	int j;
+
+	for ( j = 0; j < n; j++ )
+	{
+		double coslat = cos(lat[j]);
+		x[j] = coslat * cos(lon[j]);
+		y[j] = coslat * sin(lon[j]);
+		z[j] = sin(lat[j]);
+	}
+
+	j = 0;
+	if ( *first && n > 0 )
+	{
+		gbox->xmin = gbox->xmax = x[0];
+		gbox->ymin = gbox->ymax = y[0];
+		gbox->zmin = gbox->zmax = z[0];
+		*first = LW_FALSE;
+		j = 1;
+	}
+
+	for ( ; j < n; j++ )
+	{
+		gbox->xmin = FP_MIN(gbox->xmin, x[j]);
+		gbox->xmax = FP_MAX(gbox->xmax, x[j]);
+		gbox->ymin = FP_MIN(gbox->ymin, y[j]);
+		gbox->ymax = FP_MAX(gbox->ymax, y[j]);
+		gbox->zmin = FP_MIN(gbox->zmin, z[j]);
+		gbox->zmax = FP_MAX(gbox->zmax, z[j]);
+	}
+}
+
+/*
+* Multipoints have no edges, so the box is just the extent of the vertices
+* on the sphere. Skip the per-point boxes of the generic collection path
+* (points do not need them) and convert the vertices in batches.
+*/
+static int lwmpoint_calculate_gbox_geodetic(const LWMPOINT *mpoint, GBOX *gbox)
+{
+	double lon[GEODETIC_BATCH_SIZE], lat[GEODETIC_BATCH_SIZE];
+	GEOGRAPHIC_POINT gp;
+	int first = LW_TRUE;
+	int i, n = 0;
+	assert(mpoint);
+
+	for ( i = 0; i < mpoint->ngeoms; i++ )
+	{
+		const POINTARRAY *pa = mpoint->geoms[i]->point;
+		const POINT2D *pt;
+
+		if ( ! pa || pa->npoints < 1 )
+			continue;
+
+		pt = (const POINT2D*)getPoint_internal(pa, 0);
+		geographic_point_init(pt->x, pt->y, &gp);
+		lon[n] = gp.lon;
+		lat[n] = gp.lat;
+
+		if ( ++n == GEODETIC_BATCH_SIZE )
+		{
+			geodetic_batch_gbox(lon, lat, n, gbox, &first);
+			n = 0;
+		}
+	}
+	geodetic_batch_gbox(lon, lat, n, gbox, &first);
+
+	return first ? LW_FAILURE : LW_SUCCESS;
+}
+
 static int lwline_calculate_gbox_geodetic(const LWLINE *line, GBOX *gbox)
 {
 	assert(line);
@@ -2452,6 +2581,8 @@ int lwgeom_calculate_gbox_geodetic(const LWGEOM *geom, GBOX *gbox)
 		result = lwtriangle_calculate_gbox_geodetic((LWTRIANGLE *)geom, gbox);
 		break;
 	case MULTIPOINTTYPE:
+		result = lwmpoint_calculate_gbox_geodetic((LWMPOINT *)geom, gbox);
+		break;
 	case MULTILINETYPE:
 	case MULTIPOLYGONTYPE:
 	case POLYHEDRALSURFACETYPE:
@@ -9,10 +9,15 @@
  *
  **********************************************************************/
 
+#ifndef _LWGEODETIC_H
+#define _LWGEODETIC_H 1
+
 #include "liblwgeom_internal.h"
 
 /* For NAN */
+#ifndef _GNU_SOURCE
 #define _GNU_SOURCE
+#endif
 #include <math.h>
 
 #ifndef NAN
@@ -66,6 +71,10 @@ typedef struct
 */
 void geog2cart(const GEOGRAPHIC_POINT *g, POINT3D *p);
 void cart2geog(const POINT3D *p, GEOGRAPHIC_POINT *g);
+double dot_product(const POINT3D *p1, const POINT3D *p2);
+void vector_sum(const POINT3D *a, const POINT3D *b, POINT3D *n);
+void vector_scale(POINT3D *n, double scale);
+void normalize(POINT3D *p);
 void robust_cross_product(const GEOGRAPHIC_POINT *p, const GEOGRAPHIC_POINT *q, POINT3D *a);
 void x_to_z(POINT3D *p);
 void y_to_z(POINT3D *p);
@@ -104,3 +113,5 @@ double latitude_radians_normalize(double lat);
 double spheroid_distance(const GEOGRAPHIC_POINT *a, const GEOGRAPHIC_POINT *b, const SPHEROID *spheroid);
 double spheroid_direction(const GEOGRAPHIC_POINT *r, const GEOGRAPHIC_POINT *s, const SPHEROID *spheroid);
 int spheroid_project(const GEOGRAPHIC_POINT *r, const SPHEROID *spheroid, double distance, double azimuth, GEOGRAPHIC_POINT *g);
+
+#endif /* _LWGEODETIC_H */
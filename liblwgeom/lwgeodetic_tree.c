@@ -0,0 +1,739 @@
+/**********************************************************************
+ * $Id$
+ *
+ * PostGIS - Spatial Types for PostgreSQL
+ * http://postgis.refractions.net
+ *
+ * This is free software; you can redistribute and/or modify it under
+ * the terms of the GNU General Public Licence. See the COPYING file.
+ *
+ **********************************************************************/
+
+#include <stdlib.h>
+
+#include "liblwgeom_internal.h"
+#include "lwgeom_log.h"
+#include "lwgeodetic_tree.h"
+
+
+/**
+* Internal nodes have their point references set to NULL.
+*/
+static int circ_node_is_leaf(const CIRC_NODE *node)
+{
+	return (node->p1 != NULL);
+}
+
+/**
+* Point nodes are leaves with both point references on the same vertex.
+*/
+static int circ_node_is_point(const CIRC_NODE *node)
+{
+	return (node->p1 != NULL && node->p1 == node->p2);
+}
+
+/**
+* Geometry components are the nodes carrying a non-collection type, and the
+* roots of plain point array trees, which carry no type at all.
+*/
+static int circ_node_is_component(const CIRC_NODE *node)
+{
+	return ! lwtype_is_collection(node->geom_type);
+}
+
+/**
+* Recurse from top of node tree and free all children.
+* does not free underlying point array.
+*/
+void circ_tree_free(CIRC_NODE *node)
+{
+	int i;
+	if ( ! node )
+		return;
+
+	for ( i = 0; i < node->num_nodes; i++ )
+		circ_tree_free(node->nodes[i]);
+
+	if ( node->nodes )
+		lwfree(node->nodes);
+	lwfree(node);
+}
+
+/**
+* Create a new leaf node covering a single vertex, with a zero radius.
+*/
+static CIRC_NODE* circ_node_point_new(const POINTARRAY *pa, int i)
+{
+	POINT2D *p;
+	CIRC_NODE *node;
+
+	p = (POINT2D*)getPoint_internal(pa, i);
+
+	node = lwalloc(sizeof(CIRC_NODE));
+	geographic_point_init(p->x, p->y, &(node->center));
+	node->radius = 0.0;
+	node->num_nodes = 0;
+	node->nodes = NULL;
+	node->geom_type = 0;
+	node->pa = NULL;
+	node->p1 = p;
+	node->p2 = p;
+	return node;
+}
+
+/**
+* Create a new leaf node, with a bounding circle centered on the middle of
+* the edge and storing pointers back to the end points for later.
+*/
+CIRC_NODE* circ_node_leaf_new(const POINTARRAY *pa, int i)
+{
+	POINT2D *p1, *p2;
+	POINT3D q1, q2, c;
+	GEOGRAPHIC_POINT g1, g2;
+	CIRC_NODE *node;
+
+	p1 = (POINT2D*)getPoint_internal(pa, i);
+	p2 = (POINT2D*)getPoint_internal(pa, i+1);
+
+	/* Zero length edge, doesn't get a node */
+	if ( FP_EQUALS(p1->x, p2->x) && FP_EQUALS(p1->y, p2->y) )
+		return NULL;
+
+	geographic_point_init(p1->x, p1->y, &g1);
+	geographic_point_init(p2->x, p2->y, &g2);
+
+	node = lwalloc(sizeof(CIRC_NODE));
+	node->p1 = p1;
+	node->p2 = p2;
+	node->num_nodes = 0;
+	node->nodes = NULL;
+	node->geom_type = 0;
+	node->pa = NULL;
+
+	/* The mid-point of the arc is the center of the smallest circle around it */
+	geog2cart(&g1, &q1);
+	geog2cart(&g2, &q2);
+	vector_sum(&q1, &q2, &c);
+	normalize(&c);
+
+	/* Antipodal end points have no defined mid-point, use a start-centered circle */
+	if ( FP_IS_ZERO(c.x) && FP_IS_ZERO(c.y) && FP_IS_ZERO(c.z) )
+	{
+		node->center = g1;
+		node->radius = sphere_distance(&g1, &g2);
+	}
+	else
+	{
+		cart2geog(&c, &(node->center));
+		node->radius = FP_MAX(sphere_distance(&(node->center), &g1), sphere_distance(&(node->center), &g2));
+	}
+	return node;
+}
+
+/**
+* Grow the circle (center, radius) to also cover the circle of node c.
+* The merged circle is centered on the great circle joining the two
+* centers, so it is tight for two circles, but not necessarily minimal
+* for longer sequences.
+*/
+static void circ_node_merge(GEOGRAPHIC_POINT *center, double *radius, const CIRC_NODE *c)
+{
+	double d, r, t, sin_d;
+	POINT3D p1, p2, p;
+
+	d = sphere_distance(center, &(c->center));
+
+	/* One circle already inside the other? */
+	if ( d + c->radius <= *radius )
+		return;
+	if ( d + *radius <= c->radius )
+	{
+		*center = c->center;
+		*radius = c->radius;
+		return;
+	}
+
+	r = (*radius + c->radius + d) / 2.0;
+	sin_d = sin(d);
+
+	/* Covering the whole sphere, or no great circle to move along */
+	if ( r >= M_PI || FP_IS_ZERO(sin_d) )
+	{
+		*radius = M_PI;
+		return;
+	}
+
+	/* Slide the center towards c by the growth in radius */
+	t = r - *radius;
+	geog2cart(center, &p1);
+	geog2cart(&(c->center), &p2);
+	vector_scale(&p1, sin(d - t) / sin_d);
+	vector_scale(&p2, sin(t) / sin_d);
+	vector_sum(&p1, &p2, &p);
+	normalize(&p);
+	cart2geog(&p, center);
+	*radius = r;
+}
+
+/**
+* Create a new internal node, calculating a bounding circle that covers
+* all the children, and storing pointers to the child nodes.
+*/
+CIRC_NODE* circ_node_internal_new(CIRC_NODE **c, int num_nodes)
+{
+	int i;
+	CIRC_NODE *node = lwalloc(sizeof(CIRC_NODE));
+
+	node->center = c[0]->center;
+	node->radius = c[0]->radius;
+	for ( i = 1; i < num_nodes; i++ )
+		circ_node_merge(&(node->center), &(node->radius), c[i]);
+
+	node->num_nodes = num_nodes;
+	node->nodes = lwalloc(sizeof(CIRC_NODE*) * num_nodes);
+	memcpy(node->nodes, c, sizeof(CIRC_NODE*) * num_nodes);
+	node->geom_type = 0;
+	node->pa = NULL;
+	node->p1 = NULL;
+	node->p2 = NULL;
+	return node;
+}
+
+/**
+* Group a list of nodes into parents of up to CIRC_NODE_SIZE children,
+* level after level, until there is only one node at the top. New
+* parents are stamped with geom_type. The list is over-written.
+*/
+static CIRC_NODE* circ_nodes_merge(CIRC_NODE **nodes, int num_nodes, int geom_type)
+{
+	int i, n, num_parents;
+
+	while ( num_nodes > 1 )
+	{
+		num_parents = 0;
+		for ( i = 0; i < num_nodes; i += CIRC_NODE_SIZE )
+		{
+			n = num_nodes - i;
+			if ( n > CIRC_NODE_SIZE )
+				n = CIRC_NODE_SIZE;
+
+			/* Odd node out gets copied up a level */
+			if ( n == 1 )
+			{
+				nodes[num_parents++] = nodes[i];
+			}
+			else
+			{
+				nodes[num_parents] = circ_node_internal_new(nodes + i, n);
+				nodes[num_parents]->geom_type = geom_type;
+				num_parents++;
+			}
+		}
+		num_nodes = num_parents;
+	}
+	return nodes[0];
+}
+
+/**
+* Build a tree of nodes from a point array, one node per edge. Like
+* rect_tree_new(), we rely on point arrays having a reasonable spatial
+* ordering already and group consecutive edges without sorting.
+*/
+CIRC_NODE* circ_tree_new(const POINTARRAY *pa)
+{
+	int num_edges;
+	int i, j;
+	CIRC_NODE **nodes;
+	CIRC_NODE *node;
+	CIRC_NODE *tree;
+
+	if ( ! pa || pa->npoints < 1 )
+		return NULL;
+
+	/* Single vertex, single node */
+	if ( pa->npoints == 1 )
+	{
+		tree = circ_node_point_new(pa, 0);
+		tree->pa = pa;
+		return tree;
+	}
+
+	num_edges = pa->npoints - 1;
+	nodes = lwalloc(sizeof(CIRC_NODE*) * num_edges);
+	j = 0;
+	for ( i = 0; i < num_edges; i++ )
+	{
+		node = circ_node_leaf_new(pa, i);
+		if ( node ) /* Not zero length? */
+			nodes[j++] = node;
+	}
+
+	/* All the edges collapsed, so it's really a point */
+	if ( j == 0 )
+		tree = circ_node_point_new(pa, 0);
+	else
+		tree = circ_nodes_merge(nodes, j, 0);
+
+	lwfree(nodes);
+	tree->pa = pa;
+	return tree;
+}
+
+/**
+* Polygon nodes hold one child per ring, shell first, and an outside
+* point calculated from the geodetic box for stab-line tests.
+*/
+static CIRC_NODE* lwpoly_calculate_circ_tree(const LWPOLY *lwpoly)
+{
+	int i, j = 0;
+	CIRC_NODE **nodes;
+	CIRC_NODE *node;
+	GBOX gbox;
+
+	if ( lwpoly->nrings < 1 )
+		return NULL;
+
+	nodes = lwalloc(sizeof(CIRC_NODE*) * lwpoly->nrings);
+	for ( i = 0; i < lwpoly->nrings; i++ )
+	{
+		node = circ_tree_new(lwpoly->rings[i]);
+		if ( node )
+			nodes[j++] = node;
+	}
+
+	if ( j == 0 )
+	{
+		lwfree(nodes);
+		return NULL;
+	}
+
+	node = circ_node_internal_new(nodes, j);
+	lwfree(nodes);
+
+	gbox.flags = 0;
+	if ( lwpoly->bbox )
+		gbox = *(lwpoly->bbox);
+	else
+		lwgeom_calculate_gbox_geodetic((LWGEOM*)lwpoly, &gbox);
+	gbox_pt_outside(&gbox, &(node->pt_outside));
+
+	return node;
+}
+
+static CIRC_NODE* lwcollection_calculate_circ_tree(const LWCOLLECTION *lwcol)
+{
+	int i, j = 0;
+	CIRC_NODE **nodes;
+	CIRC_NODE *node;
+
+	if ( lwcol->ngeoms < 1 )
+		return NULL;
+
+	nodes = lwalloc(sizeof(CIRC_NODE*) * lwcol->ngeoms);
+	for ( i = 0; i < lwcol->ngeoms; i++ )
+	{
+		node = lwgeom_calculate_circ_tree(lwcol->geoms[i]);
+		if ( node )
+			nodes[j++] = node;
+	}
+
+	if ( j == 0 )
+		node = NULL;
+	/* Keep the component node intact, the collection gets its own */
+	else if ( j == 1 )
+		node = circ_node_internal_new(nodes, 1);
+	else
+		node = circ_nodes_merge(nodes, j, lwcol->type);
+
+	lwfree(nodes);
+	return node;
+}
+
+/**
+* Build a tree for a whole geometry. Components (points, lines and
+* polygons) are tagged with their type so that polygon containment can be
+* taken into account by the distance and covers calculations.
+* Returns NULL for empty geometries.
+*/
+CIRC_NODE* lwgeom_calculate_circ_tree(const LWGEOM *lwgeom)
+{
+	CIRC_NODE *node = NULL;
+
+	if ( ! lwgeom || lwgeom_is_empty(lwgeom) )
+		return NULL;
+
+	switch ( lwgeom->type )
+	{
+	case POINTTYPE:
+		node = circ_tree_new(((LWPOINT*)lwgeom)->point);
+		break;
+	case LINETYPE:
+		node = circ_tree_new(((LWLINE*)lwgeom)->points);
+		break;
+	case POLYGONTYPE:
+		node = lwpoly_calculate_circ_tree((LWPOLY*)lwgeom);
+		break;
+	case MULTIPOINTTYPE:
+	case MULTILINETYPE:
+	case MULTIPOLYGONTYPE:
+	case COLLECTIONTYPE:
+		node = lwcollection_calculate_circ_tree((LWCOLLECTION*)lwgeom);
+		break;
+	default:
+		lwerror("lwgeom_calculate_circ_tree: unsupported geometry type (%s)", lwtype_name(lwgeom->type));
+		return NULL;
+	}
+
+	if ( node )
+		node->geom_type = lwgeom->type;
+	return node;
+}
+
+/**
+* Count the crossings of the stab line with the edges under node, walking
+* only the nodes whose circle reaches the line. Sets on_boundary if the
+* start of the stab line is on an edge, and degenerate if a vertex is on
+* the stab line, in which case the count can't be trusted.
+*/
+static int circ_tree_stab_crossings(const CIRC_NODE *node, const GEOGRAPHIC_EDGE *stab, int *on_boundary, int *degenerate)
+{
+	GEOGRAPHIC_EDGE e;
+	GEOGRAPHIC_POINT g;
+	int i, c = 0;
+
+	if ( *on_boundary || *degenerate )
+		return 0;
+
+	/* Circle doesn't reach the stab line, nothing to cross here */
+	if ( edge_distance_to_point(stab, &(node->center), NULL) > node->radius + FP_TOLERANCE )
+		return 0;
+
+	if ( ! circ_node_is_leaf(node) )
+	{
+		for ( i = 0; i < node->num_nodes; i++ )
+			c += circ_tree_stab_crossings(node->nodes[i], stab, on_boundary, degenerate);
+		return c;
+	}
+
+	if ( circ_node_is_point(node) )
+		return 0;
+
+	geographic_point_init(node->p1->x, node->p1->y, &(e.start));
+	geographic_point_init(node->p2->x, node->p2->y, &(e.end));
+
+	/* Our test point is on an edge! */
+	if ( geographic_point_equals(&(stab->start), &(e.start)) ||
+	     geographic_point_equals(&(stab->start), &(e.end)) ||
+	     edge_contains_point(&e, &(stab->start)) )
+	{
+		*on_boundary = LW_TRUE;
+		return 0;
+	}
+
+	/* Vertex on the stab line, crossings can be counted twice or not at all */
+	if ( edge_contains_point(stab, &(e.start)) || edge_contains_point(stab, &(e.end)) )
+	{
+		*degenerate = LW_TRUE;
+		return 0;
+	}
+
+	return edge_intersection(&e, stab, &g) ? 1 : 0;
+}
+
+/**
+* Tree version of ptarray_point_in_ring(), for a tree built with
+* circ_tree_new() on a ring. Returns LW_TRUE if the stabline joining
+* pt_outside and pt crosses the ring an odd number of times, or if pt is
+* on the ring boundary itself, returning LW_FALSE otherwise.
+*/
+int circ_tree_contains_point(const CIRC_NODE *node, const POINT2D *pt, const POINT2D *pt_outside)
+{
+	GEOGRAPHIC_EDGE stab;
+	int on_boundary = LW_FALSE;
+	int degenerate = LW_FALSE;
+	int crossings;
+
+	/* Not enough points for a ring? You ain't closed! */
+	if ( ! node || ! node->pa || node->pa->npoints < 4 )
+		return LW_FALSE;
+
+	geographic_point_init(pt->x, pt->y, &(stab.start));
+	geographic_point_init(pt_outside->x, pt_outside->y, &(stab.end));
+
+	crossings = circ_tree_stab_crossings(node, &stab, &on_boundary, &degenerate);
+
+	if ( on_boundary )
+		return LW_TRUE;
+
+	/* Let the linear walk sort out the vertices on the stab line */
+	if ( degenerate )
+	{
+		LWDEBUG(4, "vertex on stab line, falling back to ptarray_point_in_ring");
+		return ptarray_point_in_ring(node->pa, pt_outside, pt);
+	}
+
+	return (crossings % 2) ? LW_TRUE : LW_FALSE;
+}
+
+/**
+* Returns LW_TRUE if any polygon in the tree covers the point, with the
+* same boundary rules as lwpoly_covers_point2d(): on the shell is in, on
+* a hole is out.
+*/
+int circ_tree_covers_point(const CIRC_NODE *node, const POINT2D *pt)
+{
+	int i;
+	int in_hole_count = 0;
+
+	if ( ! node )
+		return LW_FALSE;
+
+	if ( node->geom_type == POLYGONTYPE )
+	{
+		/* Not in outer ring? We're done! */
+		if ( ! circ_tree_contains_point(node->nodes[0], pt, &(node->pt_outside)) )
+			return LW_FALSE;
+
+		/* But maybe point is in a hole... */
+		for ( i = 1; i < node->num_nodes; i++ )
+		{
+			if ( circ_tree_contains_point(node->nodes[i], pt, &(node->pt_outside)) )
+				in_hole_count++;
+		}
+		return (in_hole_count % 2) ? LW_FALSE : LW_TRUE;
+	}
+
+	if ( lwtype_is_collection(node->geom_type) )
+	{
+		for ( i = 0; i < node->num_nodes; i++ )
+		{
+			if ( circ_tree_covers_point(node->nodes[i], pt) )
+				return LW_TRUE;
+		}
+	}
+
+	return LW_FALSE;
+}
+
+/**
+* Any vertex of the geometry under the node, to test for containment.
+*/
+static const POINT2D* circ_tree_get_point(const CIRC_NODE *node)
+{
+	while ( ! circ_node_is_leaf(node) )
+		node = node->nodes[0];
+	return node->p1;
+}
+
+/**
+* Returns LW_TRUE if the polygon covers a vertex of any of the components
+* under node. Since components that cross the polygon boundary will be
+* caught by the edge distance, one vertex per component is enough.
+*/
+static int circ_polygon_covers_components(const CIRC_NODE *poly, const CIRC_NODE *node)
+{
+	int i;
+
+	/* Too far apart to interact */
+	if ( sphere_distance(&(poly->center), &(node->center)) > poly->radius + node->radius + FP_TOLERANCE )
+		return LW_FALSE;
+
+	if ( circ_node_is_component(node) )
+		return circ_tree_covers_point(poly, circ_tree_get_point(node));
+
+	for ( i = 0; i < node->num_nodes; i++ )
+	{
+		if ( circ_polygon_covers_components(poly, node->nodes[i]) )
+			return LW_TRUE;
+	}
+	return LW_FALSE;
+}
+
+/**
+* Returns LW_TRUE if any polygon under n1 covers a component of n2.
+*/
+static int circ_tree_polygons_cover(const CIRC_NODE *n1, const CIRC_NODE *n2)
+{
+	int i;
+
+	if ( n1->geom_type == POLYGONTYPE )
+		return circ_polygon_covers_components(n1, n2);
+
+	if ( lwtype_is_collection(n1->geom_type) )
+	{
+		for ( i = 0; i < n1->num_nodes; i++ )
+		{
+			if ( circ_tree_polygons_cover(n1->nodes[i], n2) )
+				return LW_TRUE;
+		}
+	}
+	return LW_FALSE;
+}
+
+/**
+* Exact distance (radians) between the edges or points of two leaves,
+* whose centers are d apart.
+*/
+static double circ_leaf_distance(const CIRC_NODE *n1, const CIRC_NODE *n2, double d, GEOGRAPHIC_POINT *closest1, GEOGRAPHIC_POINT *closest2)
+{
+	GEOGRAPHIC_EDGE e1, e2;
+	GEOGRAPHIC_POINT g;
+
+	geographic_point_init(n1->p1->x, n1->p1->y, &(e1.start));
+	geographic_point_init(n2->p1->x, n2->p1->y, &(e2.start));
+
+	if ( circ_node_is_point(n1) && circ_node_is_point(n2) )
+	{
+		*closest1 = e1.start;
+		*closest2 = e2.start;
+		return sphere_distance(&(e1.start), &(e2.start));
+	}
+
+	if ( circ_node_is_point(n1) )
+	{
+		geographic_point_init(n2->p2->x, n2->p2->y, &(e2.end));
+		*closest1 = e1.start;
+		return edge_distance_to_point(&e2, &(e1.start), closest2);
+	}
+
+	geographic_point_init(n1->p2->x, n1->p2->y, &(e1.end));
+
+	if ( circ_node_is_point(n2) )
+	{
+		*closest2 = e2.start;
+		return edge_distance_to_point(&e1, &(e2.start), closest1);
+	}
+
+	geographic_point_init(n2->p2->x, n2->p2->y, &(e2.end));
+
+	/* Edges can only cross if their circles overlap */
+	if ( d <= n1->radius + n2->radius + FP_TOLERANCE && edge_intersection(&e1, &e2, &g) )
+	{
+		*closest1 = *closest2 = g;
+		return 0.0;
+	}
+
+	return edge_distance_to_edge(&e1, &e2, closest1, closest2);
+}
+
+typedef struct
+{
+	double d;
+	const CIRC_NODE *node;
+} CIRC_NODE_DIST;
+
+static int circ_node_dist_cmp(const void *a, const void *b)
+{
+	double da = ((const CIRC_NODE_DIST*)a)->d;
+	double db = ((const CIRC_NODE_DIST*)b)->d;
+	return (da < db) ? -1 : ((da > db) ? 1 : 0);
+}
+
+/**
+* Branch-and-bound walk of the two trees. Pairs of nodes whose circles
+* are further apart than the best distance found so far are skipped,
+* and children are visited nearest first so that the best distance
+* shrinks quickly. Stops once the distance drops below the threshold.
+*/
+static void circ_tree_distance_tree_internal(const CIRC_NODE *n1, const CIRC_NODE *n2, double threshold, double *min_dist, GEOGRAPHIC_POINT *closest1, GEOGRAPHIC_POINT *closest2)
+{
+	CIRC_NODE_DIST stack_dists[CIRC_NODE_SIZE];
+	CIRC_NODE_DIST *dists;
+	const CIRC_NODE *split, *other;
+	GEOGRAPHIC_POINT c1, c2;
+	double d, d_min;
+	int i;
+
+	/* Close enough already */
+	if ( *min_dist < threshold )
+		return;
+
+	d = sphere_distance(&(n1->center), &(n2->center));
+	d_min = d - n1->radius - n2->radius;
+
+	/* Nothing in here can beat what we have */
+	if ( d_min >= *min_dist )
+		return;
+
+	if ( circ_node_is_leaf(n1) && circ_node_is_leaf(n2) )
+	{
+		d = circ_leaf_distance(n1, n2, d, &c1, &c2);
+		if ( d < *min_dist )
+		{
+			*min_dist = d;
+			*closest1 = c1;
+			*closest2 = c2;
+		}
+		return;
+	}
+
+	/* Split the bigger node, leaves can't be split */
+	if ( circ_node_is_leaf(n1) || ( ! circ_node_is_leaf(n2) && n2->radius > n1->radius ) )
+	{
+		split = n2;
+		other = n1;
+	}
+	else
+	{
+		split = n1;
+		other = n2;
+	}
+
+	if ( split->num_nodes > CIRC_NODE_SIZE )
+		dists = lwalloc(sizeof(CIRC_NODE_DIST) * split->num_nodes);
+	else
+		dists = stack_dists;
+
+	for ( i = 0; i < split->num_nodes; i++ )
+	{
+		dists[i].node = split->nodes[i];
+		dists[i].d = sphere_distance(&(split->nodes[i]->center), &(other->center)) - split->nodes[i]->radius;
+	}
+	qsort(dists, split->num_nodes, sizeof(CIRC_NODE_DIST), circ_node_dist_cmp);
+
+	for ( i = 0; i < split->num_nodes; i++ )
+	{
+		if ( split == n1 )
+			circ_tree_distance_tree_internal(dists[i].node, other, threshold, min_dist, closest1, closest2);
+		else
+			circ_tree_distance_tree_internal(other, dists[i].node, threshold, min_dist, closest1, closest2);
+	}
+
+	if ( dists != stack_dists )
+		lwfree(dists);
+}
+
+/**
+* Calculate the distance between the geometries of two trees, in the units
+* of the spheroid. Polygons containing a component of the other geometry
+* make for a zero distance, otherwise the trees are searched for the closest
+* pair of edges. Returns early once the distance drops below the threshold
+* (useful for dwithin calculations).
+*/
+double circ_tree_distance_tree(const CIRC_NODE *n1, const CIRC_NODE *n2, const SPHEROID *spheroid, double threshold)
+{
+	double min_dist = MAXFLOAT;
+	double threshold_radians;
+	GEOGRAPHIC_POINT closest1, closest2;
+	int use_sphere = (spheroid->a == spheroid->b ? 1 : 0);
+
+	if ( ! n1 || ! n2 )
+		return -1.0;
+
+	if ( circ_tree_polygons_cover(n1, n2) || circ_tree_polygons_cover(n2, n1) )
+		return 0.0;
+
+	/* Leave room for the spheroid to disagree with the sphere near the threshold */
+	threshold_radians = threshold / spheroid->radius;
+	if ( ! use_sphere )
+		threshold_radians *= 0.95;
+
+	circ_tree_distance_tree_internal(n1, n2, threshold_radians, &min_dist, &closest1, &closest2);
+
+	LWDEBUGF(4, "tree distance %.8g radians", min_dist);
+
+	if ( use_sphere )
+		return spheroid->radius * min_dist;
+	else
+		return spheroid_distance(&closest1, &closest2, spheroid);
+}
@@ -0,0 +1,51 @@
+/**********************************************************************
+ * $Id$
+ *
+ * PostGIS - Spatial Types for PostgreSQL
+ * http://postgis.refractions.net
+ *
+ * This is free software; you can redistribute and/or modify it under
+ * the terms of the GNU General Public Licence. See the COPYING file.
+ *
+ **********************************************************************/
+
+#ifndef _LWGEODETIC_TREE_H
+#define _LWGEODETIC_TREE_H 1
+
+#include "lwgeodetic.h"
+
+/* Maximum number of children of an internal node */
+#define CIRC_NODE_SIZE 8
+
+/**
+* Bounding circle on the unit sphere, with a center and a radius in radians.
+* Leaf nodes cover one edge (or one point, in which case p1 == p2).
+* Internal nodes cover their children.
+* Nodes at the top of a geometry component carry the component type in
+* geom_type, polygon nodes hold one child per ring and a guaranteed outside
+* point for containment tests.
+* Note that p1 and p2 are pointers into an independent POINTARRAY, do not free them.
+*/
+typedef struct circ_node
+{
+	GEOGRAPHIC_POINT center;
+	double radius;
+	int num_nodes;
+	struct circ_node **nodes;
+	int geom_type;
+	const POINTARRAY *pa;
+	POINT2D pt_outside;
+	POINT2D *p1;
+	POINT2D *p2;
+} CIRC_NODE;
+
+CIRC_NODE* circ_node_leaf_new(const POINTARRAY *pa, int i);
+CIRC_NODE* circ_node_internal_new(CIRC_NODE **c, int num_nodes);
+CIRC_NODE* circ_tree_new(const POINTARRAY *pa);
+CIRC_NODE* lwgeom_calculate_circ_tree(const LWGEOM *lwgeom);
+void circ_tree_free(CIRC_NODE *node);
+int circ_tree_contains_point(const CIRC_NODE *node, const POINT2D *pt, const POINT2D *pt_outside);
+int circ_tree_covers_point(const CIRC_NODE *node, const POINT2D *pt);
+double circ_tree_distance_tree(const CIRC_NODE *n1, const CIRC_NODE *n2, const SPHEROID *spheroid, double threshold);
+
+#endif /* _LWGEODETIC_TREE_H */
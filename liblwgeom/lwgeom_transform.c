@@ -33,6 +33,143 @@ to_dec(POINT4D *pt)
 }
 
 
+/**
+ * Transform a point array in place, one point at a time.
+ */
+static int
+ptarray_transform_points(POINTARRAY *pa, projPJ inpj, projPJ outpj)
+{
+	int i;
+	POINT4D p;
+
+	for ( i = 0; i < pa->npoints; i++ )
+	{
+		getPoint4d_p(pa, i, &p);
+		if ( ! point4d_transform(&p, inpj, outpj) )
+			return LW_FAILURE;
+		ptarray_set_point4d(pa, i, &p);
+	}
+	return LW_SUCCESS;
+}
+
+/**
+ * Transform a point array in place with a single pj_transform call,
+ * walking the ordinates with the array stride. PROJ.4 does not report
+ * per-point failures of a batch the way it does for a single point (it
+ * may just flag the point with HUGE_VAL), so on any trouble the original
+ * ordinates are restored and the array goes through point4d_transform
+ * one point at a time, which reports errors as before.
+ */
+int
+ptarray_transform(POINTARRAY *pa, projPJ inpj, projPJ outpj)
+{
+	int i, ndims, has_z;
+	size_t size;
+	double *d, *orig;
+	int *pj_errno_ref;
+	int rv;
+
+	if ( pa->npoints < 2 )
+		return ptarray_transform_points(pa, inpj, outpj);
+
+	/* Geocentric coordinates need a Z to be computed */
+	has_z = FLAGS_GET_Z(pa->flags);
+	if ( ! has_z && (pj_is_geocent(inpj) || pj_is_geocent(outpj)) )
+		return ptarray_transform_points(pa, inpj, outpj);
+
+	ndims = FLAGS_NDIMS(pa->flags);
+	d = (double*)getPoint_internal(pa, 0);
+	size = (size_t)pa->npoints * ndims * sizeof(double);
+	orig = lwalloc(size);
+	memcpy(orig, d, size);
+
+	if ( pj_is_latlong(inpj) )
+	{
+		for ( i = 0; i < pa->npoints; i++ )
+		{
+			d[i*ndims] *= M_PI/180.0;
+			d[i*ndims+1] *= M_PI/180.0;
+		}
+	}
+
+	LWDEBUGF(4, "transforming %d points from '%s' to '%s'", pa->npoints, pj_get_def(inpj,0), pj_get_def(outpj,0));
+
+	rv = pj_transform(inpj, outpj, pa->npoints, ndims, d, d+1, has_z ? d+2 : NULL);
+	pj_errno_ref = pj_get_errno_ref();
+
+	if ( rv == 0 && *pj_errno_ref == 0 )
+	{
+		for ( i = 0; i < pa->npoints; i++ )
+		{
+			if ( d[i*ndims] == HUGE_VAL || d[i*ndims+1] == HUGE_VAL )
+			{
+				rv = -1;
+				break;
+			}
+		}
+	}
+
+	if ( rv != 0 || *pj_errno_ref != 0 )
+	{
+		LWDEBUG(4, "batch transform failed, retrying point by point");
+		memcpy(d, orig, size);
+		lwfree(orig);
+		*pj_errno_ref = 0;
+		return ptarray_transform_points(pa, inpj, outpj);
+	}
+	lwfree(orig);
+
+	if ( pj_is_latlong(outpj) )
+	{
+		for ( i = 0; i < pa->npoints; i++ )
+		{
+			d[i*ndims] *= 180.0/M_PI;
+			d[i*ndims+1] *= 180.0/M_PI;
+		}
+	}
+
+	return LW_SUCCESS;
+}
+
+/**
+ * Transform the points of a multipoint in a single batch, copying them
+ * into one contiguous array and back.
+ */
+static int
+lwmpoint_transform(LWMPOINT *mpoint, projPJ inpj, projPJ outpj)
+{
+	POINTARRAY *pa;
+	POINT4D p;
+	int i, n = 0;
+
+	pa = ptarray_construct(FLAGS_GET_Z(mpoint->flags), FLAGS_GET_M(mpoint->flags), mpoint->ngeoms);
+	for ( i = 0; i < mpoint->ngeoms; i++ )
+	{
+		if ( lwgeom_is_empty((LWGEOM*)mpoint->geoms[i]) )
+			continue;
+		getPoint4d_p(mpoint->geoms[i]->point, 0, &p);
+		ptarray_set_point4d(pa, n++, &p);
+	}
+	pa->npoints = n;
+
+	if ( ptarray_transform(pa, inpj, outpj) == LW_FAILURE )
+	{
+		ptarray_free(pa);
+		return LW_FAILURE;
+	}
+
+	n = 0;
+	for ( i = 0; i < mpoint->ngeoms; i++ )
+	{
+		if ( lwgeom_is_empty((LWGEOM*)mpoint->geoms[i]) )
+			continue;
+		getPoint4d_p(pa, n++, &p);
+		ptarray_set_point4d(mpoint->geoms[i]->point, 0, &p);
+	}
+	ptarray_free(pa);
+	return LW_SUCCESS;
+}
+
 /**
  * Transform given SERIALIZED geometry
  * from inpj projection to outpj projection
@@ -42,8 +179,6 @@ lwgeom_transform(LWGEOM *geom, projPJ inpj, projPJ outpj)
 {
 	int j, i;
 	int type = geom->type;
-	POINT4D p;
-	POINTARRAY *pa;
 
 	/* No points to transform in an empty! */
 	if ( lwgeom_is_empty(geom) )
@@ -57,13 +192,8 @@ lwgeom_transform(LWGEOM *geom, projPJ inpj, projPJ outpj)
 		case TRIANGLETYPE:
 		{
 			LWLINE *g = (LWLINE*)geom;
-			pa = g->points;
-			for ( i = 0; i < pa->npoints; i++ )
-			{
-				getPoint4d_p(pa, i, &p);
-				point4d_transform(&p, inpj, outpj);
-				ptarray_set_point4d(pa, i, &p);
-			}
+			if ( ! ptarray_transform(g->points, inpj, outpj) )
+				return LW_FAILURE;
 			break;
 		}
 		case POLYGONTYPE:
@@ -71,17 +201,15 @@ lwgeom_transform(LWGEOM *geom, projPJ inpj, projPJ outpj)
 			LWPOLY *g = (LWPOLY*)geom;
 			for ( j = 0; j < g->nrings; j++ )
 			{
-				pa = g->rings[j];
-				for ( i = 0; i < pa->npoints; i++ )
-				{
-					getPoint4d_p(pa, i, &p);
-					point4d_transform(&p, inpj, outpj);
-					ptarray_set_point4d(pa, i, &p);
-				}
+				if ( ! ptarray_transform(g->rings[j], inpj, outpj) )
+					return LW_FAILURE;
 			}
 			break;
 		}
 		case MULTIPOINTTYPE:
+		{
+			return lwmpoint_transform((LWMPOINT*)geom, inpj, outpj);
+		}
 		case MULTILINETYPE:
 		case MULTIPOLYGONTYPE:
 		case COLLECTIONTYPE:
@@ -95,7 +223,8 @@ lwgeom_transform(LWGEOM *geom, projPJ inpj, projPJ outpj)
 			LWCOLLECTION *g = (LWCOLLECTION*)geom;
 			for ( i = 0; i < g->ngeoms; i++ )
 			{
-				lwgeom_transform(g->geoms[i], inpj, outpj);
+				if ( ! lwgeom_transform(g->geoms[i], inpj, outpj) )
+					return LW_FAILURE;
 			}
 			break;
 		}
@@ -0,0 +1,293 @@
+/**********************************************************************
+ * $Id$
+ *
+ * PostGIS - Spatial Types for PostgreSQL
+ * http://postgis.refractions.net
+ *
+ * This is free software; you can redistribute and/or modify it under
+ * the terms of the GNU General Public Licence. See the COPYING file.
+ *
+ **********************************************************************/
+
+#include "liblwgeom_internal.h"
+#include "lwgeom_log.h"
+#include "lwitree.h"
+
+/*
+* Number of nodes needed for a ring of nsegs edges, every level
+* halving the one below (rounding up) until a single node is left.
+*/
+static int itree_ring_num_nodes(int nsegs, int *nlevels)
+{
+	int size = nsegs;
+	int total = 0;
+
+	*nlevels = 0;
+	if ( nsegs <= 0 )
+		return 0;
+
+	while ( LW_TRUE )
+	{
+		total += size;
+		(*nlevels)++;
+		if ( size == 1 )
+			break;
+		size = (size + 1) / 2;
+	}
+	return total;
+}
+
+/*
+* Fill the nodes of the tree of a ring, leaves first.
+*/
+static void itree_ring_build(ITREE_RING *ring, const POINTARRAY *pa, ITREE_NODE *nodes)
+{
+	ITREE_NODE *child, *parent;
+	int size, i;
+
+	ring->pa = pa;
+	ring->nsegs = pa->npoints > 1 ? pa->npoints - 1 : 0;
+	itree_ring_num_nodes(ring->nsegs, &(ring->nlevels));
+	ring->nodes = nodes;
+
+	for ( i = 0; i < ring->nsegs; i++ )
+	{
+		const POINT2D *p1 = (const POINT2D*)getPoint_internal(pa, i);
+		const POINT2D *p2 = (const POINT2D*)getPoint_internal(pa, i+1);
+		nodes[i].min = FP_MIN(p1->y, p2->y);
+		nodes[i].max = FP_MAX(p1->y, p2->y);
+	}
+
+	child = nodes;
+	size = ring->nsegs;
+	while ( size > 1 )
+	{
+		int parent_size = (size + 1) / 2;
+		parent = child + size;
+		for ( i = 0; i < parent_size; i++ )
+		{
+			parent[i] = child[2*i];
+			if ( 2*i + 1 < size )
+			{
+				parent[i].min = FP_MIN(parent[i].min, child[2*i+1].min);
+				parent[i].max = FP_MAX(parent[i].max, child[2*i+1].max);
+			}
+		}
+		child = parent;
+		size = parent_size;
+	}
+}
+
+/**
+* Build the interval trees of the rings of a polygon or multipolygon.
+* Returns NULL for other types. The trees reference the point arrays of
+* the geometry, which must stay around until itree_free().
+*/
+ITREE* itree_from_lwgeom(const LWGEOM *lwgeom)
+{
+	ITREE *itree;
+	const LWPOLY **polys;
+	const LWPOLY *single;
+	int npolys, nrings, nnodes, nlevels;
+	int p, r, i;
+	ITREE_NODE *nodes;
+
+	if ( lwgeom->type == POLYGONTYPE )
+	{
+		single = (const LWPOLY*)lwgeom;
+		polys = &single;
+		npolys = 1;
+	}
+	else if ( lwgeom->type == MULTIPOLYGONTYPE )
+	{
+		const LWMPOLY *mpoly = (const LWMPOLY*)lwgeom;
+		polys = (const LWPOLY**)(mpoly->geoms);
+		npolys = mpoly->ngeoms;
+	}
+	else
+	{
+		return NULL;
+	}
+
+	/* Size everything first so all the nodes go in a single block */
+	nrings = 0;
+	nnodes = 0;
+	for ( p = 0; p < npolys; p++ )
+	{
+		for ( r = 0; r < polys[p]->nrings; r++ )
+		{
+			const POINTARRAY *pa = polys[p]->rings[r];
+			nnodes += itree_ring_num_nodes(pa->npoints > 1 ? pa->npoints - 1 : 0, &nlevels);
+		}
+		nrings += polys[p]->nrings;
+	}
+
+	LWDEBUGF(3, "building interval trees for %d rings, %d nodes", nrings, nnodes);
+
+	itree = lwalloc(sizeof(ITREE));
+	itree->npolys = npolys;
+	itree->nrings = nrings;
+	itree->ring_counts = lwalloc(sizeof(int) * (npolys > 0 ? npolys : 1));
+	itree->rings = lwalloc(sizeof(ITREE_RING) * (nrings > 0 ? nrings : 1));
+	itree->nodes = lwalloc(sizeof(ITREE_NODE) * (nnodes > 0 ? nnodes : 1));
+
+	nodes = itree->nodes;
+	i = 0;
+	for ( p = 0; p < npolys; p++ )
+	{
+		itree->ring_counts[p] = polys[p]->nrings;
+		for ( r = 0; r < polys[p]->nrings; r++ )
+		{
+			itree_ring_build(&(itree->rings[i]), polys[p]->rings[r], nodes);
+			nodes += itree_ring_num_nodes(itree->rings[i].nsegs, &nlevels);
+			i++;
+		}
+	}
+
+	return itree;
+}
+
+void itree_free(ITREE *itree)
+{
+	if ( ! itree )
+		return;
+	lwfree(itree->nodes);
+	lwfree(itree->rings);
+	lwfree(itree->ring_counts);
+	lwfree(itree);
+}
+
+/**
+* Winding number of a ring around a point, visiting only the edges
+* whose Y extent holds the point. Nothing is allocated, the walk uses
+* a small stack of (level, node) pairs. Sets *on_boundary and returns
+* zero when the point is on the ring.
+*/
+int itree_ring_winding(const ITREE_RING *ring, const POINT2D *pt, int *on_boundary)
+{
+	int level_start[ITREE_MAX_LEVELS];
+	int level_size[ITREE_MAX_LEVELS];
+	int stack_level[2*ITREE_MAX_LEVELS];
+	int stack_node[2*ITREE_MAX_LEVELS];
+	int nstack = 0;
+	int wn = 0;
+	int l, start, size;
+
+	*on_boundary = LW_FALSE;
+
+	if ( ring->nsegs == 0 )
+		return 0;
+
+	start = 0;
+	size = ring->nsegs;
+	for ( l = 0; l < ring->nlevels; l++ )
+	{
+		level_start[l] = start;
+		level_size[l] = size;
+		start += size;
+		size = (size + 1) / 2;
+	}
+
+	stack_level[nstack] = ring->nlevels - 1;
+	stack_node[nstack] = 0;
+	nstack++;
+
+	while ( nstack > 0 )
+	{
+		const ITREE_NODE *node;
+		int k;
+
+		nstack--;
+		l = stack_level[nstack];
+		k = stack_node[nstack];
+		node = ring->nodes + level_start[l] + k;
+
+		if ( ! FP_CONTAINS_INCL(node->min, pt->y, node->max) )
+			continue;
+
+		if ( l == 0 )
+		{
+			int on_segment;
+			const POINT2D *p1 = (const POINT2D*)getPoint_internal(ring->pa, k);
+			const POINT2D *p2 = (const POINT2D*)getPoint_internal(ring->pa, k+1);
+
+			wn += lw_segment_winding(p1, p2, pt, &on_segment);
+			if ( on_segment )
+			{
+				*on_boundary = LW_TRUE;
+				return 0;
+			}
+			continue;
+		}
+
+		/* Push the right child first so the left one is visited first */
+		if ( 2*k + 1 < level_size[l-1] )
+		{
+			stack_level[nstack] = l - 1;
+			stack_node[nstack] = 2*k + 1;
+			nstack++;
+		}
+		stack_level[nstack] = l - 1;
+		stack_node[nstack] = 2*k;
+		nstack++;
+	}
+
+	return wn;
+}
+
+/**
+* Returns -1 outside the ring, 0 on the ring and 1 inside.
+*/
+int itree_point_in_ring(const ITREE_RING *ring, const POINT2D *pt)
+{
+	int on_boundary;
+	int wn = itree_ring_winding(ring, pt, &on_boundary);
+
+	if ( on_boundary )
+		return 0;
+	return wn == 0 ? -1 : 1;
+}
+
+/**
+* Returns -1 outside, 0 on the boundary and 1 inside the polygons.
+* Same answers as point_in_multipolygon() in the backend.
+*/
+int itree_point_in_multipolygon(const ITREE *itree, const POINT2D *pt)
+{
+	int i = 0; /* index of the shell of the current polygon */
+	int p, r, in_ring;
+	int result = -1;
+
+	for ( p = 0; p < itree->npolys; p++ )
+	{
+		if ( itree->ring_counts[p] == 0 )
+			continue;
+
+		in_ring = itree_point_in_ring(&(itree->rings[i]), pt);
+		if ( in_ring == 0 )
+			return 0;
+
+		if ( in_ring == 1 )
+		{
+			result = 1;
+			for ( r = 1; r < itree->ring_counts[p]; r++ )
+			{
+				in_ring = itree_point_in_ring(&(itree->rings[i+r]), pt);
+				/* Inside a hole => outside the polygon */
+				if ( in_ring == 1 )
+				{
+					result = -1;
+					break;
+				}
+				/* On the edge of a hole */
+				if ( in_ring == 0 )
+					return 0;
+			}
+			if ( result != -1 )
+				return result;
+		}
+		i += itree->ring_counts[p];
+	}
+
+	return result;
+}
@@ -0,0 +1,66 @@
+/**********************************************************************
+ * $Id$
+ *
+ * PostGIS - Spatial Types for PostgreSQL
+ * http://postgis.refractions.net
+ *
+ * This is free software; you can redistribute and/or modify it under
+ * the terms of the GNU General Public Licence. See the COPYING file.
+ *
+ **********************************************************************/
+
+#ifndef _LWITREE_H
+#define _LWITREE_H 1
+
+#include "liblwgeom.h"
+
+/* Enough levels for a ring of 2^31 edges */
+#define ITREE_MAX_LEVELS 32
+
+/**
+* Y extent of an edge (leaf) or of a run of edges (internal node).
+*/
+typedef struct
+{
+	double min;
+	double max;
+} ITREE_NODE;
+
+/**
+* Interval tree over the edges of one ring, stored level by level in a
+* flat array. Level zero holds one leaf per edge, in ring order, so leaf i
+* is the edge from vertex i to vertex i+1 of pa. Node k of a level covers
+* nodes 2k and 2k+1 of the level below. The top level has a single node.
+* Note that pa is a reference to the ring of an independent geometry, it
+* has to outlive the tree.
+*/
+typedef struct
+{
+	const POINTARRAY *pa;
+	int nsegs;
+	int nlevels;
+	ITREE_NODE *nodes;
+} ITREE_RING;
+
+/**
+* Interval trees of all the rings of a polygon or multipolygon. Rings
+* are in geometry order, each shell followed by its holes, ring_counts
+* has the number of rings of each polygon. The nodes of every ring live
+* in one allocation.
+*/
+typedef struct
+{
+	int npolys;
+	int nrings;
+	int *ring_counts;
+	ITREE_RING *rings;
+	ITREE_NODE *nodes;
+} ITREE;
+
+ITREE* itree_from_lwgeom(const LWGEOM *lwgeom);
+void itree_free(ITREE *itree);
+int itree_ring_winding(const ITREE_RING *ring, const POINT2D *pt, int *on_boundary);
+int itree_point_in_ring(const ITREE_RING *ring, const POINT2D *pt);
+int itree_point_in_multipolygon(const ITREE *itree, const POINT2D *pt);
+
+#endif /* _LWITREE_H */
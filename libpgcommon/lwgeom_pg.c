@@ -34,6 +34,22 @@
  */
 /* PG_MODULE_MAGIC; */
 
+/**
+* Get the cache slots of the function, allocating them in the function
+* memory context on the first call.
+*/
+GenericCacheCollection*
+GetGenericCacheCollection(FunctionCallInfoData *fcinfo)
+{
+	GenericCacheCollection* cache = fcinfo->flinfo->fn_extra;
+	if ( ! cache )
+	{
+		cache = MemoryContextAllocZero(fcinfo->flinfo->fn_mcxt, sizeof(GenericCacheCollection));
+		fcinfo->flinfo->fn_extra = cache;
+	}
+	return cache;
+}
+
 /**
 * Utility to convert cstrings to textp pointers 
 */
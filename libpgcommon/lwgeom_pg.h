@@ -28,6 +28,21 @@ void pg_free(void *ptr);
 void pg_error(const char *msg, va_list vp);
 void pg_notice(const char *msg, va_list vp);
 
+/*
+* Per-function caches all hang off fn_extra, each in its own slot, so
+* that functions using more than one of them (e.g. a spheroid lookup and
+* a geometry cache) don't step on each other.
+*/
+#define PROJ_CACHE_ENTRY 0
+#define GEOM_CACHE_ENTRY 1
+#define NUM_CACHE_ENTRIES 2
+
+typedef struct {
+	void* entry[NUM_CACHE_ENTRIES];
+} GenericCacheCollection;
+
+GenericCacheCollection* GetGenericCacheCollection(FunctionCallInfoData *fcinfo);
+
 
 /* Debugging macros */
 #if POSTGIS_DEBUG_LEVEL > 0
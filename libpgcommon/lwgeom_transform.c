@@ -16,9 +16,9 @@
 #include "fmgr.h"
 #include "miscadmin.h"
 #include "utils/memutils.h"
+#include "utils/inval.h"
+#include "catalog/namespace.h"
 #include "executor/spi.h"
-#include "access/hash.h"
-#include "utils/hsearch.h"
 
 /* PostGIS headers */
 #include "../postgis_config.h"
@@ -37,16 +37,12 @@
 int pj_transform_nodatum(projPJ srcdefn, projPJ dstdefn, long point_count, int point_offset, double *x, double *y, double *z );
 
 
-/* PROJ 4 lookup transaction cache methods */
-#define PROJ4_CACHE_ITEMS	8
-
 /*
- * PROJ 4 backend hash table initial hash size
- * (since 16 is the default portal hash table size, and we would
- * typically have 2 entries per portal
- * then we shall use a default size of 32)
+ * Number of projections kept by each backend. Connections handed out
+ * by a pooler live long and tend to use a handful of SRIDs, so these
+ * stay around for the life of the backend.
  */
-#define PROJ4_BACKEND_HASH_SIZE	32
+#define PROJ4_CACHE_ITEMS	64
 
 
 /* An entry in the PROJ4 SRS cache */
@@ -54,249 +50,125 @@ typedef struct struct_PROJ4SRSCacheItem
 {
 	int srid;
 	projPJ projection;
-	MemoryContext projection_mcxt;
+	uint32 last_used;
 }
 PROJ4SRSCacheItem;
 
-/** The portal cache: it's contents and cache context
+/**
+ * The backend cache. The projPJ objects are allocated by PROJ.4 itself,
+ * they are pj_free()d on eviction or when spatial_ref_sys changes.
+ * The least recently used entry goes first, last_used is stamped
+ * from clock on every lookup. generation changes whenever a projection
+ * is freed, so callers holding on to projPJ pointers can tell they are
+ * stale.
  */
-typedef struct struct_PROJ4PortalCache
+typedef struct struct_PROJ4BackendCache
 {
 	PROJ4SRSCacheItem PROJ4SRSCache[PROJ4_CACHE_ITEMS];
 	int PROJ4SRSCacheCount;
-	MemoryContext PROJ4SRSCacheContext;
+	uint32 clock;
+	uint32 generation;
+	bool invalid;
 }
-PROJ4PortalCache;
+PROJ4BackendCache;
+
+static PROJ4BackendCache PROJ4BackendSRSCache;
 
 /**
- * Backend projPJ hash table
- *
- * This hash table stores a key/value pair of MemoryContext/projPJ objects.
- * Whenever we create a projPJ object using pj_init(), we create a separate
- * MemoryContext as a child context of the current executor context.
- * The MemoryContext/projPJ object is stored in this hash table so
- * that when PROJ4SRSCacheDelete() is called during query cleanup, we can
- * lookup the projPJ object based upon the MemoryContext parameter and hence
- * pj_free() it.
+ * Per call site memo of the last pair of projections handed out, kept
+ * in fn_extra, with the slots they sit in. Valid as long as the backend
+ * cache generation has not moved.
  */
-static HTAB *PJHash = NULL;
-
-typedef struct struct_PJHashEntry
+typedef struct struct_PROJ4PortalCache
 {
-	MemoryContext ProjectionContext;
-	projPJ projection;
+	int srid1;
+	int srid2;
+	int slot1;
+	int slot2;
+	uint32 generation;
 }
-PJHashEntry;
-
-
-/* PJ Hash API */
-uint32 mcxt_ptr_hash(const void *key, Size keysize);
+PROJ4PortalCache;
 
-static HTAB *CreatePJHash(void);
-static void AddPJHashEntry(MemoryContext mcxt, projPJ projection);
-static projPJ GetPJHashEntry(MemoryContext mcxt);
-static void DeletePJHashEntry(MemoryContext mcxt);
+/* Invalidation of the backend cache */
+static bool PROJ4CacheCallbackRegistered = false;
+static Oid PROJ4SRSRelid = InvalidOid;
+static void PROJ4SRSCacheRelcacheCallback(Datum arg, Oid relid);
+static void PROJ4SRSCacheFlush(PROJ4BackendCache *PROJ4Cache);
 
 /* Internal Cache API */
-static PROJ4PortalCache *GetPROJ4SRSCache(FunctionCallInfo fcinfo) ;
-static bool IsInPROJ4SRSCache(PROJ4PortalCache *PROJ4Cache, int srid);
-static projPJ GetProjectionFromPROJ4SRSCache(PROJ4PortalCache *PROJ4Cache, int srid);
-static void AddToPROJ4SRSCache(PROJ4PortalCache *PROJ4Cache, int srid, int other_srid);
-static void DeleteFromPROJ4SRSCache(PROJ4PortalCache *PROJ4Cache, int srid);
+static PROJ4BackendCache *GetPROJ4SRSCache(FunctionCallInfo fcinfo) ;
+static int GetPROJ4SRSCacheSlot(PROJ4BackendCache *PROJ4Cache, int srid);
+static bool IsInPROJ4SRSCache(PROJ4BackendCache *PROJ4Cache, int srid);
+static projPJ GetProjectionFromPROJ4SRSCache(PROJ4BackendCache *PROJ4Cache, int srid);
+static void AddToPROJ4SRSCache(PROJ4BackendCache *PROJ4Cache, int srid, int other_srid);
+static void DeleteFromPROJ4SRSCache(PROJ4BackendCache *PROJ4Cache, int srid);
 
 /* Search path for PROJ.4 library */
 static bool IsPROJ4LibPathSet = false;
 void SetPROJ4LibPath(void);
 
-/* Memory context cache functions */
-static void PROJ4SRSCacheInit(MemoryContext context);
-static void PROJ4SRSCacheDelete(MemoryContext context);
-static void PROJ4SRSCacheReset(MemoryContext context);
-static bool PROJ4SRSCacheIsEmpty(MemoryContext context);
-static void PROJ4SRSCacheStats(MemoryContext context, int level);
-#ifdef MEMORY_CONTEXT_CHECKING
-static void PROJ4SRSCacheCheck(MemoryContext context);
-#endif
-
-
-/* Memory context definition must match the current version of PostgreSQL */
-static MemoryContextMethods PROJ4SRSCacheContextMethods =
-{
-	NULL,
-	NULL,
-	NULL,
-	PROJ4SRSCacheInit,
-	PROJ4SRSCacheReset,
-	PROJ4SRSCacheDelete,
-	NULL,
-	PROJ4SRSCacheIsEmpty,
-	PROJ4SRSCacheStats
-#ifdef MEMORY_CONTEXT_CHECKING
-	,PROJ4SRSCacheCheck
-#endif
-};
-
-
-static void
-PROJ4SRSCacheInit(MemoryContext context)
-{
-	/*
-	 * Do nothing as the cache is initialised when the transform()
-	 * function is first called
-	 */
-}
-
-static void
-PROJ4SRSCacheDelete(MemoryContext context)
-{
-	projPJ projection;
-
-	/* Lookup the projPJ pointer in the global hash table so we can free it */
-	projection = GetPJHashEntry(context);
-
-	if (!projection)
-		elog(ERROR, "PROJ4SRSCacheDelete: Trying to delete non-existant projection object with MemoryContext key (%p)", (void *)context);
-
-	POSTGIS_DEBUGF(3, "deleting projection object (%p) with MemoryContext key (%p)", projection, context);
-
-	/* Free it */
-	pj_free(projection);
-
-	/* Remove the hash entry as it is no longer needed */
-	DeletePJHashEntry(context);
-}
-
-static void
-PROJ4SRSCacheReset(MemoryContext context)
-{
-	/*
-	 * Do nothing, but we must supply a function since this call is mandatory according to tgl
-	 * (see postgis-devel archives July 2007)
-	 */
-}
-
-static bool
-PROJ4SRSCacheIsEmpty(MemoryContext context)
-{
-	/*
-	 * Always return false since this call is mandatory according to tgl
-	 * (see postgis-devel archives July 2007)
-	 */
-	return FALSE;
-}
-
-static void
-PROJ4SRSCacheStats(MemoryContext context, int level)
-{
-	/*
-	 * Simple stats display function - we must supply a function since this call is mandatory according to tgl
-	 * (see postgis-devel archives July 2007)
-	 */
-
-	fprintf(stderr, "%s: PROJ4 context\n", context->name);
-}
-
-#ifdef MEMORY_CONTEXT_CHECKING
-static void
-PROJ4SRSCacheCheck(MemoryContext context)
-{
-	/*
-	 * Do nothing - stub required for when PostgreSQL is compiled
-	 * with MEMORY_CONTEXT_CHECKING defined
-	 */
-}
-#endif
-
 
 /*
- * PROJ4 projPJ Hash Table functions
+ * Backend cache invalidation
  */
 
-
 /**
- * A version of tag_hash - we specify this here as the implementation
- * has changed over the years....
+ * Relcache callback. Fires in every backend when the spatial_ref_sys
+ * trigger (or anything else) invalidates the relation, and with
+ * InvalidOid when the whole relcache is reset. It can run in the middle
+ * of a lookup (any lock acquisition processes invalidations), so the
+ * projections are not freed here, only at the start of the next
+ * lookup.
  */
-
-uint32 mcxt_ptr_hash(const void *key, Size keysize)
+static void
+PROJ4SRSCacheRelcacheCallback(Datum arg, Oid relid)
 {
-	uint32 hashval;
-
-	hashval = DatumGetUInt32(hash_any(key, keysize));
-
-	return hashval;
+	if ( relid == InvalidOid || relid == PROJ4SRSRelid )
+		InvalidatePROJ4Cache();
 }
 
-
-static HTAB *CreatePJHash(void)
+/**
+ * Mark the projection cache of this backend as stale.
+ */
+void
+InvalidatePROJ4Cache(void)
 {
-	HASHCTL ctl;
-
-	ctl.keysize = sizeof(MemoryContext);
-	ctl.entrysize = sizeof(PJHashEntry);
-	ctl.hash = mcxt_ptr_hash;
-
-	return hash_create("PostGIS PROJ4 Backend projPJ MemoryContext Hash", PROJ4_BACKEND_HASH_SIZE, &ctl, (HASH_ELEM | HASH_FUNCTION));
+	POSTGIS_DEBUG(3, "invalidating the backend PROJ4 cache");
+	PROJ4BackendSRSCache.invalid = true;
 }
 
-static void AddPJHashEntry(MemoryContext mcxt, projPJ projection)
+static void
+PROJ4SRSCacheFlush(PROJ4BackendCache *PROJ4Cache)
 {
-	bool found;
-	void **key;
-	PJHashEntry *he;
+	int i;
 
-	/* The hash key is the MemoryContext pointer */
-	key = (void *)&mcxt;
+	POSTGIS_DEBUGF(3, "flushing %d entries from the backend PROJ4 cache", PROJ4Cache->PROJ4SRSCacheCount);
 
-	he = (PJHashEntry *) hash_search(PJHash, key, HASH_ENTER, &found);
-	if (!found)
-	{
-		/* Insert the entry into the new hash element */
-		he->ProjectionContext = mcxt;
-		he->projection = projection;
-	}
-	else
+	for (i = 0; i < PROJ4_CACHE_ITEMS; i++)
 	{
-		elog(ERROR, "AddPJHashEntry: PROJ4 projection object already exists for this MemoryContext (%p)",
-		     (void *)mcxt);
+		if (PROJ4Cache->PROJ4SRSCache[i].srid != SRID_UNKNOWN)
+			DeleteFromPROJ4SRSCache(PROJ4Cache, PROJ4Cache->PROJ4SRSCache[i].srid);
 	}
+	PROJ4Cache->invalid = false;
 }
 
-static projPJ GetPJHashEntry(MemoryContext mcxt)
-{
-	void **key;
-	PJHashEntry *he;
-
-	/* The hash key is the MemoryContext pointer */
-	key = (void *)&mcxt;
-
-	/* Return the projection object from the hash */
-	he = (PJHashEntry *) hash_search(PJHash, key, HASH_FIND, NULL);
-
-	return he->projection;
-}
-
-
-static void DeletePJHashEntry(MemoryContext mcxt)
+/* Index of the cache entry for srid, or -1 */
+static int
+GetPROJ4SRSCacheSlot(PROJ4BackendCache *PROJ4Cache, int srid)
 {
-	void **key;
-	PJHashEntry *he;
-
-	/* The hash key is the MemoryContext pointer */
-	key = (void *)&mcxt;
-
-	/* Delete the projection object from the hash */
-	he = (PJHashEntry *) hash_search(PJHash, key, HASH_REMOVE, NULL);
-
-	he->projection = NULL;
+	int i;
 
-	if (!he)
-		elog(ERROR, "DeletePJHashEntry: There was an error removing the PROJ4 projection object from this MemoryContext (%p)", (void *)mcxt);
+	for (i = 0; i < PROJ4_CACHE_ITEMS; i++)
+	{
+		if (PROJ4Cache->PROJ4SRSCache[i].srid == srid)
+			return i;
+	}
+	return -1;
 }
 
 bool
 IsInPROJ4Cache(Proj4Cache PROJ4Cache, int srid) {
-	return IsInPROJ4SRSCache((PROJ4PortalCache *)PROJ4Cache, srid) ;
+	return IsInPROJ4SRSCache((PROJ4BackendCache *)PROJ4Cache, srid) ;
 }
 
 /*
@@ -304,46 +176,36 @@ IsInPROJ4Cache(Proj4Cache PROJ4Cache, int srid) {
  */
 
 static bool
-IsInPROJ4SRSCache(PROJ4PortalCache *PROJ4Cache, int srid)
+IsInPROJ4SRSCache(PROJ4BackendCache *PROJ4Cache, int srid)
 {
 	/*
 	 * Return true/false depending upon whether the item
 	 * is in the SRS cache.
 	 */
 
-	int i;
-
-	for (i = 0; i < PROJ4_CACHE_ITEMS; i++)
-	{
-		if (PROJ4Cache->PROJ4SRSCache[i].srid == srid)
-			return 1;
-	}
-
-	/* Otherwise not found */
-	return 0;
+	return GetPROJ4SRSCacheSlot(PROJ4Cache, srid) >= 0;
 }
 
 projPJ GetProjectionFromPROJ4Cache(Proj4Cache cache, int srid)
 {
-	return GetProjectionFromPROJ4SRSCache((PROJ4PortalCache *)cache, srid) ;
+	return GetProjectionFromPROJ4SRSCache((PROJ4BackendCache *)cache, srid) ;
 }
 
 /**
  * Return the projection object from the cache (we should
  * already have checked it exists using IsInPROJ4SRSCache first)
+ * and mark it as recently used.
  */
 static projPJ
-GetProjectionFromPROJ4SRSCache(PROJ4PortalCache *PROJ4Cache, int srid)
+GetProjectionFromPROJ4SRSCache(PROJ4BackendCache *PROJ4Cache, int srid)
 {
-	int i;
+	int i = GetPROJ4SRSCacheSlot(PROJ4Cache, srid);
 
-	for (i = 0; i < PROJ4_CACHE_ITEMS; i++)
-	{
-		if (PROJ4Cache->PROJ4SRSCache[i].srid == srid)
-			return PROJ4Cache->PROJ4SRSCache[i].projection;
-	}
+	if (i < 0)
+		return NULL;
 
-	return NULL;
+	PROJ4Cache->PROJ4SRSCache[i].last_used = ++(PROJ4Cache->clock);
+	return PROJ4Cache->PROJ4SRSCache[i].projection;
 }
 
 char* GetProj4StringSPI(int srid)
@@ -465,22 +327,22 @@ static char* GetProj4String(int srid)
 }
 
 void AddToPROJ4Cache(Proj4Cache cache, int srid, int other_srid) {
-	AddToPROJ4SRSCache((PROJ4PortalCache *)cache, srid, other_srid) ;
+	AddToPROJ4SRSCache((PROJ4BackendCache *)cache, srid, other_srid) ;
 }
 
 
 /**
- * Add an entry to the local PROJ4 SRS cache. If we need to wrap around then
- * we must make sure the entry we choose to delete does not contain other_srid
+ * Add an entry to the backend PROJ4 SRS cache. If the cache is full the
+ * least recently used entry goes, but never the one for other_srid,
  * which is the definition for the other half of the transformation.
  */
 static void
-AddToPROJ4SRSCache(PROJ4PortalCache *PROJ4Cache, int srid, int other_srid)
+AddToPROJ4SRSCache(PROJ4BackendCache *PROJ4Cache, int srid, int other_srid)
 {
-	MemoryContext PJMemoryContext;
 	projPJ projection = NULL;
 	char *proj_str;
 	int* pj_errno_ref;
+	int i, slot;
 
 	/*
 	** Turn the SRID number into a proj4 string, by reading from spatial_ref_sys
@@ -502,56 +364,32 @@ AddToPROJ4SRSCache(PROJ4PortalCache *PROJ4Cache, int srid, int other_srid)
 		elog(ERROR, "AddToPROJ4SRSCache: couldn't parse proj4 string: '%s': %s", proj_str, pj_strerrno(*pj_errno_ref));
 	}
 
-	/*
-	 * If the cache is already full then find the first entry
-	 * that doesn't contain other_srid and use this as the
-	 * subsequent value of PROJ4SRSCacheCount
-	 */
-	if (PROJ4Cache->PROJ4SRSCacheCount == PROJ4_CACHE_ITEMS)
+	/* Take a free slot, or evict the least recently used entry */
+	slot = -1;
+	for (i = 0; i < PROJ4_CACHE_ITEMS; i++)
 	{
-		bool found = false;
-		int i;
-
-		for (i = 0; i < PROJ4_CACHE_ITEMS; i++)
+		if (PROJ4Cache->PROJ4SRSCache[i].srid == SRID_UNKNOWN)
 		{
-			if (PROJ4Cache->PROJ4SRSCache[i].srid != other_srid && found == false)
-			{
-				POSTGIS_DEBUGF(3, "choosing to remove item from query cache with SRID %d and index %d", PROJ4Cache->PROJ4SRSCache[i].srid, i);
-
-				DeleteFromPROJ4SRSCache(PROJ4Cache, PROJ4Cache->PROJ4SRSCache[i].srid);
-				PROJ4Cache->PROJ4SRSCacheCount = i;
-
-				found = true;
-			}
+			slot = i;
+			break;
 		}
+		if (PROJ4Cache->PROJ4SRSCache[i].srid == other_srid)
+			continue;
+		if (slot < 0 || PROJ4Cache->PROJ4SRSCache[i].last_used < PROJ4Cache->PROJ4SRSCache[slot].last_used)
+			slot = i;
 	}
 
-	/*
-	 * Now create a memory context for this projection and
-	 * store it in the backend hash
-	 */
-	POSTGIS_DEBUGF(3, "adding SRID %d with proj4text \"%s\" to query cache at index %d", srid, proj_str, PROJ4Cache->PROJ4SRSCacheCount);
-
-	PJMemoryContext = MemoryContextCreate(T_AllocSetContext, 8192,
-	                                      &PROJ4SRSCacheContextMethods,
-	                                      PROJ4Cache->PROJ4SRSCacheContext,
-	                                      "PostGIS PROJ4 PJ Memory Context");
-
-	/* Create the backend hash if it doesn't already exist */
-	if (!PJHash)
-		PJHash = CreatePJHash();
-
-	/*
-	 * Add the MemoryContext to the backend hash so we can
-	 * clean up upon portal shutdown
-	 */
-	POSTGIS_DEBUGF(3, "adding projection object (%p) to hash table with MemoryContext key (%p)", projection, PJMemoryContext);
+	if (PROJ4Cache->PROJ4SRSCache[slot].srid != SRID_UNKNOWN)
+	{
+		POSTGIS_DEBUGF(3, "choosing to remove item from backend cache with SRID %d and index %d", PROJ4Cache->PROJ4SRSCache[slot].srid, slot);
+		DeleteFromPROJ4SRSCache(PROJ4Cache, PROJ4Cache->PROJ4SRSCache[slot].srid);
+	}
 
-	AddPJHashEntry(PJMemoryContext, projection);
+	POSTGIS_DEBUGF(3, "adding SRID %d with proj4text \"%s\" to backend cache at index %d", srid, proj_str, slot);
 
-	PROJ4Cache->PROJ4SRSCache[PROJ4Cache->PROJ4SRSCacheCount].srid = srid;
-	PROJ4Cache->PROJ4SRSCache[PROJ4Cache->PROJ4SRSCacheCount].projection = projection;
-	PROJ4Cache->PROJ4SRSCache[PROJ4Cache->PROJ4SRSCacheCount].projection_mcxt = PJMemoryContext;
+	PROJ4Cache->PROJ4SRSCache[slot].srid = srid;
+	PROJ4Cache->PROJ4SRSCache[slot].projection = projection;
+	PROJ4Cache->PROJ4SRSCache[slot].last_used = ++(PROJ4Cache->clock);
 	PROJ4Cache->PROJ4SRSCacheCount++;
 
 	/* Free the projection string */
@@ -560,11 +398,11 @@ AddToPROJ4SRSCache(PROJ4PortalCache *PROJ4Cache, int srid, int other_srid)
 }
 
 void DeleteFromPROJ4Cache(Proj4Cache cache, int srid) {
-	DeleteFromPROJ4SRSCache((PROJ4PortalCache *)cache, srid) ;
+	DeleteFromPROJ4SRSCache((PROJ4BackendCache *)cache, srid) ;
 }
 
 
-static void DeleteFromPROJ4SRSCache(PROJ4PortalCache *PROJ4Cache, int srid)
+static void DeleteFromPROJ4SRSCache(PROJ4BackendCache *PROJ4Cache, int srid)
 {
 	/*
 	 * Delete the SRID entry from the cache
@@ -576,16 +414,15 @@ static void DeleteFromPROJ4SRSCache(PROJ4PortalCache *PROJ4Cache, int srid)
 	{
 		if (PROJ4Cache->PROJ4SRSCache[i].srid == srid)
 		{
-			POSTGIS_DEBUGF(3, "removing query cache entry with SRID %d at index %d", srid, i);
+			POSTGIS_DEBUGF(3, "removing backend cache entry with SRID %d at index %d", srid, i);
 
-			/*
-			 * Zero out the entries and free the PROJ4 handle
-			 * by deleting the memory context
-			 */
-			MemoryContextDelete(PROJ4Cache->PROJ4SRSCache[i].projection_mcxt);
+			/* Zero out the entry and free the PROJ4 handle */
+			pj_free(PROJ4Cache->PROJ4SRSCache[i].projection);
 			PROJ4Cache->PROJ4SRSCache[i].projection = NULL;
-			PROJ4Cache->PROJ4SRSCache[i].projection_mcxt = NULL;
 			PROJ4Cache->PROJ4SRSCache[i].srid = SRID_UNKNOWN;
+			PROJ4Cache->PROJ4SRSCache[i].last_used = 0;
+			PROJ4Cache->PROJ4SRSCacheCount--;
+			PROJ4Cache->generation++;
 		}
 	}
 }
@@ -637,45 +474,30 @@ Proj4Cache GetPROJ4Cache(FunctionCallInfo fcinfo) {
 	return (Proj4Cache)GetPROJ4SRSCache(fcinfo) ;
 }
 
-static PROJ4PortalCache *GetPROJ4SRSCache(FunctionCallInfo fcinfo)
+/**
+ * Return the backend cache, after applying any pending invalidation.
+ * The first call also hooks the cache up to relcache invalidations of
+ * spatial_ref_sys.
+ */
+static PROJ4BackendCache *GetPROJ4SRSCache(FunctionCallInfo fcinfo)
 {
-	PROJ4PortalCache *PROJ4Cache ;
+	PROJ4BackendCache *PROJ4Cache = &PROJ4BackendSRSCache;
 
-	/*
-	 * If we have not already created PROJ4 cache for this portal
-	 * then create it
-	 */
-	if (fcinfo->flinfo->fn_extra == NULL)
+	if (!PROJ4CacheCallbackRegistered)
 	{
-		MemoryContext old_context;
+		CacheRegisterRelcacheCallback(PROJ4SRSCacheRelcacheCallback, (Datum) 0);
+		PROJ4CacheCallbackRegistered = true;
+	}
 
-		old_context = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
-		PROJ4Cache = palloc(sizeof(PROJ4PortalCache));
-		MemoryContextSwitchTo(old_context);
+	/* Same name resolution as the lookup query in GetProj4StringSPI */
+	if (PROJ4SRSRelid == InvalidOid)
+		PROJ4SRSRelid = RelnameGetRelid("spatial_ref_sys");
 
-		if (PROJ4Cache)
-		{
-			int i;
-
-			POSTGIS_DEBUGF(3, "Allocating PROJ4Cache for portal with transform() MemoryContext %p", fcinfo->flinfo->fn_mcxt);
-			/* Put in any required defaults */
-			for (i = 0; i < PROJ4_CACHE_ITEMS; i++)
-			{
-				PROJ4Cache->PROJ4SRSCache[i].srid = SRID_UNKNOWN;
-				PROJ4Cache->PROJ4SRSCache[i].projection = NULL;
-				PROJ4Cache->PROJ4SRSCache[i].projection_mcxt = NULL;
-			}
-			PROJ4Cache->PROJ4SRSCacheCount = 0;
-			PROJ4Cache->PROJ4SRSCacheContext = fcinfo->flinfo->fn_mcxt;
-
-			/* Store the pointer in fcinfo->flinfo->fn_extra */
-			fcinfo->flinfo->fn_extra = PROJ4Cache;
-		}
-	}
-	else
+	if (PROJ4Cache->invalid)
 	{
-		/* Use the existing cache */
-		PROJ4Cache = fcinfo->flinfo->fn_extra;
+		PROJ4SRSCacheFlush(PROJ4Cache);
+		/* The table may have been dropped and created again */
+		PROJ4SRSRelid = RelnameGetRelid("spatial_ref_sys");
 	}
 
 	return PROJ4Cache ;
@@ -686,6 +508,8 @@ int
 GetProjectionsUsingFCInfo(FunctionCallInfo fcinfo, int srid1, int srid2, projPJ *pj1, projPJ *pj2)
 {
 	Proj4Cache *proj_cache = NULL;
+	GenericCacheCollection *generic_cache;
+	PROJ4PortalCache *memo;
 
 	/* Set the search path if we haven't already */
 	SetPROJ4LibPath();
@@ -695,6 +519,20 @@ GetProjectionsUsingFCInfo(FunctionCallInfo fcinfo, int srid1, int srid2, projPJ
 	if ( !proj_cache )
 		return LW_FAILURE;
 
+	/* Same pair as the last call from here and nothing freed since? */
+	generic_cache = GetGenericCacheCollection(fcinfo);
+	memo = generic_cache->entry[PROJ_CACHE_ENTRY];
+	if ( memo && memo->srid1 == srid1 && memo->srid2 == srid2 &&
+	     memo->generation == ((PROJ4BackendCache *)proj_cache)->generation )
+	{
+		PROJ4SRSCacheItem *items = ((PROJ4BackendCache *)proj_cache)->PROJ4SRSCache;
+		items[memo->slot1].last_used = ++(((PROJ4BackendCache *)proj_cache)->clock);
+		items[memo->slot2].last_used = items[memo->slot1].last_used;
+		*pj1 = items[memo->slot1].projection;
+		*pj2 = items[memo->slot2].projection;
+		return LW_SUCCESS;
+	}
+
 	/* Add the output srid to the cache if it's not already there */
 	if (!IsInPROJ4Cache(proj_cache, srid1))
 		AddToPROJ4Cache(proj_cache, srid1, srid2);
@@ -707,6 +545,17 @@ GetProjectionsUsingFCInfo(FunctionCallInfo fcinfo, int srid1, int srid2, projPJ
 	*pj1 = GetProjectionFromPROJ4Cache(proj_cache, srid1);
 	*pj2 = GetProjectionFromPROJ4Cache(proj_cache, srid2);
 
+	if ( ! memo )
+	{
+		memo = MemoryContextAlloc(fcinfo->flinfo->fn_mcxt, sizeof(PROJ4PortalCache));
+		generic_cache->entry[PROJ_CACHE_ENTRY] = memo;
+	}
+	memo->srid1 = srid1;
+	memo->srid2 = srid2;
+	memo->slot1 = GetPROJ4SRSCacheSlot((PROJ4BackendCache *)proj_cache, srid1);
+	memo->slot2 = GetPROJ4SRSCacheSlot((PROJ4BackendCache *)proj_cache, srid2);
+	memo->generation = ((PROJ4BackendCache *)proj_cache)->generation;
+
 	return LW_SUCCESS;
 }
 
@@ -31,6 +31,7 @@ bool IsInPROJ4Cache(Proj4Cache cache, int srid) ;
 void AddToPROJ4Cache(Proj4Cache cache, int srid, int other_srid);
 void DeleteFromPROJ4Cache(Proj4Cache cache, int srid) ;
 projPJ GetProjectionFromPROJ4Cache(Proj4Cache cache, int srid);
+void InvalidatePROJ4Cache(void);
 int GetProjectionsUsingFCInfo(FunctionCallInfo fcinfo, int srid1, int srid2, projPJ *pj1, projPJ *pj2);
 int spheroid_init_from_srid(FunctionCallInfo fcinfo, int srid, SPHEROID *s);
 void srid_is_latlong(FunctionCallInfo fcinfo, int srid);
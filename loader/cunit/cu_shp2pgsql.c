@@ -17,6 +17,8 @@
 /* Test functions */
 void test_ShpLoaderCreate(void);
 void test_ShpLoaderDestroy(void);
+void test_ShpLoaderCopyBinary(void);
+void test_ShpLoaderConvertRecord(void);
 
 SHPLOADERCONFIG *loader_config;
 SHPLOADERSTATE *loader_state;
@@ -36,7 +38,9 @@ CU_pSuite register_shp2pgsql_suite(void)
 
 	if (
 	    (NULL == CU_add_test(pSuite, "test_ShpLoaderCreate()", test_ShpLoaderCreate)) ||
-	    (NULL == CU_add_test(pSuite, "test_ShpLoaderDestroy()", test_ShpLoaderDestroy))
+	    (NULL == CU_add_test(pSuite, "test_ShpLoaderDestroy()", test_ShpLoaderDestroy)) ||
+	    (NULL == CU_add_test(pSuite, "test_ShpLoaderCopyBinary()", test_ShpLoaderCopyBinary)) ||
+	    (NULL == CU_add_test(pSuite, "test_ShpLoaderConvertRecord()", test_ShpLoaderConvertRecord))
 	)
 	{
 		CU_cleanup_registry();
@@ -76,3 +80,103 @@ void test_ShpLoaderDestroy(void)
 {
 	ShpLoaderDestroy(loader_state);
 }
+
+void test_ShpLoaderCopyBinary(void)
+{
+	SHPLOADERCONFIG *config;
+	SHPLOADERSTATE *state;
+	char *buf;
+	size_t length;
+	int ret;
+
+	config = (SHPLOADERCONFIG*)calloc(1, sizeof(SHPLOADERCONFIG));
+	set_loader_config_defaults(config);
+	config->dump_format = 1;
+	config->copy_binary = 1;
+	config->shp_file = "../../regress/loader/Point";
+	config->table = "point";
+	state = ShpLoaderCreate(config);
+	ret = ShpLoaderOpenShape(state);
+	CU_ASSERT_EQUAL(ret, SHPLOADEROK);
+	if (ret != SHPLOADEROK)
+		return;
+
+	ShpLoaderGetSQLCopyStatement(state, &buf);
+	CU_ASSERT_STRING_EQUAL(buf, "COPY \"point\" (geom) FROM stdin WITH BINARY;\n");
+	free(buf);
+
+	ShpLoaderGetCopyBinaryHeader(state, &buf, &length);
+	CU_ASSERT_EQUAL(length, 19);
+	CU_ASSERT(memcmp(buf, "PGCOPY\n\377\r\n\0\0\0\0\0\0\0\0\0", 19) == 0);
+	free(buf);
+
+	/* One field, a 2D point as 21 bytes of WKB */
+	ret = ShpLoaderGenerateCopyBinaryRow(state, 0, &buf, &length);
+	CU_ASSERT_EQUAL(ret, SHPLOADEROK);
+	CU_ASSERT_EQUAL(length, 2 + 4 + 21);
+	CU_ASSERT(memcmp(buf, "\0\1\0\0\0\25\1\1\0\0\0", 11) == 0);
+	free(buf);
+
+	ShpLoaderGetCopyBinaryTrailer(state, &buf, &length);
+	CU_ASSERT_EQUAL(length, 2);
+	CU_ASSERT(memcmp(buf, "\377\377", 2) == 0);
+	free(buf);
+
+	ShpLoaderDestroy(state);
+	free(config);
+}
+
+void test_ShpLoaderConvertRecord(void)
+{
+	SHPLOADERCONFIG *config;
+	SHPLOADERSTATE *state;
+	SHPLOADERSTATE copy;
+	SHPLOADERRECORD record;
+	char *expected, *row;
+	size_t length;
+	int ret, i;
+
+	config = (SHPLOADERCONFIG*)calloc(1, sizeof(SHPLOADERCONFIG));
+	set_loader_config_defaults(config);
+	config->dump_format = 1;
+	config->shp_file = "../../regress/loader/PointM";
+	config->table = "pointm";
+	state = ShpLoaderCreate(config);
+	ret = ShpLoaderOpenShape(state);
+	CU_ASSERT_EQUAL(ret, SHPLOADEROK);
+	if (ret != SHPLOADEROK)
+		return;
+
+	/* Reading and converting separately, on a copy of the state as a thread would,
+	   gives the same rows as generating them in one go */
+	for (i = 0; i < ShpLoaderGetRecordCount(state); i++)
+	{
+		ret = ShpLoaderGenerateSQLRowStatement(state, i, &expected);
+		CU_ASSERT_EQUAL(ret, SHPLOADEROK);
+
+		ret = ShpLoaderReadRecordData(state, i, &record);
+		CU_ASSERT_EQUAL(ret, SHPLOADEROK);
+		CU_ASSERT_EQUAL(record.item, i);
+		CU_ASSERT_EQUAL(record.obj.nSHPType, SHPT_POINTM);
+		CU_ASSERT_EQUAL(record.obj.nVertices, 1);
+		CU_ASSERT_PTR_NOT_NULL(record.obj.pabyXY);
+		CU_ASSERT_PTR_NOT_NULL(record.obj.pabyM);
+		CU_ASSERT_PTR_NULL(record.obj.pabyZ);
+
+		copy = *state;
+		ret = ShpLoaderConvertRecord(&copy, &record, &row, &length);
+		CU_ASSERT_EQUAL(ret, SHPLOADEROK);
+		CU_ASSERT_STRING_EQUAL(row, expected);
+		CU_ASSERT_EQUAL(length, strlen(expected));
+
+		ShpLoaderFreeRecord(state, &record);
+		CU_ASSERT_PTR_NULL(record.obj.pabyXY);
+		CU_ASSERT_EQUAL(record.obj.nVertices, 0);
+		CU_ASSERT_PTR_NULL(record.values);
+		free(row);
+		free(expected);
+	}
+
+	ShpLoaderDestroy(state);
+	free(config);
+}
@@ -76,6 +76,17 @@ SHP_CVSID("$Id: safileio.c,v 1.4 2008-01-16 20:05:14 bram Exp $");
 #   endif
 #endif
 
+#ifndef SHPAPI_WINDOWS
+#   include <unistd.h>
+#   if defined(_POSIX_MAPPED_FILES) && _POSIX_MAPPED_FILES > 0
+#       include <fcntl.h>
+#       include <sys/types.h>
+#       include <sys/stat.h>
+#       include <sys/mman.h>
+#       define SAMMAP_AVAILABLE
+#   endif
+#endif
+
 /* Local prototypes */
 SAFile SADFOpen( const char *pszFilename, const char *pszAccess );
 SAOffset SADFRead( void *p, SAOffset size, SAOffset nmemb, SAFile file );
@@ -206,6 +217,246 @@ void SASetupDefaultHooks( SAHooks *psHooks )
 
     psHooks->Error   = SADError;
     psHooks->Atof    = atof;
+    psHooks->FMap    = NULL;
+}
+
+
+#ifdef SAMMAP_AVAILABLE
+
+/*
+ * Memory mapped files. Files opened read-only are mapped whole, reads are
+ * copies out of the mapping and FMap() hands out pointers straight into
+ * it. Anything else, or a file that cannot be mapped, goes through stdio.
+ */
+typedef struct
+{
+    FILE          *fp;          /* stdio stream when the file is not mapped */
+    unsigned char *pabyData;    /* the mapping */
+    SAOffset       nSize;
+    SAOffset       nPos;
+} SAMmapFile;
+
+/************************************************************************/
+/*                            SAMmapFOpen()                             */
+/************************************************************************/
+
+static SAFile SAMmapFOpen( const char *pszFilename, const char *pszAccess )
+
+{
+    SAMmapFile *psFile;
+    struct stat sStat;
+    void *pData;
+    int fd;
+
+    psFile = (SAMmapFile *) calloc( 1, sizeof(SAMmapFile) );
+    if( psFile == NULL )
+        return NULL;
+
+    if( strcmp( pszAccess, "rb" ) == 0 || strcmp( pszAccess, "r" ) == 0 )
+    {
+        fd = open( pszFilename, O_RDONLY );
+        if( fd < 0 )
+        {
+            free( psFile );
+            return NULL;
+        }
+
+        if( fstat( fd, &sStat ) == 0 && sStat.st_size > 0
+            && (unsigned long long) sStat.st_size <= (size_t) -1 )
+        {
+            pData = mmap( NULL, (size_t) sStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+            if( pData != MAP_FAILED )
+            {
+#ifdef MADV_SEQUENTIAL
+                /* Shapes and records are mostly read in order */
+                madvise( pData, (size_t) sStat.st_size, MADV_SEQUENTIAL );
+#endif
+                psFile->pabyData = (unsigned char *) pData;
+                psFile->nSize = (SAOffset) sStat.st_size;
+            }
+        }
+        close( fd );
+
+        if( psFile->pabyData != NULL )
+            return (SAFile) psFile;
+    }
+
+    psFile->fp = fopen( pszFilename, pszAccess );
+    if( psFile->fp == NULL )
+    {
+        free( psFile );
+        return NULL;
+    }
+
+    return (SAFile) psFile;
+}
+
+/************************************************************************/
+/*                            SAMmapFRead()                             */
+/************************************************************************/
+
+static SAOffset SAMmapFRead( void *p, SAOffset size, SAOffset nmemb, SAFile file )
+
+{
+    SAMmapFile *psFile = (SAMmapFile *) file;
+    SAOffset nAvailable;
+
+    if( psFile->pabyData == NULL )
+        return SADFRead( p, size, nmemb, (SAFile) psFile->fp );
+
+    if( size == 0 || psFile->nPos >= psFile->nSize )
+        return 0;
+
+    nAvailable = (psFile->nSize - psFile->nPos) / size;
+    if( nmemb > nAvailable )
+        nmemb = nAvailable;
+
+    memcpy( p, psFile->pabyData + psFile->nPos, (size_t) (size * nmemb) );
+    psFile->nPos += size * nmemb;
+
+    return nmemb;
+}
+
+/************************************************************************/
+/*                            SAMmapFWrite()                            */
+/************************************************************************/
+
+static SAOffset SAMmapFWrite( void *p, SAOffset size, SAOffset nmemb, SAFile file )
+
+{
+    SAMmapFile *psFile = (SAMmapFile *) file;
+
+    /* Mapped files are read-only */
+    if( psFile->pabyData != NULL )
+        return 0;
+
+    return SADFWrite( p, size, nmemb, (SAFile) psFile->fp );
+}
+
+/************************************************************************/
+/*                            SAMmapFSeek()                             */
+/************************************************************************/
+
+static SAOffset SAMmapFSeek( SAFile file, SAOffset offset, int whence )
+
+{
+    SAMmapFile *psFile = (SAMmapFile *) file;
+
+    if( psFile->pabyData == NULL )
+        return SADFSeek( (SAFile) psFile->fp, offset, whence );
+
+    switch( whence )
+    {
+      case SEEK_SET:
+        psFile->nPos = offset;
+        break;
+      case SEEK_CUR:
+        psFile->nPos += offset;
+        break;
+      case SEEK_END:
+        psFile->nPos = psFile->nSize + offset;
+        break;
+      default:
+        return -1;
+    }
+
+    return 0;
+}
+
+/************************************************************************/
+/*                            SAMmapFTell()                             */
+/************************************************************************/
+
+static SAOffset SAMmapFTell( SAFile file )
+
+{
+    SAMmapFile *psFile = (SAMmapFile *) file;
+
+    if( psFile->pabyData == NULL )
+        return SADFTell( (SAFile) psFile->fp );
+
+    return psFile->nPos;
+}
+
+/************************************************************************/
+/*                            SAMmapFFlush()                            */
+/************************************************************************/
+
+static int SAMmapFFlush( SAFile file )
+
+{
+    SAMmapFile *psFile = (SAMmapFile *) file;
+
+    if( psFile->pabyData == NULL )
+        return SADFFlush( (SAFile) psFile->fp );
+
+    return 0;
+}
+
+/************************************************************************/
+/*                            SAMmapFClose()                            */
+/************************************************************************/
+
+static int SAMmapFClose( SAFile file )
+
+{
+    SAMmapFile *psFile = (SAMmapFile *) file;
+    int nRet;
+
+    if( psFile->pabyData != NULL )
+        nRet = munmap( psFile->pabyData, (size_t) psFile->nSize );
+    else
+        nRet = SADFClose( (SAFile) psFile->fp );
+
+    free( psFile );
+
+    return nRet;
+}
+
+/************************************************************************/
+/*                             SAMmapFMap()                             */
+/*                                                                      */
+/*      Pointer to size bytes at offset in the mapping, which stays     */
+/*      valid until the file is closed, or NULL if the file is not      */
+/*      mapped or too short.                                            */
+/************************************************************************/
+
+static const unsigned char *SAMmapFMap( SAFile file, SAOffset offset, SAOffset size )
+
+{
+    SAMmapFile *psFile = (SAMmapFile *) file;
+
+    if( psFile->pabyData == NULL
+        || offset > psFile->nSize || size > psFile->nSize - offset )
+        return NULL;
+
+    return psFile->pabyData + offset;
+}
+
+#endif
+
+/************************************************************************/
+/*                          SASetupMmapHooks()                          */
+/*                                                                      */
+/*      Hooks reading files through memory mappings where the platform  */
+/*      supports it, the default hooks elsewhere.                       */
+/************************************************************************/
+
+void SASetupMmapHooks( SAHooks *psHooks )
+
+{
+    SASetupDefaultHooks( psHooks );
+
+#ifdef SAMMAP_AVAILABLE
+    psHooks->FOpen   = SAMmapFOpen;
+    psHooks->FRead   = SAMmapFRead;
+    psHooks->FWrite  = SAMmapFWrite;
+    psHooks->FSeek   = SAMmapFSeek;
+    psHooks->FTell   = SAMmapFTell;
+    psHooks->FFlush  = SAMmapFFlush;
+    psHooks->FClose  = SAMmapFClose;
+    psHooks->FMap    = SAMmapFMap;
+#endif
 }
 
 
@@ -301,6 +552,7 @@ void SASetupUtf8Hooks( SAHooks *psHooks )
 
     psHooks->Error   = SADError;
     psHooks->Atof    = atof;
+    psHooks->FMap    = NULL;
 }
 
 #endif
@@ -264,9 +264,14 @@ typedef struct {
 
     void       (*Error) ( const char *message );
     double     (*Atof)  ( const char *str );
+
+    /* Optional, may be NULL: pointer to size bytes at offset of a file */
+    /* held in memory, valid until the file is closed, or NULL.        */
+    const unsigned char *(*FMap) ( SAFile file, SAOffset offset, SAOffset size );
 } SAHooks;
 
 void SHPAPI_CALL SASetupDefaultHooks( SAHooks *psHooks );
+void SHPAPI_CALL SASetupMmapHooks( SAHooks *psHooks );
 #ifdef SHPAPI_UTF8_HOOKS
 void SHPAPI_CALL SASetupUtf8Hooks( SAHooks *psHooks );
 #endif
@@ -365,6 +370,34 @@ typedef struct
     int		bMeasureIsUsed;
 } SHPObject;
 
+/* -------------------------------------------------------------------- */
+/*      SHPObjectView - a shape read in place. The arrays are left as   */
+/*      they are in the file, little endian and possibly unaligned:     */
+/*      part starts (and part types for multipatches) as int32, X/Y as  */
+/*      interleaved pairs of doubles, Z and M as arrays of doubles.     */
+/*      pabyZ and pabyM are NULL when the shape has no Z or M. With     */
+/*      hooks that map the file (FMap) they point into the mapping and  */
+/*      stay valid until the file is closed, otherwise into a copy of   */
+/*      the record owned by the view.                                   */
+/* -------------------------------------------------------------------- */
+typedef struct
+{
+    int		nSHPType;
+
+    int		nShapeId;
+
+    int		nParts;
+    const unsigned char *pabyPartStart;
+    const unsigned char *pabyPartType;
+
+    int		nVertices;
+    const unsigned char *pabyXY;
+    const unsigned char *pabyZ;
+    const unsigned char *pabyM;
+
+    unsigned char *pabyRecCopy;
+} SHPObjectView;
+
 /* -------------------------------------------------------------------- */
 /*      SHP API Prototypes                                              */
 /* -------------------------------------------------------------------- */
@@ -392,6 +425,10 @@ int SHPAPI_CALL
 
 void SHPAPI_CALL
       SHPDestroyObject( SHPObject * psObject );
+int SHPAPI_CALL
+      SHPReadObjectView( SHPHandle hSHP, int iShape, SHPObjectView * psView );
+void SHPAPI_CALL
+      SHPReleaseObjectView( SHPObjectView * psView );
 void SHPAPI_CALL
       SHPComputeExtents( SHPObject * psObject );
 SHPObject SHPAPI_CALL1(*)
@@ -16,8 +16,113 @@
 #include "../postgis_config.h"
 
 #include "shp2pgsql-core.h"
+#include "shp2pgsql-pipeline.h"
 #include "../liblwgeom/liblwgeom.h" /* for SRID_UNKNOWN */
 
+#include "libpq-fe.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+/* Server connection when loading directly (-C), NULL when writing to stdout */
+static PGconn *conn = NULL;
+
+/* Report a failed command on the server connection and stop */
+static void
+server_error(const char *what)
+{
+	fprintf(stderr, "%s: %s", what, PQerrorMessage(conn));
+	PQfinish(conn);
+	exit(1);
+}
+
+/* Run SQL on the server, or print it */
+static void
+send_sql(const char *sql)
+{
+	PGresult *res;
+
+	if (!conn)
+	{
+		printf("%s", sql);
+		return;
+	}
+
+	res = PQexec(conn, sql);
+	switch (PQresultStatus(res))
+	{
+	case PGRES_COMMAND_OK:
+	case PGRES_TUPLES_OK:
+	case PGRES_EMPTY_QUERY:
+	case PGRES_COPY_IN:
+		break;
+	default:
+		server_error(_("Error executing SQL"));
+	}
+	PQclear(res);
+}
+
+/* Send a piece of COPY data to the server, or write it out */
+static void
+send_copy_data(const char *data, size_t length)
+{
+	if (!conn)
+	{
+		fwrite(data, 1, length, stdout);
+		return;
+	}
+
+	if (PQputCopyData(conn, data, length) != 1)
+		server_error(_("Error sending COPY data"));
+}
+
+/* Finish a COPY on the server */
+static void
+end_copy(void)
+{
+	PGresult *res;
+
+	if (PQputCopyEnd(conn, NULL) != 1)
+		server_error(_("Error ending COPY"));
+
+	res = PQgetResult(conn);
+	if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		server_error(_("Error loading COPY data"));
+	PQclear(res);
+}
+
+/* Output a record: run or print an INSERT, or send a COPY row */
+static void
+send_record(SHPLOADERSTATE *state, char *record, size_t length)
+{
+	if (state->config->copy_binary)
+	{
+		send_copy_data(record, length);
+	}
+	else if (state->config->dump_format)
+	{
+		if (conn)
+		{
+			send_copy_data(record, strlen(record));
+			send_copy_data("\n", 1);
+		}
+		else
+		{
+			printf("%s\n", record);
+		}
+	}
+	else if (conn)
+	{
+		send_sql(record);
+	}
+	else
+	{
+		printf("%s\n", record);
+	}
+}
+
 static void
 usage()
 {
@@ -38,6 +143,15 @@ usage()
 	printf(_( "  -g <geocolumn> Specify the name of the geometry/geography column\n"
 	          "      (mostly useful in append mode).\n" ));
 	printf(_( "  -D  Use postgresql dump format (defaults to SQL insert statements).\n" ));
+	printf(_( "  -B  Use binary COPY format, sending raw EWKB geometries and typed\n"
+	          "      attributes. Without -C only the COPY data is written, for a\n"
+	          "      COPY ... FROM stdin WITH BINARY into an existing table.\n" ));
+	printf(_( "  -C <conninfo> Load directly into the database through the given\n"
+	          "      libpq connection string instead of writing to stdout.\n" ));
+	printf(_( "  -j <threads> Convert the records with this many threads, while another\n"
+	          "      one reads the files (default: 1, no extra threads).\n" ));
+	printf(_( "  -u  With -j, output the rows in whatever order they are ready\n"
+	          "      instead of the order of the shapefile.\n" ));
 	printf(_( "  -e  Execute each statement individually, do not use a transaction.\n"
 	          "      Not compatible with -D.\n" ));
 	printf(_( "  -G  Use geography type (requires lon/lat data or -r to reproject).\n" ));
@@ -66,7 +180,12 @@ main (int argc, char **argv)
 {
 	SHPLOADERCONFIG *config;
 	SHPLOADERSTATE *state;
+	SHPLOADERPIPELINE *pipeline;
 	char *header, *footer, *record;
+	char *conninfo = NULL;
+	size_t length = 0;
+	int nthreads = 1;
+	int ordered = 1;
 	int c;
 	int ret, i;
 
@@ -88,7 +207,7 @@ main (int argc, char **argv)
 	set_loader_config_defaults(config);
 
 	/* Keep the flag list alphabetic so it's easy to see what's left. */
-	while ((c = pgis_getopt(argc, argv, "acdeg:iknps:wDGIN:ST:W:X:")) != EOF)
+	while ((c = pgis_getopt(argc, argv, "acdeg:ij:knps:uwBC:DGIN:ST:W:X:")) != EOF)
 	{
 		switch (c)
 		{
@@ -99,6 +218,10 @@ main (int argc, char **argv)
 			config->opt = c;
 			break;
 
+		case 'B':
+			/* Binary COPY is a flavour of the dump format */
+			config->copy_binary = 1;
+			/* fall through */
 		case 'D':
 			config->dump_format = 1;
 			if (!config->usetransaction)
@@ -113,6 +236,10 @@ main (int argc, char **argv)
 			}
 			break;
 
+		case 'C':
+			conninfo = pgis_optarg;
+			break;
+
 		case 'G':
 			config->geography = 1;
 			break;
@@ -165,6 +292,19 @@ main (int argc, char **argv)
 			config->createindex = 1;
 			break;
 
+		case 'j':
+			nthreads = atoi(pgis_optarg);
+			if (nthreads < 1)
+			{
+				fprintf(stderr, "Invalid number of threads: %s\n", pgis_optarg);
+				exit(1);
+			}
+			break;
+
+		case 'u':
+			ordered = 0;
+			break;
+
 		case 'w':
 			config->use_wkt = 1;
 			break;
@@ -222,6 +362,12 @@ main (int argc, char **argv)
 		}
 	}
 
+	if (config->copy_binary && config->use_wkt)
+	{
+		fprintf(stderr, "Cannot use both -B and -w.\n");
+		exit(1);
+	}
+
 	/* Determine the shapefile name from the next argument, if no shape file, exit. */
 	if (pgis_optind < argc)
 	{
@@ -309,7 +455,22 @@ main (int argc, char **argv)
 		fprintf(stderr, "Postgis type: %s[%d]\n", state->pgtype, state->pgdims);
 	}
 
-	/* Print the header to stdout */
+	/* Connect to the server if loading directly */
+	if (conninfo)
+	{
+		conn = PQconnectdb(conninfo);
+		if (PQstatus(conn) != CONNECTION_OK)
+			server_error(_("Unable to connect to the database"));
+	}
+	else if (state->config->copy_binary)
+	{
+#ifdef _WIN32
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+	}
+
+	/* Print the header to stdout. Binary COPY data can't be followed by
+	   anything else, so only the data itself is written in that case. */
 	ret = ShpLoaderGetSQLHeader(state, &header);
 	if (ret != SHPLOADEROK)
 	{
@@ -319,7 +480,8 @@ main (int argc, char **argv)
 			exit(1);
 	}
 
-	printf("%s", header);
+	if (conn || !state->config->copy_binary)
+		send_sql(header);
 	free(header);
 
 	/* If we are not in "prepare" mode, go ahead and write out the data. */
@@ -338,20 +500,29 @@ main (int argc, char **argv)
 					exit(1);
 			}
 
-			printf("%s", header);
+			if (conn || !state->config->copy_binary)
+				send_sql(header);
+			free(header);
+		}
+
+		if (state->config->copy_binary)
+		{
+			ShpLoaderGetCopyBinaryHeader(state, &header, &length);
+			send_copy_data(header, length);
 			free(header);
 		}
 
 		/* Main loop: iterate through all of the records and send them to stdout */
+		pipeline = ShpLoaderPipelineCreate(state, nthreads, ordered);
 		for (i = 0; i < ShpLoaderGetRecordCount(state); i++)
 		{
-			ret = ShpLoaderGenerateSQLRowStatement(state, i, &record);
+			ret = ShpLoaderPipelineNextRow(pipeline, &record, &length);
 
 			switch (ret)
 			{
 			case SHPLOADEROK:
 				/* Simply display the geometry */
-				printf("%s\n", record);
+				send_record(state, record, length);
 				free(record);
 				break;
 
@@ -364,7 +535,7 @@ main (int argc, char **argv)
 			case SHPLOADERWARN:
 				/* Display the warning, but continue */
 				fprintf(stderr, "%s\n", state->message);
-				printf("%s\n", record);
+				send_record(state, record, length);
 				free(record);
 				break;
 
@@ -377,10 +548,22 @@ main (int argc, char **argv)
 				break;
 			}
 		}
+		ShpLoaderPipelineDestroy(pipeline);
 
 		/* If in COPY mode, terminate the COPY statement */
+		if (state->config->copy_binary)
+		{
+			ShpLoaderGetCopyBinaryTrailer(state, &footer, &length);
+			send_copy_data(footer, length);
+			free(footer);
+		}
 		if (state->config->dump_format)
-			printf("\\.\n");
+		{
+			if (conn)
+				end_copy();
+			else if (!state->config->copy_binary)
+				printf("\\.\n");
+		}
 
 	}
 
@@ -394,9 +577,13 @@ main (int argc, char **argv)
 			exit(1);
 	}
 
-	printf("%s", footer);
+	if (conn || !state->config->copy_binary)
+		send_sql(footer);
 	free(footer);
 
+	if (conn)
+		PQfinish(conn);
+
 
 	/* Free the state object */
 	ShpLoaderDestroy(state);
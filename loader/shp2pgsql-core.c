@@ -28,9 +28,9 @@ typedef struct struct_point
 
 typedef struct struct_ring
 {
-	Point *list;		/* list of points */
+	POINTARRAY *pa;		/* points, possibly referencing the shape view */
 	struct struct_ring *next;
-	int n;			/* number of points in list */
+	int n;			/* number of points in pa */
 	unsigned int linked; 	/* number of "next" rings */
 } Ring;
 
@@ -47,12 +47,13 @@ int utf8(const char *fromcode, char *inputbuf, char **outputbuf);
 char *escape_copy_string(char *str);
 char *escape_insert_string(char *str);
 
-int GeneratePointGeometry(SHPLOADERSTATE *state, SHPObject *obj, char **geometry, int force_multi);
-int GenerateLineStringGeometry(SHPLOADERSTATE *state, SHPObject *obj, char **geometry);
-int PIP(Point P, Point *V, int n);
-int FindPolygons(SHPObject *obj, Ring ***Out);
+char *GenerateGeometryString(SHPLOADERSTATE *state, LWGEOM *lwgeom);
+int GeneratePointGeometry(SHPLOADERSTATE *state, const SHPObjectView *obj, char **geometry, int force_multi);
+int GenerateLineStringGeometry(SHPLOADERSTATE *state, const SHPObjectView *obj, char **geometry);
+int PIP(Point P, const POINTARRAY *pa);
+int FindPolygons(SHPLOADERSTATE *state, const SHPObjectView *obj, Ring ***Out);
 void ReleasePolygons(Ring **polys, int npolys);
-int GeneratePolygonGeometry(SHPLOADERSTATE *state, SHPObject *obj, char **geometry);
+int GeneratePolygonGeometry(SHPLOADERSTATE *state, const SHPObjectView *obj, char **geometry);
 
 /* Append variadic formatted string to a stringbuffer */
 void
@@ -239,23 +240,146 @@ escape_insert_string(char *str)
 }
 
 
+/**
+ * @brief Serialize lwgeom in the output format of the configuration: hex encoded EWKB,
+ * or EWKT with -w, for SQL and text COPY. For binary COPY the output is instead a complete
+ * field, the EWKB preceded by its length as a network order int32, so it is not a string.
+ */
+char *
+GenerateGeometryString(SHPLOADERSTATE *state, LWGEOM *lwgeom)
+{
+	uint8_t *wkb;
+	char *mem;
+	size_t mem_length;
+
+	if (state->config->copy_binary)
+	{
+		wkb = lwgeom_to_wkb(lwgeom, WKB_EXTENDED, &mem_length);
+		if (!wkb)
+			return NULL;
+
+		mem = malloc(mem_length + 4);
+		mem[0] = (mem_length >> 24) & 0xff;
+		mem[1] = (mem_length >> 16) & 0xff;
+		mem[2] = (mem_length >> 8) & 0xff;
+		mem[3] = mem_length & 0xff;
+		memcpy(mem + 4, wkb, mem_length);
+		lwfree(wkb);
+
+		return mem;
+	}
+
+	if (state->config->use_wkt)
+		return lwgeom_to_wkt(lwgeom, WKT_EXTENDED, WKT_PRECISION, &mem_length);
+
+	return lwgeom_to_hexwkb(lwgeom, WKB_EXTENDED, &mem_length);
+}
+
+
+/* Shapefiles are little endian, so vertices can only be used in place on little endian hosts */
+static int
+host_is_little_endian(void)
+{
+	static const int one = 1;
+
+	return *((const char *)&one) == 1;
+}
+
+
+/* Return value i of an array of doubles of a shape view, which may be unaligned */
+static double
+view_double(const unsigned char *data, int i)
+{
+	unsigned char buf[8];
+	double d;
+	int j;
+
+	if (host_is_little_endian())
+	{
+		memcpy(&d, data + 8 * i, 8);
+		return d;
+	}
+
+	for (j = 0; j < 8; j++)
+		buf[j] = data[8 * i + 7 - j];
+	memcpy(&d, buf, 8);
+
+	return d;
+}
+
+
+/*
+ * Return a POINTARRAY holding vertices start to end - 1 of shape view obj, in the dimensions of
+ * the output. Consecutive repeated points are dropped unless repeated_points is set, as with
+ * ptarray_append_point. When the output is 2D and the vertices can be used as they are in the
+ * file, the array references them instead of copying, so it must not outlive the view.
+ */
+static POINTARRAY *
+view_point_array(SHPLOADERSTATE *state, const SHPObjectView *obj, int start, int end, int repeated_points)
+{
+	POINTARRAY *pa;
+	POINT4D point4d;
+	int v;
+
+	if (!state->has_z && !state->has_m && host_is_little_endian() &&
+	        ((size_t)obj->pabyXY) % sizeof(double) == 0)
+	{
+		const double *xy = (const double *)(obj->pabyXY + 16 * start);
+
+		for (v = 1; v < end - start && !repeated_points; v++)
+		{
+			if (xy[2 * v] == xy[2 * v - 2] && xy[2 * v + 1] == xy[2 * v - 1])
+				break;
+		}
+
+		if (repeated_points || v >= end - start)
+			return ptarray_construct_reference_data(0, 0, end - start, (uint8_t *)xy);
+	}
+
+	pa = ptarray_construct_empty(state->has_z, state->has_m, end - start);
+
+	for (v = start; v < end; v++)
+	{
+		point4d.x = view_double(obj->pabyXY, 2 * v);
+		point4d.y = view_double(obj->pabyXY, 2 * v + 1);
+		point4d.z = obj->pabyZ ? view_double(obj->pabyZ, v) : 0.0;
+		point4d.m = obj->pabyM ? view_double(obj->pabyM, v) : 0.0;
+
+		ptarray_append_point(pa, &point4d, repeated_points);
+	}
+
+	return pa;
+}
+
+
+/* Return the first vertex of part i of shape view obj */
+static int
+view_part_start(const SHPObjectView *obj, int i)
+{
+	unsigned char buf[4];
+	int32_t start;
+
+	memcpy(buf, obj->pabyPartStart + 4 * i, 4);
+	start = (int32_t)((uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24));
+
+	return start;
+}
+
+
 /**
  * @brief Generate an allocated geometry string for shapefile object obj using the state parameters
  * if "force_multi" is true, single points will instead be created as multipoints with a single vertice.
  */
 int
-GeneratePointGeometry(SHPLOADERSTATE *state, SHPObject *obj, char **geometry, int force_multi)
+GeneratePointGeometry(SHPLOADERSTATE *state, const SHPObjectView *obj, char **geometry, int force_multi)
 {
 	LWGEOM **lwmultipoints;
 	LWGEOM *lwgeom = NULL;
 
-	POINT4D point4d;
-
 	int dims = 0;
 	int u;
 
 	char *mem;
-	size_t mem_length;
 
 	FLAGS_SET_Z(dims, state->has_z);
 	FLAGS_SET_M(dims, state->has_m);
@@ -267,19 +391,7 @@ GeneratePointGeometry(SHPLOADERSTATE *state, SHPObject *obj, char **geometry, in
 	for (u = 0; u < obj->nVertices; u++)
 	{
 		/* Create a ptarray containing a single point */
-		POINTARRAY *pa = ptarray_construct_empty(state->has_z, state->has_m, 1);
-		
-		/* Generate the point */
-		point4d.x = obj->padfX[u];
-		point4d.y = obj->padfY[u];
-
-		if (state->has_z)
-			point4d.z = obj->padfZ[u];
-		if (state->has_m)
-			point4d.m = obj->padfM[u];
-
-		/* Add in the point! */
-		ptarray_append_point(pa, &point4d, LW_TRUE);
+		POINTARRAY *pa = view_point_array(state, obj, u, u + 1, LW_TRUE);
 
 		/* Generate the LWPOINT */
 		lwmultipoints[u] = lwpoint_as_lwgeom(lwpoint_construct(state->from_srid, NULL, pa));
@@ -297,14 +409,7 @@ GeneratePointGeometry(SHPLOADERSTATE *state, SHPObject *obj, char **geometry, in
 		lwfree(lwmultipoints);
 	}
 
-	if (state->config->use_wkt)
-	{
-		mem = lwgeom_to_wkt(lwgeom, WKT_EXTENDED, WKT_PRECISION, &mem_length);
-	}
-	else
-	{
-		mem = lwgeom_to_hexwkb(lwgeom, WKB_EXTENDED, &mem_length);
-	}
+	mem = GenerateGeometryString(state, lwgeom);
 
 	if ( !mem )
 	{
@@ -326,16 +431,14 @@ GeneratePointGeometry(SHPLOADERSTATE *state, SHPObject *obj, char **geometry, in
  * @brief Generate an allocated geometry string for shapefile object obj using the state parameters
  */
 int
-GenerateLineStringGeometry(SHPLOADERSTATE *state, SHPObject *obj, char **geometry)
+GenerateLineStringGeometry(SHPLOADERSTATE *state, const SHPObjectView *obj, char **geometry)
 {
 
 	LWGEOM **lwmultilinestrings;
 	LWGEOM *lwgeom = NULL;
-	POINT4D point4d;
 	int dims = 0;
-	int u, v, start_vertex, end_vertex;
+	int u, start_vertex, end_vertex;
 	char *mem;
-	size_t mem_length;
 
 
 	FLAGS_SET_Z(dims, state->has_z);
@@ -354,31 +457,19 @@ GenerateLineStringGeometry(SHPLOADERSTATE *state, SHPObject *obj, char **geometr
 	/* We need an array of pointers to each of our sub-geometries */
 	for (u = 0; u < obj->nParts; u++)
 	{
-		/* Create a ptarray containing the line points */
-		POINTARRAY *pa = ptarray_construct_empty(state->has_z, state->has_m, obj->nParts);
+		POINTARRAY *pa;
 
 		/* Set the start/end vertices depending upon whether this is
 		a MULTILINESTRING or not */
 		if ( u == obj->nParts-1 )
 			end_vertex = obj->nVertices;
 		else
-			end_vertex = obj->panPartStart[u + 1];
+			end_vertex = view_part_start(obj, u + 1);
 
-		start_vertex = obj->panPartStart[u];
+		start_vertex = view_part_start(obj, u);
 
-		for (v = start_vertex; v < end_vertex; v++)
-		{
-			/* Generate the point */
-			point4d.x = obj->padfX[v];
-			point4d.y = obj->padfY[v];
-
-			if (state->has_z)
-				point4d.z = obj->padfZ[v];
-			if (state->has_m)
-				point4d.m = obj->padfM[v];
-
-			ptarray_append_point(pa, &point4d, LW_FALSE);
-		}
+		/* Create a ptarray containing the line points */
+		pa = view_point_array(state, obj, start_vertex, end_vertex, LW_FALSE);
 
 		/* Generate the LWLINE */
 		lwmultilinestrings[u] = lwline_as_lwgeom(lwline_construct(state->from_srid, NULL, pa));
@@ -395,10 +486,7 @@ GenerateLineStringGeometry(SHPLOADERSTATE *state, SHPObject *obj, char **geometr
 		lwfree(lwmultilinestrings);
 	}
 
-	if (!state->config->use_wkt)
-		mem = lwgeom_to_hexwkb(lwgeom, WKB_EXTENDED, &mem_length);
-	else
-		mem = lwgeom_to_wkt(lwgeom, WKT_EXTENDED, WKT_PRECISION, &mem_length);
+	mem = GenerateGeometryString(state, lwgeom);
 
 	if ( !mem )
 	{
@@ -419,23 +507,27 @@ GenerateLineStringGeometry(SHPLOADERSTATE *state, SHPObject *obj, char **geometr
 /**
  * @brief PIP(): crossing number test for a point in a polygon
  *      input:   P = a point,
- *               V[] = vertex points of a polygon V[n+1] with V[n]=V[0]
+ *               pa = vertex points of a polygon V[n+1] with V[n]=V[0]
  * @return   0 = outside, 1 = inside
  */
 int
-PIP(Point P, Point *V, int n)
+PIP(Point P, const POINTARRAY *pa)
 {
 	int cn = 0;    /* the crossing number counter */
 	int i;
+	POINT2D V0, V1;
 
 	/* loop through all edges of the polygon */
-	for (i = 0; i < n-1; i++)      /* edge from V[i] to V[i+1] */
+	for (i = 0; i < pa->npoints-1; i++)      /* edge from V0 = V[i] to V1 = V[i+1] */
 	{
-		if (((V[i].y <= P.y) && (V[i + 1].y > P.y))    /* an upward crossing */
-		        || ((V[i].y > P.y) && (V[i + 1].y <= P.y)))   /* a downward crossing */
+		getPoint2d_p(pa, i, &V0);
+		getPoint2d_p(pa, i + 1, &V1);
+
+		if (((V0.y <= P.y) && (V1.y > P.y))    /* an upward crossing */
+		        || ((V0.y > P.y) && (V1.y <= P.y)))   /* a downward crossing */
 		{
-			double vt = (float)(P.y - V[i].y) / (V[i + 1].y - V[i].y);
-			if (P.x < V[i].x + vt * (V[i + 1].x - V[i].x)) /* P.x < intersect */
+			double vt = (float)(P.y - V0.y) / (V1.y - V0.y);
+			if (P.x < V0.x + vt * (V1.x - V0.x)) /* P.x < intersect */
 				++cn;   /* a valid crossing of y=P.y right of P.x */
 		}
 	}
@@ -445,7 +537,7 @@ PIP(Point P, Point *V, int n)
 
 
 int
-FindPolygons(SHPObject *obj, Ring ***Out)
+FindPolygons(SHPLOADERSTATE *state, const SHPObjectView *obj, Ring ***Out)
 {
 	Ring **Outer;    /* Pointers to Outer rings */
 	int out_index=0; /* Count of Outer rings */
@@ -478,42 +570,34 @@ FindPolygons(SHPObject *obj, Ring ***Out)
 		if (pi == obj->nParts - 1)
 			ve = obj->nVertices;
 		else
-			ve = obj->panPartStart[pi + 1];
+			ve = view_part_start(obj, pi + 1);
 
-		vs = obj->panPartStart[pi];
+		vs = view_part_start(obj, pi);
 
 		/* Compute number of vertexes */
 		nv = ve - vs;
 
 		/* Allocate memory for a ring */
 		ring = (Ring *)malloc(sizeof(Ring));
-		ring->list = (Point *)malloc(sizeof(Point) * nv);
+		ring->pa = view_point_array(state, obj, vs, ve, LW_TRUE);
 		ring->n = nv;
 		ring->next = NULL;
 		ring->linked = 0;
 
 		/* Iterate over ring vertexes */
-		for (vi = vs; vi < ve; vi++)
+		for (vi = 0; vi < nv; vi++)
 		{
+			POINT2D p, pn;
 			int vn = vi+1; /* next vertex for area */
-			if (vn == ve)
-				vn = vs;
+			if (vn == nv)
+				vn = 0;
 
-			ring->list[vi - vs].x = obj->padfX[vi];
-			ring->list[vi - vs].y = obj->padfY[vi];
-			ring->list[vi - vs].z = obj->padfZ[vi];
-			ring->list[vi - vs].m = obj->padfM[vi];
+			getPoint2d_p(ring->pa, vi, &p);
+			getPoint2d_p(ring->pa, vn, &pn);
 
-			area += (obj->padfX[vi] * obj->padfY[vn]) -
-			        (obj->padfY[vi] * obj->padfX[vn]);
+			area += (p.x * pn.y) - (p.y * pn.x);
 		}
 
-		/* Close the ring with first vertex  */
-		/*ring->list[vi].x = obj->padfX[vs]; */
-		/*ring->list[vi].y = obj->padfY[vs]; */
-		/*ring->list[vi].z = obj->padfZ[vs]; */
-		/*ring->list[vi].m = obj->padfM[vs]; */
-
 		/* Clockwise (or single-part). It's an Outer Ring ! */
 		if (area < 0.0 || obj->nParts == 1)
 		{
@@ -535,21 +619,25 @@ FindPolygons(SHPObject *obj, Ring ***Out)
 	for (pi = 0; pi < in_index; pi++)
 	{
 		Point pt, pt2;
+		POINT2D p;
 		int i;
 		Ring *inner = Inner[pi], *outer = NULL;
 
-		pt.x = inner->list[0].x;
-		pt.y = inner->list[0].y;
+		/* A hole has more than one vertex, being counterclockwise */
+		getPoint2d_p(inner->pa, 0, &p);
+		pt.x = p.x;
+		pt.y = p.y;
 
-		pt2.x = inner->list[1].x;
-		pt2.y = inner->list[1].y;
+		getPoint2d_p(inner->pa, 1, &p);
+		pt2.x = p.x;
+		pt2.y = p.y;
 
 		for (i = 0; i < out_index; i++)
 		{
 			int in;
 
-			in = PIP(pt, Outer[i]->list, Outer[i]->n);
-			if ( in || PIP(pt2, Outer[i]->list, Outer[i]->n) )
+			in = PIP(pt, Outer[i]->pa);
+			if ( in || PIP(pt2, Outer[i]->pa) )
 			{
 				outer = Outer[i];
 				break;
@@ -597,7 +685,8 @@ ReleasePolygons(Ring **polys, int npolys)
 		{
 			temp = Poly;
 			Poly = Poly->next;
-			free(temp->list);
+			if (temp->pa)
+				ptarray_free(temp->pa);
 			free(temp);
 		}
 	}
@@ -614,30 +703,28 @@ ReleasePolygons(Ring **polys, int npolys)
  *
  */
 int
-GeneratePolygonGeometry(SHPLOADERSTATE *state, SHPObject *obj, char **geometry)
+GeneratePolygonGeometry(SHPLOADERSTATE *state, const SHPObjectView *obj, char **geometry)
 {
 	Ring **Outer;
 	int polygon_total, ring_total;
-	int pi, vi; /* part index and vertex index */
+	int pi; /* part index */
 
 	LWGEOM **lwpolygons;
 	LWGEOM *lwgeom;
 
-	POINT4D point4d;
-
 	int dims = 0;
 
 	char *mem;
-	size_t mem_length;
 
 	FLAGS_SET_Z(dims, state->has_z);
 	FLAGS_SET_M(dims, state->has_m);
 
-	polygon_total = FindPolygons(obj, &Outer);
+	polygon_total = FindPolygons(state, obj, &Outer);
 
 	if (state->config->simple_geometries == 1 && polygon_total != 1) /* We write Non-MULTI geometries, but have several parts: */
 	{
 		snprintf(state->message, SHPLOADERMSGLEN, _("We have a Multipolygon with %d parts, can't use -S switch!"), polygon_total);
+		ReleasePolygons(Outer, polygon_total);
 
 		return SHPLOADERERR;
 	}
@@ -667,25 +754,9 @@ GeneratePolygonGeometry(SHPLOADERSTATE *state, SHPObject *obj, char **geometry)
 
 		while (polyring)
 		{
-			/* Create a POINTARRAY containing the points making up the ring */
-			POINTARRAY *pa = ptarray_construct_empty(state->has_z, state->has_m, polyring->n);
-
-			for (vi = 0; vi < polyring->n; vi++)
-			{
-				/* Build up a point array of all the points in this ring */
-				point4d.x = polyring->list[vi].x;
-				point4d.y = polyring->list[vi].y;
-
-				if (state->has_z)
-					point4d.z = polyring->list[vi].z;
-				if (state->has_m)
-					point4d.m = polyring->list[vi].m;
-
-				ptarray_append_point(pa, &point4d, LW_TRUE);
-			}
-
-			/* Copy the POINTARRAY pointer so we can use the LWPOLY constructor */
-			lwpoly_add_ring(lwpoly, pa);
+			/* Hand the POINTARRAY of the ring over to the LWPOLY */
+			lwpoly_add_ring(lwpoly, polyring->pa);
+			polyring->pa = NULL;
 
 			polyring = polyring->next;
 			ring_index++;
@@ -706,10 +777,7 @@ GeneratePolygonGeometry(SHPLOADERSTATE *state, SHPObject *obj, char **geometry)
 		lwfree(lwpolygons);
 	}
 
-	if (!state->config->use_wkt)
-		mem = lwgeom_to_hexwkb(lwgeom, WKB_EXTENDED, &mem_length);
-	else
-		mem = lwgeom_to_wkt(lwgeom, WKT_EXTENDED, WKT_PRECISION, &mem_length);
+	mem = GenerateGeometryString(state, lwgeom);
 
 	if ( !mem )
 	{
@@ -756,6 +824,7 @@ set_loader_config_defaults(SHPLOADERCONFIG *config)
 	config->geo_col = NULL;
 	config->shp_file = NULL;
 	config->dump_format = 0;
+	config->copy_binary = 0;
 	config->simple_geometries = 0;
 	config->geography = 0;
 	config->quoteidentifiers = 0;
@@ -826,7 +895,8 @@ ShpLoaderCreate(SHPLOADERCONFIG *config)
 int
 ShpLoaderOpenShape(SHPLOADERSTATE *state)
 {
-	SHPObject *obj = NULL;
+	SHPObjectView obj;
+	SAHooks hooks;
 	int j, z;
 	int ret = SHPLOADEROK;
 
@@ -836,10 +906,13 @@ ShpLoaderOpenShape(SHPLOADERSTATE *state)
 	DBFFieldType type = -1;
 	char *utf8str;
 
+	/* Map the files in memory where possible, the shapes are then read in place */
+	SASetupMmapHooks(&hooks);
+
 	/* If we are reading the entire shapefile, open it */
 	if (state->config->readshape == 1)
 	{
-		state->hSHPHandle = SHPOpen(state->config->shp_file, "rb");
+		state->hSHPHandle = SHPOpenLL(state->config->shp_file, "rb", &hooks);
 
 		if (state->hSHPHandle == NULL)
 		{
@@ -851,7 +924,7 @@ ShpLoaderOpenShape(SHPLOADERSTATE *state)
 	}
 
 	/* Open the DBF (attributes) file */
-	state->hDBFHandle = DBFOpen(state->config->shp_file, "rb");
+	state->hDBFHandle = DBFOpenLL(state->config->shp_file, "rb", &hooks);
 	if ((state->hSHPHandle == NULL && state->config->readshape == 1) || state->hDBFHandle == NULL)
 	{
 		snprintf(state->message, SHPLOADERMSGLEN, _("%s: dbf file (.dbf) can not be opened."), state->config->shp_file);
@@ -870,21 +943,20 @@ ShpLoaderOpenShape(SHPLOADERSTATE *state)
 			/* If we abort on null items, scan the entire file for NULLs */
 			for (j = 0; j < state->num_entities; j++)
 			{
-				obj = SHPReadObject(state->hSHPHandle, j);
-
-				if (!obj)
+				if (!SHPReadObjectView(state->hSHPHandle, j, &obj))
 				{
 					snprintf(state->message, SHPLOADERMSGLEN, _("Error reading shape object %d"), j);
 					return SHPLOADERERR;
 				}
 
-				if (obj->nVertices == 0)
+				if (obj.nVertices == 0)
 				{
+					SHPReleaseObjectView(&obj);
 					snprintf(state->message, SHPLOADERMSGLEN, _("Empty geometries found, aborted.)"));
 					return SHPLOADERERR;
 				}
 
-				SHPDestroyObject(obj);
+				SHPReleaseObjectView(&obj);
 			}
 		}
 
@@ -1399,16 +1471,18 @@ ShpLoaderGetSQLCopyStatement(SHPLOADERSTATE *state, char **strheader)
 		if (state->config->schema)
 		{
 			copystr = malloc(strlen(state->config->schema) + strlen(state->config->table) +
-			                 strlen(state->col_names) + 40);
+			                 strlen(state->col_names) + 52);
 
-			sprintf(copystr, "COPY \"%s\".\"%s\" %s FROM stdin;\n",
-			        state->config->schema, state->config->table, state->col_names);
+			sprintf(copystr, "COPY \"%s\".\"%s\" %s FROM stdin%s;\n",
+			        state->config->schema, state->config->table, state->col_names,
+			        state->config->copy_binary ? " WITH BINARY" : "");
 		}
 		else
 		{
-			copystr = malloc(strlen(state->config->table) + strlen(state->col_names) + 40);
+			copystr = malloc(strlen(state->config->table) + strlen(state->col_names) + 52);
 
-			sprintf(copystr, "COPY \"%s\" %s FROM stdin;\n", state->config->table, state->col_names);
+			sprintf(copystr, "COPY \"%s\" %s FROM stdin%s;\n", state->config->table, state->col_names,
+			        state->config->copy_binary ? " WITH BINARY" : "");
 		}
 
 		*strheader = copystr;
@@ -1432,38 +1506,24 @@ ShpLoaderGetRecordCount(SHPLOADERSTATE *state)
 }
 
 
-/* Return an allocated string representation of a specified record item */
-int
-ShpLoaderGenerateSQLRowStatement(SHPLOADERSTATE *state, int item, char **strrecord)
+/*
+ * Read record item, checking whether it should be loaded at all: returns SHPLOADERRECDELETED
+ * or SHPLOADERRECISNULL for records to skip, otherwise the shape, if the shapefile is being
+ * read, is returned in obj. The view has to be released with SHPReleaseObjectView.
+ */
+static int
+ShpLoaderReadRecord(SHPLOADERSTATE *state, int item, SHPObjectView *obj)
 {
-	SHPObject *obj = NULL;
-	stringbuffer_t *sb;
-	stringbuffer_t *sbwarn;
-	char val[MAXVALUELEN];
-	char *escval;
-	char *geometry=NULL, *ret;
-	char *utf8str;
-	int res, i;
-	int rv;
-
-	/* Clear the stringbuffers */
-	sbwarn = stringbuffer_create();
-	stringbuffer_clear(sbwarn);
-	sb = stringbuffer_create();
-	stringbuffer_clear(sb);
+	memset(obj, 0, sizeof(SHPObjectView));
 
 	/* If we are reading the DBF only and the record has been marked deleted, return deleted record status */
 	if (state->config->readshape == 0 && DBFIsRecordDeleted(state->hDBFHandle, item))
-	{
-		*strrecord = NULL;
 		return SHPLOADERRECDELETED;
-	}
 
 	/* If we are reading the shapefile, open the specified record */
 	if (state->config->readshape == 1)
 	{
-		obj = SHPReadObject(state->hSHPHandle, item);
-		if (!obj)
+		if (!SHPReadObjectView(state->hSHPHandle, item, obj))
 		{
 			snprintf(state->message, SHPLOADERMSGLEN, _("Error reading shape object %d"), item);
 			return SHPLOADERERR;
@@ -1472,13 +1532,203 @@ ShpLoaderGenerateSQLRowStatement(SHPLOADERSTATE *state, int item, char **strreco
 		/* If we are set to skip NULLs, return a NULL record status */
 		if (state->config->null_policy == POLICY_NULL_SKIP && obj->nVertices == 0 )
 		{
-			SHPDestroyObject(obj);
+			SHPReleaseObjectView(obj);
 
-			*strrecord = NULL;
 			return SHPLOADERRECISNULL;
 		}
 	}
 
+	return SHPLOADEROK;
+}
+
+
+/*
+ * Copy the raw DBF value of (not NULL) attribute i into val, tidying up numbers for the
+ * server and converting to UTF-8 if an encoding was given. Warnings are added to sbwarn.
+ */
+static int
+ShpLoaderPrepareAttribute(SHPLOADERSTATE *state, int i, const char *raw, char *val, stringbuffer_t *sbwarn)
+{
+	char *utf8str;
+	int rv;
+
+	switch (state->types[i])
+	{
+	case FTInteger:
+	case FTDouble:
+		rv = snprintf(val, MAXVALUELEN, "%s", raw);
+		if (rv >= MAXVALUELEN || rv == -1)
+		{
+			stringbuffer_aprintf(sbwarn, "Warning: field %d name truncated\n", i);
+			val[MAXVALUELEN - 1] = '\0';
+		}
+
+		/* If the value is an empty string, change to 0 */
+		if (val[0] == '\0')
+		{
+			val[0] = '0';
+			val[1] = '\0';
+		}
+
+		/* If the value ends with just ".", remove the dot */
+		if (val[strlen(val) - 1] == '.')
+			val[strlen(val) - 1] = '\0';
+		break;
+
+	case FTString:
+	case FTLogical:
+	case FTDate:
+		rv = snprintf(val, MAXVALUELEN, "%s", raw);
+		if (rv >= MAXVALUELEN || rv == -1)
+		{
+			stringbuffer_aprintf(sbwarn, "Warning: field %d name truncated\n", i);
+			val[MAXVALUELEN - 1] = '\0';
+		}
+		break;
+
+	default:
+		snprintf(state->message, SHPLOADERMSGLEN, _("Error: field %d has invalid or unknown field type (%d)"), i, state->types[i]);
+
+		return SHPLOADERERR;
+	}
+
+	if (state->config->encoding)
+	{
+		char *encoding_msg = _("Try \"LATIN1\" (Western European), or one of the values described at http://www.postgresql.org/docs/current/static/multibyte.html.");
+
+		rv = utf8(state->config->encoding, val, &utf8str);
+
+		if (rv != UTF8_GOOD_RESULT)
+		{
+			if ( rv == UTF8_BAD_RESULT )
+				snprintf(state->message, SHPLOADERMSGLEN, _("Unable to convert data value \"%s\" to UTF-8 (iconv reports \"%s\"). Current encoding is \"%s\". %s"), utf8str, strerror(errno), state->config->encoding, encoding_msg);
+			else if ( rv == UTF8_NO_RESULT )
+				snprintf(state->message, SHPLOADERMSGLEN, _("Unable to convert data value to UTF-8 (iconv reports \"%s\"). Current encoding is \"%s\". %s"), strerror(errno), state->config->encoding, encoding_msg);
+			else
+				snprintf(state->message, SHPLOADERMSGLEN, _("Unexpected return value from utf8()"));
+
+			if ( rv == UTF8_BAD_RESULT )
+				free(utf8str);
+
+			return SHPLOADERERR;
+		}
+		strncpy(val, utf8str, MAXVALUELEN);
+		free(utf8str);
+	}
+
+	return SHPLOADEROK;
+}
+
+
+/*
+ * Read everything record item needs from the shapefile and the DBF file into record: the
+ * shape and a copy of the attribute values, NULL for NULL attributes. This is the only part
+ * of generating a row that touches the file handles; converting the record afterwards with
+ * ShpLoaderConvertRecord does not, so it can run in another thread. Returns the same codes
+ * as ShpLoaderReadRecord, record only holds data on SHPLOADEROK.
+ */
+int
+ShpLoaderReadRecordData(SHPLOADERSTATE *state, int item, SHPLOADERRECORD *record)
+{
+	int res, i;
+
+	record->item = item;
+	record->values = NULL;
+
+	res = ShpLoaderReadRecord(state, item, &record->obj);
+	if (res != SHPLOADEROK)
+		return res;
+
+	record->values = malloc(sizeof(char *) * (state->num_fields > 0 ? state->num_fields : 1));
+	for (i = 0; i < state->num_fields; i++)
+	{
+		if (DBFIsAttributeNULL(state->hDBFHandle, item, i))
+			record->values[i] = NULL;
+		else
+			record->values[i] = strdup(DBFReadStringAttribute(state->hDBFHandle, item, i));
+	}
+
+	return SHPLOADEROK;
+}
+
+
+/* Release the data read into a record by ShpLoaderReadRecordData */
+void
+ShpLoaderFreeRecord(SHPLOADERSTATE *state, SHPLOADERRECORD *record)
+{
+	int i;
+
+	SHPReleaseObjectView(&record->obj);
+
+	if (record->values)
+	{
+		for (i = 0; i < state->num_fields; i++)
+			free(record->values[i]);
+
+		free(record->values);
+	}
+	record->values = NULL;
+}
+
+
+/*
+ * Generate the geometry of a shape with vertices, in the output format of the configuration
+ * (see GenerateGeometryString).
+ */
+static int
+ShpLoaderGenerateGeometry(SHPLOADERSTATE *state, const SHPObjectView *obj, char **geometry)
+{
+	switch (obj->nSHPType)
+	{
+	case SHPT_POLYGON:
+	case SHPT_POLYGONM:
+	case SHPT_POLYGONZ:
+		return GeneratePolygonGeometry(state, obj, geometry);
+
+	case SHPT_POINT:
+	case SHPT_POINTM:
+	case SHPT_POINTZ:
+		return GeneratePointGeometry(state, obj, geometry, 0);
+
+	case SHPT_MULTIPOINT:
+	case SHPT_MULTIPOINTM:
+	case SHPT_MULTIPOINTZ:
+		/* Force it to multi unless using -S */
+		return GeneratePointGeometry(state, obj, geometry,
+			state->config->simple_geometries ? 0 : 1);
+
+	case SHPT_ARC:
+	case SHPT_ARCM:
+	case SHPT_ARCZ:
+		return GenerateLineStringGeometry(state, obj, geometry);
+
+	default:
+		snprintf(state->message, SHPLOADERMSGLEN, _("Shape type is not supported, type id = %d"), obj->nSHPType);
+		return SHPLOADERERR;
+	}
+}
+
+
+/* Return an allocated SQL or text COPY representation of a record read with ShpLoaderReadRecordData */
+static int
+ShpLoaderConvertSQLRow(SHPLOADERSTATE *state, SHPLOADERRECORD *record, char **strrecord)
+{
+	const SHPObjectView *obj = &record->obj;
+	stringbuffer_t *sb;
+	stringbuffer_t *sbwarn;
+	char val[MAXVALUELEN];
+	char *escval;
+	char *geometry=NULL, *ret;
+	int res, i;
+
+	*strrecord = NULL;
+
+	/* Clear the stringbuffers */
+	sbwarn = stringbuffer_create();
+	stringbuffer_clear(sbwarn);
+	sb = stringbuffer_create();
+	stringbuffer_clear(sb);
+
 	/* If not in dump format, generate the INSERT string */
 	if (!state->config->dump_format)
 	{
@@ -1495,11 +1745,11 @@ ShpLoaderGenerateSQLRowStatement(SHPLOADERSTATE *state, int item, char **strreco
 	}
 
 
-	/* Read all of the attributes from the DBF file for this item */
-	for (i = 0; i < DBFGetFieldCount(state->hDBFHandle); i++)
+	/* Add all of the attributes from the DBF file for this item */
+	for (i = 0; i < state->num_fields; i++)
 	{
 		/* Special case for NULL attributes */
-		if (DBFIsAttributeNULL(state->hDBFHandle, item, i))
+		if (!record->values[i])
 		{
 			if (state->config->dump_format)
 				stringbuffer_aprintf(sb, "\\N");
@@ -1509,75 +1759,15 @@ ShpLoaderGenerateSQLRowStatement(SHPLOADERSTATE *state, int item, char **strreco
 		else
 		{
 			/* Attribute NOT NULL */
-			switch (state->types[i])
+			if (ShpLoaderPrepareAttribute(state, i, record->values[i], val, sbwarn) != SHPLOADEROK)
 			{
-			case FTInteger:
-			case FTDouble:
-				rv = snprintf(val, MAXVALUELEN, "%s", DBFReadStringAttribute(state->hDBFHandle, item, i));
-				if (rv >= MAXVALUELEN || rv == -1)
-				{
-					stringbuffer_aprintf(sbwarn, "Warning: field %d name truncated\n", i);
-					val[MAXVALUELEN - 1] = '\0';
-				}
-
-				/* If the value is an empty string, change to 0 */
-				if (val[0] == '\0')
-				{
-					val[0] = '0';
-					val[1] = '\0';
-				}
-
-				/* If the value ends with just ".", remove the dot */
-				if (val[strlen(val) - 1] == '.')
-					val[strlen(val) - 1] = '\0';
-				break;
-
-			case FTString:
-			case FTLogical:
-			case FTDate:
-				rv = snprintf(val, MAXVALUELEN, "%s", DBFReadStringAttribute(state->hDBFHandle, item, i));
-				if (rv >= MAXVALUELEN || rv == -1)
-				{
-					stringbuffer_aprintf(sbwarn, "Warning: field %d name truncated\n", i);
-					val[MAXVALUELEN - 1] = '\0';
-				}
-				break;
-
-			default:
-				snprintf(state->message, SHPLOADERMSGLEN, _("Error: field %d has invalid or unknown field type (%d)"), i, state->types[i]);
-
-				SHPDestroyObject(obj);
+				/* Error message has already been set */
 				stringbuffer_destroy(sbwarn);
 				stringbuffer_destroy(sb);
 
 				return SHPLOADERERR;
 			}
 
-			if (state->config->encoding)
-			{
-				char *encoding_msg = _("Try \"LATIN1\" (Western European), or one of the values described at http://www.postgresql.org/docs/current/static/multibyte.html.");
-
-				rv = utf8(state->config->encoding, val, &utf8str);
-
-				if (rv != UTF8_GOOD_RESULT)
-				{
-					if ( rv == UTF8_BAD_RESULT )
-						snprintf(state->message, SHPLOADERMSGLEN, _("Unable to convert data value \"%s\" to UTF-8 (iconv reports \"%s\"). Current encoding is \"%s\". %s"), utf8str, strerror(errno), state->config->encoding, encoding_msg);
-					else if ( rv == UTF8_NO_RESULT )
-						snprintf(state->message, SHPLOADERMSGLEN, _("Unable to convert data value to UTF-8 (iconv reports \"%s\"). Current encoding is \"%s\". %s"), strerror(errno), state->config->encoding, encoding_msg);
-					else
-						snprintf(state->message, SHPLOADERMSGLEN, _("Unexpected return value from utf8()"));
-
-					if ( rv == UTF8_BAD_RESULT )
-						free(utf8str);
-
-					return SHPLOADERERR;
-				}
-				strncpy(val, utf8str, MAXVALUELEN);
-				free(utf8str);
-
-			}
-
 			/* Escape attribute correctly according to dump format */
 			if (state->config->dump_format)
 			{
@@ -1596,7 +1786,7 @@ ShpLoaderGenerateSQLRowStatement(SHPLOADERSTATE *state, int item, char **strreco
 		}
 
 		/* Only put in delimeter if not last field or a shape will follow */
-		if (state->config->readshape == 1 || i < DBFGetFieldCount(state->hDBFHandle) - 1)
+		if (state->config->readshape == 1 || i < state->num_fields - 1)
 		{
 			if (state->config->dump_format)
 				stringbuffer_aprintf(sb, "\t");
@@ -1622,47 +1812,10 @@ ShpLoaderGenerateSQLRowStatement(SHPLOADERSTATE *state, int item, char **strreco
 		else
 		{
 			/* Handle all other shape attributes */
-			switch (obj->nSHPType)
-			{
-			case SHPT_POLYGON:
-			case SHPT_POLYGONM:
-			case SHPT_POLYGONZ:
-				res = GeneratePolygonGeometry(state, obj, &geometry);
-				break;
-
-			case SHPT_POINT:
-			case SHPT_POINTM:
-			case SHPT_POINTZ:
-				res = GeneratePointGeometry(state, obj, &geometry, 0);
-				break;
-
-			case SHPT_MULTIPOINT:
-			case SHPT_MULTIPOINTM:
-			case SHPT_MULTIPOINTZ:
-				/* Force it to multi unless using -S */
-				res = GeneratePointGeometry(state, obj, &geometry,
-					state->config->simple_geometries ? 0 : 1);
-				break;
-
-			case SHPT_ARC:
-			case SHPT_ARCM:
-			case SHPT_ARCZ:
-				res = GenerateLineStringGeometry(state, obj, &geometry);
-				break;
-
-			default:
-				snprintf(state->message, SHPLOADERMSGLEN, _("Shape type is not supported, type id = %d"), obj->nSHPType);
-				SHPDestroyObject(obj);
-				stringbuffer_destroy(sbwarn);
-				stringbuffer_destroy(sb);
-
-				return SHPLOADERERR;
-			}
-			/* The default returns out of the function, so res will always have been set. */
+			res = ShpLoaderGenerateGeometry(state, obj, &geometry);
 			if (res != SHPLOADEROK)
 			{
 				/* Error message has already been set */
-				SHPDestroyObject(obj);
 				stringbuffer_destroy(sbwarn);
 				stringbuffer_destroy(sb);
 
@@ -1694,9 +1847,6 @@ ShpLoaderGenerateSQLRowStatement(SHPLOADERSTATE *state, int item, char **strreco
 
 			free(geometry);
 		}
-
-		/* Tidy up everything */
-		SHPDestroyObject(obj);
 	}
 
 	/* Close the line correctly for dump/insert format */
@@ -1729,6 +1879,498 @@ ShpLoaderGenerateSQLRowStatement(SHPLOADERSTATE *state, int item, char **strreco
 }
 
 
+/* Return an allocated string representation of a specified record item */
+int
+ShpLoaderGenerateSQLRowStatement(SHPLOADERSTATE *state, int item, char **strrecord)
+{
+	SHPLOADERRECORD record;
+	int res;
+
+	*strrecord = NULL;
+
+	res = ShpLoaderReadRecordData(state, item, &record);
+	if (res != SHPLOADEROK)
+		return res;
+
+	res = ShpLoaderConvertSQLRow(state, &record, strrecord);
+	ShpLoaderFreeRecord(state, &record);
+
+	return res;
+}
+
+
+/*
+ * Binary COPY output. Every row is a count of fields followed by the fields, each one the
+ * length of its value as a network order int32 (-1 for NULL) and the value in the binary
+ * (send/recv) format of its column type. Geometries go as plain EWKB, which is what the
+ * geometry and geography receive functions read.
+ */
+
+/* Signature, flags and header extension length of a binary COPY stream */
+static const char copy_binary_signature[11] = "PGCOPY\n\377\r\n";
+
+/* Days between the julian day origin and 2000-01-01, the origin of PostgreSQL dates */
+#define COPY_BINARY_DATE_EPOCH 2451545
+
+typedef struct
+{
+	char *data;
+	size_t len;
+	size_t capacity;
+} copybuffer_t;
+
+static void
+copybuffer_append(copybuffer_t *buf, const void *data, size_t len)
+{
+	if (buf->len + len > buf->capacity)
+	{
+		while (buf->len + len > buf->capacity)
+			buf->capacity *= 2;
+		buf->data = realloc(buf->data, buf->capacity);
+	}
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+}
+
+static void
+copybuffer_append_int16(copybuffer_t *buf, int16_t value)
+{
+	unsigned char b[2];
+	b[0] = ((uint16_t)value >> 8) & 0xff;
+	b[1] = (uint16_t)value & 0xff;
+	copybuffer_append(buf, b, 2);
+}
+
+static void
+copybuffer_append_int32(copybuffer_t *buf, int32_t value)
+{
+	unsigned char b[4];
+	int i;
+	for (i = 0; i < 4; i++)
+		b[i] = ((uint32_t)value >> (24 - 8 * i)) & 0xff;
+	copybuffer_append(buf, b, 4);
+}
+
+static void
+copybuffer_append_int64(copybuffer_t *buf, int64_t value)
+{
+	unsigned char b[8];
+	int i;
+	for (i = 0; i < 8; i++)
+		b[i] = ((uint64_t)value >> (56 - 8 * i)) & 0xff;
+	copybuffer_append(buf, b, 8);
+}
+
+/* Julian day number of a date, as date2j() in the backend */
+static int
+copy_binary_date2j(int y, int m, int d)
+{
+	int julian;
+	int century;
+
+	if (m > 2)
+	{
+		m += 1;
+		y += 4800;
+	}
+	else
+	{
+		m += 13;
+		y += 4799;
+	}
+
+	century = y / 100;
+	julian = y * 365 - 32167;
+	julian += y / 4 - century + century / 4;
+	julian += 7834 * m / 256 + d;
+
+	return julian;
+}
+
+/*
+ * Append a DBF date (YYYYMMDD) as a binary date field. Returns 0 if the value is not a
+ * valid date.
+ */
+static int
+copy_binary_date(copybuffer_t *buf, const char *val)
+{
+	static const int days_in_month[12] = { 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	int y, m, d, i;
+
+	for (i = 0; i < 8; i++)
+		if (!isdigit((unsigned char)val[i]))
+			return 0;
+	if (val[8] != '\0')
+		return 0;
+
+	y = (val[0] - '0') * 1000 + (val[1] - '0') * 100 + (val[2] - '0') * 10 + (val[3] - '0');
+	m = (val[4] - '0') * 10 + (val[5] - '0');
+	d = (val[6] - '0') * 10 + (val[7] - '0');
+
+	if (m < 1 || m > 12 || d < 1 || d > days_in_month[m - 1])
+		return 0;
+	if (m == 2 && d == 29 && !((y % 4 == 0 && y % 100 != 0) || y % 400 == 0))
+		return 0;
+
+	copybuffer_append_int32(buf, 4);
+	copybuffer_append_int32(buf, copy_binary_date2j(y, m, d) - COPY_BINARY_DATE_EPOCH);
+
+	return 1;
+}
+
+/*
+ * Append a decimal number ([-+]digits[.digits][e[-+]digits]) as a binary numeric field:
+ * count of base 10000 digits, weight of the first one, sign and display scale, then the
+ * digits. Returns 0 if the value is not a number.
+ */
+static int
+copy_binary_numeric(copybuffer_t *buf, const char *val)
+{
+	char digits[MAXVALUELEN + 8];
+	int16_t groups[MAXVALUELEN / 4 + 4];
+	const char *p = val;
+	int ndigits = 0, decpos = -1, exponent = 0;
+	int negative = 0, pad, first, last, ngroups, weight, dscale, i;
+
+	while (isspace((unsigned char)*p))
+		p++;
+	if (*p == '-' || *p == '+')
+		negative = (*p++ == '-');
+
+	for (; *p; p++)
+	{
+		if (isdigit((unsigned char)*p))
+			digits[ndigits++] = *p - '0';
+		else if (*p == '.' && decpos < 0)
+			decpos = ndigits;
+		else
+			break;
+	}
+	if (ndigits == 0)
+		return 0;
+	if (decpos < 0)
+		decpos = ndigits;
+
+	if (*p == 'e' || *p == 'E')
+	{
+		char *end;
+		exponent = strtol(p + 1, &end, 10);
+		if (end == p + 1 || exponent > 1000 || exponent < -1000)
+			return 0;
+		p = end;
+	}
+	while (isspace((unsigned char)*p))
+		p++;
+	if (*p != '\0')
+		return 0;
+
+	/* Digits after the decimal point, as numeric_in() counts them */
+	dscale = ndigits - decpos - exponent;
+	if (dscale < 0)
+		dscale = 0;
+	decpos += exponent;
+
+	/* Line the digits up on base 10000 digits around the decimal point */
+	pad = ((4 - decpos % 4) % 4 + 4) % 4;
+	memmove(digits + pad, digits, ndigits);
+	memset(digits, 0, pad);
+	ndigits += pad;
+	decpos += pad;
+	while (ndigits % 4)
+		digits[ndigits++] = 0;
+
+	ngroups = ndigits / 4;
+	for (i = 0; i < ngroups; i++)
+		groups[i] = digits[4 * i] * 1000 + digits[4 * i + 1] * 100 + digits[4 * i + 2] * 10 + digits[4 * i + 3];
+	weight = decpos / 4 - 1;
+
+	/* Strip the leading and trailing zero digits */
+	for (first = 0; first < ngroups && groups[first] == 0; first++)
+		weight--;
+	for (last = ngroups; last > first && groups[last - 1] == 0; last--);
+
+	if (first == last)
+	{
+		/* Zero */
+		weight = 0;
+		negative = 0;
+	}
+
+	copybuffer_append_int32(buf, 8 + 2 * (last - first));
+	copybuffer_append_int16(buf, last - first);
+	copybuffer_append_int16(buf, weight);
+	copybuffer_append_int16(buf, negative ? 0x4000 : 0x0000);
+	copybuffer_append_int16(buf, dscale);
+	for (i = first; i < last; i++)
+		copybuffer_append_int16(buf, groups[i]);
+
+	return 1;
+}
+
+/*
+ * Append attribute i, as read by ShpLoaderReadAttribute, in the binary format of its
+ * column type.
+ */
+static int
+ShpLoaderCopyBinaryAttribute(SHPLOADERSTATE *state, int i, char *val, copybuffer_t *buf)
+{
+	const char *pgtype = state->pgfieldtypes[i];
+	char *end;
+	int ok = 1;
+
+	if (!strcmp(pgtype, "varchar"))
+	{
+		copybuffer_append_int32(buf, strlen(val));
+		copybuffer_append(buf, val, strlen(val));
+	}
+	else if (!strcmp(pgtype, "int2") || !strcmp(pgtype, "int4"))
+	{
+		long l = strtol(val, &end, 10);
+		while (isspace((unsigned char)*end))
+			end++;
+		ok = (end != val && *end == '\0');
+
+		if (ok && !strcmp(pgtype, "int2"))
+		{
+			ok = (l >= -32768 && l <= 32767);
+			copybuffer_append_int32(buf, 2);
+			copybuffer_append_int16(buf, l);
+		}
+		else if (ok)
+		{
+			ok = (l >= -2147483647L - 1 && l <= 2147483647L);
+			copybuffer_append_int32(buf, 4);
+			copybuffer_append_int32(buf, l);
+		}
+	}
+	else if (!strcmp(pgtype, "float8"))
+	{
+		union { double d; int64_t i; } u;
+
+		u.d = strtod(val, &end);
+		while (isspace((unsigned char)*end))
+			end++;
+		ok = (end != val && *end == '\0');
+		copybuffer_append_int32(buf, 8);
+		copybuffer_append_int64(buf, u.i);
+	}
+	else if (!strcmp(pgtype, "numeric"))
+	{
+		ok = copy_binary_numeric(buf, val);
+	}
+	else if (!strcmp(pgtype, "date"))
+	{
+		ok = copy_binary_date(buf, val);
+	}
+	else if (!strcmp(pgtype, "boolean"))
+	{
+		char b;
+		switch (val[0])
+		{
+		case 'T': case 't': case 'Y': case 'y': case '1':
+			b = 1;
+			break;
+		case 'F': case 'f': case 'N': case 'n': case '0':
+			b = 0;
+			break;
+		default:
+			ok = 0;
+		}
+		if (ok)
+		{
+			copybuffer_append_int32(buf, 1);
+			copybuffer_append(buf, &b, 1);
+		}
+	}
+	else
+	{
+		ok = 0;
+	}
+
+	if (!ok)
+	{
+		snprintf(state->message, SHPLOADERMSGLEN, _("Error: invalid %s value \"%s\" in field %d"), pgtype, val, i);
+		return SHPLOADERERR;
+	}
+
+	return SHPLOADEROK;
+}
+
+
+/* Return an allocated buffer holding the header of a binary COPY stream */
+int
+ShpLoaderGetCopyBinaryHeader(SHPLOADERSTATE *state, char **strheader, size_t *length)
+{
+	copybuffer_t buf;
+
+	buf.capacity = 32;
+	buf.len = 0;
+	buf.data = malloc(buf.capacity);
+
+	copybuffer_append(&buf, copy_binary_signature, sizeof(copy_binary_signature));
+	copybuffer_append_int32(&buf, 0);
+	copybuffer_append_int32(&buf, 0);
+
+	*strheader = buf.data;
+	*length = buf.len;
+
+	return SHPLOADEROK;
+}
+
+
+/* Return an allocated buffer holding the trailer of a binary COPY stream */
+int
+ShpLoaderGetCopyBinaryTrailer(SHPLOADERSTATE *state, char **strfooter, size_t *length)
+{
+	copybuffer_t buf;
+
+	buf.capacity = 2;
+	buf.len = 0;
+	buf.data = malloc(buf.capacity);
+
+	copybuffer_append_int16(&buf, -1);
+
+	*strfooter = buf.data;
+	*length = buf.len;
+
+	return SHPLOADEROK;
+}
+
+
+/* Return an allocated binary COPY row, and its length, for a record read with ShpLoaderReadRecordData */
+static int
+ShpLoaderConvertCopyBinaryRow(SHPLOADERSTATE *state, SHPLOADERRECORD *record, char **row, size_t *length)
+{
+	const SHPObjectView *obj = &record->obj;
+	stringbuffer_t *sbwarn;
+	copybuffer_t buf;
+	char val[MAXVALUELEN];
+	char *geometry = NULL;
+	uint32_t geometry_length;
+	int res, i;
+
+	*row = NULL;
+	*length = 0;
+
+	sbwarn = stringbuffer_create();
+	stringbuffer_clear(sbwarn);
+
+	buf.capacity = 1024;
+	buf.len = 0;
+	buf.data = malloc(buf.capacity);
+
+	copybuffer_append_int16(&buf, state->num_fields + state->config->readshape);
+
+	for (i = 0; i < state->num_fields; i++)
+	{
+		if (!record->values[i])
+		{
+			copybuffer_append_int32(&buf, -1);
+			continue;
+		}
+
+		res = ShpLoaderPrepareAttribute(state, i, record->values[i], val, sbwarn);
+		if (res == SHPLOADEROK)
+			res = ShpLoaderCopyBinaryAttribute(state, i, val, &buf);
+		if (res != SHPLOADEROK)
+		{
+			/* Error message has already been set */
+			stringbuffer_destroy(sbwarn);
+			free(buf.data);
+
+			return SHPLOADERERR;
+		}
+	}
+
+	if (state->config->readshape == 1)
+	{
+		if (obj->nVertices == 0)
+		{
+			copybuffer_append_int32(&buf, -1);
+		}
+		else
+		{
+			res = ShpLoaderGenerateGeometry(state, obj, &geometry);
+			if (res != SHPLOADEROK)
+			{
+				/* Error message has already been set */
+				stringbuffer_destroy(sbwarn);
+				free(buf.data);
+
+				return SHPLOADERERR;
+			}
+
+			/* The geometry already is a complete field, length included */
+			geometry_length = ((uint32_t)(unsigned char)geometry[0] << 24) | ((uint32_t)(unsigned char)geometry[1] << 16) |
+			                  ((uint32_t)(unsigned char)geometry[2] << 8) | (uint32_t)(unsigned char)geometry[3];
+			copybuffer_append(&buf, geometry, geometry_length + 4);
+			free(geometry);
+		}
+	}
+
+	*row = buf.data;
+	*length = buf.len;
+
+	/* If any warnings occurred, set the returned message string and warning status */
+	if (strlen((char *)stringbuffer_getstring(sbwarn)) > 0)
+	{
+		snprintf(state->message, SHPLOADERMSGLEN, "%s", stringbuffer_getstring(sbwarn));
+		stringbuffer_destroy(sbwarn);
+
+		return SHPLOADERWARN;
+	}
+
+	stringbuffer_destroy(sbwarn);
+
+	return SHPLOADEROK;
+}
+
+
+/*
+ * Return an allocated buffer holding record item as a binary COPY row, and its length.
+ * Same return codes as ShpLoaderGenerateSQLRowStatement.
+ */
+int
+ShpLoaderGenerateCopyBinaryRow(SHPLOADERSTATE *state, int item, char **row, size_t *length)
+{
+	SHPLOADERRECORD record;
+	int res;
+
+	*row = NULL;
+	*length = 0;
+
+	res = ShpLoaderReadRecordData(state, item, &record);
+	if (res != SHPLOADEROK)
+		return res;
+
+	res = ShpLoaderConvertCopyBinaryRow(state, &record, row, length);
+	ShpLoaderFreeRecord(state, &record);
+
+	return res;
+}
+
+
+/*
+ * Convert a record read with ShpLoaderReadRecordData into the row of the configured output:
+ * an SQL statement or text COPY line (whose length is returned too), or a binary COPY row.
+ * Only reads the state apart from its message, so several threads can convert records at
+ * once as long as each passes its own copy of the state.
+ */
+int
+ShpLoaderConvertRecord(SHPLOADERSTATE *state, SHPLOADERRECORD *record, char **row, size_t *length)
+{
+	int res;
+
+	if (state->config->dump_format && state->config->copy_binary)
+		return ShpLoaderConvertCopyBinaryRow(state, record, row, length);
+
+	res = ShpLoaderConvertSQLRow(state, record, row);
+	*length = *row ? strlen(*row) : 0;
+
+	return res;
+}
+
+
 /* Return a pointer to an allocated string containing the header for the specified loader state */
 int
 ShpLoaderGetSQLFooter(SHPLOADERSTATE *state, char **strfooter)
@@ -12,6 +12,9 @@
  *
  **********************************************************************/
 
+#ifndef SHP2PGSQL_CORE_H
+#define SHP2PGSQL_CORE_H
+
 /* Standard headers */
 #include <stdio.h>
 #include <string.h>
@@ -94,6 +97,9 @@ typedef struct shp_loader_config
 	/* 0 = SQL inserts, 1 = dump */
 	int dump_format;
 
+	/* 0 = text dump, 1 = binary COPY dump (only with dump_format) */
+	int copy_binary;
+
 	/* 0 = MULTIPOLYGON/MULTILINESTRING, 1 = force to POLYGON/LINESTRING */
 	int simple_geometries;
 	
@@ -211,6 +217,26 @@ typedef struct shp_loader_state
 } SHPLOADERSTATE;
 
 
+/*
+ * A record read from the files, ready to be converted into a row
+ */
+typedef struct shp_loader_record
+{
+	/* Record number */
+	int item;
+
+	/*
+	 * The shape, all zero when only loading the DBF file. It may point into the mapped
+	 * shapefile, so it is only valid while the state is open.
+	 */
+	SHPObjectView obj;
+
+	/* Copies of the DBF attribute values, NULL for NULL attributes */
+	char **values;
+
+} SHPLOADERRECORD;
+
+
 /* Externally accessible functions */
 void strtolower(char *s);
 void vasbappend(stringbuffer_t *sb, char *fmt, ... );
@@ -223,4 +249,12 @@ int ShpLoaderGetSQLCopyStatement(SHPLOADERSTATE *state, char **strheader);
 int ShpLoaderGetRecordCount(SHPLOADERSTATE *state);
 int ShpLoaderGenerateSQLRowStatement(SHPLOADERSTATE *state, int item, char **strrecord);
 int ShpLoaderGetSQLFooter(SHPLOADERSTATE *state, char **strfooter);
+int ShpLoaderGetCopyBinaryHeader(SHPLOADERSTATE *state, char **strheader, size_t *length);
+int ShpLoaderGenerateCopyBinaryRow(SHPLOADERSTATE *state, int item, char **row, size_t *length);
+int ShpLoaderGetCopyBinaryTrailer(SHPLOADERSTATE *state, char **strfooter, size_t *length);
+int ShpLoaderReadRecordData(SHPLOADERSTATE *state, int item, SHPLOADERRECORD *record);
+int ShpLoaderConvertRecord(SHPLOADERSTATE *state, SHPLOADERRECORD *record, char **row, size_t *length);
+void ShpLoaderFreeRecord(SHPLOADERSTATE *state, SHPLOADERRECORD *record);
 void ShpLoaderDestroy(SHPLOADERSTATE *state);
+
+#endif
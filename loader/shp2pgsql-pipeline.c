@@ -0,0 +1,392 @@
+/**********************************************************************
+ * $Id$
+ *
+ * PostGIS - Spatial Types for PostgreSQL
+ * http://postgis.refractions.net
+ *
+ * This is free software; you can redistribute and/or modify it under
+ * the terms of the GNU General Public Licence. See the COPYING file.
+ *
+ **********************************************************************/
+
+#include "../postgis_config.h"
+
+#include "shp2pgsql-pipeline.h"
+
+#if HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+/* Records in flight per worker, enough to keep the workers busy while the writer catches up */
+#define PIPELINE_SLOTS_PER_WORKER 16
+
+/* Slot states: empty, read and waiting for a worker, being converted, ready to be written */
+#define SLOT_FREE	0
+#define SLOT_READ	1
+#define SLOT_BUSY	2
+#define SLOT_DONE	3
+
+typedef struct
+{
+	int status;
+
+	/* What the reader got from the files */
+	SHPLOADERRECORD record;
+
+	/* Result of reading or converting the record, as returned by ShpLoaderGenerateSQLRowStatement */
+	int result;
+	char *row;
+	size_t length;
+	char message[SHPLOADERMSGLEN];
+} PIPELINE_SLOT;
+
+struct shp_loader_pipeline
+{
+	SHPLOADERSTATE *state;
+	int ordered;
+
+	/* Number of rows returned so far */
+	int nreturned;
+
+#if HAVE_PTHREAD
+	int nworkers;
+	pthread_t reader;
+	pthread_t *workers;
+
+	/* Everything below is protected by lock */
+	pthread_mutex_t lock;
+	pthread_cond_t slot_free;
+	pthread_cond_t slot_read;
+	pthread_cond_t slot_done;
+
+	int nslots;
+	PIPELINE_SLOT *slots;
+
+	/* Slots waiting for a worker, in reading order */
+	int *queue;
+	int queue_head;
+	int queue_len;
+
+	/* Set once the reader has read every record */
+	int reading_done;
+
+	/* Set to make every thread stop as soon as possible */
+	int abort;
+#endif
+};
+
+
+#if HAVE_PTHREAD
+
+/*
+ * Reader thread: read the records one after the other into free slots. In ordered mode
+ * record i always goes to slot i modulo the number of slots, which is where the writer
+ * looks for it.
+ */
+static void *
+pipeline_reader(void *arg)
+{
+	SHPLOADERPIPELINE *pipeline = arg;
+	SHPLOADERSTATE state = *pipeline->state;
+	SHPLOADERRECORD record;
+	PIPELINE_SLOT *slot;
+	int count = ShpLoaderGetRecordCount(pipeline->state);
+	int item, s = 0, res, stop;
+
+	for (item = 0; item < count; item++)
+	{
+		pthread_mutex_lock(&pipeline->lock);
+		while (!pipeline->abort)
+		{
+			if (pipeline->ordered)
+			{
+				s = item % pipeline->nslots;
+				if (pipeline->slots[s].status == SLOT_FREE)
+					break;
+			}
+			else
+			{
+				for (s = 0; s < pipeline->nslots; s++)
+				{
+					if (pipeline->slots[s].status == SLOT_FREE)
+						break;
+				}
+				if (s < pipeline->nslots)
+					break;
+			}
+			pthread_cond_wait(&pipeline->slot_free, &pipeline->lock);
+		}
+		stop = pipeline->abort;
+		pthread_mutex_unlock(&pipeline->lock);
+
+		if (stop)
+			break;
+
+		/* Only this thread touches the slot until it is handed over */
+		res = ShpLoaderReadRecordData(&state, item, &record);
+		slot = &pipeline->slots[s];
+		slot->record = record;
+		slot->result = res;
+		slot->row = NULL;
+		slot->length = 0;
+		if (res == SHPLOADERERR)
+			snprintf(slot->message, SHPLOADERMSGLEN, "%s", state.message);
+
+		pthread_mutex_lock(&pipeline->lock);
+		if (res == SHPLOADEROK)
+		{
+			slot->status = SLOT_READ;
+			pipeline->queue[(pipeline->queue_head + pipeline->queue_len) % pipeline->nslots] = s;
+			pipeline->queue_len++;
+			pthread_cond_signal(&pipeline->slot_read);
+		}
+		else
+		{
+			/* Nothing to convert for skipped records and errors */
+			slot->status = SLOT_DONE;
+			pthread_cond_signal(&pipeline->slot_done);
+		}
+		pthread_mutex_unlock(&pipeline->lock);
+	}
+
+	pthread_mutex_lock(&pipeline->lock);
+	pipeline->reading_done = 1;
+	pthread_cond_broadcast(&pipeline->slot_read);
+	pthread_mutex_unlock(&pipeline->lock);
+
+	return NULL;
+}
+
+
+/*
+ * Worker thread: convert the records waiting in the queue. Each worker has a private
+ * copy of the state, so the conversion functions can leave their messages in it.
+ */
+static void *
+pipeline_worker(void *arg)
+{
+	SHPLOADERPIPELINE *pipeline = arg;
+	SHPLOADERSTATE state = *pipeline->state;
+	PIPELINE_SLOT *slot;
+	int s;
+
+	while (1)
+	{
+		pthread_mutex_lock(&pipeline->lock);
+		while (pipeline->queue_len == 0 && !pipeline->reading_done && !pipeline->abort)
+			pthread_cond_wait(&pipeline->slot_read, &pipeline->lock);
+
+		if (pipeline->abort || pipeline->queue_len == 0)
+		{
+			pthread_mutex_unlock(&pipeline->lock);
+			break;
+		}
+
+		s = pipeline->queue[pipeline->queue_head];
+		pipeline->queue_head = (pipeline->queue_head + 1) % pipeline->nslots;
+		pipeline->queue_len--;
+		slot = &pipeline->slots[s];
+		slot->status = SLOT_BUSY;
+		pthread_mutex_unlock(&pipeline->lock);
+
+		slot->result = ShpLoaderConvertRecord(&state, &slot->record, &slot->row, &slot->length);
+		if (slot->result == SHPLOADERERR || slot->result == SHPLOADERWARN)
+			snprintf(slot->message, SHPLOADERMSGLEN, "%s", state.message);
+		ShpLoaderFreeRecord(&state, &slot->record);
+
+		pthread_mutex_lock(&pipeline->lock);
+		slot->status = SLOT_DONE;
+		pthread_cond_signal(&pipeline->slot_done);
+		pthread_mutex_unlock(&pipeline->lock);
+	}
+
+	return NULL;
+}
+
+#endif
+
+
+/*
+ * Start generating the rows of state with nworkers conversion threads. Without thread
+ * support, or with fewer than two workers, the rows are simply generated one after the
+ * other by ShpLoaderPipelineNextRow.
+ */
+SHPLOADERPIPELINE *
+ShpLoaderPipelineCreate(SHPLOADERSTATE *state, int nworkers, int ordered)
+{
+	SHPLOADERPIPELINE *pipeline;
+
+	pipeline = malloc(sizeof(SHPLOADERPIPELINE));
+	memset(pipeline, 0, sizeof(SHPLOADERPIPELINE));
+	pipeline->state = state;
+	pipeline->ordered = ordered;
+
+#if HAVE_PTHREAD
+	if (nworkers > 1)
+	{
+		int i;
+
+		pipeline->nslots = nworkers * PIPELINE_SLOTS_PER_WORKER;
+		pipeline->slots = malloc(sizeof(PIPELINE_SLOT) * pipeline->nslots);
+		memset(pipeline->slots, 0, sizeof(PIPELINE_SLOT) * pipeline->nslots);
+		pipeline->queue = malloc(sizeof(int) * pipeline->nslots);
+
+		pthread_mutex_init(&pipeline->lock, NULL);
+		pthread_cond_init(&pipeline->slot_free, NULL);
+		pthread_cond_init(&pipeline->slot_read, NULL);
+		pthread_cond_init(&pipeline->slot_done, NULL);
+
+		pipeline->workers = malloc(sizeof(pthread_t) * nworkers);
+		for (i = 0; i < nworkers; i++)
+		{
+			if (pthread_create(&pipeline->workers[i], NULL, pipeline_worker, pipeline) != 0)
+				break;
+		}
+		pipeline->nworkers = i;
+
+		if (pipeline->nworkers > 0 && pthread_create(&pipeline->reader, NULL, pipeline_reader, pipeline) == 0)
+			return pipeline;
+
+		/* No threads after all, stop the workers and carry on without them */
+		pthread_mutex_lock(&pipeline->lock);
+		pipeline->abort = 1;
+		pthread_cond_broadcast(&pipeline->slot_read);
+		pthread_mutex_unlock(&pipeline->lock);
+		for (i = 0; i < pipeline->nworkers; i++)
+			pthread_join(pipeline->workers[i], NULL);
+
+		pthread_mutex_destroy(&pipeline->lock);
+		pthread_cond_destroy(&pipeline->slot_free);
+		pthread_cond_destroy(&pipeline->slot_read);
+		pthread_cond_destroy(&pipeline->slot_done);
+
+		free(pipeline->workers);
+		free(pipeline->slots);
+		free(pipeline->queue);
+		pipeline->workers = NULL;
+		pipeline->slots = NULL;
+		pipeline->queue = NULL;
+		pipeline->nworkers = 0;
+		pipeline->abort = 0;
+	}
+#endif
+
+	return pipeline;
+}
+
+
+/*
+ * Return the next row: the same as ShpLoaderGenerateSQLRowStatement, or
+ * ShpLoaderGenerateCopyBinaryRow for binary COPY, for the next record, including the
+ * message left in the state. It has to be called once per record, and not again after
+ * an error.
+ */
+int
+ShpLoaderPipelineNextRow(SHPLOADERPIPELINE *pipeline, char **row, size_t *length)
+{
+	SHPLOADERSTATE *state = pipeline->state;
+	int item = pipeline->nreturned++;
+	int res;
+
+	*row = NULL;
+	*length = 0;
+
+#if HAVE_PTHREAD
+	if (pipeline->slots)
+	{
+		PIPELINE_SLOT *slot = NULL;
+		int s;
+
+		pthread_mutex_lock(&pipeline->lock);
+		while (1)
+		{
+			if (pipeline->ordered)
+			{
+				s = item % pipeline->nslots;
+				if (pipeline->slots[s].status == SLOT_DONE && pipeline->slots[s].record.item == item)
+					slot = &pipeline->slots[s];
+			}
+			else
+			{
+				for (s = 0; s < pipeline->nslots; s++)
+				{
+					if (pipeline->slots[s].status == SLOT_DONE)
+					{
+						slot = &pipeline->slots[s];
+						break;
+					}
+				}
+			}
+			if (slot)
+				break;
+
+			pthread_cond_wait(&pipeline->slot_done, &pipeline->lock);
+		}
+
+		res = slot->result;
+		*row = slot->row;
+		*length = slot->length;
+		if (res == SHPLOADERERR || res == SHPLOADERWARN)
+			snprintf(state->message, SHPLOADERMSGLEN, "%s", slot->message);
+
+		slot->row = NULL;
+		slot->status = SLOT_FREE;
+		pthread_cond_signal(&pipeline->slot_free);
+		pthread_mutex_unlock(&pipeline->lock);
+
+		return res;
+	}
+#endif
+
+	if (state->config->dump_format && state->config->copy_binary)
+		return ShpLoaderGenerateCopyBinaryRow(state, item, row, length);
+
+	res = ShpLoaderGenerateSQLRowStatement(state, item, row);
+	if (*row)
+		*length = strlen(*row);
+
+	return res;
+}
+
+
+/* Stop the threads, if any are still running, and free the pipeline */
+void
+ShpLoaderPipelineDestroy(SHPLOADERPIPELINE *pipeline)
+{
+#if HAVE_PTHREAD
+	if (pipeline->slots)
+	{
+		int i;
+
+		pthread_mutex_lock(&pipeline->lock);
+		pipeline->abort = 1;
+		pthread_cond_broadcast(&pipeline->slot_free);
+		pthread_cond_broadcast(&pipeline->slot_read);
+		pthread_mutex_unlock(&pipeline->lock);
+
+		pthread_join(pipeline->reader, NULL);
+		for (i = 0; i < pipeline->nworkers; i++)
+			pthread_join(pipeline->workers[i], NULL);
+
+		/* Throw away whatever did not get returned */
+		for (i = 0; i < pipeline->nslots; i++)
+		{
+			if (pipeline->slots[i].status == SLOT_READ)
+				ShpLoaderFreeRecord(pipeline->state, &pipeline->slots[i].record);
+			else if (pipeline->slots[i].status == SLOT_DONE)
+				free(pipeline->slots[i].row);
+		}
+
+		pthread_mutex_destroy(&pipeline->lock);
+		pthread_cond_destroy(&pipeline->slot_free);
+		pthread_cond_destroy(&pipeline->slot_read);
+		pthread_cond_destroy(&pipeline->slot_done);
+
+		free(pipeline->workers);
+		free(pipeline->slots);
+		free(pipeline->queue);
+	}
+#endif
+
+	free(pipeline);
+}
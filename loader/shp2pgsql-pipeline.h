@@ -0,0 +1,29 @@
+/**********************************************************************
+ * $Id$
+ *
+ * PostGIS - Spatial Types for PostgreSQL
+ * http://postgis.refractions.net
+ *
+ * This is free software; you can redistribute and/or modify it under
+ * the terms of the GNU General Public Licence. See the COPYING file.
+ *
+ **********************************************************************/
+
+#ifndef SHP2PGSQL_PIPELINE_H
+#define SHP2PGSQL_PIPELINE_H
+
+#include "shp2pgsql-core.h"
+
+/*
+ * Generates the rows of a loader state with several threads: one reads the records from
+ * the shapefile and the DBF file, which have to be read sequentially, while a pool of
+ * workers turns them into geometries and rows. Rows come back in record order, or in the
+ * order they are ready when ordered is 0.
+ */
+typedef struct shp_loader_pipeline SHPLOADERPIPELINE;
+
+SHPLOADERPIPELINE *ShpLoaderPipelineCreate(SHPLOADERSTATE *state, int nworkers, int ordered);
+int ShpLoaderPipelineNextRow(SHPLOADERPIPELINE *pipeline, char **row, size_t *length);
+void ShpLoaderPipelineDestroy(SHPLOADERPIPELINE *pipeline);
+
+#endif
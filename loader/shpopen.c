@@ -2086,6 +2086,265 @@ SHPReadObject( SHPHandle psSHP, int hEntity )
     return( psShape );
 }
 
+/************************************************************************/
+/*                            SHPViewInt32()                            */
+/************************************************************************/
+
+static int32 SHPViewInt32( const uchar * pabyData )
+
+{
+    int32       nValue;
+
+    memcpy( &nValue, pabyData, 4 );
+    if( bBigEndian ) SwapWord( 4, &nValue );
+
+    return nValue;
+}
+
+/************************************************************************/
+/*                         SHPReadObjectView()                          */
+/*                                                                      */
+/*      Locate the vertices and parts of one shape in the record,       */
+/*      without copying or converting them (see SHPObjectView). The     */
+/*      record is not even read when the hooks can map the file.        */
+/*      Applies the same checks as SHPReadObject() and returns FALSE    */
+/*      if they fail. The view has to be released with                  */
+/*      SHPReleaseObjectView().                                         */
+/************************************************************************/
+
+int SHPAPI_CALL
+SHPReadObjectView( SHPHandle psSHP, int hEntity, SHPObjectView * psView )
+
+{
+    int                  nEntitySize, nRequiredSize, nOffset, i;
+    const uchar         *pabyRec = NULL;
+    char                 szErrorMsg[128];
+
+    memset( psView, 0, sizeof(SHPObjectView) );
+
+/* -------------------------------------------------------------------- */
+/*      Validate the record/entity number.                              */
+/* -------------------------------------------------------------------- */
+    if( hEntity < 0 || hEntity >= psSHP->nRecords )
+        return FALSE;
+
+    nEntitySize = psSHP->panRecSize[hEntity]+8;
+    psView->nShapeId = hEntity;
+
+/* -------------------------------------------------------------------- */
+/*      Use the record in place if the file is mapped, otherwise read   */
+/*      a copy of it.                                                   */
+/* -------------------------------------------------------------------- */
+    if( psSHP->sHooks.FMap != NULL )
+        pabyRec = psSHP->sHooks.FMap( psSHP->fpSHP,
+                                      psSHP->panRecOffset[hEntity],
+                                      nEntitySize );
+
+    if( pabyRec == NULL )
+    {
+        psView->pabyRecCopy = (uchar *) malloc( nEntitySize );
+        if( psView->pabyRecCopy == NULL )
+        {
+            snprintf( szErrorMsg, sizeof(szErrorMsg),
+                      "Not enough memory to allocate requested memory (nEntitySize=%d). "
+                      "Probably broken SHP file", nEntitySize );
+            psSHP->sHooks.Error( szErrorMsg );
+            return FALSE;
+        }
+
+        if( psSHP->sHooks.FSeek( psSHP->fpSHP, psSHP->panRecOffset[hEntity], 0 ) != 0 )
+        {
+            snprintf( szErrorMsg, sizeof(szErrorMsg),
+                      "Error in fseek() reading object from .shp file at offset %u",
+                      psSHP->panRecOffset[hEntity] );
+            psSHP->sHooks.Error( szErrorMsg );
+            SHPReleaseObjectView( psView );
+            return FALSE;
+        }
+
+        if( psSHP->sHooks.FRead( psView->pabyRecCopy, nEntitySize, 1, psSHP->fpSHP ) != 1 )
+        {
+            snprintf( szErrorMsg, sizeof(szErrorMsg),
+                      "Error in fread() reading object of size %u at offset %u from .shp file",
+                      nEntitySize, psSHP->panRecOffset[hEntity] );
+            psSHP->sHooks.Error( szErrorMsg );
+            SHPReleaseObjectView( psView );
+            return FALSE;
+        }
+
+        pabyRec = psView->pabyRecCopy;
+    }
+
+    if ( 8 + 4 > nEntitySize )
+        goto corrupted;
+
+    psView->nSHPType = SHPViewInt32( pabyRec + 8 );
+
+/* ==================================================================== */
+/*  Polygon, Arc or MultiPatch.                                         */
+/* ==================================================================== */
+    if( psView->nSHPType == SHPT_POLYGON || psView->nSHPType == SHPT_ARC
+        || psView->nSHPType == SHPT_POLYGONZ
+        || psView->nSHPType == SHPT_POLYGONM
+        || psView->nSHPType == SHPT_ARCZ
+        || psView->nSHPType == SHPT_ARCM
+        || psView->nSHPType == SHPT_MULTIPATCH )
+    {
+        int32		nPoints, nParts, nPartStart, nPrevPartStart = 0;
+
+        if ( 40 + 8 + 4 > nEntitySize )
+            goto corrupted;
+
+        nPoints = SHPViewInt32( pabyRec + 40 + 8 );
+        nParts = SHPViewInt32( pabyRec + 36 + 8 );
+
+        if (nPoints < 0 || nParts < 0 ||
+            nPoints > 50 * 1000 * 1000 || nParts > 10 * 1000 * 1000)
+            goto corrupted;
+
+        nRequiredSize = 44 + 8 + 4 * nParts + 16 * nPoints;
+        if ( psView->nSHPType == SHPT_POLYGONZ
+             || psView->nSHPType == SHPT_ARCZ
+             || psView->nSHPType == SHPT_MULTIPATCH )
+        {
+            nRequiredSize += 16 + 8 * nPoints;
+        }
+        if( psView->nSHPType == SHPT_MULTIPATCH )
+        {
+            nRequiredSize += 4 * nParts;
+        }
+        if (nRequiredSize > nEntitySize)
+            goto corrupted;
+
+        /* Part starts have to be increasing and inside the vertex array */
+        for( i = 0; i < nParts; i++ )
+        {
+            nPartStart = SHPViewInt32( pabyRec + 44 + 8 + 4 * i );
+            if( nPartStart < 0 || (nPartStart >= nPoints && nPoints > 0)
+                || (i > 0 && nPartStart <= nPrevPartStart) )
+                goto corrupted;
+            nPrevPartStart = nPartStart;
+        }
+
+        psView->nVertices = nPoints;
+        psView->nParts = nParts;
+        psView->pabyPartStart = pabyRec + 44 + 8;
+
+        nOffset = 44 + 8 + 4*nParts;
+
+        if( psView->nSHPType == SHPT_MULTIPATCH )
+        {
+            psView->pabyPartType = pabyRec + nOffset;
+            nOffset += 4*nParts;
+        }
+
+        psView->pabyXY = pabyRec + nOffset;
+        nOffset += 16*nPoints;
+
+        if( psView->nSHPType == SHPT_POLYGONZ
+            || psView->nSHPType == SHPT_ARCZ
+            || psView->nSHPType == SHPT_MULTIPATCH )
+        {
+            psView->pabyZ = pabyRec + nOffset + 16;
+            nOffset += 16 + 8*nPoints;
+        }
+
+        /* As in SHPReadObject(), M is there if the record is long enough */
+        if( nEntitySize >= nOffset + 16 + 8*nPoints )
+            psView->pabyM = pabyRec + nOffset + 16;
+    }
+
+/* ==================================================================== */
+/*  MultiPoint.                                                         */
+/* ==================================================================== */
+    else if( psView->nSHPType == SHPT_MULTIPOINT
+             || psView->nSHPType == SHPT_MULTIPOINTM
+             || psView->nSHPType == SHPT_MULTIPOINTZ )
+    {
+        int32		nPoints;
+
+        if ( 44 + 4 > nEntitySize )
+            goto corrupted;
+
+        nPoints = SHPViewInt32( pabyRec + 44 );
+        if (nPoints < 0 || nPoints > 50 * 1000 * 1000)
+            goto corrupted;
+
+        nRequiredSize = 48 + nPoints * 16;
+        if( psView->nSHPType == SHPT_MULTIPOINTZ )
+        {
+            nRequiredSize += 16 + nPoints * 8;
+        }
+        if (nRequiredSize > nEntitySize)
+            goto corrupted;
+
+        psView->nVertices = nPoints;
+        psView->pabyXY = pabyRec + 48;
+        nOffset = 48 + 16*nPoints;
+
+        if( psView->nSHPType == SHPT_MULTIPOINTZ )
+        {
+            psView->pabyZ = pabyRec + nOffset + 16;
+            nOffset += 16 + 8*nPoints;
+        }
+
+        if( nEntitySize >= nOffset + 16 + 8*nPoints )
+            psView->pabyM = pabyRec + nOffset + 16;
+    }
+
+/* ==================================================================== */
+/*  Point.                                                              */
+/* ==================================================================== */
+    else if( psView->nSHPType == SHPT_POINT
+             || psView->nSHPType == SHPT_POINTM
+             || psView->nSHPType == SHPT_POINTZ )
+    {
+        if (20 + 8 + (( psView->nSHPType == SHPT_POINTZ ) ? 8 : 0)> nEntitySize)
+            goto corrupted;
+
+        psView->nVertices = 1;
+        psView->pabyXY = pabyRec + 12;
+        nOffset = 20 + 8;
+
+        if( psView->nSHPType == SHPT_POINTZ )
+        {
+            psView->pabyZ = pabyRec + nOffset;
+            nOffset += 8;
+        }
+
+        if( nEntitySize >= nOffset + 8 )
+            psView->pabyM = pabyRec + nOffset;
+    }
+
+    return TRUE;
+
+  corrupted:
+    snprintf( szErrorMsg, sizeof(szErrorMsg),
+              "Corrupted .shp file : shape %d : nEntitySize = %d",
+              hEntity, nEntitySize );
+    psSHP->sHooks.Error( szErrorMsg );
+    SHPReleaseObjectView( psView );
+
+    return FALSE;
+}
+
+/************************************************************************/
+/*                        SHPReleaseObjectView()                        */
+/************************************************************************/
+
+void SHPAPI_CALL
+SHPReleaseObjectView( SHPObjectView * psView )
+
+{
+    if( psView == NULL )
+        return;
+
+    if( psView->pabyRecCopy != NULL )
+        free( psView->pabyRecCopy );
+
+    memset( psView, 0, sizeof(SHPObjectView) );
+}
+
 /************************************************************************/
 /*                            SHPTypeName()                             */
 /************************************************************************/
@@ -232,6 +232,14 @@ CREATE OR REPLACE FUNCTION geography_gist_decompress(internal)
 	AS 'MODULE_PATHNAME' ,'gserialized_gist_decompress'
 	LANGUAGE 'C';
 
+#if POSTGIS_PGSQL_VERSION >= 91
+-- Availability: 2.0.0
+CREATE OR REPLACE FUNCTION geography_gist_distance(internal, geography, int4) 
+	RETURNS float8 
+	AS 'MODULE_PATHNAME' ,'gserialized_gist_geog_distance'
+	LANGUAGE 'C';
+#endif
+
 -- Availability: 1.5.0
 CREATE OR REPLACE FUNCTION geography_gist_selectivity (internal, oid, internal, int4)
 	RETURNS float8
@@ -258,6 +266,19 @@ CREATE OPERATOR && (
 	JOIN = geography_gist_join_selectivity
 );
 
+-- Availability: 2.0.0
+CREATE OR REPLACE FUNCTION geography_distance_box(geography, geography) 
+	RETURNS float8 
+	AS 'MODULE_PATHNAME' ,'gserialized_geog_distance'
+	LANGUAGE 'C' IMMUTABLE STRICT;
+
+#if POSTGIS_PGSQL_VERSION >= 91
+-- Availability: 2.0.0
+CREATE OPERATOR <-> (
+	LEFTARG = geography, RIGHTARG = geography, PROCEDURE = geography_distance_box,
+	COMMUTATOR = '<->'
+);
+#endif
 
 -- Availability: 1.5.0
 CREATE OPERATOR CLASS gist_geography_ops
@@ -267,6 +288,10 @@ CREATE OPERATOR CLASS gist_geography_ops
 --	OPERATOR        6        ~=	,
 --	OPERATOR        7        ~	,
 --	OPERATOR        8        @	,
+#if POSTGIS_PGSQL_VERSION >= 91
+	OPERATOR        13       <-> FOR ORDER BY pg_catalog.float_ops,
+	FUNCTION        8        geography_gist_distance (internal, geography, int4),
+#endif
 	FUNCTION        1        geography_gist_consistent (internal, geography, int4),
 	FUNCTION        2        geography_gist_union (bytea, internal),
 	FUNCTION        3        geography_gist_compress (internal),
@@ -25,6 +25,7 @@
 #include "lwgeom_pg.h"       /* For debugging macros. */
 #include "geography.h"	     /* For utility functions. */
 #include "lwgeom_transform.h" /* For SRID functions */
+#include "lwgeom_cache.h"     /* For repeated argument trees */
 
 Datum geography_distance(PG_FUNCTION_ARGS);
 Datum geography_dwithin(PG_FUNCTION_ARGS);
@@ -38,6 +39,52 @@ Datum geography_perimeter(PG_FUNCTION_ARGS);
 Datum geography_project(PG_FUNCTION_ARGS);
 Datum geography_azimuth(PG_FUNCTION_ARGS);
 
+/*
+** Calculate the distance against the cached tree of a repeated argument,
+** building a tree for the other argument on the fly. Returns LW_FAILURE
+** if neither argument is cached, so the caller can do it the long way.
+*/
+static int geography_distance_cache(FunctionCallInfoData *fcinfo, GSERIALIZED *g1, GSERIALIZED *g2, const LWGEOM *lwgeom1, const LWGEOM *lwgeom2, const SPHEROID *s, double tolerance, double *distance)
+{
+	CircTreeGeomCache *cache = GetCircTreeGeomCache(fcinfo, g1, g2);
+	CIRC_NODE *tree;
+
+	if ( ! cache->argnum || ! cache->index )
+		return LW_FAILURE;
+
+	tree = lwgeom_calculate_circ_tree(cache->argnum == 1 ? lwgeom2 : lwgeom1);
+	if ( cache->argnum == 1 )
+		*distance = circ_tree_distance_tree(cache->index, tree, s, tolerance);
+	else
+		*distance = circ_tree_distance_tree(tree, cache->index, s, tolerance);
+	circ_tree_free(tree);
+
+	return LW_SUCCESS;
+}
+
+/*
+** Covers test of points against the cached tree of a repeated polygon.
+*/
+static int geography_covers_cache(const CIRC_NODE *tree, const LWGEOM *lwgeom)
+{
+	POINT2D pt;
+	int i;
+
+	if ( lwgeom->type == POINTTYPE )
+	{
+		getPoint2d_p(((LWPOINT*)lwgeom)->point, 0, &pt);
+		return circ_tree_covers_point(tree, &pt);
+	}
+
+	for ( i = 0; i < ((LWMPOINT*)lwgeom)->ngeoms; i++ )
+	{
+		getPoint2d_p(((LWMPOINT*)lwgeom)->geoms[i]->point, 0, &pt);
+		if ( ! circ_tree_covers_point(tree, &pt) )
+			return LW_FALSE;
+	}
+	return LW_TRUE;
+}
+
 /*
 ** geography_distance(GSERIALIZED *g1, GSERIALIZED *g2, double tolerance, boolean use_spheroid)
 ** returns double distance in meters
@@ -82,7 +129,9 @@ Datum geography_distance(PG_FUNCTION_ARGS)
 		PG_RETURN_NULL();
 	}
 
-	distance = lwgeom_distance_spheroid(lwgeom1, lwgeom2, &s, FP_TOLERANCE);
+	/* Repeated argument? Search its cached tree. */
+	if ( geography_distance_cache(fcinfo, g1, g2, lwgeom1, lwgeom2, &s, FP_TOLERANCE, &distance) == LW_FAILURE )
+		distance = lwgeom_distance_spheroid(lwgeom1, lwgeom2, &s, FP_TOLERANCE);
 
 	/* Clean up */
 	lwgeom_free(lwgeom1);
@@ -141,7 +190,9 @@ Datum geography_dwithin(PG_FUNCTION_ARGS)
 		PG_RETURN_BOOL(FALSE);
 	}
 
-	distance = lwgeom_distance_spheroid(lwgeom1, lwgeom2, &s, tolerance);
+	/* Repeated argument? Search its cached tree. */
+	if ( geography_distance_cache(fcinfo, g1, g2, lwgeom1, lwgeom2, &s, tolerance, &distance) == LW_FAILURE )
+		distance = lwgeom_distance_spheroid(lwgeom1, lwgeom2, &s, tolerance);
 
 	/* Clean up */
 	lwgeom_free(lwgeom1);
@@ -466,6 +517,21 @@ Datum geography_covers(PG_FUNCTION_ARGS)
 		PG_RETURN_BOOL(false);
 	}
 
+	/* Repeated polygon? Test the points against its cached tree. */
+	if ( type1 == POLYGONTYPE && (type2 == POINTTYPE || type2 == MULTIPOINTTYPE) )
+	{
+		CircTreeGeomCache *cache = GetCircTreeGeomCache(fcinfo, g1, NULL);
+		if ( cache->argnum && cache->index )
+		{
+			result = geography_covers_cache(cache->index, lwgeom2);
+			lwgeom_free(lwgeom1);
+			lwgeom_free(lwgeom2);
+			PG_FREE_IF_COPY(g1, 0);
+			PG_FREE_IF_COPY(g2, 1);
+			PG_RETURN_BOOL(result);
+		}
+	}
+
 	/* Calculate answer */
 	result = lwgeom_covers_lwgeom_sphere(lwgeom1, lwgeom2);
 
@@ -48,43 +48,145 @@
  * 	200-9999: reserved for other globally-known stats kinds
  * 	10000-32767: reserved for private site-local use
  *
+ * 	Kind 100 was the uniform grid histogram of earlier releases,
+ * 	which is laid out differently. Columns analyzed by those are
+ * 	estimated with the defaults until they are analyzed again.
+ *
  */
-#define STATISTIC_KIND_GEOMETRY 100
+#define STATISTIC_KIND_GEOMETRY 102
 
 /*
- * Define this if you want to use standard deviation based
- * histogram extent computation. If you do, you can also
- * tweak the deviation factor used in computation with
- * SDFACTOR.
+ * The histogram is a kd-tree built over the box centers of the
+ * sample features, splitting at the median so all cells hold about
+ * the same number of features. Dense areas get small cells and
+ * empty areas get none.
+ *
+ * Cells hold at least GEOM_STATS_MIN_FEATURES features and there are
+ * at most GEOM_STATS_CELLS_PER_TARGET cells per unit of statistics
+ * target, the number of cells being a power of two.
  */
-#define USE_STANDARD_DEVIATION 1
-#define SDFACTOR 3.25
+#define GEOM_STATS_MIN_FEATURES 10
+#define GEOM_STATS_CELLS_PER_TARGET 16
+
+/*
+ * Planning time bound: the estimators visit at most this many pairs
+ * of kd-tree nodes, past that they take the nodes at hand as a whole
+ * instead of descending to their cells.
+ */
+#define GEOM_STATS_MAX_NODE_PAIRS 65536
+
+/*
+ * A cell of the histogram, summarizing the features whose box center
+ * fell in a leaf of the kd-tree.
+ */
+typedef struct GEOM_STATS_CELL_T
+{
+	/* fraction of the sample rows in the cell */
+	float4 fraction;
+
+	/* extent of the box centers of the features */
+	float4 xmin, ymin, xmax, ymax;
+
+	/* average half width and half height of the feature boxes */
+	float4 halfwidth, halfheight;
+}
+GEOM_STATS_CELL;
 
 typedef struct GEOM_STATS_T
 {
-	/* cols * rows = total boxes in grid */
-	float4 cols;
-	float4 rows;
+	/* number of cells, a power of two */
+	float4 ncells;
+
+	/* number of sample features in the cells */
+	float4 nfeatures;
 
 	/* average bounding box area of not-null features */
 	float4 avgFeatureArea;
 
-	/*
-	 * average number of histogram cells
-	 * covered by the sample not-null features
-	 */
-	float4 avgFeatureCells;
+	/* fraction of the sample rows neither null nor empty */
+	float4 notnullFraction;
 
 	/* BOX of area */
 	float4 xmin,ymin, xmax, ymax;
 
 	/*
-	 * variable length # of floats for histogram
+	 * variable length # of cells, the leaves of
+	 * the kd-tree from left to right
 	 */
-	float4 value[1];
+	GEOM_STATS_CELL cells[1];
 }
 GEOM_STATS;
 
+/*
+ * Histogram for the N-D && operator (&&&), kept in the second stats
+ * slot. Cells have the layout of GEOM_STATS_CELL generalized to ndims
+ * dimensions, ordered as in GIDX: X, Y, then Z and M if present (M
+ * comes third when there is no Z). Only the dimensions all the sample
+ * features have are kept.
+ */
+#define STATISTIC_KIND_ND_GEOMETRY 103
+
+#define ND_DIMS 4
+
+/* Number of floats of a cell: fraction, then min, max and half of every dimension */
+#define STATS_CELL_SIZE(ndims) (1 + 3 * (ndims))
+
+typedef struct ND_STATS_T
+{
+	/* number of dimensions */
+	float4 ndims;
+
+	/* number of cells, a power of two */
+	float4 ncells;
+
+	/* number of sample features in the cells */
+	float4 nfeatures;
+
+	/* fraction of the sample rows neither null nor empty */
+	float4 notnullFraction;
+
+	/* extent of the feature boxes */
+	float4 min[ND_DIMS];
+	float4 max[ND_DIMS];
+
+	/*
+	 * variable length # of cells of STATS_CELL_SIZE(ndims)
+	 * floats each, the leaves of the kd-tree from left to right
+	 */
+	float4 cells[1];
+}
+ND_STATS;
+
+/*
+ * Node of the kd-tree, rebuilt from the cells at estimation time.
+ * Nodes are numbered heap-style: the root is 1, the children of node
+ * i are 2i and 2i+1, and cell j is node ncells+j. Inner nodes
+ * summarize their two children the same way cells summarize features.
+ */
+typedef struct GEOM_STATS_NODE_T
+{
+	double fraction;
+
+	/* extent of the box centers, average half sizes */
+	double min[ND_DIMS], max[ND_DIMS];
+	double half[ND_DIMS];
+
+	/* extent of the feature boxes, for pruning */
+	double reach_min[ND_DIMS], reach_max[ND_DIMS];
+}
+GEOM_STATS_NODE;
+
+/*
+ * Box center and half sizes of a sample feature, while building
+ * the histograms.
+ */
+typedef struct GEOM_STATS_SAMPLE_T
+{
+	double center[ND_DIMS];
+	double half[ND_DIMS];
+}
+GEOM_STATS_SAMPLE;
+
 static float8 estimate_selectivity(GBOX *box, GEOM_STATS *geomstats);
 
 
@@ -111,10 +213,364 @@ static float8 estimate_selectivity(GBOX *box, GEOM_STATS *geomstats);
 
 Datum geometry_gist_sel_2d(PG_FUNCTION_ARGS);
 Datum geometry_gist_joinsel_2d(PG_FUNCTION_ARGS);
+Datum geometry_gist_sel_nd(PG_FUNCTION_ARGS);
+Datum geometry_gist_joinsel_nd(PG_FUNCTION_ARGS);
 Datum geometry_analyze_2d(PG_FUNCTION_ARGS);
 Datum geometry_estimated_extent(PG_FUNCTION_ARGS);
 
 
+/**
+ * Check that a stats slot has the size its number of cells calls for,
+ * so a slot of another layout is never read as a histogram.
+ */
+static int
+geometry_stats_is_valid(const GEOM_STATS *geomstats, int nvalues)
+{
+	int ncells;
+
+	if ( nvalues * sizeof(float4) < offsetof(GEOM_STATS, cells) )
+		return LW_FALSE;
+
+	ncells = (int)geomstats->ncells;
+	if ( ncells < 1 || (ncells & (ncells - 1)) != 0 )
+		return LW_FALSE;
+
+	return nvalues * sizeof(float4) == offsetof(GEOM_STATS, cells) + ncells * sizeof(GEOM_STATS_CELL);
+}
+
+/**
+ * Same as geometry_stats_is_valid() for the N-D histogram.
+ */
+static int
+nd_stats_is_valid(const ND_STATS *ndstats, int nvalues)
+{
+	int ncells, ndims;
+
+	if ( nvalues * sizeof(float4) < offsetof(ND_STATS, cells) )
+		return LW_FALSE;
+
+	ndims = (int)ndstats->ndims;
+	if ( ndims < 2 || ndims > ND_DIMS )
+		return LW_FALSE;
+
+	ncells = (int)ndstats->ncells;
+	if ( ncells < 1 || (ncells & (ncells - 1)) != 0 )
+		return LW_FALSE;
+
+	return nvalues * sizeof(float4) == offsetof(ND_STATS, cells) + ncells * STATS_CELL_SIZE(ndims) * sizeof(float4);
+}
+
+/**
+ * Rebuild the kd-tree of the ncells cells of a histogram of ndims
+ * dimensions, see GEOM_STATS_NODE. The array has 2*ncells nodes,
+ * node 0 is unused.
+ */
+static GEOM_STATS_NODE *
+stats_tree(const float4 *cells, int ncells, int ndims)
+{
+	GEOM_STATS_NODE *nodes = palloc(sizeof(GEOM_STATS_NODE) * 2 * ncells);
+	int i, d;
+
+	for ( i = 0; i < ncells; i++ )
+	{
+		const float4 *cell = cells + i * STATS_CELL_SIZE(ndims);
+		GEOM_STATS_NODE *node = &(nodes[ncells + i]);
+
+		node->fraction = cell[0];
+		for ( d = 0; d < ndims; d++ )
+		{
+			node->min[d] = cell[1 + d];
+			node->max[d] = cell[1 + ndims + d];
+			node->half[d] = cell[1 + 2 * ndims + d];
+			node->reach_min[d] = node->min[d] - node->half[d];
+			node->reach_max[d] = node->max[d] + node->half[d];
+		}
+	}
+
+	for ( i = ncells - 1; i > 0; i-- )
+	{
+		const GEOM_STATS_NODE *l = &(nodes[2*i]);
+		const GEOM_STATS_NODE *r = &(nodes[2*i+1]);
+		GEOM_STATS_NODE *node = &(nodes[i]);
+
+		node->fraction = l->fraction + r->fraction;
+		for ( d = 0; d < ndims; d++ )
+		{
+			node->min[d] = Min(l->min[d], r->min[d]);
+			node->max[d] = Max(l->max[d], r->max[d]);
+			if ( node->fraction > 0 )
+				node->half[d] = (l->fraction * l->half[d] + r->fraction * r->half[d]) / node->fraction;
+			else
+				node->half[d] = (l->half[d] + r->half[d]) / 2;
+			node->reach_min[d] = Min(l->reach_min[d], r->reach_min[d]);
+			node->reach_max[d] = Max(l->reach_max[d], r->reach_max[d]);
+		}
+	}
+
+	return nodes;
+}
+
+/*
+ * Integral over [0,u] of min(max(s,0),h) ds
+ */
+static double
+clamped_ramp_integral(double u, double h)
+{
+	if ( u <= 0 )
+		return 0.0;
+	if ( u <= h )
+		return u * u / 2;
+	return h * h / 2 + h * (u - h);
+}
+
+/*
+ * Length of the intersection of two intervals
+ */
+static double
+interval_overlap(double min1, double max1, double min2, double max2)
+{
+	double len = Min(max1, max2) - Max(min1, min2);
+	return len > 0 ? len : 0.0;
+}
+
+/**
+ * Probability that |u1 - u2| <= d, with u1 and u2 uniformly distributed
+ * over [min1,max1] and [min2,max2]. This is the area of the band
+ * -d <= u2 - u1 <= d over the area of the rectangle of (u1,u2) pairs.
+ */
+static double
+uniform_overlap_probability(double min1, double max1, double min2, double max2, double d)
+{
+	double len1 = max1 - min1;
+	double len2 = max2 - min2;
+	double below_d, below_minus_d, p;
+
+	if ( len1 <= 0 && len2 <= 0 )
+		return fabs(min1 - min2) <= d ? 1.0 : 0.0;
+	if ( len1 <= 0 )
+		return interval_overlap(min1 - d, min1 + d, min2, max2) / len2;
+	if ( len2 <= 0 )
+		return interval_overlap(min2 - d, min2 + d, min1, max1) / len1;
+
+	/* Area of the rectangle where u2 - u1 <= t, integrating over u1 */
+	below_d = clamped_ramp_integral(max1 + d - min2, len2) -
+	          clamped_ramp_integral(min1 + d - min2, len2);
+	below_minus_d = clamped_ramp_integral(max1 - d - min2, len2) -
+	                clamped_ramp_integral(min1 - d - min2, len2);
+
+	p = (below_d - below_minus_d) / (len1 * len2);
+
+	if ( p > 1.0 ) p = 1.0;
+	else if ( p < 0.0 ) p = 0.0;
+	return p;
+}
+
+/**
+ * Fraction of the pairs of rows of two kd-trees whose boxes overlap
+ * on the first ndims dimensions, starting from node i1 of the first
+ * and node i2 of the second.
+ *
+ * Within a node the features are taken to have their box centers
+ * spread uniformly over the extent of the centers, and the average
+ * box size. Two of them overlap when their centers are closer than
+ * the sum of their half sizes on every axis.
+ *
+ * Node pairs whose box extents do not meet are pruned, the others
+ * are split down to cell pairs until *budget node pairs have been
+ * visited.
+ */
+static double
+stats_tree_join(const GEOM_STATS_NODE *t1, int n1, int i1,
+                const GEOM_STATS_NODE *t2, int n2, int i2, int ndims, int *budget)
+{
+	const GEOM_STATS_NODE *a = &(t1[i1]);
+	const GEOM_STATS_NODE *b = &(t2[i2]);
+	int leaf1 = (i1 >= n1);
+	int leaf2 = (i2 >= n2);
+	double size1 = 1.0, size2 = 1.0;
+	double p;
+	int d;
+
+	(*budget)--;
+
+	if ( a->fraction <= 0 || b->fraction <= 0 )
+		return 0.0;
+
+	for ( d = 0; d < ndims; d++ )
+	{
+		if ( a->reach_min[d] > b->reach_max[d] || a->reach_max[d] < b->reach_min[d] )
+			return 0.0;
+	}
+
+	if ( (leaf1 && leaf2) || *budget <= 0 )
+	{
+		p = a->fraction * b->fraction;
+		for ( d = 0; d < ndims; d++ )
+			p *= uniform_overlap_probability(a->min[d], a->max[d], b->min[d], b->max[d], a->half[d] + b->half[d]);
+		return p;
+	}
+
+	/* Split the node that reaches further */
+	for ( d = 0; d < ndims; d++ )
+	{
+		size1 *= a->reach_max[d] - a->reach_min[d];
+		size2 *= b->reach_max[d] - b->reach_min[d];
+	}
+	if ( leaf2 || ( ! leaf1 && size1 >= size2 ) )
+	{
+		return stats_tree_join(t1, n1, 2*i1, t2, n2, i2, ndims, budget) +
+		       stats_tree_join(t1, n1, 2*i1+1, t2, n2, i2, ndims, budget);
+	}
+	return stats_tree_join(t1, n1, i1, t2, n2, 2*i2, ndims, budget) +
+	       stats_tree_join(t1, n1, i1, t2, n2, 2*i2+1, ndims, budget);
+}
+
+/**
+ * Fraction of the rows of a histogram whose boxes overlap
+ * a search box given by its minimum and maximum on the first
+ * ndims dimensions.
+ *
+ * The search box is taken as a histogram of its own, with a single
+ * cell holding every row, and joined with the histogram. The fraction
+ * of the rows in a cell whose boxes overlap the search box is the
+ * fraction of their centers that are within reach of it.
+ */
+static float8
+stats_selectivity(const float4 *cells, int ncells, int cell_ndims,
+                  const double *min, const double *max, int ndims)
+{
+	GEOM_STATS_NODE *tree;
+	GEOM_STATS_NODE query[2];
+	int budget = GEOM_STATS_MAX_NODE_PAIRS;
+	float8 selectivity;
+	int d;
+
+	/* A single cell tree, node 0 is unused */
+	query[1].fraction = 1.0;
+	for ( d = 0; d < ndims; d++ )
+	{
+		query[1].min[d] = query[1].max[d] = (min[d] + max[d]) / 2;
+		query[1].half[d] = (max[d] - min[d]) / 2;
+		query[1].reach_min[d] = min[d];
+		query[1].reach_max[d] = max[d];
+	}
+
+	tree = stats_tree(cells, ncells, cell_ndims);
+	selectivity = stats_tree_join(tree, ncells, 1, query, 1, 1, ndims, &budget);
+	pfree(tree);
+
+	POSTGIS_DEBUGF(3, " selectivity=%f, %d node pairs left", selectivity, budget);
+
+	/* prevent rounding overflows */
+	if (selectivity > 1.0) selectivity = 1.0;
+	else if (selectivity < 0) selectivity = 0.0;
+
+	return selectivity;
+}
+
+/**
+ * Fraction of the cross product of the rows of two histograms
+ * whose boxes overlap on the first ndims dimensions.
+ */
+static float8
+stats_join_selectivity(const float4 *cells1, int ncells1, int ndims1,
+                       const float4 *cells2, int ncells2, int ndims2, int ndims)
+{
+	GEOM_STATS_NODE *tree1, *tree2;
+	int budget = GEOM_STATS_MAX_NODE_PAIRS;
+	float8 selectivity;
+
+	tree1 = stats_tree(cells1, ncells1, ndims1);
+	tree2 = stats_tree(cells2, ncells2, ndims2);
+
+	selectivity = stats_tree_join(tree1, ncells1, 1, tree2, ncells2, 1, ndims, &budget);
+
+	POSTGIS_DEBUGF(3, " join selectivity %g, %d node pairs left", selectivity, budget);
+
+	pfree(tree1);
+	pfree(tree2);
+
+	if (selectivity > 1.0) selectivity = 1.0;
+	else if (selectivity < 0) selectivity = 0.0;
+
+	return selectivity;
+}
+
+/**
+ * Minimum and maximum of a box on each of its dimensions, in the
+ * order of GIDX. Returns the number of dimensions.
+ */
+static int
+gbox_nd_extent(const GBOX *box, double *min, double *max)
+{
+	int ndims = 2;
+
+	min[0] = box->xmin;
+	max[0] = box->xmax;
+	min[1] = box->ymin;
+	max[1] = box->ymax;
+	if ( FLAGS_GET_Z(box->flags) )
+	{
+		min[ndims] = box->zmin;
+		max[ndims] = box->zmax;
+		ndims++;
+	}
+	if ( FLAGS_GET_M(box->flags) )
+	{
+		min[ndims] = box->mmin;
+		max[ndims] = box->mmax;
+		ndims++;
+	}
+	return ndims;
+}
+
+/**
+ * Fraction of the cross product of the rows of two columns
+ * whose 2D boxes overlap.
+ */
+static float8
+estimate_join_selectivity(GEOM_STATS *geomstats1, GEOM_STATS *geomstats2)
+{
+	/* The columns don't overlap at all */
+	if ( geomstats1->xmin > geomstats2->xmax ||
+	     geomstats1->xmax < geomstats2->xmin ||
+	     geomstats1->ymin > geomstats2->ymax ||
+	     geomstats1->ymax < geomstats2->ymin )
+	{
+		POSTGIS_DEBUG(3, " column extents do not overlap, returning 0");
+
+		return 0.0;
+	}
+
+	return stats_join_selectivity((float4 *)geomstats1->cells, (int)geomstats1->ncells, 2,
+	                              (float4 *)geomstats2->cells, (int)geomstats2->ncells, 2, 2);
+}
+
+/**
+ * Fraction of the cross product of the rows of two columns
+ * whose N-D boxes overlap on the dimensions they share.
+ */
+static float8
+estimate_join_selectivity_nd(ND_STATS *ndstats1, ND_STATS *ndstats2)
+{
+	int ndims = Min((int)ndstats1->ndims, (int)ndstats2->ndims);
+	int d;
+
+	/* The columns don't overlap at all */
+	for ( d = 0; d < ndims; d++ )
+	{
+		if ( ndstats1->min[d] > ndstats2->max[d] || ndstats1->max[d] < ndstats2->min[d] )
+		{
+			POSTGIS_DEBUG(3, " column extents do not overlap, returning 0");
+
+			return 0.0;
+		}
+	}
+
+	return stats_join_selectivity(ndstats1->cells, (int)ndstats1->ncells, (int)ndstats1->ndims,
+	                              ndstats2->cells, (int)ndstats2->ncells, (int)ndstats2->ndims, ndims);
+}
+
 #if ! REALLY_DO_JOINSEL
 /**
  * JOIN selectivity in the GiST && operator
@@ -131,32 +587,6 @@ Datum geometry_gist_joinsel(PG_FUNCTION_ARGS)
 
 #else /* REALLY_DO_JOINSEL */
 
-static int
-calculate_column_intersection(GBOX *search_box, GEOM_STATS *geomstats1, GEOM_STATS *geomstats2)
-{
-	/**
-	* Calculate the intersection of two columns from their geomstats extents - return true
-	* if a valid intersection was found, false if there is no overlap
-	*/
-
-	float8 i_xmin = Max(geomstats1->xmin, geomstats2->xmin);
-	float8 i_ymin = Max(geomstats1->ymin, geomstats2->ymin);
-	float8 i_xmax = Min(geomstats1->xmax, geomstats2->xmax);
-	float8 i_ymax = Min(geomstats1->ymax, geomstats2->ymax);
-
-	/* If the rectangles don't intersect, return false */
-	if (i_xmin > i_xmax || i_ymin > i_ymax)
-		return FALSE;
-
-	/* Otherwise return the rectangle in search_box */
-	search_box->xmin = i_xmin;
-	search_box->ymin = i_ymin;
-	search_box->xmax = i_xmax;
-	search_box->ymax = i_ymax;
-
-	return TRUE;
-}
-
 /**
 * JOIN selectivity in the GiST && operator
 * for all PG versions
@@ -174,7 +604,7 @@ Datum geometry_gist_joinsel_2d(PG_FUNCTION_ARGS)
 	Var *var1, *var2;
 	Oid relid1, relid2;
 
-	HeapTuple stats1_tuple, stats2_tuple, class_tuple;
+	HeapTuple stats1_tuple, stats2_tuple;
 	GEOM_STATS *geomstats1, *geomstats2;
 	/*
 	* These are to avoid casting the corresponding
@@ -183,21 +613,18 @@ Datum geometry_gist_joinsel_2d(PG_FUNCTION_ARGS)
 	*/
 	GEOM_STATS **gs1ptr=&geomstats1, **gs2ptr=&geomstats2;
 	int geomstats1_nvalues = 0, geomstats2_nvalues = 0;
-	float8 selectivity1 = 0.0, selectivity2 = 0.0;
-	float4 num1_tuples = 0.0, num2_tuples = 0.0;
-	float4 total_tuples = 0.0, rows_returned = 0.0;
-	GBOX search_box;
+	float8 selectivity;
 
 
 	/**
-	* Join selectivity algorithm. To calculation the selectivity we
-	* calculate the intersection of the two column sample extents,
-	* sum the results, and then multiply by two since for each
-	* geometry in col 1 that intersects a geometry in col 2, the same
-	* will also be true.
+	* Join selectivity algorithm. The histograms of both columns
+	* are kd-trees of cells. Walking the two trees together, the
+	* pairs of cells that can hold overlapping boxes are found and
+	* the fraction of their row pairs that overlap is summed up,
+	* giving the fraction of the cross product of the two tables
+	* that the join returns.
 	*/
 
-
 	POSTGIS_DEBUGF(3, "geometry_gist_joinsel called with jointype %d", jointype);
 
 	/*
@@ -281,23 +708,23 @@ Datum geometry_gist_joinsel_2d(PG_FUNCTION_ARGS)
 		PG_RETURN_FLOAT8(DEFAULT_GEOMETRY_JOINSEL);
 	}
 
-
-	/**
-	* Setup the search box - this is the intersection of the two column
-	* extents.
-	*/
-	calculate_column_intersection(&search_box, geomstats1, geomstats2);
-
 	POSTGIS_DEBUGF(3, " -- geomstats1 box: %.15g %.15g, %.15g %.15g",geomstats1->xmin,geomstats1->ymin,geomstats1->xmax,geomstats1->ymax);
 	POSTGIS_DEBUGF(3, " -- geomstats2 box: %.15g %.15g, %.15g %.15g",geomstats2->xmin,geomstats2->ymin,geomstats2->xmax,geomstats2->ymax);
-	POSTGIS_DEBUGF(3, " -- calculated intersection box is : %.15g %.15g, %.15g %.15g",search_box.xmin,search_box.ymin,search_box.xmax,search_box.ymax);
-
 
 	/* Do the selectivity */
-	selectivity1 = estimate_selectivity(&search_box, geomstats1);
-	selectivity2 = estimate_selectivity(&search_box, geomstats2);
+	if ( geometry_stats_is_valid(geomstats1, geomstats1_nvalues) &&
+	     geometry_stats_is_valid(geomstats2, geomstats2_nvalues) )
+	{
+		selectivity = estimate_join_selectivity(geomstats1, geomstats2);
+	}
+	else
+	{
+		POSTGIS_DEBUG(3, " corrupted histogram - returning default geometry join selectivity");
+
+		selectivity = DEFAULT_GEOMETRY_JOINSEL;
+	}
 
-	POSTGIS_DEBUGF(3, "selectivity1: %.15g   selectivity2: %.15g", selectivity1, selectivity2);
+	POSTGIS_DEBUGF(3, "join selectivity: %.15g", selectivity);
 
 	/* Free the statistic tuples */
 	free_attstatsslot(0, NULL, 0, (float *)geomstats1, geomstats1_nvalues);
@@ -306,74 +733,123 @@ Datum geometry_gist_joinsel_2d(PG_FUNCTION_ARGS)
 	free_attstatsslot(0, NULL, 0, (float *)geomstats2, geomstats2_nvalues);
 	ReleaseSysCache(stats2_tuple);
 
-	/*
-	* OK, so before we calculate the join selectivity we also need to
-	* know the number of tuples in each of the columns since
-	* estimate_selectivity returns the number of estimated tuples
-	* divided by the total number of tuples - hence we need to
-	* multiply out the returned selectivity by the total number of rows.
-	*/
-	class_tuple = SearchSysCache(RELOID, ObjectIdGetDatum(relid1),
-	                             0, 0, 0);
+	PG_RETURN_FLOAT8(selectivity);
+}
+
+/**
+* JOIN selectivity in the GiST &&& operator, same as
+* geometry_gist_joinsel_2d() on the N-D histograms.
+*/
+PG_FUNCTION_INFO_V1(geometry_gist_joinsel_nd);
+Datum geometry_gist_joinsel_nd(PG_FUNCTION_ARGS)
+{
+	PlannerInfo *root = (PlannerInfo *) PG_GETARG_POINTER(0);
+
+	/* Oid operator = PG_GETARG_OID(1); */
+	List *args = (List *) PG_GETARG_POINTER(2);
+	JoinType jointype = (JoinType) PG_GETARG_INT16(3);
+
+	Node *arg1, *arg2;
+	Var *var1, *var2;
+	Oid relid1, relid2;
 
-	if (HeapTupleIsValid(class_tuple))
+	HeapTuple stats1_tuple, stats2_tuple;
+	ND_STATS *ndstats1, *ndstats2;
+	ND_STATS **nd1ptr=&ndstats1, **nd2ptr=&ndstats2;
+	int ndstats1_nvalues = 0, ndstats2_nvalues = 0;
+	float8 selectivity;
+
+	POSTGIS_DEBUGF(3, "geometry_gist_joinsel_nd called with jointype %d", jointype);
+
+	if (jointype != JOIN_INNER)
 	{
-		Form_pg_class reltup = (Form_pg_class) GETSTRUCT(class_tuple);
-		num1_tuples = reltup->reltuples;
+		elog(NOTICE, "geometry_gist_joinsel_nd called with incorrect join type");
+		PG_RETURN_FLOAT8(DEFAULT_GEOMETRY_JOINSEL);
 	}
 
-	ReleaseSysCache(class_tuple);
+	arg1 = (Node *) linitial(args);
+	arg2 = (Node *) lsecond(args);
+
+	if (!IsA(arg1, Var) || !IsA(arg2, Var))
+	{
+		elog(DEBUG1, "geometry_gist_joinsel_nd called with arguments that are not column references");
+		PG_RETURN_FLOAT8(DEFAULT_GEOMETRY_JOINSEL);
+	}
 
+	var1 = (Var *)arg1;
+	var2 = (Var *)arg2;
 
-	class_tuple = SearchSysCache(RELOID, ObjectIdGetDatum(relid2),
-	                             0, 0, 0);
+	relid1 = getrelid(var1->varno, root->parse->rtable);
+	relid2 = getrelid(var2->varno, root->parse->rtable);
 
-	if (HeapTupleIsValid(class_tuple))
+	/* Read the stats tuple from the first column */
+	stats1_tuple = SearchSysCache(STATRELATT, ObjectIdGetDatum(relid1), Int16GetDatum(var1->varattno), 0, 0);
+	if ( ! stats1_tuple )
 	{
-		Form_pg_class reltup = (Form_pg_class) GETSTRUCT(class_tuple);
-		num2_tuples = reltup->reltuples;
-	}
+		POSTGIS_DEBUG(3, " No statistics, returning default geometry join selectivity");
 
-	ReleaseSysCache(class_tuple);
+		PG_RETURN_FLOAT8(DEFAULT_GEOMETRY_JOINSEL);
+	}
 
+	if ( ! get_attstatsslot(stats1_tuple, 0, 0, STATISTIC_KIND_ND_GEOMETRY, InvalidOid, NULL, NULL,
+#if POSTGIS_PGSQL_VERSION > 84
+	                        NULL,
+#endif
+	                        (float4 **)nd1ptr, &ndstats1_nvalues) )
+	{
+		POSTGIS_DEBUG(3, " STATISTIC_KIND_ND_GEOMETRY stats not found - returning default geometry join selectivity");
 
-	/*
-	* Finally calculate the estimate of the number of rows returned
-	*
-	*    = 2 * (nrows from col1 + nrows from col2) /
-	*	total nrows in col1 x total nrows in col2
-	*
-	* The factor of 2 accounts for the fact that for each tuple in
-	* col 1 matching col 2,
-	* there will be another match in col 2 matching col 1
-	*/
+		ReleaseSysCache(stats1_tuple);
+		PG_RETURN_FLOAT8(DEFAULT_GEOMETRY_JOINSEL);
+	}
 
-	total_tuples = num1_tuples * num2_tuples;
-	rows_returned = 2 * ((num1_tuples * selectivity1) +
-	                     (num2_tuples * selectivity2));
+	/* Read the stats tuple from the second column */
+	stats2_tuple = SearchSysCache(STATRELATT, ObjectIdGetDatum(relid2), Int16GetDatum(var2->varattno), 0, 0);
+	if ( ! stats2_tuple )
+	{
+		POSTGIS_DEBUG(3, " No statistics, returning default geometry join selectivity");
 
-	POSTGIS_DEBUGF(3, "Rows from rel1: %g", num1_tuples * selectivity1);
-	POSTGIS_DEBUGF(3, "Rows from rel2: %g", num2_tuples * selectivity2);
-	POSTGIS_DEBUGF(3, "Estimated rows returned: %g", rows_returned);
+		free_attstatsslot(0, NULL, 0, (float *)ndstats1, ndstats1_nvalues);
+		ReleaseSysCache(stats1_tuple);
+		PG_RETURN_FLOAT8(DEFAULT_GEOMETRY_JOINSEL);
+	}
 
-	/*
-	* One (or both) tuple count is zero...
-	* We return default selectivity estimate.
-	* We could probably attempt at an estimate
-	* w/out looking at tables tuple count, with
-	* a function of selectivity1, selectivity2.
-	*/
-	if ( ! total_tuples )
+	if ( ! get_attstatsslot(stats2_tuple, 0, 0, STATISTIC_KIND_ND_GEOMETRY, InvalidOid, NULL, NULL,
+#if POSTGIS_PGSQL_VERSION > 84
+	                        NULL,
+#endif
+	                        (float4 **)nd2ptr, &ndstats2_nvalues) )
 	{
-		POSTGIS_DEBUG(3, "Total tuples == 0, returning default join selectivity");
+		POSTGIS_DEBUG(3, " STATISTIC_KIND_ND_GEOMETRY stats not found - returning default geometry join selectivity");
 
+		free_attstatsslot(0, NULL, 0, (float *)ndstats1, ndstats1_nvalues);
+		ReleaseSysCache(stats2_tuple);
+		ReleaseSysCache(stats1_tuple);
 		PG_RETURN_FLOAT8(DEFAULT_GEOMETRY_JOINSEL);
 	}
 
-	if ( rows_returned > total_tuples )
-		PG_RETURN_FLOAT8(1.0);
+	/* Do the selectivity */
+	if ( nd_stats_is_valid(ndstats1, ndstats1_nvalues) &&
+	     nd_stats_is_valid(ndstats2, ndstats2_nvalues) )
+	{
+		selectivity = estimate_join_selectivity_nd(ndstats1, ndstats2);
+	}
+	else
+	{
+		POSTGIS_DEBUG(3, " corrupted histogram - returning default geometry join selectivity");
 
-	PG_RETURN_FLOAT8(rows_returned / total_tuples);
+		selectivity = DEFAULT_GEOMETRY_JOINSEL;
+	}
+
+	POSTGIS_DEBUGF(3, "join selectivity: %.15g", selectivity);
+
+	free_attstatsslot(0, NULL, 0, (float *)ndstats1, ndstats1_nvalues);
+	ReleaseSysCache(stats1_tuple);
+
+	free_attstatsslot(0, NULL, 0, (float *)ndstats2, ndstats2_nvalues);
+	ReleaseSysCache(stats2_tuple);
+
+	PG_RETURN_FLOAT8(selectivity);
 }
 
 #endif /* REALLY_DO_JOINSEL */
@@ -385,27 +861,11 @@ Datum geometry_gist_joinsel_2d(PG_FUNCTION_ARGS)
  * This function returns an estimate of the selectivity
  * of a search_box looking at data in the GEOM_STATS
  * structure.
- * */
-/**
-* TODO: handle box dimension collapses (probably should be handled
-* by the statistic generator, avoiding GEOM_STATS with collapsed
-* dimensions)
-*/
+ */
 static float8
 estimate_selectivity(GBOX *box, GEOM_STATS *geomstats)
 {
-	int x, y;
-	int x_idx_min, x_idx_max, y_idx_min, y_idx_max;
-	double intersect_x, intersect_y, AOI;
-	double cell_area, box_area;
-	double geow, geoh; /* width and height of histogram */
-	int histocols, historows; /* histogram grid size */
-	double value;
-	float overlapping_cells;
-	float avg_feat_cells;
-	double gain;
-	float8 selectivity;
-
+	double min[2], max[2];
 
 	/*
 	 * Search box completely miss histogram extent
@@ -420,211 +880,204 @@ estimate_selectivity(GBOX *box, GEOM_STATS *geomstats)
 		return 0.0;
 	}
 
+	min[0] = box->xmin;
+	min[1] = box->ymin;
+	max[0] = box->xmax;
+	max[1] = box->ymax;
+
+	return stats_selectivity((float4 *)geomstats->cells, (int)geomstats->ncells, 2, min, max, 2);
+}
+
+/**
+ * Same as estimate_selectivity() for the N-D histogram, on the
+ * dimensions both the search box and the column have.
+ */
+static float8
+estimate_selectivity_nd(GBOX *box, ND_STATS *ndstats)
+{
+	double min[ND_DIMS], max[ND_DIMS];
+	int ndims, d;
+
+	ndims = gbox_nd_extent(box, min, max);
+	if ( ndims > (int)ndstats->ndims )
+		ndims = (int)ndstats->ndims;
+
 	/*
-	 * Search box completely contains histogram extent
+	 * Search box completely miss histogram extent
 	 */
-	if ( box->xmax >= geomstats->xmax &&
-	        box->xmin <= geomstats->xmin &&
-	        box->ymax >= geomstats->ymax &&
-	        box->ymin <= geomstats->ymin )
+	for ( d = 0; d < ndims; d++ )
 	{
-		POSTGIS_DEBUG(3, " search_box contains histogram, returning 1");
+		if ( max[d] < ndstats->min[d] || min[d] > ndstats->max[d] )
+		{
+			POSTGIS_DEBUG(3, " search_box does not overlaps histogram, returning 0");
 
-		return 1.0;
+			return 0.0;
+		}
 	}
 
-	geow = geomstats->xmax-geomstats->xmin;
-	geoh = geomstats->ymax-geomstats->ymin;
+	return stats_selectivity(ndstats->cells, (int)ndstats->ncells, (int)ndstats->ndims, min, max, ndims);
+}
 
-	histocols = geomstats->cols;
-	historows = geomstats->rows;
+/**
+ * This function should return an estimation of the number of
+ * rows returned by a query involving an overlap check
+ * ( it's the restrict function for the && operator )
+ *
+ * It can make use (if available) of the statistics collected
+ * by the geometry analyzer function.
+ *
+ * Note that the good work is done by estimate_selectivity() above.
+ * This function just tries to find the search_box, loads the statistics
+ * and invoke the work-horse.
+ *
+ * This is the one used for PG version >= 7.5
+ *
+ */
+PG_FUNCTION_INFO_V1(geometry_gist_sel_2d);
+Datum geometry_gist_sel_2d(PG_FUNCTION_ARGS)
+{
+	PlannerInfo *root = (PlannerInfo *) PG_GETARG_POINTER(0);
 
-	POSTGIS_DEBUGF(3, " histogram has %d cols, %d rows", histocols, historows);
-	POSTGIS_DEBUGF(3, " histogram geosize is %fx%f", geow, geoh);
+	/* Oid operator = PG_GETARG_OID(1); */
+	List *args = (List *) PG_GETARG_POINTER(2);
+	/* int varRelid = PG_GETARG_INT32(3); */
+	Oid relid;
+	HeapTuple stats_tuple;
+	GEOM_STATS *geomstats;
+	/*
+	 * This is to avoid casting the corresponding
+	 * "type-punned" pointer, which would break
+	 * "strict-aliasing rules".
+	 */
+	GEOM_STATS **gsptr=&geomstats;
+	int geomstats_nvalues=0;
+	Node *other;
+	Var *self;
+	GBOX search_box;
+	float8 selectivity=0;
 
-	cell_area = (geow*geoh) / (histocols*historows);
-	box_area = (box->xmax-box->xmin)*(box->ymax-box->ymin);
-	value = 0;
+	POSTGIS_DEBUG(2, "geometry_gist_sel called");
 
-	/* Find first overlapping column */
-	x_idx_min = (box->xmin-geomstats->xmin) / geow * histocols;
-	if (x_idx_min < 0)
+	/* Fail if not a binary opclause (probably shouldn't happen) */
+	if (list_length(args) != 2)
 	{
-		POSTGIS_DEBUGF(3, " search_box overlaps %d columns on the left of histogram grid", -x_idx_min);
+		POSTGIS_DEBUG(3, "geometry_gist_sel: not a binary opclause");
 
-		/* should increment the value somehow */
-		x_idx_min = 0;
+		PG_RETURN_FLOAT8(DEFAULT_GEOMETRY_SEL);
 	}
-	if (x_idx_min >= histocols)
-	{
-		POSTGIS_DEBUGF(3, " search_box overlaps %d columns on the right of histogram grid", x_idx_min-histocols+1);
 
-		/* should increment the value somehow */
-		x_idx_min = histocols-1;
-	}
 
-	/* Find first overlapping row */
-	y_idx_min = (box->ymin-geomstats->ymin) / geoh * historows;
-	if (y_idx_min <0)
+	/*
+	 * Find the constant part
+	 */
+	other = (Node *) linitial(args);
+	if ( ! IsA(other, Const) )
 	{
-		POSTGIS_DEBUGF(3, " search_box overlaps %d columns on the bottom of histogram grid", -y_idx_min);
-
-		/* should increment the value somehow */
-		y_idx_min = 0;
+		self = (Var *)other;
+		other = (Node *) lsecond(args);
 	}
-	if (y_idx_min >= historows)
+	else
 	{
-		POSTGIS_DEBUGF(3, " search_box overlaps %d columns on the top of histogram grid", y_idx_min-historows+1);
-
-		/* should increment the value somehow */
-		y_idx_min = historows-1;
+		self = (Var *) lsecond(args);
 	}
 
-	/* Find last overlapping column */
-	x_idx_max = (box->xmax-geomstats->xmin) / geow * histocols;
-	if (x_idx_max <0)
-	{
-		/* should increment the value somehow */
-		x_idx_max = 0;
-	}
-	if (x_idx_max >= histocols )
+	if ( ! IsA(other, Const) )
 	{
-		/* should increment the value somehow */
-		x_idx_max = histocols-1;
-	}
+		POSTGIS_DEBUG(3, " no constant arguments - returning default selectivity");
 
-	/* Find last overlapping row */
-	y_idx_max = (box->ymax-geomstats->ymin) / geoh * historows;
-	if (y_idx_max <0)
-	{
-		/* should increment the value somehow */
-		y_idx_max = 0;
+		PG_RETURN_FLOAT8(DEFAULT_GEOMETRY_SEL);
 	}
-	if (y_idx_max >= historows)
+
+	/*
+	 * We are working on two constants..
+	 * TODO: check if expression is true,
+	 *       returned set would be either
+	 *       the whole or none.
+	 */
+	if ( ! IsA(self, Var) )
 	{
-		/* should increment the value somehow */
-		y_idx_max = historows-1;
+		POSTGIS_DEBUG(3, " no variable argument ? - returning default selectivity");
+
+		PG_RETURN_FLOAT8(DEFAULT_GEOMETRY_SEL);
 	}
 
 	/*
-	 * the {x,y}_idx_{min,max}
-	 * define the grid squares that the box intersects
+	 * Convert the constant to a BOX
 	 */
-	for (y=y_idx_min; y<=y_idx_max; y++)
+
+	if( ! gserialized_datum_get_gbox_p(((Const*)other)->constvalue, &search_box) )
 	{
-		for (x=x_idx_min; x<=x_idx_max; x++)
-		{
-			double val;
-			double gain;
+		POSTGIS_DEBUG(3, "search box is EMPTY");
+		PG_RETURN_FLOAT8(0.0);
+	}
 
-			val = geomstats->value[x+y*histocols];
+	POSTGIS_DEBUGF(4, " requested search box is : %.15g %.15g, %.15g %.15g",search_box.xmin,search_box.ymin,search_box.xmax,search_box.ymax);
 
-			/*
-			 * Of the cell value we get
-			 * only the overlap fraction.
-			 */
+	/*
+	 * Get pg_statistic row
+	 */
 
-			intersect_x = Min(box->xmax, geomstats->xmin + (x+1) * geow / histocols) - Max(box->xmin, geomstats->xmin + x * geow / histocols );
-			intersect_y = Min(box->ymax, geomstats->ymin + (y+1) * geoh / historows) - Max(box->ymin, geomstats->ymin+ y * geoh / historows) ;
+	relid = getrelid(self->varno, root->parse->rtable);
 
-			AOI = intersect_x*intersect_y;
-			gain = AOI/cell_area;
+	stats_tuple = SearchSysCache(STATRELATT, ObjectIdGetDatum(relid), Int16GetDatum(self->varattno), 0, 0);
+	if ( ! stats_tuple )
+	{
+		POSTGIS_DEBUG(3, " No statistics, returning default estimate");
 
-			POSTGIS_DEBUGF(4, " [%d,%d] cell val %.15f",
-			               x, y, val);
-			POSTGIS_DEBUGF(4, " [%d,%d] AOI %.15f",
-			               x, y, AOI);
-			POSTGIS_DEBUGF(4, " [%d,%d] gain %.15f",
-			               x, y, gain);
+		PG_RETURN_FLOAT8(DEFAULT_GEOMETRY_SEL);
+	}
 
-			val *= gain;
 
-			POSTGIS_DEBUGF(4, " [%d,%d] adding %.15f to value",
-			               x, y, val);
+	if ( ! get_attstatsslot(stats_tuple, 0, 0, STATISTIC_KIND_GEOMETRY, InvalidOid, NULL, NULL,
+#if POSTGIS_PGSQL_VERSION >= 85
+	                        NULL,
+#endif
+	                        (float4 **)gsptr, &geomstats_nvalues) )
+	{
+		POSTGIS_DEBUG(3, " STATISTIC_KIND_GEOMETRY stats not found - returning default geometry selectivity");
 
-			value += val;
-		}
+		ReleaseSysCache(stats_tuple);
+		PG_RETURN_FLOAT8(DEFAULT_GEOMETRY_SEL);
 	}
 
+	POSTGIS_DEBUGF(4, " %d read from stats", geomstats_nvalues);
+
+	POSTGIS_DEBUGF(4, " histo: xmin,ymin: %f,%f",
+	               geomstats->xmin, geomstats->ymin);
+	POSTGIS_DEBUGF(4, " histo: xmax,ymax: %f,%f",
+	               geomstats->xmax, geomstats->ymax);
+	POSTGIS_DEBUGF(4, " histo: cells: %f", geomstats->ncells);
+	POSTGIS_DEBUGF(4, " histo: avgFeatureArea: %f", geomstats->avgFeatureArea);
 
 	/*
-	 * If the search_box is a point, it will
-	 * overlap a single cell and thus get
-	 * it's value, which is the fraction of
-	 * samples (we can presume of row set also)
-	 * which bumped to that cell.
-	 *
-	 * If the table features are points, each
-	 * of them will overlap a single histogram cell.
-	 * Our search_box value would then be correctly
-	 * computed as the sum of the bumped cells values.
-	 *
-	 * If both our search_box AND the sample features
-	 * overlap more then a single histogram cell we
-	 * need to consider the fact that our sum computation
-	 * will have many duplicated included. E.g. each
-	 * single sample feature would have contributed to
-	 * raise the search_box value by as many times as
-	 * many cells in the histogram are commonly overlapped
-	 * by both search_box and feature. We should then
-	 * divide our value by the number of cells in the virtual
-	 * 'intersection' between average feature cell occupation
-	 * and occupation of the search_box. This is as
-	 * fuzzy as you understand it :)
-	 *
-	 * Consistency check: whenever the number of cells is
-	 * one of whichever part (search_box_occupation,
-	 * avg_feature_occupation) the 'intersection' must be 1.
-	 * If sounds that our 'intersaction' is actually the
-	 * minimun number between search_box_occupation and
-	 * avg_feat_occupation.
-	 *
+	 * Do the estimation
 	 */
-	overlapping_cells = (x_idx_max-x_idx_min+1) *
-	                    (y_idx_max-y_idx_min+1);
-	avg_feat_cells = geomstats->avgFeatureCells;
-
-	POSTGIS_DEBUGF(3, " search_box overlaps %f cells", overlapping_cells);
-	POSTGIS_DEBUGF(3, " avg feat overlaps %f cells", avg_feat_cells);
-
-	if ( ! overlapping_cells )
+	if ( geometry_stats_is_valid(geomstats, geomstats_nvalues) )
+	{
+		selectivity = estimate_selectivity(&search_box, geomstats);
+	}
+	else
 	{
-		POSTGIS_DEBUG(3, " no overlapping cells, returning 0.0");
+		POSTGIS_DEBUG(3, " corrupted histogram - returning default geometry selectivity");
 
-		return 0.0;
+		selectivity = DEFAULT_GEOMETRY_SEL;
 	}
 
-	gain = 1/Min(overlapping_cells, avg_feat_cells);
-	selectivity = value*gain;
 
-	POSTGIS_DEBUGF(3, " SUM(ov_histo_cells)=%f", value);
-	POSTGIS_DEBUGF(3, " gain=%f", gain);
-	POSTGIS_DEBUGF(3, " selectivity=%f", selectivity);
+	POSTGIS_DEBUGF(3, " returning computed value: %f", selectivity);
 
-	/* prevent rounding overflows */
-	if (selectivity > 1.0) selectivity = 1.0;
-	else if (selectivity < 0) selectivity = 0.0;
+	free_attstatsslot(0, NULL, 0, (float *)geomstats, geomstats_nvalues);
+	ReleaseSysCache(stats_tuple);
+	PG_RETURN_FLOAT8(selectivity);
 
-	return selectivity;
 }
 
 /**
- * This function should return an estimation of the number of
- * rows returned by a query involving an overlap check
- * ( it's the restrict function for the && operator )
- *
- * It can make use (if available) of the statistics collected
- * by the geometry analyzer function.
- *
- * Note that the good work is done by estimate_selectivity() above.
- * This function just tries to find the search_box, loads the statistics
- * and invoke the work-horse.
- *
- * This is the one used for PG version >= 7.5
- *
+ * Restrict function for the &&& operator, same as
+ * geometry_gist_sel_2d() on the N-D histogram.
  */
-PG_FUNCTION_INFO_V1(geometry_gist_sel_2d);
-Datum geometry_gist_sel_2d(PG_FUNCTION_ARGS)
+PG_FUNCTION_INFO_V1(geometry_gist_sel_nd);
+Datum geometry_gist_sel_nd(PG_FUNCTION_ARGS)
 {
 	PlannerInfo *root = (PlannerInfo *) PG_GETARG_POINTER(0);
 
@@ -633,30 +1086,23 @@ Datum geometry_gist_sel_2d(PG_FUNCTION_ARGS)
 	/* int varRelid = PG_GETARG_INT32(3); */
 	Oid relid;
 	HeapTuple stats_tuple;
-	GEOM_STATS *geomstats;
-	/*
-	 * This is to avoid casting the corresponding
-	 * "type-punned" pointer, which would break
-	 * "strict-aliasing rules".
-	 */
-	GEOM_STATS **gsptr=&geomstats;
-	int geomstats_nvalues=0;
+	ND_STATS *ndstats;
+	ND_STATS **ndptr=&ndstats;
+	int ndstats_nvalues=0;
 	Node *other;
 	Var *self;
 	GBOX search_box;
 	float8 selectivity=0;
 
-	POSTGIS_DEBUG(2, "geometry_gist_sel called");
+	POSTGIS_DEBUG(2, "geometry_gist_sel_nd called");
 
-	/* Fail if not a binary opclause (probably shouldn't happen) */
 	if (list_length(args) != 2)
 	{
-		POSTGIS_DEBUG(3, "geometry_gist_sel: not a binary opclause");
+		POSTGIS_DEBUG(3, "geometry_gist_sel_nd: not a binary opclause");
 
 		PG_RETURN_FLOAT8(DEFAULT_GEOMETRY_SEL);
 	}
 
-
 	/*
 	 * Find the constant part
 	 */
@@ -671,42 +1117,22 @@ Datum geometry_gist_sel_2d(PG_FUNCTION_ARGS)
 		self = (Var *) lsecond(args);
 	}
 
-	if ( ! IsA(other, Const) )
-	{
-		POSTGIS_DEBUG(3, " no constant arguments - returning default selectivity");
-
-		PG_RETURN_FLOAT8(DEFAULT_GEOMETRY_SEL);
-	}
-
-	/*
-	 * We are working on two constants..
-	 * TODO: check if expression is true,
-	 *       returned set would be either
-	 *       the whole or none.
-	 */
-	if ( ! IsA(self, Var) )
+	if ( ! IsA(other, Const) || ! IsA(self, Var) )
 	{
-		POSTGIS_DEBUG(3, " no variable argument ? - returning default selectivity");
+		POSTGIS_DEBUG(3, " not a column and a constant - returning default selectivity");
 
 		PG_RETURN_FLOAT8(DEFAULT_GEOMETRY_SEL);
 	}
 
-	/*
-	 * Convert the constant to a BOX
-	 */
-
 	if( ! gserialized_datum_get_gbox_p(((Const*)other)->constvalue, &search_box) )
 	{
 		POSTGIS_DEBUG(3, "search box is EMPTY");
 		PG_RETURN_FLOAT8(0.0);
 	}
 
-	POSTGIS_DEBUGF(4, " requested search box is : %.15g %.15g, %.15g %.15g",search_box.xmin,search_box.ymin,search_box.xmax,search_box.ymax);
-
 	/*
 	 * Get pg_statistic row
 	 */
-
 	relid = getrelid(self->varno, root->parse->rtable);
 
 	stats_tuple = SearchSysCache(STATRELATT, ObjectIdGetDatum(relid), Int16GetDatum(self->varattno), 0, 0);
@@ -717,44 +1143,156 @@ Datum geometry_gist_sel_2d(PG_FUNCTION_ARGS)
 		PG_RETURN_FLOAT8(DEFAULT_GEOMETRY_SEL);
 	}
 
-
-	if ( ! get_attstatsslot(stats_tuple, 0, 0, STATISTIC_KIND_GEOMETRY, InvalidOid, NULL, NULL,
+	if ( ! get_attstatsslot(stats_tuple, 0, 0, STATISTIC_KIND_ND_GEOMETRY, InvalidOid, NULL, NULL,
 #if POSTGIS_PGSQL_VERSION >= 85
 	                        NULL,
 #endif
-	                        (float4 **)gsptr, &geomstats_nvalues) )
+	                        (float4 **)ndptr, &ndstats_nvalues) )
 	{
-		POSTGIS_DEBUG(3, " STATISTIC_KIND_GEOMETRY stats not found - returning default geometry selectivity");
+		POSTGIS_DEBUG(3, " STATISTIC_KIND_ND_GEOMETRY stats not found - returning default geometry selectivity");
 
 		ReleaseSysCache(stats_tuple);
 		PG_RETURN_FLOAT8(DEFAULT_GEOMETRY_SEL);
 	}
 
-	POSTGIS_DEBUGF(4, " %d read from stats", geomstats_nvalues);
-
-	POSTGIS_DEBUGF(4, " histo: xmin,ymin: %f,%f",
-	               geomstats->xmin, geomstats->ymin);
-	POSTGIS_DEBUGF(4, " histo: xmax,ymax: %f,%f",
-	               geomstats->xmax, geomstats->ymax);
-	POSTGIS_DEBUGF(4, " histo: cols: %f", geomstats->rows);
-	POSTGIS_DEBUGF(4, " histo: rows: %f", geomstats->cols);
-	POSTGIS_DEBUGF(4, " histo: avgFeatureArea: %f", geomstats->avgFeatureArea);
-	POSTGIS_DEBUGF(4, " histo: avgFeatureCells: %f", geomstats->avgFeatureCells);
-
-	/*
-	 * Do the estimation
-	 */
-	selectivity = estimate_selectivity(&search_box, geomstats);
+	if ( nd_stats_is_valid(ndstats, ndstats_nvalues) )
+	{
+		selectivity = estimate_selectivity_nd(&search_box, ndstats);
+	}
+	else
+	{
+		POSTGIS_DEBUG(3, " corrupted histogram - returning default geometry selectivity");
 
+		selectivity = DEFAULT_GEOMETRY_SEL;
+	}
 
 	POSTGIS_DEBUGF(3, " returning computed value: %f", selectivity);
 
-	free_attstatsslot(0, NULL, 0, (float *)geomstats, geomstats_nvalues);
+	free_attstatsslot(0, NULL, 0, (float *)ndstats, ndstats_nvalues);
 	ReleaseSysCache(stats_tuple);
 	PG_RETURN_FLOAT8(selectivity);
+}
+
+
+
+
+/*
+ * Reorder samples so the one at position k is where sorting on the
+ * given axis would put it, the ones before not after it on that axis
+ * and the ones after not before it.
+ */
+static void
+sample_select(GEOM_STATS_SAMPLE *samples, int nsamples, int k, int axis)
+{
+	int left = 0, right = nsamples - 1;
+
+	while ( left < right )
+	{
+		double pivot = samples[(left + right) / 2].center[axis];
+		int i = left, j = right;
+
+		while ( i <= j )
+		{
+			while ( samples[i].center[axis] < pivot ) i++;
+			while ( samples[j].center[axis] > pivot ) j--;
+			if ( i <= j )
+			{
+				GEOM_STATS_SAMPLE tmp = samples[i];
+				samples[i] = samples[j];
+				samples[j] = tmp;
+				i++;
+				j--;
+			}
+		}
+
+		if ( k <= j )
+			right = j;
+		else if ( k >= i )
+			left = i;
+		else
+			break;
+	}
+}
+
+/**
+ * Fill the ncells cells of ndims dimensions of a histogram with the
+ * nsamples features, splitting them at the median center of the axis
+ * they spread most on, recursively, until there is one cell per set.
+ */
+static void
+build_stats_cells(GEOM_STATS_SAMPLE *samples, int nsamples, int ndims,
+                  float4 *cells, int ncells, int samplerows)
+{
+	double min[ND_DIMS], max[ND_DIMS], half[ND_DIMS];
+	double spread = -1;
+	int axis = 0, i, d;
+
+	for ( d = 0; d < ndims; d++ )
+	{
+		min[d] = max[d] = samples[0].center[d];
+		half[d] = 0;
+	}
+	for (i=0; i<nsamples; i++)
+	{
+		for ( d = 0; d < ndims; d++ )
+		{
+			min[d] = Min(min[d], samples[i].center[d]);
+			max[d] = Max(max[d], samples[i].center[d]);
+			half[d] += samples[i].half[d];
+		}
+	}
+
+	if ( ncells == 1 )
+	{
+		cells[0] = (float4)nsamples / samplerows;
+		for ( d = 0; d < ndims; d++ )
+		{
+			cells[1 + d] = min[d];
+			cells[1 + ndims + d] = max[d];
+			cells[1 + 2 * ndims + d] = half[d] / nsamples;
+		}
+
+		POSTGIS_DEBUGF(4, " cell of %d features, centers %f %f, %f %f",
+		               nsamples, min[0], min[1], max[0], max[1]);
+		return;
+	}
+
+	/* give backend a chance of interrupting us */
+	vacuum_delay_point();
+
+	for ( d = 0; d < ndims; d++ )
+	{
+		if ( max[d] - min[d] > spread )
+		{
+			spread = max[d] - min[d];
+			axis = d;
+		}
+	}
+
+	sample_select(samples, nsamples, nsamples / 2, axis);
 
+	build_stats_cells(samples, nsamples / 2, ndims,
+	                  cells, ncells / 2, samplerows);
+	build_stats_cells(samples + nsamples / 2, nsamples - nsamples / 2, ndims,
+	                  cells + (ncells / 2) * STATS_CELL_SIZE(ndims), ncells / 2, samplerows);
 }
 
+/*
+ * Number of cells for a histogram of nfeatures features: as many as
+ * possible, a power of two so the kd-tree is balanced.
+ */
+static int
+stats_num_cells(int nfeatures, int maxcells)
+{
+	int ncells = 1;
+
+	while ( ncells * 2 <= maxcells &&
+	        ncells * 2 * GEOM_STATS_MIN_FEATURES <= nfeatures )
+	{
+		ncells *= 2;
+	}
+	return ncells;
+}
 
 /**
  * This function is called by the analyze function iff
@@ -779,53 +1317,31 @@ compute_geometry_stats(VacAttrStats *stats, AnalyzeAttrFetchFunc fetchfunc,
 {
 	MemoryContext old_context;
 	int i;
-	int geom_stats_size;
-	GBOX **sampleboxes;
+	int geom_stats_size, nd_stats_size;
+	GEOM_STATS_SAMPLE *samples;
 	GEOM_STATS *geomstats;
+	ND_STATS *ndstats;
 	bool isnull;
-	int null_cnt=0, notnull_cnt=0, examinedsamples=0;
-	GBOX *sample_extent=NULL;
+	int null_cnt=0, notnull_cnt=0;
+	double nd_min[ND_DIMS], nd_max[ND_DIMS];
+	int ndims = ND_DIMS; /* dimensions all the features have */
 	double total_width=0;
 	double total_boxes_area=0;
-	int total_boxes_cells=0;
-	double cell_area;
-	double cell_width;
-	double cell_height;
-#if USE_STANDARD_DEVIATION
-	/* for standard deviation */
-	double avgLOWx, avgLOWy, avgHIGx, avgHIGy;
-	double sumLOWx=0, sumLOWy=0, sumHIGx=0, sumHIGy=0;
-	double sdLOWx=0, sdLOWy=0, sdHIGx=0, sdHIGy=0;
-	GBOX *newhistobox=NULL;
-#endif
-	double geow, geoh; /* width and height of histogram */
-	int histocells;
-	int cols, rows; /* histogram grid size */
-	GBOX histobox;
-
-	/*
-	 * This is where geometry_analyze
-	 * should put its' custom parameters.
-	 */
-	/* void *mystats = stats->extra_data; */
+	int maxcells, ncells, d;
 
 	/*
-	 * We'll build an histogram having from 40 to 400 boxesPerSide
-	 * Total number of cells is determined by attribute stat
-	 * target. It can go from  1600 to 160000 (stat target: 10,1000)
+	 * We'll build an histogram of up to 16 cells per unit of
+	 * stat target, as long as every cell gets enough features:
+	 * up to 1024 cells for the default stat target of 100.
 	 */
-	histocells = 160*stats->attr->attstattarget;
+	maxcells = GEOM_STATS_CELLS_PER_TARGET * stats->attr->attstattarget;
 
 
 	POSTGIS_DEBUG(2, "compute_geometry_stats called");
 	POSTGIS_DEBUGF(3, " samplerows: %d", samplerows);
-	POSTGIS_DEBUGF(3, " histogram cells: %d", histocells);
+	POSTGIS_DEBUGF(3, " max histogram cells: %d", maxcells);
 
-	/*
-	 * We might need less space, but don't think
-	 * its worth saving...
-	 */
-	sampleboxes = palloc(sizeof(GBOX *)*samplerows);
+	samples = palloc(sizeof(GEOM_STATS_SAMPLE)*samplerows);
 
 	/*
 	 * First scan:
@@ -833,13 +1349,15 @@ compute_geometry_stats(VacAttrStats *stats, AnalyzeAttrFetchFunc fetchfunc,
 	 *  o count null-infinite/not-null values
 	 *  o compute total_width
 	 *  o compute total features's box area (for avgFeatureArea)
-	 *  o sum features box coordinates (for standard deviation)
+	 *  o keep the box centers and sizes for the histogram
 	 */
 	for (i=0; i<samplerows; i++)
 	{
 		Datum datum;
 		GSERIALIZED *geom;
 		GBOX box;
+		double min[ND_DIMS], max[ND_DIMS];
+		int box_ndims;
 
 		datum = fetchfunc(stats, i, &isnull);
 
@@ -862,61 +1380,51 @@ compute_geometry_stats(VacAttrStats *stats, AnalyzeAttrFetchFunc fetchfunc,
 			continue;
 		}
 
+		box_ndims = gbox_nd_extent(&box, min, max);
+
 		/*
 		 * Skip infinite geoms
 		 */
-		if ( ! finite(box.xmin) ||
-		        ! finite(box.xmax) ||
-		        ! finite(box.ymin) ||
-		        ! finite(box.ymax) )
+		for ( d = 0; d < box_ndims; d++ )
+		{
+			if ( ! finite(min[d]) || ! finite(max[d]) )
+				break;
+		}
+		if ( d < box_ndims )
 		{
 			POSTGIS_DEBUGF(3, " skipped infinite geometry %d", i);
 
 			continue;
 		}
 
-		/*
-		 * Cache bounding box
-		 * TODO: reduce BOX2DFLOAT4 copies
-		 */
-		sampleboxes[notnull_cnt] = palloc(sizeof(GBOX));
-		memcpy(sampleboxes[notnull_cnt], &box, sizeof(GBOX));
+		for ( d = 0; d < box_ndims; d++ )
+		{
+			samples[notnull_cnt].center[d] = (min[d] + max[d]) / 2;
+			samples[notnull_cnt].half[d] = (max[d] - min[d]) / 2;
+		}
+		ndims = Min(ndims, box_ndims);
 
 		/*
 		 * Add to sample extent union
 		 */
-		if ( ! sample_extent )
-		{
-			sample_extent = palloc(sizeof(GBOX));
-			memcpy(sample_extent, &box, sizeof(GBOX));
-		}
-		else
+		for ( d = 0; d < box_ndims; d++ )
 		{
-			sample_extent->xmax = Max(sample_extent->xmax,
-			                                  box.xmax);
-			sample_extent->ymax = Max(sample_extent->ymax,
-			                                  box.ymax);
-			sample_extent->xmin = Min(sample_extent->xmin,
-			                                  box.xmin);
-			sample_extent->ymin = Min(sample_extent->ymin,
-			                                  box.ymin);
+			if ( ! notnull_cnt || d >= ndims )
+			{
+				nd_min[d] = min[d];
+				nd_max[d] = max[d];
+			}
+			else
+			{
+				nd_min[d] = Min(nd_min[d], min[d]);
+				nd_max[d] = Max(nd_max[d], max[d]);
+			}
 		}
 
 		/** TODO: ask if we need geom or bvol size for stawidth */
 		total_width += geom->size;
 		total_boxes_area += (box.xmax-box.xmin)*(box.ymax-box.ymin);
 
-#if USE_STANDARD_DEVIATION
-		/*
-		 * Add bvol coordinates to sum for standard deviation
-		 * computation.
-		 */
-		sumLOWx += box.xmin;
-		sumLOWy += box.ymin;
-		sumHIGx += box.xmax;
-		sumHIGy += box.ymax;
-#endif
-
 		notnull_cnt++;
 
 		/* give backend a chance of interrupting us */
@@ -931,309 +1439,71 @@ compute_geometry_stats(VacAttrStats *stats, AnalyzeAttrFetchFunc fetchfunc,
 		return;
 	}
 
-#if USE_STANDARD_DEVIATION
-
 	POSTGIS_DEBUGF(3, " sample_extent: xmin,ymin: %f,%f",
-	               sample_extent->xmin, sample_extent->ymin);
+	               nd_min[0], nd_min[1]);
 	POSTGIS_DEBUGF(3, " sample_extent: xmax,ymax: %f,%f",
-	               sample_extent->xmax, sample_extent->ymax);
-
-	/*
-	 * Second scan:
-	 *  o compute standard deviation
-	 */
-	avgLOWx = sumLOWx/notnull_cnt;
-	avgLOWy = sumLOWy/notnull_cnt;
-	avgHIGx = sumHIGx/notnull_cnt;
-	avgHIGy = sumHIGy/notnull_cnt;
-	for (i=0; i<notnull_cnt; i++)
-	{
-		GBOX *box;
-		box = (GBOX *)sampleboxes[i];
-
-		sdLOWx += (box->xmin - avgLOWx) * (box->xmin - avgLOWx);
-		sdLOWy += (box->ymin - avgLOWy) * (box->ymin - avgLOWy);
-		sdHIGx += (box->xmax - avgHIGx) * (box->xmax - avgHIGx);
-		sdHIGy += (box->ymax - avgHIGy) * (box->ymax - avgHIGy);
-	}
-	sdLOWx = sqrt(sdLOWx/notnull_cnt);
-	sdLOWy = sqrt(sdLOWy/notnull_cnt);
-	sdHIGx = sqrt(sdHIGx/notnull_cnt);
-	sdHIGy = sqrt(sdHIGy/notnull_cnt);
-
-	POSTGIS_DEBUG(3, " standard deviations:");
-	POSTGIS_DEBUGF(3, "  LOWx - avg:%f sd:%f", avgLOWx, sdLOWx);
-	POSTGIS_DEBUGF(3, "  LOWy - avg:%f sd:%f", avgLOWy, sdLOWy);
-	POSTGIS_DEBUGF(3, "  HIGx - avg:%f sd:%f", avgHIGx, sdHIGx);
-	POSTGIS_DEBUGF(3, "  HIGy - avg:%f sd:%f", avgHIGy, sdHIGy);
-
-	histobox.xmin = Max((avgLOWx - SDFACTOR * sdLOWx),
-	                       sample_extent->xmin);
-	histobox.ymin = Max((avgLOWy - SDFACTOR * sdLOWy),
-	                       sample_extent->ymin);
-	histobox.xmax = Min((avgHIGx + SDFACTOR * sdHIGx),
-	                       sample_extent->xmax);
-	histobox.ymax = Min((avgHIGy + SDFACTOR * sdHIGy),
-	                       sample_extent->ymax);
-
-	POSTGIS_DEBUGF(3, " sd_extent: xmin,ymin: %f,%f",
-	               histobox.xmin, histobox.ymin);
-	POSTGIS_DEBUGF(3, " sd_extent: xmax,ymax: %f,%f",
-	               histobox.xmin, histobox.ymax);
-
-	/*
-	 * Third scan:
-	 *   o skip hard deviants
-	 *   o compute new histogram box
-	 */
-	for (i=0; i<notnull_cnt; i++)
-	{
-		GBOX *box;
-		box = (GBOX *)sampleboxes[i];
-
-		if ( box->xmin > histobox.xmax ||
-		        box->xmax < histobox.xmin ||
-		        box->ymin > histobox.ymax ||
-		        box->ymax < histobox.ymin )
-		{
-			POSTGIS_DEBUGF(4, " feat %d is an hard deviant, skipped", i);
-
-			sampleboxes[i] = NULL;
-			continue;
-		}
-		if ( ! newhistobox )
-		{
-			newhistobox = palloc(sizeof(GBOX));
-			memcpy(newhistobox, box, sizeof(GBOX));
-		}
-		else
-		{
-			if ( box->xmin < newhistobox->xmin )
-				newhistobox->xmin = box->xmin;
-			if ( box->ymin < newhistobox->ymin )
-				newhistobox->ymin = box->ymin;
-			if ( box->xmax > newhistobox->xmax )
-				newhistobox->xmax = box->xmax;
-			if ( box->ymax > newhistobox->ymax )
-				newhistobox->ymax = box->ymax;
-		}
-	}
-
-	/*
-	 * Set histogram extent as the intersection between
-	 * standard deviation based histogram extent
-	 * and computed sample extent after removal of
-	 * hard deviants (there might be no hard deviants).
-	 */
-	if ( histobox.xmin < newhistobox->xmin )
-		histobox.xmin = newhistobox->xmin;
-	if ( histobox.ymin < newhistobox->ymin )
-		histobox.ymin = newhistobox->ymin;
-	if ( histobox.xmax > newhistobox->xmax )
-		histobox.xmax = newhistobox->xmax;
-	if ( histobox.ymax > newhistobox->ymax )
-		histobox.ymax = newhistobox->ymax;
-
-
-#else /* ! USE_STANDARD_DEVIATION */
-
-	/*
-	* Set histogram extent box
-	*/
-	histobox.xmin = sample_extent->xmin;
-	histobox.ymin = sample_extent->ymin;
-	histobox.xmax = sample_extent->xmax;
-	histobox.ymax = sample_extent->ymax;
-#endif /* USE_STANDARD_DEVIATION */
-
-
-	POSTGIS_DEBUGF(3, " histogram_extent: xmin,ymin: %f,%f",
-	               histobox.xmin, histobox.ymin);
-	POSTGIS_DEBUGF(3, " histogram_extent: xmax,ymax: %f,%f",
-	               histobox.xmax, histobox.ymax);
-
+	               nd_max[0], nd_max[1]);
 
-	geow = histobox.xmax - histobox.xmin;
-	geoh = histobox.ymax - histobox.ymin;
+	ncells = stats_num_cells(notnull_cnt, maxcells);
 
-	/*
-	 * Compute histogram cols and rows based on aspect ratio
-	 * of histogram extent
-	 */
-	if ( ! geow && ! geoh )
-	{
-		cols = 1;
-		rows = 1;
-		histocells = 1;
-	}
-	else if ( ! geow )
-	{
-		cols = 1;
-		rows = histocells;
-	}
-	else if ( ! geoh )
-	{
-		cols = histocells;
-		rows = 1;
-	}
-	else
-	{
-		if ( geow<geoh)
-		{
-			cols = ceil(sqrt((double)histocells*(geow/geoh)));
-			rows = ceil((double)histocells/cols);
-		}
-		else
-		{
-			rows = ceil(sqrt((double)histocells*(geoh/geow)));
-			cols = ceil((double)histocells/rows);
-		}
-		histocells = cols*rows;
-	}
-
-	POSTGIS_DEBUGF(3, " computed histogram grid size (CxR): %dx%d (%d cells)", cols, rows, histocells);
+	POSTGIS_DEBUGF(3, " histogram cells: %d for %d features", ncells, notnull_cnt);
 
 
 	/*
 	 * Create the histogram (GEOM_STATS)
 	 */
 	old_context = MemoryContextSwitchTo(stats->anl_context);
-	geom_stats_size=sizeof(GEOM_STATS)+(histocells-1)*sizeof(float4);
+	geom_stats_size = offsetof(GEOM_STATS, cells) + ncells * sizeof(GEOM_STATS_CELL);
 	geomstats = palloc(geom_stats_size);
 	MemoryContextSwitchTo(old_context);
 
+	geomstats->ncells = ncells;
+	geomstats->nfeatures = notnull_cnt;
 	geomstats->avgFeatureArea = total_boxes_area/notnull_cnt;
-	geomstats->xmin = histobox.xmin;
-	geomstats->ymin = histobox.ymin;
-	geomstats->xmax = histobox.xmax;
-	geomstats->ymax = histobox.ymax;
-	geomstats->cols = cols;
-	geomstats->rows = rows;
-
-	/* Initialize all values to 0 */
-	for (i=0; i<histocells; i++) geomstats->value[i] = 0;
-
-	cell_width = geow/cols;
-	cell_height = geoh/rows;
-	cell_area = cell_width*cell_height;
-
-	POSTGIS_DEBUGF(4, "cell_width: %f", cell_width);
-	POSTGIS_DEBUGF(4, "cell_height: %f", cell_height);
-
+	geomstats->notnullFraction = (float4)notnull_cnt/samplerows;
+	geomstats->xmin = nd_min[0];
+	geomstats->ymin = nd_min[1];
+	geomstats->xmax = nd_max[0];
+	geomstats->ymax = nd_max[1];
 
 	/*
-	 * Fourth scan:
-	 *  o fill histogram values with the number of
-	 *    features' bbox overlaps: a feature's bvol
-	 *    can fully overlap (1) or partially overlap
-	 *    (fraction of 1) an histogram cell.
-	 *
-	 *  o compute total cells occupation
-	 *
+	 * Second pass:
+	 *  o split the features in cells of
+	 *    the same number of features each
 	 */
-	for (i=0; i<notnull_cnt; i++)
-	{
-		GBOX *box;
-		int x_idx_min, x_idx_max, x;
-		int y_idx_min, y_idx_max, y;
-		int numcells=0;
-
-		box = (GBOX *)sampleboxes[i];
-		if ( ! box ) continue; /* hard deviant.. */
-
-		/* give backend a chance of interrupting us */
-		vacuum_delay_point();
-
-		POSTGIS_DEBUGF(4, " feat %d box is %f %f, %f %f",
-		               i, box->xmax, box->ymax,
-		               box->xmin, box->ymin);
-
-		/* Find first overlapping column */
-		x_idx_min = (box->xmin-geomstats->xmin) / geow * cols;
-		if (x_idx_min <0) x_idx_min = 0;
-		if (x_idx_min >= cols) x_idx_min = cols-1;
-
-		/* Find first overlapping row */
-		y_idx_min = (box->ymin-geomstats->ymin) / geoh * rows;
-		if (y_idx_min <0) y_idx_min = 0;
-		if (y_idx_min >= rows) y_idx_min = rows-1;
-
-		/* Find last overlapping column */
-		x_idx_max = (box->xmax-geomstats->xmin) / geow * cols;
-		if (x_idx_max <0) x_idx_max = 0;
-		if (x_idx_max >= cols ) x_idx_max = cols-1;
-
-		/* Find last overlapping row */
-		y_idx_max = (box->ymax-geomstats->ymin) / geoh * rows;
-		if (y_idx_max <0) y_idx_max = 0;
-		if (y_idx_max >= rows) y_idx_max = rows-1;
-
-		POSTGIS_DEBUGF(4, " feat %d overlaps columns %d-%d, rows %d-%d",
-		               i, x_idx_min, x_idx_max, y_idx_min, y_idx_max);
+	build_stats_cells(samples, notnull_cnt, 2, (float4 *)geomstats->cells, ncells, samplerows);
 
-		/*
-		 * the {x,y}_idx_{min,max}
-		 * define the grid squares that the box intersects
-		 */
-		for (y=y_idx_min; y<=y_idx_max; y++)
-		{
-			for (x=x_idx_min; x<=x_idx_max; x++)
-			{
-				geomstats->value[x+y*cols] += 1;
-				numcells++;
-			}
-		}
-
-		/*
-		 * before adding to the total cells
-		 * we could decide if we really
-		 * want this feature to count
-		 */
-		total_boxes_cells += numcells;
-
-		examinedsamples++;
-	}
+	POSTGIS_DEBUGF(3, " histo: avgFeatureArea: %f", geomstats->avgFeatureArea);
+	POSTGIS_DEBUGF(3, " histo: notnullFraction: %f", geomstats->notnullFraction);
 
-	POSTGIS_DEBUGF(3, " examined_samples: %d/%d", examinedsamples, samplerows);
+	/*
+	 * Create the N-D histogram (ND_STATS), on
+	 * the dimensions all the features have
+	 */
+	old_context = MemoryContextSwitchTo(stats->anl_context);
+	nd_stats_size = offsetof(ND_STATS, cells) + ncells * STATS_CELL_SIZE(ndims) * sizeof(float4);
+	ndstats = palloc0(nd_stats_size);
+	MemoryContextSwitchTo(old_context);
 
-	if ( ! examinedsamples )
+	ndstats->ndims = ndims;
+	ndstats->ncells = ncells;
+	ndstats->nfeatures = notnull_cnt;
+	ndstats->notnullFraction = geomstats->notnullFraction;
+	for ( d = 0; d < ndims; d++ )
 	{
-		elog(NOTICE, " no examined values, invalid stats");
-		stats->stats_valid = false;
-
-		POSTGIS_DEBUG(3, " no stats have been gathered");
-
-		return;
+		ndstats->min[d] = nd_min[d];
+		ndstats->max[d] = nd_max[d];
 	}
 
-	/** TODO: what about null features (TODO) */
-	geomstats->avgFeatureCells = (float4)total_boxes_cells/examinedsamples;
-
-	POSTGIS_DEBUGF(3, " histo: total_boxes_cells: %d", total_boxes_cells);
-	POSTGIS_DEBUGF(3, " histo: avgFeatureArea: %f", geomstats->avgFeatureArea);
-	POSTGIS_DEBUGF(3, " histo: avgFeatureCells: %f", geomstats->avgFeatureCells);
-
-
 	/*
-	 * Normalize histogram
-	 *
-	 * We divide each histogram cell value
-	 * by the number of samples examined.
-	 *
+	 * Third pass:
+	 *  o same as the second one, in N-D
 	 */
-	for (i=0; i<histocells; i++)
-		geomstats->value[i] /= examinedsamples;
+	build_stats_cells(samples, notnull_cnt, ndims, ndstats->cells, ncells, samplerows);
 
-	{
-		int x, y;
-		for (x=0; x<cols; x++)
-		{
-			for (y=0; y<rows; y++)
-			{
-				POSTGIS_DEBUGF(4, " histo[%d,%d] = %.15f", x, y, geomstats->value[x+y*cols]);
-			}
-		}
-	}
+	pfree(samples);
+
+	POSTGIS_DEBUGF(3, " nd histo: %d dimensions", ndims);
 
 
 	/*
@@ -1244,6 +1514,11 @@ compute_geometry_stats(VacAttrStats *stats, AnalyzeAttrFetchFunc fetchfunc,
 	stats->stanumbers[0] = (float4 *)geomstats;
 	stats->numnumbers[0] = geom_stats_size/sizeof(float4);
 
+	stats->stakind[1] = STATISTIC_KIND_ND_GEOMETRY;
+	stats->staop[1] = InvalidOid;
+	stats->stanumbers[1] = (float4 *)ndstats;
+	stats->numnumbers[1] = nd_stats_size/sizeof(float4);
+
 	stats->stanullfrac = (float4)null_cnt/samplerows;
 	stats->stawidth = total_width/notnull_cnt;
 	stats->stadistinct = -1.0;
@@ -1252,6 +1527,9 @@ compute_geometry_stats(VacAttrStats *stats, AnalyzeAttrFetchFunc fetchfunc,
 	               stats->stakind[0]);
 	POSTGIS_DEBUGF(3, " out: slot 0: op %d (InvalidOid)", stats->staop[0]);
 	POSTGIS_DEBUGF(3, " out: slot 0: numnumbers %d", stats->numnumbers[0]);
+	POSTGIS_DEBUGF(3, " out: slot 1: kind %d (STATISTIC_KIND_ND_GEOMETRY)",
+	               stats->stakind[1]);
+	POSTGIS_DEBUGF(3, " out: slot 1: numnumbers %d", stats->numnumbers[1]);
 	POSTGIS_DEBUGF(3, " out: null fraction: %d/%d=%g", null_cnt, samplerows, stats->stanullfrac);
 	POSTGIS_DEBUGF(3, " out: average width: %d bytes", stats->stawidth);
 	POSTGIS_DEBUG(3, " out: distinct values: all (no check done)");
@@ -83,6 +83,7 @@ Datum gserialized_overabove_2d(PG_FUNCTION_ARGS);
 Datum gserialized_overbelow_2d(PG_FUNCTION_ARGS);
 Datum gserialized_distance_box_2d(PG_FUNCTION_ARGS);
 Datum gserialized_distance_centroid_2d(PG_FUNCTION_ARGS);
+Datum gserialized_hilbert_key_2d(PG_FUNCTION_ARGS);
 
 /*
 ** true/false test function type
@@ -580,6 +581,38 @@ gserialized_datum_predicate_2d(Datum gs1, Datum gs2, box2df_predicate predicate)
 
 
 
+/***********************************************************************
+* Sort key
+*/
+
+/**
+* Position of the box center along a Hilbert curve, as a bigint. Loading
+* a table in this order before building the GiST index gives the index
+* well packed, low overlap pages and keeps the pages hot during the
+* build. Empty geometries have no box and get a NULL.
+*/
+PG_FUNCTION_INFO_V1(gserialized_hilbert_key_2d);
+Datum gserialized_hilbert_key_2d(PG_FUNCTION_ARGS)
+{
+	BOX2DF b;
+	GBOX gbox;
+	uint64_t hash;
+
+	if ( gserialized_datum_get_box2df_p(PG_GETARG_DATUM(0), &b) == LW_FAILURE )
+		PG_RETURN_NULL();
+
+	gbox.flags = 0;
+	gbox.xmin = b.xmin;
+	gbox.xmax = b.xmax;
+	gbox.ymin = b.ymin;
+	gbox.ymax = b.ymax;
+	hash = gbox_get_sortable_hash(&gbox);
+
+	/* Flip the top bit so signed comparisons keep the curve order */
+	PG_RETURN_INT64((int64)(hash ^ UINT64CONST(0x8000000000000000)));
+}
+
+
 /***********************************************************************
 * GiST 2-D Index Operator Functions
 */
@@ -34,6 +34,8 @@
 #include "gserialized_gist.h"	     /* For utility functions. */
 #include "geography.h"
 
+#include <math.h>
+
 /*
 ** When is a node split not so good? If more than 90% of the entries
 ** end up in one of the children.
@@ -64,6 +66,10 @@ Datum gserialized_gist_penalty(PG_FUNCTION_ARGS);
 Datum gserialized_gist_picksplit(PG_FUNCTION_ARGS);
 Datum gserialized_gist_union(PG_FUNCTION_ARGS);
 Datum gserialized_gist_same(PG_FUNCTION_ARGS);
+#if POSTGIS_PGSQL_VERSION >= 91
+Datum gserialized_gist_distance(PG_FUNCTION_ARGS);
+Datum gserialized_gist_geog_distance(PG_FUNCTION_ARGS);
+#endif
 
 /*
 ** ND Operator prototypes
@@ -71,12 +77,19 @@ Datum gserialized_gist_same(PG_FUNCTION_ARGS);
 Datum gserialized_overlaps(PG_FUNCTION_ARGS);
 Datum gserialized_contains(PG_FUNCTION_ARGS);
 Datum gserialized_within(PG_FUNCTION_ARGS);
+Datum gserialized_distance_nd(PG_FUNCTION_ARGS);
+Datum gserialized_geog_distance(PG_FUNCTION_ARGS);
 
 /*
 ** GIDX true/false test function type
 */
 typedef bool (*gidx_predicate)(GIDX *a, GIDX *b);
 
+/*
+** GIDX distance function type
+*/
+typedef double (*gidx_distance_function)(GIDX *a, GIDX *b);
+
 
 /* Allocate a new copy of GIDX */
 static GIDX* gidx_copy(GIDX *b)
@@ -366,6 +379,54 @@ static bool gidx_equals(GIDX *a, GIDX *b)
 	return TRUE;
 }
 
+/*
+** Distance between two GIDX boxes, zero when they overlap.
+**
+** Only the shared dimensions count, a box with fewer dimensions is
+** taken to span the whole range of the ones it lacks. For geometry
+** with M the M range counts like any other dimension.
+*/
+static double gidx_distance(GIDX *a, GIDX *b)
+{
+	int i;
+	double sum = 0.0;
+
+	/* Ensure 'a' has the most dimensions. */
+	gidx_dimensionality_check(&a, &b);
+
+	for (i = 0; i < GIDX_NDIMS(b); i++)
+	{
+		double d = 0.0;
+
+		if ( GIDX_GET_MIN(a,i) > GIDX_GET_MAX(b,i) )
+			d = (double)GIDX_GET_MIN(a,i) - (double)GIDX_GET_MAX(b,i);
+		else if ( GIDX_GET_MIN(b,i) > GIDX_GET_MAX(a,i) )
+			d = (double)GIDX_GET_MIN(b,i) - (double)GIDX_GET_MAX(a,i);
+
+		sum += d * d;
+	}
+	return sqrt(sum);
+}
+
+/*
+** Distance in meters between two geocentric geography boxes.
+**
+** The boxes hold points of the unit sphere, so their distance is a
+** lower bound of the chord between any two of those points. The chord
+** c subtends an arc of 2*asin(c/2) radians, which is scaled to the
+** mean radius of the earth.
+*/
+static double gidx_distance_geodetic(GIDX *a, GIDX *b)
+{
+	double chord = gidx_distance(a, b);
+
+	/* Nothing on the sphere is more than a diameter apart */
+	if ( chord > 2.0 )
+		chord = 2.0;
+
+	return WGS84_RADIUS * 2.0 * asin(chord / 2.0);
+}
+
 /**
 * Support function. Based on two datums return true if
 * they satisfy the predicate and false otherwise.
@@ -393,6 +454,29 @@ gserialized_datum_predicate(Datum gs1, Datum gs2, gidx_predicate predicate)
 	return LW_FALSE;
 }
 
+/**
+* Support function. Based on two datums return the distance
+* between their boxes, or MAXFLOAT when one of them is empty.
+*/
+static double
+gserialized_datum_distance(Datum gs1, Datum gs2, gidx_distance_function distance)
+{
+	char boxmem1[GIDX_MAX_SIZE];
+	char boxmem2[GIDX_MAX_SIZE];
+	GIDX *gidx1 = (GIDX*)boxmem1;
+	GIDX *gidx2 = (GIDX*)boxmem2;
+
+	POSTGIS_DEBUG(3, "entered function");
+
+	if ( (gserialized_datum_get_gidx_p(gs1, gidx1) == LW_SUCCESS) &&
+	     (gserialized_datum_get_gidx_p(gs2, gidx2) == LW_SUCCESS) )
+	{
+		POSTGIS_DEBUGF(3, "got boxes %s and %s", gidx_to_string(gidx1), gidx_to_string(gidx2));
+		return distance(gidx1, gidx2);
+	}
+	return MAXFLOAT;
+}
+
 /**
 * Return a #GSERIALIZED with an expanded bounding box.
 */
@@ -464,6 +548,26 @@ Datum gserialized_overlaps(PG_FUNCTION_ARGS)
 	PG_RETURN_BOOL(FALSE);
 }
 
+/*
+** '<<->>' operator function. Based on two serialized geometries return
+** the distance between their N-D boxes.
+*/
+PG_FUNCTION_INFO_V1(gserialized_distance_nd);
+Datum gserialized_distance_nd(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_FLOAT8(gserialized_datum_distance(PG_GETARG_DATUM(0), PG_GETARG_DATUM(1), gidx_distance));
+}
+
+/*
+** Geography '<->' operator function. Based on two serialized geographies
+** return the distance in meters between their geocentric boxes.
+*/
+PG_FUNCTION_INFO_V1(gserialized_geog_distance);
+Datum gserialized_geog_distance(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_FLOAT8(gserialized_datum_distance(PG_GETARG_DATUM(0), PG_GETARG_DATUM(1), gidx_distance_geodetic));
+}
+
 /***********************************************************************
 * GiST Index  Support Functions
 */
@@ -687,6 +791,76 @@ Datum gserialized_gist_consistent(PG_FUNCTION_ARGS)
 	PG_RETURN_BOOL(result);
 }
 
+#if POSTGIS_PGSQL_VERSION >= 91
+/*
+** GiST support function. Called from the distance functions below.
+**
+** The box of an internal node holds the boxes of all its children, so
+** its distance to the query box is already the smallest distance any
+** child could have and leaves and nodes get the same treatment.
+*/
+static double gserialized_gist_distance_internal(GISTENTRY *entry, Datum query, StrategyNumber strategy,
+                                                 gidx_distance_function distance)
+{
+	char gidxmem[GIDX_MAX_SIZE];
+	GIDX *query_box = (GIDX*)gidxmem;
+	GIDX *entry_box;
+
+	/* We are using '13' as the gist distance-between-boxes strategy number */
+	if ( strategy != 13 )
+	{
+		elog(ERROR, "unrecognized strategy number: %d", strategy);
+		return MAXFLOAT;
+	}
+
+	/* Null box should never make this far. */
+	if ( gserialized_datum_get_gidx_p(query, query_box) == LW_FAILURE )
+	{
+		POSTGIS_DEBUG(4, "[GIST] null query_gbox_index!");
+		return MAXFLOAT;
+	}
+
+	entry_box = (GIDX*)DatumGetPointer(entry->key);
+
+	return distance(entry_box, query_box);
+}
+
+/*
+** GiST support function. Take in a query and an entry and return the
+** distance between their N-D boxes, for the geometry '<<->>' operator.
+**
+** Strategy 13 = box-based distance tests
+*/
+PG_FUNCTION_INFO_V1(gserialized_gist_distance);
+Datum gserialized_gist_distance(PG_FUNCTION_ARGS)
+{
+	GISTENTRY *entry = (GISTENTRY*) PG_GETARG_POINTER(0);
+	StrategyNumber strategy = (StrategyNumber) PG_GETARG_UINT16(2);
+
+	POSTGIS_DEBUG(4, "[GIST] 'distance' function called");
+
+	PG_RETURN_FLOAT8(gserialized_gist_distance_internal(entry, PG_GETARG_DATUM(1), strategy, gidx_distance));
+}
+
+/*
+** GiST support function. Take in a query and an entry and return the
+** distance in meters between their geocentric boxes, for the geography
+** '<->' operator.
+**
+** Strategy 13 = box-based distance tests
+*/
+PG_FUNCTION_INFO_V1(gserialized_gist_geog_distance);
+Datum gserialized_gist_geog_distance(PG_FUNCTION_ARGS)
+{
+	GISTENTRY *entry = (GISTENTRY*) PG_GETARG_POINTER(0);
+	StrategyNumber strategy = (StrategyNumber) PG_GETARG_UINT16(2);
+
+	POSTGIS_DEBUG(4, "[GIST] 'distance' function called");
+
+	PG_RETURN_FLOAT8(gserialized_gist_distance_internal(entry, PG_GETARG_DATUM(1), strategy, gidx_distance_geodetic));
+}
+#endif
+
 
 /*
 ** GiST support function. Calculate the "penalty" cost of adding this entry into an existing entry.
@@ -1280,7 +1280,7 @@ CREATE OR REPLACE FUNCTION makeline_garray (geometry[])
 -- Deprecation in 1.2.3
 CREATE AGGREGATE makeline (
 	BASETYPE = geometry,
-	SFUNC = pgis_geometry_accum_transfn,
+	SFUNC = pgis_geometry_makeline_transfn,
 	STYPE = pgis_abs,
 	FINALFUNC = pgis_geometry_makeline_finalfn
 	);
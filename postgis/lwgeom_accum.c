@@ -13,9 +13,12 @@
 #include "postgres.h"
 #include "fmgr.h"
 #include "funcapi.h"
+#include "miscadmin.h"
 #include "access/tupmacs.h"
+#include "access/tuptoaster.h"
 #include "utils/array.h"
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
 
 #include "../postgis_config.h"
 
@@ -25,6 +28,9 @@
 /* Local prototypes */
 Datum PGISDirectFunctionCall1(PGFunction func, Datum arg1);
 Datum pgis_geometry_accum_transfn(PG_FUNCTION_ARGS);
+Datum pgis_geometry_union_transfn(PG_FUNCTION_ARGS);
+Datum pgis_geometry_collect_transfn(PG_FUNCTION_ARGS);
+Datum pgis_geometry_makeline_transfn(PG_FUNCTION_ARGS);
 Datum pgis_geometry_accum_finalfn(PG_FUNCTION_ARGS);
 Datum pgis_geometry_union_finalfn(PG_FUNCTION_ARGS);
 Datum pgis_geometry_collect_finalfn(PG_FUNCTION_ARGS);
@@ -35,9 +41,7 @@ Datum pgis_abs_out(PG_FUNCTION_ARGS);
 
 /* External prototypes */
 Datum pgis_union_geometry_array(PG_FUNCTION_ARGS);
-Datum LWGEOM_collect_garray(PG_FUNCTION_ARGS);
 Datum polygonize_garray(PG_FUNCTION_ARGS);
-Datum LWGEOM_makeline_garray(PG_FUNCTION_ARGS);
 
 
 /** @file
@@ -53,14 +57,74 @@ Datum LWGEOM_makeline_garray(PG_FUNCTION_ARGS);
 
 
 /**
-** To pass the internal ArrayBuildState pointer between the
+** ST_Union, ST_Collect and ST_MakeLine do not keep the whole group around
+** until the final function. They have transfns of their own, that fold
+** the rows in as they arrive:
+**
+** - ST_Union buffers the geometries in an ArrayBuildState and unions the
+**   buffer (cascaded union) every time it grows past work_mem, keeping the
+**   partial result as the first element of the next buffer. The buffer is
+**   also allowed to grow as large as the partial union, so each partial
+**   union is merged a bounded number of times.
+** - ST_Collect deserializes every geometry straight into the list of
+**   components of the output collection.
+** - ST_MakeLine appends every point straight to the vertices of the output
+**   line.
+*/
+
+/** Geometries buffered by ST_Union, with their sizes */
+typedef struct
+{
+	ArrayBuildState *a;  /* the partial union first, if any */
+	Size buffered;       /* bytes added since the last union */
+	Size merged;         /* bytes of the partial union */
+}
+pgis_union_state;
+
+/** Components of the ST_Collect output, see LWGEOM_collect_garray() */
+typedef struct
+{
+	LWGEOM **geoms;
+	int ngeoms;
+	int maxgeoms;
+	int srid;
+	uint32 outtype;
+	GBOX *box;           /* NULL as soon as one component has no box */
+	Size size;
+}
+pgis_collect_state;
+
+/**
+** Vertices of the ST_MakeLine output, see LWGEOM_makeline_garray().
+** They are kept in 4D and brought down to the dimensions of the inputs
+** at the end.
+*/
+typedef struct
+{
+	POINTARRAY *pa;
+	int ngeoms;
+	int srid;
+	int hasz;
+	int hasm;
+}
+pgis_makeline_state;
+
+/**
+** To pass the internal state pointer between the
 ** transfn and finalfn we need to wrap it into a custom type first,
-** the pgis_abs type in our case.
+** the pgis_abs type in our case. The type is 8 bytes long, so only
+** the pointer itself is carried from one call to the next.
 */
 
 typedef struct
 {
-	ArrayBuildState *a;
+	union
+	{
+		ArrayBuildState *a;
+		pgis_union_state *u;
+		pgis_collect_state *c;
+		pgis_makeline_state *l;
+	} state;
 }
 pgis_abs;
 
@@ -90,21 +154,19 @@ pgis_abs_out(PG_FUNCTION_ARGS)
 ** function (present since 8.0) to build an array in a side memory
 ** context.
 */
-PG_FUNCTION_INFO_V1(pgis_geometry_accum_transfn);
-Datum
-pgis_geometry_accum_transfn(PG_FUNCTION_ARGS)
+static MemoryContext
+pgis_aggcontext(FunctionCallInfo fcinfo)
 {
-	Oid arg1_typeid = get_fn_expr_argtype(fcinfo->flinfo, 1);
 	MemoryContext aggcontext;
-	ArrayBuildState *state;
-	pgis_abs *p;
-	Datum elem;
-
-	if (arg1_typeid == InvalidOid)
-		ereport(ERROR,
-		        (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-		         errmsg("could not determine input data type")));
 
+#if POSTGIS_PGSQL_VERSION >= 90
+	if ( ! AggCheckCallContext(fcinfo, &aggcontext) )
+	{
+		/* cannot be called directly because of dummy-type argument */
+		elog(ERROR, "array_agg_transfn called in non-aggregate context");
+		aggcontext = NULL;  /* keep compiler quiet */
+	}
+#else
 	if (fcinfo->context && IsA(fcinfo->context, AggState))
 		aggcontext = ((AggState *) fcinfo->context)->aggcontext;
 #if POSTGIS_PGSQL_VERSION == 84
@@ -112,11 +174,6 @@ pgis_geometry_accum_transfn(PG_FUNCTION_ARGS)
 	else if (fcinfo->context && IsA(fcinfo->context, WindowAggState))
 		aggcontext = ((WindowAggState *) fcinfo->context)->wincontext;
 #endif
-#if POSTGIS_PGSQL_VERSION > 84
-
-	else if (fcinfo->context && IsA(fcinfo->context, WindowAggState))
-		aggcontext = ((WindowAggState *) fcinfo->context)->aggcontext;
-#endif
 
 	else
 	{
@@ -124,24 +181,345 @@ pgis_geometry_accum_transfn(PG_FUNCTION_ARGS)
 		elog(ERROR, "array_agg_transfn called in non-aggregate context");
 		aggcontext = NULL;  /* keep compiler quiet */
 	}
+#endif
+
+	return aggcontext;
+}
+
+PG_FUNCTION_INFO_V1(pgis_geometry_accum_transfn);
+Datum
+pgis_geometry_accum_transfn(PG_FUNCTION_ARGS)
+{
+	Oid arg1_typeid = get_fn_expr_argtype(fcinfo->flinfo, 1);
+	MemoryContext aggcontext;
+	ArrayBuildState *state;
+	pgis_abs *p;
+	Datum elem;
+
+	if (arg1_typeid == InvalidOid)
+		ereport(ERROR,
+		        (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+		         errmsg("could not determine input data type")));
+
+	aggcontext = pgis_aggcontext(fcinfo);
 
 	if ( PG_ARGISNULL(0) )
 	{
 		p = (pgis_abs*) palloc(sizeof(pgis_abs));
-		p->a = NULL;
+		p->state.a = NULL;
 	}
 	else
 	{
 		p = (pgis_abs*) PG_GETARG_POINTER(0);
 	}
-	state = p->a;
+	state = p->state.a;
 	elem = PG_ARGISNULL(1) ? (Datum) 0 : PG_GETARG_DATUM(1);
 	state = accumArrayResult(state,
 	                         elem,
 	                         PG_ARGISNULL(1),
 	                         arg1_typeid,
 	                         aggcontext);
-	p->a = state;
+	p->state.a = state;
+
+	PG_RETURN_POINTER(p);
+}
+
+/**
+** Returns the ST_Union of the buffered geometries, NULL if they are
+** all NULL.
+*/
+static Datum
+pgis_union_state_result(pgis_union_state *state)
+{
+	int dims[1];
+	int lbs[1];
+	Datum geometry_array;
+
+	dims[0] = state->a->nelems;
+	lbs[0] = 1;
+#if POSTGIS_PGSQL_VERSION < 84
+	geometry_array = makeMdArrayResult(state->a, 1, dims, lbs, CurrentMemoryContext);
+#else
+	geometry_array = makeMdArrayResult(state->a, 1, dims, lbs, CurrentMemoryContext, false);
+#endif
+
+	return PGISDirectFunctionCall1( pgis_union_geometry_array, geometry_array );
+}
+
+/**
+** The union transfer function accumulates like the "accum" one, and
+** replaces the buffer by its union when it gets too large.
+*/
+PG_FUNCTION_INFO_V1(pgis_geometry_union_transfn);
+Datum
+pgis_geometry_union_transfn(PG_FUNCTION_ARGS)
+{
+	Oid arg1_typeid = get_fn_expr_argtype(fcinfo->flinfo, 1);
+	MemoryContext aggcontext, oldcontext;
+	pgis_union_state *state;
+	pgis_abs *p;
+	Datum elem, result;
+
+	if (arg1_typeid == InvalidOid)
+		ereport(ERROR,
+		        (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+		         errmsg("could not determine input data type")));
+
+	aggcontext = pgis_aggcontext(fcinfo);
+
+	if ( PG_ARGISNULL(0) )
+	{
+		oldcontext = MemoryContextSwitchTo(aggcontext);
+		p = (pgis_abs*) palloc(sizeof(pgis_abs));
+		p->state.u = palloc0(sizeof(pgis_union_state));
+		MemoryContextSwitchTo(oldcontext);
+	}
+	else
+	{
+		p = (pgis_abs*) PG_GETARG_POINTER(0);
+	}
+	state = p->state.u;
+
+	/* NULLs don't change the union */
+	if ( PG_ARGISNULL(1) )
+		PG_RETURN_POINTER(p);
+
+	elem = PG_GETARG_DATUM(1);
+	state->a = accumArrayResult(state->a, elem, false, arg1_typeid, aggcontext);
+	state->buffered += toast_raw_datum_size(elem);
+
+	if ( state->a->nelems < 2 ||
+	     state->buffered < Max((Size)work_mem * 1024L, state->merged) )
+	{
+		PG_RETURN_POINTER(p);
+	}
+
+	POSTGIS_DEBUGF(3, "union of %d buffered geometries, %lu bytes",
+	               state->a->nelems, (unsigned long)state->buffered);
+
+	/*
+	 * The union is built in the per-row context, it is copied in a fresh
+	 * buffer before the old one goes away.
+	 */
+	result = pgis_union_state_result(state);
+	MemoryContextDelete(state->a->mcontext);
+	state->a = NULL;
+	state->buffered = 0;
+	state->merged = 0;
+	if ( result )
+	{
+		state->a = accumArrayResult(NULL, result, false, arg1_typeid, aggcontext);
+		state->merged = toast_raw_datum_size(result);
+	}
+
+	PG_RETURN_POINTER(p);
+}
+
+/**
+** The collect transfer function adds the geometry to the
+** components of the output collection.
+*/
+PG_FUNCTION_INFO_V1(pgis_geometry_collect_transfn);
+Datum
+pgis_geometry_collect_transfn(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggcontext, oldcontext;
+	pgis_collect_state *state;
+	pgis_abs *p;
+	GSERIALIZED *geom;
+	LWGEOM *lwgeom;
+	uint8_t intype;
+
+	aggcontext = pgis_aggcontext(fcinfo);
+
+	if ( PG_ARGISNULL(0) )
+	{
+		oldcontext = MemoryContextSwitchTo(aggcontext);
+		p = (pgis_abs*) palloc(sizeof(pgis_abs));
+		p->state.c = palloc0(sizeof(pgis_collect_state));
+		MemoryContextSwitchTo(oldcontext);
+	}
+	else
+	{
+		p = (pgis_abs*) PG_GETARG_POINTER(0);
+	}
+	state = p->state.c;
+
+	/* Don't do anything for NULL values */
+	if ( PG_ARGISNULL(1) )
+		PG_RETURN_POINTER(p);
+
+	geom = (GSERIALIZED *)PG_DETOAST_DATUM(PG_GETARG_DATUM(1));
+	intype = gserialized_get_type(geom);
+
+	state->size += VARSIZE(geom);
+	if ( state->size > MaxAllocSize )
+		ereport(ERROR,
+		        (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+		         errmsg("ST_Collect: collection too large")));
+
+	lwgeom = lwgeom_from_gserialized(geom);
+
+	if ( ! state->ngeoms )
+	{
+		/* Get first geometry SRID */
+		state->srid = lwgeom->srid;
+	}
+	else if ( lwgeom->srid != state->srid )
+	{
+		/* Check SRID homogeneity */
+		elog(ERROR, "Operation on mixed SRID geometries");
+		PG_RETURN_NULL();
+	}
+
+	oldcontext = MemoryContextSwitchTo(aggcontext);
+
+	/* COMPUTE_BBOX WHEN_SIMPLE */
+	if ( ! state->ngeoms )
+	{
+		if ( lwgeom->bbox )
+			state->box = gbox_copy(lwgeom->bbox);
+	}
+	else if ( state->box )
+	{
+		if ( lwgeom->bbox )
+		{
+			state->box->xmin = Min(state->box->xmin, lwgeom->bbox->xmin);
+			state->box->ymin = Min(state->box->ymin, lwgeom->bbox->ymin);
+			state->box->xmax = Max(state->box->xmax, lwgeom->bbox->xmax);
+			state->box->ymax = Max(state->box->ymax, lwgeom->bbox->ymax);
+		}
+		else
+		{
+			pfree(state->box);
+			state->box = NULL;
+		}
+	}
+
+	if ( state->ngeoms == state->maxgeoms )
+	{
+		state->maxgeoms = state->maxgeoms ? state->maxgeoms * 2 : 16;
+		if ( state->geoms )
+			state->geoms = repalloc(state->geoms, sizeof(LWGEOM *) * state->maxgeoms);
+		else
+			state->geoms = palloc(sizeof(LWGEOM *) * state->maxgeoms);
+	}
+
+	/* The deserialized geometry points into the input, keep a copy */
+	lwgeom_drop_bbox(lwgeom);
+	state->geoms[state->ngeoms] = lwgeom_clone_deep(lwgeom);
+	lwgeom_drop_srid(state->geoms[state->ngeoms]);
+	state->ngeoms++;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	/* Output type not initialized */
+	if ( ! state->outtype )
+	{
+		/* Input is single, make multi */
+		if ( ! lwtype_is_collection(intype) )
+			state->outtype = lwtype_get_collectiontype(intype);
+		/* Input is multi, make collection */
+		else
+			state->outtype = COLLECTIONTYPE;
+	}
+
+	/* Input type not compatible with output */
+	/* make output type a collection */
+	else if ( state->outtype != COLLECTIONTYPE && intype != state->outtype-3 )
+	{
+		state->outtype = COLLECTIONTYPE;
+	}
+
+	PG_RETURN_POINTER(p);
+}
+
+/**
+** The makeline transfer function adds the vertices of points and lines
+** to the output line, other types are discarded.
+*/
+PG_FUNCTION_INFO_V1(pgis_geometry_makeline_transfn);
+Datum
+pgis_geometry_makeline_transfn(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggcontext, oldcontext;
+	pgis_makeline_state *state;
+	pgis_abs *p;
+	GSERIALIZED *geom;
+	LWGEOM *lwgeom;
+	POINTARRAY *pa;
+	POINT4D pt;
+	int i;
+
+	aggcontext = pgis_aggcontext(fcinfo);
+
+	if ( PG_ARGISNULL(0) )
+	{
+		oldcontext = MemoryContextSwitchTo(aggcontext);
+		p = (pgis_abs*) palloc(sizeof(pgis_abs));
+		p->state.l = palloc0(sizeof(pgis_makeline_state));
+		p->state.l->pa = ptarray_construct_empty(LW_TRUE, LW_TRUE, 64);
+		MemoryContextSwitchTo(oldcontext);
+	}
+	else
+	{
+		p = (pgis_abs*) PG_GETARG_POINTER(0);
+	}
+	state = p->state.l;
+
+	/* Don't do anything for NULL values */
+	if ( PG_ARGISNULL(1) )
+		PG_RETURN_POINTER(p);
+
+	geom = (GSERIALIZED *)PG_DETOAST_DATUM(PG_GETARG_DATUM(1));
+	if ( gserialized_get_type(geom) != POINTTYPE && gserialized_get_type(geom) != LINETYPE )
+		PG_RETURN_POINTER(p);
+
+	lwgeom = lwgeom_from_gserialized(geom);
+
+	/* Check SRID homogeneity */
+	if ( ! state->ngeoms )
+	{
+		state->srid = lwgeom->srid;
+	}
+	else if ( lwgeom->srid != state->srid )
+	{
+		elog(ERROR, "Operation on mixed SRID geometries");
+		PG_RETURN_NULL();
+	}
+	state->ngeoms++;
+
+	if ( FLAGS_GET_Z(lwgeom->flags) ) state->hasz = LW_TRUE;
+	if ( FLAGS_GET_M(lwgeom->flags) ) state->hasm = LW_TRUE;
+
+	if ( lwgeom_is_empty(lwgeom) )
+		PG_RETURN_POINTER(p);
+
+	if ( lwgeom->type == POINTTYPE )
+		pa = ((LWPOINT*)lwgeom)->point;
+	else
+		pa = ((LWLINE*)lwgeom)->points;
+
+	if ( ((Size)state->pa->npoints + pa->npoints) * sizeof(POINT4D) > MaxAllocSize )
+		ereport(ERROR,
+		        (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+		         errmsg("ST_MakeLine: line too large")));
+
+	/* The points array is grown in the context it was created in */
+	for ( i = 0; i < pa->npoints; i++ )
+	{
+		getPoint4d_p(pa, i, &pt);
+
+		/* Lines don't repeat the end point of the line before them */
+		if ( i == 0 && lwgeom->type == LINETYPE && state->pa->npoints )
+		{
+			POINT4D last;
+			getPoint4d_p(state->pa, state->pa->npoints - 1, &last);
+			if ( last.x == pt.x && last.y == pt.y )
+				continue;
+		}
+		ptarray_append_point(state->pa, &pt, LW_TRUE);
+	}
 
 	PG_RETURN_POINTER(p);
 }
@@ -168,7 +546,7 @@ pgis_accum_finalfn(pgis_abs *p, MemoryContext mctx, FunctionCallInfo fcinfo)
 #endif
 	       ));
 
-	state = p->a;
+	state = p->state.a;
 	dims[0] = state->nelems;
 	lbs[0] = 1;
 #if POSTGIS_PGSQL_VERSION < 84
@@ -213,15 +591,17 @@ pgis_geometry_union_finalfn(PG_FUNCTION_ARGS)
 {
 	pgis_abs *p;
 	Datum result = 0;
-	Datum geometry_array = 0;
 
 	if (PG_ARGISNULL(0))
 		PG_RETURN_NULL();   /* returns null iff no input values */
 
 	p = (pgis_abs*) PG_GETARG_POINTER(0);
 
-	geometry_array = pgis_accum_finalfn(p, CurrentMemoryContext, fcinfo);
-	result = PGISDirectFunctionCall1( pgis_union_geometry_array, geometry_array );
+	/* Only NULL values */
+	if ( ! p->state.u->a )
+		PG_RETURN_NULL();
+
+	result = pgis_union_state_result(p->state.u);
 	if (!result)
 		PG_RETURN_NULL();
 
@@ -229,28 +609,39 @@ pgis_geometry_union_finalfn(PG_FUNCTION_ARGS)
 }
 
 /**
-* The "collect" final function passes the geometry[] to a geometrycollection
-* conversion before returning the result.
+* The "collect" final function serializes the collection of
+* the accumulated geometries.
 */
 PG_FUNCTION_INFO_V1(pgis_geometry_collect_finalfn);
 Datum
 pgis_geometry_collect_finalfn(PG_FUNCTION_ARGS)
 {
 	pgis_abs *p;
-	Datum result = 0;
-	Datum geometry_array = 0;
+	pgis_collect_state *state;
+	LWGEOM *outlwg;
+	GBOX *box = NULL;
 
 	if (PG_ARGISNULL(0))
 		PG_RETURN_NULL();   /* returns null iff no input values */
 
 	p = (pgis_abs*) PG_GETARG_POINTER(0);
+	state = p->state.c;
 
-	geometry_array = pgis_accum_finalfn(p, CurrentMemoryContext, fcinfo);
-	result = PGISDirectFunctionCall1( LWGEOM_collect_garray, geometry_array );
-	if (!result)
+	/* If we have been passed a complete set of NULLs then return NULL */
+	if ( ! state->outtype )
 		PG_RETURN_NULL();
 
-	PG_RETURN_DATUM(result);
+	/*
+	 * The components stay in the state, window aggregates
+	 * may call us again with more of them.
+	 */
+	if ( state->box )
+		box = gbox_copy(state->box);
+	outlwg = (LWGEOM *)lwcollection_construct(
+	             state->outtype, state->srid,
+	             box, state->ngeoms, state->geoms);
+
+	PG_RETURN_POINTER(geometry_serialize(outlwg));
 }
 
 /**
@@ -277,28 +668,45 @@ pgis_geometry_polygonize_finalfn(PG_FUNCTION_ARGS)
 }
 
 /**
-* The "makeline" final function passes the geometry[] to a line builder
-* before returning the result.
+* The "makeline" final function builds the line of the accumulated
+* vertices, in the dimensions of the input geometries.
 */
 PG_FUNCTION_INFO_V1(pgis_geometry_makeline_finalfn);
 Datum
 pgis_geometry_makeline_finalfn(PG_FUNCTION_ARGS)
 {
 	pgis_abs *p;
-	Datum result = 0;
-	Datum geometry_array = 0;
+	pgis_makeline_state *state;
+	POINTARRAY *pa;
+	LWLINE *outline;
+	POINT4D pt;
+	int i;
 
 	if (PG_ARGISNULL(0))
 		PG_RETURN_NULL();   /* returns null iff no input values */
 
 	p = (pgis_abs*) PG_GETARG_POINTER(0);
+	state = p->state.l;
 
-	geometry_array = pgis_accum_finalfn(p, CurrentMemoryContext, fcinfo);
-	result = PGISDirectFunctionCall1( LWGEOM_makeline_garray, geometry_array );
-	if (!result)
+	/* Return null on no points or lines */
+	if ( ! state->ngeoms )
+	{
+		elog(NOTICE, "No points or linestrings in input array");
 		PG_RETURN_NULL();
+	}
 
-	PG_RETURN_DATUM(result);
+	if ( ! state->pa->npoints )
+		PG_RETURN_POINTER(geometry_serialize((LWGEOM*)lwline_construct_empty(state->srid, state->hasz, state->hasm)));
+
+	pa = ptarray_construct_empty(state->hasz, state->hasm, state->pa->npoints);
+	for ( i = 0; i < state->pa->npoints; i++ )
+	{
+		getPoint4d_p(state->pa, i, &pt);
+		ptarray_append_point(pa, &pt, LW_TRUE);
+	}
+	outline = lwline_construct(state->srid, NULL, pa);
+
+	PG_RETURN_POINTER(geometry_serialize((LWGEOM*)outline));
 }
 
 /**
@@ -15,6 +15,12 @@
  * Comparision function for use in Binary Tree searches
  * (ORDER BY, GROUP BY, DISTINCT)
  *
+ * The default operator class compares bounding box corners. The
+ * btree_geometry_hilbert_ops class orders geometries along a Hilbert
+ * curve through the centers of their bounding boxes instead, so that
+ * sorting, CLUSTER on a btree index and merge joins keep spatially
+ * close rows close together.
+ *
  ***********************************************************/
 
 #include "postgres.h"
@@ -24,6 +30,7 @@
 #include "../postgis_config.h"
 #include "liblwgeom.h"
 #include "lwgeom_pg.h"
+#include "gserialized_gist.h"
 
 #include <math.h>
 #include <float.h>
@@ -37,6 +44,12 @@ Datum lwgeom_eq(PG_FUNCTION_ARGS);
 Datum lwgeom_ge(PG_FUNCTION_ARGS);
 Datum lwgeom_gt(PG_FUNCTION_ARGS);
 Datum lwgeom_cmp(PG_FUNCTION_ARGS);
+Datum lwgeom_hilbert_lt(PG_FUNCTION_ARGS);
+Datum lwgeom_hilbert_le(PG_FUNCTION_ARGS);
+Datum lwgeom_hilbert_eq(PG_FUNCTION_ARGS);
+Datum lwgeom_hilbert_ge(PG_FUNCTION_ARGS);
+Datum lwgeom_hilbert_gt(PG_FUNCTION_ARGS);
+Datum lwgeom_hilbert_cmp(PG_FUNCTION_ARGS);
 
 
 #define BTREE_SRID_MISMATCH_SEVERITY ERROR
@@ -387,3 +400,135 @@ Datum lwgeom_cmp(PG_FUNCTION_ARGS)
 	PG_RETURN_INT32(0);
 }
 
+/**
+* Read the SRID and 2D bounding box of a geometry datum. When the
+* serialization carries a box only the header and box are detoasted.
+* Returns LW_FAILURE for empty geometries, which have no box.
+*/
+static int
+lwgeom_hilbert_get_box(Datum gsdatum, int32_t *srid, GBOX *gbox)
+{
+	GSERIALIZED *gpart;
+	int result = LW_SUCCESS;
+
+	gpart = (GSERIALIZED*)PG_DETOAST_DATUM_SLICE(gsdatum, 0, 8 + sizeof(BOX2DF));
+	*srid = gserialized_get_srid(gpart);
+	gbox->flags = 0;
+
+	if ( FLAGS_GET_BBOX(gpart->flags) )
+	{
+		BOX2DF box2df;
+		memcpy(&box2df, gpart->data, sizeof(BOX2DF));
+		gbox->xmin = box2df.xmin;
+		gbox->xmax = box2df.xmax;
+		gbox->ymin = box2df.ymin;
+		gbox->ymax = box2df.ymax;
+	}
+	else
+	{
+		GSERIALIZED *g = (GSERIALIZED*)PG_DETOAST_DATUM(gsdatum);
+		result = gserialized_get_gbox_p(g, gbox);
+		if ( (Pointer)g != DatumGetPointer(gsdatum) )
+			pfree(g);
+	}
+
+	if ( (Pointer)gpart != DatumGetPointer(gsdatum) )
+		pfree(gpart);
+
+	return result;
+}
+
+/**
+* Three way comparison of two geometry datums, erroring out on mixed SRIDs.
+* Empty geometries sort first.
+*/
+static int
+lwgeom_hilbert_compare(Datum gs1, Datum gs2)
+{
+	GBOX box1;
+	GBOX box2;
+	int32_t srid1, srid2;
+	int empty1, empty2;
+	uint64_t key1, key2;
+
+	empty1 = (lwgeom_hilbert_get_box(gs1, &srid1, &box1) == LW_FAILURE);
+	empty2 = (lwgeom_hilbert_get_box(gs2, &srid2, &box2) == LW_FAILURE);
+
+	if ( srid1 != srid2 )
+	{
+		elog(BTREE_SRID_MISMATCH_SEVERITY,
+		     "Operation on two GEOMETRIES with different SRIDs\n");
+	}
+
+	if ( empty1 || empty2 )
+		return empty2 - empty1;
+
+	/*
+	* Equality has to agree with the ordering for btree to work, so the
+	* corners are compared exactly (no FPeq tolerance): boxes within the
+	* tolerance of each other may still be in different Hilbert cells.
+	*/
+	key1 = gbox_get_sortable_hash(&box1);
+	key2 = gbox_get_sortable_hash(&box2);
+
+	POSTGIS_DEBUGF(3, "hilbert keys %llu %llu", (unsigned long long)key1, (unsigned long long)key2);
+
+	if ( key1 != key2 )
+		return key1 < key2 ? -1 : 1;
+
+	if ( box1.xmin != box2.xmin )
+		return box1.xmin < box2.xmin ? -1 : 1;
+
+	if ( box1.ymin != box2.ymin )
+		return box1.ymin < box2.ymin ? -1 : 1;
+
+	if ( box1.xmax != box2.xmax )
+		return box1.xmax < box2.xmax ? -1 : 1;
+
+	if ( box1.ymax != box2.ymax )
+		return box1.ymax < box2.ymax ? -1 : 1;
+
+	return 0;
+}
+
+PG_FUNCTION_INFO_V1(lwgeom_hilbert_lt);
+Datum lwgeom_hilbert_lt(PG_FUNCTION_ARGS)
+{
+	POSTGIS_DEBUG(2, "lwgeom_hilbert_lt called");
+	PG_RETURN_BOOL(lwgeom_hilbert_compare(PG_GETARG_DATUM(0), PG_GETARG_DATUM(1)) < 0);
+}
+
+PG_FUNCTION_INFO_V1(lwgeom_hilbert_le);
+Datum lwgeom_hilbert_le(PG_FUNCTION_ARGS)
+{
+	POSTGIS_DEBUG(2, "lwgeom_hilbert_le called");
+	PG_RETURN_BOOL(lwgeom_hilbert_compare(PG_GETARG_DATUM(0), PG_GETARG_DATUM(1)) <= 0);
+}
+
+PG_FUNCTION_INFO_V1(lwgeom_hilbert_eq);
+Datum lwgeom_hilbert_eq(PG_FUNCTION_ARGS)
+{
+	POSTGIS_DEBUG(2, "lwgeom_hilbert_eq called");
+	PG_RETURN_BOOL(lwgeom_hilbert_compare(PG_GETARG_DATUM(0), PG_GETARG_DATUM(1)) == 0);
+}
+
+PG_FUNCTION_INFO_V1(lwgeom_hilbert_ge);
+Datum lwgeom_hilbert_ge(PG_FUNCTION_ARGS)
+{
+	POSTGIS_DEBUG(2, "lwgeom_hilbert_ge called");
+	PG_RETURN_BOOL(lwgeom_hilbert_compare(PG_GETARG_DATUM(0), PG_GETARG_DATUM(1)) >= 0);
+}
+
+PG_FUNCTION_INFO_V1(lwgeom_hilbert_gt);
+Datum lwgeom_hilbert_gt(PG_FUNCTION_ARGS)
+{
+	POSTGIS_DEBUG(2, "lwgeom_hilbert_gt called");
+	PG_RETURN_BOOL(lwgeom_hilbert_compare(PG_GETARG_DATUM(0), PG_GETARG_DATUM(1)) > 0);
+}
+
+PG_FUNCTION_INFO_V1(lwgeom_hilbert_cmp);
+Datum lwgeom_hilbert_cmp(PG_FUNCTION_ARGS)
+{
+	POSTGIS_DEBUG(2, "lwgeom_hilbert_cmp called");
+	PG_RETURN_INT32(lwgeom_hilbert_compare(PG_GETARG_DATUM(0), PG_GETARG_DATUM(1)));
+}
@@ -12,22 +12,143 @@
 
 #include "postgres.h"
 #include "fmgr.h"
+#include "access/hash.h"
 
 #include "../postgis_config.h"
 #include "lwgeom_cache.h"
 
+/* Number of leading and trailing bytes of a key that get hashed */
+#define GEOM_CACHE_HASH_BYTES 64
+
+int postgis_geometry_cache_size = 128;
+int postgis_geometry_cache_memory = 8192;
+
+/**
+* Cheap hash of a serialized geometry, to look it up in the multi-slot
+* caches. Only the head (size, srid, flags, box and first coordinates)
+* and the tail are hashed, whatever the size of the geometry, so keys
+* with the same hash still have to be compared in full.
+*/
+uint32 GeomCacheKeyHash(const GSERIALIZED *g)
+{
+	size_t size = VARSIZE(g);
+	const unsigned char *bytes = (const unsigned char *)g;
+	uint32 hash;
+
+	if ( size <= 2 * GEOM_CACHE_HASH_BYTES )
+		return DatumGetUInt32(hash_any(bytes, size));
+
+	hash = DatumGetUInt32(hash_any(bytes, GEOM_CACHE_HASH_BYTES));
+	hash ^= DatumGetUInt32(hash_any(bytes + size - GEOM_CACHE_HASH_BYTES, GEOM_CACHE_HASH_BYTES));
+	return hash;
+}
+
 GeomCache* GetGeomCache(FunctionCallInfoData *fcinfo)
 {
 	MemoryContext old_context;
-	GeomCache* cache = fcinfo->flinfo->fn_extra;
+	GenericCacheCollection* generic_cache = GetGenericCacheCollection(fcinfo);
+	GeomCache* cache = generic_cache->entry[GEOM_CACHE_ENTRY];
 	if ( ! cache ) {
 		old_context = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
 		cache = palloc(sizeof(GeomCache));
 		MemoryContextSwitchTo(old_context);
 		cache->prep = 0;
 		cache->rtree = 0;
-		fcinfo->flinfo->fn_extra = cache;
+		cache->circ = 0;
+		generic_cache->entry[GEOM_CACHE_ENTRY] = cache;
 	}
 	return cache;
 }
 
+/**
+* Drop the tree and the keys of the previous calls.
+*/
+static void
+CircTreeGeomCacheClear(CircTreeGeomCache *cache)
+{
+	if ( cache->index )
+		circ_tree_free(cache->index);
+	if ( cache->lwgeom )
+		lwgeom_free(cache->lwgeom);
+	if ( cache->geom1 )
+		pfree(cache->geom1);
+	if ( cache->geom2 )
+		pfree(cache->geom2);
+	cache->argnum = 0;
+	cache->index = 0;
+	cache->lwgeom = 0;
+	cache->geom1 = 0;
+	cache->geom2 = 0;
+	cache->geom1_size = 0;
+	cache->geom2_size = 0;
+}
+
+/**
+* Pull the geodetic tree of a repeated argument from the cache, building
+* it the second time a key is seen, so rapidly cycling keys don't cause
+* too much indexing. Keys are compared on their serialized form, like
+* retrieveCache() does. Returns a cache with argnum set to the indexed
+* argument (1 or 2), or to 0 if neither argument is repeating yet.
+* Pass a NULL g2 to only consider the first argument.
+*/
+CircTreeGeomCache*
+GetCircTreeGeomCache(FunctionCallInfoData *fcinfo, const GSERIALIZED *g1, const GSERIALIZED *g2)
+{
+	MemoryContext old_context;
+	GeomCache* supercache = GetGeomCache(fcinfo);
+	CircTreeGeomCache* cache = supercache->circ;
+	size_t g1_size = VARSIZE(g1);
+	size_t g2_size = g2 ? VARSIZE(g2) : 0;
+	int argnum = 0;
+
+	if ( ! cache )
+	{
+		old_context = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+		cache = palloc0(sizeof(CircTreeGeomCache));
+		MemoryContextSwitchTo(old_context);
+		supercache->circ = cache;
+	}
+
+	/* Is the indexed argument still the same? */
+	if ( cache->argnum == 1 && cache->geom1_size == g1_size && ! memcmp(cache->geom1, g1, g1_size) )
+		return cache;
+	if ( cache->argnum == 2 && g2 && cache->geom2_size == g2_size && ! memcmp(cache->geom2, g2, g2_size) )
+		return cache;
+
+	/* Is one of the arguments showing up for the second time? */
+	if ( ! cache->argnum )
+	{
+		if ( cache->geom1 && cache->geom1_size == g1_size && ! memcmp(cache->geom1, g1, g1_size) )
+			argnum = 1;
+		else if ( g2 && cache->geom2 && cache->geom2_size == g2_size && ! memcmp(cache->geom2, g2, g2_size) )
+			argnum = 2;
+	}
+
+	old_context = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+
+	if ( argnum )
+	{
+		POSTGIS_DEBUGF(3, "GetCircTreeGeomCache: building tree for argument %d", argnum);
+		cache->lwgeom = lwgeom_from_gserialized(argnum == 1 ? cache->geom1 : cache->geom2);
+		cache->index = lwgeom_calculate_circ_tree(cache->lwgeom);
+		cache->argnum = argnum;
+	}
+	else
+	{
+		/* Miss, remember the keys for the next call */
+		CircTreeGeomCacheClear(cache);
+		cache->geom1 = palloc(g1_size);
+		memcpy(cache->geom1, g1, g1_size);
+		cache->geom1_size = g1_size;
+		if ( g2 )
+		{
+			cache->geom2 = palloc(g2_size);
+			memcpy(cache->geom2, g2, g2_size);
+			cache->geom2_size = g2_size;
+		}
+	}
+
+	MemoryContextSwitchTo(old_context);
+	return cache;
+}
+
@@ -19,12 +19,41 @@
 #include "lwgeom_pg.h"
 #include "lwgeom_rtree.h"
 #include "lwgeom_geos_prepared.h"
+#include "lwgeodetic_tree.h"
+
+/*
+* Geodetic edge tree of a repeated geography argument. The keys of the
+* last call are kept until one of them shows up a second time, then the
+* tree is built for that argument (argnum) and kept while it repeats.
+* The tree points into the coordinates of lwgeom, which points into the
+* key copy, so all three live and die together.
+*/
+typedef struct {
+	int argnum;
+	GSERIALIZED *geom1;
+	GSERIALIZED *geom2;
+	size_t geom1_size;
+	size_t geom2_size;
+	LWGEOM *lwgeom;
+	CIRC_NODE *index;
+} CircTreeGeomCache;
 
 typedef struct {
 	PrepGeomCache* prep;
 	RTREE_POLY_CACHE* rtree;
+	CircTreeGeomCache* circ;
 } GeomCache;
 
+/*
+* Limits of the multi-slot caches of prepared geometries and point in
+* polygon indexes, from the postgis.geometry_cache_size (number of
+* geometries) and postgis.geometry_cache_memory (kB) settings.
+*/
+extern int postgis_geometry_cache_size;
+extern int postgis_geometry_cache_memory;
+
 GeomCache* GetGeomCache(FunctionCallInfoData *fcinfo);
+uint32 GeomCacheKeyHash(const GSERIALIZED *g);
+CircTreeGeomCache* GetCircTreeGeomCache(FunctionCallInfoData *fcinfo, const GSERIALIZED *g1, const GSERIALIZED *g2);
 
 #endif /* LWGEOM_GEOS_CACHE_H_ 1 */
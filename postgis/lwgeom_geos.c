@@ -24,7 +24,6 @@
 #include "funcapi.h"
 
 #include "../postgis_config.h"
-#include "lwgeom_functions_analytic.h" /* for point_in_polygon */
 #include "lwgeom_cache.h"
 #include "lwgeom_geos.h"
 #include "liblwgeom_internal.h"
@@ -93,7 +92,7 @@ Datum pgis_union_geometry_array(PG_FUNCTION_ARGS);
 */
 
 static RTREE_POLY_CACHE *
-GetRtreeCache(FunctionCallInfoData *fcinfo, LWGEOM *lwgeom, GSERIALIZED *poly)
+GetRtreeCache(FunctionCallInfoData *fcinfo, GSERIALIZED *poly)
 {
 	MemoryContext old_context;
 	GeomCache* supercache = GetGeomCache(fcinfo);
@@ -105,13 +104,47 @@ GetRtreeCache(FunctionCallInfoData *fcinfo, LWGEOM *lwgeom, GSERIALIZED *poly)
 	 * future use, then switch back to the local context.
 	 */
 	old_context = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
-	poly_cache = retrieveCache(lwgeom, poly, poly_cache);
+	poly_cache = retrieveCache(poly, poly_cache);
 	supercache->rtree = poly_cache;
 	MemoryContextSwitchTo(old_context);
 
 	return poly_cache;
 }
 
+/*
+ * Locate a point against a polygon or multipolygon. A polygon seen
+ * repeatedly goes through its cached ring index, others are walked in
+ * place in their serialized form, so no geometry gets built.
+ * Returns -1 outside, 0 on the boundary and 1 inside.
+ */
+static int
+pip_short_circuit(FunctionCallInfoData *fcinfo, GSERIALIZED *gpoint, GSERIALIZED *gpoly)
+{
+	RTREE_POLY_CACHE *poly_cache;
+	POINT2D pt;
+	int result;
+
+	if ( gserialized_peek_point_2d(gpoint, &pt) == LW_FAILURE )
+	{
+		/* Callers only get here with non-empty points */
+		elog(ERROR, "pip_short_circuit: point argument is empty or not a point");
+		return -1;
+	}
+
+	poly_cache = GetRtreeCache(fcinfo, gpoly);
+
+	if ( poly_cache->index )
+	{
+		result = itree_point_in_multipolygon(poly_cache->index, &pt);
+	}
+	else
+	{
+		result = gserialized_point_in_polygon(gpoly, &pt);
+	}
+
+	return result;
+}
+
 
 PG_FUNCTION_INFO_V1(postgis_geos_version);
 Datum postgis_geos_version(PG_FUNCTION_ARGS)
@@ -1990,9 +2023,7 @@ Datum contains(PG_FUNCTION_ARGS)
 	GEOSGeometry *g1, *g2;
 	GBOX box1, box2;
 	int type1, type2;
-	LWGEOM *lwgeom;
-	LWPOINT *point;
-	RTREE_POLY_CACHE *poly_cache;
+	int pip_result;
 	bool result;
 #ifdef PREPARED_GEOM
 	PrepGeomCache *prep_cache;
@@ -2034,36 +2065,10 @@ Datum contains(PG_FUNCTION_ARGS)
 	if ((type1 == POLYGONTYPE || type1 == MULTIPOLYGONTYPE) && type2 == POINTTYPE)
 	{
 		POSTGIS_DEBUG(3, "Point in Polygon test requested...short-circuiting.");
-		lwgeom = lwgeom_from_gserialized(geom1);
-		point = lwgeom_as_lwpoint(lwgeom_from_gserialized(geom2));
-
-		POSTGIS_DEBUGF(3, "Precall point_in_multipolygon_rtree %p, %p", lwgeom, point);
-
-		poly_cache = GetRtreeCache(fcinfo, lwgeom, geom1);
-
-		if ( poly_cache->ringIndices )
-		{
-			result = point_in_multipolygon_rtree(poly_cache->ringIndices, poly_cache->polyCount, poly_cache->ringCounts, point);
-		}
-		else if ( type1 == POLYGONTYPE )
-		{
-			result = point_in_polygon((LWPOLY*)lwgeom, point);
-		}
-		else if ( type1 == MULTIPOLYGONTYPE )
-		{
-			result = point_in_multipolygon((LWMPOLY*)lwgeom, point);
-		}
-		else
-		{
-			/* Gulp! Should not be here... */
-			elog(ERROR,"Type isn't poly or multipoly!");
-			PG_RETURN_NULL();
-		}
-		lwgeom_free(lwgeom);
-		lwpoint_free(point);
+		pip_result = pip_short_circuit(fcinfo, geom2, geom1);
 		PG_FREE_IF_COPY(geom1, 0);
 		PG_FREE_IF_COPY(geom2, 1);
-		if ( result == 1 ) /* completely inside */
+		if ( pip_result == 1 ) /* completely inside */
 		{
 			PG_RETURN_BOOL(TRUE);
 		}
@@ -2227,9 +2232,7 @@ Datum covers(PG_FUNCTION_ARGS)
 	bool result;
 	GBOX box1, box2;
 	int type1, type2;
-	LWGEOM *lwgeom;
-	LWPOINT *point;
-	RTREE_POLY_CACHE *poly_cache;
+	int pip_result;
 #ifdef PREPARED_GEOM
 	PrepGeomCache *prep_cache;
 #endif
@@ -2268,37 +2271,10 @@ Datum covers(PG_FUNCTION_ARGS)
 	{
 		POSTGIS_DEBUG(3, "Point in Polygon test requested...short-circuiting.");
 
-		lwgeom = lwgeom_from_gserialized(geom1);
-		point = lwgeom_as_lwpoint(lwgeom_from_gserialized(geom2));
-
-		POSTGIS_DEBUGF(3, "Precall point_in_multipolygon_rtree %p, %p", lwgeom, point);
-
-		poly_cache = GetRtreeCache(fcinfo, lwgeom, geom1);
-
-		if ( poly_cache->ringIndices )
-		{
-			result = point_in_multipolygon_rtree(poly_cache->ringIndices, poly_cache->polyCount, poly_cache->ringCounts, point);
-		}
-		else if ( type1 == POLYGONTYPE )
-		{
-			result = point_in_polygon((LWPOLY*)lwgeom, point);
-		}
-		else if ( type1 == MULTIPOLYGONTYPE )
-		{
-			result = point_in_multipolygon((LWMPOLY*)lwgeom, point);
-		}
-		else
-		{
-			/* Gulp! Should not be here... */
-			elog(ERROR,"Type isn't poly or multipoly!");
-			PG_RETURN_NULL();
-		}
-
-		lwgeom_free(lwgeom);
-		lwpoint_free(point);
+		pip_result = pip_short_circuit(fcinfo, geom2, geom1);
 		PG_FREE_IF_COPY(geom1, 0);
 		PG_FREE_IF_COPY(geom2, 1);
-		if ( result != -1 ) /* not outside */
+		if ( pip_result != -1 ) /* not outside */
 		{
 			PG_RETURN_BOOL(TRUE);
 		}
@@ -2385,10 +2361,8 @@ Datum coveredby(PG_FUNCTION_ARGS)
 	GEOSGeometry *g1, *g2;
 	bool result;
 	GBOX box1, box2;
-	LWGEOM *lwgeom;
-	LWPOINT *point;
 	int type1, type2;
-	RTREE_POLY_CACHE *poly_cache;
+	int pip_result;
 	char *patt = "**F**F***";
 
 	geom1 = (GSERIALIZED *)PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
@@ -2427,35 +2401,10 @@ Datum coveredby(PG_FUNCTION_ARGS)
 	{
 		POSTGIS_DEBUG(3, "Point in Polygon test requested...short-circuiting.");
 
-		point = lwgeom_as_lwpoint(lwgeom_from_gserialized(geom1));
-		lwgeom = lwgeom_from_gserialized(geom2);
-
-		poly_cache = GetRtreeCache(fcinfo, lwgeom, geom2);
-
-		if ( poly_cache->ringIndices )
-		{
-			result = point_in_multipolygon_rtree(poly_cache->ringIndices, poly_cache->polyCount, poly_cache->ringCounts, point);
-		}
-		else if ( type2 == POLYGONTYPE )
-		{
-			result = point_in_polygon((LWPOLY*)lwgeom, point);
-		}
-		else if ( type2 == MULTIPOLYGONTYPE )
-		{
-			result = point_in_multipolygon((LWMPOLY*)lwgeom, point);
-		}
-		else
-		{
-			/* Gulp! Should not be here... */
-			elog(ERROR,"Type isn't poly or multipoly!");
-			PG_RETURN_NULL();
-		}
-
-		lwgeom_free(lwgeom);
-		lwpoint_free(point);
+		pip_result = pip_short_circuit(fcinfo, geom1, geom2);
 		PG_FREE_IF_COPY(geom1, 0);
 		PG_FREE_IF_COPY(geom2, 1);
-		if ( result != -1 ) /* not outside */
+		if ( pip_result != -1 ) /* not outside */
 		{
 			PG_RETURN_BOOL(TRUE);
 		}
@@ -2576,13 +2525,10 @@ Datum intersects(PG_FUNCTION_ARGS)
 {
 	GSERIALIZED *geom1;
 	GSERIALIZED *geom2;
-	GSERIALIZED *serialized_poly;
 	bool result;
 	GBOX box1, box2;
-	int type1, type2, polytype;
-	LWPOINT *point;
-	LWGEOM *lwgeom;
-	RTREE_POLY_CACHE *poly_cache;
+	int type1, type2;
+	int pip_result;
 #ifdef PREPARED_GEOM
 	PrepGeomCache *prep_cache;
 #endif
@@ -2623,46 +2569,12 @@ Datum intersects(PG_FUNCTION_ARGS)
 		POSTGIS_DEBUG(3, "Point in Polygon test requested...short-circuiting.");
 
 		if ( type1 == POINTTYPE )
-		{
-			point = lwgeom_as_lwpoint(lwgeom_from_gserialized(geom1));
-			lwgeom = lwgeom_from_gserialized(geom2);
-			serialized_poly = geom2;
-			polytype = type2;
-		}
-		else
-		{
-			point = lwgeom_as_lwpoint(lwgeom_from_gserialized(geom2));
-			lwgeom = lwgeom_from_gserialized(geom1);
-			serialized_poly = geom1;
-			polytype = type1;
-		}
-
-		poly_cache = GetRtreeCache(fcinfo, lwgeom, serialized_poly);
-
-		if ( poly_cache->ringIndices )
-		{
-			result = point_in_multipolygon_rtree(poly_cache->ringIndices, poly_cache->polyCount, poly_cache->ringCounts, point);
-		}
-		else if ( polytype == POLYGONTYPE )
-		{
-			result = point_in_polygon((LWPOLY*)lwgeom, point);
-		}
-		else if ( polytype == MULTIPOLYGONTYPE )
-		{
-			result = point_in_multipolygon((LWMPOLY*)lwgeom, point);
-		}
+			pip_result = pip_short_circuit(fcinfo, geom1, geom2);
 		else
-		{
-			/* Gulp! Should not be here... */
-			elog(ERROR,"Type isn't poly or multipoly!");
-			PG_RETURN_NULL();
-		}
-
-		lwgeom_free(lwgeom);
-		lwpoint_free(point);
+			pip_result = pip_short_circuit(fcinfo, geom2, geom1);
 		PG_FREE_IF_COPY(geom1, 0);
 		PG_FREE_IF_COPY(geom2, 1);
-		if ( result != -1 ) /* not outside */
+		if ( pip_result != -1 ) /* not outside */
 		{
 			PG_RETURN_BOOL(TRUE);
 		}
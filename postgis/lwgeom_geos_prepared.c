@@ -31,13 +31,13 @@
 **
 **  Working parts:
 **
-**  PrepGeomCache, the actual struct that holds the keys we compare
-**  to determine if our cache is stale, and references to the GEOS
-**  objects used in computations.
+**  PrepGeomCache, the actual struct that holds the slots of the
+**  cache, each with the key we compare to find a geometry again, and
+**  references to the GEOS objects used in computations.
 **
 **  PrepGeomHash, a global hash table that uses a MemoryContext as
-**  key and returns a structure holding references to the GEOS
-**  objects used in computations.
+**  key and returns a structure holding the slots, so the GEOS objects
+**  used in computations can be found.
 **
 **  PreparedCacheContextMethods, a set of callback functions that
 **  get hooked into a MemoryContext that is in turn used as a
@@ -60,7 +60,7 @@
 ** so we need to map that over to actual references to GEOS objects to
 ** delete.
 **
-** This hash table stores a key/value pair of MemoryContext/Geom* objects.
+** This hash table stores a key/value pair of MemoryContext/slots.
 */
 static HTAB* PrepGeomHash = NULL;
 
@@ -69,8 +69,8 @@ static HTAB* PrepGeomHash = NULL;
 typedef struct
 {
 	MemoryContext context;
-	const GEOSPreparedGeometry* prepared_geom;
-	const GEOSGeometry* geom;
+	PrepGeomCacheEntry* entries;
+	int nentries;
 }
 PrepGeomHashEntry;
 
@@ -121,6 +121,7 @@ static void
 PreparedCacheDelete(MemoryContext context)
 {
 	PrepGeomHashEntry* pghe;
+	int i;
 
 	/* Lookup the hash entry pointer in the global hash table so we can free it */
 	pghe = GetPrepGeomHashEntry(context);
@@ -128,13 +129,17 @@ PreparedCacheDelete(MemoryContext context)
 	if (!pghe)
 		elog(ERROR, "PreparedCacheDelete: Trying to delete non-existant hash entry object with MemoryContext key (%p)", (void *)context);
 
-	POSTGIS_DEBUGF(3, "deleting geom object (%p) and prepared geom object (%p) with MemoryContext key (%p)", pghe->geom, pghe->prepared_geom, context);
+	POSTGIS_DEBUGF(3, "deleting %d cache entries (%p) with MemoryContext key (%p)", pghe->nentries, pghe->entries, context);
 
 	/* Free them */
-	if ( pghe->prepared_geom )
-		GEOSPreparedGeom_destroy( pghe->prepared_geom );
-	if ( pghe->geom )
-		GEOSGeom_destroy( (GEOSGeometry *)pghe->geom );
+	for ( i = 0; i < pghe->nentries; i++ )
+	{
+		if ( pghe->entries[i].prepared_geom )
+			GEOSPreparedGeom_destroy( pghe->entries[i].prepared_geom );
+		if ( pghe->entries[i].geom )
+			GEOSGeom_destroy( (GEOSGeometry *)pghe->entries[i].geom );
+	}
+	pfree(pghe->entries);
 
 	/* Remove the hash entry as it is no longer needed */
 	DeletePrepGeomHashEntry(context);
@@ -222,8 +227,8 @@ AddPrepGeomHashEntry(PrepGeomHashEntry pghe)
 	{
 		/* Insert the entry into the new hash element */
 		he->context = pghe.context;
-		he->geom = pghe.geom;
-		he->prepared_geom = pghe.prepared_geom;
+		he->entries = pghe.entries;
+		he->nentries = pghe.nentries;
 	}
 	else
 	{
@@ -259,42 +264,207 @@ DeletePrepGeomHashEntry(MemoryContext mcxt)
 	/* Delete the projection object from the hash */
 	he = (PrepGeomHashEntry *) hash_search(PrepGeomHash, key, HASH_REMOVE, NULL);
 
-	he->prepared_geom = NULL;
-	he->geom = NULL;
-
 	if (!he)
 		elog(ERROR, "DeletePrepGeomHashEntry: There was an error removing the geometry object from this MemoryContext (%p)", (void *)mcxt);
 }
 
+/*
+** Approximate memory held by a slot: the key, plus as much again for
+** the GEOS objects once it is prepared.
+*/
+static Size
+PrepGeomCacheEntrySize(const PrepGeomCacheEntry *entry)
+{
+	return entry->prepared_geom ? 2 * entry->pg_geom_size : entry->pg_geom_size;
+}
+
+/*
+** Find the slot of a geometry, or NULL.
+*/
+static PrepGeomCacheEntry*
+PrepGeomCacheFind(PrepGeomCache *cache, const GSERIALIZED *pg_geom, uint32 hash)
+{
+	size_t size = VARSIZE(pg_geom);
+	int i;
+
+	for ( i = 0; i < cache->nentries; i++ )
+	{
+		PrepGeomCacheEntry *entry = &(cache->entries[i]);
+		if ( entry->hash == hash &&
+		     entry->pg_geom_size == size &&
+		     memcmp(entry->pg_geom, pg_geom, size) == 0 )
+			return entry;
+	}
+	return NULL;
+}
+
+/*
+** Release the key and the GEOS objects of a slot, leaving it empty.
+*/
+static void
+PrepGeomCacheEntryClear(PrepGeomCache *cache, PrepGeomCacheEntry *entry)
+{
+	cache->memory -= PrepGeomCacheEntrySize(entry);
+	if ( entry->prepared_geom )
+		GEOSPreparedGeom_destroy( entry->prepared_geom );
+	if ( entry->geom )
+		GEOSGeom_destroy( (GEOSGeometry *)entry->geom );
+	if ( entry->pg_geom )
+		pfree(entry->pg_geom);
+	memset(entry, 0, sizeof(PrepGeomCacheEntry));
+}
+
+/*
+** Pick the slot to give up: the least recently used of the keys seen
+** only once, as those rarely come back in a join, otherwise the least
+** recently used prepared geometry. Slots used by the current call are
+** never picked. Returns NULL if there is nothing to give up.
+*/
+static PrepGeomCacheEntry*
+PrepGeomCacheVictim(PrepGeomCache *cache)
+{
+	PrepGeomCacheEntry *victim = NULL;
+	int i;
+
+	for ( i = 0; i < cache->nentries; i++ )
+	{
+		PrepGeomCacheEntry *entry = &(cache->entries[i]);
+		if ( entry->last_used == cache->clock )
+			continue;
+		if ( ! victim ||
+		     ( victim->prepared_geom && ! entry->prepared_geom ) ||
+		     ( ( ! victim->prepared_geom ) == ( ! entry->prepared_geom ) && entry->last_used < victim->last_used ) )
+			victim = entry;
+	}
+	return victim;
+}
+
+/*
+** Give up slots until the cache fits its memory budget again.
+*/
+static void
+PrepGeomCacheShrink(PrepGeomCache *cache)
+{
+	Size budget = (Size)postgis_geometry_cache_memory * 1024L;
+
+	while ( cache->memory > budget )
+	{
+		PrepGeomCacheEntry *victim = PrepGeomCacheVictim(cache);
+		if ( ! victim )
+			break;
+		POSTGIS_DEBUGF(3, "GetPrepGeomCache: over budget, dropping entry %p", victim);
+		PrepGeomCacheEntryClear(cache, victim);
+	}
+}
+
+/*
+** Remember a geometry seen for the first time, in a free slot or in
+** the one of a victim. Keys are copied into the function manager memory
+** context, as the argument will be pfree'd at the end of the call.
+*/
+static void
+PrepGeomCacheAdd(FunctionCallInfoData *fcinfo, PrepGeomCache *cache, const GSERIALIZED *pg_geom, uint32 hash)
+{
+	PrepGeomCacheEntry *entry = NULL;
+	size_t size = VARSIZE(pg_geom);
+	int i;
+
+	/* Same geometry in both arguments */
+	if ( PrepGeomCacheFind(cache, pg_geom, hash) )
+		return;
+
+	for ( i = 0; i < cache->nentries; i++ )
+	{
+		if ( ! cache->entries[i].pg_geom )
+		{
+			entry = &(cache->entries[i]);
+			break;
+		}
+	}
+	if ( ! entry && cache->nentries < cache->maxentries )
+		entry = &(cache->entries[cache->nentries++]);
+	if ( ! entry )
+	{
+		entry = PrepGeomCacheVictim(cache);
+		if ( ! entry )
+			return;
+		POSTGIS_DEBUGF(3, "GetPrepGeomCache: cache full, dropping entry %p", entry);
+		PrepGeomCacheEntryClear(cache, entry);
+	}
+
+	POSTGIS_DEBUGF(3, "GetPrepGeomCache: copying key into entry %p", entry);
+	entry->pg_geom = MemoryContextAlloc(fcinfo->flinfo->fn_mcxt, size);
+	memcpy(entry->pg_geom, pg_geom, size);
+	entry->pg_geom_size = size;
+	entry->hash = hash;
+	entry->last_used = cache->clock;
+	cache->memory += PrepGeomCacheEntrySize(entry);
+}
+
+/*
+** Look a geometry up, preparing it if this is the second time it is
+** seen. Returns LW_TRUE and fills the outcome of the cache if the
+** geometry is now prepared.
+*/
+static int
+PrepGeomCacheUse(PrepGeomCache *cache, const GSERIALIZED *pg_geom, uint32 hash, int argnum)
+{
+	PrepGeomCacheEntry *entry = PrepGeomCacheFind(cache, pg_geom, hash);
+
+	if ( ! entry )
+		return LW_FALSE;
+
+	entry->last_used = cache->clock;
+	if ( ! entry->prepared_geom )
+	{
+		/*
+		** Cache hit, but we haven't prepared our geometry yet.
+		** Prepare it.
+		*/
+		POSTGIS_DEBUGF(3, "GetPrepGeomCache: preparing obj in argument %d", argnum);
+		cache->memory -= PrepGeomCacheEntrySize(entry);
+		entry->geom = POSTGIS2GEOS( entry->pg_geom );
+		entry->prepared_geom = GEOSPrepare( entry->geom );
+		cache->memory += PrepGeomCacheEntrySize(entry);
+		PrepGeomCacheShrink(cache);
+	}
+	else
+	{
+		/*
+		** Cache hit, and we're good to go. Do nothing.
+		*/
+		POSTGIS_DEBUGF(3, "GetPrepGeomCache: cache hit, argument %d", argnum);
+	}
+
+	cache->argnum = argnum;
+	cache->geom = entry->geom;
+	cache->prepared_geom = entry->prepared_geom;
+	return LW_TRUE;
+}
+
 /*
 ** GetPrepGeomCache
 **
-** Pull the current prepared geometry from the cache or make
-** one if there is not one available. Only prepare geometry
-** if we are seeing a key for the second time. That way rapidly
-** cycling keys don't cause too much preparing.
+** Pull the prepared geometry of one of the arguments from the cache,
+** or remember the arguments if none of them is there yet. Only prepare
+** geometry if we are seeing a key for the second time. That way rapidly
+** cycling keys don't cause too much preparing, while a join cycling
+** through a set of geometries that fits the cache prepares each of them
+** once.
 */
 PrepGeomCache*
 GetPrepGeomCache(FunctionCallInfoData *fcinfo, GSERIALIZED *pg_geom1, GSERIALIZED *pg_geom2)
 {
-	MemoryContext old_context;
 	GeomCache* supercache = GetGeomCache(fcinfo);
 	PrepGeomCache* cache = supercache->prep;
-	int copy_keys = 1;
-	size_t pg_geom1_size = 0;
-	size_t pg_geom2_size = 0;
+	uint32 hash1 = 0;
+	uint32 hash2 = 0;
 
 	assert ( ! cache || cache->type == 2 );
 
 	if (!PrepGeomHash)
 		CreatePrepGeomHash();
 
-	if ( pg_geom1 )
-		pg_geom1_size = VARSIZE(pg_geom1) + VARHDRSZ;
-
-	if ( pg_geom2 )
-		pg_geom2_size = VARSIZE(pg_geom2) + VARHDRSZ;
-
 	if ( cache == NULL)
 	{
 		/*
@@ -302,21 +472,16 @@ GetPrepGeomCache(FunctionCallInfoData *fcinfo, GSERIALIZED *pg_geom1, GSERIALIZE
 		** Set it up, but don't prepare the geometry yet.
 		** That way if the next call is a cache miss we haven't
 		** wasted time preparing a geometry we don't need.
+		** The slots go in the top context, so they outlive the
+		** function context until the delete callback is done
+		** with them.
 		*/
 		PrepGeomHashEntry pghe;
 
-		old_context = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
-		cache = palloc(sizeof(PrepGeomCache));
-		MemoryContextSwitchTo(old_context);
-
+		cache = MemoryContextAllocZero(fcinfo->flinfo->fn_mcxt, sizeof(PrepGeomCache));
 		cache->type = 2;
-		cache->prepared_geom = 0;
-		cache->geom = 0;
-		cache->argnum = 0;
-		cache->pg_geom1 = 0;
-		cache->pg_geom2 = 0;
-		cache->pg_geom1_size = 0;
-		cache->pg_geom2_size = 0;
+		cache->maxentries = postgis_geometry_cache_size;
+		cache->entries = MemoryContextAllocZero(TopMemoryContext, sizeof(PrepGeomCacheEntry) * cache->maxentries);
 		cache->context = MemoryContextCreate(T_AllocSetContext, 8192,
 		                                     &PreparedCacheContextMethods,
 		                                     fcinfo->flinfo->fn_mcxt,
@@ -325,132 +490,41 @@ GetPrepGeomCache(FunctionCallInfoData *fcinfo, GSERIALIZED *pg_geom1, GSERIALIZE
 		POSTGIS_DEBUGF(3, "GetPrepGeomCache: creating cache: %p", cache);
 
 		pghe.context = cache->context;
-		pghe.geom = 0;
-		pghe.prepared_geom = 0;
+		pghe.entries = cache->entries;
+		pghe.nentries = cache->maxentries;
 		AddPrepGeomHashEntry( pghe );
 
 		supercache->prep = cache;
 
 		POSTGIS_DEBUGF(3, "GetPrepGeomCache: adding context to hash: %p", cache);
 	}
-	else if ( pg_geom1 &&
-	          cache->argnum != 2 &&
-	          cache->pg_geom1_size == pg_geom1_size &&
-	          memcmp(cache->pg_geom1, pg_geom1, pg_geom1_size) == 0)
-	{
-		if ( !cache->prepared_geom )
-		{
-			/*
-			** Cache hit, but we haven't prepared our geometry yet.
-			** Prepare it.
-			*/
-			PrepGeomHashEntry* pghe;
-
-			cache->geom = POSTGIS2GEOS( pg_geom1 );
-			cache->prepared_geom = GEOSPrepare( cache->geom );
-			cache->argnum = 1;
-			POSTGIS_DEBUG(3, "GetPrepGeomCache: preparing obj in argument 1");
-
-			pghe = GetPrepGeomHashEntry(cache->context);
-			pghe->geom = cache->geom;
-			pghe->prepared_geom = cache->prepared_geom;
-			POSTGIS_DEBUG(3, "GetPrepGeomCache: storing references to prepared obj in argument 1");
-		}
-		else
-		{
-			/*
-			** Cache hit, and we're good to go. Do nothing.
-			*/
-			POSTGIS_DEBUG(3, "GetPrepGeomCache: cache hit, argument 1");
-		}
-		/* We don't need new keys until we have a cache miss */
-		copy_keys = 0;
-	}
-	else if ( pg_geom2 &&
-	          cache->argnum != 1 &&
-	          cache->pg_geom2_size == pg_geom2_size &&
-	          memcmp(cache->pg_geom2, pg_geom2, pg_geom2_size) == 0)
-	{
-		if ( !cache->prepared_geom )
-		{
-			/*
-			** Cache hit on arg2, but we haven't prepared our geometry yet.
-			** Prepare it.
-			*/
-			PrepGeomHashEntry* pghe;
-
-			cache->geom = POSTGIS2GEOS( pg_geom2 );
-			cache->prepared_geom = GEOSPrepare( cache->geom );
-			cache->argnum = 2;
-			POSTGIS_DEBUG(3, "GetPrepGeomCache: preparing obj in argument 2");
-
-			pghe = GetPrepGeomHashEntry(cache->context);
-			pghe->geom = cache->geom;
-			pghe->prepared_geom = cache->prepared_geom;
-			POSTGIS_DEBUG(3, "GetPrepGeomCache: storing references to prepared obj in argument 2");
-		}
-		else
-		{
-			/*
-			** Cache hit, and we're good to go. Do nothing.
-			*/
-			POSTGIS_DEBUG(3, "GetPrepGeomCache: cache hit, argument 2");
-		}
-		/* We don't need new keys until we have a cache miss */
-		copy_keys = 0;
-	}
-	else if ( cache->prepared_geom )
-	{
-		/*
-		** No cache hits, so this must be a miss.
-		** Destroy the GEOS objects, empty the cache.
-		*/
-		PrepGeomHashEntry* pghe;
 
-		pghe = GetPrepGeomHashEntry(cache->context);
-		pghe->geom = 0;
-		pghe->prepared_geom = 0;
+	cache->clock++;
+	cache->argnum = 0;
+	cache->geom = 0;
+	cache->prepared_geom = 0;
 
-		POSTGIS_DEBUGF(3, "GetPrepGeomCache: cache miss, argument %d", cache->argnum);
-		GEOSPreparedGeom_destroy( cache->prepared_geom );
-		GEOSGeom_destroy( (GEOSGeometry *)cache->geom );
-
-		cache->prepared_geom = 0;
-		cache->geom = 0;
-		cache->argnum = 0;
-
-	}
-
-	if ( copy_keys && pg_geom1 )
+	if ( pg_geom1 )
 	{
-		/*
-		** If this is a new key (cache miss) we flip into the function
-		** manager memory context and make a copy. We can't just store a pointer
-		** because this copy will be pfree'd at the end of this function
-		** call.
-		*/
-		POSTGIS_DEBUG(3, "GetPrepGeomCache: copying pg_geom1 into cache");
-		old_context = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
-		if ( cache->pg_geom1 )
-			pfree(cache->pg_geom1);
-		cache->pg_geom1 = palloc(pg_geom1_size);
-		MemoryContextSwitchTo(old_context);
-		memcpy(cache->pg_geom1, pg_geom1, pg_geom1_size);
-		cache->pg_geom1_size = pg_geom1_size;
+		hash1 = GeomCacheKeyHash(pg_geom1);
+		if ( PrepGeomCacheUse(cache, pg_geom1, hash1, 1) )
+			return cache;
 	}
-	if ( copy_keys && pg_geom2 )
+	if ( pg_geom2 )
 	{
-		POSTGIS_DEBUG(3, "GetPrepGeomCache: copying pg_geom2 into cache");
-		old_context = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
-		if ( cache->pg_geom2 )
-			pfree(cache->pg_geom2);
-		cache->pg_geom2 = palloc(pg_geom2_size);
-		MemoryContextSwitchTo(old_context);
-		memcpy(cache->pg_geom2, pg_geom2, pg_geom2_size);
-		cache->pg_geom2_size = pg_geom2_size;
+		hash2 = GeomCacheKeyHash(pg_geom2);
+		if ( PrepGeomCacheUse(cache, pg_geom2, hash2, 2) )
+			return cache;
 	}
 
+	/* No cache hits, remember the keys for the next calls */
+	POSTGIS_DEBUG(3, "GetPrepGeomCache: cache miss");
+	if ( pg_geom1 )
+		PrepGeomCacheAdd(fcinfo, cache, pg_geom1, hash1);
+	if ( pg_geom2 )
+		PrepGeomCacheAdd(fcinfo, cache, pg_geom2, hash2);
+	PrepGeomCacheShrink(cache);
+
 	return cache;
 
 }
-
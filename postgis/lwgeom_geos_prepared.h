@@ -25,25 +25,48 @@
 #include "lwgeom_geos.h"
 
 /*
-** Cache structure. We use GSERIALIZED as keys so no transformations
-** are needed before we memcmp them with other keys. We store the
-** size to avoid having to calculate the size every time.
-** The argnum gives the number of function arguments we are caching.
+** One cached geometry. The serialized copy is the key, looked up
+** through its hash and then compared in full. The GEOS Geometry and
+** PreparedGeometry are only built the second time the key is seen,
+** so keys that never repeat don't cost any preparing. Both have to be
+** kept, because the PreparedGeometry contains a reference to the
+** geometry.
+*/
+typedef struct
+{
+	uint32                        hash;
+	uint32                        last_used;
+	GSERIALIZED                   *pg_geom;
+	size_t                        pg_geom_size;
+	const GEOSPreparedGeometry    *prepared_geom;
+	const GEOSGeometry            *geom;
+}
+PrepGeomCacheEntry;
+
+/*
+** Cache structure. Holds up to maxentries geometries, from either
+** argument, least recently used ones going first when the slots or the
+** memory budget (see postgis.geometry_cache_size and
+** postgis.geometry_cache_memory) run out.
+** The argnum, prepared_geom and geom members describe the outcome of
+** the last GetPrepGeomCache call: argnum is the argument (1 or 2) whose
+** geometry is prepared, or 0 if neither was.
 ** Intersects requires that both arguments be checked for cacheability,
 ** while Contains only requires that the containing argument be checked.
-** Both the Geometry and the PreparedGeometry have to be cached,
-** because the PreparedGeometry contains a reference to the geometry.
+** The entries live outside of the function memory context, they are
+** released along with the GEOS objects by the context delete callback.
 */
 typedef struct
 {
 	char                          type;
-	GSERIALIZED                     *pg_geom1;
-	GSERIALIZED                     *pg_geom2;
-	size_t                        pg_geom1_size;
-	size_t                        pg_geom2_size;
 	int32                         argnum;
 	const GEOSPreparedGeometry    *prepared_geom;
-	const GEOSGeometry                  *geom;
+	const GEOSGeometry            *geom;
+	int                           nentries;
+	int                           maxentries;
+	Size                          memory;
+	uint32                        clock;
+	PrepGeomCacheEntry            *entries;
 	MemoryContext                 context;
 }
 PrepGeomCache;
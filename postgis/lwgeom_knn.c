@@ -0,0 +1,288 @@
+/**********************************************************************
+ * $Id$
+ *
+ * PostGIS - Spatial Types for PostgreSQL
+ * http://postgis.refractions.net
+ *
+ * This is free software; you can redistribute and/or modify it under
+ * the terms of the GNU General Public Licence. See the COPYING file.
+ *
+ **********************************************************************/
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "executor/spi.h"
+#include "lib/stringinfo.h"
+#include "utils/builtins.h"
+#include "utils/datum.h"
+#include "utils/lsyscache.h"
+
+#include "../postgis_config.h"
+#include "liblwgeom.h"
+#include "lwgeom_pg.h"
+
+#include <float.h>
+
+Datum LWGEOM_knearest(PG_FUNCTION_ARGS);
+
+/** Number of rows pulled from the cursor at a time */
+#define KNN_FETCH_SIZE 64
+
+/** Largest k accepted, all the candidates are kept in memory */
+#define KNN_MAX_K 100000
+
+/**
+* A candidate row and its exact distance to the query geometry.
+*/
+typedef struct
+{
+	double distance;
+	Datum row;
+}
+KNN_CANDIDATE;
+
+/**
+* The k best candidates found so far, in a binary max-heap on the
+* distance while the table is scanned, so the worst of them is at the
+* top, then sorted nearest first.
+*/
+typedef struct
+{
+	int ncandidates;
+	int next;
+	KNN_CANDIDATE *candidates;
+}
+KNN_STATE;
+
+/*
+* Move the candidate at i down the first n ones of the heap, until
+* its children are no further than it.
+*/
+static void
+knn_sift_down(KNN_CANDIDATE *heap, int n, int i)
+{
+	KNN_CANDIDATE c = heap[i];
+	int child;
+
+	while ( (child = 2 * i + 1) < n )
+	{
+		if ( child + 1 < n && heap[child+1].distance > heap[child].distance )
+			child++;
+		if ( heap[child].distance <= c.distance )
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = c;
+}
+
+/*
+* Put a row in the heap of the k best candidates, dropping the worst
+* one when the heap is full. The row is copied into the memory context
+* of the function, out of the SPI one.
+*/
+static void
+knn_add_candidate(KNN_STATE *state, int k, double distance, Datum row, MemoryContext mcxt)
+{
+	KNN_CANDIDATE *heap = state->candidates;
+	MemoryContext oldcontext;
+	KNN_CANDIDATE c;
+	int i, parent;
+
+	if ( state->ncandidates == k && distance >= heap[0].distance )
+		return;
+
+	oldcontext = MemoryContextSwitchTo(mcxt);
+	c.row = datumCopy(row, false, -1);
+	MemoryContextSwitchTo(oldcontext);
+	c.distance = distance;
+
+	/* Full, the new row takes the place of the worst one */
+	if ( state->ncandidates == k )
+	{
+		pfree(DatumGetPointer(heap[0].row));
+		heap[0] = c;
+		knn_sift_down(heap, k, 0);
+		return;
+	}
+
+	/* Otherwise it goes up from the bottom */
+	i = state->ncandidates++;
+	while ( i > 0 )
+	{
+		parent = (i - 1) / 2;
+		if ( heap[parent].distance >= c.distance )
+			break;
+		heap[i] = heap[parent];
+		i = parent;
+	}
+	heap[i] = c;
+}
+
+/*
+* Sort the heap of candidates in place, nearest first.
+*/
+static void
+knn_sort_candidates(KNN_STATE *state)
+{
+	KNN_CANDIDATE *heap = state->candidates;
+	KNN_CANDIDATE c;
+	int n;
+
+	for ( n = state->ncandidates - 1; n > 0; n-- )
+	{
+		c = heap[0];
+		heap[0] = heap[n];
+		heap[n] = c;
+		knn_sift_down(heap, n, 0);
+	}
+}
+
+/**
+* ST_KNearest(rows anyelement, geomcolumn text, geom geometry, k integer)
+*
+* Returns the k rows of the table with the rowtype of the first argument
+* whose geometries are closest to geom, nearest first, by exact 2D
+* distance.
+*
+* The table is read through a cursor ordered by box distance (<#>, which
+* walks the GiST index on 9.1 and up). The box distance of a row is a
+* lower bound of its exact distance, so once it passes the k-th best
+* exact distance found so far no later row can get in and the scan stops.
+*/
+PG_FUNCTION_INFO_V1(LWGEOM_knearest);
+Datum LWGEOM_knearest(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	KNN_STATE *state;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		MemoryContext oldcontext;
+		Oid rowtype, reloid, argtypes[1];
+		Datum values[1];
+		char *column, *relname;
+		StringInfoData query;
+		GSERIALIZED *gser;
+		LWGEOM *lwgeom;
+		Portal portal;
+		int k, i;
+		bool done = false;
+
+		funcctx = SRF_FIRSTCALL_INIT();
+
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+		state = palloc0(sizeof(KNN_STATE));
+		funcctx->user_fctx = state;
+		MemoryContextSwitchTo(oldcontext);
+
+		/* Only the first argument may be NULL, it just names the table */
+		if ( PG_ARGISNULL(1) || PG_ARGISNULL(2) || PG_ARGISNULL(3) )
+			SRF_RETURN_DONE(funcctx);
+
+		k = PG_GETARG_INT32(3);
+		if ( k > KNN_MAX_K )
+			elog(ERROR, "ST_KNearest: k must not be greater than %d", KNN_MAX_K);
+		if ( k <= 0 )
+			SRF_RETURN_DONE(funcctx);
+
+		rowtype = get_fn_expr_argtype(fcinfo->flinfo, 0);
+		reloid = get_typ_typrelid(rowtype);
+		if ( reloid == InvalidOid )
+			elog(ERROR, "ST_KNearest: first argument must be a row of a table, not %s", format_type_be(rowtype));
+
+		gser = (GSERIALIZED*)PG_DETOAST_DATUM(PG_GETARG_DATUM(2));
+		lwgeom = lwgeom_from_gserialized(gser);
+		if ( lwgeom_is_empty(lwgeom) )
+		{
+			lwgeom_free(lwgeom);
+			SRF_RETURN_DONE(funcctx);
+		}
+
+		column = quote_identifier(text2cstring(PG_GETARG_TEXT_P(1)));
+		relname = quote_qualified_identifier(get_namespace_name(get_rel_namespace(reloid)), get_rel_name(reloid));
+
+		initStringInfo(&query);
+#if POSTGIS_PGSQL_VERSION >= 91
+		appendStringInfo(&query, "SELECT t, t.%s, t.%s <#> $1 AS d FROM %s t WHERE t.%s IS NOT NULL ORDER BY t.%s <#> $1",
+		        column, column, relname, column, column);
+#else
+		appendStringInfo(&query, "SELECT t, t.%s, geometry_distance_box(t.%s, $1) AS d FROM %s t WHERE t.%s IS NOT NULL ORDER BY d",
+		        column, column, relname, column);
+#endif
+		POSTGIS_DEBUGF(3, "ST_KNearest query: %s", query.data);
+
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+		state->candidates = palloc(sizeof(KNN_CANDIDATE) * k);
+		MemoryContextSwitchTo(oldcontext);
+
+		if ( SPI_connect() != SPI_OK_CONNECT )
+			elog(ERROR, "ST_KNearest: could not connect to SPI manager");
+
+		argtypes[0] = get_fn_expr_argtype(fcinfo->flinfo, 2);
+		values[0] = PointerGetDatum(gser);
+		portal = SPI_cursor_open_with_args(NULL, query.data, 1, argtypes, values, NULL, true, 0);
+
+		while ( ! done )
+		{
+			SPI_cursor_fetch(portal, true, KNN_FETCH_SIZE);
+			if ( SPI_processed == 0 )
+				break;
+
+			for ( i = 0; i < SPI_processed; i++ )
+			{
+				HeapTuple tuple = SPI_tuptable->vals[i];
+				TupleDesc tupdesc = SPI_tuptable->tupdesc;
+				bool isnull;
+				double boxdist, distance;
+				Datum row, geom;
+				GSERIALIZED *candidate;
+				LWGEOM *candidate_lwgeom;
+
+				/* Rows come by increasing box distance, nobody further can win */
+				boxdist = DatumGetFloat8(SPI_getbinval(tuple, tupdesc, 3, &isnull));
+				if ( isnull || (state->ncandidates == k && boxdist > state->candidates[0].distance) )
+				{
+					done = true;
+					break;
+				}
+
+				geom = SPI_getbinval(tuple, tupdesc, 2, &isnull);
+				candidate = (GSERIALIZED*)PG_DETOAST_DATUM(geom);
+				if ( gserialized_get_srid(candidate) != lwgeom->srid )
+					elog(ERROR, "Operation on two GEOMETRIES with different SRIDs");
+
+				candidate_lwgeom = lwgeom_from_gserialized(candidate);
+				distance = lwgeom_mindistance2d(candidate_lwgeom, lwgeom);
+				lwgeom_free(candidate_lwgeom);
+				if ( (Pointer)candidate != DatumGetPointer(geom) )
+					pfree(candidate);
+
+				/* Empties have no distance */
+				if ( distance >= MAXFLOAT )
+					continue;
+
+				row = SPI_getbinval(tuple, tupdesc, 1, &isnull);
+				knn_add_candidate(state, k, distance, row, funcctx->multi_call_memory_ctx);
+			}
+			SPI_freetuptable(SPI_tuptable);
+		}
+
+		SPI_cursor_close(portal);
+		SPI_finish();
+		lwgeom_free(lwgeom);
+
+		knn_sort_candidates(state);
+
+		POSTGIS_DEBUGF(3, "ST_KNearest found %d rows", state->ncandidates);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	state = funcctx->user_fctx;
+
+	if ( state->next < state->ncandidates )
+		SRF_RETURN_NEXT(funcctx, state->candidates[state->next++].row);
+
+	SRF_RETURN_DONE(funcctx);
+}
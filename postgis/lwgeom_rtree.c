@@ -16,461 +16,154 @@
 #include "liblwgeom.h"
 #include "liblwgeom_internal.h"         /* For FP comparators. */
 #include "lwgeom_rtree.h"
+#include "lwgeom_cache.h"          /* For the cache limits. */
 
 
-Datum LWGEOM_polygon_index(PG_FUNCTION_ARGS);
-
-
-/**
- * Creates an rtree given a pointer to the point array.
- * Must copy the point array.
- */
-RTREE_NODE *createTree(POINTARRAY *pointArray)
-{
-	RTREE_NODE *root;
-	RTREE_NODE** nodes = lwalloc(sizeof(RTREE_NODE*) * pointArray->npoints);
-	int i, nodeCount;
-	int childNodes, parentNodes;
-
-	POSTGIS_DEBUGF(2, "createTree called with pointarray %p", pointArray);
-
-	nodeCount = pointArray->npoints - 1;
-
-	POSTGIS_DEBUGF(3, "Total leaf nodes: %d", nodeCount);
-
-	/*
-	 * Create a leaf node for every line segment.
-	 */
-	for (i = 0; i < nodeCount; i++)
-	{
-		nodes[i] = createLeafNode(pointArray, i);
-	}
-
-	/*
-	 * Next we group nodes by pairs.  If there's an odd number of nodes,
-	 * we bring the last node up a level as is.	 Continue until we have
-	 * a single top node.
-	 */
-	childNodes = nodeCount;
-	parentNodes = nodeCount / 2;
-	while (parentNodes > 0)
-	{
-		POSTGIS_DEBUGF(3, "Merging %d children into %d parents.", childNodes, parentNodes);
-
-		i = 0;
-		while (i < parentNodes)
-		{
-			nodes[i] = createInteriorNode(nodes[i*2], nodes[i*2+1]);
-			i++;
-		}
-		/*
-		 * Check for an odd numbered final node.
-		 */
-		if (parentNodes * 2 < childNodes)
-		{
-			POSTGIS_DEBUGF(3, "Shuffling child %d to parent %d", childNodes - 1, i);
-
-			nodes[i] = nodes[childNodes - 1];
-			parentNodes++;
-		}
-		childNodes = parentNodes;
-		parentNodes = parentNodes / 2;
-	}
-
-	root = nodes[0];
-	lwfree(nodes);
-	POSTGIS_DEBUGF(3, "createTree returning %p", root);
-
-	return root;
-}
-
-/**
- * Creates an interior node given the children.
- */
-RTREE_NODE *createInteriorNode(RTREE_NODE *left, RTREE_NODE *right)
+RTREE_POLY_CACHE * createCache()
 {
-	RTREE_NODE *parent;
-
-	POSTGIS_DEBUGF(2, "createInteriorNode called for children %p, %p", left, right);
-
-	parent = lwalloc(sizeof(RTREE_NODE));
-	parent->leftNode = left;
-	parent->rightNode = right;
-	parent->interval = mergeIntervals(left->interval, right->interval);
-	parent->segment = NULL;
-
-	POSTGIS_DEBUGF(3, "createInteriorNode returning %p", parent);
-
-	return parent;
+	RTREE_POLY_CACHE *result;
+	result = lwalloc(sizeof(RTREE_POLY_CACHE));
+	result->index = 0;
+	result->nentries = 0;
+	result->maxentries = postgis_geometry_cache_size;
+	result->memory = 0;
+	result->clock = 0;
+	result->entries = lwalloc(sizeof(RTREE_POLY_CACHE_ENTRY) * result->maxentries);
+	memset(result->entries, 0, sizeof(RTREE_POLY_CACHE_ENTRY) * result->maxentries);
+	result->type = 1;
+	return result;
 }
 
-/**
- * Creates a leaf node given the pointer to the start point of the segment.
- */
-RTREE_NODE *createLeafNode(POINTARRAY *pa, int startPoint)
+void populateCache(RTREE_POLY_CACHE_ENTRY *entry)
 {
-	RTREE_NODE *parent;
-	LWLINE *line;
-	double value1;
-	double value2;
-	POINT4D tmp;
-	POINTARRAY *npa;
-
-	POSTGIS_DEBUGF(2, "createLeafNode called for point %d of %p", startPoint, pa);
+	POSTGIS_DEBUGF(2, "populateCache called with entry %p", entry);
 
-	if (pa->npoints < startPoint + 2)
+	/*
+	** Read the geometry out of our own copy of the serialized
+	** polygon, the point arrays and the trees then point into it.
+	*/
+	entry->lwgeom = lwgeom_from_gserialized(entry->poly);
+	entry->index = itree_from_lwgeom(entry->lwgeom);
+	if ( ! entry->index )
 	{
-		lwerror("createLeafNode: npoints = %d, startPoint = %d", pa->npoints, startPoint);
+		/* Not areal, nothing to index */
+		lwgeom_free(entry->lwgeom);
+		entry->lwgeom = 0;
 	}
 
-	/*
-	 * The given point array will be part of a geometry that will be freed
-	 * independently of the index.	Since we may want to cache the index,
-	 * we must create independent arrays.
-	 */
-	npa = ptarray_construct_empty(0,0,2);
-
-	getPoint4d_p(pa, startPoint, &tmp);
-	value1 = tmp.y;
-	ptarray_append_point(npa,&tmp,LW_TRUE);
-	
-	getPoint4d_p(pa, startPoint+1, &tmp);
-	value2 = tmp.y;
-	ptarray_append_point(npa,&tmp,LW_TRUE);
-
-	line = lwline_construct(SRID_UNKNOWN, NULL, npa);
-	
-	parent = lwalloc(sizeof(RTREE_NODE));
-	parent->interval = createInterval(value1, value2);
-	parent->segment = line;
-	parent->leftNode = NULL;
-	parent->rightNode = NULL;
-
-	POSTGIS_DEBUGF(3, "createLeafNode returning %p", parent);
-
-	return parent;
+	POSTGIS_DEBUGF(3, "populateCache returning %p", entry);
 }
 
 /**
- * Creates an interval with the total extents of the two given intervals.
+ * Free the cached polygon and all the sub-objects properly.
  */
-INTERVAL *mergeIntervals(INTERVAL *inter1, INTERVAL *inter2)
+void clearCache(RTREE_POLY_CACHE_ENTRY *entry)
 {
-	INTERVAL *interval;
-
-	POSTGIS_DEBUGF(2, "mergeIntervals called with %p, %p", inter1, inter2);
-
-	interval = lwalloc(sizeof(INTERVAL));
-	interval->max = FP_MAX(inter1->max, inter2->max);
-	interval->min = FP_MIN(inter1->min, inter2->min);
-
-	POSTGIS_DEBUGF(3, "interval min = %8.3f, max = %8.3f", interval->min, interval->max);
-
-	return interval;
+	POSTGIS_DEBUGF(2, "clearCache called for %p", entry);
+	if (entry->index)
+		itree_free(entry->index);
+	if (entry->lwgeom)
+		lwgeom_free(entry->lwgeom);
+	if (entry->poly)
+		lwfree(entry->poly);
+	memset(entry, 0, sizeof(RTREE_POLY_CACHE_ENTRY));
 }
 
-/**
- * Creates an interval given the min and max values, in arbitrary order.
- */
-INTERVAL *createInterval(double value1, double value2)
+/*
+** Approximate memory held by an entry: the key, plus as much again
+** for the deserialized polygon and its trees once it is indexed.
+*/
+static size_t entrySize(const RTREE_POLY_CACHE_ENTRY *entry)
 {
-	INTERVAL *interval;
-
-	POSTGIS_DEBUGF(2, "createInterval called with %8.3f, %8.3f", value1, value2);
-
-	interval = lwalloc(sizeof(INTERVAL));
-	interval->max = FP_MAX(value1, value2);
-	interval->min = FP_MIN(value1, value2);
-
-	POSTGIS_DEBUGF(3, "interval min = %8.3f, max = %8.3f", interval->min, interval->max);
-
-	return interval;
+	size_t size = entry->poly ? VARSIZE(entry->poly) : 0;
+	return entry->index ? 2 * size : size;
 }
 
-/**
- * Recursively frees the child nodes, the interval and the line before
- * freeing the root node.
- */
-void freeTree(RTREE_NODE *root)
+static void dropEntry(RTREE_POLY_CACHE *cache, RTREE_POLY_CACHE_ENTRY *entry)
 {
-	POSTGIS_DEBUGF(2, "freeTree called for %p", root);
-
-	if (root->leftNode)
-		freeTree(root->leftNode);
-	if (root->rightNode)
-		freeTree(root->rightNode);
-	lwfree(root->interval);
-	if (root->segment)
-	{
-		lwline_free(root->segment);
-	}
-	lwfree(root);
-}
-
-
-/**
- * Free the cache object and all the sub-objects properly.
- */
-void clearCache(RTREE_POLY_CACHE *cache)
-{
-	int g, r, i;
-	POSTGIS_DEBUGF(2, "clearCache called for %p", cache);
-        i = 0;
-        for (g = 0; g < cache->polyCount; g++)
-        {
-	        for (r = 0; r < cache->ringCounts[g]; r++)
-	        {
-		        freeTree(cache->ringIndices[i]);
-                        i++;
-                }
-	}
-	lwfree(cache->ringIndices);
-        lwfree(cache->ringCounts);
-	lwfree(cache->poly);
-	cache->poly = 0;
-	cache->ringIndices = 0;
-	cache->ringCounts = 0;
-	cache->polyCount = 0;
+	cache->memory -= entrySize(entry);
+	clearCache(entry);
 }
 
-
-/**
- * Retrieves a collection of line segments given the root and crossing value.
- * The collection is a multilinestring consisting of two point lines
- * representing the segments of the ring that may be crossed by the
- * horizontal projection line at the given y value.
- */
-LWMLINE *findLineSegments(RTREE_NODE *root, double value)
+/*
+** The entry to give up: the least recently used of the polygons seen
+** only once, otherwise the least recently used copied one. The entry
+** of the current call is never picked.
+*/
+static RTREE_POLY_CACHE_ENTRY *victimEntry(RTREE_POLY_CACHE *cache)
 {
-	LWMLINE *tmp, *result;
-	LWGEOM **lwgeoms;
-
-	POSTGIS_DEBUGF(2, "findLineSegments called for tree %p and value %8.3f", root, value);
-
-	result = NULL;
-
-	if (!isContained(root->interval, value))
-	{
-		POSTGIS_DEBUGF(3, "findLineSegments %p: not contained.", root);
+	RTREE_POLY_CACHE_ENTRY *victim = 0;
+	int i;
 
-		return NULL;
-	}
-
-	/* If there is a segment defined for this node, include it. */
-	if (root->segment)
+	for (i = 0; i < cache->nentries; i++)
 	{
-		POSTGIS_DEBUGF(3, "findLineSegments %p: adding segment %p %d.", root, root->segment, root->segment->type);
-
-		lwgeoms = lwalloc(sizeof(LWGEOM *));
-		lwgeoms[0] = (LWGEOM *)root->segment;
-
-		POSTGIS_DEBUGF(3, "Found geom %p, type %d, dim %d", root->segment, root->segment->type, FLAGS_GET_Z(root->segment->flags));
-
-		result = (LWMLINE *)lwcollection_construct(MULTILINETYPE, SRID_UNKNOWN, NULL, 1, lwgeoms);
+		RTREE_POLY_CACHE_ENTRY *entry = &(cache->entries[i]);
+		if (! entry->size || entry->last_used == cache->clock)
+			continue;
+		if (! victim ||
+		    (victim->poly && ! entry->poly) ||
+		    ((! victim->poly) == (! entry->poly) && entry->last_used < victim->last_used))
+			victim = entry;
 	}
-
-	/* If there is a left child node, recursively include its results. */
-	if (root->leftNode)
-	{
-		POSTGIS_DEBUGF(3, "findLineSegments %p: recursing left.", root);
-
-		tmp = findLineSegments(root->leftNode, value);
-		if (tmp)
-		{
-			POSTGIS_DEBUGF(3, "Found geom %p, type %d, dim %d", tmp, tmp->type, FLAGS_GET_Z(tmp->flags));
-
-			if (result)
-				result = mergeMultiLines(result, tmp);
-			else
-				result = tmp;
-		}
-	}
-
-	/* Same for any right child. */
-	if (root->rightNode)
-	{
-		POSTGIS_DEBUGF(3, "findLineSegments %p: recursing right.", root);
-
-		tmp = findLineSegments(root->rightNode, value);
-		if (tmp)
-		{
-			POSTGIS_DEBUGF(3, "Found geom %p, type %d, dim %d", tmp, tmp->type, FLAGS_GET_Z(tmp->flags));
-
-			if (result)
-				result = mergeMultiLines(result, tmp);
-			else
-				result = tmp;
-		}
-	}
-
-	return result;
+	return victim;
 }
 
-/** Merges two multilinestrings into a single multilinestring. */
-LWMLINE *mergeMultiLines(LWMLINE *line1, LWMLINE *line2)
+static void shrinkCache(RTREE_POLY_CACHE *cache)
 {
-	LWGEOM **geoms;
-	LWCOLLECTION *col;
-	int i, j, ngeoms;
+	size_t budget = (size_t)postgis_geometry_cache_memory * 1024;
 
-	POSTGIS_DEBUGF(2, "mergeMultiLines called on %p, %d, %d; %p, %d, %d", line1, line1->ngeoms, line1->type, line2, line2->ngeoms, line2->type);
-
-	ngeoms = line1->ngeoms + line2->ngeoms;
-	geoms = lwalloc(sizeof(LWGEOM *) * ngeoms);
-
-	j = 0;
-	for (i = 0; i < line1->ngeoms; i++, j++)
+	while (cache->memory > budget)
 	{
-		geoms[j] = lwgeom_clone((LWGEOM *)line1->geoms[i]);
+		RTREE_POLY_CACHE_ENTRY *victim = victimEntry(cache);
+		if (! victim)
+			break;
+		POSTGIS_DEBUGF(3, "Cache over budget, dropping entry %p.", victim);
+		dropEntry(cache, victim);
 	}
-	for (i = 0; i < line2->ngeoms; i++, j++)
-	{
-		geoms[j] = lwgeom_clone((LWGEOM *)line2->geoms[i]);
-	}
-	col = lwcollection_construct(MULTILINETYPE, SRID_UNKNOWN, NULL, ngeoms, geoms);
-
-	POSTGIS_DEBUGF(3, "mergeMultiLines returning %p, %d, %d", col, col->ngeoms, col->type);
-
-	return (LWMLINE *)col;
-}
-
-/**
- * Returns 1 if min < value <= max, 0 otherwise. */
-uint32 isContained(INTERVAL *interval, double value)
-{
-	return FP_CONTAINS_INCL(interval->min, value, interval->max) ? 1 : 0;
 }
 
-PG_FUNCTION_INFO_V1(LWGEOM_polygon_index);
-Datum LWGEOM_polygon_index(PG_FUNCTION_ARGS)
+/*
+** Remember the hash and size of a polygon seen for the first time, in
+** a free entry or the one of a victim. The polygon itself is only
+** copied if it comes around again.
+*/
+static RTREE_POLY_CACHE_ENTRY *setCacheKey(RTREE_POLY_CACHE *currentCache, GSERIALIZED *serializedPoly, uint32 hash)
 {
-	GSERIALIZED *igeom, *result;
-	LWPOLY *poly;
-	LWMLINE *mline;
-	RTREE_NODE *root;
-	double yval;
-#if POSTGIS_DEBUG_LEVEL >= 3
-	int i = 0;
-#endif
-
-	POSTGIS_DEBUG(2, "polygon_index called.");
-
-	result = NULL;
-	igeom = (GSERIALIZED *)PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
-	yval = PG_GETARG_FLOAT8(1);
-	if ( gserialized_get_type(igeom) != POLYGONTYPE )
-	{
-		PG_FREE_IF_COPY(igeom, 0);
-		PG_RETURN_NULL();
-	}
-	poly = lwgeom_as_lwpoly(lwgeom_from_gserialized(igeom));
-	root = createTree(poly->rings[0]);
-
-	mline = findLineSegments(root, yval);
+	RTREE_POLY_CACHE_ENTRY *entry = 0;
+	int i;
 
-#if POSTGIS_DEBUG_LEVEL >= 3
-	POSTGIS_DEBUGF(3, "mline returned %p %d", mline, mline->type);
-	for (i = 0; i < mline->ngeoms; i++)
+	for (i = 0; i < currentCache->nentries; i++)
 	{
-		POSTGIS_DEBUGF(3, "geom[%d] %p %d", i, mline->geoms[i], mline->geoms[i]->type);
-	}
-#endif
-
-	if (mline)
-		result = geometry_serialize((LWGEOM *)mline);
-
-	POSTGIS_DEBUGF(3, "returning result %p", result);
-
-	lwfree(root);
-
-	lwpoly_free(poly);
-	lwmline_free(mline);
-	PG_FREE_IF_COPY(igeom, 0);
-	PG_RETURN_POINTER(result);
-
-}
-
-RTREE_POLY_CACHE * createCache()
-{
-	RTREE_POLY_CACHE *result;
-	result = lwalloc(sizeof(RTREE_POLY_CACHE));
-	result->polyCount = 0;
-	result->ringCounts = 0;
-	result->ringIndices = 0;
-	result->poly = 0;
-	result->type = 1;
-	return result;
-}
-
-void populateCache(RTREE_POLY_CACHE *currentCache, LWGEOM *lwgeom, GSERIALIZED *serializedPoly)
-{
-	int i, p, r, length;
-	LWMPOLY *mpoly;
-	LWPOLY *poly;
-	int nrings;
-
-	POSTGIS_DEBUGF(2, "populateCache called with cache %p geom %p", currentCache, lwgeom);
-
-	if (lwgeom->type == MULTIPOLYGONTYPE)
-	{
-		POSTGIS_DEBUG(2, "populateCache MULTIPOLYGON");
-		mpoly = (LWMPOLY *)lwgeom;
-		nrings = 0;
-		/*
-		** Count the total number of rings.
-		*/
-		currentCache->polyCount = mpoly->ngeoms;
-		currentCache->ringCounts = lwalloc(sizeof(int) * mpoly->ngeoms);
-		for ( i = 0; i < mpoly->ngeoms; i++ )
-		{
-                        currentCache->ringCounts[i] = mpoly->geoms[i]->nrings;
-			nrings += mpoly->geoms[i]->nrings;
-		}
-		currentCache->ringIndices = lwalloc(sizeof(RTREE_NODE *) * nrings);
-		/*
-		** Load the array in geometry order, each outer ring followed by the inner rings
-                ** associated with that outer ring
-		*/
-                i = 0;
-		for ( p = 0; p < mpoly->ngeoms; p++ )
+		if (! currentCache->entries[i].size)
 		{
-			for ( r = 0; r < mpoly->geoms[p]->nrings; r++ )
-			{
-				currentCache->ringIndices[i] = createTree(mpoly->geoms[p]->rings[r]);
-				i++;
-			}
+			entry = &(currentCache->entries[i]);
+			break;
 		}
 	}
-	else if ( lwgeom->type == POLYGONTYPE )
+	if (! entry && currentCache->nentries < currentCache->maxentries)
+		entry = &(currentCache->entries[currentCache->nentries++]);
+	if (! entry)
+		entry = victimEntry(currentCache);
+	if (! entry)
 	{
-		POSTGIS_DEBUG(2, "populateCache POLYGON");
-		poly = (LWPOLY *)lwgeom;
-		currentCache->polyCount = 1;
-		currentCache->ringCounts = lwalloc(sizeof(int));
-		currentCache->ringCounts[0] = poly->nrings;
-		/*
-		** Just load the rings on in order
-		*/
-		currentCache->ringIndices = lwalloc(sizeof(RTREE_NODE *) * poly->nrings);
-		for ( i = 0; i < poly->nrings; i++ )
+		/* All the entries are in use by this call, reuse the oldest */
+		entry = &(currentCache->entries[0]);
+		for (i = 1; i < currentCache->nentries; i++)
 		{
-			currentCache->ringIndices[i] = createTree(poly->rings[i]);
+			if (currentCache->entries[i].last_used < entry->last_used)
+				entry = &(currentCache->entries[i]);
 		}
 	}
-	else
+	if (entry->size)
 	{
-		/* Uh oh, shouldn't be here. */
-		return;
+		POSTGIS_DEBUGF(3, "Cache full, dropping entry %p.", entry);
+		dropEntry(currentCache, entry);
 	}
 
-	/*
-	** Copy the serialized form of the polygon into the cache so
-	** we can test for equality against subsequent polygons.
-	*/
-	length = VARSIZE(serializedPoly);
-	currentCache->poly = lwalloc(length);
-	memcpy(currentCache->poly, serializedPoly, length);
-	POSTGIS_DEBUGF(3, "populateCache returning %p", currentCache);
+	entry->hash = hash;
+	entry->size = VARSIZE(serializedPoly);
+	entry->last_used = currentCache->clock;
+	return entry;
 }
 
 /**
@@ -478,46 +171,79 @@ void populateCache(RTREE_POLY_CACHE *currentCache, LWGEOM *lwgeom, GSERIALIZED *
  * it is applicable to the current polygon.
  * The memory context must be changed to function scope before calling this
  * method.	The method will allocate memory for the cache it creates,
- * as well as freeing the memory of any cache that is no longer applicable.
+ * as well as freeing the memory of any polygon it gives up.
+ * On return the index member of the cache holds the index of the polygon,
+ * if it has been built.
  */
-RTREE_POLY_CACHE *retrieveCache(LWGEOM *lwgeom, GSERIALIZED *serializedPoly, RTREE_POLY_CACHE *currentCache)
+RTREE_POLY_CACHE *retrieveCache(GSERIALIZED *serializedPoly, RTREE_POLY_CACHE *currentCache)
 {
+	RTREE_POLY_CACHE_ENTRY *entry = 0;
+	RTREE_POLY_CACHE_ENTRY *seen = 0;
+	uint32 hash;
 	int length;
+	int i;
 
-	POSTGIS_DEBUGF(2, "retrieveCache called with %p %p %p", lwgeom, serializedPoly, currentCache);
+	POSTGIS_DEBUGF(2, "retrieveCache called with %p %p", serializedPoly, currentCache);
 
 	assert ( ! currentCache || currentCache->type == 1 );
 
 	if (!currentCache)
 	{
 		POSTGIS_DEBUG(3, "No existing cache, create one.");
-		return createCache();
-	}
-	if (!(currentCache->poly))
-	{
-		POSTGIS_DEBUG(3, "Cache contains no polygon, populating it.");
-		populateCache(currentCache, lwgeom, serializedPoly);
-		return currentCache;
+		currentCache = createCache();
 	}
 
+	currentCache->clock++;
+	currentCache->index = 0;
+
+	hash = GeomCacheKeyHash(serializedPoly);
 	length = VARSIZE(serializedPoly);
+	for (i = 0; i < currentCache->nentries; i++)
+	{
+		RTREE_POLY_CACHE_ENTRY *e = &(currentCache->entries[i]);
+		if (e->hash != hash || e->size != (uint32) length)
+			continue;
+		if (! e->poly)
+			seen = e;
+		else if (! memcmp(serializedPoly, e->poly, length))
+		{
+			entry = e;
+			break;
+		}
+	}
 
-	if (VARSIZE(currentCache->poly) != length)
+	if (!entry && !seen)
 	{
-		POSTGIS_DEBUG(3, "Polygon size mismatch, creating new cache.");
-		clearCache(currentCache);
+		/*
+		** A new polygon. Remember its hash, but only pay for a
+		** copy and the index if it comes around again.
+		*/
+		POSTGIS_DEBUG(3, "Polygon miss, remembering it.");
+		setCacheKey(currentCache, serializedPoly, hash);
 		return currentCache;
 	}
-	if ( memcmp(serializedPoly, currentCache->poly, length) )
+
+	if (!entry)
 	{
-		POSTGIS_DEBUG(3, "Polygon mismatch, creating new cache.");
-		clearCache(currentCache);
-		return currentCache;
+		/*
+		** Same hash and size as a polygon seen once. Copy this one,
+		** as the indexes point into the copy, and index it.
+		*/
+		POSTGIS_DEBUG(3, "Polygon seen again, populating cache.");
+		entry = seen;
+		entry->poly = lwalloc(length);
+		memcpy(entry->poly, serializedPoly, length);
+		entry->last_used = currentCache->clock;
+		populateCache(entry);
+		currentCache->memory += entrySize(entry);
+		shrinkCache(currentCache);
+	}
+	else
+	{
+		POSTGIS_DEBUGF(3, "Polygon match, retaining cache entry, %p.", entry);
+		entry->last_used = currentCache->clock;
 	}
 
-	POSTGIS_DEBUGF(3, "Polygon match, retaining current cache, %p.",
-	                  currentCache);
-
+	currentCache->index = entry->index;
 	return currentCache;
 }
-
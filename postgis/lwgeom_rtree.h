@@ -2,70 +2,58 @@
 #define _LWGEOM_RTREE_H
 
 #include "liblwgeom.h"
-
-typedef struct
-{
-	double min;
-	double max;
-}
-INTERVAL;
-
-/* Returns 1 if min < value <= max, 0 otherwise */
-uint32 isContained(INTERVAL *interval, double value);
-/* Creates an interval given the min and max values, in whatever order. */
-INTERVAL *createInterval(double value1, double value2);
-/* Creates an interval with the total extents of the two given intervals. */
-INTERVAL *mergeIntervals(INTERVAL *inter1, INTERVAL *inter2);
+#include "lwitree.h"
 
 /*
- * The following struct and methods are used for a 1D RTree implementation,
- * described at:
+ * Point in polygon cache. The rings of the cached polygons are indexed
+ * with the packed 1D interval trees of liblwgeom (see lwitree.h), built
+ * on the same idea as the packed 1-dimensional R-tree described at:
  *  http://lin-ear-th-inking.blogspot.com/2007/06/packed-1-dimensional-r-tree.html
+ * Each entry holds one polygon: the trees reference the rings of lwgeom,
+ * which references the serialized copy in poly, so all three live and
+ * die together. A polygon seen once only leaves its hash and size, it
+ * is copied and indexed once it shows up a second time. Free entries
+ * have a size of 0.
  */
-typedef struct rtree_node
+typedef struct
 {
-	INTERVAL *interval;
-	struct rtree_node *leftNode;
-	struct rtree_node *rightNode;
-	LWLINE *segment;
+	uint32 hash;
+	uint32 size;
+	uint32 last_used;
+	ITREE *index;
+	LWGEOM *lwgeom;
+	GSERIALIZED *poly;
 }
-RTREE_NODE;
+RTREE_POLY_CACHE_ENTRY;
 
-/* Creates an interior node given the children. */
-RTREE_NODE *createInteriorNode(RTREE_NODE *left, RTREE_NODE *right);
-/* Creates a leaf node given the pointer to the start point of the segment. */
-RTREE_NODE *createLeafNode(POINTARRAY *pa, int startPoint);
 /*
- * Creates an rtree given a pointer to the point array.
- * Must copy the point array.
+ * Up to maxentries polygons, least recently used ones going first when
+ * the entries or the memory budget run out. index is the one of the
+ * polygon of the last retrieveCache() call, if it has been built.
  */
-RTREE_NODE *createTree(POINTARRAY *pointArray);
-/* Frees the tree. */
-void freeTree(RTREE_NODE *root);
-/* Retrieves a collection of line segments given the root and crossing value. */
-LWMLINE *findLineSegments(RTREE_NODE *root, double value);
-/* Merges two multilinestrings into a single multilinestring. */
-LWMLINE *mergeMultiLines(LWMLINE *line1, LWMLINE *line2);
-
 typedef struct
 {
 	char type;
-	RTREE_NODE **ringIndices;
-	int* ringCounts;
-	int polyCount;
-	GSERIALIZED *poly;
+	ITREE *index;
+	int nentries;
+	int maxentries;
+	size_t memory;
+	uint32 clock;
+	RTREE_POLY_CACHE_ENTRY *entries;
 }
 RTREE_POLY_CACHE;
 
 /*
  * Creates a new cachable index if needed, or returns the current cache if
- * it is applicable to the current polygon.
+ * it is applicable to the current polygon. The index is only built once
+ * the same polygon shows up twice.
  */
-RTREE_POLY_CACHE *retrieveCache(LWGEOM *lwgeom, GSERIALIZED *serializedPoly, RTREE_POLY_CACHE *currentCache);
+RTREE_POLY_CACHE *retrieveCache(GSERIALIZED *serializedPoly, RTREE_POLY_CACHE *currentCache);
 RTREE_POLY_CACHE *createCache(void);
-/* Frees the cache. */
-void populateCache(RTREE_POLY_CACHE *cache, LWGEOM *lwgeom, GSERIALIZED *serializedPoly);
-void clearCache(RTREE_POLY_CACHE *cache);
+/* Builds the ring indexes of a cached polygon. */
+void populateCache(RTREE_POLY_CACHE_ENTRY *entry);
+/* Frees a cached polygon, leaving its entry empty. */
+void clearCache(RTREE_POLY_CACHE_ENTRY *entry);
 
 
 
@@ -12,6 +12,8 @@
 
 #include "postgres.h"
 #include "fmgr.h"
+#include "commands/trigger.h"
+#include "utils/inval.h"
 
 #include "../postgis_config.h"
 #include "liblwgeom.h"
@@ -21,6 +23,7 @@
 Datum transform(PG_FUNCTION_ARGS);
 Datum transform_geom(PG_FUNCTION_ARGS);
 Datum postgis_proj_version(PG_FUNCTION_ARGS);
+Datum srs_cache_invalidate(PG_FUNCTION_ARGS);
 
 
 
@@ -191,6 +194,29 @@ Datum transform_geom(PG_FUNCTION_ARGS)
 }
 
 
+/**
+ * Statement trigger on spatial_ref_sys. Projections are cached for the
+ * life of each backend, so any change to the table has to reach all of
+ * them: invalidating the relcache entry of the table broadcasts a
+ * message at commit which every backend turns into a cache flush.
+ */
+PG_FUNCTION_INFO_V1(srs_cache_invalidate);
+Datum srs_cache_invalidate(PG_FUNCTION_ARGS)
+{
+	TriggerData *trigdata = (TriggerData *) fcinfo->context;
+
+	if (!CALLED_AS_TRIGGER(fcinfo))
+		elog(ERROR, "srs_cache_invalidate: not called by trigger manager");
+
+	CacheInvalidateRelcache(trigdata->tg_relation);
+
+	/* Do not wait for the end of the command in this backend */
+	InvalidatePROJ4Cache();
+
+	return PointerGetDatum(NULL);
+}
+
+
 PG_FUNCTION_INFO_V1(postgis_proj_version);
 Datum postgis_proj_version(PG_FUNCTION_ARGS)
 {
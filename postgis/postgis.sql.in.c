@@ -316,6 +316,91 @@ CREATE OPERATOR CLASS btree_geometry_ops
 	OPERATOR	5	> ,
 	FUNCTION	1	geometry_cmp (geom1 geometry, geom2 geometry);
 
+--
+-- Hilbert curve order, for spatial locality in sorts and btree indexes
+--
+
+-- Availability: 2.0.0
+CREATE OR REPLACE FUNCTION geometry_hilbert_lt(geom1 geometry, geom2 geometry)
+	RETURNS bool
+	AS 'MODULE_PATHNAME', 'lwgeom_hilbert_lt'
+	LANGUAGE 'C' IMMUTABLE STRICT;
+
+-- Availability: 2.0.0
+CREATE OR REPLACE FUNCTION geometry_hilbert_le(geom1 geometry, geom2 geometry)
+	RETURNS bool
+	AS 'MODULE_PATHNAME', 'lwgeom_hilbert_le'
+	LANGUAGE 'C' IMMUTABLE STRICT;
+
+-- Availability: 2.0.0
+CREATE OR REPLACE FUNCTION geometry_hilbert_gt(geom1 geometry, geom2 geometry)
+	RETURNS bool
+	AS 'MODULE_PATHNAME', 'lwgeom_hilbert_gt'
+	LANGUAGE 'C' IMMUTABLE STRICT;
+
+-- Availability: 2.0.0
+CREATE OR REPLACE FUNCTION geometry_hilbert_ge(geom1 geometry, geom2 geometry)
+	RETURNS bool
+	AS 'MODULE_PATHNAME', 'lwgeom_hilbert_ge'
+	LANGUAGE 'C' IMMUTABLE STRICT;
+
+-- Availability: 2.0.0
+CREATE OR REPLACE FUNCTION geometry_hilbert_eq(geom1 geometry, geom2 geometry)
+	RETURNS bool
+	AS 'MODULE_PATHNAME', 'lwgeom_hilbert_eq'
+	LANGUAGE 'C' IMMUTABLE STRICT;
+
+-- Availability: 2.0.0
+CREATE OR REPLACE FUNCTION geometry_hilbert_cmp(geom1 geometry, geom2 geometry)
+	RETURNS integer
+	AS 'MODULE_PATHNAME', 'lwgeom_hilbert_cmp'
+	LANGUAGE 'C' IMMUTABLE STRICT;
+
+-- Availability: 2.0.0
+CREATE OPERATOR #< (
+	LEFTARG = geometry, RIGHTARG = geometry, PROCEDURE = geometry_hilbert_lt,
+	COMMUTATOR = '#>', NEGATOR = '#>=',
+	RESTRICT = contsel, JOIN = contjoinsel
+);
+
+-- Availability: 2.0.0
+CREATE OPERATOR #<= (
+	LEFTARG = geometry, RIGHTARG = geometry, PROCEDURE = geometry_hilbert_le,
+	COMMUTATOR = '#>=', NEGATOR = '#>',
+	RESTRICT = contsel, JOIN = contjoinsel
+);
+
+-- Availability: 2.0.0
+CREATE OPERATOR #= (
+	LEFTARG = geometry, RIGHTARG = geometry, PROCEDURE = geometry_hilbert_eq,
+	COMMUTATOR = '#=',
+	RESTRICT = eqsel, JOIN = eqjoinsel
+);
+
+-- Availability: 2.0.0
+CREATE OPERATOR #>= (
+	LEFTARG = geometry, RIGHTARG = geometry, PROCEDURE = geometry_hilbert_ge,
+	COMMUTATOR = '#<=', NEGATOR = '#<',
+	RESTRICT = contsel, JOIN = contjoinsel
+);
+
+-- Availability: 2.0.0
+CREATE OPERATOR #> (
+	LEFTARG = geometry, RIGHTARG = geometry, PROCEDURE = geometry_hilbert_gt,
+	COMMUTATOR = '#<', NEGATOR = '#<=',
+	RESTRICT = contsel, JOIN = contjoinsel
+);
+
+-- Availability: 2.0.0
+CREATE OPERATOR CLASS btree_geometry_hilbert_ops
+	FOR TYPE geometry USING btree AS
+	OPERATOR	1	#< ,
+	OPERATOR	2	#<= ,
+	OPERATOR	3	#= ,
+	OPERATOR	4	#>= ,
+	OPERATOR	5	#> ,
+	FUNCTION	1	geometry_hilbert_cmp (geom1 geometry, geom2 geometry);
+
 
 -----------------------------------------------------------------------------
 -- GiST 2D GEOMETRY-over-GSERIALIZED INDEX
@@ -641,17 +726,25 @@ CREATE OR REPLACE FUNCTION geometry_gist_decompress_nd(internal)
 	AS 'MODULE_PATHNAME' ,'gserialized_gist_decompress'
 	LANGUAGE 'C';
 
+#if POSTGIS_PGSQL_VERSION >= 91
+-- Availability: 2.0.0
+CREATE OR REPLACE FUNCTION geometry_gist_distance_nd(internal,geometry,int4) 
+	RETURNS float8 
+	AS 'MODULE_PATHNAME' ,'gserialized_gist_distance'
+	LANGUAGE 'C';
+#endif
+
 -- Availability: 2.0.0
---CREATE OR REPLACE FUNCTION geometry_gist_selectivity_nd (internal, oid, internal, int4)
---	RETURNS float8
---	AS 'MODULE_PATHNAME', 'geometry_gist_selectivity_nd'
---	LANGUAGE 'C';
+CREATE OR REPLACE FUNCTION geometry_gist_sel_nd (internal, oid, internal, int4)
+	RETURNS float8
+	AS 'MODULE_PATHNAME', 'geometry_gist_sel_nd'
+	LANGUAGE 'C';
 
 -- Availability: 2.0.0
---CREATE OR REPLACE FUNCTION geography_gist_join_selectivity_nd(internal, oid, internal, smallint)
---	RETURNS float8
---	AS 'MODULE_PATHNAME', 'geometry_gist_join_selectivity_nd'
---	LANGUAGE 'C';
+CREATE OR REPLACE FUNCTION geometry_gist_joinsel_nd(internal, oid, internal, smallint)
+	RETURNS float8
+	AS 'MODULE_PATHNAME', 'geometry_gist_joinsel_nd'
+	LANGUAGE 'C';
 
 -- ---------- ---------- ---------- ---------- ---------- ---------- ----------
 -- N-D GEOMETRY Operators
@@ -667,10 +760,21 @@ CREATE OR REPLACE FUNCTION geometry_overlaps_nd(geometry, geometry)
 CREATE OPERATOR &&& (
 	LEFTARG = geometry, RIGHTARG = geometry, PROCEDURE = geometry_overlaps_nd,
 	COMMUTATOR = '&&&'
-	,RESTRICT = contsel, JOIN = contjoinsel
---	,RESTRICT = geometry_gist_selectivity_nd 
---	,JOIN = geometry_gist_join_selectivity_nd
+	,RESTRICT = geometry_gist_sel_nd, JOIN = geometry_gist_joinsel_nd
+);
+
+-- Availability: 2.0.0
+CREATE OR REPLACE FUNCTION geometry_distance_nd(geom1 geometry, geom2 geometry) 
+	RETURNS float8 
+	AS 'MODULE_PATHNAME' ,'gserialized_distance_nd'
+	LANGUAGE 'C' IMMUTABLE STRICT;
+
+#if POSTGIS_PGSQL_VERSION >= 91
+CREATE OPERATOR <<->> (
+    LEFTARG = geometry, RIGHTARG = geometry, PROCEDURE = geometry_distance_nd,
+    COMMUTATOR = '<<->>'
 );
+#endif
 
 -- Availability: 2.0.0
 CREATE OPERATOR CLASS gist_geometry_ops_nd
@@ -680,6 +784,10 @@ CREATE OPERATOR CLASS gist_geometry_ops_nd
 --	OPERATOR        6        ~=	,
 --	OPERATOR        7        ~	,
 --	OPERATOR        8        @	,
+#if POSTGIS_PGSQL_VERSION >= 91
+	OPERATOR        13       <<->> FOR ORDER BY pg_catalog.float_ops,
+	FUNCTION        8        geometry_gist_distance_nd (internal, geometry, int4),
+#endif
 	FUNCTION        1        geometry_gist_consistent_nd (internal, geometry, int4),
 	FUNCTION        2        geometry_gist_union_nd (bytea, internal),
 	FUNCTION        3        geometry_gist_compress_nd (internal),
@@ -1044,6 +1152,13 @@ CREATE OR REPLACE FUNCTION ST_Distance(geom1 geometry, geom2 geometry)
 	LANGUAGE 'C' IMMUTABLE STRICT
 	COST 100;
 
+-- Exact k nearest neighbours, the rows come back nearest first
+-- Availability: 2.0.0
+CREATE OR REPLACE FUNCTION ST_KNearest(tbl anyelement, geomcolumn text, geom geometry, k integer)
+	RETURNS SETOF anyelement
+	AS 'MODULE_PATHNAME', 'LWGEOM_knearest'
+	LANGUAGE 'C' STABLE;
+
 -- Availability: 1.2.2
 CREATE OR REPLACE FUNCTION ST_point_inside_circle(geometry,float8,float8,float8)
 	RETURNS bool
@@ -1486,6 +1601,17 @@ CREATE TABLE spatial_ref_sys (
 	 proj4text varchar(2048)
 );
 
+-- Projections are cached by each backend, flush them when the table changes
+-- Availability: 2.0.0
+CREATE OR REPLACE FUNCTION postgis_srs_cache_invalidate()
+	RETURNS trigger
+	AS 'MODULE_PATHNAME', 'srs_cache_invalidate'
+	LANGUAGE 'C';
+
+CREATE TRIGGER spatial_ref_sys_cache_invalidate
+	AFTER INSERT OR UPDATE OR DELETE OR TRUNCATE ON spatial_ref_sys
+	FOR EACH STATEMENT EXECUTE PROCEDURE postgis_srs_cache_invalidate();
+
 
 -----------------------------------------------------------------------
 -- POPULATE_GEOMETRY_COLUMNS()
@@ -2945,8 +3071,8 @@ CREATE AGGREGATE ST_MemUnion (
 
 --
 -- pgis_abs
--- Container type to hold the ArrayBuildState pointer as it passes through
--- the geometry array accumulation aggregate.
+-- Container type to hold the state pointer as it passes through
+-- the geometry accumulation aggregates.
 --
 CREATE OR REPLACE FUNCTION pgis_abs_in(cstring)
 	RETURNS pgis_abs
@@ -2971,6 +3097,24 @@ CREATE OR REPLACE FUNCTION pgis_geometry_accum_transfn(pgis_abs, geometry)
 	AS 'MODULE_PATHNAME'
 	LANGUAGE 'C';
 
+-- Availability: 2.0.0
+CREATE OR REPLACE FUNCTION pgis_geometry_union_transfn(pgis_abs, geometry)
+	RETURNS pgis_abs
+	AS 'MODULE_PATHNAME'
+	LANGUAGE 'C';
+
+-- Availability: 2.0.0
+CREATE OR REPLACE FUNCTION pgis_geometry_collect_transfn(pgis_abs, geometry)
+	RETURNS pgis_abs
+	AS 'MODULE_PATHNAME'
+	LANGUAGE 'C';
+
+-- Availability: 2.0.0
+CREATE OR REPLACE FUNCTION pgis_geometry_makeline_transfn(pgis_abs, geometry)
+	RETURNS pgis_abs
+	AS 'MODULE_PATHNAME'
+	LANGUAGE 'C';
+
 -- Availability: 1.4.0
 CREATE OR REPLACE FUNCTION pgis_geometry_accum_finalfn(pgis_abs)
 	RETURNS geometry[]
@@ -3018,7 +3162,7 @@ CREATE OR REPLACE FUNCTION ST_Union (geometry[])
 -- Availability: 1.2.2
 CREATE AGGREGATE ST_Union (
 	basetype = geometry,
-	sfunc = pgis_geometry_accum_transfn,
+	sfunc = pgis_geometry_union_transfn,
 	stype = pgis_abs,
 	finalfunc = pgis_geometry_union_finalfn
 	);
@@ -3026,7 +3170,7 @@ CREATE AGGREGATE ST_Union (
 -- Availability: 1.2.2
 CREATE AGGREGATE ST_Collect (
 	BASETYPE = geometry,
-	SFUNC = pgis_geometry_accum_transfn,
+	SFUNC = pgis_geometry_collect_transfn,
 	STYPE = pgis_abs,
 	FINALFUNC = pgis_geometry_collect_finalfn
 	);
@@ -3042,7 +3186,7 @@ CREATE AGGREGATE ST_Polygonize (
 -- Availability: 1.2.2
 CREATE AGGREGATE ST_MakeLine (
 	BASETYPE = geometry,
-	SFUNC = pgis_geometry_accum_transfn,
+	SFUNC = pgis_geometry_makeline_transfn,
 	STYPE = pgis_abs,
 	FINALFUNC = pgis_geometry_makeline_finalfn
 	);
@@ -3421,6 +3565,12 @@ CREATE OR REPLACE FUNCTION ST_GeoHash(geom geometry, maxchars int4 DEFAULT 0)
 		AS 'MODULE_PATHNAME', 'ST_GeoHash'
 	LANGUAGE 'C' IMMUTABLE STRICT;
 
+-- Availability: 2.0.0
+CREATE OR REPLACE FUNCTION ST_HilbertKey(geom geometry)
+	RETURNS bigint
+	AS 'MODULE_PATHNAME', 'gserialized_hilbert_key_2d'
+	LANGUAGE 'C' IMMUTABLE STRICT;
+
 ------------------------------------------------------------------------
 -- OGC defined
 ------------------------------------------------------------------------
@@ -18,6 +18,7 @@
 #include "../postgis_config.h"
 #include "lwgeom_log.h"
 #include "lwgeom_pg.h"
+#include "lwgeom_cache.h"
 
 /*
  * This is required for builds against pgsql
@@ -31,6 +32,38 @@ void _PG_init(void);
 void
 _PG_init(void)
 {
+  DefineCustomIntVariable(
+    "postgis.geometry_cache_size", /* name */
+    "Sets the number of geometries each function keeps prepared or indexed.", /* short_desc */
+    "Repeated arguments of the prepared predicates and of the point in polygon tests are cached, least recently used ones going first.", /* long_desc */
+    &postgis_geometry_cache_size, /* valueAddr */
+    128, /* bootValue */
+    1, 65536, /* min-max */
+    PGC_USERSET, /* GucContext context */
+    0, /* int flags */
+#if POSTGIS_PGSQL_VERSION >= 91
+    NULL, /* GucIntCheckHook check_hook */
+#endif
+    NULL, /* GucIntAssignHook assign_hook */
+    NULL  /* GucShowHook show_hook */
+   );
+
+  DefineCustomIntVariable(
+    "postgis.geometry_cache_memory", /* name */
+    "Sets the memory each function may use for prepared or indexed geometries.", /* short_desc */
+    NULL, /* long_desc */
+    &postgis_geometry_cache_memory, /* valueAddr */
+    8192, /* bootValue */
+    64, MAX_KILOBYTES, /* min-max */
+    PGC_USERSET, /* GucContext context */
+    GUC_UNIT_KB, /* int flags */
+#if POSTGIS_PGSQL_VERSION >= 91
+    NULL, /* GucIntCheckHook check_hook */
+#endif
+    NULL, /* GucIntAssignHook assign_hook */
+    NULL  /* GucShowHook show_hook */
+   );
+
 #if 0
   /* Define custom GUC variables. */
   DefineCustomIntVariable(
@@ -29,8 +29,27 @@
 #include "raster2pgsql.h"
 #include "gdal_vrt.h"
 #include "ogr_srs_api.h"
+#include "libpq-fe.h"
 #include <assert.h>
 
+#if HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+/* Server connection when loading directly (-L), NULL when writing to stdout */
+static PGconn *conn = NULL;
+
+/* Set while the server is taking the data of a COPY */
+static int conn_copy_in = 0;
+
+/* Only the binary COPY data is written to stdout (-B without -L) */
+static int copy_data_only = 0;
+
 /* This is needed by liblwgeom */
 void lwgeom_init_allocators(void) {
 	lwgeom_install_default_allocators();
@@ -77,6 +96,124 @@ void rt_init_allocators(void) {
 	);
 }
 
+/* Report a failed command on the server connection and stop */
+static void
+server_error(const char *what) {
+	fprintf(stderr, _("ERROR: %s: %s"), what, PQerrorMessage(conn));
+	PQfinish(conn);
+	exit(1);
+}
+
+/* Send a piece of COPY data to the server, or write it out */
+static void
+send_copy_data(const void *data, size_t length) {
+	if (conn == NULL) {
+		fwrite(data, 1, length, stdout);
+		return;
+	}
+
+	if (PQputCopyData(conn, (const char *) data, length) != 1)
+		server_error(_("Error sending COPY data"));
+}
+
+/* Finish the COPY in progress on the server */
+static void
+end_copy(void) {
+	PGresult *res;
+
+	if (PQputCopyEnd(conn, NULL) != 1)
+		server_error(_("Error ending COPY"));
+
+	res = PQgetResult(conn);
+	if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		server_error(_("Error loading COPY data"));
+	PQclear(res);
+
+	conn_copy_in = 0;
+}
+
+/*
+ * Output a line of the SQL script: print it, or run it on the server.
+ * After a COPY statement the server takes the lines as data, up to
+ * the end of data marker.
+ */
+static void
+send_line(const char *line) {
+	PGresult *res;
+
+	if (conn == NULL) {
+		if (!copy_data_only)
+			printf("%s\n", line);
+		return;
+	}
+
+	if (conn_copy_in) {
+		if (CSEQUAL(line, "\\.")) {
+			end_copy();
+		}
+		else {
+			send_copy_data(line, strlen(line));
+			send_copy_data("\n", 1);
+		}
+		return;
+	}
+
+	res = PQexec(conn, line);
+	switch (PQresultStatus(res)) {
+		case PGRES_COPY_IN:
+			conn_copy_in = 1;
+			break;
+		case PGRES_COMMAND_OK:
+		case PGRES_TUPLES_OK:
+		case PGRES_EMPTY_QUERY:
+			break;
+		default:
+			server_error(_("Error executing SQL"));
+	}
+	PQclear(res);
+}
+
+/* Binary COPY header: signature, flags and header extension length */
+static void
+copy_binary_header(void) {
+	static const char header[19] = "PGCOPY\n\377\r\n\0\0\0\0\0\0\0\0\0";
+
+	send_copy_data(header, 19);
+}
+
+/* Binary COPY trailer: a field count of -1 */
+static void
+copy_binary_trailer(void) {
+	send_copy_data("\377\377", 2);
+}
+
+/* Store an int32 in network byte order */
+static void
+copy_binary_int32(uint8_t *buf, uint32_t value) {
+	buf[0] = (value >> 24) & 0xff;
+	buf[1] = (value >> 16) & 0xff;
+	buf[2] = (value >> 8) & 0xff;
+	buf[3] = value & 0xff;
+}
+
+/* Binary COPY row of a raster in WKB and its filename, if not NULL */
+static void
+copy_binary_row(const uint8_t *wkb, uint32_t wkbsize, const char *filename) {
+	uint8_t buf[6];
+
+	buf[0] = 0;
+	buf[1] = (filename != NULL ? 2 : 1);
+	copy_binary_int32(buf + 2, wkbsize);
+	send_copy_data(buf, 6);
+	send_copy_data(wkb, wkbsize);
+
+	if (filename != NULL) {
+		copy_binary_int32(buf, strlen(filename));
+		send_copy_data(buf, 4);
+		send_copy_data(filename, strlen(filename));
+	}
+}
+
 static void
 raster_destroy(rt_raster raster) {
 	uint16_t i;
@@ -347,6 +484,11 @@ usage() {
 		"  -t <tile size> Cut raster into tiles to be inserted one per\n"
 		"      table row.  <tile size> is expressed as WIDTHxHEIGHT.\n"
 	));
+	printf(_(
+		"  -j <threads> Build the tiles on the given number of threads, each\n"
+		"      reading the raster through its own GDAL dataset.  Tiles are\n"
+		"      still output in order.\n"
+	));
 	printf(_(
 		"  -R  Register the raster as an out-of-db (filesystem) raster.  Provided\n"
 		"      raster should have absolute path to the file\n"
@@ -373,6 +515,15 @@ usage() {
 		"      the pattern o_<overview factor>_<table>.  Created overview is\n"
 		"      stored in the database and is not affected by -R.\n"
 	));
+	printf(_(
+		"  -O <resampling> Resampling method of overviews: nearest (default),\n"
+		"      average, gauss, cubic or mode.  Each overview is downsampled\n"
+		"      from the largest overview whose factor divides its own, or from\n"
+		"      the raster if there is none.  Overviews are written as\n"
+		"      uncompressed temporary GeoTIFF files in the directory set by the\n"
+		"      CPL_TMPDIR environment variable (default: current directory),\n"
+		"      which needs room for all the overviews of a raster at once.\n"
+	));
 	printf(_(
 		"  -q  Wrap PostgreSQL identifiers in quotes.\n"
 	));
@@ -421,6 +572,16 @@ usage() {
 	printf(_(
 		"  -Y  Use COPY statements instead of INSERT statements.\n"
 	));
+	printf(_(
+		"  -B  Use binary COPY, sending the rasters as raw WKB instead of hex\n"
+		"      encoded text.  Without -L only the COPY data is written, for a\n"
+		"      COPY ... FROM stdin WITH BINARY into an existing table, and\n"
+		"      -l is not available.\n"
+	));
+	printf(_(
+		"  -L <conninfo> Load directly into the database through the given\n"
+		"      libpq connection string instead of writing to stdout.\n"
+	));
 	printf(_(
 		"  -G  Print the supported GDAL raster formats.\n"
 	));
@@ -444,6 +605,38 @@ init_rastinfo(RASTERINFO *info) {
 	memset(info->tile_size, 0, sizeof(int) * 2);
 }
 
+static void
+init_pyramid(PYRAMID *pyramid) {
+	pyramid->overview_count = 0;
+	pyramid->nband_count = 0;
+	pyramid->band = NULL;
+	pyramid->file = NULL;
+}
+
+static void
+rtdealloc_pyramid(PYRAMID *pyramid) {
+	GDALDriverH hdrv = GDALGetDriverByName("GTiff");
+	int n = pyramid->overview_count * pyramid->nband_count;
+	int i = 0;
+
+	for (i = 0; i < n; i++) {
+		if (pyramid->band != NULL && pyramid->band[i] != NULL)
+			GDALClose(pyramid->band[i]);
+		if (pyramid->file != NULL && pyramid->file[i] != NULL) {
+			if (hdrv != NULL)
+				GDALDeleteDataset(hdrv, pyramid->file[i]);
+			rtdealloc(pyramid->file[i]);
+		}
+	}
+
+	if (pyramid->band != NULL)
+		rtdealloc(pyramid->band);
+	if (pyramid->file != NULL)
+		rtdealloc(pyramid->file);
+
+	init_pyramid(pyramid);
+}
+
 static void
 rtdealloc_rastinfo(RASTERINFO *info) {
 	if (info->srs != NULL)
@@ -618,6 +811,10 @@ init_config(RTLOADERCFG *config) {
 	config->version = 0;
 	config->transaction = 1;
 	config->copy_statements = 0;
+	config->copy_binary = 0;
+	config->threads = 1;
+	config->conninfo = NULL;
+	config->overview_resampling = NULL;
 }
 
 static void
@@ -654,6 +851,10 @@ rtdealloc_config(RTLOADERCFG *config) {
 		rtdealloc(config->tablespace);
 	if (config->idx_tablespace != NULL)
 		rtdealloc(config->idx_tablespace);
+	if (config->conninfo != NULL)
+		rtdealloc(config->conninfo);
+	if (config->overview_resampling != NULL)
+		rtdealloc(config->overview_resampling);
 
 	rtdealloc(config);
 }
@@ -686,7 +887,7 @@ dump_stringbuffer(STRINGBUFFER *buffer) {
 	int i = 0;
 
 	for (i = 0; i < buffer->length; i++) {
-		printf("%s\n", buffer->line[i]);
+		send_line(buffer->line[i]);
 	}
 }
 
@@ -893,7 +1094,7 @@ create_table(
 static int
 copy_from(
 	const char *schema, const char *table, const char *column,
-	const char *filename,
+	const char *filename, int binary,
 	STRINGBUFFER *buffer
 ) {
 	char *sql = NULL;
@@ -909,17 +1110,20 @@ copy_from(
 	len += strlen(column);
 	if (filename != NULL)
 		len += strlen(",\"filename\"");
+	if (binary)
+		len += strlen(" WITH BINARY");
 
 	sql = rtalloc(sizeof(char) * len);
 	if (sql == NULL) {
 		rterror(_("copy_from: Could not allocate memory for COPY statement"));
 		return 0;
 	}
-	sprintf(sql, "COPY %s%s (%s%s) FROM stdin;",
+	sprintf(sql, "COPY %s%s (%s%s) FROM stdin%s;",
 		(schema != NULL ? schema : ""),
 		table,
 		column,
-		(filename != NULL ? ",\"filename\"" : "")
+		(filename != NULL ? ",\"filename\"" : ""),
+		(binary ? " WITH BINARY" : "")
 	);
 
 	append_sql_to_buffer(buffer, sql);
@@ -1187,11 +1391,201 @@ add_overview_constraints(
 	return 1;
 }
 
+/* Serialize a tile: raw WKB for binary COPY, hex WKB otherwise */
+static uint8_t *
+serialize_tile(RTLOADERCFG *config, rt_raster rast, uint32_t *size) {
+	if (config->copy_binary)
+		return rt_raster_to_wkb(rast, size);
+
+	return (uint8_t *) rt_raster_to_hexwkb(rast, size);
+}
+
+/*
+ * Output a serialized tile of table: as a binary COPY row, or added to
+ * tileset, which is turned into statements once it gets too big
+ */
+static int
+add_tile(
+	int idx, RTLOADERCFG *config, const char *table,
+	uint8_t *tile, uint32_t size,
+	STRINGBUFFER *tileset, STRINGBUFFER *buffer
+) {
+	if (config->copy_binary) {
+		copy_binary_row(tile, size, (config->file_column ? config->rt_filename[idx] : NULL));
+		return 1;
+	}
+
+	/* add hexwkb to tileset */
+	append_stringbuffer(tileset, (char *) tile);
+
+	/* flush if tileset gets too big */
+	if (tileset->length > 10) {
+		if (!insert_records(
+			config->schema, table, config->raster_column,
+			(config->file_column ? config->rt_filename[idx] : NULL), config->copy_statements,
+			tileset, buffer
+		)) {
+			rterror(_("add_tile: Could not convert raster tiles into INSERT or COPY statements"));
+			return 0;
+		}
+
+		rtdealloc_stringbuffer(tileset, 0);
+	}
+
+	return 1;
+}
+
+/*
+ * Build every overview of raster idx.  Overviews are computed by
+ * increasing factor with the resampling method of config, each one
+ * downsampled from the overview of the largest factor dividing its own,
+ * so that the pixels averaged are aligned, or from the raster at full
+ * resolution if no such overview exists.  Each band of each overview is
+ * kept in an uncompressed temporary GeoTIFF, named by
+ * CPLGenerateTempFilename(), until the overviews are tiled.
+ */
 static int
-build_overview(int idx, RTLOADERCFG *config, RASTERINFO *info, int ovx, STRINGBUFFER *tileset, STRINGBUFFER *buffer) {
+build_pyramid(int idx, RTLOADERCFG *config, RASTERINFO *info, PYRAMID *pyramid) {
+	GDALDriverH hdrv;
 	GDALDatasetH hdsSrc;
-	VRTDatasetH hdsOv;
-	VRTSourcedRasterBandH hbandOv;
+	VRTDatasetH hdsVrt;
+	VRTSourcedRasterBandH hbandVrt;
+	GDALRasterBandH hbandPrev;
+	GDALRasterBandH hbandOv;
+	char *options[] = {"TILED=YES", NULL};
+	const char *resampling = (config->overview_resampling != NULL ? config->overview_resampling : "NEAREST");
+	const char *tmpfile = NULL;
+	int *order = NULL;
+	int dimOv[2] = {0};
+	int factor = 0;
+	int i = 0;
+	int j = 0;
+	int k = 0;
+	int n = 0;
+
+	hdrv = GDALGetDriverByName("GTiff");
+	if (hdrv == NULL) {
+		rterror(_("build_pyramid: Could not find the GTiff driver for storing overviews"));
+		return 0;
+	}
+
+	hdsSrc = GDALOpenShared(config->rt_file[idx], GA_ReadOnly);
+	if (hdsSrc == NULL) {
+		rterror(_("build_pyramid: Could not open raster: %s"), config->rt_file[idx]);
+		return 0;
+	}
+
+	n = config->overview_count * info->nband_count;
+	pyramid->band = rtalloc(sizeof(GDALDatasetH) * n);
+	pyramid->file = rtalloc(sizeof(char *) * n);
+	order = rtalloc(sizeof(int) * config->overview_count);
+	if (pyramid->band == NULL || pyramid->file == NULL || order == NULL) {
+		rterror(_("build_pyramid: Could not allocate memory for overviews"));
+		if (order != NULL) rtdealloc(order);
+		GDALClose(hdsSrc);
+		return 0;
+	}
+	memset(pyramid->band, 0, sizeof(GDALDatasetH) * n);
+	memset(pyramid->file, 0, sizeof(char *) * n);
+	pyramid->overview_count = config->overview_count;
+	pyramid->nband_count = info->nband_count;
+
+	/* overviews by increasing factor */
+	for (i = 0; i < config->overview_count; i++) {
+		for (k = i; k > 0 && config->overview[order[k - 1]] > config->overview[i]; k--)
+			order[k] = order[k - 1];
+		order[k] = i;
+	}
+
+	/* raster at full resolution, with the bands and nodata values of the tiles */
+	hdsVrt = VRTCreate(info->dim[0], info->dim[1]);
+	for (j = 0; j < info->nband_count; j++) {
+		GDALAddBand(hdsVrt, info->gdalbandtype[j], NULL);
+		hbandVrt = (VRTSourcedRasterBandH) GDALGetRasterBand(hdsVrt, j + 1);
+
+		if (info->hasnodata[j])
+			GDALSetRasterNoDataValue(hbandVrt, info->nodataval[j]);
+
+		VRTAddSimpleSource(
+			hbandVrt, GDALGetRasterBand(hdsSrc, info->nband[j]),
+			0, 0,
+			info->dim[0], info->dim[1],
+			0, 0,
+			info->dim[0], info->dim[1],
+			"near", VRT_NODATA_UNSET
+		);
+	}
+
+	/* make sure VRT reflects all changes */
+	VRTFlushCache(hdsVrt);
+
+	for (k = 0; k < config->overview_count; k++) {
+		factor = config->overview[order[k]];
+
+		dimOv[0] = (int) (info->dim[0] + (factor / 2)) / factor;
+		dimOv[1] = (int) (info->dim[1] + (factor / 2)) / factor;
+		if (dimOv[0] < 1) dimOv[0] = 1;
+		if (dimOv[1] < 1) dimOv[1] = 1;
+
+		for (j = 0; j < info->nband_count; j++) {
+			n = order[k] * info->nband_count + j;
+
+			tmpfile = CPLGenerateTempFilename("raster2pgsql");
+			pyramid->file[n] = rtalloc(sizeof(char) * (strlen(tmpfile) + 1));
+			if (pyramid->file[n] == NULL) {
+				rterror(_("build_pyramid: Could not allocate memory for overview file name"));
+				rtdealloc(order);
+				GDALClose(hdsVrt);
+				GDALClose(hdsSrc);
+				return 0;
+			}
+			strcpy(pyramid->file[n], tmpfile);
+
+			pyramid->band[n] = GDALCreate(hdrv, pyramid->file[n], dimOv[0], dimOv[1], 1, info->gdalbandtype[j], options);
+			if (pyramid->band[n] == NULL) {
+				rterror(_("build_pyramid: Could not create overview file: %s"), pyramid->file[n]);
+				rtdealloc(pyramid->file[n]);
+				pyramid->file[n] = NULL;
+				rtdealloc(order);
+				GDALClose(hdsVrt);
+				GDALClose(hdsSrc);
+				return 0;
+			}
+			hbandOv = GDALGetRasterBand(pyramid->band[n], 1);
+
+			/* so averaging the next overview skips nodata */
+			if (info->hasnodata[j])
+				GDALSetRasterNoDataValue(hbandOv, info->nodataval[j]);
+
+			/* downsample the overview of the largest factor dividing this one, or the raster */
+			hbandPrev = GDALGetRasterBand(hdsVrt, j + 1);
+			for (i = k - 1; i >= 0; i--) {
+				if (factor % config->overview[order[i]] == 0) {
+					hbandPrev = GDALGetRasterBand(pyramid->band[order[i] * info->nband_count + j], 1);
+					break;
+				}
+			}
+
+			if (GDALRegenerateOverviews(hbandPrev, 1, &hbandOv, resampling, GDALDummyProgress, NULL) != CE_None) {
+				rterror(_("build_pyramid: Could not build overview of factor %d for band %d"), factor, j + 1);
+				rtdealloc(order);
+				GDALClose(hdsVrt);
+				GDALClose(hdsSrc);
+				return 0;
+			}
+
+			GDALFlushCache(pyramid->band[n]);
+		}
+	}
+
+	rtdealloc(order);
+	GDALClose(hdsVrt);
+	GDALClose(hdsSrc);
+	return 1;
+}
+
+static int
+build_overview(int idx, RTLOADERCFG *config, RASTERINFO *info, int ovx, PYRAMID *pyramid, STRINGBUFFER *tileset, STRINGBUFFER *buffer) {
 	double gtOv[6] = {0.};
 	int dimOv[2] = {0};
 
@@ -1208,19 +1602,13 @@ build_overview(int idx, RTLOADERCFG *config, RASTERINFO *info, int ovx, STRINGBU
 	double gt[6] = {0.};
 
 	rt_raster rast = NULL;
-	char *hex;
-	uint32_t hexlen = 0;
-
-	hdsSrc = GDALOpenShared(config->rt_file[idx], GA_ReadOnly);
-	if (hdsSrc == NULL) {
-		rterror(_("build_overview: Could not open raster: %s"), config->rt_file[idx]);
-		return 0;
-	}
+	uint8_t *tile;
+	uint32_t tilelen = 0;
 
 	/* working copy of geotransform matrix */
 	memcpy(gtOv, info->gt, sizeof(double) * 6);
 
-	if (ovx >= config->overview_count) {
+	if (ovx >= config->overview_count || ovx >= pyramid->overview_count) {
 		rterror(_("build_overview: Invalid overview index: %d"), ovx);
 		return 0;
 	}
@@ -1233,43 +1621,13 @@ build_overview(int idx, RTLOADERCFG *config, RASTERINFO *info, int ovx, STRINGBU
 		return 0;
 	}
 
-	dimOv[0] = (int) (info->dim[0] + (factor / 2)) / factor;
-	dimOv[1] = (int) (info->dim[1] + (factor / 2)) / factor;
-
-	/* create VRT dataset */
-	hdsOv = VRTCreate(dimOv[0], dimOv[1]);
-	/*
-	GDALSetDescription(hdsOv, "/tmp/ov.vrt");
-	*/
-	GDALSetProjection(hdsOv, info->srs);
+	dimOv[0] = GDALGetRasterXSize(pyramid->band[ovx * pyramid->nband_count]);
+	dimOv[1] = GDALGetRasterYSize(pyramid->band[ovx * pyramid->nband_count]);
 
 	/* adjust scale */
 	gtOv[1] *= factor;
 	gtOv[5] *= factor;
 
-	GDALSetGeoTransform(hdsOv, gtOv);
-
-	/* add bands as simple sources */
-	for (j = 0; j < info->nband_count; j++) {
-		GDALAddBand(hdsOv, info->gdalbandtype[j], NULL);
-		hbandOv = (VRTSourcedRasterBandH) GDALGetRasterBand(hdsOv, j + 1);
-
-		if (info->hasnodata[j])
-			GDALSetRasterNoDataValue(hbandOv, info->nodataval[j]);
-
-		VRTAddSimpleSource(
-			hbandOv, GDALGetRasterBand(hdsSrc, info->nband[j]),
-			0, 0,
-			info->dim[0], info->dim[1],
-			0, 0,
-			dimOv[0], dimOv[1],
-			"near", VRT_NODATA_UNSET
-		);
-	}
-
-	/* make sure VRT reflects all changes */
-	VRTFlushCache(hdsOv);
-
 	/* decide on tile size */
 	if (!config->tile_size[0])
 		tile_size[0] = dimOv[0];
@@ -1325,7 +1683,7 @@ build_overview(int idx, RTLOADERCFG *config, RASTERINFO *info, int ovx, STRINGBU
 					GDALSetRasterNoDataValue(hbandDst, info->nodataval[j]);
 
 				VRTAddSimpleSource(
-					hbandDst, GDALGetRasterBand(hdsOv, j + 1),
+					hbandDst, GDALGetRasterBand(pyramid->band[ovx * pyramid->nband_count + j], 1),
 					xtile * tile_size[0], ytile * tile_size[1],
 					tile_size[0], tile_size[1],
 					0, 0,
@@ -1348,41 +1706,399 @@ build_overview(int idx, RTLOADERCFG *config, RASTERINFO *info, int ovx, STRINGBU
 			/* set srid if provided */
 			rt_raster_set_srid(rast, info->srid);
 
-			/* convert rt_raster to hexwkb */
-			hex = rt_raster_to_hexwkb(rast, &hexlen);
+			/* convert rt_raster to wkb */
+			tile = serialize_tile(config, rast, &tilelen);
 			raster_destroy(rast);
 
-			if (hex == NULL) {
-				rterror(_("build_overview: Could not convert PostGIS raster to hex WKB"));
+			if (tile == NULL) {
+				rterror(_("build_overview: Could not convert PostGIS raster to WKB"));
 				GDALClose(hdsDst);
 				return 0;
 			}
 
-			/* add hexwkb to tileset */
-			append_stringbuffer(tileset, hex);
-
-			rtdealloc(hex);
 			GDALClose(hdsDst);
 
-			/* flush if tileset gets too big */
-			if (tileset->length > 10) {
-				if (!insert_records(
-					config->schema, ovtable, config->raster_column,
-					(config->file_column ? config->rt_filename[idx] : NULL), config->copy_statements,
-					tileset, buffer
-				)) {
-					rterror(_("build_overview: Could not convert raster tiles into INSERT or COPY statements"));
-					GDALClose(hdsSrc);
-					return 0;
-				}
+			if (!add_tile(idx, config, ovtable, tile, tilelen, tileset, buffer)) {
+				rtdealloc(tile);
+				return 0;
+			}
+
+			rtdealloc(tile);
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * Build tile (xtile, ytile) of raster idx and return it serialized.
+ * In-db tiles are read from hdsSrc through a VRT with constraints set
+ * for just the data required for the tile, out-db tiles (hdsSrc NULL)
+ * only reference the file.
+ */
+static uint8_t *
+build_tile(
+	int idx, RTLOADERCFG *config, RASTERINFO *info,
+	GDALDatasetH hdsSrc, int xtile, int ytile,
+	uint32_t *size
+) {
+	double gt[6] = {0.};
+	rt_raster rast = NULL;
+	uint8_t *tile = NULL;
+	int i = 0;
+
+	memcpy(gt, info->gt, sizeof(double) * 6);
+
+	/* compute tile's upper-left corner */
+	GDALApplyGeoTransform(
+		info->gt,
+		xtile * info->tile_size[0], ytile * info->tile_size[1],
+		&(gt[0]), &(gt[3])
+	);
+
+	/* out-db raster */
+	if (hdsSrc == NULL) {
+		rt_band band = NULL;
+
+		/* create raster object */
+		rast = rt_raster_new(info->tile_size[0], info->tile_size[1]);
+		if (rast == NULL) {
+			rterror(_("build_tile: Could not create raster"));
+			return NULL;
+		}
 
-				rtdealloc_stringbuffer(tileset, 0);
+		/* set raster attributes */
+		rt_raster_set_srid(rast, info->srid);
+		rt_raster_set_geotransform_matrix(rast, gt);
+
+		/* add bands */
+		for (i = 0; i < info->nband_count; i++) {
+			band = rt_band_new_offline(
+				info->tile_size[0], info->tile_size[1],
+				info->bandtype[i],
+				info->hasnodata[i], info->nodataval[i],
+				info->nband[i] - 1,
+				config->rt_file[idx]
+			);
+			if (band == NULL) {
+				rterror(_("build_tile: Could not create offline band"));
+				raster_destroy(rast);
+				return NULL;
+			}
+
+			/* add band to raster */
+			if (rt_raster_add_band(rast, band, rt_raster_get_num_bands(rast)) == -1) {
+				rterror(_("build_tile: Could not add offlineband to raster"));
+				rt_band_destroy(band);
+				raster_destroy(rast);
+				return NULL;
 			}
 		}
 	}
+	/* in-db raster */
+	else {
+		VRTDatasetH hdsDst;
+		VRTSourcedRasterBandH hbandDst;
+
+		/* create VRT dataset */
+		hdsDst = VRTCreate(info->tile_size[0], info->tile_size[1]);
+		GDALSetProjection(hdsDst, info->srs);
+		GDALSetGeoTransform(hdsDst, gt);
+
+		/* add bands as simple sources */
+		for (i = 0; i < info->nband_count; i++) {
+			GDALAddBand(hdsDst, info->gdalbandtype[i], NULL);
+			hbandDst = (VRTSourcedRasterBandH) GDALGetRasterBand(hdsDst, i + 1);
+
+			if (info->hasnodata[i])
+				GDALSetRasterNoDataValue(hbandDst, info->nodataval[i]);
+
+			VRTAddSimpleSource(
+				hbandDst, GDALGetRasterBand(hdsSrc, info->nband[i]),
+				xtile * info->tile_size[0], ytile * info->tile_size[1],
+				info->tile_size[0], info->tile_size[1],
+				0, 0,
+				info->tile_size[0], info->tile_size[1],
+				"near", VRT_NODATA_UNSET
+			);
+		}
+
+		/* make sure VRT reflects all changes */
+		VRTFlushCache(hdsDst);
+
+		/* convert VRT dataset to rt_raster */
+		rast = rt_raster_from_gdal_dataset(hdsDst);
+		GDALClose(hdsDst);
+		if (rast == NULL) {
+			rterror(_("build_tile: Could not convert VRT dataset to PostGIS raster"));
+			return NULL;
+		}
+
+		/* set srid if provided */
+		rt_raster_set_srid(rast, info->srid);
+	}
+
+	/* convert rt_raster to wkb */
+	tile = serialize_tile(config, rast, size);
+	raster_destroy(rast);
+
+	if (tile == NULL) {
+		rterror(_("build_tile: Could not convert PostGIS raster to WKB"));
+		return NULL;
+	}
+
+	return tile;
+}
+
+#if HAVE_PTHREAD
+
+/* Tiles in flight per thread, so the threads keep busy while the output catches up */
+#define TILES_PER_THREAD 4
+
+typedef struct {
+	/* index of the tile being built in the slot, -1 if the slot is free */
+	int tile;
+	int done;
+
+	uint8_t *data;
+	uint32_t size;
+} TILESLOT;
+
+typedef struct {
+	int idx;
+	RTLOADERCFG *config;
+	RASTERINFO *info;
+	int ntiles[2];
+
+	/* everything below is protected by lock */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	/* next tile to build */
+	int next;
+
+	/* tile t goes to slot t modulo nslots */
+	int nslots;
+	TILESLOT *slots;
+
+	/* set to make every thread stop as soon as possible */
+	int abort;
+} TILER;
+
+/*
+ * Tiler thread: build the tiles in order, as slots become free. Each
+ * thread reads the raster through its own GDAL dataset.
+ */
+static void *
+tiler_thread(void *arg) {
+	TILER *tiler = (TILER *) arg;
+	GDALDatasetH hdsSrc = NULL;
+	int ntiles = tiler->ntiles[0] * tiler->ntiles[1];
+	TILESLOT *slot = NULL;
+	uint8_t *data = NULL;
+	uint32_t size = 0;
+	int t = 0;
+
+	if (!tiler->config->outdb) {
+		hdsSrc = GDALOpen(tiler->config->rt_file[tiler->idx], GA_ReadOnly);
+		if (hdsSrc == NULL) {
+			rterror(_("tiler_thread: Could not open raster: %s"), tiler->config->rt_file[tiler->idx]);
+
+			pthread_mutex_lock(&tiler->lock);
+			tiler->abort = 1;
+			pthread_cond_broadcast(&tiler->cond);
+			pthread_mutex_unlock(&tiler->lock);
+			return NULL;
+		}
+	}
+
+	while (1) {
+		pthread_mutex_lock(&tiler->lock);
+		while (
+			!tiler->abort &&
+			tiler->next < ntiles &&
+			tiler->slots[tiler->next % tiler->nslots].tile != -1
+		) {
+			pthread_cond_wait(&tiler->cond, &tiler->lock);
+		}
+		if (tiler->abort || tiler->next >= ntiles) {
+			pthread_mutex_unlock(&tiler->lock);
+			break;
+		}
+
+		t = tiler->next++;
+		slot = &(tiler->slots[t % tiler->nslots]);
+		slot->tile = t;
+		slot->done = 0;
+		pthread_mutex_unlock(&tiler->lock);
+
+		data = build_tile(
+			tiler->idx, tiler->config, tiler->info,
+			hdsSrc, t % tiler->ntiles[0], t / tiler->ntiles[0],
+			&size
+		);
+
+		pthread_mutex_lock(&tiler->lock);
+		slot->data = data;
+		slot->size = size;
+		slot->done = 1;
+		if (data == NULL)
+			tiler->abort = 1;
+		pthread_cond_broadcast(&tiler->cond);
+		pthread_mutex_unlock(&tiler->lock);
+	}
+
+	if (hdsSrc != NULL)
+		GDALClose(hdsSrc);
+
+	return NULL;
+}
+
+/*
+ * Build the tiles on config->threads threads and output them in order.
+ * Returns -1 if no thread could be started.
+ */
+static int
+tile_raster_threaded(
+	int idx, RTLOADERCFG *config, RASTERINFO *info,
+	int *ntiles,
+	STRINGBUFFER *tileset, STRINGBUFFER *buffer
+) {
+	TILER tiler;
+	TILESLOT *slot = NULL;
+	pthread_t *threads = NULL;
+	int nthreads = 0;
+	uint8_t *data = NULL;
+	uint32_t size = 0;
+	int rtn = 1;
+	int i = 0;
+	int t = 0;
+
+	memset(&tiler, 0, sizeof(TILER));
+	tiler.idx = idx;
+	tiler.config = config;
+	tiler.info = info;
+	tiler.ntiles[0] = ntiles[0];
+	tiler.ntiles[1] = ntiles[1];
+
+	threads = rtalloc(sizeof(pthread_t) * config->threads);
+	tiler.nslots = config->threads * TILES_PER_THREAD;
+	tiler.slots = rtalloc(sizeof(TILESLOT) * tiler.nslots);
+	if (threads == NULL || tiler.slots == NULL) {
+		rterror(_("tile_raster_threaded: Could not allocate memory for tiler threads"));
+		if (threads != NULL) rtdealloc(threads);
+		if (tiler.slots != NULL) rtdealloc(tiler.slots);
+		return 0;
+	}
+	for (i = 0; i < tiler.nslots; i++) {
+		tiler.slots[i].tile = -1;
+		tiler.slots[i].done = 0;
+		tiler.slots[i].data = NULL;
+		tiler.slots[i].size = 0;
+	}
+
+	pthread_mutex_init(&tiler.lock, NULL);
+	pthread_cond_init(&tiler.cond, NULL);
+
+	for (nthreads = 0; nthreads < config->threads; nthreads++) {
+		if (pthread_create(&(threads[nthreads]), NULL, tiler_thread, &tiler) != 0)
+			break;
+	}
+
+	if (!nthreads)
+		rtn = -1;
+
+	/* output the tiles as they come */
+	for (t = 0; rtn == 1 && t < ntiles[0] * ntiles[1]; t++) {
+		slot = &(tiler.slots[t % tiler.nslots]);
+
+		pthread_mutex_lock(&tiler.lock);
+		while (!(slot->tile == t && slot->done) && !tiler.abort)
+			pthread_cond_wait(&tiler.cond, &tiler.lock);
+
+		data = NULL;
+		if (slot->tile == t && slot->done) {
+			data = slot->data;
+			size = slot->size;
+			slot->data = NULL;
+			slot->tile = -1;
+			pthread_cond_broadcast(&tiler.cond);
+		}
+		pthread_mutex_unlock(&tiler.lock);
+
+		/* the threads already reported what went wrong */
+		if (data == NULL) {
+			rtn = 0;
+			break;
+		}
+
+		if (!add_tile(idx, config, config->table, data, size, tileset, buffer))
+			rtn = 0;
+		rtdealloc(data);
+	}
+
+	/* stop the threads, they may still be working on tiles after an error */
+	pthread_mutex_lock(&tiler.lock);
+	tiler.abort = 1;
+	pthread_cond_broadcast(&tiler.cond);
+	pthread_mutex_unlock(&tiler.lock);
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	for (i = 0; i < tiler.nslots; i++) {
+		if (tiler.slots[i].data != NULL)
+			rtdealloc(tiler.slots[i].data);
+	}
+
+	pthread_cond_destroy(&tiler.cond);
+	pthread_mutex_destroy(&tiler.lock);
+
+	rtdealloc(tiler.slots);
+	rtdealloc(threads);
+
+	return rtn;
+}
+
+#endif
+
+/* Build and output the tiles of raster idx */
+static int
+tile_raster(
+	int idx, RTLOADERCFG *config, RASTERINFO *info,
+	GDALDatasetH hdsSrc, int *ntiles,
+	STRINGBUFFER *tileset, STRINGBUFFER *buffer
+) {
+	uint8_t *tile = NULL;
+	uint32_t tilelen = 0;
+	int xtile = 0;
+	int ytile = 0;
+
+#if HAVE_PTHREAD
+	if (config->threads > 1 && ntiles[0] * ntiles[1] > 1) {
+		int rtn = tile_raster_threaded(idx, config, info, ntiles, tileset, buffer);
+
+		/* no threads after all, carry on without them */
+		if (rtn != -1)
+			return rtn;
+	}
+#endif
+
+	for (ytile = 0; ytile < ntiles[1]; ytile++) {
+		for (xtile = 0; xtile < ntiles[0]; xtile++) {
+			tile = build_tile(idx, config, info, hdsSrc, xtile, ytile, &tilelen);
+			if (tile == NULL)
+				return 0;
+
+			if (!add_tile(idx, config, config->table, tile, tilelen, tileset, buffer)) {
+				rtdealloc(tile);
+				return 0;
+			}
+
+			rtdealloc(tile);
+		}
+	}
 
-	GDALClose(hdsOv);
-	GDALClose(hdsSrc);
 	return 1;
 }
 
@@ -1393,15 +2109,8 @@ convert_raster(int idx, RTLOADERCFG *config, RASTERINFO *info, STRINGBUFFER *til
 	int nband = 0;
 	int i = 0;
 	int ntiles[2] = {1, 1};
-	int xtile = 0;
-	int ytile = 0;
-	double gt[6] = {0.};
 	const char* pszProjectionRef = NULL;
 
-	rt_raster rast = NULL;
-	char *hex;
-	uint32_t hexlen = 0;
-
 	info->srid = config->srid;
 
 	hdsSrc = GDALOpenShared(config->rt_file[idx], GA_ReadOnly);
@@ -1464,7 +2173,6 @@ convert_raster(int idx, RTLOADERCFG *config, RASTERINFO *info, STRINGBUFFER *til
 		info->gt[4] = 0;
 		info->gt[5] = -1;
 	}
-	memcpy(gt, info->gt, sizeof(double) * 6);
 
 	/* record # of bands */
 	/* user-specified bands */
@@ -1574,182 +2282,20 @@ convert_raster(int idx, RTLOADERCFG *config, RASTERINFO *info, STRINGBUFFER *til
 		}
 	}
 
-	/* out-db raster */
+	/* out-db raster, the tiles only reference the file */
 	if (config->outdb) {
-		rt_band band = NULL;
-
 		GDALClose(hdsSrc);
-
-		/* each tile is a raster */
-		for (ytile = 0; ytile < ntiles[1]; ytile++) {
-			for (xtile = 0; xtile < ntiles[0]; xtile++) {
-				
-				/* compute tile's upper-left corner */
-				GDALApplyGeoTransform(
-					info->gt,
-					xtile * info->tile_size[0], ytile * info->tile_size[1],
-					&(gt[0]), &(gt[3])
-				);
-
-				/* create raster object */
-				rast = rt_raster_new(info->tile_size[0], info->tile_size[1]);
-				if (rast == NULL) {
-					rterror(_("convert_raster: Could not create raster"));
-					return 0;
-				}
-
-				/* set raster attributes */
-				rt_raster_set_srid(rast, info->srid);
-				rt_raster_set_geotransform_matrix(rast, gt);
-
-				/* add bands */
-				for (i = 0; i < info->nband_count; i++) {
-					band = rt_band_new_offline(
-						info->tile_size[0], info->tile_size[1],
-						info->bandtype[i],
-						info->hasnodata[i], info->nodataval[i],
-						info->nband[i] - 1,
-						config->rt_file[idx]
-					);
-					if (band == NULL) {
-						rterror(_("convert_raster: Could not create offline band"));
-						raster_destroy(rast);
-						return 0;
-					}
-
-					/* add band to raster */
-					if (rt_raster_add_band(rast, band, rt_raster_get_num_bands(rast)) == -1) {
-						rterror(_("convert_raster: Could not add offlineband to raster"));
-						rt_band_destroy(band);
-						raster_destroy(rast);
-						return 0;
-					}
-				}
-
-				/* convert rt_raster to hexwkb */
-				hex = rt_raster_to_hexwkb(rast, &hexlen);
-				raster_destroy(rast);
-
-				if (hex == NULL) {
-					rterror(_("convert_raster: Could not convert PostGIS raster to hex WKB"));
-					return 0;
-				}
-
-				/* add hexwkb to tileset */
-				append_stringbuffer(tileset, hex);
-
-				rtdealloc(hex);
-
-				/* flush if tileset gets too big */
-				if (tileset->length > 10) {
-					if (!insert_records(
-						config->schema, config->table, config->raster_column,
-						(config->file_column ? config->rt_filename[idx] : NULL), config->copy_statements,
-						tileset, buffer
-					)) {
-						rterror(_("convert_raster: Could not convert raster tiles into INSERT or COPY statements"));
-						return 0;
-					}
-
-					rtdealloc_stringbuffer(tileset, 0);
-				}
-			}
-		}
+		hdsSrc = NULL;
 	}
-	/* in-db raster */
-	else {
-		VRTDatasetH hdsDst;
-		VRTSourcedRasterBandH hbandDst;
-
-		/* each tile is a VRT with constraints set for just the data required for the tile */
-		for (ytile = 0; ytile < ntiles[1]; ytile++) {
-			for (xtile = 0; xtile < ntiles[0]; xtile++) {
-
-				/* compute tile's upper-left corner */
-				GDALApplyGeoTransform(
-					info->gt,
-					xtile * info->tile_size[0], ytile * info->tile_size[1],
-					&(gt[0]), &(gt[3])
-				);
-				/*
-				rtinfo(_("tile (%d, %d) gt = (%f, %f, %f, %f, %f, %f)"),
-					xtile, ytile,
-					gt[0], gt[1], gt[2], gt[3], gt[4], gt[5]
-				);
-				*/
-
-				/* create VRT dataset */
-				hdsDst = VRTCreate(info->tile_size[0], info->tile_size[1]);
-				GDALSetProjection(hdsDst, info->srs);
-				GDALSetGeoTransform(hdsDst, gt);
-
-				/* add bands as simple sources */
-				for (i = 0; i < info->nband_count; i++) {
-					GDALAddBand(hdsDst, info->gdalbandtype[i], NULL);
-					hbandDst = (VRTSourcedRasterBandH) GDALGetRasterBand(hdsDst, i + 1);
-
-					if (info->hasnodata[i])
-						GDALSetRasterNoDataValue(hbandDst, info->nodataval[i]);
-
-					VRTAddSimpleSource(
-						hbandDst, GDALGetRasterBand(hdsSrc, info->nband[i]),
-						xtile * info->tile_size[0], ytile * info->tile_size[1],
-						info->tile_size[0], info->tile_size[1],
-						0, 0,
-						info->tile_size[0], info->tile_size[1],
-						"near", VRT_NODATA_UNSET
-					);
-				}
-
-				/* make sure VRT reflects all changes */
-				VRTFlushCache(hdsDst);
-
-				/* convert VRT dataset to rt_raster */
-				rast = rt_raster_from_gdal_dataset(hdsDst);
-				if (rast == NULL) {
-					rterror(_("convert_raster: Could not convert VRT dataset to PostGIS raster"));
-					GDALClose(hdsDst);
-					return 0;
-				}
-
-				/* set srid if provided */
-				rt_raster_set_srid(rast, info->srid);
 
-				/* convert rt_raster to hexwkb */
-				hex = rt_raster_to_hexwkb(rast, &hexlen);
-				raster_destroy(rast);
-
-				if (hex == NULL) {
-					rterror(_("convert_raster: Could not convert PostGIS raster to hex WKB"));
-					GDALClose(hdsDst);
-					return 0;
-				}
-
-				/* add hexwkb to tileset */
-				append_stringbuffer(tileset, hex);
-
-				rtdealloc(hex);
-				GDALClose(hdsDst);
-
-				/* flush if tileset gets too big */
-				if (tileset->length > 10) {
-					if (!insert_records(
-						config->schema, config->table, config->raster_column,
-						(config->file_column ? config->rt_filename[idx] : NULL), config->copy_statements,
-						tileset, buffer
-					)) {
-						rterror(_("convert_raster: Could not convert raster tiles into INSERT or COPY statements"));
-						GDALClose(hdsSrc);
-						return 0;
-					}
-
-					rtdealloc_stringbuffer(tileset, 0);
-				}
-			}
-		}
+	if (!tile_raster(idx, config, info, hdsSrc, ntiles, tileset, buffer)) {
+		if (hdsSrc != NULL)
+			GDALClose(hdsSrc);
+		return 0;
+	}
 
+	if (hdsSrc != NULL)
 		GDALClose(hdsSrc);
-	}
 
 	return 1;
 }
@@ -1833,7 +2379,7 @@ process_rasters(RTLOADERCFG *config, STRINGBUFFER *buffer) {
 
 			if (config->copy_statements && !copy_from(
 				config->schema, config->table, config->raster_column,
-				(config->file_column ? config->rt_filename[i] : NULL),
+				(config->file_column ? config->rt_filename[i] : NULL), config->copy_binary,
 				buffer
 			)) {
 				rterror(_("process_rasters: Could not add COPY statement to string buffer"));
@@ -1842,6 +2388,15 @@ process_rasters(RTLOADERCFG *config, STRINGBUFFER *buffer) {
 				return 0;
 			}
 
+			/* binary rows go out as they come, after the COPY statement */
+			if (config->copy_binary) {
+				flush_stringbuffer(buffer);
+
+				/* without a connection all the rasters share one stream */
+				if (conn != NULL || i == 0)
+					copy_binary_header();
+			}
+
 			/* convert raster */
 			if (!convert_raster(i, config, &rastinfo, &tileset, buffer)) {
 				rterror(_("process_rasters: Could not process raster: %s"), config->rt_file[i]);
@@ -1864,6 +2419,9 @@ process_rasters(RTLOADERCFG *config, STRINGBUFFER *buffer) {
 
 			rtdealloc_stringbuffer(&tileset, 0);
 
+			if (config->copy_binary && (conn != NULL || i == config->rt_file_count - 1))
+				copy_binary_trailer();
+
 			if (config->copy_statements && !copy_from_end(buffer)) {
 				rterror(_("process_rasters: Could not add COPY end statement to string buffer"));
 				rtdealloc_rastinfo(&rastinfo);
@@ -1875,23 +2433,42 @@ process_rasters(RTLOADERCFG *config, STRINGBUFFER *buffer) {
 
 			/* overviews */
 			if (config->overview_count) {
+				PYRAMID pyramid;
 				int j = 0;
 
+				init_pyramid(&pyramid);
+
+				/* all the overviews are built before any is tiled */
+				if (!build_pyramid(i, config, &rastinfo, &pyramid)) {
+					rterror(_("process_rasters: Could not create overviews for raster %s"), config->rt_file[i]);
+					rtdealloc_pyramid(&pyramid);
+					rtdealloc_rastinfo(&rastinfo);
+					return 0;
+				}
+
 				for (j = 0; j < config->overview_count; j++) {
 
 					if (config->copy_statements && !copy_from(
 							config->schema, config->overview_table[j], config->raster_column,
-							(config->file_column ? config->rt_filename[i] : NULL),
+							(config->file_column ? config->rt_filename[i] : NULL), config->copy_binary,
 							buffer
 					)) {
 						rterror(_("process_rasters: Could not add COPY statement to string buffer"));
+						rtdealloc_pyramid(&pyramid);
 						rtdealloc_rastinfo(&rastinfo);
 						rtdealloc_stringbuffer(&tileset, 0);
 						return 0;
 					}
 
-					if (!build_overview(i, config, &rastinfo, j, &tileset, buffer)) {
+					/* overviews with binary COPY are only built when loading directly */
+					if (config->copy_binary) {
+						flush_stringbuffer(buffer);
+						copy_binary_header();
+					}
+
+					if (!build_overview(i, config, &rastinfo, j, &pyramid, &tileset, buffer)) {
 						rterror(_("process_rasters: Could not create overview of factor %d for raster %s"), config->overview[j], config->rt_file[i]);
+						rtdealloc_pyramid(&pyramid);
 						rtdealloc_rastinfo(&rastinfo);
 						rtdealloc_stringbuffer(&tileset, 0);
 						return 0;
@@ -1903,6 +2480,7 @@ process_rasters(RTLOADERCFG *config, STRINGBUFFER *buffer) {
 						&tileset, buffer
 					)) {
 						rterror(_("process_rasters: Could not convert overview tiles into INSERT or COPY statements"));
+						rtdealloc_pyramid(&pyramid);
 						rtdealloc_rastinfo(&rastinfo);
 						rtdealloc_stringbuffer(&tileset, 0);
 						return 0;
@@ -1913,14 +2491,20 @@ process_rasters(RTLOADERCFG *config, STRINGBUFFER *buffer) {
 					/* flush buffer after every raster */
 					flush_stringbuffer(buffer);
 
+					if (config->copy_binary)
+						copy_binary_trailer();
+
 					if (config->copy_statements) {
 						if (!copy_from_end(buffer)) {
 							rterror(_("process_rasters: Could not add COPY end statement to string buffer"));
+							rtdealloc_pyramid(&pyramid);
 							rtdealloc_rastinfo(&rastinfo);
 							return 0;
 						}
 					}
 				}
+
+				rtdealloc_pyramid(&pyramid);
 			}
 
 			if (config->rt_file_count > 1) {
@@ -2222,6 +2806,15 @@ main(int argc, char **argv) {
 			}
 
 		}
+		/* tiler threads */
+		else if (CSEQUAL(argv[i], "-j") && i < argc - 1) {
+			config->threads = atoi(argv[++i]);
+			if (config->threads < 1) {
+				rterror(_("Number of threads must be greater than 0"));
+				rtdealloc_config(config);
+				exit(1);
+			}
+		}
 		/* out-of-db raster */
 		else if (CSEQUAL(argv[i], "-R")) {
 			config->outdb = 1;
@@ -2290,6 +2883,33 @@ main(int argc, char **argv) {
 				}
 			}
 		}
+		/* overview resampling */
+		else if (CSEQUAL(argv[i], "-O") && i < argc - 1) {
+			const char *methods[] = {"NEAREST", "AVERAGE", "GAUSS", "CUBIC", "MODE"};
+
+			if (config->overview_resampling != NULL)
+				rtdealloc(config->overview_resampling);
+			config->overview_resampling = rtalloc(sizeof(char) * (strlen(argv[++i]) + 1));
+			if (config->overview_resampling == NULL) {
+				rterror(_("Could not allocate memory for storing overview resampling method"));
+				rtdealloc_config(config);
+				exit(1);
+			}
+			strcpy(config->overview_resampling, argv[i]);
+
+			for (j = 0; config->overview_resampling[j] != '\0'; j++)
+				config->overview_resampling[j] = toupper(config->overview_resampling[j]);
+
+			for (j = 0; j < (int) (sizeof(methods) / sizeof(methods[0])); j++) {
+				if (CSEQUAL(config->overview_resampling, methods[j]))
+					break;
+			}
+			if (j == (int) (sizeof(methods) / sizeof(methods[0]))) {
+				rterror(_("Unknown overview resampling method: %s"), argv[i]);
+				rtdealloc_config(config);
+				exit(1);
+			}
+		}
 		/* quote identifiers */
 		else if (CSEQUAL(argv[i], "-q")) {
 			config->quoteident = 1;
@@ -2357,6 +2977,21 @@ main(int argc, char **argv) {
 		else if (CSEQUAL(argv[i], "-Y")) {
 			config->copy_statements = 1;
 		}
+		/* binary COPY */
+		else if (CSEQUAL(argv[i], "-B")) {
+			config->copy_statements = 1;
+			config->copy_binary = 1;
+		}
+		/* load directly into the database */
+		else if (CSEQUAL(argv[i], "-L") && i < argc - 1) {
+			config->conninfo = rtalloc(sizeof(char) * (strlen(argv[++i]) + 1));
+			if (config->conninfo == NULL) {
+				rterror(_("Could not allocate memory for storing connection string"));
+				rtdealloc_config(config);
+				exit(1);
+			}
+			strncpy(config->conninfo, argv[i], strlen(argv[i]) + 1);
+		}
 		/* GDAL formats */
 		else if (CSEQUAL(argv[i], "-G")) {
 			uint32_t drv_count = 0;
@@ -2410,6 +3045,13 @@ main(int argc, char **argv) {
 		rtdealloc_config(config);
 		exit(1);
 	}
+
+	/* binary COPY to stdout can only feed a single table */
+	if (config->copy_binary && config->conninfo == NULL && config->overview_count) {
+		rterror(_("Overviews (-l) cannot be built with binary COPY (-B) unless loading directly (-L)"));
+		rtdealloc_config(config);
+		exit(1);
+	}
 	/* at least two files, see if last is table */
 	else if (config->rt_file_count > 1) {
 		fp = fopen(config->rt_file[config->rt_file_count - 1], "rb");
@@ -2741,16 +3383,39 @@ main(int argc, char **argv) {
 	}
 	init_stringbuffer(buffer);
 
+	/* output to the database or stdout */
+	if (config->conninfo != NULL) {
+		conn = PQconnectdb(config->conninfo);
+		if (PQstatus(conn) != CONNECTION_OK) {
+			rterror(_("Could not connect to database: %s"), PQerrorMessage(conn));
+			PQfinish(conn);
+			rtdealloc_stringbuffer(buffer, 1);
+			rtdealloc_config(config);
+			exit(1);
+		}
+	}
+	else if (config->copy_binary) {
+		copy_data_only = 1;
+#ifdef _WIN32
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+	}
+
 	/* pass off to processing function */
 	if (!process_rasters(config, buffer)) {
 		rterror(_("Unable to process rasters"));
 		rtdealloc_stringbuffer(buffer, 1);
 		rtdealloc_config(config);
+		if (conn != NULL)
+			PQfinish(conn);
 		exit(1);
 	}
 
 	flush_stringbuffer(buffer);
 
+	if (conn != NULL)
+		PQfinish(conn);
+
 	rtdealloc_stringbuffer(buffer, 1);
 	rtdealloc_config(config);
 
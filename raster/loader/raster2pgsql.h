@@ -138,6 +138,18 @@ typedef struct raster_loader_config {
 	/* use COPY instead of INSERT */
 	int copy_statements;
 
+	/* use binary COPY, 1 = yes, 0 = no (default) */
+	int copy_binary;
+
+	/* number of threads building the tiles, 1 = no threads (default) */
+	int threads;
+
+	/* connection string to load directly into the database, NULL = write to stdout (default) */
+	char *conninfo;
+
+	/* GDAL resampling method of overviews, NULL = NEAREST (default) */
+	char *overview_resampling;
+
 } RTLOADERCFG;
 
 typedef struct rasterinfo_t {
@@ -171,6 +183,18 @@ typedef struct rasterinfo_t {
 
 } RASTERINFO;
 
+typedef struct pyramid_t {
+	/* number of overviews and bands of each overview */
+	int overview_count;
+	int nband_count;
+
+	/* single band datasets of each overview band, [overview * nband_count + band] */
+	GDALDatasetH *band;
+
+	/* temporary files of the datasets */
+	char **file;
+} PYRAMID;
+
 typedef struct stringbuffer_t {
 	uint32_t length;
 	char **line;
@@ -34,6 +34,8 @@
 #include <string.h> /* for memcpy and strlen */
 #include <assert.h>
 #include <time.h> /* for time */
+#include <ctype.h> /* for isdigit, isalpha and tolower */
+#include <stdlib.h> /* for strtod */
 #include "rt_api.h"
 #include "gdal_vrt.h"
 
@@ -933,6 +935,180 @@ rt_pixtype_get_min_value(rt_pixtype pixtype) {
 	}
 }
 
+/**
+ * Convert values of the given pixel type to doubles.  Each pixel
+ * type gets its own plain loop over a typed array, which compilers
+ * can vectorize.
+ *
+ * @param pixtype : pixel type of the values in src
+ * @param src : the values, aligned as per rt_pixtype_alignment
+ * @param len : number of values in src
+ * @param dst : array of at least len doubles
+ *
+ * @return 1 on success, 0 on error
+ */
+int
+rt_pixtype_to_double(rt_pixtype pixtype, const void *src, uint32_t len,
+	double *dst) {
+	uint32_t i;
+
+	assert(NULL != src);
+	assert(NULL != dst);
+
+	switch (pixtype) {
+		case PT_1BB:
+		case PT_2BUI:
+		case PT_4BUI:
+		case PT_8BUI: {
+			const uint8_t *ptr = src;
+			for (i = 0; i < len; i++)
+				dst[i] = ptr[i];
+			break;
+		}
+		case PT_8BSI: {
+			const int8_t *ptr = src;
+			for (i = 0; i < len; i++)
+				dst[i] = ptr[i];
+			break;
+		}
+		case PT_16BSI: {
+			const int16_t *ptr = src;
+			for (i = 0; i < len; i++)
+				dst[i] = ptr[i];
+			break;
+		}
+		case PT_16BUI: {
+			const uint16_t *ptr = src;
+			for (i = 0; i < len; i++)
+				dst[i] = ptr[i];
+			break;
+		}
+		case PT_32BSI: {
+			const int32_t *ptr = src;
+			for (i = 0; i < len; i++)
+				dst[i] = ptr[i];
+			break;
+		}
+		case PT_32BUI: {
+			const uint32_t *ptr = src;
+			for (i = 0; i < len; i++)
+				dst[i] = ptr[i];
+			break;
+		}
+		case PT_32BF: {
+			const float *ptr = src;
+			for (i = 0; i < len; i++)
+				dst[i] = ptr[i];
+			break;
+		}
+		case PT_64BF: {
+			memcpy(dst, src, sizeof(double) * len);
+			break;
+		}
+		default: {
+			rterror("rt_pixtype_to_double: Unknown pixeltype %d", pixtype);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * Convert doubles to values of the given pixel type, clamping
+ * them to the range of the pixel type the same way as
+ * rt_band_set_pixel.
+ *
+ * @param pixtype : pixel type of the values in dst
+ * @param src : array of len doubles
+ * @param len : number of values in src
+ * @param dst : where to put the values, aligned as per
+ *   rt_pixtype_alignment
+ *
+ * @return 1 on success, 0 on error
+ */
+int
+rt_pixtype_from_double(rt_pixtype pixtype, const double *src, uint32_t len,
+	void *dst) {
+	uint32_t i;
+
+	assert(NULL != src);
+	assert(NULL != dst);
+
+	switch (pixtype) {
+		case PT_1BB: {
+			uint8_t *ptr = dst;
+			for (i = 0; i < len; i++)
+				ptr[i] = rt_util_clamp_to_1BB(src[i]);
+			break;
+		}
+		case PT_2BUI: {
+			uint8_t *ptr = dst;
+			for (i = 0; i < len; i++)
+				ptr[i] = rt_util_clamp_to_2BUI(src[i]);
+			break;
+		}
+		case PT_4BUI: {
+			uint8_t *ptr = dst;
+			for (i = 0; i < len; i++)
+				ptr[i] = rt_util_clamp_to_4BUI(src[i]);
+			break;
+		}
+		case PT_8BSI: {
+			int8_t *ptr = dst;
+			for (i = 0; i < len; i++)
+				ptr[i] = rt_util_clamp_to_8BSI(src[i]);
+			break;
+		}
+		case PT_8BUI: {
+			uint8_t *ptr = dst;
+			for (i = 0; i < len; i++)
+				ptr[i] = rt_util_clamp_to_8BUI(src[i]);
+			break;
+		}
+		case PT_16BSI: {
+			int16_t *ptr = dst;
+			for (i = 0; i < len; i++)
+				ptr[i] = rt_util_clamp_to_16BSI(src[i]);
+			break;
+		}
+		case PT_16BUI: {
+			uint16_t *ptr = dst;
+			for (i = 0; i < len; i++)
+				ptr[i] = rt_util_clamp_to_16BUI(src[i]);
+			break;
+		}
+		case PT_32BSI: {
+			int32_t *ptr = dst;
+			for (i = 0; i < len; i++)
+				ptr[i] = rt_util_clamp_to_32BSI(src[i]);
+			break;
+		}
+		case PT_32BUI: {
+			uint32_t *ptr = dst;
+			for (i = 0; i < len; i++)
+				ptr[i] = rt_util_clamp_to_32BUI(src[i]);
+			break;
+		}
+		case PT_32BF: {
+			float *ptr = dst;
+			for (i = 0; i < len; i++)
+				ptr[i] = rt_util_clamp_to_32F(src[i]);
+			break;
+		}
+		case PT_64BF: {
+			memmove(dst, src, sizeof(double) * len);
+			break;
+		}
+		default: {
+			rterror("rt_pixtype_from_double: Unknown pixeltype %d", pixtype);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
 /*- rt_band ----------------------------------------------------------*/
 
 /**
@@ -985,6 +1161,7 @@ rt_band_new_inline(
 	band->ownsData = 0;
 	band->isnodata = FALSE;
 	band->raster = NULL;
+	band->hascachedstats = FALSE;
 
 	/* properly set nodataval as it may need to be constrained to the data type */
 	if (hasnodata && rt_band_set_nodata(band, nodataval) < 0) {
@@ -1043,6 +1220,7 @@ rt_band_new_offline(
 	band->hasnodata = hasnodata;
 	band->isnodata = FALSE;
 	band->raster = NULL;
+	band->hascachedstats = FALSE;
 
 	/* properly set nodataval as it may need to be constrained to the data type */
 	if (hasnodata && rt_band_set_nodata(band, nodataval) < 0) {
@@ -1119,6 +1297,11 @@ rt_band_duplicate(rt_band band) {
 
 	if (rtn == NULL)
 		rterror("rt_band_duplicate: Could not copy band");
+	/* same pixels, same statistics */
+	else if (band->hascachedstats) {
+		rtn->cachedstats = band->cachedstats;
+		rtn->hascachedstats = TRUE;
+	}
 
 	return rtn;
 }
@@ -1442,6 +1625,7 @@ rt_band_set_hasnodata_flag(rt_band band, int flag) {
 
 
     band->hasnodata = (flag) ? 1 : 0;
+    band->hascachedstats = FALSE;
 }
 
 void
@@ -1451,6 +1635,7 @@ rt_band_set_isnodata_flag(rt_band band, int flag) {
 
 
     band->isnodata = (flag) ? 1 : 0;
+    band->hascachedstats = FALSE;
 }
 
 int
@@ -1487,6 +1672,7 @@ rt_band_set_nodata(rt_band band, double val) {
     assert(NULL != band);
 
     pixtype = band->pixtype;
+    band->hascachedstats = FALSE;
 
     RASTER_DEBUGF(3, "rt_band_set_nodata: setting nodata value %g with band type %s", val, rt_pixtype_name(pixtype));
 
@@ -1637,6 +1823,7 @@ rt_band_set_pixel_line(
 	data = rt_band_get_data(band);
 	offset = x + (y * band->width);
 	RASTER_DEBUGF(5, "offset = %d", offset);
+	band->hascachedstats = FALSE;
 
 	/* make sure len of values to copy don't exceed end of data */
 	if (len > (band->width * band->height) - offset) {
@@ -1751,6 +1938,7 @@ rt_band_set_pixel(rt_band band, uint16_t x, uint16_t y,
 
     data = rt_band_get_data(band);
     offset = x + (y * band->width);
+    band->hascachedstats = FALSE;
 
     switch (pixtype) {
         case PT_1BB:
@@ -1992,6 +2180,57 @@ rt_band_get_pixel(rt_band band, uint16_t x, uint16_t y, double *result) {
     }
 }
 
+/**
+ * Get values of multiple pixels.  Unlike rt_band_get_pixel, the
+ * values are not converted: the returned pointer is into the band's
+ * data and has to be read as an array of the band's pixel type,
+ * e.g. with rt_pixtype_to_double.  Coordinates and data are checked
+ * once for the whole run of pixels.
+ *
+ * @param band : the band to get values from
+ * @param x : X coordinate (0-based)
+ * @param y : Y coordinate (0-based)
+ * @param len : # of pixels wanted, starting at x, y and going along
+ *   the row and onto the next rows
+ *
+ * @return pointer to the values of the pixels, or NULL on error
+ */
+void *
+rt_band_get_pixel_line(
+	rt_band band,
+	uint16_t x, uint16_t y,
+	uint16_t len
+) {
+	uint8_t *data = NULL;
+	uint32_t offset = 0;
+	int size = 0;
+
+	assert(NULL != band);
+
+	if (x >= band->width || y >= band->height) {
+		rterror("rt_band_get_pixel_line: Coordinates out of range");
+		return NULL;
+	}
+
+	offset = x + (y * band->width);
+	if (len > (band->width * band->height) - offset) {
+		rterror("rt_band_get_pixel_line: Unable to get pixels as values length exceeds end of data");
+		return NULL;
+	}
+
+	size = rt_pixtype_size(band->pixtype);
+	if (size < 1)
+		return NULL;
+
+	data = rt_band_get_data(band);
+	if (data == NULL) {
+		rterror("rt_band_get_pixel_line: Cannot get band data");
+		return NULL;
+	}
+
+	return data + (offset * size);
+}
+
 double
 rt_band_get_nodata(rt_band band) {
 
@@ -2017,7 +2256,8 @@ int
 rt_band_check_is_nodata(rt_band band)
 {
     int i, j;
-    double pxValue = band->nodataval;
+    void *line = NULL;
+    double *values = NULL;
 
 
 
@@ -2038,23 +2278,146 @@ rt_band_check_is_nodata(rt_band band)
 			}
     }
 
-    /* Check all pixels */
-    for(i = 0; i < band->width; i++)
+    values = rtalloc(sizeof(double) * band->width);
+    if (NULL == values) {
+        rterror("rt_band_check_is_nodata: Unable to allocate memory for pixel values");
+        return FALSE;
+    }
+
+    /* Check all pixels, a row at a time */
+    for(j = 0; j < band->height; j++)
     {
-        for(j = 0; j < band->height; j++)
+        line = rt_band_get_pixel_line(band, 0, j, band->width);
+        if (NULL == line || !rt_pixtype_to_double(band->pixtype, line, band->width, values)) {
+            rtdealloc(values);
+            return FALSE;
+        }
+
+        for(i = 0; i < band->width; i++)
         {
-            rt_band_get_pixel(band, i, j, &pxValue);
-            if (FLT_NEQ(pxValue, band->nodataval)) {
+            if (FLT_NEQ(values[i], band->nodataval)) {
+                rtdealloc(values);
                 band->isnodata = FALSE;
                 return FALSE;
             }
         }
     }
 
+    rtdealloc(values);
     band->isnodata = TRUE;
     return TRUE;
 }
 
+/**
+ * Compute the statistics of a band and cache them in the band, to be
+ * stored with it when the raster is serialized. The cache is dropped
+ * as soon as a pixel or the nodata value of the band changes.
+ *
+ * @param band : the band to compute the statistics of
+ *
+ * @return 1 on success, 0 on error (out-db band)
+ */
+int
+rt_band_compute_cached_stats(rt_band band) {
+	struct rt_cachedstats_t stats;
+	double *values = NULL;
+	void *line = NULL;
+	double value = 0;
+	double delta = 0;
+	uint32_t n = 0;
+	int x = 0;
+	int y = 0;
+
+	assert(NULL != band);
+
+	if (band->offline) {
+		rterror("rt_band_compute_cached_stats: Statistics of out-db bands are not cached");
+		return 0;
+	}
+
+	memset(&stats, 0, sizeof(struct rt_cachedstats_t));
+	stats.nodataval = band->nodataval;
+
+	/* entire band is nodata, the pixels may not even be set */
+	if (band->isnodata) {
+		n = band->width * band->height;
+		if (band->hasnodata)
+			stats.nodata_count = n;
+		else if (n > 0) {
+			stats.count = n;
+			stats.min = stats.max = stats.mean = band->nodataval;
+		}
+	}
+	else if (band->width > 0) {
+		values = rtalloc(sizeof(double) * band->width);
+		if (NULL == values) {
+			rterror("rt_band_compute_cached_stats: Unable to allocate memory for pixel values");
+			return 0;
+		}
+
+		for (y = 0; y < band->height; y++) {
+			line = rt_band_get_pixel_line(band, 0, y, band->width);
+			if (NULL == line || !rt_pixtype_to_double(band->pixtype, line, band->width, values)) {
+				rterror("rt_band_compute_cached_stats: Unable to get pixel values of row %d", y);
+				rtdealloc(values);
+				return 0;
+			}
+
+			for (x = 0; x < band->width; x++) {
+				value = values[x];
+				if (band->hasnodata && FLT_EQ(value, band->nodataval)) {
+					stats.nodata_count++;
+					continue;
+				}
+
+				if (stats.count < 1)
+					stats.min = stats.max = value;
+				else if (value < stats.min)
+					stats.min = value;
+				else if (value > stats.max)
+					stats.max = value;
+
+				/* one-pass standard deviation, Welford */
+				stats.count++;
+				delta = value - stats.mean;
+				stats.mean += delta / stats.count;
+				stats.Q += delta * (value - stats.mean);
+			}
+		}
+
+		rtdealloc(values);
+	}
+
+	band->cachedstats = stats;
+	band->hascachedstats = TRUE;
+
+	return 1;
+}
+
+/**
+ * Get the statistics cached in a band
+ *
+ * @param band : the band to get the statistics of
+ * @param stats : where to copy the statistics
+ *
+ * @return TRUE if the band has up to date statistics, FALSE otherwise
+ */
+int
+rt_band_get_cached_stats(rt_band band, rt_cachedstats stats) {
+	assert(NULL != band);
+	assert(NULL != stats);
+
+	if (!band->hascachedstats)
+		return FALSE;
+
+	*stats = band->cachedstats;
+	return TRUE;
+}
+
+/* defined with rt_statsagg */
+static double *_rti_statsagg_steal_values(rt_statsagg agg);
+static void _rti_statsagg_get_moments(rt_statsagg agg, double *M, double *Q);
+
 /**
  * Compute summary statistics for a band
  *
@@ -2071,29 +2434,12 @@ rt_band_check_is_nodata(rt_band band)
 rt_bandstats
 rt_band_get_summary_stats(rt_band band, int exclude_nodata_value, double sample,
 	int inc_vals, uint64_t *cK, double *cM, double *cQ) {
-	uint8_t *data = NULL;
-	uint32_t x = 0;
-	uint32_t y = 0;
-	uint32_t z = 0;
-	uint32_t offset = 0;
-	uint32_t diff = 0;
-	int rtn;
-	int hasnodata = FALSE;
-	double nodata = 0;
-	double *values = NULL;
-	double value;
+	rt_statsagg agg = NULL;
 	rt_bandstats stats = NULL;
-
-	uint32_t do_sample = 0;
-	uint32_t sample_size = 0;
-	uint32_t sample_per = 0;
-	uint32_t sample_int = 0;
-	uint32_t i = 0;
-	uint32_t j = 0;
-	double sum = 0;
-	uint32_t k = 0;
-	double M = 0;
-	double Q = 0;
+	double M;
+	double Q;
+	double delta;
+	double n;
 
 #if POSTGIS_DEBUG_LEVEL > 0
 	clock_t start, stop;
@@ -2107,227 +2453,45 @@ rt_band_get_summary_stats(rt_band band, int exclude_nodata_value, double sample,
 
 	assert(NULL != band);
 
-	data = rt_band_get_data(band);
-	if (data == NULL) {
-		rterror("rt_band_get_summary_stats: Cannot get band data");
+	/* all values are kept if requested, nothing is sketched */
+	agg = rt_statsagg_new(inc_vals, 0);
+	if (NULL == agg) {
+		rterror("rt_band_get_summary_stats: Unable to allocate memory for stats");
 		return NULL;
 	}
 
-	hasnodata = rt_band_get_hasnodata_flag(band);
-	if (hasnodata != FALSE)
-		nodata = rt_band_get_nodata(band);
-	else
-		exclude_nodata_value = 0;
-
-	RASTER_DEBUGF(3, "nodata = %f", nodata);
-	RASTER_DEBUGF(3, "hasnodata = %d", hasnodata);
-	RASTER_DEBUGF(3, "exclude_nodata_value = %d", exclude_nodata_value);
-
-	/* entire band is nodata */
-	if (rt_band_get_isnodata_flag(band) != FALSE) {
-		stats = (rt_bandstats) rtalloc(sizeof(struct rt_bandstats_t));
-		if (NULL == stats) {
-			rterror("rt_band_get_summary_stats: Unable to allocate memory for stats");
-			return NULL;
-		}
+	if (!rt_statsagg_add_band(agg, band, exclude_nodata_value, sample)) {
+		rterror("rt_band_get_summary_stats: Unable to compute stats of band");
+		rt_statsagg_destroy(agg);
+		return NULL;
+	}
 
-		stats->sample = 1;
-		stats->sorted = 0;
-		stats->values = NULL;
+	stats = rt_statsagg_get_summary_stats(agg);
+	if (NULL == stats) {
+		rt_statsagg_destroy(agg);
+		return NULL;
+	}
 
-		if (exclude_nodata_value) {
-			rtwarn("All pixels of band have the NODATA value");
+	if (inc_vals && stats->count > 0)
+		stats->values = _rti_statsagg_steal_values(agg);
 
-			stats->count = 0;
-			stats->min = stats->max = 0;
-			stats->sum = 0;
-			stats->mean = 0;
-			stats->stddev = -1;
+	/* coverage one-pass standard deviation, merged as in rt_statsagg_merge */
+	if (NULL != cK && stats->count > 0) {
+		_rti_statsagg_get_moments(agg, &M, &Q);
+		if (*cK < 1) {
+			*cM = M;
+			*cQ = Q;
 		}
 		else {
-			stats->count = band->width * band->height;
-			stats->min = stats->max = nodata;
-			stats->sum = stats->count * nodata;
-			stats->mean = nodata;
-			stats->stddev = 0;
+			n = (double) *cK + stats->count;
+			delta = M - *cM;
+			*cM += delta * stats->count / n;
+			*cQ += Q + (delta * delta * *cK * stats->count / n);
 		}
-
-		return stats;
-	}
-
-	/* clamp percentage */
-	if (
-		(sample < 0 || FLT_EQ(sample, 0.0)) ||
-		(sample > 1 || FLT_EQ(sample, 1.0))
-	) {
-		do_sample = 0;
-		sample = 1;
-	}
-	else
-		do_sample = 1;
-	RASTER_DEBUGF(3, "do_sample = %d", do_sample);
-
-	/* sample all pixels */
-	if (!do_sample) {
-		sample_size = band->width * band->height;
-		sample_per = band->height;
-	}
-	/*
-	 randomly sample a percentage of available pixels
-	 sampling method is known as
-	 	"systematic random sample without replacement"
-	*/
-	else {
-		sample_size = round((band->width * band->height) * sample);
-		sample_per = round(sample_size / band->width);
-		sample_int = round(band->height / sample_per);
-		srand(time(NULL));
+		*cK += stats->count;
 	}
 
-	RASTER_DEBUGF(3, "sampling %d of %d available pixels w/ %d per set"
-		, sample_size, (band->width * band->height), sample_per);
-
-	if (inc_vals) {
-		values = rtalloc(sizeof(double) * sample_size);
-		if (NULL == values) {
-			rtwarn("Unable to allocate memory for values");
-			inc_vals = 0;
-		}
-	}
-
-	/* initialize stats */
-	stats = (rt_bandstats) rtalloc(sizeof(struct rt_bandstats_t));
-	if (NULL == stats) {
-		rterror("rt_band_get_summary_stats: Unable to allocate memory for stats");
-		return NULL;
-	}
-	stats->sample = sample;
-	stats->count = 0;
-	stats->sum = 0;
-	stats->mean = 0;
-	stats->stddev = -1;
-	stats->min = stats->max = 0;
-	stats->values = NULL;
-	stats->sorted = 0;
-
-	for (x = 0, j = 0, k = 0; x < band->width; x++) {
-		y = -1;
-		diff = 0;
-
-		for (i = 0, z = 0; i < sample_per; i++) {
-			if (!do_sample)
-				y = i;
-			else {
-				offset = (rand() % sample_int) + 1;
-				y += diff + offset;
-				diff = sample_int - offset;
-			}
-			RASTER_DEBUGF(5, "(x, y, z) = (%d, %d, %d)", x, y, z);
-			if (y >= band->height || z > sample_per) break;
-
-			rtn = rt_band_get_pixel(band, x, y, &value);
-#if POSTGIS_DEBUG_LEVEL > 0
-			if (rtn != -1) {
-				RASTER_DEBUGF(5, "(x, y, value) = (%d,%d, %f)", x, y, value);
-			}
-#endif
-
-			j++;
-			if (
-				rtn != -1 && (
-					!exclude_nodata_value || (
-						exclude_nodata_value &&
-						(hasnodata != FALSE) &&
-						FLT_NEQ(value, nodata)
-					)
-				)
-			) {
-
-				/* inc_vals set, collect pixel values */
-				if (inc_vals) values[k] = value;
-
-				/* average */
-				k++;
-				sum += value;
-
-				/*
-					one-pass standard deviation
-					http://www.eecs.berkeley.edu/~mhoemmen/cs194/Tutorials/variance.pdf
-				*/
-				if (k == 1) {
-					Q = 0;
-					M = value;
-				}
-				else {
-					Q += (((k  - 1) * pow(value - M, 2)) / k);
-					M += ((value - M ) / k);
-				}
-
-				/* coverage one-pass standard deviation */
-				if (NULL != cK) {
-					(*cK)++;
-					if (*cK == 1) {
-						*cQ = 0;
-						*cM = value;
-					}
-					else {
-						*cQ += (((*cK  - 1) * pow(value - *cM, 2)) / *cK);
-						*cM += ((value - *cM ) / *cK);
-					}
-				}
-
-				/* min/max */
-				if (stats->count < 1) {
-					stats->count = 1;
-					stats->min = stats->max = value;
-				}
-				else {
-					if (value < stats->min)
-						stats->min = value;
-					if (value > stats->max)
-						stats->max = value;
-				}
-
-			}
-
-			z++;
-		}
-	}
-
-	RASTER_DEBUG(3, "sampling complete");
-
-	stats->count = k;
-	if (k > 0) {
-		if (inc_vals) {
-			/* free unused memory */
-			if (sample_size != k) {
-				values = rtrealloc(values, k * sizeof(double));
-			}
-
-			stats->values = values;
-		}
-
-		stats->sum = sum;
-		stats->mean = sum / k;
-
-		/* standard deviation */
-		if (!do_sample)
-			stats->stddev = sqrt(Q / k);
-		/* sample deviation */
-		else {
-			if (k < 2)
-				stats->stddev = -1;
-			else
-				stats->stddev = sqrt(Q / (k - 1));
-		}
-	}
-	/* inc_vals thus values allocated but not used */
-	else if (inc_vals)
-		rtdealloc(values);
-
-	/* if count is zero and do_sample is one */
-	if (k < 0 && do_sample)
-		rtwarn("All sampled pixels of band have the NODATA value");
+	rt_statsagg_destroy(agg);
 
 #if POSTGIS_DEBUG_LEVEL > 0
 	stop = clock();
@@ -2340,26 +2504,14 @@ rt_band_get_summary_stats(rt_band band, int exclude_nodata_value, double sample,
 	return stats;
 }
 
-/**
- * Count the distribution of data
- *
- * @param stats: a populated stats struct for processing
- * @param bin_count: the number of bins to group the data by
- * @param bin_width: the width of each bin as an array
- * @param bin_width_count: number of values in bin_width
- * @param right: evaluate bins by (a,b] rather than default [a,b)
- * @param min: user-defined minimum value of the histogram
- *   a value less than the minimum value is not counted in any bins
- *   if min = max, min and max are not used
- * @param max: user-defined maximum value of the histogram
- *   a value greater than the max value is not counted in any bins
- *   if min = max, min and max are not used
- * @param rtn_count: set to the number of bins being returned
- *
- * @return the histogram of the data
+/*
+ * Count the distribution of values_count values, each value counting
+ * as many times as its weight (once if weights is NULL).  count is the
+ * total weight, vmin and vmax the extreme values.
  */
-rt_histogram
-rt_band_get_histogram(rt_bandstats stats,
+static rt_histogram
+_rti_get_histogram(double *values, uint32_t *weights, uint32_t values_count,
+	uint32_t count, double vmin, double vmax,
 	int bin_count, double *bin_width, int bin_width_count,
 	int right, double min, double max, uint32_t *rtn_count) {
 	rt_histogram bins = NULL;
@@ -2368,7 +2520,8 @@ rt_band_get_histogram(rt_bandstats stats,
 	int j;
 	double tmp;
 	double value;
-	int sum = 0;
+	uint32_t weight;
+	uint32_t sum = 0;
 	int user_minmax = 0;
 	double qmin;
 	double qmax;
@@ -2383,13 +2536,6 @@ rt_band_get_histogram(rt_bandstats stats,
 	start = clock();
 #endif
 
-	assert(NULL != stats);
-
-	if (stats->count < 1 || NULL == stats->values) {
-		rterror("rt_util_get_histogram: rt_bandstats object has no value");
-		return NULL;
-	}
-
 	/* bin width must be positive numbers and not zero */
 	if (NULL != bin_width && bin_width_count > 0) {
 		for (i = 0; i < bin_width_count; i++) {
@@ -2402,8 +2548,8 @@ rt_band_get_histogram(rt_bandstats stats,
 
 	/* ignore min and max parameters */
 	if (FLT_EQ(max, min)) {
-		qmin = stats->min;
-		qmax = stats->max;
+		qmin = vmin;
+		qmax = vmax;
 	}
 	else {
 		user_minmax = 1;
@@ -2423,12 +2569,12 @@ rt_band_get_histogram(rt_bandstats stats,
 
 			all computed bins are assumed to have equal width
 		*/
-		/* Square-root choice for stats->count < 30 */
-		if (stats->count < 30)
-			bin_count = ceil(sqrt(stats->count));
-		/* Sturges' formula for stats->count >= 30 */
+		/* Square-root choice for count < 30 */
+		if (count < 30)
+			bin_count = ceil(sqrt(count));
+		/* Sturges' formula for count >= 30 */
 		else
-			bin_count = ceil(log2((double) stats->count) + 1.);
+			bin_count = ceil(log2((double) count) + 1.);
 
 		/* bin_width_count provided and bin_width has value */
 		if (bin_width_count > 0 && NULL != bin_width) {
@@ -2462,7 +2608,7 @@ rt_band_get_histogram(rt_bandstats stats,
 			return NULL;
 		}
 
-		bins->count = stats->count;
+		bins->count = count;
 		bins->percent = -1;
 		bins->min = qmin;
 		bins->max = qmax;
@@ -2541,8 +2687,9 @@ rt_band_get_histogram(rt_bandstats stats,
 	}
 
 	/* process the values */
-	for (i = 0; i < stats->count; i++) {
-		value = stats->values[i];
+	for (i = 0; i < values_count; i++) {
+		value = values[i];
+		weight = (NULL != weights) ? weights[i] : 1;
 
 		/* default, [a, b) */
 		if (!right) {
@@ -2555,8 +2702,8 @@ rt_band_get_histogram(rt_bandstats stats,
 						)
 					)
 				) {
-					bins[j].count++;
-					sum++;
+					bins[j].count += weight;
+					sum += weight;
 					break;
 				}
 			}
@@ -2572,8 +2719,8 @@ rt_band_get_histogram(rt_bandstats stats,
 						)
 					)
 				) {
-					bins[j].count++;
-					sum++;
+					bins[j].count += weight;
+					sum += weight;
 					break;
 				}
 			}
@@ -2602,24 +2749,79 @@ rt_band_get_histogram(rt_bandstats stats,
 }
 
 /**
- * Compute the default set of or requested quantiles for a set of data
- * the quantile formula used is same as Excel and R default method
+ * Count the distribution of data
  *
  * @param stats: a populated stats struct for processing
- * @param quantiles: the quantiles to be computed
- * @param quantiles_count: the number of quantiles to be computed
- * @param rtn_count: set to the number of quantiles being returned
+ * @param bin_count: the number of bins to group the data by
+ * @param bin_width: the width of each bin as an array
+ * @param bin_width_count: number of values in bin_width
+ * @param right: evaluate bins by (a,b] rather than default [a,b)
+ * @param min: user-defined minimum value of the histogram
+ *   a value less than the minimum value is not counted in any bins
+ *   if min = max, min and max are not used
+ * @param max: user-defined maximum value of the histogram
+ *   a value greater than the max value is not counted in any bins
+ *   if min = max, min and max are not used
+ * @param rtn_count: set to the number of bins being returned
  *
- * @return the default set of or requested quantiles for a band
+ * @return the histogram of the data
  */
-rt_quantile
-rt_band_get_quantiles(rt_bandstats stats,
+rt_histogram
+rt_band_get_histogram(rt_bandstats stats,
+	int bin_count, double *bin_width, int bin_width_count,
+	int right, double min, double max, uint32_t *rtn_count) {
+	assert(NULL != stats);
+
+	if (stats->count < 1 || NULL == stats->values) {
+		rterror("rt_util_get_histogram: rt_bandstats object has no value");
+		return NULL;
+	}
+
+	return _rti_get_histogram(
+		stats->values, NULL, stats->count,
+		stats->count, stats->min, stats->max,
+		bin_count, bin_width, bin_width_count,
+		right, min, max, rtn_count
+	);
+}
+
+/*
+ * Value of the given 0-based rank in values_count sorted values, each
+ * value taking as many ranks as its weight (one if weights is NULL)
+ */
+static double
+_rti_value_at_rank(double *values, uint32_t *weights, uint32_t values_count,
+	uint32_t rank) {
+	uint32_t i;
+	uint64_t cum = 0;
+
+	if (NULL == weights)
+		return values[rank];
+
+	for (i = 0; i < values_count; i++) {
+		cum += weights[i];
+		if (rank < cum)
+			return values[i];
+	}
+
+	return values[values_count - 1];
+}
+
+/*
+ * Compute quantiles of values_count values sorted ascending, each value
+ * counting as many times as its weight (once if weights is NULL).
+ * count is the total weight.
+ */
+static rt_quantile
+_rti_get_quantiles(double *values, uint32_t *weights, uint32_t values_count,
+	uint32_t count,
 	double *quantiles, int quantiles_count, uint32_t *rtn_count) {
 	rt_quantile rtn;
 	int init_quantiles = 0;
 	int i = 0;
 	double h;
-	int hl;
+	uint32_t hl;
+	double value;
 
 #if POSTGIS_DEBUG_LEVEL > 0
 	clock_t start, stop;
@@ -2631,13 +2833,6 @@ rt_band_get_quantiles(rt_bandstats stats,
 	start = clock();
 #endif
 
-	assert(NULL != stats);
-
-	if (stats->count < 1 || NULL == stats->values) {
-		rterror("rt_band_get_quantiles: rt_bandstats object has no value");
-		return NULL;
-	}
-
 	/* quantiles not provided */
 	if (NULL == quantiles) {
 		/* quantile count not specified, default to quartiles */
@@ -2675,12 +2870,6 @@ rt_band_get_quantiles(rt_bandstats stats,
 		return NULL;
 	}
 
-	/* sort values */
-	if (!stats->sorted) {
-		quicksort(stats->values, stats->values + stats->count - 1);
-		stats->sorted = 1;
-	}
-
 	/*
 		make quantiles
 
@@ -2690,15 +2879,18 @@ rt_band_get_quantiles(rt_bandstats stats,
 	for (i = 0; i < quantiles_count; i++) {
 		rtn[i].quantile = quantiles[i];
 
-		h = ((stats->count - 1.) * quantiles[i]) + 1.;
+		h = ((count - 1.) * quantiles[i]) + 1.;
 		hl = floor(h);
 
 		/* h greater than hl, do full equation */
-		if (h > hl)
-			rtn[i].value = stats->values[hl - 1] + ((h - hl) * (stats->values[hl] - stats->values[hl - 1]));
+		if (h > hl) {
+			value = _rti_value_at_rank(values, weights, values_count, hl - 1);
+			rtn[i].value = value + ((h - hl) * (_rti_value_at_rank(values, weights, values_count, hl) - value));
+		}
 		/* shortcut as second part of equation is zero */
 		else
-			rtn[i].value = stats->values[hl - 1];
+			rtn[i].value = _rti_value_at_rank(values, weights, values_count, hl - 1);
+		rtn[i].has_value = 1;
 	}
 
 #if POSTGIS_DEBUG_LEVEL > 0
@@ -2713,7120 +2905,9478 @@ rt_band_get_quantiles(rt_bandstats stats,
 	return rtn;
 }
 
-static struct quantile_llist_element *quantile_llist_search(
-	struct quantile_llist_element *element,
-	double needle
-) {
-	if (NULL == element)
+/**
+ * Compute the default set of or requested quantiles for a set of data
+ * the quantile formula used is same as Excel and R default method
+ *
+ * @param stats: a populated stats struct for processing
+ * @param quantiles: the quantiles to be computed
+ * @param quantiles_count: the number of quantiles to be computed
+ * @param rtn_count: set to the number of quantiles being returned
+ *
+ * @return the default set of or requested quantiles for a band
+ */
+rt_quantile
+rt_band_get_quantiles(rt_bandstats stats,
+	double *quantiles, int quantiles_count, uint32_t *rtn_count) {
+	assert(NULL != stats);
+
+	if (stats->count < 1 || NULL == stats->values) {
+		rterror("rt_band_get_quantiles: rt_bandstats object has no value");
 		return NULL;
-	else if (FLT_NEQ(needle, element->value)) {
-		if (NULL != element->next)
-			return quantile_llist_search(element->next, needle);
-		else
-			return NULL;
 	}
-	else
-		return element;
-}
-
-static struct quantile_llist_element *quantile_llist_insert(
-	struct quantile_llist_element *element,
-	double value,
-	uint32_t *idx
-) {
-	struct quantile_llist_element *qle = NULL;
-
-	if (NULL == element) {
-		qle = rtalloc(sizeof(struct quantile_llist_element));
-		RASTER_DEBUGF(4, "qle @ %p is only element in list", qle);
-		if (NULL == qle) return NULL;
 
-		qle->value = value;
-		qle->count = 1;
-
-		qle->prev = NULL;
-		qle->next = NULL;
-
-		if (NULL != idx) *idx = 0;
-		return qle;
+	/* sort values */
+	if (!stats->sorted) {
+		quicksort(stats->values, stats->values + stats->count - 1);
+		stats->sorted = 1;
 	}
-	else if (value > element->value) {
-		if (NULL != idx) *idx += 1;
-		if (NULL != element->next)
-			return quantile_llist_insert(element->next, value, idx);
-		/* insert as last element in list */
-		else {
-			qle = rtalloc(sizeof(struct quantile_llist_element));
-			RASTER_DEBUGF(4, "insert qle @ %p as last element", qle);
-			if (NULL == qle) return NULL;
-
-			qle->value = value;
-			qle->count = 1;
 
-			qle->prev = element;
-			qle->next = NULL;
-			element->next = qle;
-
-			return qle;
-		}
-	}
-	/* insert before current element */
-	else {
-		qle = rtalloc(sizeof(struct quantile_llist_element));
-		RASTER_DEBUGF(4, "insert qle @ %p before current element", qle);
-		if (NULL == qle) return NULL;
+	return _rti_get_quantiles(
+		stats->values, NULL, stats->count, stats->count,
+		quantiles, quantiles_count, rtn_count
+	);
+}
 
-		qle->value = value;
-		qle->count = 1;
+/* where a value of rt_band_get_value_count was first found */
+struct _rti_valuecount_first_t {
+	uint32_t first;
+	uint32_t idx;
+};
 
-		if (NULL != element->prev) element->prev->next = qle;
-		qle->next = element;
-		qle->prev = element->prev;
-		element->prev = qle;
+static int
+_rti_valuecount_first_cmp(const void *a, const void *b) {
+	const struct _rti_valuecount_first_t *_a = a;
+	const struct _rti_valuecount_first_t *_b = b;
 
-		return qle;
-	}
+	if (_a->first < _b->first) return -1;
+	if (_a->first > _b->first) return 1;
+	return 0;
 }
 
-static int quantile_llist_delete(struct quantile_llist_element *element) {
-	if (NULL == element) return 0;
-
-	/* beginning of list */
-	if (NULL == element->prev && NULL != element->next) {
-		element->next->prev = NULL;
-	}
-	/* end of list */
-	else if (NULL != element->prev && NULL == element->next) {
-		element->prev->next = NULL;
-	}
-	/* within list */
-	else if (NULL != element->prev && NULL != element->next) {
-		element->prev->next = element->next;
-		element->next->prev = element->prev;
-	}
+/**
+ * Count the number of times provided value(s) occur in
+ * the band
+ *
+ * @param band: the band to query for minimum and maximum pixel values
+ * @param exclude_nodata_value: if non-zero, ignore nodata values
+ * @param search_values: array of values to count
+ * @param search_values_count: the number of search values
+ * @param roundto: the decimal place to round the values to
+ * @param rtn_total: the number of pixels examined in the band
+ * @param rtn_count: the number of value counts being returned
+ *
+ * @return the number of times the provide value(s) occur
+ */
+rt_valuecount
+rt_band_get_value_count(rt_band band, int exclude_nodata_value,
+	double *search_values, uint32_t search_values_count, double roundto,
+	uint32_t *rtn_total, uint32_t *rtn_count) {
+	rt_valuecount vcnts = NULL;
+	rt_pixtype pixtype = PT_END;
+	uint8_t *data = NULL;
+	int hasnodata = FALSE;
+	double nodata = 0;
 
-	RASTER_DEBUGF(4, "qle @ %p destroyed", element);
-	rtdealloc(element);
+	int scale = 0;
+	int doround = 0;
+	double tmpd = 0;
+	int i = 0;
 
-	return 1;
-}
+	uint32_t x = 0;
+	uint32_t y = 0;
+	void *line = NULL;
+	double *pxlvals = NULL;
+	double pxlval;
+	double rpxlval;
+	uint32_t pos;
+	uint32_t *first = NULL;
+	uint32_t total = 0;
+	int vcnts_count = 0;
+	int new_valuecount = 0;
 
-int quantile_llist_destroy(struct quantile_llist **list, uint32_t list_count) {
-	struct quantile_llist_element *element = NULL;
-	uint32_t i;
+#if POSTGIS_DEBUG_LEVEL > 0
+	clock_t start, stop;
+	double elapsed = 0;
+#endif
 
-	if (NULL == *list) return 0;
+	RASTER_DEBUG(3, "starting");
+#if POSTGIS_DEBUG_LEVEL > 0
+	start = clock();
+#endif
 
-	for (i = 0; i < list_count; i++) {
-		element = (*list)[i].head;
-		while (NULL != element->next) {
-			quantile_llist_delete(element->next);
-		}
-		quantile_llist_delete(element);
+	assert(NULL != band);
 
-		rtdealloc((*list)[i].index);
+	data = rt_band_get_data(band);
+	if (data == NULL) {
+		rterror("rt_band_get_summary_stats: Cannot get band data");
+		return NULL;
 	}
 
-	rtdealloc(*list);
-	return 1;
-}
-
-static void quantile_llist_index_update(struct quantile_llist *qll, struct quantile_llist_element *qle, uint32_t idx) {
-	uint32_t anchor = (uint32_t) floor(idx / 100);
+	pixtype = band->pixtype;
 
-	if (qll->tail == qle) return;
+	hasnodata = rt_band_get_hasnodata_flag(band);
+	if (hasnodata != FALSE)
+		nodata = rt_band_get_nodata(band);
+	else
+		exclude_nodata_value = 0;
 
-	if (
-		(anchor != 0) && (
-			NULL == qll->index[anchor].element ||
-			idx <= qll->index[anchor].index
-		)
-	) {
-		qll->index[anchor].index = idx;
-		qll->index[anchor].element = qle;
-	}
+	RASTER_DEBUGF(3, "nodata = %f", nodata);
+	RASTER_DEBUGF(3, "hasnodata = %d", hasnodata);
+	RASTER_DEBUGF(3, "exclude_nodata_value = %d", exclude_nodata_value);
 
-	if (anchor != 0 && NULL == qll->index[0].element) {
-		qll->index[0].index = 0;
-		qll->index[0].element = qll->head;
+	/* process roundto */
+	if (roundto < 0 || FLT_EQ(roundto, 0.0)) {
+		roundto = 0;
+		scale = 0;
 	}
-}
-
-static void quantile_llist_index_delete(struct quantile_llist *qll, struct quantile_llist_element *qle) {
-	uint32_t i = 0;
-
-	for (i = 0; i < qll->index_max; i++) {
-		if (
-			NULL == qll->index[i].element ||
-			(qll->index[i].element) != qle
-		) {
-			continue;
+	/* tenths, hundredths, thousandths, etc */
+	else if (roundto < 1) {
+    switch (pixtype) {
+			/* integer band types don't have digits after the decimal place */
+			case PT_1BB:
+			case PT_2BUI:
+			case PT_4BUI:
+			case PT_8BSI:
+			case PT_8BUI:
+			case PT_16BSI:
+			case PT_16BUI:
+			case PT_32BSI:
+			case PT_32BUI:
+				roundto = 0;
+				break;
+			/* floating points, check the rounding */
+			case PT_32BF:
+			case PT_64BF:
+				for (scale = 0; scale <= 20; scale++) {
+					tmpd = roundto * pow(10, scale);
+					if (FLT_EQ((tmpd - ((int) tmpd)), 0.0)) break;
+				}
+				break;
+			case PT_END:
+				break;
 		}
-
-		RASTER_DEBUGF(5, "deleting index: %d => %f", i, qle->value);
-		qll->index[i].index = -1;
-		qll->index[i].element = NULL;
 	}
-}
-
-static struct quantile_llist_element *quantile_llist_index_search(
-	struct quantile_llist *qll,
-	double value,
-	uint32_t *index
-) {
-	uint32_t i = 0, j = 0;
-	RASTER_DEBUGF(5, "searching index for value %f", value);
-
-	for (i = 0; i < qll->index_max; i++) {
-		if (NULL == qll->index[i].element) {
-			if (i < 1) break;
-			continue;
-		}
-		if (value > (qll->index[i]).element->value) continue;
-
-		if (FLT_EQ(value, qll->index[i].element->value)) {
-			RASTER_DEBUGF(5, "using index value at %d = %f", i, qll->index[i].element->value);
-			*index = i * 100;
-			return qll->index[i].element;
-		}
-		else if (i > 0) {
-			for (j = 1; j < i; j++) {
-				if (NULL != qll->index[i - j].element) {
-					RASTER_DEBUGF(5, "using index value at %d = %f", i - j, qll->index[i - j].element->value);
-					*index = (i - j) * 100;
-					return qll->index[i - j].element;
-				}
+	/* ones, tens, hundreds, etc */
+	else {
+		for (scale = 0; scale >= -20; scale--) {
+			tmpd = roundto * pow(10, scale);
+			if (tmpd < 1 || FLT_EQ(tmpd, 1.0)) {
+				if (scale == 0) doround = 1;
+				break;
 			}
 		}
 	}
 
-	*index = 0;
-	return qll->head;
-}
+	if (scale != 0 || doround)
+		doround = 1;
+	else
+		doround = 0;
+	RASTER_DEBUGF(3, "scale = %d", scale);
+	RASTER_DEBUGF(3, "doround = %d", doround);
 
-static void quantile_llist_index_reset(struct quantile_llist *qll) {
-	uint32_t i = 0;
+	/* process search_values */
+	if (search_values_count > 0 && NULL != search_values) {
+		vcnts = (rt_valuecount) rtalloc(sizeof(struct rt_valuecount_t) * search_values_count);
+		if (NULL == vcnts) {
+			rterror("rt_band_get_count_of_values: Unable to allocate memory for value counts");
+			*rtn_count = 0;
+			return NULL;
+		}
 
-	RASTER_DEBUG(5, "resetting index");
-	for (i = 0; i < qll->index_max; i++) {
-		qll->index[i].index = -1;
-		qll->index[i].element = NULL;
+		for (i = 0; i < search_values_count; i++) {
+			vcnts[i].count = 0;
+			vcnts[i].percent = 0;
+			if (!doround)
+				vcnts[i].value = search_values[i];
+			else
+				vcnts[i].value = ROUND(search_values[i], scale);
+		}
+		vcnts_count = i;
 	}
-}
-
-/**
- * Compute the default set of or requested quantiles for a coverage
- *
- * This function is based upon the algorithm described in:
- *
- * A One-Pass Space-Efficient Algorithm for Finding Quantiles (1995)
- *   by Rakesh Agrawal, Arun Swami
- *   in Proc. 7th Intl. Conf. Management of Data (COMAD-95)
- *
- * http://www.almaden.ibm.com/cs/projects/iis/hdb/Publications/papers/comad95.pdf
- *
- * In the future, it may be worth exploring algorithms that don't
- *   require the size of the coverage
- *
- * @param band: the band to include in the quantile search
- * @param exclude_nodata_value: if non-zero, ignore nodata values
- * @param sample: percentage of pixels to sample
- * @param cov_count: number of values in coverage
- * @param qlls: set of quantile_llist structures
- * @param qlls_count: the number of quantile_llist structures
- * @param quantiles: the quantiles to be computed
- *   if bot qlls and quantiles provided, qlls is used
- * @param quantiles_count: the number of quantiles to be computed
- * @param rtn_count: the number of quantiles being returned
- *
- * @return the default set of or requested quantiles for a band
- */
-rt_quantile
-rt_band_get_quantiles_stream(rt_band band,
-	int exclude_nodata_value, double sample,
-	uint64_t cov_count,
-	struct quantile_llist **qlls, uint32_t *qlls_count,
-	double *quantiles, int quantiles_count,
-	uint32_t *rtn_count) {
-	rt_quantile rtn = NULL;
-	int init_quantiles = 0;
+	else
+		search_values_count = 0;
+	RASTER_DEBUGF(3, "search_values_count = %d", search_values_count);
 
-	struct quantile_llist *qll = NULL;
-	struct quantile_llist_element *qle = NULL;
-	struct quantile_llist_element *qls = NULL;
-	const uint32_t MAX_VALUES = 750;
+	/* entire band is nodata */
+	if (rt_band_get_isnodata_flag(band) != FALSE) {
+		if (exclude_nodata_value) {
+			rtwarn("All pixels of band have the NODATA value");
+			return NULL;
+		}
+		else {
+			if (search_values_count > 0) {
+				/* check for nodata match */
+				for (i = 0; i < search_values_count; i++) {
+					if (!doround)
+						tmpd = nodata;
+					else
+						tmpd = ROUND(nodata, scale);
 
-	uint8_t *data = NULL;
-	int hasnodata = FALSE;
-	double nodata = 0;
-	double value;
+					if (FLT_NEQ(tmpd, vcnts[i].value))
+						continue;
 
-	uint32_t a = 0;
-	uint32_t i = 0;
-	uint32_t j = 0;
-	uint32_t k = 0;
-	uint32_t x = 0;
-	uint32_t y = 0;
-	uint32_t z = 0;
-	uint32_t idx = 0;
-	uint32_t offset = 0;
-	uint32_t diff = 0;
-	uint8_t exists = 0;
+					vcnts[i].count = band->width * band->height;
+					if (NULL != rtn_total) *rtn_total = vcnts[i].count;
+					vcnts->percent = 1.0;
+				}
 
-	uint32_t do_sample = 0;
-	uint32_t sample_size = 0;
-	uint32_t sample_per = 0;
-	uint32_t sample_int = 0;
-	int status;
+				*rtn_count = vcnts_count;
+			}
+			/* no defined search values */
+			else {
+				vcnts = (rt_valuecount) rtalloc(sizeof(struct rt_valuecount_t));
+				if (NULL == vcnts) {
+					rterror("rt_band_get_count_of_values: Unable to allocate memory for value counts");
+					*rtn_count = 0;
+					return NULL;
+				}
 
-	RASTER_DEBUG(3, "starting");
+				vcnts->value = nodata;
+				vcnts->count = band->width * band->height;
+				if (NULL != rtn_total) *rtn_total = vcnts[i].count;
+				vcnts->percent = 1.0;
 
-	assert(NULL != band);
-	assert(cov_count > 1);
-	RASTER_DEBUGF(3, "cov_count = %d", cov_count);
+				*rtn_count = 1;
+			}
 
+			return vcnts;
+		}
+	}
 
-	data = rt_band_get_data(band);
-	if (data == NULL) {
-		rterror("rt_band_get_summary_stats: Cannot get band data");
+	pxlvals = rtalloc(sizeof(double) * band->width);
+	if (NULL == pxlvals) {
+		rterror("rt_band_get_count_of_values: Unable to allocate memory for pixel values");
+		if (NULL != vcnts) rtdealloc(vcnts);
+		*rtn_count = 0;
 		return NULL;
 	}
 
-	hasnodata = rt_band_get_hasnodata_flag(band);
-	if (hasnodata != FALSE)
-		nodata = rt_band_get_nodata(band);
-	else
-		exclude_nodata_value = 0;
-	RASTER_DEBUGF(3, "nodata = %f", nodata);
-	RASTER_DEBUGF(3, "hasnodata = %d", hasnodata);
-	RASTER_DEBUGF(3, "exclude_nodata_value = %d", exclude_nodata_value);
+	/*
+		pixels are read a row at a time but the values are reported
+		in the order they are found column by column, so remember
+		the column-major position of each value's first pixel
+	*/
+	for (y = 0; y < band->height; y++) {
+		line = rt_band_get_pixel_line(band, 0, y, band->width);
+		if (NULL == line || !rt_pixtype_to_double(pixtype, line, band->width, pxlvals)) {
+			rterror("rt_band_get_count_of_values: Unable to get pixel values of row %d", y);
+			rtdealloc(pxlvals);
+			if (NULL != first) rtdealloc(first);
+			if (NULL != vcnts) rtdealloc(vcnts);
+			*rtn_count = 0;
+			return NULL;
+		}
 
-	/* quantile_llist not provided */
-	if (NULL == *qlls) {
-		/* quantiles not provided */
-		if (NULL == quantiles) {
-			/* quantile count not specified, default to quartiles */
-			if (quantiles_count < 2)
-				quantiles_count = 5;
-
-			quantiles = rtalloc(sizeof(double) * quantiles_count);
-			init_quantiles = 1;
-			if (NULL == quantiles) {
-				rterror("rt_band_get_quantiles_stream: Unable to allocate memory for quantile input");
-				return NULL;
-			}
+		for (x = 0; x < band->width; x++) {
+			pxlval = pxlvals[x];
+			pos = (x * band->height) + y;
 
-			quantiles_count--;
-			for (i = 0; i <= quantiles_count; i++)
-				quantiles[i] = ((double) i) / quantiles_count;
-			quantiles_count++;
-		}
+			if (
+				!exclude_nodata_value || (
+					exclude_nodata_value &&
+					(hasnodata != FALSE) &&
+					FLT_NEQ(pxlval, nodata)
+				)
+			) {
+				total++;
+				if (doround) {
+					rpxlval = ROUND(pxlval, scale);
+				}
+				else
+					rpxlval = pxlval;
+				RASTER_DEBUGF(5, "(pxlval, rpxlval) => (%0.6f, %0.6f)", pxlval, rpxlval);
 
-		/* check quantiles */
-		for (i = 0; i < quantiles_count; i++) {
-			if (quantiles[i] < 0. || quantiles[i] > 1.) {
-				rterror("rt_band_get_quantiles_stream: Quantile value not between 0 and 1");
-				if (init_quantiles) rtdealloc(quantiles);
-				return NULL;
+				new_valuecount = 1;
+				/* search for match in existing valuecounts */
+				for (i = 0; i < vcnts_count; i++) {
+					/* match found */
+					if (FLT_EQ(vcnts[i].value, rpxlval)) {
+						vcnts[i].count++;
+						if (NULL != first && pos < first[i]) first[i] = pos;
+						new_valuecount = 0;
+						RASTER_DEBUGF(5, "(value, count) => (%0.6f, %d)", vcnts[i].value, vcnts[i].count);
+						break;
+					}
+				}
+
+				/*
+					don't add new valuecount either because
+						- no need for new one
+						- user-defined search values
+				*/
+				if (!new_valuecount || search_values_count > 0) continue;
+
+				/* add new valuecount */
+				vcnts = rtrealloc(vcnts, sizeof(struct rt_valuecount_t) * (vcnts_count + 1));
+				first = rtrealloc(first, sizeof(uint32_t) * (vcnts_count + 1));
+				if (NULL == vcnts || NULL == first) {
+					rterror("rt_band_get_count_of_values: Unable to allocate memory for value counts");
+					rtdealloc(pxlvals);
+					*rtn_count = 0;
+					return NULL;
+				}
+
+				vcnts[vcnts_count].value = rpxlval;
+				vcnts[vcnts_count].count = 1;
+				vcnts[vcnts_count].percent = 0;
+				first[vcnts_count] = pos;
+				RASTER_DEBUGF(5, "(value, count) => (%0.6f, %d)", vcnts[vcnts_count].value, vcnts[vcnts_count].count);
+				vcnts_count++;
 			}
 		}
-		quicksort(quantiles, quantiles + quantiles_count - 1);
+	}
+	rtdealloc(pxlvals);
 
-		/* initialize linked-list set */
-		*qlls_count = quantiles_count * 2;
-		RASTER_DEBUGF(4, "qlls_count = %d", *qlls_count);
-		*qlls = rtalloc(sizeof(struct quantile_llist) * *qlls_count);
-		if (NULL == *qlls) {
-			rterror("rt_band_get_quantiles_stream: Unable to allocate memory for quantile output");
-			if (init_quantiles) rtdealloc(quantiles);
+	/* put the values back in column-major order */
+	if (NULL != first && vcnts_count > 1) {
+		struct _rti_valuecount_first_t *order = NULL;
+		rt_valuecount sorted = NULL;
+
+		order = rtalloc(sizeof(struct _rti_valuecount_first_t) * vcnts_count);
+		sorted = rtalloc(sizeof(struct rt_valuecount_t) * vcnts_count);
+		if (NULL == order || NULL == sorted) {
+			rterror("rt_band_get_count_of_values: Unable to allocate memory for value counts");
+			if (NULL != order) rtdealloc(order);
+			if (NULL != sorted) rtdealloc(sorted);
+			rtdealloc(first);
+			rtdealloc(vcnts);
+			*rtn_count = 0;
 			return NULL;
 		}
 
-		j = (uint32_t) floor(MAX_VALUES / 100.) + 1;
-		for (i = 0; i < *qlls_count; i++) {
-			qll = &((*qlls)[i]);
-			qll->quantile = quantiles[(i * quantiles_count) / *qlls_count];
-			qll->count = 0;
-			qll->sum1 = 0;
-			qll->sum2 = 0;
-			qll->head = NULL;
-			qll->tail = NULL;
-
-			/* initialize index */
-			qll->index = rtalloc(sizeof(struct quantile_llist_index) * j);
-			if (NULL == qll->index) {
-				rterror("rt_band_get_quantiles_stream: Unable to allocate memory for quantile output");
-				if (init_quantiles) rtdealloc(quantiles);
-				return NULL;
-			}
-			qll->index_max = j;
-			quantile_llist_index_reset(qll);
-
-			/* AL-GEQ */
-			if (!(i % 2)) {
-				qll->algeq = 1;
-				qll->tau = (uint64_t) ROUND(cov_count - (cov_count * qll->quantile), 0);
-				if (qll->tau < 1) qll->tau = 1;
-			}
-			/* AL-GT */
-			else {
-				qll->algeq = 0;
-				qll->tau = cov_count - (*qlls)[i - 1].tau + 1;
-			}
-
-			RASTER_DEBUGF(4, "qll init: (algeq, quantile, count, tau, sum1, sum2) = (%d, %f, %d, %d, %d, %d)",
-				qll->algeq, qll->quantile, qll->count, qll->tau, qll->sum1, qll->sum2);
-			RASTER_DEBUGF(4, "qll init: (head, tail) = (%p, %p)", qll->head, qll->tail);
+		for (i = 0; i < vcnts_count; i++) {
+			order[i].first = first[i];
+			order[i].idx = i;
 		}
+		qsort(order, vcnts_count, sizeof(struct _rti_valuecount_first_t), _rti_valuecount_first_cmp);
+		for (i = 0; i < vcnts_count; i++)
+			sorted[i] = vcnts[order[i].idx];
 
-		if (init_quantiles) rtdealloc(quantiles);
+		rtdealloc(order);
+		rtdealloc(vcnts);
+		vcnts = sorted;
 	}
+	if (NULL != first) rtdealloc(first);
 
-	/* clamp percentage */
-	if (
-		(sample < 0 || FLT_EQ(sample, 0.0)) ||
-		(sample > 1 || FLT_EQ(sample, 1.0))
-	) {
-		do_sample = 0;
-		sample = 1;
-	}
-	else
-		do_sample = 1;
-	RASTER_DEBUGF(3, "do_sample = %d", do_sample);
+#if POSTGIS_DEBUG_LEVEL > 0
+	stop = clock();
+	elapsed = ((double) (stop - start)) / CLOCKS_PER_SEC;
+	RASTER_DEBUGF(3, "elapsed time = %0.4f", elapsed);
+#endif
 
-	/* sample all pixels */
-	if (!do_sample) {
-		sample_size = band->width * band->height;
-		sample_per = band->height;
-	}
-	/*
-	 randomly sample a percentage of available pixels
-	 sampling method is known as
-	 	"systematic random sample without replacement"
-	*/
-	else {
-		sample_size = round((band->width * band->height) * sample);
-		sample_per = round(sample_size / band->width);
-		sample_int = round(band->height / sample_per);
-		srand(time(NULL));
+	for (i = 0; i < vcnts_count; i++) {
+		vcnts[i].percent = (double) vcnts[i].count / total;
+		RASTER_DEBUGF(5, "(value, count) => (%0.6f, %d)", vcnts[i].value, vcnts[i].count);
 	}
-	RASTER_DEBUGF(3, "sampling %d of %d available pixels w/ %d per set"
-		, sample_size, (band->width * band->height), sample_per);
 
-	for (x = 0, j = 0, k = 0; x < band->width; x++) {
-		y = -1;
-		diff = 0;
+	RASTER_DEBUG(3, "done");
+	if (NULL != rtn_total) *rtn_total = total;
+	*rtn_count = vcnts_count;
+	return vcnts;
+}
 
-		for (i = 0, z = 0; i < sample_per; i++) {
-			if (do_sample != 1)
-				y = i;
-			else {
-				offset = (rand() % sample_int) + 1;
-				y += diff + offset;
-				diff = sample_int - offset;
-			}
-			RASTER_DEBUGF(5, "(x, y, z) = (%d, %d, %d)", x, y, z);
-			if (y >= band->height || z > sample_per) break;
+/**
+ * Returns new band with values reclassified
+ *
+ * @param srcband : the band who's values will be reclassified
+ * @param pixtype : pixel type of the new band
+ * @param hasnodata : indicates if the band has a nodata value
+ * @param nodataval : nodata value for the new band
+ * @param exprset : array of rt_reclassexpr structs
+ * @param exprcount : number of elements in expr
+ *
+ * @return a new rt_band or 0 on error
+ */
+rt_band
+rt_band_reclass(rt_band srcband, rt_pixtype pixtype,
+	uint32_t hasnodata, double nodataval, rt_reclassexpr *exprset,
+	int exprcount) {
+	rt_band band = NULL;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	int numval = 0;
+	int memsize = 0;
+	void *mem = NULL;
+	uint32_t src_hasnodata = 0;
+	double src_nodataval = 0.0;
 
-			status = rt_band_get_pixel(band, x, y, &value);
+	void *line = NULL;
+	double *ovs = NULL;
+	double *nvs = NULL;
+	uint32_t x;
+	uint32_t y;
+	int i;
+	double or = 0;
+	double ov = 0;
+	double nr = 0;
+	double nv = 0;
+	int do_nv = 0;
+	rt_reclassexpr expr = NULL;
 
-			j++;
-			if (
-				status != -1 && (
-					!exclude_nodata_value || (
-						exclude_nodata_value &&
-						(hasnodata != FALSE) &&
-						FLT_NEQ(value, nodata)
-					)
-				)
-			) {
+	assert(NULL != srcband);
+	assert(NULL != exprset);
 
-				/* process each quantile */
-				for (a = 0; a < *qlls_count; a++) {
-					qll = &((*qlls)[a]);
-					qls = NULL;
-					RASTER_DEBUGF(4, "%d of %d (%f)", a + 1, *qlls_count, qll->quantile);
-					RASTER_DEBUGF(5, "qll before: (algeq, quantile, count, tau, sum1, sum2) = (%d, %f, %d, %d, %d, %d)",
-						qll->algeq, qll->quantile, qll->count, qll->tau, qll->sum1, qll->sum2);
-					RASTER_DEBUGF(5, "qll before: (head, tail) = (%p, %p)", qll->head, qll->tail);
-
-					/* OPTIMIZATION: shortcuts for quantiles of zero or one */
-					if (FLT_EQ(qll->quantile, 0.)) {
-						if (NULL != qll->head) {
-							if (value < qll->head->value)
-								qll->head->value = value;
-						}
-						else {
-							qle = quantile_llist_insert(qll->head, value, NULL);
-							qll->head = qle;
-							qll->tail = qle;
-							qll->count = 1;
-						}
+	/* source nodata */
+	src_hasnodata = rt_band_get_hasnodata_flag(srcband);
+	src_nodataval = rt_band_get_nodata(srcband);
 
-						RASTER_DEBUGF(4, "quantile shortcut for %f\n\n", qll->quantile);
-						continue;
-					}
-					else if (FLT_EQ(qll->quantile, 1.)) {
-						if (NULL != qll->head) {
-							if (value > qll->head->value)
-								qll->head->value = value;
-						}
-						else {
-							qle = quantile_llist_insert(qll->head, value, NULL);
-							qll->head = qle;
-							qll->tail = qle;
-							qll->count = 1;
-						}
+	/* size of memory block to allocate */
+	width = rt_band_get_width(srcband);
+	height = rt_band_get_height(srcband);
+	numval = width * height;
+	memsize = rt_pixtype_size(pixtype) * numval;
+	mem = (int *) rtalloc(memsize);
+	if (!mem) {
+		rterror("rt_band_reclass: Could not allocate memory for band");
+		return 0;
+	}
 
-						RASTER_DEBUGF(4, "quantile shortcut for %f\n\n", qll->quantile);
-						continue;
-					}
+	/* initialize to zero */
+	if (!hasnodata) {
+		memset(mem, 0, memsize);
+	}
+	/* initialize to nodataval */
+	else {
+		int32_t checkvalint = 0;
+		uint32_t checkvaluint = 0;
+		double checkvaldouble = 0;
+		float checkvalfloat = 0;
 
-					/* value exists in list */
-					/* OPTIMIZATION: check to see if value exceeds last value */
-					if (NULL != qll->tail && value > qll->tail->value)
-						qle = NULL;
-					/* OPTIMIZATION: check to see if value equals last value */
-					else if (NULL != qll->tail && FLT_EQ(value, qll->tail->value))
-						qle = qll->tail;
-					/* OPTIMIZATION: use index if possible */
-					else {
-						qls = quantile_llist_index_search(qll, value, &idx);
-						qle = quantile_llist_search(qls, value);
-					}
+		switch (pixtype) {
+			case PT_1BB:
+			{
+				uint8_t *ptr = mem;
+				uint8_t clamped_initval = rt_util_clamp_to_1BB(nodataval);
+				for (i = 0; i < numval; i++)
+					ptr[i] = clamped_initval;
+				checkvalint = ptr[0];
+				break;
+			}
+			case PT_2BUI:
+			{
+				uint8_t *ptr = mem;
+				uint8_t clamped_initval = rt_util_clamp_to_2BUI(nodataval);
+				for (i = 0; i < numval; i++)
+					ptr[i] = clamped_initval;
+				checkvalint = ptr[0];
+				break;
+			}
+			case PT_4BUI:
+			{
+				uint8_t *ptr = mem;
+				uint8_t clamped_initval = rt_util_clamp_to_4BUI(nodataval);
+				for (i = 0; i < numval; i++)
+					ptr[i] = clamped_initval;
+				checkvalint = ptr[0];
+				break;
+			}
+			case PT_8BSI:
+			{
+				int8_t *ptr = mem;
+				int8_t clamped_initval = rt_util_clamp_to_8BSI(nodataval);
+				for (i = 0; i < numval; i++)
+					ptr[i] = clamped_initval;
+				checkvalint = ptr[0];
+				break;
+			}
+			case PT_8BUI:
+			{
+				uint8_t *ptr = mem;
+				uint8_t clamped_initval = rt_util_clamp_to_8BUI(nodataval);
+				for (i = 0; i < numval; i++)
+					ptr[i] = clamped_initval;
+				checkvalint = ptr[0];
+				break;
+			}
+			case PT_16BSI:
+			{
+				int16_t *ptr = mem;
+				int16_t clamped_initval = rt_util_clamp_to_16BSI(nodataval);
+				for (i = 0; i < numval; i++)
+					ptr[i] = clamped_initval;
+				checkvalint = ptr[0];
+				break;
+			}
+			case PT_16BUI:
+			{
+				uint16_t *ptr = mem;
+				uint16_t clamped_initval = rt_util_clamp_to_16BUI(nodataval);
+				for (i = 0; i < numval; i++)
+					ptr[i] = clamped_initval;
+				checkvalint = ptr[0];
+				break;
+			}
+			case PT_32BSI:
+			{
+				int32_t *ptr = mem;
+				int32_t clamped_initval = rt_util_clamp_to_32BSI(nodataval);
+				for (i = 0; i < numval; i++)
+					ptr[i] = clamped_initval;
+				checkvalint = ptr[0];
+				break;
+			}
+			case PT_32BUI:
+			{
+				uint32_t *ptr = mem;
+				uint32_t clamped_initval = rt_util_clamp_to_32BUI(nodataval);
+				for (i = 0; i < numval; i++)
+					ptr[i] = clamped_initval;
+				checkvaluint = ptr[0];
+				break;
+			}
+			case PT_32BF:
+			{
+				float *ptr = mem;
+				float clamped_initval = rt_util_clamp_to_32F(nodataval);
+				for (i = 0; i < numval; i++)
+					ptr[i] = clamped_initval;
+				checkvalfloat = ptr[0];
+				break;
+			}
+			case PT_64BF:
+			{
+				double *ptr = mem;
+				for (i = 0; i < numval; i++)
+					ptr[i] = nodataval;
+				checkvaldouble = ptr[0];
+				break;
+			}
+			default:
+			{
+				rterror("rt_band_reclass: Unknown pixeltype %d", pixtype);
+				rtdealloc(mem);
+				return 0;
+			}
+		}
 
-					/* value found */
-					if (NULL != qle) {
-						RASTER_DEBUGF(4, "%f found in list", value);
-						RASTER_DEBUGF(5, "qle before: (value, count) = (%f, %d)", qle->value, qle->count);
+		/* Overflow checking */
+		rt_util_dbl_trunc_warning(
+			nodataval,
+			checkvalint, checkvaluint,
+			checkvalfloat, checkvaldouble,
+			pixtype
+		);
+	}
+	RASTER_DEBUGF(3, "rt_band_reclass: width = %d height = %d", width, height);
 
-						qle->count++;
-						qll->sum1++;
+	band = rt_band_new_inline(width, height, pixtype, hasnodata, nodataval, mem);
+	if (!band) {
+		rterror("rt_band_reclass: Could not create new band");
+		rtdealloc(mem);
+		return 0;
+	}
+	RASTER_DEBUGF(3, "rt_band_reclass: new band @ %p", band);
 
-						if (qll->algeq)
-							qll->sum2 = qll->sum1 - qll->head->count;
-						else
-							qll->sum2 = qll->sum1 - qll->tail->count;
+	/* a row of values of each band */
+	ovs = rtalloc(sizeof(double) * width);
+	nvs = rtalloc(sizeof(double) * width);
+	if (NULL == ovs || NULL == nvs) {
+		rterror("rt_band_reclass: Could not allocate memory for pixel values");
+		if (NULL != ovs) rtdealloc(ovs);
+		if (NULL != nvs) rtdealloc(nvs);
+		rt_band_destroy(band);
+		rtdealloc(mem);
+		return 0;
+	}
 
-						RASTER_DEBUGF(4, "qle after: (value, count) = (%f, %d)", qle->value, qle->count);
-					}
-					/* can still add element */
-					else if (qll->count < MAX_VALUES) {
-						RASTER_DEBUGF(4, "Adding %f to list", value);
-
-						/* insert */
-						/* OPTIMIZATION: check to see if value exceeds last value */
-						if (NULL != qll->tail && (value > qll->tail->value || FLT_EQ(value, qll->tail->value))) {
-							idx = qll->count;
-							qle = quantile_llist_insert(qll->tail, value, &idx);
-						}
-						/* OPTIMIZATION: use index if possible */
-						else
-							qle = quantile_llist_insert(qls, value, &idx);
-						if (NULL == qle) return NULL;
-						RASTER_DEBUGF(5, "value added at index: %d => %f", idx, value);
-						qll->count++;
-						qll->sum1++;
-
-						/* first element */
-						if (NULL == qle->prev)
-							qll->head = qle;
-						/* last element */
-						if (NULL == qle->next)
-							qll->tail = qle;
-
-						if (qll->algeq)
-							qll->sum2 = qll->sum1 - qll->head->count;
-						else
-							qll->sum2 = qll->sum1 - qll->tail->count;
+	for (y = 0; y < height; y++) {
+		line = rt_band_get_pixel_line(srcband, 0, y, width);
+		if (NULL == line || !rt_pixtype_to_double(srcband->pixtype, line, width, ovs)) {
+			rterror("rt_band_reclass: Could not get values of row %d", y);
+			rtdealloc(ovs);
+			rtdealloc(nvs);
+			rt_band_destroy(band);
+			rtdealloc(mem);
+			return 0;
+		}
 
-						/* index is only needed if there are at least 100 values */
-						quantile_llist_index_update(qll, qle, idx);
+		/* pixels no expression matches keep the initial value */
+		line = rt_band_get_pixel_line(band, 0, y, width);
+		rt_pixtype_to_double(pixtype, line, width, nvs);
 
-						RASTER_DEBUGF(5, "qle, prev, next, head, tail = %p, %p, %p, %p, %p", qle, qle->prev, qle->next, qll->head, qll->tail);
-					}
-					/* AL-GEQ */
-					else if (qll->algeq) {
-						RASTER_DEBUGF(4, "value, head->value = %f, %f", value, qll->head->value);
-
-						if (value < qll->head->value) {
-							/* ignore value if test isn't true */
-							if (qll->sum1 >= qll->tau) {
-								RASTER_DEBUGF(4, "skipping %f", value);
-							}
-							else {
-
-								/* delete last element */
-								RASTER_DEBUGF(4, "deleting %f from list", qll->tail->value);
-								qle = qll->tail->prev;
-								RASTER_DEBUGF(5, "to-be tail is %f with count %d", qle->value, qle->count);
-								qle->count += qll->tail->count;
-								quantile_llist_index_delete(qll, qll->tail);
-								quantile_llist_delete(qll->tail);
-								qll->tail = qle;
-								qll->count--;
-								RASTER_DEBUGF(5, "tail is %f with count %d", qll->tail->value, qll->tail->count);
-
-								/* insert value */
-								RASTER_DEBUGF(4, "adding %f to list", value);
-								/* OPTIMIZATION: check to see if value exceeds last value */
-								if (NULL != qll->tail && (value > qll->tail->value || FLT_EQ(value, qll->tail->value))) {
-									idx = qll->count;
-									qle = quantile_llist_insert(qll->tail, value, &idx);
-								}
-								/* OPTIMIZATION: use index if possible */
-								else {
-									qls = quantile_llist_index_search(qll, value, &idx);
-									qle = quantile_llist_insert(qls, value, &idx);
-								}
-								if (NULL == qle) return NULL;
-								RASTER_DEBUGF(5, "value added at index: %d => %f", idx, value);
-								qll->count++;
-								qll->sum1++;
-
-								/* first element */
-								if (NULL == qle->prev)
-									qll->head = qle;
-								/* last element */
-								if (NULL == qle->next)
-									qll->tail = qle;
-
-								qll->sum2 = qll->sum1 - qll->head->count;
-
-								quantile_llist_index_update(qll, qle, idx);
-
-								RASTER_DEBUGF(5, "qle, head, tail = %p, %p, %p", qle, qll->head, qll->tail);
+		for (x = 0; x < width; x++) {
+			ov = ovs[x];
 
-							}
-						}
-						else {
-							qle = qll->tail;
-							while (NULL != qle) {
-								if (qle->value < value) {
-									qle->count++;
-									qll->sum1++;
-									qll->sum2 = qll->sum1 - qll->head->count;
-									RASTER_DEBUGF(4, "incremented count of %f by 1 to %d", qle->value, qle->count);
-									break;
-								}
+			do {
+				do_nv = 0;
 
-								qle = qle->prev;
-							}
-						}
-					}
-					/* AL-GT */
-					else {
-						RASTER_DEBUGF(4, "value, tail->value = %f, %f", value, qll->tail->value);
+				/* no data*/
+				if (src_hasnodata && hasnodata && ov == src_nodataval) {
+					do_nv = 1;
+					break;
+				}
 
-						if (value > qll->tail->value) {
-							/* ignore value if test isn't true */
-							if (qll->sum1 >= qll->tau) {
-								RASTER_DEBUGF(4, "skipping %f", value);
-							}
-							else {
-
-								/* delete last element */
-								RASTER_DEBUGF(4, "deleting %f from list", qll->head->value);
-								qle = qll->head->next;
-								RASTER_DEBUGF(5, "to-be tail is %f with count %d", qle->value, qle->count);
-								qle->count += qll->head->count;
-								quantile_llist_index_delete(qll, qll->head);
-								quantile_llist_delete(qll->head);
-								qll->head = qle;
-								qll->count--;
-								quantile_llist_index_update(qll, NULL, 0);
-								RASTER_DEBUGF(5, "tail is %f with count %d", qll->head->value, qll->head->count);
-
-								/* insert value */
-								RASTER_DEBUGF(4, "adding %f to list", value);
-								/* OPTIMIZATION: check to see if value exceeds last value */
-								if (NULL != qll->tail && (value > qll->tail->value || FLT_EQ(value, qll->tail->value))) {
-									idx = qll->count;
-									qle = quantile_llist_insert(qll->tail, value, &idx);
-								}
-								/* OPTIMIZATION: use index if possible */
-								else {
-									qls = quantile_llist_index_search(qll, value, &idx);
-									qle = quantile_llist_insert(qls, value, &idx);
-								}
-								if (NULL == qle) return NULL;
-								RASTER_DEBUGF(5, "value added at index: %d => %f", idx, value);
-								qll->count++;
-								qll->sum1++;
-
-								/* first element */
-								if (NULL == qle->prev)
-									qll->head = qle;
-								/* last element */
-								if (NULL == qle->next)
-									qll->tail = qle;
-
-								qll->sum2 = qll->sum1 - qll->tail->count;
-
-								quantile_llist_index_update(qll, qle, idx);
-
-								RASTER_DEBUGF(5, "qle, head, tail = %p, %p, %p", qle, qll->head, qll->tail);
-
-							}
-						}
-						else {
-							qle = qll->head;
-							while (NULL != qle) {
-								if (qle->value > value) {
-									qle->count++;
-									qll->sum1++;
-									qll->sum2 = qll->sum1 - qll->tail->count;
-									RASTER_DEBUGF(4, "incremented count of %f by 1 to %d", qle->value, qle->count);
-									break;
-								}
+				for (i = 0; i < exprcount; i++) {
+					expr = exprset[i];
 
-								qle = qle->next;
-							}
-						}
+					/* ov matches min and max*/
+					if (
+						FLT_EQ(expr->src.min, ov) &&
+						FLT_EQ(expr->src.max, ov)
+					) {
+						do_nv = 1;
+						break;
 					}
 
-					RASTER_DEBUGF(5, "sum2, tau = %d, %d", qll->sum2, qll->tau);
-					if (qll->sum2 >= qll->tau) {
-						/* AL-GEQ */
-						if (qll->algeq) {
-							RASTER_DEBUGF(4, "deleting first element %f from list", qll->head->value);
-
-							if (NULL != qll->head->next) {
-								qle = qll->head->next;
-								qll->sum1 -= qll->head->count;
-								qll->sum2 = qll->sum1 - qle->count;
-								quantile_llist_index_delete(qll, qll->head);
-								quantile_llist_delete(qll->head);
-								qll->head = qle;
-								qll->count--;
-
-								quantile_llist_index_update(qll, NULL, 0);
-							}
-							else {
-								quantile_llist_delete(qll->head);
-								qll->head = NULL;
-								qll->tail = NULL;
-								qll->sum1 = 0;
-								qll->sum2 = 0;
-								qll->count = 0;
-
-								quantile_llist_index_reset(qll);
-							}
-						}
-						/* AL-GT */
-						else {
-							RASTER_DEBUGF(4, "deleting first element %f from list", qll->tail->value);
-
-							if (NULL != qll->tail->prev) {
-								qle = qll->tail->prev;
-								qll->sum1 -= qll->tail->count;
-								qll->sum2 = qll->sum1 - qle->count;
-								quantile_llist_index_delete(qll, qll->tail);
-								quantile_llist_delete(qll->tail);
-								qll->tail = qle;
-								qll->count--;
-							}
-							else {
-								quantile_llist_delete(qll->tail);
-								qll->head = NULL;
-								qll->tail = NULL;
-								qll->sum1 = 0;
-								qll->sum2 = 0;
-								qll->count = 0;
-
-								quantile_llist_index_reset(qll);
-							}
+					/* process min */
+					if ((
+						expr->src.exc_min && (
+							expr->src.min > ov ||
+							FLT_EQ(expr->src.min, ov)
+						)) || (
+						expr->src.inc_min && (
+							expr->src.min < ov ||
+							FLT_EQ(expr->src.min, ov)
+						)) || (
+						expr->src.min < ov
+					)) {
+						/* process max */
+						if ((
+							expr->src.exc_max && (
+								ov > expr->src.max ||
+								FLT_EQ(expr->src.max, ov)
+							)) || (
+								expr->src.inc_max && (
+								ov < expr->src.max ||
+								FLT_EQ(expr->src.max, ov)
+							)) || (
+							ov < expr->src.max
+						)) {
+							do_nv = 1;
+							break;
 						}
 					}
-
-					RASTER_DEBUGF(5, "qll after: (algeq, quantile, count, tau, sum1, sum2) = (%d, %f, %d, %d, %d, %d)",
-						qll->algeq, qll->quantile, qll->count, qll->tau, qll->sum1, qll->sum2);
-					RASTER_DEBUGF(5, "qll after: (head, tail) = (%p, %p)\n\n", qll->head, qll->tail);
 				}
+			}
+			while (0);
+
+			/* no expression matched, do not continue */
+			if (!do_nv) continue;
+
+			/* converting a value from one range to another range
+			OldRange = (OldMax - OldMin)
+			NewRange = (NewMax - NewMin)
+			NewValue = (((OldValue - OldMin) * NewRange) / OldRange) + NewMin
+			*/
 
+			/* nodata */
+			if (
+				src_hasnodata &&
+				hasnodata &&
+				FLT_EQ(ov, src_nodataval)
+			) {
+				nv = nodataval;
+			}
+			/*
+				"src" min and max is the same, prevent division by zero
+				set nv to "dst" min, which should be the same as "dst" max
+			*/
+			else if (FLT_EQ(expr->src.max, expr->src.min)) {
+				nv = expr->dst.min;
 			}
 			else {
-				RASTER_DEBUGF(5, "skipping value at (x, y) = (%d, %d)", x, y);
+				or = expr->src.max - expr->src.min;
+				nr = expr->dst.max - expr->dst.min;
+				nv = (((ov - expr->src.min) * nr) / or) + expr->dst.min;
+
+				/* if dst range is from high to low */
+				if (expr->dst.min > expr->dst.max) {
+					if (nv > expr->dst.min)
+						nv = expr->dst.min;
+					else if (nv < expr->dst.max)
+						nv = expr->dst.max;
+				}
+				/* if dst range is from low to high */
+				else {
+					if (nv < expr->dst.min)
+						nv = expr->dst.min;
+					else if (nv > expr->dst.max)
+						nv = expr->dst.max;
+				}
+			}
+
+			/* round the value for integers */
+			switch (pixtype) {
+				case PT_1BB:
+				case PT_2BUI:
+				case PT_4BUI:
+				case PT_8BSI:
+				case PT_8BUI:
+				case PT_16BSI:
+				case PT_16BUI:
+				case PT_32BSI:
+				case PT_32BUI:
+					nv = round(nv);
+					break;
+				default:
+					break;
 			}
 
-			z++;
+			RASTER_DEBUGF(3, "(%d, %d) ov: %f or: %f - %f nr: %f - %f nv: %f"
+				, x
+				, y
+				, ov
+				, (NULL != expr) ? expr->src.min : 0
+				, (NULL != expr) ? expr->src.max : 0
+				, (NULL != expr) ? expr->dst.min : 0
+				, (NULL != expr) ? expr->dst.max : 0
+				, nv
+			);
+			nvs[x] = nv;
+
+			expr = NULL;
 		}
+
+		rt_pixtype_from_double(pixtype, nvs, width, line);
 	}
 
-	/* process quantiles */
-	*rtn_count = *qlls_count / 2;
-	rtn = rtalloc(sizeof(struct rt_quantile_t) * *rtn_count);
-	if (NULL == rtn) return NULL;
+	rtdealloc(ovs);
+	rtdealloc(nvs);
 
-	RASTER_DEBUGF(3, "returning %d quantiles", *rtn_count);
-	for (i = 0, k = 0; i < *qlls_count; i++) {
-		qll = &((*qlls)[i]);
+	return band;
+}
 
-		exists = 0;
-		for (x = 0; x < k; x++) {
-			if (FLT_EQ(qll->quantile, rtn[x].quantile)) {
-				exists = 1;
-				break;
-			}
-		}
-		if (exists) continue;
+/*- rt_raster --------------------------------------------------------*/
 
-		RASTER_DEBUGF(5, "qll: (algeq, quantile, count, tau, sum1, sum2) = (%d, %f, %d, %d, %d, %d)",
-			qll->algeq, qll->quantile, qll->count, qll->tau, qll->sum1, qll->sum2);
-		RASTER_DEBUGF(5, "qll: (head, tail) = (%p, %p)", qll->head, qll->tail);
+rt_raster
+rt_raster_new(uint16_t width, uint16_t height) {
+    rt_raster ret = NULL;
 
-		rtn[k].quantile = qll->quantile;
-		rtn[k].has_value = 0;
 
-		/* check that qll->head and qll->tail have value */
-		if (qll->head == NULL || qll->tail == NULL)
-			continue;
 
-		/* AL-GEQ */
-		if (qll->algeq)
-			qle = qll->head;
-		/* AM-GT */
-		else
-			qle = qll->tail;
+    ret = (rt_raster) rtalloc(sizeof (struct rt_raster_t));
+    if (!ret) {
+        rterror("rt_raster_new: Out of virtual memory creating an rt_raster");
+        return 0;
+    }
 
-		exists = 0;
-		for (j = i + 1; j < *qlls_count; j++) {
-			if (FLT_EQ((*qlls)[j].quantile, qll->quantile)) {
+    RASTER_DEBUGF(3, "Created rt_raster @ %p", ret);
 
-				RASTER_DEBUGF(5, "qlls[%d]: (algeq, quantile, count, tau, sum1, sum2) = (%d, %f, %d, %d, %d, %d)",
-					j, (*qlls)[j].algeq, (*qlls)[j].quantile, (*qlls)[j].count, (*qlls)[j].tau, (*qlls)[j].sum1, (*qlls)[j].sum2);
-				RASTER_DEBUGF(5, "qlls[%d]: (head, tail) = (%p, %p)", j, (*qlls)[j].head, (*qlls)[j].tail);
+    assert(NULL != ret);
 
-				exists = 1;
-				break;
-			}
-		}
+    ret->width = width;
 
-		/* weighted average for quantile */
-		if (exists) {
-			if ((*qlls)[j].algeq) {
-				rtn[k].value = ((qle->value * qle->count) + ((*qlls)[j].head->value * (*qlls)[j].head->count)) / (qle->count + (*qlls)[j].head->count);
-				RASTER_DEBUGF(5, "qlls[%d].head: (value, count) = (%f, %d)", j, (*qlls)[j].head->value, (*qlls)[j].head->count);
-			}
-			else {
-				rtn[k].value = ((qle->value * qle->count) + ((*qlls)[j].tail->value * (*qlls)[j].tail->count)) / (qle->count + (*qlls)[j].tail->count);
-				RASTER_DEBUGF(5, "qlls[%d].tail: (value, count) = (%f, %d)", j, (*qlls)[j].tail->value, (*qlls)[j].tail->count);
-			}
-		}
-		/* straight value for quantile */
-		else {
-			rtn[k].value = qle->value;
-		}
-		rtn[k].has_value = 1;
-		RASTER_DEBUGF(3, "(quantile, value) = (%f, %f)\n\n", rtn[k].quantile, rtn[k].value);
+    ret->height = height;
+    ret->scaleX = 1;
+    ret->scaleY = 1;
+    ret->ipX = 0.0;
+    ret->ipY = 0.0;
+    ret->skewX = 0.0;
+    ret->skewY = 0.0;
+    ret->srid = SRID_UNKNOWN;
 
-		k++;
-	}
+    ret->numBands = 0;
+    ret->bands = 0;
+    ret->cachedstats = NULL;
 
-	RASTER_DEBUG(3, "done");
-	return rtn;
+    return ret;
 }
 
-/**
- * Count the number of times provided value(s) occur in
- * the band
- *
- * @param band: the band to query for minimum and maximum pixel values
- * @param exclude_nodata_value: if non-zero, ignore nodata values
- * @param search_values: array of values to count
- * @param search_values_count: the number of search values
- * @param roundto: the decimal place to round the values to
- * @param rtn_total: the number of pixels examined in the band
- * @param rtn_count: the number of value counts being returned
- *
- * @return the number of times the provide value(s) occur
- */
-rt_valuecount
-rt_band_get_value_count(rt_band band, int exclude_nodata_value,
-	double *search_values, uint32_t search_values_count, double roundto,
-	uint32_t *rtn_total, uint32_t *rtn_count) {
-	rt_valuecount vcnts = NULL;
-	rt_pixtype pixtype = PT_END;
-	uint8_t *data = NULL;
-	int hasnodata = FALSE;
-	double nodata = 0;
+void
+rt_raster_destroy(rt_raster raster) {
 
-	int scale = 0;
-	int doround = 0;
-	double tmpd = 0;
-	int i = 0;
 
-	uint32_t x = 0;
-	uint32_t y = 0;
-	int rtn;
-	double pxlval;
-	double rpxlval;
-	uint32_t total = 0;
-	int vcnts_count = 0;
-	int new_valuecount = 0;
+    RASTER_DEBUGF(3, "Destroying rt_raster @ %p", raster);
 
-#if POSTGIS_DEBUG_LEVEL > 0
-	clock_t start, stop;
-	double elapsed = 0;
-#endif
+    if (raster->bands) {
+        rtdealloc(raster->bands);
+    }
+    if (raster->cachedstats) {
+        rtdealloc(raster->cachedstats);
+    }
+    rtdealloc(raster);
+}
 
-	RASTER_DEBUG(3, "starting");
-#if POSTGIS_DEBUG_LEVEL > 0
-	start = clock();
-#endif
+uint16_t
+rt_raster_get_width(rt_raster raster) {
 
-	assert(NULL != band);
+    assert(NULL != raster);
 
-	data = rt_band_get_data(band);
-	if (data == NULL) {
-		rterror("rt_band_get_summary_stats: Cannot get band data");
-		return NULL;
-	}
+    return raster->width;
+}
 
-	pixtype = band->pixtype;
+uint16_t
+rt_raster_get_height(rt_raster raster) {
 
-	hasnodata = rt_band_get_hasnodata_flag(band);
-	if (hasnodata != FALSE)
-		nodata = rt_band_get_nodata(band);
-	else
-		exclude_nodata_value = 0;
+    assert(NULL != raster);
 
-	RASTER_DEBUGF(3, "nodata = %f", nodata);
-	RASTER_DEBUGF(3, "hasnodata = %d", hasnodata);
-	RASTER_DEBUGF(3, "exclude_nodata_value = %d", exclude_nodata_value);
+    return raster->height;
+}
 
-	/* process roundto */
-	if (roundto < 0 || FLT_EQ(roundto, 0.0)) {
-		roundto = 0;
-		scale = 0;
-	}
-	/* tenths, hundredths, thousandths, etc */
-	else if (roundto < 1) {
-    switch (pixtype) {
-			/* integer band types don't have digits after the decimal place */
-			case PT_1BB:
-			case PT_2BUI:
-			case PT_4BUI:
-			case PT_8BSI:
-			case PT_8BUI:
-			case PT_16BSI:
-			case PT_16BUI:
-			case PT_32BSI:
-			case PT_32BUI:
-				roundto = 0;
-				break;
-			/* floating points, check the rounding */
-			case PT_32BF:
-			case PT_64BF:
-				for (scale = 0; scale <= 20; scale++) {
-					tmpd = roundto * pow(10, scale);
-					if (FLT_EQ((tmpd - ((int) tmpd)), 0.0)) break;
-				}
-				break;
-			case PT_END:
-				break;
-		}
-	}
-	/* ones, tens, hundreds, etc */
-	else {
-		for (scale = 0; scale >= -20; scale--) {
-			tmpd = roundto * pow(10, scale);
-			if (tmpd < 1 || FLT_EQ(tmpd, 1.0)) {
-				if (scale == 0) doround = 1;
-				break;
-			}
-		}
-	}
+void
+rt_raster_set_scale(rt_raster raster,
+        double scaleX, double scaleY) {
 
-	if (scale != 0 || doround)
-		doround = 1;
-	else
-		doround = 0;
-	RASTER_DEBUGF(3, "scale = %d", scale);
-	RASTER_DEBUGF(3, "doround = %d", doround);
 
-	/* process search_values */
-	if (search_values_count > 0 && NULL != search_values) {
-		vcnts = (rt_valuecount) rtalloc(sizeof(struct rt_valuecount_t) * search_values_count);
-		if (NULL == vcnts) {
-			rterror("rt_band_get_count_of_values: Unable to allocate memory for value counts");
-			*rtn_count = 0;
-			return NULL;
-		}
+    assert(NULL != raster);
 
-		for (i = 0; i < search_values_count; i++) {
-			vcnts[i].count = 0;
-			vcnts[i].percent = 0;
-			if (!doround)
-				vcnts[i].value = search_values[i];
-			else
-				vcnts[i].value = ROUND(search_values[i], scale);
-		}
-		vcnts_count = i;
-	}
-	else
-		search_values_count = 0;
-	RASTER_DEBUGF(3, "search_values_count = %d", search_values_count);
+    raster->scaleX = scaleX;
+    raster->scaleY = scaleY;
+}
 
-	/* entire band is nodata */
-	if (rt_band_get_isnodata_flag(band) != FALSE) {
-		if (exclude_nodata_value) {
-			rtwarn("All pixels of band have the NODATA value");
-			return NULL;
-		}
-		else {
-			if (search_values_count > 0) {
-				/* check for nodata match */
-				for (i = 0; i < search_values_count; i++) {
-					if (!doround)
-						tmpd = nodata;
-					else
-						tmpd = ROUND(nodata, scale);
+double
+rt_raster_get_x_scale(rt_raster raster) {
 
-					if (FLT_NEQ(tmpd, vcnts[i].value))
-						continue;
 
-					vcnts[i].count = band->width * band->height;
-					if (NULL != rtn_total) *rtn_total = vcnts[i].count;
-					vcnts->percent = 1.0;
-				}
+    assert(NULL != raster);
 
-				*rtn_count = vcnts_count;
-			}
-			/* no defined search values */
-			else {
-				vcnts = (rt_valuecount) rtalloc(sizeof(struct rt_valuecount_t));
-				if (NULL == vcnts) {
-					rterror("rt_band_get_count_of_values: Unable to allocate memory for value counts");
-					*rtn_count = 0;
-					return NULL;
-				}
+    return raster->scaleX;
+}
 
-				vcnts->value = nodata;
-				vcnts->count = band->width * band->height;
-				if (NULL != rtn_total) *rtn_total = vcnts[i].count;
-				vcnts->percent = 1.0;
+double
+rt_raster_get_y_scale(rt_raster raster) {
 
-				*rtn_count = 1;
-			}
 
-			return vcnts;
-		}
-	}
+    assert(NULL != raster);
 
-	for (x = 0; x < band->width; x++) {
-		for (y = 0; y < band->height; y++) {
-			rtn = rt_band_get_pixel(band, x, y, &pxlval);
+    return raster->scaleY;
+}
 
-			/* error getting value, continue */
-			if (rtn == -1) continue;
+void
+rt_raster_set_skews(rt_raster raster,
+        double skewX, double skewY) {
 
-			if (
-				!exclude_nodata_value || (
-					exclude_nodata_value &&
-					(hasnodata != FALSE) &&
-					FLT_NEQ(pxlval, nodata)
-				)
-			) {
-				total++;
-				if (doround) {
-					rpxlval = ROUND(pxlval, scale);
-				}
-				else
-					rpxlval = pxlval;
-				RASTER_DEBUGF(5, "(pxlval, rpxlval) => (%0.6f, %0.6f)", pxlval, rpxlval);
 
-				new_valuecount = 1;
-				/* search for match in existing valuecounts */
-				for (i = 0; i < vcnts_count; i++) {
-					/* match found */
-					if (FLT_EQ(vcnts[i].value, rpxlval)) {
-						vcnts[i].count++;
-						new_valuecount = 0;
-						RASTER_DEBUGF(5, "(value, count) => (%0.6f, %d)", vcnts[i].value, vcnts[i].count);
-						break;
-					}
-				}
+    assert(NULL != raster);
 
-				/*
-					don't add new valuecount either because
-						- no need for new one
-						- user-defined search values
-				*/
-				if (!new_valuecount || search_values_count > 0) continue;
+    raster->skewX = skewX;
+    raster->skewY = skewY;
+}
 
-				/* add new valuecount */
-				vcnts = rtrealloc(vcnts, sizeof(struct rt_valuecount_t) * (vcnts_count + 1));
-				if (NULL == vcnts) {
-					rterror("rt_band_get_count_of_values: Unable to allocate memory for value counts");
-					*rtn_count = 0;
-					return NULL;
-				}
+double
+rt_raster_get_x_skew(rt_raster raster) {
 
-				vcnts[vcnts_count].value = rpxlval;
-				vcnts[vcnts_count].count = 1;
-				vcnts[vcnts_count].percent = 0;
-				RASTER_DEBUGF(5, "(value, count) => (%0.6f, %d)", vcnts[vcnts_count].value, vcnts[vcnts_count].count);
-				vcnts_count++;
-			}
-		}
-	}
 
-#if POSTGIS_DEBUG_LEVEL > 0
-	stop = clock();
-	elapsed = ((double) (stop - start)) / CLOCKS_PER_SEC;
-	RASTER_DEBUGF(3, "elapsed time = %0.4f", elapsed);
-#endif
+    assert(NULL != raster);
 
-	for (i = 0; i < vcnts_count; i++) {
-		vcnts[i].percent = (double) vcnts[i].count / total;
-		RASTER_DEBUGF(5, "(value, count) => (%0.6f, %d)", vcnts[i].value, vcnts[i].count);
-	}
+    return raster->skewX;
+}
 
-	RASTER_DEBUG(3, "done");
-	if (NULL != rtn_total) *rtn_total = total;
-	*rtn_count = vcnts_count;
-	return vcnts;
+double
+rt_raster_get_y_skew(rt_raster raster) {
+
+
+    assert(NULL != raster);
+
+    return raster->skewY;
 }
 
-/**
- * Returns new band with values reclassified
- *
- * @param srcband : the band who's values will be reclassified
- * @param pixtype : pixel type of the new band
- * @param hasnodata : indicates if the band has a nodata value
- * @param nodataval : nodata value for the new band
- * @param exprset : array of rt_reclassexpr structs
- * @param exprcount : number of elements in expr
- *
- * @return a new rt_band or 0 on error
- */
-rt_band
-rt_band_reclass(rt_band srcband, rt_pixtype pixtype,
-	uint32_t hasnodata, double nodataval, rt_reclassexpr *exprset,
-	int exprcount) {
-	rt_band band = NULL;
-	uint32_t width = 0;
-	uint32_t height = 0;
-	int numval = 0;
-	int memsize = 0;
-	void *mem = NULL;
-	uint32_t src_hasnodata = 0;
-	double src_nodataval = 0.0;
+void
+rt_raster_set_offsets(rt_raster raster, double x, double y) {
 
-	int rtn;
-	uint32_t x;
-	uint32_t y;
-	int i;
-	double or = 0;
-	double ov = 0;
-	double nr = 0;
-	double nv = 0;
-	int do_nv = 0;
-	rt_reclassexpr expr = NULL;
 
-	assert(NULL != srcband);
-	assert(NULL != exprset);
+    assert(NULL != raster);
 
-	/* source nodata */
-	src_hasnodata = rt_band_get_hasnodata_flag(srcband);
-	src_nodataval = rt_band_get_nodata(srcband);
+    raster->ipX = x;
+    raster->ipY = y;
+}
 
-	/* size of memory block to allocate */
-	width = rt_band_get_width(srcband);
-	height = rt_band_get_height(srcband);
-	numval = width * height;
-	memsize = rt_pixtype_size(pixtype) * numval;
-	mem = (int *) rtalloc(memsize);
-	if (!mem) {
-		rterror("rt_band_reclass: Could not allocate memory for band");
-		return 0;
-	}
+double
+rt_raster_get_x_offset(rt_raster raster) {
 
-	/* initialize to zero */
-	if (!hasnodata) {
-		memset(mem, 0, memsize);
-	}
-	/* initialize to nodataval */
-	else {
-		int32_t checkvalint = 0;
-		uint32_t checkvaluint = 0;
-		double checkvaldouble = 0;
-		float checkvalfloat = 0;
 
-		switch (pixtype) {
-			case PT_1BB:
-			{
-				uint8_t *ptr = mem;
-				uint8_t clamped_initval = rt_util_clamp_to_1BB(nodataval);
-				for (i = 0; i < numval; i++)
-					ptr[i] = clamped_initval;
-				checkvalint = ptr[0];
-				break;
-			}
-			case PT_2BUI:
-			{
-				uint8_t *ptr = mem;
-				uint8_t clamped_initval = rt_util_clamp_to_2BUI(nodataval);
-				for (i = 0; i < numval; i++)
-					ptr[i] = clamped_initval;
-				checkvalint = ptr[0];
-				break;
-			}
-			case PT_4BUI:
-			{
-				uint8_t *ptr = mem;
-				uint8_t clamped_initval = rt_util_clamp_to_4BUI(nodataval);
-				for (i = 0; i < numval; i++)
-					ptr[i] = clamped_initval;
-				checkvalint = ptr[0];
-				break;
-			}
-			case PT_8BSI:
-			{
-				int8_t *ptr = mem;
-				int8_t clamped_initval = rt_util_clamp_to_8BSI(nodataval);
-				for (i = 0; i < numval; i++)
-					ptr[i] = clamped_initval;
-				checkvalint = ptr[0];
-				break;
-			}
-			case PT_8BUI:
-			{
-				uint8_t *ptr = mem;
-				uint8_t clamped_initval = rt_util_clamp_to_8BUI(nodataval);
-				for (i = 0; i < numval; i++)
-					ptr[i] = clamped_initval;
-				checkvalint = ptr[0];
-				break;
-			}
-			case PT_16BSI:
-			{
-				int16_t *ptr = mem;
-				int16_t clamped_initval = rt_util_clamp_to_16BSI(nodataval);
-				for (i = 0; i < numval; i++)
-					ptr[i] = clamped_initval;
-				checkvalint = ptr[0];
-				break;
-			}
-			case PT_16BUI:
-			{
-				uint16_t *ptr = mem;
-				uint16_t clamped_initval = rt_util_clamp_to_16BUI(nodataval);
-				for (i = 0; i < numval; i++)
-					ptr[i] = clamped_initval;
-				checkvalint = ptr[0];
-				break;
-			}
-			case PT_32BSI:
-			{
-				int32_t *ptr = mem;
-				int32_t clamped_initval = rt_util_clamp_to_32BSI(nodataval);
-				for (i = 0; i < numval; i++)
-					ptr[i] = clamped_initval;
-				checkvalint = ptr[0];
-				break;
-			}
-			case PT_32BUI:
-			{
-				uint32_t *ptr = mem;
-				uint32_t clamped_initval = rt_util_clamp_to_32BUI(nodataval);
-				for (i = 0; i < numval; i++)
-					ptr[i] = clamped_initval;
-				checkvaluint = ptr[0];
-				break;
-			}
-			case PT_32BF:
-			{
-				float *ptr = mem;
-				float clamped_initval = rt_util_clamp_to_32F(nodataval);
-				for (i = 0; i < numval; i++)
-					ptr[i] = clamped_initval;
-				checkvalfloat = ptr[0];
-				break;
-			}
-			case PT_64BF:
-			{
-				double *ptr = mem;
-				for (i = 0; i < numval; i++)
-					ptr[i] = nodataval;
-				checkvaldouble = ptr[0];
-				break;
-			}
-			default:
-			{
-				rterror("rt_band_reclass: Unknown pixeltype %d", pixtype);
-				rtdealloc(mem);
+    assert(NULL != raster);
+
+    return raster->ipX;
+}
+
+double
+rt_raster_get_y_offset(rt_raster raster) {
+
+
+    assert(NULL != raster);
+
+    return raster->ipY;
+}
+
+void
+rt_raster_get_phys_params(rt_raster rast,
+        double *i_mag, double *j_mag, double *theta_i, double *theta_ij)
+{
+    double o11, o12, o21, o22 ; /* geotransform coefficients */
+
+    if (rast == NULL) return ;
+    if ( (i_mag==NULL) || (j_mag==NULL) || (theta_i==NULL) || (theta_ij==NULL))
+        return ;
+
+    /* retrieve coefficients from raster */
+    o11 = rt_raster_get_x_scale(rast) ;
+    o12 = rt_raster_get_x_skew(rast) ;
+    o21 = rt_raster_get_y_skew(rast) ;
+    o22 = rt_raster_get_y_scale(rast) ;
+
+    rt_raster_calc_phys_params(o11, o12, o21, o22, i_mag, j_mag, theta_i, theta_ij);
+}
+
+void
+rt_raster_calc_phys_params(double xscale, double xskew, double yskew, double yscale,
+                           double *i_mag, double *j_mag, double *theta_i, double *theta_ij)
+
+{
+    double theta_test ;
+
+    if ( (i_mag==NULL) || (j_mag==NULL) || (theta_i==NULL) || (theta_ij==NULL))
+        return ;
+
+    /* pixel size in the i direction */
+    *i_mag = sqrt(xscale*xscale + yskew*yskew) ;
+
+    /* pixel size in the j direction */
+    *j_mag = sqrt(xskew*xskew + yscale*yscale) ;
+
+    /* Rotation
+     * ========
+     * Two steps:
+     * 1] calculate the magnitude of the angle between the x axis and
+     *     the i basis vector.
+     * 2] Calculate the sign of theta_i based on the angle between the y axis
+     *     and the i basis vector.
+     */
+    *theta_i = acos(xscale/(*i_mag)) ;  /* magnitude */
+    theta_test = acos(yskew/(*i_mag)) ; /* sign */
+    if (theta_test < M_PI_2){
+        *theta_i = -(*theta_i) ;
+    }
+
+
+    /* Angular separation of basis vectors
+     * ===================================
+     * Two steps:
+     * 1] calculate the magnitude of the angle between the j basis vector and
+     *     the i basis vector.
+     * 2] Calculate the sign of theta_ij based on the angle between the
+     *    perpendicular of the i basis vector and the j basis vector.
+     */
+    *theta_ij = acos(((xscale*xskew) + (yskew*yscale))/((*i_mag)*(*j_mag))) ;
+    theta_test = acos( ((-yskew*xskew)+(xscale*yscale)) /
+            ((*i_mag)*(*j_mag)));
+    if (theta_test > M_PI_2) {
+        *theta_ij = -(*theta_ij) ;
+    }
+}
+
+void
+rt_raster_set_phys_params(rt_raster rast,double i_mag, double j_mag, double theta_i, double theta_ij)
+{
+    double o11, o12, o21, o22 ; /* calculated geotransform coefficients */
+    int success ;
+
+    if (rast == NULL) return ;
+
+    success = rt_raster_calc_gt_coeff(i_mag, j_mag, theta_i, theta_ij,
+                            &o11, &o12, &o21, &o22) ;
+
+    if (success) {
+        rt_raster_set_scale(rast, o11, o22) ;
+        rt_raster_set_skews(rast, o12, o21) ;
+    }
+}
+
+int
+rt_raster_calc_gt_coeff(double i_mag, double j_mag, double theta_i, double theta_ij,
+                        double *xscale, double *xskew, double *yskew, double *yscale)
+{
+    double f ;        /* reflection flag 1.0 or -1.0 */
+    double k_i ;      /* shearing coefficient */
+    double s_i, s_j ; /* scaling coefficients */
+    double cos_theta_i, sin_theta_i ;
+
+    if ( (xscale==NULL) || (xskew==NULL) || (yskew==NULL) || (yscale==NULL)) {
+        return 0;
+    }
+
+    if ( (theta_ij == 0.0) || (theta_ij == M_PI)) {
+        return 0;
+    }
+
+    /* Reflection across the i axis */
+    f=1.0 ;
+    if (theta_ij < 0) {
+        f = -1.0;
+    }
+
+    /* scaling along i axis */
+    s_i = i_mag ;
+
+    /* shearing parallel to i axis */
+    k_i = tan(f*M_PI_2 - theta_ij) ;
+
+    /* scaling along j axis */
+    s_j = j_mag / (sqrt(k_i*k_i + 1)) ;
+
+    /* putting it altogether */
+    cos_theta_i = cos(theta_i) ;
+    sin_theta_i = sin(theta_i) ;
+    *xscale = s_i * cos_theta_i ;
+    *xskew  = k_i * s_j * f * cos_theta_i + s_j * f * sin_theta_i ;
+    *yskew  = -s_i * sin_theta_i ;
+    *yscale = -k_i * s_j * f * sin_theta_i + s_j * f * cos_theta_i ;
+    return 1;
+}
+
+int32_t
+rt_raster_get_srid(rt_raster raster) {
+	assert(NULL != raster);
+
+	return clamp_srid(raster->srid);
+}
+
+void
+rt_raster_set_srid(rt_raster raster, int32_t srid) {
+	assert(NULL != raster);
+
+	raster->srid = clamp_srid(srid);
+}
+
+int
+rt_raster_get_num_bands(rt_raster raster) {
+
+
+    assert(NULL != raster);
+
+    return raster->numBands;
+}
+
+rt_band
+rt_raster_get_band(rt_raster raster, int n) {
+
+
+    assert(NULL != raster);
+
+    if (n >= raster->numBands || n < 0) return 0;
+    return raster->bands[n];
+}
+
+/**
+ * Compute and cache the statistics of all the in-db bands of a raster,
+ * see rt_band_compute_cached_stats. Out-db bands are left without.
+ *
+ * @param raster : the raster to compute the statistics of
+ *
+ * @return 1 on success, 0 on error
+ */
+int
+rt_raster_compute_cached_stats(rt_raster raster) {
+	int i = 0;
+
+	assert(NULL != raster);
+
+	for (i = 0; i < raster->numBands; i++) {
+		if (raster->bands[i]->offline)
+			continue;
+		if (!rt_band_compute_cached_stats(raster->bands[i])) {
+			rterror("rt_raster_compute_cached_stats: Unable to compute statistics of band at index %d", i);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* Statistics of a serialized band are usable if they cover all the pixels */
+static int
+_rti_cachedstats_is_valid(rt_raster raster, rt_cachedstats stats) {
+	return (
+		stats->count + stats->nodata_count == (uint32_t) raster->width * raster->height
+	);
+}
+
+/**
+ * Get the cached statistics of a band of a raster. For a raster
+ * deserialized header only, these are the statistics read by
+ * rt_raster_deserialize_cached_stats.
+ *
+ * @param raster : the raster to get the statistics of
+ * @param nband : 0-based index of the band
+ * @param stats : where to copy the statistics
+ *
+ * @return TRUE if the band has up to date statistics, FALSE otherwise
+ */
+int
+rt_raster_get_cached_stats(rt_raster raster, int nband, rt_cachedstats stats) {
+	assert(NULL != raster);
+	assert(NULL != stats);
+
+	if (nband < 0 || nband >= raster->numBands)
+		return FALSE;
+
+	if (NULL != raster->bands)
+		return rt_band_get_cached_stats(raster->bands[nband], stats);
+
+	if (
+		NULL == raster->cachedstats ||
+		!_rti_cachedstats_is_valid(raster, &(raster->cachedstats[nband]))
+	) {
+		return FALSE;
+	}
+
+	*stats = raster->cachedstats[nband];
+	return TRUE;
+}
+
+/**
+ * Add band data to a raster.
+ *
+ * @param raster : the raster to add a band to
+ * @param band : the band to add, ownership left to caller.
+ *               Band dimensions are required to match with raster ones.
+ * @param index : the position where to insert the new band (0 based)
+ *
+ * @return identifier (position) for the just-added raster, or -1 on error
+ */
+int32_t
+rt_raster_add_band(rt_raster raster, rt_band band, int index) {
+    rt_band *oldbands = NULL;
+    rt_band oldband = NULL;
+    rt_band tmpband = NULL;
+    uint16_t i = 0;
+
+
+
+    assert(NULL != raster);
+
+    RASTER_DEBUGF(3, "Adding band %p to raster %p", band, raster);
+
+    if (band->width != raster->width || band->height != raster->height) {
+        rterror("rt_raster_add_band: Can't add a %dx%d band to a %dx%d raster",
+                band->width, band->height, raster->width, raster->height);
+        return -1;
+    }
+
+    if (index > raster->numBands)
+        index = raster->numBands;
+
+    if (index < 0)
+        index = 0;
+
+    oldbands = raster->bands;
+
+    RASTER_DEBUGF(3, "Oldbands at %p", oldbands);
+
+    raster->bands = (rt_band*) rtrealloc(raster->bands,
+            sizeof (rt_band)*(raster->numBands + 1)
+            );
+
+    RASTER_DEBUG(3, "Checking bands");
+
+    if (NULL == raster->bands) {
+        rterror("rt_raster_add_band: Out of virtual memory "
+                "reallocating band pointers");
+        raster->bands = oldbands;
+        return -1;
+    }
+
+    RASTER_DEBUGF(4, "realloc returned %p", raster->bands);
+
+    for (i = 0; i <= raster->numBands; ++i) {
+        if (i == index) {
+            oldband = raster->bands[i];
+            raster->bands[i] = band;
+        } else if (i > index) {
+            tmpband = raster->bands[i];
+            raster->bands[i] = oldband;
+            oldband = tmpband;
+        }
+    }
+
+		band->raster = raster;
+
+    raster->numBands++;
+
+    RASTER_DEBUGF(4, "now raster has %d bands", raster->numBands);
+
+    return index;
+}
+
+/**
+ * Generate a new inline band and add it to a raster.
+ *
+ * @param raster : the raster to add a band to
+ * @param pixtype: the pixel type for the new band
+ * @param initialvalue: initial value for pixels
+ * @param hasnodata: indicates if the band has a nodata value
+ * @param nodatavalue: nodata value for the new band
+ * @param index: position to add the new band in the raster
+ *
+ * @return identifier (position) for the just-added raster, or -1 on error
+ */
+int32_t
+rt_raster_generate_new_band(rt_raster raster, rt_pixtype pixtype,
+        double initialvalue, uint32_t hasnodata, double nodatavalue, int index)
+{
+    rt_band band = NULL;
+    int width = 0;
+    int height = 0;
+    int numval = 0;
+    int datasize = 0;
+    int oldnumbands = 0;
+    int numbands = 0;
+    void * mem = NULL;
+    int32_t checkvalint = 0;
+    uint32_t checkvaluint = 0;
+    double checkvaldouble = 0;
+    float checkvalfloat = 0;
+    int i;
+
+
+    assert(NULL != raster);
+
+    /* Make sure index is in a valid range */
+    oldnumbands = rt_raster_get_num_bands(raster);
+    if (index < 0)
+        index = 0;
+    else if (index > oldnumbands + 1)
+        index = oldnumbands + 1;
+
+    /* Determine size of memory block to allocate and allocate it */
+    width = rt_raster_get_width(raster);
+    height = rt_raster_get_height(raster);
+    numval = width * height;
+    datasize = rt_pixtype_size(pixtype) * numval;
+
+    mem = (int *)rtalloc(datasize);
+    if (!mem) {
+        rterror("rt_raster_generate_new_band: Could not allocate memory for band");
+        return -1;
+    }
+
+    if (FLT_EQ(initialvalue, 0.0))
+        memset(mem, 0, datasize);
+    else {
+        switch (pixtype)
+        {
+            case PT_1BB:
+            {
+                uint8_t *ptr = mem;
+                uint8_t clamped_initval = rt_util_clamp_to_1BB(initialvalue);
+                for (i = 0; i < numval; i++)
+                    ptr[i] = clamped_initval;
+                checkvalint = ptr[0];
+                break;
+            }
+            case PT_2BUI:
+            {
+                uint8_t *ptr = mem;
+                uint8_t clamped_initval = rt_util_clamp_to_2BUI(initialvalue);
+                for (i = 0; i < numval; i++)
+                    ptr[i] = clamped_initval;
+                checkvalint = ptr[0];
+                break;
+            }
+            case PT_4BUI:
+            {
+                uint8_t *ptr = mem;
+                uint8_t clamped_initval = rt_util_clamp_to_4BUI(initialvalue);
+                for (i = 0; i < numval; i++)
+                    ptr[i] = clamped_initval;
+                checkvalint = ptr[0];
+                break;
+            }
+            case PT_8BSI:
+            {
+                int8_t *ptr = mem;
+                int8_t clamped_initval = rt_util_clamp_to_8BSI(initialvalue);
+                for (i = 0; i < numval; i++)
+                    ptr[i] = clamped_initval;
+                checkvalint = ptr[0];
+                break;
+            }
+            case PT_8BUI:
+            {
+                uint8_t *ptr = mem;
+                uint8_t clamped_initval = rt_util_clamp_to_8BUI(initialvalue);
+                for (i = 0; i < numval; i++)
+                    ptr[i] = clamped_initval;
+                checkvalint = ptr[0];
+                break;
+            }
+            case PT_16BSI:
+            {
+                int16_t *ptr = mem;
+                int16_t clamped_initval = rt_util_clamp_to_16BSI(initialvalue);
+                for (i = 0; i < numval; i++)
+                    ptr[i] = clamped_initval;
+                checkvalint = ptr[0];
+                break;
+            }
+            case PT_16BUI:
+            {
+                uint16_t *ptr = mem;
+                uint16_t clamped_initval = rt_util_clamp_to_16BUI(initialvalue);
+                for (i = 0; i < numval; i++)
+                    ptr[i] = clamped_initval;
+                checkvalint = ptr[0];
+                break;
+            }
+            case PT_32BSI:
+            {
+                int32_t *ptr = mem;
+                int32_t clamped_initval = rt_util_clamp_to_32BSI(initialvalue);
+                for (i = 0; i < numval; i++)
+                    ptr[i] = clamped_initval;
+                checkvalint = ptr[0];
+                break;
+            }
+            case PT_32BUI:
+            {
+                uint32_t *ptr = mem;
+                uint32_t clamped_initval = rt_util_clamp_to_32BUI(initialvalue);
+                for (i = 0; i < numval; i++)
+                    ptr[i] = clamped_initval;
+                checkvaluint = ptr[0];
+                break;
+            }
+            case PT_32BF:
+            {
+                float *ptr = mem;
+                float clamped_initval = rt_util_clamp_to_32F(initialvalue);
+                for (i = 0; i < numval; i++)
+                    ptr[i] = clamped_initval;
+                checkvalfloat = ptr[0];
+                break;
+            }
+            case PT_64BF:
+            {
+                double *ptr = mem;
+                for (i = 0; i < numval; i++)
+                    ptr[i] = initialvalue;
+                checkvaldouble = ptr[0];
+                break;
+            }
+            default:
+            {
+                rterror("rt_raster_generate_new_band: Unknown pixeltype %d", pixtype);
+                rtdealloc(mem);
+                return -1;
+            }
+        }
+    }
+
+    /* Overflow checking */
+    rt_util_dbl_trunc_warning(
+			initialvalue,
+			checkvalint, checkvaluint,
+			checkvalfloat, checkvaldouble,
+			pixtype
+		);
+
+    band = rt_band_new_inline(width, height, pixtype, hasnodata, nodatavalue, mem);
+    if (! band) {
+        rterror("rt_raster_generate_new_band: Could not add band to raster. Aborting");
+        rtdealloc(mem);
+        return -1;
+    }
+    index = rt_raster_add_band(raster, band, index);
+    numbands = rt_raster_get_num_bands(raster);
+    if (numbands == oldnumbands || index == -1) {
+        rterror("rt_raster_generate_new_band: Could not add band to raster. Aborting");
+        rt_band_destroy(band);
+    }
+
+    return index;
+}
+
+/**
+ * Get 6-element array of raster geotransform matrix
+ *
+ * @param raster : the raster to get matrix of
+ * @param gt : output parameter, 6-element geotransform matrix
+ *
+ */
+void
+rt_raster_get_geotransform_matrix(rt_raster raster,
+	double *gt) {
+	assert(NULL != raster);
+	assert(NULL != gt);
+
+	gt[0] = raster->ipX;
+	gt[1] = raster->scaleX;
+	gt[2] = raster->skewX;
+	gt[3] = raster->ipY;
+	gt[4] = raster->skewY;
+	gt[5] = raster->scaleY;
+}
+
+/**
+ * Set raster's geotransform using 6-element array
+ *
+ * @param raster : the raster to set matrix of
+ * @param gt : intput parameter, 6-element geotransform matrix
+ *
+ */
+void
+rt_raster_set_geotransform_matrix(rt_raster raster,
+	double *gt) {
+	assert(NULL != raster);
+	assert(NULL != gt);
+
+	raster->ipX = gt[0];
+	raster->scaleX = gt[1];
+	raster->skewX = gt[2];
+	raster->ipY = gt[3];
+	raster->skewY = gt[4];
+	raster->scaleY = gt[5];
+}
+
+/**
+ * Convert an xr, yr raster point to an xw, yw point on map
+ *
+ * @param raster : the raster to get info from
+ * @param xr : the pixel's column
+ * @param yr : the pixel's row
+ * @param xw : output parameter, X ordinate of the geographical point
+ * @param yw : output parameter, Y ordinate of the geographical point
+ * @param gt : input/output parameter, 3x2 geotransform matrix
+ *
+ * @return if zero, error occurred in function
+ */
+int
+rt_raster_cell_to_geopoint(rt_raster raster,
+	double xr, double yr,
+	double *xw, double *yw,
+	double *gt
+) {
+	double *_gt = NULL;
+	int init_gt = 0;
+	int i = 0;
+
+	assert(NULL != raster);
+	assert(NULL != xw);
+	assert(NULL != yw);
+
+	if (NULL == gt) {
+		_gt = rtalloc(sizeof(double) * 6);
+		if (NULL == _gt) {
+			rterror("rt_raster_cell_to_geopoint: Unable to allocate memory for geotransform matrix");
+			return 0;
+		}
+		init_gt = 1;
+
+		for (i = 0; i < 6; i++) _gt[i] = 0;
+	}
+	else {
+		_gt = gt;
+		init_gt = 0;
+	}
+
+	/* scale of matrix is not set */
+	if (
+		FLT_EQ(_gt[1], 0) ||
+		FLT_EQ(_gt[5], 0)
+	) {
+		rt_raster_get_geotransform_matrix(raster, _gt);
+	}
+
+	RASTER_DEBUGF(4, "gt = (%f, %f, %f, %f, %f, %f)",
+		_gt[0],
+		_gt[1],
+		_gt[2],
+		_gt[3],
+		_gt[4],
+		_gt[5]
+	);
+
+	GDALApplyGeoTransform(_gt, xr, yr, xw, yw);
+	RASTER_DEBUGF(4, "GDALApplyGeoTransform (c -> g) for (%f, %f) = (%f, %f)",
+		xr, yr, *xw, *yw);
+
+	if (init_gt) rtdealloc(_gt);
+	return 1;
+}
+
+/**
+ * Convert an xw,yw map point to a xr,yr raster point
+ *
+ * @param raster : the raster to get info from
+ * @param xw : X ordinate of the geographical point
+ * @param yw : Y ordinate of the geographical point
+ * @param xr : output parameter, the pixel's column
+ * @param yr : output parameter, the pixel's row
+ * @param igt : input/output parameter, 3x2 inverse geotransform matrix
+ *
+ * @return if zero, error occurred in function
+ */
+int
+rt_raster_geopoint_to_cell(rt_raster raster,
+	double xw, double yw,
+	double *xr, double *yr,
+	double *igt
+) {
+	double *_igt = NULL;
+	int i = 0;
+	int init_igt = 0;
+	double rnd = 0;
+
+	assert(NULL != raster);
+	assert(NULL != xr);
+	assert(NULL != yr);
+
+	if (igt == NULL) {
+		_igt = rtalloc(sizeof(double) * 6);
+		if (_igt == NULL) {
+			rterror("rt_raster_geopoint_to_cell: Unable to allocate memory for inverse geotransform matrix");
+			return 0;
+		}
+		init_igt = 1;
+
+		for (i = 0; i < 6; i++) _igt[i] = 0;
+	}
+	else {
+		_igt = igt;
+		init_igt = 0;
+	}
+
+	/* matrix is not set */
+	if (
+		FLT_EQ(_igt[0], 0.) &&
+		FLT_EQ(_igt[1], 0.) &&
+		FLT_EQ(_igt[2], 0.) &&
+		FLT_EQ(_igt[3], 0.) &&
+		FLT_EQ(_igt[4], 0.) &&
+		FLT_EQ(_igt[5], 0.)
+	) {
+		double gt[6] = {0.0};
+		rt_raster_get_geotransform_matrix(raster, gt);
+
+		if (!GDALInvGeoTransform(gt, _igt)) {
+			rterror("rt_raster_geopoint_to_cell: Unable to compute inverse geotransform matrix");
+			if (init_igt) rtdealloc(_igt);
+			return 0;
+		}
+	}
+
+	GDALApplyGeoTransform(_igt, xw, yw, xr, yr);
+	RASTER_DEBUGF(4, "GDALApplyGeoTransform (g -> c) for (%f, %f) = (%f, %f)",
+		xw, yw, *xr, *yr);
+
+	rnd = ROUND(*xr, 0);
+	if (FLT_EQ(rnd, *xr))
+		*xr = rnd;
+	else
+		*xr = floor(*xr);
+
+	rnd = ROUND(*yr, 0);
+	if (FLT_EQ(rnd, *yr))
+		*yr = rnd;
+	else
+		*yr = floor(*yr);
+
+	RASTER_DEBUGF(4, "Corrected GDALApplyGeoTransform (g -> c) for (%f, %f) = (%f, %f)",
+		xw, yw, *xr, *yr);
+
+	if (init_igt) rtdealloc(_igt);
+	return 1;
+}
+
+/**
+ * Returns a set of "geomval" value, one for each group of pixel
+ * sharing the same value for the provided band.
+ *
+ * A "geomval " value is a complex type composed of a the wkt
+ * representation of a geometry (one for each group of pixel sharing
+ * the same value) and the value associated with this geometry.
+ *
+ * @param raster: the raster to get info from.
+ * @param nband: the band to polygonize. 0-based
+ *
+ * @return A set of "geomval" values, one for each group of pixels
+ * sharing the same value for the provided band. The returned values are
+ * WKT geometries, not real PostGIS geometries (this may change in the
+ * future, and the function returns real geometries)
+ */
+rt_geomval
+rt_raster_dump_as_wktpolygons(rt_raster raster, int nband, int * pnElements)
+{
+    char * pszQuery;
+    long j;
+    OGRSFDriverH ogr_drv = NULL;
+    GDALDriverH gdal_drv = NULL;
+    GDALDatasetH memdataset = NULL;
+    GDALRasterBandH gdal_band = NULL;
+    OGRDataSourceH memdatasource = NULL;
+    rt_geomval pols = NULL;
+    OGRLayerH hLayer = NULL;
+    OGRFeatureH hFeature = NULL;
+    OGRGeometryH hGeom = NULL;
+    OGRFieldDefnH hFldDfn = NULL;
+    char * pszSrcText = NULL;
+    int nFeatureCount = 0;
+    rt_band band = NULL;
+    int iPixVal = -1;
+    double dValue = 0.0;
+    int iBandHasNodataValue = FALSE;
+    double dBandNoData = 0.0;
+
+    uint32_t bandNums[1] = {nband};
+
+    /* Checkings */
+
+
+    assert(NULL != raster);
+    assert(nband >= 0 && nband < rt_raster_get_num_bands(raster));
+
+    RASTER_DEBUG(2, "In rt_raster_dump_as_polygons");
+
+    /*******************************
+     * Get band
+     *******************************/
+    band = rt_raster_get_band(raster, nband);
+    if (NULL == band) {
+        rterror("rt_raster_dump_as_wktpolygons: Error getting band %d from raster", nband);
+        return 0;
+    }
+
+    iBandHasNodataValue = rt_band_get_hasnodata_flag(band);
+    if (iBandHasNodataValue) dBandNoData = rt_band_get_nodata(band);
+
+    /*****************************************************
+     * Convert raster to GDAL MEM dataset
+     *****************************************************/
+    memdataset = rt_raster_to_gdal_mem(raster, NULL, bandNums, 1, &gdal_drv);
+		if (NULL == memdataset) {
+				rterror("rt_raster_dump_as_wktpolygons: Couldn't convert raster to GDAL MEM dataset");
+
 				return 0;
-			}
 		}
 
-		/* Overflow checking */
-		rt_util_dbl_trunc_warning(
-			nodataval,
-			checkvalint, checkvaluint,
-			checkvalfloat, checkvaldouble,
-			pixtype
-		);
-	}
-	RASTER_DEBUGF(3, "rt_band_reclass: width = %d height = %d", width, height);
+    /*****************************
+     * Register ogr mem driver
+     *****************************/
+    OGRRegisterAll();
+
+    RASTER_DEBUG(3, "creating OGR MEM vector");
+
+
+    /*****************************************************
+     * Create an OGR in-memory vector for layers
+     *****************************************************/
+    ogr_drv = OGRGetDriverByName("Memory");
+    memdatasource = OGR_Dr_CreateDataSource(ogr_drv, "", NULL);
+
+    if (NULL == memdatasource) {
+        rterror("rt_raster_dump_as_wktpolygons: Couldn't create a OGR Datasource to store pols");
+        GDALClose(memdataset);
+        return 0;
+    }
+
+    /**
+     * Can MEM driver create new layers?
+     **/
+    if (!OGR_DS_TestCapability(memdatasource, ODsCCreateLayer)) {
+        rterror("rt_raster_dump_as_wktpolygons: MEM driver can't create new layers, aborting");
+        /* xxx jorgearevalo: what should we do now? */
+        GDALClose(memdataset);
+        OGRReleaseDataSource(memdatasource);
+        return 0;
+    }
+
+    RASTER_DEBUG(3, "polygonizying GDAL MEM raster band");
+
+    /*****************************
+     * Polygonize the raster band
+     *****************************/
+
+    /**
+     * From GDALPolygonize function header: "Polygon features will be
+     * created on the output layer, with polygon geometries representing
+     * the polygons". So,the WKB geometry type should be "wkbPolygon"
+     **/
+    hLayer = OGR_DS_CreateLayer(memdatasource, "PolygonizedLayer", NULL,
+            wkbPolygon, NULL);
+
+    if (NULL == hLayer) {
+        rterror("rt_raster_dump_as_wktpolygons: Couldn't create layer to store polygons");
+        GDALClose(memdataset);
+        OGRReleaseDataSource(memdatasource);
+        return 0;
+    }
+
+    /**
+     * Create a new field in the layer, to store the px value
+     */
+
+    /* First, create a field definition to create the field */
+    hFldDfn = OGR_Fld_Create("PixelValue", OFTReal);
+
+    /* Second, create the field */
+    if (OGR_L_CreateField(hLayer, hFldDfn, TRUE) !=
+            OGRERR_NONE) {
+        rtwarn("Couldn't create a field in OGR Layer. The polygons generated won't be able to store the pixel value");
+        iPixVal = -1;
+    }
+    else {
+        /* Index to the new field created in the layer */
+        iPixVal = 0;
+    }
+
+
+    /* Get GDAL raster band */
+    gdal_band = GDALGetRasterBand(memdataset, 1);
+    if (NULL == gdal_band) {
+        rterror("rt_raster_dump_as_wktpolygons: Couldn't get GDAL band to polygonize");
+        GDALClose(memdataset);
+
+        OGR_Fld_Destroy(hFldDfn);
+        OGR_DS_DeleteLayer(memdatasource, 0);
+        OGRReleaseDataSource(memdatasource);
+
+        return 0;
+    }
+
+    /**
+     * We don't need a raster mask band. Each band has a nodata value.
+     **/
+#ifdef GDALFPOLYGONIZE
+    GDALFPolygonize(gdal_band, NULL, hLayer, iPixVal, NULL, NULL, NULL);
+#else
+    GDALPolygonize(gdal_band, NULL, hLayer, iPixVal, NULL, NULL, NULL);
+#endif
+
+    /**
+     * Optimization: Apply a OGR SQL filter to the layer to select the
+     * features different from NODATA value.
+     *
+     * Thanks to David Zwarg.
+     **/
+    if (iBandHasNodataValue) {
+        pszQuery = (char *) rtalloc(50 * sizeof (char));
+        sprintf(pszQuery, "PixelValue != %f", dBandNoData );
+        OGRErr e = OGR_L_SetAttributeFilter(hLayer, pszQuery);
+        if (e != OGRERR_NONE) {
+                rtwarn("Error filtering NODATA values for band. All values"
+                        " will be treated as data values");
+        }
+    }
+
+    else {
+        pszQuery = NULL;
+    }
+
+
+
+    /*********************************************************************
+     * Transform OGR layers in WKT polygons
+     * XXX jorgearevalo: GDALPolygonize does not set the coordinate system
+     * on the output layer. Application code should do this when the layer
+     * is created, presumably matching the raster coordinate system.
+     * TODO: modify GDALPolygonize to directly emit polygons in WKT format?
+     *********************************************************************/
+    nFeatureCount = OGR_L_GetFeatureCount(hLayer, TRUE);
+
+    /* Allocate memory for pols */
+    pols = (rt_geomval) rtalloc(nFeatureCount * sizeof (struct rt_geomval_t));
+
+    if (NULL == pols) {
+        rterror("rt_raster_dump_as_wktpolygons: Couldn't allocate memory for "
+                "geomval structure");
+        GDALClose(memdataset);
+
+        OGR_Fld_Destroy(hFldDfn);
+        OGR_DS_DeleteLayer(memdatasource, 0);
+				if (NULL != pszQuery) rtdealloc(pszQuery);
+        OGRReleaseDataSource(memdatasource);
+
+        return 0;
+    }
+
+    RASTER_DEBUGF(3, "storing polygons (%d)", nFeatureCount);
+
+    if (pnElements)
+        *pnElements = 0;
+
+    /* Reset feature reading to start in the first feature */
+    OGR_L_ResetReading(hLayer);
+
+    for (j = 0; j < nFeatureCount; j++) {
+
+        hFeature = OGR_L_GetNextFeature(hLayer);
+        dValue = OGR_F_GetFieldAsDouble(hFeature, iPixVal);
+
+        hGeom = OGR_F_GetGeometryRef(hFeature);
+     	OGR_G_ExportToWkt(hGeom, &pszSrcText);
+
+      	pols[j].val = dValue;
+       	pols[j].srid = rt_raster_get_srid(raster);
+     	pols[j].geom = (char *) rtalloc((1 + strlen(pszSrcText))
+                    * sizeof (char));
+     	strcpy(pols[j].geom, pszSrcText);
+
+     	RASTER_DEBUGF(4, "Feature %d, Polygon: %s", j, pols[j].geom);
+     	RASTER_DEBUGF(4, "Feature %d, value: %f", j, pols[j].val);
+     	RASTER_DEBUGF(4, "Feature %d, srid: %d", j, pols[j].srid);
+
+		/**
+         * We can't use deallocator from rt_context, because it comes from
+         * postgresql backend, that uses pfree. This function needs a
+         * postgresql memory context to work with, and the memory created
+         * for pszSrcText is created outside this context.
+         **/
+        /*rtdealloc(pszSrcText);*/
+        free(pszSrcText);
+        pszSrcText = NULL;
+
+        OGR_F_Destroy(hFeature);
+    }
+
+    if (pnElements)
+        *pnElements = nFeatureCount;
+
+    RASTER_DEBUG(3, "destroying GDAL MEM raster");
+
+    GDALClose(memdataset);
+
+    RASTER_DEBUG(3, "destroying OGR MEM vector");
+
+    OGR_Fld_Destroy(hFldDfn);
+    OGR_DS_DeleteLayer(memdatasource, 0);
+		if (NULL != pszQuery) rtdealloc(pszQuery);
+    OGRReleaseDataSource(memdatasource);
+
+    return pols;
+}
+
+LWPOLY*
+rt_raster_get_convex_hull(rt_raster raster) {
+		double gt[6] = {0.0};
+    POINTARRAY **rings = NULL;
+    POINTARRAY *pts = NULL;
+    LWPOLY* ret = NULL;
+    POINT4D p4d;
+
+    assert(NULL != raster);
+
+    RASTER_DEBUGF(3, "rt_raster_get_convex_hull: raster is %dx%d",
+            raster->width, raster->height);
+
+    if ((!raster->width) || (!raster->height)) {
+        return 0;
+    }
+
+    rings = (POINTARRAY **) rtalloc(sizeof (POINTARRAY*));
+    if (!rings) {
+        rterror("rt_raster_get_convex_hull: Out of memory [%s:%d]", __FILE__, __LINE__);
+        return 0;
+    }
+    rings[0] = ptarray_construct(0, 0, 5);
+    /* TODO: handle error on ptarray construction */
+    /* XXX jorgearevalo: the error conditions aren't managed in ptarray_construct */
+    if (!rings[0]) {
+        rterror("rt_raster_get_convex_hull: Out of memory [%s:%d]", __FILE__, __LINE__);
+        return 0;
+    }
+    pts = rings[0];
+
+    /* Upper-left corner (first and last points) */
+    rt_raster_cell_to_geopoint(raster,
+            0, 0,
+            &p4d.x, &p4d.y,
+						gt);
+    ptarray_set_point4d(pts, 0, &p4d);
+    ptarray_set_point4d(pts, 4, &p4d); /* needed for closing it? */
+
+    /* Upper-right corner (we go clockwise) */
+    rt_raster_cell_to_geopoint(raster,
+            raster->width, 0,
+            &p4d.x, &p4d.y,
+						gt);
+    ptarray_set_point4d(pts, 1, &p4d);
+
+    /* Lower-right corner */
+    rt_raster_cell_to_geopoint(raster,
+            raster->width, raster->height,
+            &p4d.x, &p4d.y,
+						gt);
+    ptarray_set_point4d(pts, 2, &p4d);
+
+    /* Lower-left corner */
+    rt_raster_cell_to_geopoint(raster,
+            0, raster->height,
+            &p4d.x, &p4d.y,
+						gt);
+    ptarray_set_point4d(pts, 3, &p4d);
+
+    ret = lwpoly_construct(rt_raster_get_srid(raster), 0, 1, rings);
+
+    return ret;
+}
+
+/*--------- WKB I/O ---------------------------------------------------*/
+
+static uint8_t
+isMachineLittleEndian(void) {
+    static int endian_check_int = 1; /* dont modify this!!! */
+    /* 0=big endian|xdr --  1=little endian|ndr */
+    return *((uint8_t *) & endian_check_int);
+}
+
+static uint8_t
+read_uint8(const uint8_t** from) {
+    assert(NULL != from);
+
+    return *(*from)++;
+}
+
+/* unused up to now
+static void
+write_uint8(uint8_t** from, uint8_t v)
+{
+    assert(NULL != from);
+
+ *(*from)++ = v;
+}
+ */
+
+static int8_t
+read_int8(const uint8_t** from) {
+    assert(NULL != from);
+
+    return (int8_t) read_uint8(from);
+}
+
+/* unused up to now
+static void
+write_int8(uint8_t** from, int8_t v)
+{
+    assert(NULL != from);
+
+ *(*from)++ = v;
+}
+ */
+
+static uint16_t
+read_uint16(const uint8_t** from, uint8_t littleEndian) {
+    uint16_t ret = 0;
+
+    assert(NULL != from);
+
+    if (littleEndian) {
+        ret = (*from)[0] |
+                (*from)[1] << 8;
+    } else {
+        /* big endian */
+        ret = (*from)[0] << 8 |
+                (*from)[1];
+    }
+    *from += 2;
+    return ret;
+}
+
+static void
+write_uint16(uint8_t** to, uint8_t littleEndian, uint16_t v) {
+    assert(NULL != to);
+
+    if (littleEndian) {
+        (*to)[0] = v & 0x00FF;
+        (*to)[1] = v >> 8;
+    } else {
+        (*to)[1] = v & 0x00FF;
+        (*to)[0] = v >> 8;
+    }
+    *to += 2;
+}
+
+static int16_t
+read_int16(const uint8_t** from, uint8_t littleEndian) {
+    assert(NULL != from);
+
+    return read_uint16(from, littleEndian);
+}
+
+/* unused up to now
+static void
+write_int16(uint8_t** to, uint8_t littleEndian, int16_t v)
+{
+    assert(NULL != to);
+
+    if ( littleEndian )
+    {
+        (*to)[0] = v & 0x00FF;
+        (*to)[1] = v >> 8;
+    }
+    else
+    {
+        (*to)[1] = v & 0x00FF;
+        (*to)[0] = v >> 8;
+    }
+ *to += 2;
+}
+ */
+
+static uint32_t
+read_uint32(const uint8_t** from, uint8_t littleEndian) {
+    uint32_t ret = 0;
+
+    assert(NULL != from);
+
+    if (littleEndian) {
+        ret = (uint32_t) ((*from)[0] & 0xff) |
+                (uint32_t) ((*from)[1] & 0xff) << 8 |
+                (uint32_t) ((*from)[2] & 0xff) << 16 |
+                (uint32_t) ((*from)[3] & 0xff) << 24;
+    } else {
+        /* big endian */
+        ret = (uint32_t) ((*from)[3] & 0xff) |
+                (uint32_t) ((*from)[2] & 0xff) << 8 |
+                (uint32_t) ((*from)[1] & 0xff) << 16 |
+                (uint32_t) ((*from)[0] & 0xff) << 24;
+    }
+
+    *from += 4;
+    return ret;
+}
+
+/* unused up to now
+static void
+write_uint32(uint8_t** to, uint8_t littleEndian, uint32_t v)
+{
+    assert(NULL != to);
+
+    if ( littleEndian )
+    {
+        (*to)[0] = v & 0x000000FF;
+        (*to)[1] = ( v & 0x0000FF00 ) >> 8;
+        (*to)[2] = ( v & 0x00FF0000 ) >> 16;
+        (*to)[3] = ( v & 0xFF000000 ) >> 24;
+    }
+    else
+    {
+        (*to)[3] = v & 0x000000FF;
+        (*to)[2] = ( v & 0x0000FF00 ) >> 8;
+        (*to)[1] = ( v & 0x00FF0000 ) >> 16;
+        (*to)[0] = ( v & 0xFF000000 ) >> 24;
+    }
+ *to += 4;
+}
+ */
+
+static int32_t
+read_int32(const uint8_t** from, uint8_t littleEndian) {
+    assert(NULL != from);
+
+    return read_uint32(from, littleEndian);
+}
+
+/* unused up to now
+static void
+write_int32(uint8_t** to, uint8_t littleEndian, int32_t v)
+{
+    assert(NULL != to);
+
+    if ( littleEndian )
+    {
+        (*to)[0] = v & 0x000000FF;
+        (*to)[1] = ( v & 0x0000FF00 ) >> 8;
+        (*to)[2] = ( v & 0x00FF0000 ) >> 16;
+        (*to)[3] = ( v & 0xFF000000 ) >> 24;
+    }
+    else
+    {
+        (*to)[3] = v & 0x000000FF;
+        (*to)[2] = ( v & 0x0000FF00 ) >> 8;
+        (*to)[1] = ( v & 0x00FF0000 ) >> 16;
+        (*to)[0] = ( v & 0xFF000000 ) >> 24;
+    }
+ *to += 4;
+}
+ */
+
+static float
+read_float32(const uint8_t** from, uint8_t littleEndian) {
+
+    union {
+        float f;
+        uint32_t i;
+    } ret;
+
+    ret.i = read_uint32(from, littleEndian);
+
+    return ret.f;
+}
+
+/* unused up to now
+static void
+write_float32(uint8_t** from, uint8_t littleEndian, float f)
+{
+    union {
+        float f;
+        uint32_t i;
+    } u;
+
+    u.f = f;
+    write_uint32(from, littleEndian, u.i);
+}
+ */
+
+static double
+read_float64(const uint8_t** from, uint8_t littleEndian) {
+
+    union {
+        double d;
+        uint64_t i;
+    } ret;
+
+    assert(NULL != from);
+
+    if (littleEndian) {
+        ret.i = (uint64_t) ((*from)[0] & 0xff) |
+                (uint64_t) ((*from)[1] & 0xff) << 8 |
+                (uint64_t) ((*from)[2] & 0xff) << 16 |
+                (uint64_t) ((*from)[3] & 0xff) << 24 |
+                (uint64_t) ((*from)[4] & 0xff) << 32 |
+                (uint64_t) ((*from)[5] & 0xff) << 40 |
+                (uint64_t) ((*from)[6] & 0xff) << 48 |
+                (uint64_t) ((*from)[7] & 0xff) << 56;
+    } else {
+        /* big endian */
+        ret.i = (uint64_t) ((*from)[7] & 0xff) |
+                (uint64_t) ((*from)[6] & 0xff) << 8 |
+                (uint64_t) ((*from)[5] & 0xff) << 16 |
+                (uint64_t) ((*from)[4] & 0xff) << 24 |
+                (uint64_t) ((*from)[3] & 0xff) << 32 |
+                (uint64_t) ((*from)[2] & 0xff) << 40 |
+                (uint64_t) ((*from)[1] & 0xff) << 48 |
+                (uint64_t) ((*from)[0] & 0xff) << 56;
+    }
+
+    *from += 8;
+    return ret.d;
+}
+
+/* unused up to now
+static void
+write_float64(uint8_t** to, uint8_t littleEndian, double v)
+{
+    union {
+        double d;
+        uint64_t i;
+    } u;
+
+    assert(NULL != to);
+
+    u.d = v;
+
+    if ( littleEndian )
+    {
+        (*to)[0] =   u.i & 0x00000000000000FFULL;
+        (*to)[1] = ( u.i & 0x000000000000FF00ULL ) >> 8;
+        (*to)[2] = ( u.i & 0x0000000000FF0000ULL ) >> 16;
+        (*to)[3] = ( u.i & 0x00000000FF000000ULL ) >> 24;
+        (*to)[4] = ( u.i & 0x000000FF00000000ULL ) >> 32;
+        (*to)[5] = ( u.i & 0x0000FF0000000000ULL ) >> 40;
+        (*to)[6] = ( u.i & 0x00FF000000000000ULL ) >> 48;
+        (*to)[7] = ( u.i & 0xFF00000000000000ULL ) >> 56;
+    }
+    else
+    {
+        (*to)[7] =   u.i & 0x00000000000000FFULL;
+        (*to)[6] = ( u.i & 0x000000000000FF00ULL ) >> 8;
+        (*to)[5] = ( u.i & 0x0000000000FF0000ULL ) >> 16;
+        (*to)[4] = ( u.i & 0x00000000FF000000ULL ) >> 24;
+        (*to)[3] = ( u.i & 0x000000FF00000000ULL ) >> 32;
+        (*to)[2] = ( u.i & 0x0000FF0000000000ULL ) >> 40;
+        (*to)[1] = ( u.i & 0x00FF000000000000ULL ) >> 48;
+        (*to)[0] = ( u.i & 0xFF00000000000000ULL ) >> 56;
+    }
+ *to += 8;
+}
+ */
+
+#define BANDTYPE_FLAGS_MASK 0xF0
+#define BANDTYPE_PIXTYPE_MASK 0x0F
+#define BANDTYPE_FLAG_OFFDB     (1<<7)
+#define BANDTYPE_FLAG_HASNODATA (1<<6)
+#define BANDTYPE_FLAG_ISNODATA  (1<<5)
+#define BANDTYPE_FLAG_RESERVED3 (1<<4)
+
+#define BANDTYPE_PIXTYPE(x) ((x)&BANDTYPE_PIXTYPE_MASK)
+#define BANDTYPE_IS_OFFDB(x) ((x)&BANDTYPE_FLAG_OFFDB)
+#define BANDTYPE_HAS_NODATA(x) ((x)&BANDTYPE_FLAG_HASNODATA)
+#define BANDTYPE_IS_NODATA(x) ((x)&BANDTYPE_FLAG_ISNODATA)
+
+/* Read band from WKB as at start of band */
+static rt_band
+rt_band_from_wkb(uint16_t width, uint16_t height,
+        const uint8_t** ptr, const uint8_t* end,
+        uint8_t littleEndian) {
+    rt_band band = NULL;
+    int pixbytes = 0;
+    uint8_t type = 0;
+    unsigned long sz = 0;
+    uint32_t v = 0;
+
+
+
+    assert(NULL != ptr);
+    assert(NULL != end);
+
+    band = rtalloc(sizeof (struct rt_band_t));
+    if (!band) {
+        rterror("rt_band_from_wkb: Out of memory allocating rt_band during WKB parsing");
+        return 0;
+    }
+
+    if (end - *ptr < 1) {
+        rterror("rt_band_from_wkb: Premature end of WKB on band reading (%s:%d)",
+                __FILE__, __LINE__);
+        return 0;
+    }
+    type = read_uint8(ptr);
+
+    if ((type & BANDTYPE_PIXTYPE_MASK) >= PT_END) {
+        rterror("rt_band_from_wkb: Invalid pixtype %d", type & BANDTYPE_PIXTYPE_MASK);
+        rtdealloc(band);
+        return 0;
+    }
+    assert(NULL != band);
+
+    band->pixtype = type & BANDTYPE_PIXTYPE_MASK;
+    band->offline = BANDTYPE_IS_OFFDB(type) ? 1 : 0;
+    band->hasnodata = BANDTYPE_HAS_NODATA(type) ? 1 : 0;
+    band->isnodata = BANDTYPE_IS_NODATA(type) ? 1 : 0;
+    band->width = width;
+    band->height = height;
+    band->hascachedstats = FALSE;
+
+    RASTER_DEBUGF(3, " Band pixtype:%s, offline:%d, hasnodata:%d",
+            rt_pixtype_name(band->pixtype),
+            band->offline,
+            band->hasnodata);
+
+    /* Check there's enough bytes to read nodata value */
+
+    pixbytes = rt_pixtype_size(band->pixtype);
+    if (((*ptr) + pixbytes) >= end) {
+        rterror("rt_band_from_wkb: Premature end of WKB on band novalue reading");
+        rtdealloc(band);
+        return 0;
+    }
+
+    /* Read nodata value */
+    switch (band->pixtype) {
+        case PT_1BB:
+        {
+            band->nodataval = ((int) read_uint8(ptr)) & 0x01;
+            break;
+        }
+        case PT_2BUI:
+        {
+            band->nodataval = ((int) read_uint8(ptr)) & 0x03;
+            break;
+        }
+        case PT_4BUI:
+        {
+            band->nodataval = ((int) read_uint8(ptr)) & 0x0F;
+            break;
+        }
+        case PT_8BSI:
+        {
+            band->nodataval = read_int8(ptr);
+            break;
+        }
+        case PT_8BUI:
+        {
+            band->nodataval = read_uint8(ptr);
+            break;
+        }
+        case PT_16BSI:
+        {
+            band->nodataval = read_int16(ptr, littleEndian);
+            break;
+        }
+        case PT_16BUI:
+        {
+            band->nodataval = read_uint16(ptr, littleEndian);
+            break;
+        }
+        case PT_32BSI:
+        {
+            band->nodataval = read_int32(ptr, littleEndian);
+            break;
+        }
+        case PT_32BUI:
+        {
+            band->nodataval = read_uint32(ptr, littleEndian);
+            break;
+        }
+        case PT_32BF:
+        {
+            band->nodataval = read_float32(ptr, littleEndian);
+            break;
+        }
+        case PT_64BF:
+        {
+            band->nodataval = read_float64(ptr, littleEndian);
+            break;
+        }
+        default:
+        {
+            rterror("rt_band_from_wkb: Unknown pixeltype %d", band->pixtype);
+            rtdealloc(band);
+            return 0;
+        }
+    }
+
+    RASTER_DEBUGF(3, " Nodata value: %g, pixbytes: %d, ptr @ %p, end @ %p",
+            band->nodataval, pixbytes, *ptr, end);
+
+    if (band->offline) {
+        if (((*ptr) + 1) >= end) {
+            rterror("rt_band_from_wkb: Premature end of WKB on offline "
+                    "band data bandNum reading (%s:%d)",
+                    __FILE__, __LINE__);
+            rtdealloc(band);
+            return 0;
+        }
+        band->data.offline.bandNum = read_int8(ptr);
+
+        band->data.offline.mem = NULL;
+
+        {
+            /* check we have a NULL-termination */
+            sz = 0;
+            while ((*ptr)[sz] && &((*ptr)[sz]) < end) ++sz;
+            if (&((*ptr)[sz]) >= end) {
+                rterror("rt_band_from_wkb: Premature end of WKB on band offline path reading");
+                rtdealloc(band);
+                return 0;
+            }
+
+            band->ownsData = 1;
+            band->data.offline.path = rtalloc(sz + 1);
+
+            memcpy(band->data.offline.path, *ptr, sz);
+            band->data.offline.path[sz] = '\0';
+
+            RASTER_DEBUGF(3, "OFFDB band path is %s (size is %d)",
+                    band->data.offline.path, sz);
+
+            *ptr += sz + 1;
+
+            /* TODO: How could we know if the offline band is a nodata band? */
+            band->isnodata = FALSE;
+        }
+        return band;
+    }
+
+    /* This is an on-disk band */
+    sz = width * height * pixbytes;
+    if (((*ptr) + sz) > end) {
+        rterror("rt_band_from_wkb: Premature end of WKB on band data reading (%s:%d)",
+                __FILE__, __LINE__);
+        rtdealloc(band);
+        return 0;
+    }
+
+    band->data.mem = rtalloc(sz);
+    if (!band->data.mem) {
+        rterror("rt_band_from_wkb: Out of memory during band creation in WKB parser");
+        rtdealloc(band);
+        return 0;
+    }
 
-	band = rt_band_new_inline(width, height, pixtype, hasnodata, nodataval, mem);
-	if (!band) {
-		rterror("rt_band_reclass: Could not create new band");
-		rtdealloc(mem);
-		return 0;
-	}
-	RASTER_DEBUGF(3, "rt_band_reclass: new band @ %p", band);
+    memcpy(band->data.mem, *ptr, sz);
+    *ptr += sz;
 
-	for (x = 0; x < width; x++) {
-		for (y = 0; y < height; y++) {
-			rtn = rt_band_get_pixel(srcband, x, y, &ov);
+    /* Should now flip values if > 8bit and
+     * littleEndian != isMachineLittleEndian */
+    if (pixbytes > 1) {
+        if (isMachineLittleEndian() != littleEndian) {
+            {
+                void (*flipper)(uint8_t*) = 0;
+                uint8_t *flipme = NULL;
 
-			/* error getting value, skip */
-			if (rtn == -1) {
-				RASTER_DEBUGF(3, "Cannot get value at %d, %d", x, y);
-				continue;
-			}
+                if (pixbytes == 2) flipper = flip_endian_16;
+                else if (pixbytes == 4) flipper = flip_endian_32;
+                else if (pixbytes == 8) flipper = flip_endian_64;
+                else {
+                    rterror("rt_band_from_wkb: Unexpected pix bytes %d", pixbytes);
+                    rtdealloc(band);
+                    rtdealloc(band->data.mem);
+                    return 0;
+                }
 
-			do {
-				do_nv = 0;
+                flipme = band->data.mem;
+                sz = width * height;
+                for (v = 0; v < sz; ++v) {
+                    flipper(flipme);
+                    flipme += pixbytes;
+                }
+            }
+        }
+    }
+        /* And should check for invalid values for < 8bit types */
+    else if (band->pixtype == PT_1BB ||
+            band->pixtype == PT_2BUI ||
+            band->pixtype == PT_4BUI) {
+        {
+            uint8_t maxVal = band->pixtype == PT_1BB ? 1 :
+                    band->pixtype == PT_2BUI ? 3 :
+                    15;
+            uint8_t val;
 
-				/* no data*/
-				if (src_hasnodata && hasnodata && ov == src_nodataval) {
-					do_nv = 1;
-					break;
-				}
+            sz = width*height;
+            for (v = 0; v < sz; ++v) {
+                val = ((uint8_t*) band->data.mem)[v];
+                if (val > maxVal) {
+                    rterror("rt_band_from_wkb: Invalid value %d for pixel of type %s",
+                            val, rt_pixtype_name(band->pixtype));
+                    rtdealloc(band->data.mem);
+                    rtdealloc(band);
+                    return 0;
+                }
+            }
+        }
+    }
 
-				for (i = 0; i < exprcount; i++) {
-					expr = exprset[i];
+    /* And we should check if the band is a nodata band */
+    /* TODO: No!! This is too slow */
+    /*rt_band_check_is_nodata(band);*/
 
-					/* ov matches min and max*/
-					if (
-						FLT_EQ(expr->src.min, ov) &&
-						FLT_EQ(expr->src.max, ov)
-					) {
-						do_nv = 1;
-						break;
-					}
+    return band;
+}
 
-					/* process min */
-					if ((
-						expr->src.exc_min && (
-							expr->src.min > ov ||
-							FLT_EQ(expr->src.min, ov)
-						)) || (
-						expr->src.inc_min && (
-							expr->src.min < ov ||
-							FLT_EQ(expr->src.min, ov)
-						)) || (
-						expr->src.min < ov
-					)) {
-						/* process max */
-						if ((
-							expr->src.exc_max && (
-								ov > expr->src.max ||
-								FLT_EQ(expr->src.max, ov)
-							)) || (
-								expr->src.inc_max && (
-								ov < expr->src.max ||
-								FLT_EQ(expr->src.max, ov)
-							)) || (
-							ov < expr->src.max
-						)) {
-							do_nv = 1;
-							break;
-						}
-					}
-				}
-			}
-			while (0);
+/* -4 for size, +1 for endian */
+#define RT_WKB_HDR_SZ (sizeof(struct rt_raster_serialized_t)-4+1)
 
-			/* no expression matched, do not continue */
-			if (!do_nv) continue;
+rt_raster
+rt_raster_from_wkb(const uint8_t* wkb, uint32_t wkbsize) {
+    const uint8_t *ptr = wkb;
+    const uint8_t *wkbend = NULL;
+    rt_raster rast = NULL;
+    uint8_t endian = 0;
+    uint16_t version = 0;
+    uint16_t i = 0;
 
-			/* converting a value from one range to another range
-			OldRange = (OldMax - OldMin)
-			NewRange = (NewMax - NewMin)
-			NewValue = (((OldValue - OldMin) * NewRange) / OldRange) + NewMin
-			*/
 
-			/* nodata */
-			if (
-				src_hasnodata &&
-				hasnodata &&
-				FLT_EQ(ov, src_nodataval)
-			) {
-				nv = nodataval;
-			}
-			/*
-				"src" min and max is the same, prevent division by zero
-				set nv to "dst" min, which should be the same as "dst" max
-			*/
-			else if (FLT_EQ(expr->src.max, expr->src.min)) {
-				nv = expr->dst.min;
-			}
-			else {
-				or = expr->src.max - expr->src.min;
-				nr = expr->dst.max - expr->dst.min;
-				nv = (((ov - expr->src.min) * nr) / or) + expr->dst.min;
 
-				/* if dst range is from high to low */
-				if (expr->dst.min > expr->dst.max) {
-					if (nv > expr->dst.min)
-						nv = expr->dst.min;
-					else if (nv < expr->dst.max)
-						nv = expr->dst.max;
-				}
-				/* if dst range is from low to high */
-				else {
-					if (nv < expr->dst.min)
-						nv = expr->dst.min;
-					else if (nv > expr->dst.max)
-						nv = expr->dst.max;
-				}
-			}
+    assert(NULL != ptr);
 
-			/* round the value for integers */
-			switch (pixtype) {
-				case PT_1BB:
-				case PT_2BUI:
-				case PT_4BUI:
-				case PT_8BSI:
-				case PT_8BUI:
-				case PT_16BSI:
-				case PT_16BUI:
-				case PT_32BSI:
-				case PT_32BUI:
-					nv = round(nv);
-					break;
-				default:
-					break;
-			}
+    /* Check that wkbsize is >= sizeof(rt_raster_serialized) */
+    if (wkbsize < RT_WKB_HDR_SZ) {
+        rterror("rt_raster_from_wkb: wkb size (%d)  < min size (%d)",
+                wkbsize, RT_WKB_HDR_SZ);
+        return 0;
+    }
+    wkbend = wkb + wkbsize;
 
-			RASTER_DEBUGF(3, "(%d, %d) ov: %f or: %f - %f nr: %f - %f nv: %f"
-				, x
-				, y
-				, ov
-				, (NULL != expr) ? expr->src.min : 0
-				, (NULL != expr) ? expr->src.max : 0
-				, (NULL != expr) ? expr->dst.min : 0
-				, (NULL != expr) ? expr->dst.max : 0
-				, nv
-			);
-			if (rt_band_set_pixel(band, x, y, nv) < 0) {
-				rterror("rt_band_reclass: Could not assign value to new band");
-				rt_band_destroy(band);
-				rtdealloc(mem);
-				return 0;
-			}
+    RASTER_DEBUGF(3, "Parsing header from wkb position %d (expected 0)",
+            d_binptr_to_pos(ptr, wkbend, wkbsize));
 
-			expr = NULL;
-		}
-	}
 
-	return band;
-}
+    CHECK_BINPTR_POSITION(ptr, wkbend, wkbsize, 0);
+
+    /* Read endianness */
+    endian = *ptr;
+    ptr += 1;
+
+    /* Read version of protocol */
+    version = read_uint16(&ptr, endian);
+    if (version != 0) {
+        rterror("rt_raster_from_wkb: WKB version %d unsupported", version);
+        return 0;
+    }
+
+    /* Read other components of raster header */
+    rast = (rt_raster) rtalloc(sizeof (struct rt_raster_t));
+    if (!rast) {
+        rterror("rt_raster_from_wkb: Out of memory allocating raster for wkb input");
+        return 0;
+    }
+    rast->numBands = read_uint16(&ptr, endian);
+    rast->scaleX = read_float64(&ptr, endian);
+    rast->scaleY = read_float64(&ptr, endian);
+    rast->ipX = read_float64(&ptr, endian);
+    rast->ipY = read_float64(&ptr, endian);
+    rast->skewX = read_float64(&ptr, endian);
+    rast->skewY = read_float64(&ptr, endian);
+		rt_raster_set_srid(rast, read_int32(&ptr, endian));
+    rast->width = read_uint16(&ptr, endian);
+    rast->height = read_uint16(&ptr, endian);
+    rast->cachedstats = NULL;
+
+    /* Consistency checking, should have been checked before */
+    assert(ptr <= wkbend);
 
-/*- rt_raster --------------------------------------------------------*/
+    RASTER_DEBUGF(3, "rt_raster_from_wkb: Raster numBands: %d",
+            rast->numBands);
+    RASTER_DEBUGF(3, "rt_raster_from_wkb: Raster scale: %gx%g",
+            rast->scaleX, rast->scaleY);
+    RASTER_DEBUGF(3, "rt_raster_from_wkb: Raster ip: %gx%g",
+            rast->ipX, rast->ipY);
+    RASTER_DEBUGF(3, "rt_raster_from_wkb: Raster skew: %gx%g",
+            rast->skewX, rast->skewY);
+    RASTER_DEBUGF(3, "rt_raster_from_wkb: Raster srid: %d",
+            rast->srid);
+    RASTER_DEBUGF(3, "rt_raster_from_wkb: Raster dims: %dx%d",
+            rast->width, rast->height);
+    RASTER_DEBUGF(3, "Parsing raster header finished at wkb position %d (expected 61)",
+            d_binptr_to_pos(ptr, wkbend, wkbsize));
 
-rt_raster
-rt_raster_new(uint16_t width, uint16_t height) {
-    rt_raster ret = NULL;
+    CHECK_BINPTR_POSITION(ptr, wkbend, wkbsize, 61);
 
+    /* Read all bands of raster */
 
+    if (!rast->numBands) {
+        /* Here ptr should have been left to right after last used byte */
+        if (ptr < wkbend) {
+            rtwarn("%d bytes of WKB remained unparsed", wkbend - ptr);
+        } else if (ptr > wkbend) {
+            /* Easier to get a segfault before I guess */
+            rtwarn("We parsed %d bytes more then available!", ptr - wkbend);
+        }
+        rast->bands = 0;
+        return rast;
+    }
 
-    ret = (rt_raster) rtalloc(sizeof (struct rt_raster_t));
-    if (!ret) {
-        rterror("rt_raster_new: Out of virtual memory creating an rt_raster");
+    /* Now read the bands */
+    rast->bands = (rt_band*) rtalloc(sizeof (rt_band) * rast->numBands);
+    if (!rast->bands) {
+        rterror("rt_raster_from_wkb: Out of memory allocating bands for WKB raster decoding");
+        rtdealloc(rast);
         return 0;
     }
 
-    RASTER_DEBUGF(3, "Created rt_raster @ %p", ret);
-
-    assert(NULL != ret);
+    /* ptr should now point to start of first band */
+    assert(ptr <= wkbend); /* we should have checked this before */
 
-    ret->width = width;
+    for (i = 0; i < rast->numBands; ++i) {
+        RASTER_DEBUGF(3, "Parsing band %d from wkb position %d", i,
+                d_binptr_to_pos(ptr, wkbend, wkbsize));
 
-    ret->height = height;
-    ret->scaleX = 1;
-    ret->scaleY = 1;
-    ret->ipX = 0.0;
-    ret->ipY = 0.0;
-    ret->skewX = 0.0;
-    ret->skewY = 0.0;
-    ret->srid = SRID_UNKNOWN;
+        rt_band band = rt_band_from_wkb(rast->width, rast->height,
+                &ptr, wkbend, endian);
+        if (!band) {
+            rterror("rt_raster_from_wkb: Error reading WKB form of band %d", i);
+            rtdealloc(rast);
+            /* TODO: dealloc any previously allocated band too ! */
+            return 0;
+        }
+				band->raster = rast;
+        rast->bands[i] = band;
+    }
 
-    ret->numBands = 0;
-    ret->bands = 0;
+    /* Here ptr should have been left to right after last used byte */
+    if (ptr < wkbend) {
+        rtwarn("%d bytes of WKB remained unparsed", wkbend - ptr);
+    } else if (ptr > wkbend) {
+        /* Easier to get a segfault before I guess */
+        rtwarn("We parsed %d bytes more then available!",
+                ptr - wkbend);
+    }
 
-    return ret;
+    assert(NULL != rast);
+    return rast;
 }
 
-void
-rt_raster_destroy(rt_raster raster) {
+rt_raster
+rt_raster_from_hexwkb(const char* hexwkb,
+        uint32_t hexwkbsize) {
+    uint8_t* wkb = NULL;
+    uint32_t wkbsize = 0;
+    uint32_t i = 0;
 
 
-    RASTER_DEBUGF(3, "Destroying rt_raster @ %p", raster);
 
-    if (raster->bands) {
-        rtdealloc(raster->bands);
-    }
-    rtdealloc(raster);
-}
+    assert(NULL != hexwkb);
 
-uint16_t
-rt_raster_get_width(rt_raster raster) {
+    RASTER_DEBUGF(3, "rt_raster_from_hexwkb: input wkb: %s", hexwkb);
 
-    assert(NULL != raster);
+    if (hexwkbsize % 2) {
+        rterror("rt_raster_from_hexwkb: Raster HEXWKB input must have an even number of characters");
+        return 0;
+    }
+    wkbsize = hexwkbsize / 2;
 
-    return raster->width;
-}
+    wkb = rtalloc(wkbsize);
+    if (!wkb) {
+        rterror("rt_raster_from_hexwkb: Out of memory allocating memory for decoding HEXWKB");
+        return 0;
+    }
 
-uint16_t
-rt_raster_get_height(rt_raster raster) {
+    for (i = 0; i < wkbsize; ++i) /* parse full hex */ {
+        wkb[i] = parse_hex((char*) & (hexwkb[i * 2]));
+    }
 
-    assert(NULL != raster);
+    rt_raster ret = rt_raster_from_wkb(wkb, wkbsize);
 
-    return raster->height;
+    rtdealloc(wkb); /* as long as rt_raster_from_wkb copies memory */
+
+    return ret;
 }
 
-void
-rt_raster_set_scale(rt_raster raster,
-        double scaleX, double scaleY) {
+static uint32_t
+rt_raster_wkb_size(rt_raster raster) {
+    uint32_t size = RT_WKB_HDR_SZ;
+    uint16_t i = 0;
+
 
 
     assert(NULL != raster);
 
-    raster->scaleX = scaleX;
-    raster->scaleY = scaleY;
-}
+    RASTER_DEBUGF(3, "rt_raster_wkb_size: computing size for %d bands",
+            raster->numBands);
 
-double
-rt_raster_get_x_scale(rt_raster raster) {
+    for (i = 0; i < raster->numBands; ++i) {
+        rt_band band = raster->bands[i];
+        rt_pixtype pixtype = band->pixtype;
+        int pixbytes = rt_pixtype_size(pixtype);
+
+        RASTER_DEBUGF(3, "rt_raster_wkb_size: adding size of band %d", i);
 
+        if (pixbytes < 1) {
+            rterror("rt_raster_wkb_size: Corrupted band: unknown pixtype");
+            return 0;
+        }
 
-    assert(NULL != raster);
+        /* Add space for band type */
+        size += 1;
 
-    return raster->scaleX;
-}
+        /* Add space for nodata value */
+        size += pixbytes;
 
-double
-rt_raster_get_y_scale(rt_raster raster) {
+        if (band->offline) {
+            /* Add space for band number */
+            size += 1;
 
+            /* Add space for null-terminated path */
+            size += strlen(band->data.offline.path) + 1;
+        } else {
+            /* Add space for actual data */
+            size += pixbytes * raster->width * raster->height;
+        }
 
-    assert(NULL != raster);
+    }
 
-    return raster->scaleY;
+    return size;
 }
 
-void
-rt_raster_set_skews(rt_raster raster,
-        double skewX, double skewY) {
-
+uint8_t *
+rt_raster_to_wkb(rt_raster raster, uint32_t *wkbsize) {
+#if POSTGIS_DEBUG_LEVEL > 0
+    const uint8_t *wkbend = NULL;
+#endif
+    uint8_t *wkb = NULL;
+    uint8_t *ptr = NULL;
+    uint16_t i = 0;
+    uint8_t littleEndian = isMachineLittleEndian();
 
-    assert(NULL != raster);
 
-    raster->skewX = skewX;
-    raster->skewY = skewY;
-}
 
-double
-rt_raster_get_x_skew(rt_raster raster) {
+    assert(NULL != raster);
+    assert(NULL != wkbsize);
 
+    RASTER_DEBUG(2, "rt_raster_to_wkb: about to call rt_raster_wkb_size");
 
-    assert(NULL != raster);
+    *wkbsize = rt_raster_wkb_size(raster);
 
-    return raster->skewX;
-}
+    RASTER_DEBUGF(3, "rt_raster_to_wkb: found size: %d", *wkbsize);
 
-double
-rt_raster_get_y_skew(rt_raster raster) {
+    wkb = (uint8_t*) rtalloc(*wkbsize);
+    if (!wkb) {
+        rterror("rt_raster_to_wkb: Out of memory allocating WKB for raster");
+        return 0;
+    }
 
+    ptr = wkb;
 
-    assert(NULL != raster);
+#if POSTGIS_DEBUG_LEVEL > 2
+    wkbend = ptr + (*wkbsize);
+#endif
+    RASTER_DEBUGF(3, "Writing raster header to wkb on position %d (expected 0)",
+            d_binptr_to_pos(ptr, wkbend, *wkbsize));
 
-    return raster->skewY;
-}
+    /* Write endianness */
+    *ptr = littleEndian;
+    ptr += 1;
 
-void
-rt_raster_set_offsets(rt_raster raster, double x, double y) {
+    /* Write version(size - (end - ptr)) */
+    write_uint16(&ptr, littleEndian, 0);
 
+    /* Copy header (from numBands up) */
+    memcpy(ptr, &(raster->numBands), sizeof (struct rt_raster_serialized_t) - 6);
+    ptr += sizeof (struct rt_raster_serialized_t) - 6;
 
-    assert(NULL != raster);
+    RASTER_DEBUGF(3, "Writing bands header to wkb position %d (expected 61)",
+            d_binptr_to_pos(ptr, wkbend, *wkbsize));
 
-    raster->ipX = x;
-    raster->ipY = y;
-}
+    /* Serialize bands now */
+    for (i = 0; i < raster->numBands; ++i) {
+        rt_band band = raster->bands[i];
+        rt_pixtype pixtype = band->pixtype;
+        int pixbytes = rt_pixtype_size(pixtype);
 
-double
-rt_raster_get_x_offset(rt_raster raster) {
+        RASTER_DEBUGF(3, "Writing WKB for band %d", i);
+        RASTER_DEBUGF(3, "Writing band pixel type to wkb position %d",
+                d_binptr_to_pos(ptr, wkbend, *wkbsize));
 
+        if (pixbytes < 1) {
+            rterror("rt_raster_to_wkb: Corrupted band: unknown pixtype");
+            return 0;
+        }
 
-    assert(NULL != raster);
+        /* Add band type */
+        *ptr = band->pixtype;
+        if (band->offline) *ptr |= BANDTYPE_FLAG_OFFDB;
+        if (band->hasnodata) *ptr |= BANDTYPE_FLAG_HASNODATA;
+        if (band->isnodata) *ptr |= BANDTYPE_FLAG_ISNODATA;
+        ptr += 1;
 
-    return raster->ipX;
-}
+#if 0 /* no padding required for WKB */
+        /* Add padding (if needed) */
+        if (pixbytes > 1) {
+            memset(ptr, '\0', pixbytes - 1);
+            ptr += pixbytes - 1;
+        }
+        /* Consistency checking (ptr is pixbytes-aligned) */
+        assert(!(((uint64_t) ptr) % pixbytes));
+#endif
 
-double
-rt_raster_get_y_offset(rt_raster raster) {
+        RASTER_DEBUGF(3, "Writing band nodata to wkb position %d",
+                d_binptr_to_pos(ptr, wkbend, *wkbsize));
 
+        /* Add nodata value */
+        switch (pixtype) {
+            case PT_1BB:
+            case PT_2BUI:
+            case PT_4BUI:
+            case PT_8BUI:
+            {
+                uint8_t v = band->nodataval;
+                *ptr = v;
+                ptr += 1;
+                break;
+            }
+            case PT_8BSI:
+            {
+                int8_t v = band->nodataval;
+                *ptr = v;
+                ptr += 1;
+                break;
+            }
+            case PT_16BSI:
+            case PT_16BUI:
+            {
+                uint16_t v = band->nodataval;
+                memcpy(ptr, &v, 2);
+                ptr += 2;
+                break;
+            }
+            case PT_32BSI:
+            case PT_32BUI:
+            {
+                uint32_t v = band->nodataval;
+                memcpy(ptr, &v, 4);
+                ptr += 4;
+                break;
+            }
+            case PT_32BF:
+            {
+                float v = band->nodataval;
+                memcpy(ptr, &v, 4);
+                ptr += 4;
+                break;
+            }
+            case PT_64BF:
+            {
+                memcpy(ptr, &band->nodataval, 8);
+                ptr += 8;
+                break;
+            }
+            default:
+                rterror("rt_raster_to_wkb: Fatal error caused by unknown pixel type. Aborting.");
+                abort(); /* shoudn't happen */
+                return 0;
+        }
 
-    assert(NULL != raster);
+#if 0 /* no padding for WKB */
+        /* Consistency checking (ptr is pixbytes-aligned) */
+        assert(!((uint64_t) ptr % pixbytes));
+#endif
 
-    return raster->ipY;
-}
+        if (band->offline) {
+            /* Write band number */
+            *ptr = band->data.offline.bandNum;
+            ptr += 1;
 
-void
-rt_raster_get_phys_params(rt_raster rast,
-        double *i_mag, double *j_mag, double *theta_i, double *theta_ij)
-{
-    double o11, o12, o21, o22 ; /* geotransform coefficients */
+            /* Write path */
+            strcpy((char*) ptr, band->data.offline.path);
+            ptr += strlen(band->data.offline.path) + 1;
+        } else {
+            /* Write data */
+            {
+                uint32_t datasize = raster->width * raster->height * pixbytes;
+                RASTER_DEBUGF(4, "rt_raster_to_wkb: Copying %d bytes", datasize);
+                memcpy(ptr, band->data.mem, datasize);
+                ptr += datasize;
+            }
+        }
 
-    if (rast == NULL) return ;
-    if ( (i_mag==NULL) || (j_mag==NULL) || (theta_i==NULL) || (theta_ij==NULL))
-        return ;
+#if 0 /* no padding for WKB */
+        /* Pad up to 8-bytes boundary */
+        while ((uint64_t) ptr % 8) {
+            *ptr = 0;
+            ++ptr;
+        }
 
-    /* retrieve coefficients from raster */
-    o11 = rt_raster_get_x_scale(rast) ;
-    o12 = rt_raster_get_x_skew(rast) ;
-    o21 = rt_raster_get_y_skew(rast) ;
-    o22 = rt_raster_get_y_scale(rast) ;
+        /* Consistency checking (ptr is pixbytes-aligned) */
+        assert(!((uint64_t) ptr % pixbytes));
+#endif
+    }
 
-    rt_raster_calc_phys_params(o11, o12, o21, o22, i_mag, j_mag, theta_i, theta_ij);
+    return wkb;
 }
 
-void
-rt_raster_calc_phys_params(double xscale, double xskew, double yskew, double yscale,
-                           double *i_mag, double *j_mag, double *theta_i, double *theta_ij)
+char *
+rt_raster_to_hexwkb(rt_raster raster, uint32_t *hexwkbsize) {
+    uint8_t *wkb = NULL;
+    char* hexwkb = NULL;
+    uint32_t i = 0;
+    uint32_t wkbsize = 0;
 
-{
-    double theta_test ;
 
-    if ( (i_mag==NULL) || (j_mag==NULL) || (theta_i==NULL) || (theta_ij==NULL))
-        return ;
 
-    /* pixel size in the i direction */
-    *i_mag = sqrt(xscale*xscale + yskew*yskew) ;
+    assert(NULL != raster);
+    assert(NULL != hexwkbsize);
 
-    /* pixel size in the j direction */
-    *j_mag = sqrt(xskew*xskew + yscale*yscale) ;
+    RASTER_DEBUG(2, "rt_raster_to_hexwkb: calling rt_raster_to_wkb");
 
-    /* Rotation
-     * ========
-     * Two steps:
-     * 1] calculate the magnitude of the angle between the x axis and
-     *     the i basis vector.
-     * 2] Calculate the sign of theta_i based on the angle between the y axis
-     *     and the i basis vector.
-     */
-    *theta_i = acos(xscale/(*i_mag)) ;  /* magnitude */
-    theta_test = acos(yskew/(*i_mag)) ; /* sign */
-    if (theta_test < M_PI_2){
-        *theta_i = -(*theta_i) ;
-    }
+    wkb = rt_raster_to_wkb(raster, &wkbsize);
 
+    RASTER_DEBUG(3, "rt_raster_to_hexwkb: rt_raster_to_wkb returned");
 
-    /* Angular separation of basis vectors
-     * ===================================
-     * Two steps:
-     * 1] calculate the magnitude of the angle between the j basis vector and
-     *     the i basis vector.
-     * 2] Calculate the sign of theta_ij based on the angle between the
-     *    perpendicular of the i basis vector and the j basis vector.
-     */
-    *theta_ij = acos(((xscale*xskew) + (yskew*yscale))/((*i_mag)*(*j_mag))) ;
-    theta_test = acos( ((-yskew*xskew)+(xscale*yscale)) /
-            ((*i_mag)*(*j_mag)));
-    if (theta_test > M_PI_2) {
-        *theta_ij = -(*theta_ij) ;
+    *hexwkbsize = wkbsize * 2; /* hex is 2 times bytes */
+    hexwkb = (char*) rtalloc((*hexwkbsize) + 1);
+    if (!hexwkb) {
+        rtdealloc(wkb);
+        rterror("rt_raster_to_hexwkb: Out of memory hexifying raster WKB");
+        return 0;
     }
-}
+    hexwkb[*hexwkbsize] = '\0'; /* Null-terminate */
 
-void
-rt_raster_set_phys_params(rt_raster rast,double i_mag, double j_mag, double theta_i, double theta_ij)
-{
-    double o11, o12, o21, o22 ; /* calculated geotransform coefficients */
-    int success ;
+    for (i = 0; i < wkbsize; ++i) {
+        deparse_hex(wkb[i], &(hexwkb[2 * i]));
+    }
 
-    if (rast == NULL) return ;
+    rtdealloc(wkb); /* we don't need this anymore */
 
-    success = rt_raster_calc_gt_coeff(i_mag, j_mag, theta_i, theta_ij,
-                            &o11, &o12, &o21, &o22) ;
+    RASTER_DEBUGF(3, "rt_raster_to_hexwkb: output wkb: %s", hexwkb);
 
-    if (success) {
-        rt_raster_set_scale(rast, o11, o22) ;
-        rt_raster_set_skews(rast, o12, o21) ;
-    }
+    return hexwkb;
 }
 
-int
-rt_raster_calc_gt_coeff(double i_mag, double j_mag, double theta_i, double theta_ij,
-                        double *xscale, double *xskew, double *yskew, double *yscale)
-{
-    double f ;        /* reflection flag 1.0 or -1.0 */
-    double k_i ;      /* shearing coefficient */
-    double s_i, s_j ; /* scaling coefficients */
-    double cos_theta_i, sin_theta_i ;
+/*--------- Serializer/Deserializer --------------------------------------*/
 
-    if ( (xscale==NULL) || (xskew==NULL) || (yskew==NULL) || (yscale==NULL)) {
-        return 0;
-    }
+/* A raster is serialized with band statistics (version 1) if any band has some */
+static int
+_rti_raster_has_cached_stats(rt_raster raster) {
+    uint16_t i = 0;
 
-    if ( (theta_ij == 0.0) || (theta_ij == M_PI)) {
-        return 0;
+    for (i = 0; i < raster->numBands; ++i) {
+        if (raster->bands[i]->hascachedstats)
+            return TRUE;
     }
 
-    /* Reflection across the i axis */
-    f=1.0 ;
-    if (theta_ij < 0) {
-        f = -1.0;
-    }
+    return FALSE;
+}
 
-    /* scaling along i axis */
-    s_i = i_mag ;
+static uint32_t
+rt_raster_serialized_size(rt_raster raster) {
+    uint32_t size = sizeof (struct rt_raster_serialized_t);
+    uint16_t i = 0;
 
-    /* shearing parallel to i axis */
-    k_i = tan(f*M_PI_2 - theta_ij) ;
 
-    /* scaling along j axis */
-    s_j = j_mag / (sqrt(k_i*k_i + 1)) ;
 
-    /* putting it altogether */
-    cos_theta_i = cos(theta_i) ;
-    sin_theta_i = sin(theta_i) ;
-    *xscale = s_i * cos_theta_i ;
-    *xskew  = k_i * s_j * f * cos_theta_i + s_j * f * sin_theta_i ;
-    *yskew  = -s_i * sin_theta_i ;
-    *yscale = -k_i * s_j * f * sin_theta_i + s_j * f * cos_theta_i ;
-    return 1;
-}
+    assert(NULL != raster);
 
-int32_t
-rt_raster_get_srid(rt_raster raster) {
-	assert(NULL != raster);
+    /* Band statistics, 8-bytes aligned as is the header */
+    if (_rti_raster_has_cached_stats(raster))
+        size += sizeof (struct rt_cachedstats_t) * raster->numBands;
 
-	return clamp_srid(raster->srid);
-}
+    RASTER_DEBUGF(3, "Serialized size with just header:%d - now adding size of %d bands",
+            size, raster->numBands);
 
-void
-rt_raster_set_srid(rt_raster raster, int32_t srid) {
-	assert(NULL != raster);
+    for (i = 0; i < raster->numBands; ++i) {
+        rt_band band = raster->bands[i];
+        rt_pixtype pixtype = band->pixtype;
+        int pixbytes = rt_pixtype_size(pixtype);
 
-	raster->srid = clamp_srid(srid);
-}
+        if (pixbytes < 1) {
+            rterror("rt_raster_serialized_size: Corrupted band: unknown pixtype");
+            return 0;
+        }
 
-int
-rt_raster_get_num_bands(rt_raster raster) {
+        /* Add space for band type, hasnodata flag and data padding */
+        size += pixbytes;
 
+        /* Add space for nodata value */
+        size += pixbytes;
 
-    assert(NULL != raster);
+        if (band->offline) {
+            /* Add space for band number */
+            size += 1;
 
-    return raster->numBands;
-}
+            /* Add space for null-terminated path */
+            size += strlen(band->data.offline.path) + 1;
+        } else {
+            /* Add space for raster band data */
+            size += pixbytes * raster->width * raster->height;
+        }
 
-rt_band
-rt_raster_get_band(rt_raster raster, int n) {
+        RASTER_DEBUGF(3, "Size before alignment is %d", size);
 
+        /* Align size to 8-bytes boundary (trailing padding) */
+        /* XXX jorgearevalo: bug here. If the size is actually 8-bytes aligned,
+         this line will add 8 bytes trailing padding, and it's not necessary */
+        /*size += 8 - (size % 8);*/
+        if (size % 8)
+            size += 8 - (size % 8);
 
-    assert(NULL != raster);
+        RASTER_DEBUGF(3, "Size after alignment is %d", size);
+    }
 
-    if (n >= raster->numBands || n < 0) return 0;
-    return raster->bands[n];
+    return size;
 }
 
-/**
- * Add band data to a raster.
- *
- * @param raster : the raster to add a band to
- * @param band : the band to add, ownership left to caller.
- *               Band dimensions are required to match with raster ones.
- * @param index : the position where to insert the new band (0 based)
- *
- * @return identifier (position) for the just-added raster, or -1 on error
- */
-int32_t
-rt_raster_add_band(rt_raster raster, rt_band band, int index) {
-    rt_band *oldbands = NULL;
-    rt_band oldband = NULL;
-    rt_band tmpband = NULL;
+void*
+rt_raster_serialize(rt_raster raster) {
+    uint32_t size = rt_raster_serialized_size(raster);
+    uint8_t* ret = NULL;
+    uint8_t* ptr = NULL;
     uint16_t i = 0;
 
 
-
     assert(NULL != raster);
 
-    RASTER_DEBUGF(3, "Adding band %p to raster %p", band, raster);
-
-    if (band->width != raster->width || band->height != raster->height) {
-        rterror("rt_raster_add_band: Can't add a %dx%d band to a %dx%d raster",
-                band->width, band->height, raster->width, raster->height);
-        return -1;
+    ret = (uint8_t*) rtalloc(size);
+    if (!ret) {
+        rterror("rt_raster_serialize: Out of memory allocating %d bytes for serializing a raster",
+                size);
+        return 0;
     }
+    memset(ret, '-', size);
 
-    if (index > raster->numBands)
-        index = raster->numBands;
+    ptr = ret;
 
-    if (index < 0)
-        index = 0;
+    RASTER_DEBUGF(3, "sizeof(struct rt_raster_serialized_t):%u",
+            sizeof (struct rt_raster_serialized_t));
+    RASTER_DEBUGF(3, "sizeof(struct rt_raster_t):%u",
+            sizeof (struct rt_raster_t));
+    RASTER_DEBUGF(3, "serialized size:%lu", (long unsigned) size);
 
-    oldbands = raster->bands;
+    /* Set size */
+    /* NOTE: Value of rt_raster.size may be updated in
+     * returned object, for instance, by rt_pg layer to
+     * store value calculated by SET_VARSIZE.
+     */
+    raster->size = size;
 
-    RASTER_DEBUGF(3, "Oldbands at %p", oldbands);
+    /* Set version */
+    raster->version = _rti_raster_has_cached_stats(raster) ? 1 : 0;
 
-    raster->bands = (rt_band*) rtrealloc(raster->bands,
-            sizeof (rt_band)*(raster->numBands + 1)
-            );
+    /* Copy header */
+    memcpy(ptr, raster, sizeof (struct rt_raster_serialized_t));
 
-    RASTER_DEBUG(3, "Checking bands");
+    RASTER_DEBUG(3, "Start hex dump of raster being serialized using 0x2D to mark non-written bytes");
 
-    if (NULL == raster->bands) {
-        rterror("rt_raster_add_band: Out of virtual memory "
-                "reallocating band pointers");
-        raster->bands = oldbands;
-        return -1;
-    }
+#if POSTGIS_DEBUG_LEVEL > 2
+    uint8_t* dbg_ptr = ptr;
+    d_print_binary_hex("HEADER", dbg_ptr, size);
+#endif
 
-    RASTER_DEBUGF(4, "realloc returned %p", raster->bands);
+    ptr += sizeof (struct rt_raster_serialized_t);
 
-    for (i = 0; i <= raster->numBands; ++i) {
-        if (i == index) {
-            oldband = raster->bands[i];
-            raster->bands[i] = band;
-        } else if (i > index) {
-            tmpband = raster->bands[i];
-            raster->bands[i] = oldband;
-            oldband = tmpband;
+    /* Statistics of the bands, zeroed (invalid) for the bands without */
+    if (raster->version > 0) {
+        for (i = 0; i < raster->numBands; ++i) {
+            if (raster->bands[i]->hascachedstats)
+                memcpy(ptr, &(raster->bands[i]->cachedstats), sizeof (struct rt_cachedstats_t));
+            else
+                memset(ptr, 0, sizeof (struct rt_cachedstats_t));
+            ptr += sizeof (struct rt_cachedstats_t);
         }
     }
 
-		band->raster = raster;
-
-    raster->numBands++;
+    /* Serialize bands now */
+    for (i = 0; i < raster->numBands; ++i) {
+        rt_band band = raster->bands[i];
+        assert(NULL != band);
 
-    RASTER_DEBUGF(4, "now raster has %d bands", raster->numBands);
+        rt_pixtype pixtype = band->pixtype;
+        int pixbytes = rt_pixtype_size(pixtype);
+        if (pixbytes < 1) {
+            rterror("rt_raster_serialize: Corrupted band: unknown pixtype");
+            return 0;
+        }
 
-    return index;
-}
+        /* Add band type */
+        *ptr = band->pixtype;
+        if (band->offline) {
+            *ptr |= BANDTYPE_FLAG_OFFDB;
+        }
+        if (band->hasnodata) {
+            *ptr |= BANDTYPE_FLAG_HASNODATA;
+        }
 
-/**
- * Generate a new inline band and add it to a raster.
- *
- * @param raster : the raster to add a band to
- * @param pixtype: the pixel type for the new band
- * @param initialvalue: initial value for pixels
- * @param hasnodata: indicates if the band has a nodata value
- * @param nodatavalue: nodata value for the new band
- * @param index: position to add the new band in the raster
- *
- * @return identifier (position) for the just-added raster, or -1 on error
- */
-int32_t
-rt_raster_generate_new_band(rt_raster raster, rt_pixtype pixtype,
-        double initialvalue, uint32_t hasnodata, double nodatavalue, int index)
-{
-    rt_band band = NULL;
-    int width = 0;
-    int height = 0;
-    int numval = 0;
-    int datasize = 0;
-    int oldnumbands = 0;
-    int numbands = 0;
-    void * mem = NULL;
-    int32_t checkvalint = 0;
-    uint32_t checkvaluint = 0;
-    double checkvaldouble = 0;
-    float checkvalfloat = 0;
-    int i;
+        if (band->isnodata) {
+            *ptr |= BANDTYPE_FLAG_ISNODATA;
+        }
 
+#if POSTGIS_DEBUG_LEVEL > 2
+        d_print_binary_hex("PIXTYPE", dbg_ptr, size);
+#endif
 
-    assert(NULL != raster);
+        ptr += 1;
 
-    /* Make sure index is in a valid range */
-    oldnumbands = rt_raster_get_num_bands(raster);
-    if (index < 0)
-        index = 0;
-    else if (index > oldnumbands + 1)
-        index = oldnumbands + 1;
+        /* Add padding (if needed) */
+        if (pixbytes > 1) {
+            memset(ptr, '\0', pixbytes - 1);
+            ptr += pixbytes - 1;
+        }
 
-    /* Determine size of memory block to allocate and allocate it */
-    width = rt_raster_get_width(raster);
-    height = rt_raster_get_height(raster);
-    numval = width * height;
-    datasize = rt_pixtype_size(pixtype) * numval;
+#if POSTGIS_DEBUG_LEVEL > 2
+        d_print_binary_hex("PADDING", dbg_ptr, size);
+#endif
 
-    mem = (int *)rtalloc(datasize);
-    if (!mem) {
-        rterror("rt_raster_generate_new_band: Could not allocate memory for band");
-        return -1;
-    }
+        /* Consistency checking (ptr is pixbytes-aligned) */
+        assert(!((ptr - ret) % pixbytes));
 
-    if (FLT_EQ(initialvalue, 0.0))
-        memset(mem, 0, datasize);
-    else {
-        switch (pixtype)
-        {
+        /* Add nodata value */
+        switch (pixtype) {
             case PT_1BB:
-            {
-                uint8_t *ptr = mem;
-                uint8_t clamped_initval = rt_util_clamp_to_1BB(initialvalue);
-                for (i = 0; i < numval; i++)
-                    ptr[i] = clamped_initval;
-                checkvalint = ptr[0];
-                break;
-            }
             case PT_2BUI:
-            {
-                uint8_t *ptr = mem;
-                uint8_t clamped_initval = rt_util_clamp_to_2BUI(initialvalue);
-                for (i = 0; i < numval; i++)
-                    ptr[i] = clamped_initval;
-                checkvalint = ptr[0];
-                break;
-            }
             case PT_4BUI:
-            {
-                uint8_t *ptr = mem;
-                uint8_t clamped_initval = rt_util_clamp_to_4BUI(initialvalue);
-                for (i = 0; i < numval; i++)
-                    ptr[i] = clamped_initval;
-                checkvalint = ptr[0];
-                break;
-            }
-            case PT_8BSI:
-            {
-                int8_t *ptr = mem;
-                int8_t clamped_initval = rt_util_clamp_to_8BSI(initialvalue);
-                for (i = 0; i < numval; i++)
-                    ptr[i] = clamped_initval;
-                checkvalint = ptr[0];
-                break;
-            }
             case PT_8BUI:
             {
-                uint8_t *ptr = mem;
-                uint8_t clamped_initval = rt_util_clamp_to_8BUI(initialvalue);
-                for (i = 0; i < numval; i++)
-                    ptr[i] = clamped_initval;
-                checkvalint = ptr[0];
-                break;
-            }
-            case PT_16BSI:
-            {
-                int16_t *ptr = mem;
-                int16_t clamped_initval = rt_util_clamp_to_16BSI(initialvalue);
-                for (i = 0; i < numval; i++)
-                    ptr[i] = clamped_initval;
-                checkvalint = ptr[0];
+                uint8_t v = band->nodataval;
+                *ptr = v;
+                ptr += 1;
                 break;
             }
-            case PT_16BUI:
+            case PT_8BSI:
             {
-                uint16_t *ptr = mem;
-                uint16_t clamped_initval = rt_util_clamp_to_16BUI(initialvalue);
-                for (i = 0; i < numval; i++)
-                    ptr[i] = clamped_initval;
-                checkvalint = ptr[0];
+                int8_t v = band->nodataval;
+                *ptr = v;
+                ptr += 1;
                 break;
             }
-            case PT_32BSI:
+            case PT_16BSI:
+            case PT_16BUI:
             {
-                int32_t *ptr = mem;
-                int32_t clamped_initval = rt_util_clamp_to_32BSI(initialvalue);
-                for (i = 0; i < numval; i++)
-                    ptr[i] = clamped_initval;
-                checkvalint = ptr[0];
+                uint16_t v = band->nodataval;
+                memcpy(ptr, &v, 2);
+                ptr += 2;
                 break;
             }
+            case PT_32BSI:
             case PT_32BUI:
             {
-                uint32_t *ptr = mem;
-                uint32_t clamped_initval = rt_util_clamp_to_32BUI(initialvalue);
-                for (i = 0; i < numval; i++)
-                    ptr[i] = clamped_initval;
-                checkvaluint = ptr[0];
+                uint32_t v = band->nodataval;
+                memcpy(ptr, &v, 4);
+                ptr += 4;
                 break;
             }
             case PT_32BF:
             {
-                float *ptr = mem;
-                float clamped_initval = rt_util_clamp_to_32F(initialvalue);
-                for (i = 0; i < numval; i++)
-                    ptr[i] = clamped_initval;
-                checkvalfloat = ptr[0];
+                float v = band->nodataval;
+                memcpy(ptr, &v, 4);
+                ptr += 4;
                 break;
             }
             case PT_64BF:
             {
-                double *ptr = mem;
-                for (i = 0; i < numval; i++)
-                    ptr[i] = initialvalue;
-                checkvaldouble = ptr[0];
+                memcpy(ptr, &band->nodataval, 8);
+                ptr += 8;
                 break;
             }
             default:
-            {
-                rterror("rt_raster_generate_new_band: Unknown pixeltype %d", pixtype);
-                rtdealloc(mem);
-                return -1;
-            }
+                rterror("rt_raster_serialize: Fatal error caused by unknown pixel type. Aborting.");
+                abort(); /* shouldn't happen */
+                return 0;
         }
-    }
-
-    /* Overflow checking */
-    rt_util_dbl_trunc_warning(
-			initialvalue,
-			checkvalint, checkvaluint,
-			checkvalfloat, checkvaldouble,
-			pixtype
-		);
-
-    band = rt_band_new_inline(width, height, pixtype, hasnodata, nodatavalue, mem);
-    if (! band) {
-        rterror("rt_raster_generate_new_band: Could not add band to raster. Aborting");
-        rtdealloc(mem);
-        return -1;
-    }
-    index = rt_raster_add_band(raster, band, index);
-    numbands = rt_raster_get_num_bands(raster);
-    if (numbands == oldnumbands || index == -1) {
-        rterror("rt_raster_generate_new_band: Could not add band to raster. Aborting");
-        rt_band_destroy(band);
-    }
-
-    return index;
-}
-
-/**
- * Get 6-element array of raster geotransform matrix
- *
- * @param raster : the raster to get matrix of
- * @param gt : output parameter, 6-element geotransform matrix
- *
- */
-void
-rt_raster_get_geotransform_matrix(rt_raster raster,
-	double *gt) {
-	assert(NULL != raster);
-	assert(NULL != gt);
-
-	gt[0] = raster->ipX;
-	gt[1] = raster->scaleX;
-	gt[2] = raster->skewX;
-	gt[3] = raster->ipY;
-	gt[4] = raster->skewY;
-	gt[5] = raster->scaleY;
-}
-
-/**
- * Set raster's geotransform using 6-element array
- *
- * @param raster : the raster to set matrix of
- * @param gt : intput parameter, 6-element geotransform matrix
- *
- */
-void
-rt_raster_set_geotransform_matrix(rt_raster raster,
-	double *gt) {
-	assert(NULL != raster);
-	assert(NULL != gt);
-
-	raster->ipX = gt[0];
-	raster->scaleX = gt[1];
-	raster->skewX = gt[2];
-	raster->ipY = gt[3];
-	raster->skewY = gt[4];
-	raster->scaleY = gt[5];
-}
-
-/**
- * Convert an xr, yr raster point to an xw, yw point on map
- *
- * @param raster : the raster to get info from
- * @param xr : the pixel's column
- * @param yr : the pixel's row
- * @param xw : output parameter, X ordinate of the geographical point
- * @param yw : output parameter, Y ordinate of the geographical point
- * @param gt : input/output parameter, 3x2 geotransform matrix
- *
- * @return if zero, error occurred in function
- */
-int
-rt_raster_cell_to_geopoint(rt_raster raster,
-	double xr, double yr,
-	double *xw, double *yw,
-	double *gt
-) {
-	double *_gt = NULL;
-	int init_gt = 0;
-	int i = 0;
-
-	assert(NULL != raster);
-	assert(NULL != xw);
-	assert(NULL != yw);
-
-	if (NULL == gt) {
-		_gt = rtalloc(sizeof(double) * 6);
-		if (NULL == _gt) {
-			rterror("rt_raster_cell_to_geopoint: Unable to allocate memory for geotransform matrix");
-			return 0;
-		}
-		init_gt = 1;
-
-		for (i = 0; i < 6; i++) _gt[i] = 0;
-	}
-	else {
-		_gt = gt;
-		init_gt = 0;
-	}
-
-	/* scale of matrix is not set */
-	if (
-		FLT_EQ(_gt[1], 0) ||
-		FLT_EQ(_gt[5], 0)
-	) {
-		rt_raster_get_geotransform_matrix(raster, _gt);
-	}
-
-	RASTER_DEBUGF(4, "gt = (%f, %f, %f, %f, %f, %f)",
-		_gt[0],
-		_gt[1],
-		_gt[2],
-		_gt[3],
-		_gt[4],
-		_gt[5]
-	);
-
-	GDALApplyGeoTransform(_gt, xr, yr, xw, yw);
-	RASTER_DEBUGF(4, "GDALApplyGeoTransform (c -> g) for (%f, %f) = (%f, %f)",
-		xr, yr, *xw, *yw);
-
-	if (init_gt) rtdealloc(_gt);
-	return 1;
-}
 
-/**
- * Convert an xw,yw map point to a xr,yr raster point
- *
- * @param raster : the raster to get info from
- * @param xw : X ordinate of the geographical point
- * @param yw : Y ordinate of the geographical point
- * @param xr : output parameter, the pixel's column
- * @param yr : output parameter, the pixel's row
- * @param igt : input/output parameter, 3x2 inverse geotransform matrix
- *
- * @return if zero, error occurred in function
- */
-int
-rt_raster_geopoint_to_cell(rt_raster raster,
-	double xw, double yw,
-	double *xr, double *yr,
-	double *igt
-) {
-	double *_igt = NULL;
-	int i = 0;
-	int init_igt = 0;
-	double rnd = 0;
+        /* Consistency checking (ptr is pixbytes-aligned) */
+        assert(!((ptr - ret) % pixbytes));
 
-	assert(NULL != raster);
-	assert(NULL != xr);
-	assert(NULL != yr);
+#if POSTGIS_DEBUG_LEVEL > 2
+        d_print_binary_hex("nodata", dbg_ptr, size);
+#endif
 
-	if (igt == NULL) {
-		_igt = rtalloc(sizeof(double) * 6);
-		if (_igt == NULL) {
-			rterror("rt_raster_geopoint_to_cell: Unable to allocate memory for inverse geotransform matrix");
-			return 0;
-		}
-		init_igt = 1;
+        if (band->offline) {
+            /* Write band number */
+            *ptr = band->data.offline.bandNum;
+            ptr += 1;
 
-		for (i = 0; i < 6; i++) _igt[i] = 0;
-	}
-	else {
-		_igt = igt;
-		init_igt = 0;
-	}
+            /* Write path */
+            strcpy((char*) ptr, band->data.offline.path);
+            ptr += strlen(band->data.offline.path) + 1;
+        } else {
+            /* Write data */
+            uint32_t datasize = raster->width * raster->height * pixbytes;
+            memcpy(ptr, band->data.mem, datasize);
+            ptr += datasize;
+        }
 
-	/* matrix is not set */
-	if (
-		FLT_EQ(_igt[0], 0.) &&
-		FLT_EQ(_igt[1], 0.) &&
-		FLT_EQ(_igt[2], 0.) &&
-		FLT_EQ(_igt[3], 0.) &&
-		FLT_EQ(_igt[4], 0.) &&
-		FLT_EQ(_igt[5], 0.)
-	) {
-		double gt[6] = {0.0};
-		rt_raster_get_geotransform_matrix(raster, gt);
+#if POSTGIS_DEBUG_LEVEL > 2
+        d_print_binary_hex("BAND", dbg_ptr, size);
+#endif
 
-		if (!GDALInvGeoTransform(gt, _igt)) {
-			rterror("rt_raster_geopoint_to_cell: Unable to compute inverse geotransform matrix");
-			if (init_igt) rtdealloc(_igt);
-			return 0;
-		}
-	}
+        /* Pad up to 8-bytes boundary */
+        while ((uintptr_t) ptr % 8) {
+            *ptr = 0;
+            ++ptr;
 
-	GDALApplyGeoTransform(_igt, xw, yw, xr, yr);
-	RASTER_DEBUGF(4, "GDALApplyGeoTransform (g -> c) for (%f, %f) = (%f, %f)",
-		xw, yw, *xr, *yr);
+            RASTER_DEBUGF(3, "PAD at %d", (uintptr_t) ptr % 8);
 
-	rnd = ROUND(*xr, 0);
-	if (FLT_EQ(rnd, *xr))
-		*xr = rnd;
-	else
-		*xr = floor(*xr);
+        }
 
-	rnd = ROUND(*yr, 0);
-	if (FLT_EQ(rnd, *yr))
-		*yr = rnd;
-	else
-		*yr = floor(*yr);
+        /* Consistency checking (ptr is pixbytes-aligned) */
+        assert(!((ptr - ret) % pixbytes));
 
-	RASTER_DEBUGF(4, "Corrected GDALApplyGeoTransform (g -> c) for (%f, %f) = (%f, %f)",
-		xw, yw, *xr, *yr);
+    } /* for-loop over bands */
 
-	if (init_igt) rtdealloc(_igt);
-	return 1;
+#if POSTGIS_DEBUG_LEVEL > 2
+    d_print_binary_hex("SERIALIZED RASTER", dbg_ptr, size);
+#endif
+
+    return ret;
 }
 
-/**
- * Returns a set of "geomval" value, one for each group of pixel
- * sharing the same value for the provided band.
- *
- * A "geomval " value is a complex type composed of a the wkt
- * representation of a geometry (one for each group of pixel sharing
- * the same value) and the value associated with this geometry.
- *
- * @param raster: the raster to get info from.
- * @param nband: the band to polygonize. 0-based
- *
- * @return A set of "geomval" values, one for each group of pixels
- * sharing the same value for the provided band. The returned values are
- * WKT geometries, not real PostGIS geometries (this may change in the
- * future, and the function returns real geometries)
- */
-rt_geomval
-rt_raster_dump_as_wktpolygons(rt_raster raster, int nband, int * pnElements)
-{
-    char * pszQuery;
-    long j;
-    OGRSFDriverH ogr_drv = NULL;
-    GDALDriverH gdal_drv = NULL;
-    GDALDatasetH memdataset = NULL;
-    GDALRasterBandH gdal_band = NULL;
-    OGRDataSourceH memdatasource = NULL;
-    rt_geomval pols = NULL;
-    OGRLayerH hLayer = NULL;
-    OGRFeatureH hFeature = NULL;
-    OGRGeometryH hGeom = NULL;
-    OGRFieldDefnH hFldDfn = NULL;
-    char * pszSrcText = NULL;
-    int nFeatureCount = 0;
-    rt_band band = NULL;
-    int iPixVal = -1;
-    double dValue = 0.0;
-    int iBandHasNodataValue = FALSE;
-    double dBandNoData = 0.0;
+rt_raster
+rt_raster_deserialize(void* serialized, int header_only) {
+    rt_raster rast = NULL;
+    const uint8_t *ptr = NULL;
+    const uint8_t *beg = NULL;
+    const struct rt_cachedstats_t *stats = NULL;
+    uint16_t i = 0;
+    uint8_t littleEndian = isMachineLittleEndian();
 
-    uint32_t bandNums[1] = {nband};
 
-    /* Checkings */
 
+    assert(NULL != serialized);
 
-    assert(NULL != raster);
-    assert(nband >= 0 && nband < rt_raster_get_num_bands(raster));
+    RASTER_DEBUG(2, "rt_raster_deserialize: Entering...");
 
-    RASTER_DEBUG(2, "In rt_raster_dump_as_polygons");
+    /* NOTE: Value of rt_raster.size may be different
+     * than actual size of raster data being read.
+     * See note on SET_VARSIZE in rt_raster_serialize function above.
+     */
 
-    /*******************************
-     * Get band
-     *******************************/
-    band = rt_raster_get_band(raster, nband);
-    if (NULL == band) {
-        rterror("rt_raster_dump_as_wktpolygons: Error getting band %d from raster", nband);
+    /* Allocate memory for deserialized raster header */
+
+    RASTER_DEBUG(3, "rt_raster_deserialize: Allocating memory for deserialized raster header");
+    rast = (rt_raster) rtalloc(sizeof (struct rt_raster_t));
+    if (!rast) {
+        rterror("rt_raster_deserialize: Out of memory allocating raster for deserialization");
         return 0;
     }
 
-    iBandHasNodataValue = rt_band_get_hasnodata_flag(band);
-    if (iBandHasNodataValue) dBandNoData = rt_band_get_nodata(band);
+    /* Deserialize raster header */
+    RASTER_DEBUG(3, "rt_raster_deserialize: Deserialize raster header");
+    memcpy(rast, serialized, sizeof (struct rt_raster_serialized_t));
+    rast->cachedstats = NULL;
 
-    /*****************************************************
-     * Convert raster to GDAL MEM dataset
-     *****************************************************/
-    memdataset = rt_raster_to_gdal_mem(raster, NULL, bandNums, 1, &gdal_drv);
-		if (NULL == memdataset) {
-				rterror("rt_raster_dump_as_wktpolygons: Couldn't convert raster to GDAL MEM dataset");
+    if (rast->version > 1) {
+        rterror("rt_raster_deserialize: Serialized raster version %d unsupported", rast->version);
+        rtdealloc(rast);
+        return 0;
+    }
 
-				return 0;
-		}
+    if (0 == rast->numBands || header_only) {
+        rast->bands = 0;
+        return rast;
+    }
+    beg = (const uint8_t*) serialized;
 
-    /*****************************
-     * Register ogr mem driver
-     *****************************/
-    OGRRegisterAll();
+    RASTER_DEBUG(3, "rt_raster_deserialize: Allocating memory for bands");
+    /* Allocate registry of raster bands */
+    rast->bands = rtalloc(rast->numBands * sizeof (rt_band));
 
-    RASTER_DEBUG(3, "creating OGR MEM vector");
+    RASTER_DEBUGF(3, "rt_raster_deserialize: %d bands", rast->numBands);
+
+    /* Move to the beginning of first band, after the band statistics if any */
+    ptr = beg;
+    ptr += sizeof (struct rt_raster_serialized_t);
+    if (rast->version > 0) {
+        stats = (const struct rt_cachedstats_t *) ptr;
+        ptr += sizeof (struct rt_cachedstats_t) * rast->numBands;
+    }
 
+    /* Deserialize bands now */
+    for (i = 0; i < rast->numBands; ++i) {
+        rt_band band = NULL;
+        uint8_t type = 0;
+        int pixbytes = 0;
 
-    /*****************************************************
-     * Create an OGR in-memory vector for layers
-     *****************************************************/
-    ogr_drv = OGRGetDriverByName("Memory");
-    memdatasource = OGR_Dr_CreateDataSource(ogr_drv, "", NULL);
+        band = rtalloc(sizeof (struct rt_band_t));
+        if (!band) {
+            rterror("rt_raster_deserialize: Out of memory allocating rt_band during deserialization");
+            return 0;
+        }
 
-    if (NULL == memdatasource) {
-        rterror("rt_raster_dump_as_wktpolygons: Couldn't create a OGR Datasource to store pols");
-        GDALClose(memdataset);
-        return 0;
-    }
+        rast->bands[i] = band;
 
-    /**
-     * Can MEM driver create new layers?
-     **/
-    if (!OGR_DS_TestCapability(memdatasource, ODsCCreateLayer)) {
-        rterror("rt_raster_dump_as_wktpolygons: MEM driver can't create new layers, aborting");
-        /* xxx jorgearevalo: what should we do now? */
-        GDALClose(memdataset);
-        OGRReleaseDataSource(memdatasource);
-        return 0;
-    }
+        type = *ptr;
+        ptr++;
+        band->pixtype = type & BANDTYPE_PIXTYPE_MASK;
+
+        RASTER_DEBUGF(3, "rt_raster_deserialize: band %d with pixel type %s", i, rt_pixtype_name(band->pixtype));
+
+        band->offline = BANDTYPE_IS_OFFDB(type) ? 1 : 0;
+        band->hasnodata = BANDTYPE_HAS_NODATA(type) ? 1 : 0;
+        band->isnodata = BANDTYPE_IS_NODATA(type) ? 1 : 0;
+        band->width = rast->width;
+        band->height = rast->height;
+        band->ownsData = 0;
+				band->raster = rast;
+
+        band->hascachedstats = FALSE;
+        if (NULL != stats) {
+            memcpy(&(band->cachedstats), &(stats[i]), sizeof (struct rt_cachedstats_t));
+            band->hascachedstats = _rti_cachedstats_is_valid(rast, &(band->cachedstats));
+        }
+
+        /* Advance by data padding */
+        pixbytes = rt_pixtype_size(band->pixtype);
+        ptr += pixbytes - 1;
+
+        /* Read nodata value */
+        switch (band->pixtype) {
+            case PT_1BB:
+            {
+                band->nodataval = ((int) read_uint8(&ptr)) & 0x01;
+                break;
+            }
+            case PT_2BUI:
+            {
+                band->nodataval = ((int) read_uint8(&ptr)) & 0x03;
+                break;
+            }
+            case PT_4BUI:
+            {
+                band->nodataval = ((int) read_uint8(&ptr)) & 0x0F;
+                break;
+            }
+            case PT_8BSI:
+            {
+                band->nodataval = read_int8(&ptr);
+                break;
+            }
+            case PT_8BUI:
+            {
+                band->nodataval = read_uint8(&ptr);
+                break;
+            }
+            case PT_16BSI:
+            {
+                band->nodataval = read_int16(&ptr, littleEndian);
+                break;
+            }
+            case PT_16BUI:
+            {
+                band->nodataval = read_uint16(&ptr, littleEndian);
+                break;
+            }
+            case PT_32BSI:
+            {
+                band->nodataval = read_int32(&ptr, littleEndian);
+                break;
+            }
+            case PT_32BUI:
+            {
+                band->nodataval = read_uint32(&ptr, littleEndian);
+                break;
+            }
+            case PT_32BF:
+            {
+                band->nodataval = read_float32(&ptr, littleEndian);
+                break;
+            }
+            case PT_64BF:
+            {
+                band->nodataval = read_float64(&ptr, littleEndian);
+                break;
+            }
+            default:
+            {
+                rterror("rt_raster_deserialize: Unknown pixeltype %d", band->pixtype);
+                rtdealloc(band);
+                rtdealloc(rast);
+                return 0;
+            }
+        }
+
+        RASTER_DEBUGF(3, "rt_raster_deserialize: has nodata flag %d", band->hasnodata);
+        RASTER_DEBUGF(3, "rt_raster_deserialize: nodata value %g", band->nodataval);
+
+        /* Consistency checking (ptr is pixbytes-aligned) */
+        assert(!((ptr - beg) % pixbytes));
+
+        if (band->offline) {
+            /* Read band number */
+            band->data.offline.bandNum = *ptr;
+            ptr += 1;
 
-    RASTER_DEBUG(3, "polygonizying GDAL MEM raster band");
+            /* Register path */
+            band->data.offline.path = (char*) ptr;
+            ptr += strlen(band->data.offline.path) + 1;
 
-    /*****************************
-     * Polygonize the raster band
-     *****************************/
+						band->data.offline.mem = NULL;
+        } else {
+            /* Register data */
+            const uint32_t datasize = rast->width * rast->height * pixbytes;
+            band->data.mem = (uint8_t*) ptr;
+            ptr += datasize;
+        }
 
-    /**
-     * From GDALPolygonize function header: "Polygon features will be
-     * created on the output layer, with polygon geometries representing
-     * the polygons". So,the WKB geometry type should be "wkbPolygon"
-     **/
-    hLayer = OGR_DS_CreateLayer(memdatasource, "PolygonizedLayer", NULL,
-            wkbPolygon, NULL);
+        /* Skip bytes of padding up to 8-bytes boundary */
+#if POSTGIS_DEBUG_LEVEL > 0
+        const uint8_t *padbeg = ptr;
+#endif
+        while (0 != ((ptr - beg) % 8)){
+            ++ptr;
+        }
 
-    if (NULL == hLayer) {
-        rterror("rt_raster_dump_as_wktpolygons: Couldn't create layer to store polygons");
-        GDALClose(memdataset);
-        OGRReleaseDataSource(memdatasource);
-        return 0;
+        RASTER_DEBUGF(3, "rt_raster_deserialize: skip %d bytes of 8-bytes boundary padding", ptr - padbeg);
+
+        /* Consistency checking (ptr is pixbytes-aligned) */
+        assert(!((ptr - beg) % pixbytes));
     }
 
-    /**
-     * Create a new field in the layer, to store the px value
-     */
+    return rast;
+}
 
-    /* First, create a field definition to create the field */
-    hFldDfn = OGR_Fld_Create("PixelValue", OFTReal);
+uint32_t
+rt_raster_serialized_header_size(rt_raster raster) {
+    uint32_t size = sizeof (struct rt_raster_serialized_t);
 
-    /* Second, create the field */
-    if (OGR_L_CreateField(hLayer, hFldDfn, TRUE) !=
-            OGRERR_NONE) {
-        rtwarn("Couldn't create a field in OGR Layer. The polygons generated won't be able to store the pixel value");
-        iPixVal = -1;
-    }
-    else {
-        /* Index to the new field created in the layer */
-        iPixVal = 0;
-    }
+    assert(NULL != raster);
 
+    if (raster->version > 0)
+        size += sizeof (struct rt_cachedstats_t) * raster->numBands;
 
-    /* Get GDAL raster band */
-    gdal_band = GDALGetRasterBand(memdataset, 1);
-    if (NULL == gdal_band) {
-        rterror("rt_raster_dump_as_wktpolygons: Couldn't get GDAL band to polygonize");
-        GDALClose(memdataset);
+    return size;
+}
 
-        OGR_Fld_Destroy(hFldDfn);
-        OGR_DS_DeleteLayer(memdatasource, 0);
-        OGRReleaseDataSource(memdatasource);
+int
+rt_raster_deserialize_cached_stats(rt_raster raster, const void *serialized) {
+    const uint8_t *ptr = NULL;
 
-        return 0;
-    }
+    assert(NULL != raster);
+    assert(NULL != serialized);
 
-    /**
-     * We don't need a raster mask band. Each band has a nodata value.
-     **/
-#ifdef GDALFPOLYGONIZE
-    GDALFPolygonize(gdal_band, NULL, hLayer, iPixVal, NULL, NULL, NULL);
-#else
-    GDALPolygonize(gdal_band, NULL, hLayer, iPixVal, NULL, NULL, NULL);
-#endif
+    if (raster->version < 1 || raster->numBands < 1)
+        return FALSE;
 
-    /**
-     * Optimization: Apply a OGR SQL filter to the layer to select the
-     * features different from NODATA value.
-     *
-     * Thanks to David Zwarg.
-     **/
-    if (iBandHasNodataValue) {
-        pszQuery = (char *) rtalloc(50 * sizeof (char));
-        sprintf(pszQuery, "PixelValue != %f", dBandNoData );
-        OGRErr e = OGR_L_SetAttributeFilter(hLayer, pszQuery);
-        if (e != OGRERR_NONE) {
-                rtwarn("Error filtering NODATA values for band. All values"
-                        " will be treated as data values");
+    if (NULL == raster->cachedstats) {
+        raster->cachedstats = rtalloc(sizeof (struct rt_cachedstats_t) * raster->numBands);
+        if (NULL == raster->cachedstats) {
+            rterror("rt_raster_deserialize_cached_stats: Out of memory allocating band statistics");
+            return FALSE;
         }
     }
 
-    else {
-        pszQuery = NULL;
-    }
+    ptr = (const uint8_t *) serialized;
+    ptr += sizeof (struct rt_raster_serialized_t);
+    memcpy(raster->cachedstats, ptr, sizeof (struct rt_cachedstats_t) * raster->numBands);
 
+    return TRUE;
+}
 
+/**
+ * Return TRUE if the raster is empty. i.e. is NULL, width = 0 or height = 0
+ *
+ * @param raster: the raster to get info from
+ *
+ * @return TRUE if the raster is empty, FALSE otherwise
+ */
+int
+rt_raster_is_empty(rt_raster raster) {
+	return (NULL == raster || raster->height <= 0 || raster->width <= 0);
+}
 
-    /*********************************************************************
-     * Transform OGR layers in WKT polygons
-     * XXX jorgearevalo: GDALPolygonize does not set the coordinate system
-     * on the output layer. Application code should do this when the layer
-     * is created, presumably matching the raster coordinate system.
-     * TODO: modify GDALPolygonize to directly emit polygons in WKT format?
-     *********************************************************************/
-    nFeatureCount = OGR_L_GetFeatureCount(hLayer, TRUE);
+/**
+ * Return TRUE if the raster do not have a band of this number.
+ *
+ * @param raster: the raster to get info from
+ * @param nband: the band number. 0-based
+ *
+ * @return TRUE if the raster do not have a band of this number, FALSE otherwise
+ */
+int
+rt_raster_has_no_band(rt_raster raster, int nband) {
+	return (NULL == raster || nband >= raster->numBands || nband < 0);
+}
 
-    /* Allocate memory for pols */
-    pols = (rt_geomval) rtalloc(nFeatureCount * sizeof (struct rt_geomval_t));
+/**
+ * Copy one band from one raster to another.  Bands are duplicated from
+ * fromrast to torast using rt_band_duplicate.  The caller will need
+ * to ensure that the copied band's data or path remains allocated
+ * for the lifetime of the copied bands.
+ *
+ * @param torast: raster to copy band to
+ * @param fromrast: raster to copy band from
+ * @param fromindex: index of band in source raster, 0-based
+ * @param toindex: index of new band in destination raster, 0-based
+ *
+ * @return The band index of the second raster where the new band is copied.
+ */
+int32_t
+rt_raster_copy_band(
+	rt_raster torast, rt_raster fromrast,
+	int fromindex, int toindex
+) {
+	rt_band srcband = NULL;
+	rt_band dstband = NULL;
 
-    if (NULL == pols) {
-        rterror("rt_raster_dump_as_wktpolygons: Couldn't allocate memory for "
-                "geomval structure");
-        GDALClose(memdataset);
+	assert(NULL != torast);
+	assert(NULL != fromrast);
 
-        OGR_Fld_Destroy(hFldDfn);
-        OGR_DS_DeleteLayer(memdatasource, 0);
-				if (NULL != pszQuery) rtdealloc(pszQuery);
-        OGRReleaseDataSource(memdatasource);
+	/* Check raster dimensions */
+	if (torast->height != fromrast->height || torast->width != fromrast->width) {
+		rtwarn("rt_raster_copy_band: Attempting to add a band with different width or height");
+		return -1;
+	}
 
-        return 0;
-    }
+	/* Check bands limits */
+	if (fromrast->numBands < 1) {
+		rtwarn("rt_raster_copy_band: Second raster has no band");
+		return -1;
+	}
+	else if (fromindex < 0) {
+		rtwarn("rt_raster_copy_band: Band index for second raster < 0. Defaulted to 0");
+		fromindex = 0;
+	}
+	else if (fromindex >= fromrast->numBands) {
+		rtwarn("rt_raster_copy_band: Band index for second raster > number of bands, truncated from %u to %u", fromindex, fromrast->numBands - 1);
+		fromindex = fromrast->numBands - 1;
+	}
 
-    RASTER_DEBUGF(3, "storing polygons (%d)", nFeatureCount);
+	if (toindex < 0) {
+		rtwarn("rt_raster_copy_band: Band index for first raster < 0. Defaulted to 0");
+		toindex = 0;
+	}
+	else if (toindex > torast->numBands) {
+		rtwarn("rt_raster_copy_band: Band index for first raster > number of bands, truncated from %u to %u", toindex, torast->numBands);
+		toindex = torast->numBands;
+	}
 
-    if (pnElements)
-        *pnElements = 0;
+	/* Get band from source raster */
+	srcband = rt_raster_get_band(fromrast, fromindex);
 
-    /* Reset feature reading to start in the first feature */
-    OGR_L_ResetReading(hLayer);
+	/* duplicate band */
+	dstband = rt_band_duplicate(srcband);
 
-    for (j = 0; j < nFeatureCount; j++) {
+	/* Add band to the second raster */
+	return rt_raster_add_band(torast, dstband, toindex);
+}
 
-        hFeature = OGR_L_GetNextFeature(hLayer);
-        dValue = OGR_F_GetFieldAsDouble(hFeature, iPixVal);
+/**
+ * Construct a new rt_raster from an existing rt_raster and an array
+ * of band numbers
+ *
+ * @param raster : the source raster
+ * @param bandNums : array of band numbers to extract from source raster
+ *                   and add to the new raster (0 based)
+ * @param count : number of elements in bandNums
+ *
+ * @return a new rt_raster or 0 on error
+ */
+rt_raster
+rt_raster_from_band(rt_raster raster, uint32_t *bandNums, int count) {
+	rt_raster rast = NULL;
+	int i = 0;
+	int idx;
+	int32_t flag;
+	double gt[6] = {0.};
 
-        hGeom = OGR_F_GetGeometryRef(hFeature);
-     	OGR_G_ExportToWkt(hGeom, &pszSrcText);
+	assert(NULL != raster);
+	assert(NULL != bandNums);
 
-      	pols[j].val = dValue;
-       	pols[j].srid = rt_raster_get_srid(raster);
-     	pols[j].geom = (char *) rtalloc((1 + strlen(pszSrcText))
-                    * sizeof (char));
-     	strcpy(pols[j].geom, pszSrcText);
+	RASTER_DEBUGF(3, "rt_raster_from_band: source raster has %d bands",
+		rt_raster_get_num_bands(raster));
+
+	/* create new raster */
+	rast = rt_raster_new(raster->width, raster->height);
+	if (NULL == rast) {
+		rterror("rt_raster_from_band: Out of memory allocating new raster");
+		return 0;
+	}
+
+	/* copy raster attributes */
+	rt_raster_get_geotransform_matrix(raster, gt);
+	rt_raster_set_geotransform_matrix(rast, gt);
+
+	/* srid */
+	rt_raster_set_srid(rast, raster->srid);
+
+	/* copy bands */
+	for (i = 0; i < count; i++) {
+		idx = bandNums[i];
+		flag = rt_raster_copy_band(rast, raster, idx, i);
+
+		if (flag < 0) {
+			rterror("rt_raster_from_band: Unable to copy band");
+			rt_raster_destroy(rast);
+			return NULL;
+		}
 
-     	RASTER_DEBUGF(4, "Feature %d, Polygon: %s", j, pols[j].geom);
-     	RASTER_DEBUGF(4, "Feature %d, value: %f", j, pols[j].val);
-     	RASTER_DEBUGF(4, "Feature %d, srid: %d", j, pols[j].srid);
+		RASTER_DEBUGF(3, "rt_raster_from_band: band created at index %d",
+			flag);
+	}
 
-		/**
-         * We can't use deallocator from rt_context, because it comes from
-         * postgresql backend, that uses pfree. This function needs a
-         * postgresql memory context to work with, and the memory created
-         * for pszSrcText is created outside this context.
-         **/
-        /*rtdealloc(pszSrcText);*/
-        free(pszSrcText);
-        pszSrcText = NULL;
+	RASTER_DEBUGF(3, "rt_raster_from_band: new raster has %d bands",
+		rt_raster_get_num_bands(rast));
+	return rast;
+}
 
-        OGR_F_Destroy(hFeature);
-    }
+/**
+ * Replace band at provided index with new band
+ *
+ * @param raster: raster of band to be replaced
+ * @param band : new band to add to raster
+ * @param index : index of band to replace (0-based)
+ *
+ * @return 0 on error or replaced band
+ */
+rt_band
+rt_raster_replace_band(rt_raster raster, rt_band band, int index) {
+	rt_band oldband = NULL;
+	assert(NULL != raster);
 
-    if (pnElements)
-        *pnElements = nFeatureCount;
+	if (band->width != raster->width || band->height != raster->height) {
+		rterror("rt_raster_replace_band: Band does not match raster's dimensions: %dx%d band to %dx%d raster",
+			band->width, band->height, raster->width, raster->height);
+		return 0;
+	}
 
-    RASTER_DEBUG(3, "destroying GDAL MEM raster");
+	if (index >= raster->numBands || index < 0) {
+		rterror("rt_raster_replace_band: Band index is not valid");
+		return 0;
+	}
 
-    GDALClose(memdataset);
+	oldband = rt_raster_get_band(raster, index);
+	RASTER_DEBUGF(3, "rt_raster_replace_band: old band at %p", oldband);
+	RASTER_DEBUGF(3, "rt_raster_replace_band: new band at %p", band);
 
-    RASTER_DEBUG(3, "destroying OGR MEM vector");
+	raster->bands[index] = band;
+	RASTER_DEBUGF(3, "rt_raster_replace_band: new band at %p", raster->bands[index]);
 
-    OGR_Fld_Destroy(hFldDfn);
-    OGR_DS_DeleteLayer(memdatasource, 0);
-		if (NULL != pszQuery) rtdealloc(pszQuery);
-    OGRReleaseDataSource(memdatasource);
+	band->raster = raster;
 
-    return pols;
+	return oldband;
 }
 
-LWPOLY*
-rt_raster_get_convex_hull(rt_raster raster) {
-		double gt[6] = {0.0};
-    POINTARRAY **rings = NULL;
-    POINTARRAY *pts = NULL;
-    LWPOLY* ret = NULL;
-    POINT4D p4d;
+/**
+ * Return formatted GDAL raster from raster
+ *
+ * @param raster : the raster to convert
+ * @param srs : the raster's coordinate system in OGC WKT
+ * @param format : format to convert to. GDAL driver short name
+ * @param options : list of format creation options. array of strings
+ * @param gdalsize : will be set to the size of returned bytea
+ *
+ * @return formatted GDAL raster.  the calling function is responsible
+ *   for freeing the returned data using CPLFree()
+ */
+uint8_t*
+rt_raster_to_gdal(rt_raster raster, const char *srs,
+	char *format, char **options, uint64_t *gdalsize) {
+	GDALDriverH src_drv = NULL;
+	GDALDatasetH src_ds = NULL;
 
-    assert(NULL != raster);
+	vsi_l_offset rtn_lenvsi;
+	uint64_t rtn_len = 0;
 
-    RASTER_DEBUGF(3, "rt_raster_get_convex_hull: raster is %dx%d",
-            raster->width, raster->height);
+	GDALDriverH rtn_drv = NULL;
+	GDALDatasetH rtn_ds = NULL;
+	uint8_t *rtn = NULL;
 
-    if ((!raster->width) || (!raster->height)) {
-        return 0;
-    }
+	assert(NULL != raster);
 
-    rings = (POINTARRAY **) rtalloc(sizeof (POINTARRAY*));
-    if (!rings) {
-        rterror("rt_raster_get_convex_hull: Out of memory [%s:%d]", __FILE__, __LINE__);
-        return 0;
-    }
-    rings[0] = ptarray_construct(0, 0, 5);
-    /* TODO: handle error on ptarray construction */
-    /* XXX jorgearevalo: the error conditions aren't managed in ptarray_construct */
-    if (!rings[0]) {
-        rterror("rt_raster_get_convex_hull: Out of memory [%s:%d]", __FILE__, __LINE__);
-        return 0;
-    }
-    pts = rings[0];
+	/* any supported format is possible */
+	GDALAllRegister();
+	RASTER_DEBUG(3, "rt_raster_to_gdal: loaded all supported GDAL formats");
 
-    /* Upper-left corner (first and last points) */
-    rt_raster_cell_to_geopoint(raster,
-            0, 0,
-            &p4d.x, &p4d.y,
-						gt);
-    ptarray_set_point4d(pts, 0, &p4d);
-    ptarray_set_point4d(pts, 4, &p4d); /* needed for closing it? */
+	/* output format not specified */
+	if (format == NULL || !strlen(format))
+		format = "GTiff";
+	RASTER_DEBUGF(3, "rt_raster_to_gdal: output format is %s", format);
 
-    /* Upper-right corner (we go clockwise) */
-    rt_raster_cell_to_geopoint(raster,
-            raster->width, 0,
-            &p4d.x, &p4d.y,
-						gt);
-    ptarray_set_point4d(pts, 1, &p4d);
+	/* load raster into a GDAL MEM raster */
+	src_ds = rt_raster_to_gdal_mem(raster, srs, NULL, 0, &src_drv);
+	if (NULL == src_ds) {
+		rterror("rt_raster_to_gdal: Unable to convert raster to GDAL MEM format");
+		return 0;
+	}
 
-    /* Lower-right corner */
-    rt_raster_cell_to_geopoint(raster,
-            raster->width, raster->height,
-            &p4d.x, &p4d.y,
-						gt);
-    ptarray_set_point4d(pts, 2, &p4d);
+	/* load driver */
+	rtn_drv = GDALGetDriverByName(format);
+	if (NULL == rtn_drv) {
+		rterror("rt_raster_to_gdal: Unable to load the output GDAL driver");
+		GDALClose(src_ds);
+		return 0;
+	}
+	RASTER_DEBUG(3, "rt_raster_to_gdal: Output driver loaded");
 
-    /* Lower-left corner */
-    rt_raster_cell_to_geopoint(raster,
-            0, raster->height,
-            &p4d.x, &p4d.y,
-						gt);
-    ptarray_set_point4d(pts, 3, &p4d);
+	/* convert GDAL MEM raster to output format */
+	RASTER_DEBUG(3, "rt_raster_to_gdal: Copying GDAL MEM raster to memory file in output format");
+	rtn_ds = GDALCreateCopy(
+		rtn_drv,
+		"/vsimem/out.dat", /* should be fine assuming this is in a process */
+		src_ds,
+		FALSE, /* should copy be strictly equivelent? */
+		options, /* format options */
+		NULL, /* progress function */
+		NULL /* progress data */
+	);
+	if (NULL == rtn_ds) {
+		rterror("rt_raster_to_gdal: Unable to create the output GDAL dataset");
+		GDALClose(src_ds);
+		return 0;
+	}
 
-    ret = lwpoly_construct(rt_raster_get_srid(raster), 0, 1, rings);
+	/* close source dataset */
+	GDALClose(src_ds);
+	RASTER_DEBUG(3, "rt_raster_to_gdal: Closed GDAL MEM raster");
 
-    return ret;
-}
+	/* close dataset, this also flushes any pending writes */
+	GDALClose(rtn_ds);
+	RASTER_DEBUG(3, "rt_raster_to_gdal: Closed GDAL output raster");
 
-/*--------- WKB I/O ---------------------------------------------------*/
+	RASTER_DEBUG(3, "rt_raster_to_gdal: Done copying GDAL MEM raster to memory file in output format");
 
-static uint8_t
-isMachineLittleEndian(void) {
-    static int endian_check_int = 1; /* dont modify this!!! */
-    /* 0=big endian|xdr --  1=little endian|ndr */
-    return *((uint8_t *) & endian_check_int);
-}
+	/* from memory file to buffer */
+	RASTER_DEBUG(3, "rt_raster_to_gdal: Copying GDAL memory file to buffer");
+	rtn = VSIGetMemFileBuffer("/vsimem/out.dat", &rtn_lenvsi, TRUE);
+	RASTER_DEBUG(3, "rt_raster_to_gdal: Done copying GDAL memory file to buffer");
+	if (NULL == rtn) {
+		rterror("rt_raster_to_gdal: Unable to create the output GDAL raster");
+		return 0;
+	}
 
-static uint8_t
-read_uint8(const uint8_t** from) {
-    assert(NULL != from);
+	rtn_len = (uint64_t) rtn_lenvsi;
+	*gdalsize = rtn_len;
 
-    return *(*from)++;
+	return rtn;
 }
 
-/* unused up to now
-static void
-write_uint8(uint8_t** from, uint8_t v)
-{
-    assert(NULL != from);
-
- *(*from)++ = v;
-}
+/**
+ * Returns a set of available GDAL drivers
+ *
+ * @param drv_count : number of GDAL drivers available
+ * @param cancc : if non-zero, filter drivers to only those
+ *   with support for CreateCopy and VirtualIO
+ *
+ * @return set of "gdaldriver" values of available GDAL drivers
  */
+rt_gdaldriver
+rt_raster_gdal_drivers(uint32_t *drv_count, uint8_t cancc) {
+	const char *state;
+	const char *txt;
+	int txt_len;
+	GDALDriverH *drv = NULL;
+	rt_gdaldriver rtn = NULL;
+	int count;
+	int i;
+	uint32_t j;
 
-static int8_t
-read_int8(const uint8_t** from) {
-    assert(NULL != from);
+	GDALAllRegister();
+	count = GDALGetDriverCount();
+	rtn = (rt_gdaldriver) rtalloc(count * sizeof(struct rt_gdaldriver_t));
+	if (NULL == rtn) {
+		rterror("rt_raster_gdal_drivers: Unable to allocate memory for gdaldriver structure");
+		return 0;
+	}
 
-    return (int8_t) read_uint8(from);
-}
+	for (i = 0, j = 0; i < count; i++) {
+		drv = GDALGetDriver(i);
+
+		if (cancc) {
+			/* CreateCopy support */
+			state = GDALGetMetadataItem(drv, GDAL_DCAP_CREATECOPY, NULL);
+			if (state == NULL) continue;
+
+			/* VirtualIO support */
+			state = GDALGetMetadataItem(drv, GDAL_DCAP_VIRTUALIO, NULL);
+			if (state == NULL) continue;
+		}
 
-/* unused up to now
-static void
-write_int8(uint8_t** from, int8_t v)
-{
-    assert(NULL != from);
+		/* index of driver */
+		rtn[j].idx = i;
 
- *(*from)++ = v;
-}
- */
+		/* short name */
+		txt = GDALGetDriverShortName(drv);
+		txt_len = strlen(txt);
 
-static uint16_t
-read_uint16(const uint8_t** from, uint8_t littleEndian) {
-    uint16_t ret = 0;
+		if (cancc) {
+			RASTER_DEBUGF(3, "rt_raster_gdal_driver: driver %s (%d) supports CreateCopy() and VirtualIO()", txt, i);
+		}
 
-    assert(NULL != from);
+		txt_len = (txt_len + 1) * sizeof(char);
+		rtn[j].short_name = (char *) rtalloc(txt_len);
+		memcpy(rtn[j].short_name, txt, txt_len);
 
-    if (littleEndian) {
-        ret = (*from)[0] |
-                (*from)[1] << 8;
-    } else {
-        /* big endian */
-        ret = (*from)[0] << 8 |
-                (*from)[1];
-    }
-    *from += 2;
-    return ret;
-}
+		/* long name */
+		txt = GDALGetDriverLongName(drv);
+		txt_len = strlen(txt);
 
-static void
-write_uint16(uint8_t** to, uint8_t littleEndian, uint16_t v) {
-    assert(NULL != to);
+		txt_len = (txt_len + 1) * sizeof(char);
+		rtn[j].long_name = (char *) rtalloc(txt_len);
+		memcpy(rtn[j].long_name, txt, txt_len);
 
-    if (littleEndian) {
-        (*to)[0] = v & 0x00FF;
-        (*to)[1] = v >> 8;
-    } else {
-        (*to)[1] = v & 0x00FF;
-        (*to)[0] = v >> 8;
-    }
-    *to += 2;
-}
+		/* creation options */
+		txt = GDALGetDriverCreationOptionList(drv);
+		txt_len = strlen(txt);
 
-static int16_t
-read_int16(const uint8_t** from, uint8_t littleEndian) {
-    assert(NULL != from);
+		txt_len = (txt_len + 1) * sizeof(char);
+		rtn[j].create_options = (char *) rtalloc(txt_len);
+		memcpy(rtn[j].create_options, txt, txt_len);
 
-    return read_uint16(from, littleEndian);
-}
+		j++;
+	}
 
-/* unused up to now
-static void
-write_int16(uint8_t** to, uint8_t littleEndian, int16_t v)
-{
-    assert(NULL != to);
+	/* free unused memory */
+	rtn = rtrealloc(rtn, j * sizeof(struct rt_gdaldriver_t));
+	*drv_count = j;
 
-    if ( littleEndian )
-    {
-        (*to)[0] = v & 0x00FF;
-        (*to)[1] = v >> 8;
-    }
-    else
-    {
-        (*to)[1] = v & 0x00FF;
-        (*to)[0] = v >> 8;
-    }
- *to += 2;
+	return rtn;
 }
- */
 
-static uint32_t
-read_uint32(const uint8_t** from, uint8_t littleEndian) {
-    uint32_t ret = 0;
+/**
+ * Return GDAL dataset using GDAL MEM driver from raster
+ *
+ * @param raster : raster to convert to GDAL MEM
+ * @param srs : the raster's coordinate system in OGC WKT
+ * @param bandNums : array of band numbers to extract from raster
+ *                   and include in the GDAL dataset (0 based)
+ * @param count : number of elements in bandNums
+ * @param rtn_drv : is set to the GDAL driver object
+ *
+ * @return GDAL dataset using GDAL MEM driver
+ */
+GDALDatasetH
+rt_raster_to_gdal_mem(rt_raster raster, const char *srs,
+	uint32_t *bandNums, int count, GDALDriverH *rtn_drv) {
+	GDALDriverH drv = NULL;
+	GDALDatasetH ds = NULL;
+	double gt[6] = {0.0};
+	CPLErr cplerr;
+	GDALDataType gdal_pt = GDT_Unknown;
+	GDALRasterBandH band;
+	void *pVoid;
+	char *pszDataPointer;
+	char szGDALOption[50];
+	char *apszOptions[4];
+	double nodata = 0.0;
+	int allocBandNums = 0;
 
-    assert(NULL != from);
+	int i;
+	int numBands;
+	rt_band rtband = NULL;
+	rt_pixtype pt = PT_END;
 
-    if (littleEndian) {
-        ret = (uint32_t) ((*from)[0] & 0xff) |
-                (uint32_t) ((*from)[1] & 0xff) << 8 |
-                (uint32_t) ((*from)[2] & 0xff) << 16 |
-                (uint32_t) ((*from)[3] & 0xff) << 24;
-    } else {
-        /* big endian */
-        ret = (uint32_t) ((*from)[3] & 0xff) |
-                (uint32_t) ((*from)[2] & 0xff) << 8 |
-                (uint32_t) ((*from)[1] & 0xff) << 16 |
-                (uint32_t) ((*from)[0] & 0xff) << 24;
-    }
+	assert(NULL != raster);
 
-    *from += 4;
-    return ret;
-}
+	/* store raster in GDAL MEM raster */
+	if (!rt_util_gdal_driver_registered("MEM"))
+		GDALRegister_MEM();
+	drv = GDALGetDriverByName("MEM");
+	if (NULL == drv) {
+		rterror("rt_raster_to_gdal_mem: Unable to load the MEM GDAL driver");
+		return 0;
+	}
+	*rtn_drv = drv;
 
-/* unused up to now
-static void
-write_uint32(uint8_t** to, uint8_t littleEndian, uint32_t v)
-{
-    assert(NULL != to);
+	ds = GDALCreate(drv, "", rt_raster_get_width(raster),
+		rt_raster_get_height(raster), 0, GDT_Byte, NULL);
+	if (NULL == ds) {
+		rterror("rt_raster_to_gdal_mem: Could not create a GDALDataset to convert into");
+		return 0;
+	}
 
-    if ( littleEndian )
-    {
-        (*to)[0] = v & 0x000000FF;
-        (*to)[1] = ( v & 0x0000FF00 ) >> 8;
-        (*to)[2] = ( v & 0x00FF0000 ) >> 16;
-        (*to)[3] = ( v & 0xFF000000 ) >> 24;
-    }
-    else
-    {
-        (*to)[3] = v & 0x000000FF;
-        (*to)[2] = ( v & 0x0000FF00 ) >> 8;
-        (*to)[1] = ( v & 0x00FF0000 ) >> 16;
-        (*to)[0] = ( v & 0xFF000000 ) >> 24;
-    }
- *to += 4;
-}
- */
+	/* add geotransform */
+	rt_raster_get_geotransform_matrix(raster, gt);
+	cplerr = GDALSetGeoTransform(ds, gt);
+	if (cplerr != CE_None) {
+		rterror("rt_raster_to_gdal_mem: Unable to set geotransformation");
+		GDALClose(ds);
+		return 0;
+	}
 
-static int32_t
-read_int32(const uint8_t** from, uint8_t littleEndian) {
-    assert(NULL != from);
+	/* set spatial reference */
+	if (NULL != srs && strlen(srs)) {
+		cplerr = GDALSetProjection(ds, srs);
+		if (cplerr != CE_None) {
+			rterror("rt_raster_to_gdal_mem: Unable to set projection");
+			GDALClose(ds);
+			return 0;
+		}
+		RASTER_DEBUGF(3, "Projection set to: %s", srs);
+	}
 
-    return read_uint32(from, littleEndian);
-}
+	/* process bandNums */
+	numBands = rt_raster_get_num_bands(raster);
+	if (NULL != bandNums && count > 0) {
+		for (i = 0; i < count; i++) {
+			if (bandNums[i] < 0 || bandNums[i] >= numBands) {
+				rterror("rt_raster_to_gdal_mem: The band index %d is invalid", bandNums[i]);
+				GDALClose(ds);
+				return 0;
+			}
+		}
+	}
+	else {
+		count = numBands;
+		bandNums = (uint32_t *) rtalloc(sizeof(uint32_t) * count);
+		if (NULL == bandNums) {
+			rterror("rt_raster_to_gdal_mem: Unable to allocate memory for band indices");
+			GDALClose(ds);
+			return 0;
+		}
+		allocBandNums = 1;
+		for (i = 0; i < count; i++) bandNums[i] = i;
+	}
 
-/* unused up to now
-static void
-write_int32(uint8_t** to, uint8_t littleEndian, int32_t v)
-{
-    assert(NULL != to);
+	/* add band(s) */
+	for (i = 0; i < count; i++) {
+		rtband = rt_raster_get_band(raster, bandNums[i]);
+		if (NULL == rtband) {
+			rterror("rt_raster_to_gdal_mem: Unable to get requested band index %d", bandNums[i]);
+			if (allocBandNums) rtdealloc(bandNums);
+			GDALClose(ds);
+			return 0;
+		}
 
-    if ( littleEndian )
-    {
-        (*to)[0] = v & 0x000000FF;
-        (*to)[1] = ( v & 0x0000FF00 ) >> 8;
-        (*to)[2] = ( v & 0x00FF0000 ) >> 16;
-        (*to)[3] = ( v & 0xFF000000 ) >> 24;
-    }
-    else
-    {
-        (*to)[3] = v & 0x000000FF;
-        (*to)[2] = ( v & 0x0000FF00 ) >> 8;
-        (*to)[1] = ( v & 0x00FF0000 ) >> 16;
-        (*to)[0] = ( v & 0xFF000000 ) >> 24;
-    }
- *to += 4;
-}
- */
+		pt = rt_band_get_pixtype(rtband);
+		gdal_pt = rt_util_pixtype_to_gdal_datatype(pt);
+		if (gdal_pt == GDT_Unknown)
+			rtwarn("rt_raster_to_gdal_mem: Unknown pixel type for band");
 
-static float
-read_float32(const uint8_t** from, uint8_t littleEndian) {
+		pVoid = rt_band_get_data(rtband);
+		RASTER_DEBUGF(4, "Band data is at pos %p", pVoid);
 
-    union {
-        float f;
-        uint32_t i;
-    } ret;
+		pszDataPointer = (char *) rtalloc(20 * sizeof (char));
+		sprintf(pszDataPointer, "%p", pVoid);
+		RASTER_DEBUGF(4, "rt_raster_to_gdal_mem: szDatapointer is %p",
+			pszDataPointer);
 
-    ret.i = read_uint32(from, littleEndian);
+		if (strnicmp(pszDataPointer, "0x", 2) == 0)
+			sprintf(szGDALOption, "DATAPOINTER=%s", pszDataPointer);
+		else
+			sprintf(szGDALOption, "DATAPOINTER=0x%s", pszDataPointer);
 
-    return ret.f;
-}
+		RASTER_DEBUG(3, "Storing info for GDAL MEM raster band");
 
-/* unused up to now
-static void
-write_float32(uint8_t** from, uint8_t littleEndian, float f)
-{
-    union {
-        float f;
-        uint32_t i;
-    } u;
+		apszOptions[0] = szGDALOption;
+		apszOptions[1] = NULL; /* pixel offset, not needed */
+		apszOptions[2] = NULL; /* line offset, not needed */
+		apszOptions[3] = NULL;
 
-    u.f = f;
-    write_uint32(from, littleEndian, u.i);
-}
- */
+		/* free */
+		rtdealloc(pszDataPointer);
 
-static double
-read_float64(const uint8_t** from, uint8_t littleEndian) {
+		if (GDALAddBand(ds, gdal_pt, apszOptions) == CE_Failure) {
+			rterror("rt_raster_to_gdal_mem: Could not add GDAL raster band");
+			if (allocBandNums) rtdealloc(bandNums);
+			GDALClose(ds);
+			return 0;
+		}
 
-    union {
-        double d;
-        uint64_t i;
-    } ret;
+		/* check band count */
+		if (GDALGetRasterCount(ds) != i + 1) {
+			rterror("rt_raster_to_gdal_mem: Error creating GDAL MEM raster band");
+			if (allocBandNums) rtdealloc(bandNums);
+			GDALClose(ds);
+			return 0;
+		}
 
-    assert(NULL != from);
+		/* get band to write data to */
+		band = NULL;
+		band = GDALGetRasterBand(ds, i + 1);
+		if (NULL == band) {
+			rterror("rt_raster_to_gdal_mem: Could not get GDAL band for additional processing");
+			if (allocBandNums) rtdealloc(bandNums);
+			GDALClose(ds);
+			return 0;
+		}
 
-    if (littleEndian) {
-        ret.i = (uint64_t) ((*from)[0] & 0xff) |
-                (uint64_t) ((*from)[1] & 0xff) << 8 |
-                (uint64_t) ((*from)[2] & 0xff) << 16 |
-                (uint64_t) ((*from)[3] & 0xff) << 24 |
-                (uint64_t) ((*from)[4] & 0xff) << 32 |
-                (uint64_t) ((*from)[5] & 0xff) << 40 |
-                (uint64_t) ((*from)[6] & 0xff) << 48 |
-                (uint64_t) ((*from)[7] & 0xff) << 56;
-    } else {
-        /* big endian */
-        ret.i = (uint64_t) ((*from)[7] & 0xff) |
-                (uint64_t) ((*from)[6] & 0xff) << 8 |
-                (uint64_t) ((*from)[5] & 0xff) << 16 |
-                (uint64_t) ((*from)[4] & 0xff) << 24 |
-                (uint64_t) ((*from)[3] & 0xff) << 32 |
-                (uint64_t) ((*from)[2] & 0xff) << 40 |
-                (uint64_t) ((*from)[1] & 0xff) << 48 |
-                (uint64_t) ((*from)[0] & 0xff) << 56;
-    }
+		/* Add nodata value for band */
+		if (rt_band_get_hasnodata_flag(rtband) != FALSE) {
+			nodata = rt_band_get_nodata(rtband);
+			if (GDALSetRasterNoDataValue(band, nodata) != CE_None)
+				rtwarn("rt_raster_to_gdal_mem: Could not set nodata value for band");
+			RASTER_DEBUGF(3, "nodata value set to %f", GDALGetRasterNoDataValue(band, NULL));
+		}
+	}
 
-    *from += 8;
-    return ret.d;
+	/* necessary??? */
+	GDALFlushCache(ds);
+
+	if (allocBandNums) rtdealloc(bandNums);
+
+	return ds;
 }
 
-/* unused up to now
-static void
-write_float64(uint8_t** to, uint8_t littleEndian, double v)
-{
-    union {
-        double d;
-        uint64_t i;
-    } u;
+/**
+ * Return a raster from a GDAL dataset
+ *
+ * @param ds : the GDAL dataset to convert to a raster
+ *
+ * @return raster
+ */
+rt_raster
+rt_raster_from_gdal_dataset(GDALDatasetH ds) {
+	rt_raster rast = NULL;
+	double gt[6] = {0};
+	CPLErr cplerr;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t numBands = 0;
+	int i = 0;
+	int status;
 
-    assert(NULL != to);
+	const char *srs = NULL;
 
-    u.d = v;
+	GDALRasterBandH gdband = NULL;
+	GDALDataType gdpixtype = GDT_Unknown;
+	rt_band band;
+	int32_t idx;
+	rt_pixtype pt = PT_END;
+	uint32_t ptlen = 0;
+	uint32_t hasnodata = 0;
+	double nodataval;
 
-    if ( littleEndian )
-    {
-        (*to)[0] =   u.i & 0x00000000000000FFULL;
-        (*to)[1] = ( u.i & 0x000000000000FF00ULL ) >> 8;
-        (*to)[2] = ( u.i & 0x0000000000FF0000ULL ) >> 16;
-        (*to)[3] = ( u.i & 0x00000000FF000000ULL ) >> 24;
-        (*to)[4] = ( u.i & 0x000000FF00000000ULL ) >> 32;
-        (*to)[5] = ( u.i & 0x0000FF0000000000ULL ) >> 40;
-        (*to)[6] = ( u.i & 0x00FF000000000000ULL ) >> 48;
-        (*to)[7] = ( u.i & 0xFF00000000000000ULL ) >> 56;
-    }
-    else
-    {
-        (*to)[7] =   u.i & 0x00000000000000FFULL;
-        (*to)[6] = ( u.i & 0x000000000000FF00ULL ) >> 8;
-        (*to)[5] = ( u.i & 0x0000000000FF0000ULL ) >> 16;
-        (*to)[4] = ( u.i & 0x00000000FF000000ULL ) >> 24;
-        (*to)[3] = ( u.i & 0x000000FF00000000ULL ) >> 32;
-        (*to)[2] = ( u.i & 0x0000FF0000000000ULL ) >> 40;
-        (*to)[1] = ( u.i & 0x00FF000000000000ULL ) >> 48;
-        (*to)[0] = ( u.i & 0xFF00000000000000ULL ) >> 56;
-    }
- *to += 8;
-}
- */
+	int x;
+	int y;
 
-#define BANDTYPE_FLAGS_MASK 0xF0
-#define BANDTYPE_PIXTYPE_MASK 0x0F
-#define BANDTYPE_FLAG_OFFDB     (1<<7)
-#define BANDTYPE_FLAG_HASNODATA (1<<6)
-#define BANDTYPE_FLAG_ISNODATA  (1<<5)
-#define BANDTYPE_FLAG_RESERVED3 (1<<4)
+	int nXBlocks, nYBlocks;
+	int nXBlockSize, nYBlockSize;
+	int iXBlock, iYBlock;
+	int nXValid, nYValid;
+	int iY;
 
-#define BANDTYPE_PIXTYPE(x) ((x)&BANDTYPE_PIXTYPE_MASK)
-#define BANDTYPE_IS_OFFDB(x) ((x)&BANDTYPE_FLAG_OFFDB)
-#define BANDTYPE_HAS_NODATA(x) ((x)&BANDTYPE_FLAG_HASNODATA)
-#define BANDTYPE_IS_NODATA(x) ((x)&BANDTYPE_FLAG_ISNODATA)
+	void *values = NULL;
+	uint32_t valueslen = 0;
+	void *ptr = NULL;
 
-/* Read band from WKB as at start of band */
-static rt_band
-rt_band_from_wkb(uint16_t width, uint16_t height,
-        const uint8_t** ptr, const uint8_t* end,
-        uint8_t littleEndian) {
-    rt_band band = NULL;
-    int pixbytes = 0;
-    uint8_t type = 0;
-    unsigned long sz = 0;
-    uint32_t v = 0;
+	assert(NULL != ds);
 
+	/* raster size */
+	width = GDALGetRasterXSize(ds);
+	height = GDALGetRasterYSize(ds);
+	RASTER_DEBUGF(3, "Raster dimensions (width x height): %d x %d", width, height);
 
+	/* create new raster */
+	RASTER_DEBUG(3, "Creating new raster");
+	rast = rt_raster_new(width, height);
+	if (NULL == rast) {
+		rterror("rt_raster_from_gdal_dataset: Out of memory allocating new raster");
+		return NULL;
+	}
 
-    assert(NULL != ptr);
-    assert(NULL != end);
+	/* get raster attributes */
+	cplerr = GDALGetGeoTransform(ds, gt);
+	if (cplerr != CE_None) {
+		rterror("rt_raster_from_gdal_dataset: Unable to get geotransformation");
+		rt_raster_destroy(rast);
+		return NULL;
+	}
+	RASTER_DEBUGF(3, "Raster geotransform (%f, %f, %f, %f, %f, %f)",
+		gt[0], gt[1], gt[2], gt[3], gt[4], gt[5]);
 
-    band = rtalloc(sizeof (struct rt_band_t));
-    if (!band) {
-        rterror("rt_band_from_wkb: Out of memory allocating rt_band during WKB parsing");
-        return 0;
-    }
+	/* apply raster attributes */
+	rt_raster_set_geotransform_matrix(rast, gt);
 
-    if (end - *ptr < 1) {
-        rterror("rt_band_from_wkb: Premature end of WKB on band reading (%s:%d)",
-                __FILE__, __LINE__);
-        return 0;
-    }
-    type = read_uint8(ptr);
+	/* srid */
+	srs = GDALGetProjectionRef(ds);
+	if (srs != NULL && srs[0] != '\0') {
+		OGRSpatialReferenceH hSRS = OSRNewSpatialReference(NULL);
+		if (OSRSetFromUserInput(hSRS, srs) == OGRERR_NONE) {
+			const char* pszAuthorityName = OSRGetAuthorityName(hSRS, NULL);
+			const char* pszAuthorityCode = OSRGetAuthorityCode(hSRS, NULL);
+			if (
+				pszAuthorityName != NULL &&
+				strcmp(pszAuthorityName, "EPSG") == 0 &&
+				pszAuthorityCode != NULL
+			) {
+				rt_raster_set_srid(rast, atoi(pszAuthorityCode));
+			}
+		}
+		OSRDestroySpatialReference(hSRS);
+	}
 
-    if ((type & BANDTYPE_PIXTYPE_MASK) >= PT_END) {
-        rterror("rt_band_from_wkb: Invalid pixtype %d", type & BANDTYPE_PIXTYPE_MASK);
-        rtdealloc(band);
-        return 0;
-    }
-    assert(NULL != band);
+	/* copy bands */
+	numBands = GDALGetRasterCount(ds);
+	for (i = 1; i <= numBands; i++) {
+		RASTER_DEBUGF(3, "Processing band %d of %d", i, numBands);
+		gdband = NULL;
+		gdband = GDALGetRasterBand(ds, i);
+		if (NULL == gdband) {
+			rterror("rt_raster_from_gdal_dataset: Unable to get GDAL band");
+			rt_raster_destroy(rast);
+			return NULL;
+		}
 
-    band->pixtype = type & BANDTYPE_PIXTYPE_MASK;
-    band->offline = BANDTYPE_IS_OFFDB(type) ? 1 : 0;
-    band->hasnodata = BANDTYPE_HAS_NODATA(type) ? 1 : 0;
-    band->isnodata = BANDTYPE_IS_NODATA(type) ? 1 : 0;
-    band->width = width;
-    band->height = height;
+		/* pixtype */
+		gdpixtype = GDALGetRasterDataType(gdband);
+		pt = rt_util_gdal_datatype_to_pixtype(gdpixtype);
+		if (pt == PT_END) {
+			rterror("rt_raster_from_gdal_dataset: Unknown pixel type for GDAL band");
+			rt_raster_destroy(rast);
+			return NULL;
+		}
+		ptlen = rt_pixtype_size(pt);
 
-    RASTER_DEBUGF(3, " Band pixtype:%s, offline:%d, hasnodata:%d",
-            rt_pixtype_name(band->pixtype),
-            band->offline,
-            band->hasnodata);
+		/* size: width and height */
+		width = GDALGetRasterBandXSize(gdband);
+		height = GDALGetRasterBandYSize(gdband);
+		RASTER_DEBUGF(3, "Band dimensions (width x height): %d x %d", width, height);
 
-    /* Check there's enough bytes to read nodata value */
+		/* nodata */
+		nodataval = GDALGetRasterNoDataValue(gdband, &status);
+		if (!status) {
+			nodataval = 0;
+			hasnodata = 0;
+		}
+		else
+			hasnodata = 1;
+		RASTER_DEBUGF(3, "(hasnodata, nodataval) = (%d, %f)", hasnodata, nodataval);
 
-    pixbytes = rt_pixtype_size(band->pixtype);
-    if (((*ptr) + pixbytes) >= end) {
-        rterror("rt_band_from_wkb: Premature end of WKB on band novalue reading");
-        rtdealloc(band);
-        return 0;
-    }
+		/* create band object */
+		idx = rt_raster_generate_new_band(
+			rast, pt,
+			(hasnodata ? nodataval : 0),
+			hasnodata, nodataval, rt_raster_get_num_bands(rast)
+		);
+		if (idx < 0) {
+			rterror("rt_raster_from_gdal_dataset: Could not allocate memory for raster band");
+			rt_raster_destroy(rast);
+			return NULL;
+		}
+		band = rt_raster_get_band(rast, idx);
 
-    /* Read nodata value */
-    switch (band->pixtype) {
-        case PT_1BB:
-        {
-            band->nodataval = ((int) read_uint8(ptr)) & 0x01;
-            break;
-        }
-        case PT_2BUI:
-        {
-            band->nodataval = ((int) read_uint8(ptr)) & 0x03;
-            break;
-        }
-        case PT_4BUI:
-        {
-            band->nodataval = ((int) read_uint8(ptr)) & 0x0F;
-            break;
-        }
-        case PT_8BSI:
-        {
-            band->nodataval = read_int8(ptr);
-            break;
-        }
-        case PT_8BUI:
-        {
-            band->nodataval = read_uint8(ptr);
-            break;
-        }
-        case PT_16BSI:
-        {
-            band->nodataval = read_int16(ptr, littleEndian);
-            break;
-        }
-        case PT_16BUI:
-        {
-            band->nodataval = read_uint16(ptr, littleEndian);
-            break;
-        }
-        case PT_32BSI:
-        {
-            band->nodataval = read_int32(ptr, littleEndian);
-            break;
-        }
-        case PT_32BUI:
-        {
-            band->nodataval = read_uint32(ptr, littleEndian);
-            break;
-        }
-        case PT_32BF:
-        {
-            band->nodataval = read_float32(ptr, littleEndian);
-            break;
-        }
-        case PT_64BF:
-        {
-            band->nodataval = read_float64(ptr, littleEndian);
-            break;
-        }
-        default:
-        {
-            rterror("rt_band_from_wkb: Unknown pixeltype %d", band->pixtype);
-            rtdealloc(band);
-            return 0;
-        }
-    }
+		/* this makes use of GDAL's "natural" blocks */
+		GDALGetBlockSize(gdband, &nXBlockSize, &nYBlockSize);
+		nXBlocks = (width + nXBlockSize - 1) / nXBlockSize;
+		nYBlocks = (height + nYBlockSize - 1) / nYBlockSize;
+		RASTER_DEBUGF(4, "(nXBlockSize, nYBlockSize) = (%d, %d)", nXBlockSize, nYBlockSize);
+		RASTER_DEBUGF(4, "(nXBlocks, nYBlocks) = (%d, %d)", nXBlocks, nYBlocks);
 
-    RASTER_DEBUGF(3, " Nodata value: %g, pixbytes: %d, ptr @ %p, end @ %p",
-            band->nodataval, pixbytes, *ptr, end);
+		/* allocate memory for values */
+		valueslen = ptlen * nXBlockSize * nYBlockSize;
+		switch (gdpixtype) {
+			case GDT_Byte:
+				values = (uint8_t *) rtalloc(valueslen);
+				break;
+			case GDT_UInt16:
+				values = (uint16_t *) rtalloc(valueslen);
+				break;
+			case GDT_Int16:
+				values = (int16_t *) rtalloc(valueslen);
+				break;
+			case GDT_UInt32:
+				values = (uint32_t *) rtalloc(valueslen);
+				break;
+			case GDT_Int32:
+				values = (int32_t *) rtalloc(valueslen);
+				break;
+			case GDT_Float32:
+				values = (float *) rtalloc(valueslen);
+				break;
+			case GDT_Float64:
+				values = (double *) rtalloc(valueslen);
+				break;
+			default:
+				/* should NEVER get here */
+				rterror("rt_raster_from_gdal_dataset: Could not allocate memory for unknown pixel type");
+				rt_raster_destroy(rast);
+				return NULL;
+		}
+		if (values == NULL) {
+			rterror("rt_raster_from_gdal_dataset: Could not allocate memory for GDAL band pixel values");
+			rt_raster_destroy(rast);
+			return NULL;
+		}
 
-    if (band->offline) {
-        if (((*ptr) + 1) >= end) {
-            rterror("rt_band_from_wkb: Premature end of WKB on offline "
-                    "band data bandNum reading (%s:%d)",
-                    __FILE__, __LINE__);
-            rtdealloc(band);
-            return 0;
-        }
-        band->data.offline.bandNum = read_int8(ptr);
+		for (iYBlock = 0; iYBlock < nYBlocks; iYBlock++) {
+			for (iXBlock = 0; iXBlock < nXBlocks; iXBlock++) {
+				memset(values, 0, valueslen);
 
-        band->data.offline.mem = NULL;
+				x = iXBlock * nXBlockSize;
+				y = iYBlock * nYBlockSize;
+				RASTER_DEBUGF(4, "(iXBlock, iYBlock) = (%d, %d)", iXBlock, iYBlock);
+				RASTER_DEBUGF(4, "(x, y) = (%d, %d)", x, y);
 
-        {
-            /* check we have a NULL-termination */
-            sz = 0;
-            while ((*ptr)[sz] && &((*ptr)[sz]) < end) ++sz;
-            if (&((*ptr)[sz]) >= end) {
-                rterror("rt_band_from_wkb: Premature end of WKB on band offline path reading");
-                rtdealloc(band);
-                return 0;
-            }
+				/* valid block width */
+				if ((iXBlock + 1) * nXBlockSize > width)
+					nXValid = width - (iXBlock * nXBlockSize);
+				else
+					nXValid = nXBlockSize;
 
-            band->ownsData = 1;
-            band->data.offline.path = rtalloc(sz + 1);
+				/* valid block height */
+				if ((iYBlock + 1) * nYBlockSize > height)
+					nYValid = height - (iYBlock * nYBlockSize);
+				else
+					nYValid = nYBlockSize;
 
-            memcpy(band->data.offline.path, *ptr, sz);
-            band->data.offline.path[sz] = '\0';
+				RASTER_DEBUGF(4, "(nXValid, nYValid) = (%d, %d)", nXValid, nYValid);
 
-            RASTER_DEBUGF(3, "OFFDB band path is %s (size is %d)",
-                    band->data.offline.path, sz);
+				cplerr = GDALRasterIO(
+					gdband, GF_Read,
+					x, y,
+					nXValid, nYValid,
+					values, nXValid, nYValid,
+					gdpixtype,
+					0, 0
+				);
+				if (cplerr != CE_None) {
+					rterror("rt_raster_from_gdal_dataset: Unable to get data from transformed raster");
+					rtdealloc(values);
+					rt_raster_destroy(rast);
+					return NULL;
+				}
 
-            *ptr += sz + 1;
+				/* if block width is same as raster width, shortcut */
+				if (nXBlocks == 1 && nYBlockSize > 1 && nXValid == width) {
+					x = 0;
+					y = nYBlockSize * iYBlock;
 
-            /* TODO: How could we know if the offline band is a nodata band? */
-            band->isnodata = FALSE;
-        }
-        return band;
-    }
+					RASTER_DEBUGF(4, "Setting set of pixel lines at (%d, %d) for %d pixels", x, y, nXValid * nYValid);
+					rt_band_set_pixel_line(band, x, y, values, nXValid * nYValid);
+				}
+				else {
+					ptr = values;
+					x = nXBlockSize * iXBlock;
+					for (iY = 0; iY < nYValid; iY++) {
+						y = iY + (nYBlockSize * iYBlock);
 
-    /* This is an on-disk band */
-    sz = width * height * pixbytes;
-    if (((*ptr) + sz) > end) {
-        rterror("rt_band_from_wkb: Premature end of WKB on band data reading (%s:%d)",
-                __FILE__, __LINE__);
-        rtdealloc(band);
-        return 0;
-    }
+						RASTER_DEBUGF(4, "Setting pixel line at (%d, %d) for %d pixels", x, y, nXValid);
+						rt_band_set_pixel_line(band, x, y, ptr, nXValid);
+						ptr += (nXValid * ptlen);
+					}
+				}
+			}
+		}
 
-    band->data.mem = rtalloc(sz);
-    if (!band->data.mem) {
-        rterror("rt_band_from_wkb: Out of memory during band creation in WKB parser");
-        rtdealloc(band);
-        return 0;
-    }
+		/* free memory */
+		rtdealloc(values);
+	}
 
-    memcpy(band->data.mem, *ptr, sz);
-    *ptr += sz;
+	return rast;
+}
 
-    /* Should now flip values if > 8bit and
-     * littleEndian != isMachineLittleEndian */
-    if (pixbytes > 1) {
-        if (isMachineLittleEndian() != littleEndian) {
-            {
-                void (*flipper)(uint8_t*) = 0;
-                uint8_t *flipme = NULL;
+/**
+ * Return a warped raster using GDAL Warp API
+ *
+ * @param raster : raster to transform
+ * @param src_srs : the raster's coordinate system in OGC WKT
+ * @param dst_srs : the warped raster's coordinate system in OGC WKT
+ * @param scale_x : the x size of pixels of the warped raster's pixels in
+ *   units of dst_srs
+ * @param scale_y : the y size of pixels of the warped raster's pixels in
+ *   units of dst_srs
+ * @param width : the number of columns of the warped raster.  note that
+ *   width/height CANNOT be used with scale_x/scale_y
+ * @param height : the number of rows of the warped raster.  note that
+ *   width/height CANNOT be used with scale_x/scale_y
+ * @param ul_xw : the X value of upper-left corner of the warped raster in
+ *   units of dst_srs
+ * @param ul_yw : the Y value of upper-left corner of the warped raster in
+ *   units of dst_srs
+ * @param grid_xw : the X value of point on a grid to align warped raster
+ *   to in units of dst_srs
+ * @param grid_yw : the Y value of point on a grid to align warped raster
+ *   to in units of dst_srs
+ * @param skew_x : the X skew of the warped raster in units of dst_srs
+ * @param skew_y : the Y skew of the warped raster in units of dst_srs
+ * @param resample_alg : the resampling algorithm
+ * @param max_err : maximum error measured in input pixels permitted
+ *   (0.0 for exact calculations)
+ *
+ * @return the warped raster
+ */
+rt_raster rt_raster_gdal_warp(
+	rt_raster raster, const char *src_srs,
+	const char *dst_srs,
+	double *scale_x, double *scale_y,
+	int *width, int *height,
+	double *ul_xw, double *ul_yw,
+	double *grid_xw, double *grid_yw,
+	double *skew_x, double *skew_y,
+	GDALResampleAlg resample_alg, double max_err
+) {
+	CPLErr cplerr;
+	GDALDriverH src_drv = NULL;
+	GDALDatasetH src_ds = NULL;
+	GDALWarpOptions *wopts = NULL;
+	GDALDriverH dst_drv = NULL;
+	GDALDatasetH dst_ds = NULL;
+	char *_src_srs = NULL;
+	char *_dst_srs = NULL;
+	char *dst_options[] = {"SUBCLASS=VRTWarpedDataset", NULL};
+	char **transform_opts = NULL;
+	int transform_opts_len = 2;
+	void *transform_arg = NULL;
+	void *imgproj_arg = NULL;
+	void *approx_arg = NULL;
+	GDALTransformerFunc transform_func = NULL;
 
-                if (pixbytes == 2) flipper = flip_endian_16;
-                else if (pixbytes == 4) flipper = flip_endian_32;
-                else if (pixbytes == 8) flipper = flip_endian_64;
-                else {
-                    rterror("rt_band_from_wkb: Unexpected pix bytes %d", pixbytes);
-                    rtdealloc(band);
-                    rtdealloc(band->data.mem);
-                    return 0;
-                }
+	GDALRasterBandH band;
+	rt_band rtband = NULL;
+	rt_pixtype pt = PT_END;
+	GDALDataType gdal_pt = GDT_Unknown;
+	double nodata = 0.0;
 
-                flipme = band->data.mem;
-                sz = width * height;
-                for (v = 0; v < sz; ++v) {
-                    flipper(flipme);
-                    flipme += pixbytes;
-                }
-            }
-        }
-    }
-        /* And should check for invalid values for < 8bit types */
-    else if (band->pixtype == PT_1BB ||
-            band->pixtype == PT_2BUI ||
-            band->pixtype == PT_4BUI) {
-        {
-            uint8_t maxVal = band->pixtype == PT_1BB ? 1 :
-                    band->pixtype == PT_2BUI ? 3 :
-                    15;
-            uint8_t val;
+	double dst_gt[6] = {0};
+	double dst_extent[4];
+	int _width = 0;
+	int _height = 0;
+	int ul_user = 0;
+	double min_x = 0;
+	double min_y = 0;
+	double max_x = 0;
+	double max_y = 0;
+	double pix_x = 0;
+	double pix_y = 0;
 
-            sz = width*height;
-            for (v = 0; v < sz; ++v) {
-                val = ((uint8_t*) band->data.mem)[v];
-                if (val > maxVal) {
-                    rterror("rt_band_from_wkb: Invalid value %d for pixel of type %s",
-                            val, rt_pixtype_name(band->pixtype));
-                    rtdealloc(band->data.mem);
-                    rtdealloc(band);
-                    return 0;
-                }
-            }
-        }
-    }
+	double djunk = 0;
+	double grid_shift_xw = 0;
+	double grid_shift_yw = 0;
+	double grid_pix_x = 0;
+	double grid_pix_y = 0;
 
-    /* And we should check if the band is a nodata band */
-    /* TODO: No!! This is too slow */
-    /*rt_band_check_is_nodata(band);*/
+	rt_raster rast = NULL;
+	int i = 0;
+	int j = 0;
+	int numBands = 0;
 
-    return band;
-}
+	RASTER_DEBUG(3, "starting");
 
-/* -4 for size, +1 for endian */
-#define RT_WKB_HDR_SZ (sizeof(struct rt_raster_serialized_t)-4+1)
+	assert(NULL != raster);
+	assert(NULL != src_srs);
 
-rt_raster
-rt_raster_from_wkb(const uint8_t* wkb, uint32_t wkbsize) {
-    const uint8_t *ptr = wkb;
-    const uint8_t *wkbend = NULL;
-    rt_raster rast = NULL;
-    uint8_t endian = 0;
-    uint16_t version = 0;
-    uint16_t i = 0;
+	/*
+		max_err must be gte zero
 
+		the value 0.125 is the default used in gdalwarp.cpp on line 283
+	*/
+	if (max_err < 0.) max_err = 0.125;
+	RASTER_DEBUGF(4, "max_err = %f", max_err);
 
+	_src_srs = rt_util_gdal_convert_sr(src_srs, 0);
+	/* dst_srs not provided, set to src_srs */
+	if (NULL == dst_srs)
+		_dst_srs = rt_util_gdal_convert_sr(src_srs, 0);
+	else
+		_dst_srs = rt_util_gdal_convert_sr(dst_srs, 0);
 
-    assert(NULL != ptr);
+	/* load raster into a GDAL MEM dataset */
+	src_ds = rt_raster_to_gdal_mem(raster, _src_srs, NULL, 0, &src_drv);
+	if (NULL == src_ds) {
+		rterror("rt_raster_gdal_warp: Unable to convert raster to GDAL MEM format");
 
-    /* Check that wkbsize is >= sizeof(rt_raster_serialized) */
-    if (wkbsize < RT_WKB_HDR_SZ) {
-        rterror("rt_raster_from_wkb: wkb size (%d)  < min size (%d)",
-                wkbsize, RT_WKB_HDR_SZ);
-        return 0;
-    }
-    wkbend = wkb + wkbsize;
+		CPLFree(_src_srs);
+		CPLFree(_dst_srs);
 
-    RASTER_DEBUGF(3, "Parsing header from wkb position %d (expected 0)",
-            d_binptr_to_pos(ptr, wkbend, wkbsize));
+		return NULL;
+	}
+	RASTER_DEBUG(3, "raster loaded into GDAL MEM dataset");
+
+	/* set transform_opts */
+	transform_opts = (char **) rtalloc(sizeof(char *) * (transform_opts_len + 1));
+	if (NULL == transform_opts) {
+		rterror("rt_raster_gdal_warp: Unable to allocation memory for transform options");
 
+		GDALClose(src_ds);
 
-    CHECK_BINPTR_POSITION(ptr, wkbend, wkbsize, 0);
+		CPLFree(_src_srs);
+		CPLFree(_dst_srs);
 
-    /* Read endianness */
-    endian = *ptr;
-    ptr += 1;
+		return NULL;
+	}
+	for (i = 0; i < transform_opts_len; i++) {
+		switch (i) {
+			case 1:
+				transform_opts[i] = (char *) rtalloc(sizeof(char) * (strlen("DST_SRS=") + strlen(_dst_srs) + 1));
+				break;
+			case 0:
+				transform_opts[i] = (char *) rtalloc(sizeof(char) * (strlen("SRC_SRS=") + strlen(_src_srs) + 1));
+				break;
+		}
+		if (NULL == transform_opts[i]) {
+			rterror("rt_raster_gdal_warp: Unable to allocation memory for transform options");
 
-    /* Read version of protocol */
-    version = read_uint16(&ptr, endian);
-    if (version != 0) {
-        rterror("rt_raster_from_wkb: WKB version %d unsupported", version);
-        return 0;
-    }
+			for (j = 0; j < i; j++) rtdealloc(transform_opts[j]);
+			rtdealloc(transform_opts);
+			GDALClose(src_ds);
 
-    /* Read other components of raster header */
-    rast = (rt_raster) rtalloc(sizeof (struct rt_raster_t));
-    if (!rast) {
-        rterror("rt_raster_from_wkb: Out of memory allocating raster for wkb input");
-        return 0;
-    }
-    rast->numBands = read_uint16(&ptr, endian);
-    rast->scaleX = read_float64(&ptr, endian);
-    rast->scaleY = read_float64(&ptr, endian);
-    rast->ipX = read_float64(&ptr, endian);
-    rast->ipY = read_float64(&ptr, endian);
-    rast->skewX = read_float64(&ptr, endian);
-    rast->skewY = read_float64(&ptr, endian);
-		rt_raster_set_srid(rast, read_int32(&ptr, endian));
-    rast->width = read_uint16(&ptr, endian);
-    rast->height = read_uint16(&ptr, endian);
+			CPLFree(_src_srs);
+			CPLFree(_dst_srs);
 
-    /* Consistency checking, should have been checked before */
-    assert(ptr <= wkbend);
+			return NULL;
+		}
+
+		switch (i) {
+			case 1:
+				snprintf(
+					transform_opts[i],
+					sizeof(char) * (strlen("DST_SRS=") + strlen(_dst_srs) + 1),
+					"DST_SRS=%s",
+					_dst_srs
+				);
+				break;
+			case 0:
+				snprintf(
+					transform_opts[i],
+					sizeof(char) * (strlen("SRC_SRS=") + strlen(_src_srs) + 1),
+					"SRC_SRS=%s",
+					_src_srs
+				);
+				break;
+		}
+		RASTER_DEBUGF(4, "transform_opts[%d] = %s", i, transform_opts[i]);
+	}
+	transform_opts[transform_opts_len] = NULL;
+	CPLFree(_src_srs);
+	CPLFree(_dst_srs);
 
-    RASTER_DEBUGF(3, "rt_raster_from_wkb: Raster numBands: %d",
-            rast->numBands);
-    RASTER_DEBUGF(3, "rt_raster_from_wkb: Raster scale: %gx%g",
-            rast->scaleX, rast->scaleY);
-    RASTER_DEBUGF(3, "rt_raster_from_wkb: Raster ip: %gx%g",
-            rast->ipX, rast->ipY);
-    RASTER_DEBUGF(3, "rt_raster_from_wkb: Raster skew: %gx%g",
-            rast->skewX, rast->skewY);
-    RASTER_DEBUGF(3, "rt_raster_from_wkb: Raster srid: %d",
-            rast->srid);
-    RASTER_DEBUGF(3, "rt_raster_from_wkb: Raster dims: %dx%d",
-            rast->width, rast->height);
-    RASTER_DEBUGF(3, "Parsing raster header finished at wkb position %d (expected 61)",
-            d_binptr_to_pos(ptr, wkbend, wkbsize));
+	/* transformation object for building dst dataset */
+	transform_arg = GDALCreateGenImgProjTransformer2(src_ds, NULL, transform_opts);
+	if (NULL == transform_arg) {
+		rterror("rt_raster_gdal_warp: Unable to create GDAL transformation object for output dataset creation");
 
-    CHECK_BINPTR_POSITION(ptr, wkbend, wkbsize, 61);
+		GDALClose(src_ds);
 
-    /* Read all bands of raster */
+		for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
+		rtdealloc(transform_opts);
 
-    if (!rast->numBands) {
-        /* Here ptr should have been left to right after last used byte */
-        if (ptr < wkbend) {
-            rtwarn("%d bytes of WKB remained unparsed", wkbend - ptr);
-        } else if (ptr > wkbend) {
-            /* Easier to get a segfault before I guess */
-            rtwarn("We parsed %d bytes more then available!", ptr - wkbend);
-        }
-        rast->bands = 0;
-        return rast;
-    }
+		return NULL;
+	}
 
-    /* Now read the bands */
-    rast->bands = (rt_band*) rtalloc(sizeof (rt_band) * rast->numBands);
-    if (!rast->bands) {
-        rterror("rt_raster_from_wkb: Out of memory allocating bands for WKB raster decoding");
-        rtdealloc(rast);
-        return 0;
-    }
+	/* get approximate output georeferenced bounds and resolution */
+	cplerr = GDALSuggestedWarpOutput2(src_ds, GDALGenImgProjTransform,
+		transform_arg, dst_gt, &_width, &_height, dst_extent, 0);
+	GDALDestroyGenImgProjTransformer(transform_arg);
+	if (cplerr != CE_None) {
+		rterror("rt_raster_gdal_warp: Unable to get GDAL suggested warp output for output dataset creation");
 
-    /* ptr should now point to start of first band */
-    assert(ptr <= wkbend); /* we should have checked this before */
+		GDALClose(src_ds);
 
-    for (i = 0; i < rast->numBands; ++i) {
-        RASTER_DEBUGF(3, "Parsing band %d from wkb position %d", i,
-                d_binptr_to_pos(ptr, wkbend, wkbsize));
+		for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
+		rtdealloc(transform_opts);
 
-        rt_band band = rt_band_from_wkb(rast->width, rast->height,
-                &ptr, wkbend, endian);
-        if (!band) {
-            rterror("rt_raster_from_wkb: Error reading WKB form of band %d", i);
-            rtdealloc(rast);
-            /* TODO: dealloc any previously allocated band too ! */
-            return 0;
-        }
-				band->raster = rast;
-        rast->bands[i] = band;
-    }
+		return NULL;
+	}
 
-    /* Here ptr should have been left to right after last used byte */
-    if (ptr < wkbend) {
-        rtwarn("%d bytes of WKB remained unparsed", wkbend - ptr);
-    } else if (ptr > wkbend) {
-        /* Easier to get a segfault before I guess */
-        rtwarn("We parsed %d bytes more then available!",
-                ptr - wkbend);
-    }
+	RASTER_DEBUGF(3, "Suggested geotransform: %f, %f, %f, %f, %f, %f",
+		dst_gt[0], dst_gt[1], dst_gt[2], dst_gt[3], dst_gt[4], dst_gt[5]);
+	RASTER_DEBUGF(3, "Suggested extent: %f, %f, %f, %f",
+		dst_extent[0], dst_extent[1], dst_extent[2], dst_extent[3]);
 
-    assert(NULL != rast);
-    return rast;
-}
+	/* user-defined upper-left corner */
+	if (
+		NULL != ul_xw &&
+		NULL != ul_yw
+	) {
+		min_x = *ul_xw;
+		max_y = *ul_yw;
+		ul_user = 1;
+	}
+	else if (
+		((NULL != ul_xw) && (NULL == ul_yw)) ||
+		((NULL == ul_xw) && (NULL != ul_yw))
+	) {
+		rterror("rt_raster_gdal_warp: Both X and Y upper-left corner values must be provided");
 
-rt_raster
-rt_raster_from_hexwkb(const char* hexwkb,
-        uint32_t hexwkbsize) {
-    uint8_t* wkb = NULL;
-    uint32_t wkbsize = 0;
-    uint32_t i = 0;
+		GDALClose(src_ds);
 
+		for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
+		rtdealloc(transform_opts);
 
+		return NULL;
+	}
 
-    assert(NULL != hexwkb);
+	/* skew */
+	if (NULL != skew_x)
+		dst_gt[2] = *skew_x;
+	if (NULL != skew_y)
+		dst_gt[4] = *skew_y;
 
-    RASTER_DEBUGF(3, "rt_raster_from_hexwkb: input wkb: %s", hexwkb);
+	/* scale and width/height are mutually exclusive */
+	if (
+		((NULL != scale_x) || (NULL != scale_y)) &&
+		((NULL != width) || (NULL != height))
+	) {
+		rterror("rt_raster_gdal_warp: Scale X/Y and width/height are mutually exclusive.  Only provide one");
 
-    if (hexwkbsize % 2) {
-        rterror("rt_raster_from_hexwkb: Raster HEXWKB input must have an even number of characters");
-        return 0;
-    }
-    wkbsize = hexwkbsize / 2;
+		GDALClose(src_ds);
 
-    wkb = rtalloc(wkbsize);
-    if (!wkb) {
-        rterror("rt_raster_from_hexwkb: Out of memory allocating memory for decoding HEXWKB");
-        return 0;
-    }
+		for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
+		rtdealloc(transform_opts);
 
-    for (i = 0; i < wkbsize; ++i) /* parse full hex */ {
-        wkb[i] = parse_hex((char*) & (hexwkb[i * 2]));
-    }
+		return NULL;
+	}
 
-    rt_raster ret = rt_raster_from_wkb(wkb, wkbsize);
+	/* user-defined width/height */
+	if ((NULL != width) && (*width > 0.)) {
+		_width = *width;
+		dst_gt[1] = (dst_extent[2] - dst_extent[0]) / ((double) _width);
+		pix_x = 0;
+	}
+	if ((NULL != height) && (*height > 0.)) {
+		_height = *height;
+		dst_gt[5] = -1 * fabs((dst_extent[3] - dst_extent[1]) / ((double) _height));
+		pix_y = 0;
+	}
 
-    rtdealloc(wkb); /* as long as rt_raster_from_wkb copies memory */
+	/* user-defined scale */
+	if (
+		((NULL != scale_x) && (FLT_NEQ(*scale_x, 0.0))) &&
+		((NULL != scale_y) && (FLT_NEQ(*scale_y, 0.0)))
+	) {
+		pix_x = fabs(*scale_x);
+		pix_y = fabs(*scale_y);
+	}
+	else if (
+		((NULL != scale_x) && (NULL == scale_y)) ||
+		((NULL == scale_x) && (NULL != scale_y))
+	) {
+		rterror("rt_raster_gdal_warp: Both X and Y scale values must be provided for scale");
 
-    return ret;
-}
+		GDALClose(src_ds);
 
-static uint32_t
-rt_raster_wkb_size(rt_raster raster) {
-    uint32_t size = RT_WKB_HDR_SZ;
-    uint16_t i = 0;
+		for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
+		rtdealloc(transform_opts);
 
+		return NULL;
+	}
 
+	/* alignment only considered if upper-left corner not provided */
+	if (
+		!ul_user && (
+			(NULL != grid_xw) || (NULL != grid_yw)
+		)
+	) {
+		if (
+			((NULL != grid_xw) && (NULL == grid_yw)) ||
+			((NULL == grid_xw) && (NULL != grid_yw))
+		) {
+			rterror("rt_raster_gdal_warp: Both X and Y alignment values must be provided");
 
-    assert(NULL != raster);
+			GDALClose(src_ds);
 
-    RASTER_DEBUGF(3, "rt_raster_wkb_size: computing size for %d bands",
-            raster->numBands);
+			for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
+			rtdealloc(transform_opts);
 
-    for (i = 0; i < raster->numBands; ++i) {
-        rt_band band = raster->bands[i];
-        rt_pixtype pixtype = band->pixtype;
-        int pixbytes = rt_pixtype_size(pixtype);
+			return NULL;
+		}
 
-        RASTER_DEBUGF(3, "rt_raster_wkb_size: adding size of band %d", i);
+		/* use scale for alignment */
+		if (FLT_NEQ(pix_x, 0.))
+			grid_pix_x = pix_x;
+		else
+			grid_pix_x = fabs(dst_gt[1]);
+		if (FLT_NEQ(pix_y, 0.))
+			grid_pix_y = pix_y;
+		else
+			grid_pix_y = fabs(dst_gt[5]);
 
-        if (pixbytes < 1) {
-            rterror("rt_raster_wkb_size: Corrupted band: unknown pixtype");
-            return 0;
-        }
+		/* grid shift of upper left to match alignment grid */
+		grid_shift_xw = grid_pix_x * modf(fabs(*grid_xw - dst_gt[0]) / grid_pix_x, &djunk);
+		grid_shift_yw = grid_pix_y * modf(fabs(*grid_yw - dst_gt[3]) / grid_pix_y, &djunk);
 
-        /* Add space for band type */
-        size += 1;
+		/* shift along X axis for upper left */
+		if (FLT_NEQ(grid_shift_xw, 0.) && FLT_NEQ(grid_shift_xw, grid_pix_x)) {
+			min_x = dst_gt[0] - grid_shift_xw;
+			min_x = modf(fabs(*grid_xw - min_x) / grid_pix_x, &djunk);
+			if (FLT_NEQ(min_x, 0.) && FLT_NEQ(min_x, 1.))
+				grid_shift_xw = grid_pix_x - grid_shift_xw;
+			min_x = dst_gt[0] - grid_shift_xw;
 
-        /* Add space for nodata value */
-        size += pixbytes;
+			ul_user = 1;
+		}
+		else
+			min_x = dst_gt[0];
 
-        if (band->offline) {
-            /* Add space for band number */
-            size += 1;
+		/* shift along Y axis for upper left */
+		if (FLT_NEQ(grid_shift_yw, 0.) && FLT_NEQ(grid_shift_yw, grid_pix_y)) {
+			max_y = dst_gt[3] + grid_shift_yw;
+			max_y = modf(fabs(*grid_yw - max_y) / grid_pix_y, &djunk);
+			if (FLT_NEQ(max_y, 0.) && FLT_NEQ(max_y, 1.))
+				grid_shift_yw = grid_pix_y - grid_shift_yw;
+			max_y = dst_gt[3] + grid_shift_yw;
 
-            /* Add space for null-terminated path */
-            size += strlen(band->data.offline.path) + 1;
-        } else {
-            /* Add space for actual data */
-            size += pixbytes * raster->width * raster->height;
-        }
+			ul_user = 1;
+		}
+		else
+			max_y = dst_gt[3];
 
-    }
+		/* adjust width and height to account new upper left */
+		if (ul_user) {
+			/* use suggested lower right corner */
+			max_x = dst_gt[0] + dst_gt[1] * _width;
+			min_y = dst_gt[3] + dst_gt[5] * _height;
 
-    return size;
-}
+			/* user defined width */
+			if ((NULL != width) && (*width > 0.))
+				grid_pix_x = fabs((max_x - min_x) / ((double) _width));
+			else
+				_width = (int) ((max_x - min_x + (grid_pix_x / 2.)) / grid_pix_x);
 
-uint8_t *
-rt_raster_to_wkb(rt_raster raster, uint32_t *wkbsize) {
-#if POSTGIS_DEBUG_LEVEL > 0
-    const uint8_t *wkbend = NULL;
-#endif
-    uint8_t *wkb = NULL;
-    uint8_t *ptr = NULL;
-    uint16_t i = 0;
-    uint8_t littleEndian = isMachineLittleEndian();
+			/* user defined height  */
+			if ((NULL != height) && (*height > 0.))
+				grid_pix_y = fabs((max_y - min_y) / ((double) _height));
+			else
+				_height = (int) ((max_y - min_y + (grid_pix_y / 2.)) / grid_pix_y);
 
+			dst_gt[1] = grid_pix_x;
+			dst_gt[5] = -1 * grid_pix_y;
+			RASTER_DEBUGF(3, "new dimensions: %d x %d", _width, _height);
+		}
 
+		RASTER_DEBUGF(3, "shift is: %f, %f", grid_shift_xw, grid_shift_yw);
+		RASTER_DEBUGF(3, "new ul is: %f, %f", min_x, max_y);
+	}
 
-    assert(NULL != raster);
-    assert(NULL != wkbsize);
+	/* process user-defined scale */
+	if (
+		(FLT_NEQ(pix_x, 0.0)) ||
+		(FLT_NEQ(pix_y, 0.0))
+	) {
+		/* axis scale is zero, use suggested scale for axis */
+		if (FLT_EQ(pix_x, 0.0))
+			pix_x = fabs(dst_gt[1]);
+		if (FLT_EQ(pix_y, 0.0))
+			pix_y = fabs(dst_gt[5]);
 
-    RASTER_DEBUG(2, "rt_raster_to_wkb: about to call rt_raster_wkb_size");
+		/* upper-left corner not provided by user */
+		if (!ul_user) {
+			min_x = dst_gt[0];
+			max_y = dst_gt[3];
+		}
 
-    *wkbsize = rt_raster_wkb_size(raster);
+		/* lower-right corner */
+		max_x = min_x + dst_gt[1] * _width;
+		min_y = max_y + dst_gt[5] * _height;
 
-    RASTER_DEBUGF(3, "rt_raster_to_wkb: found size: %d", *wkbsize);
+		_width = (int) ((max_x - min_x + (pix_x / 2.)) / pix_x);
+		_height = (int) ((max_y - min_y + (pix_y / 2.)) / pix_y);
+		dst_gt[0] = min_x;
+		dst_gt[3] = max_y;
+		dst_gt[1] = pix_x;
+		dst_gt[5] = -1 * pix_y;
 
-    wkb = (uint8_t*) rtalloc(*wkbsize);
-    if (!wkb) {
-        rterror("rt_raster_to_wkb: Out of memory allocating WKB for raster");
-        return 0;
-    }
+		RASTER_DEBUGF(3, "new dimensions: %d x %d", _width, _height);
+	}
+	/* user-defined upper-left corner */
+	else if (ul_user) {
+		dst_gt[0] = min_x;
+		dst_gt[3] = max_y;
+	}
 
-    ptr = wkb;
+	RASTER_DEBUGF(3, "Applied geotransform: %f, %f, %f, %f, %f, %f",
+		dst_gt[0], dst_gt[1], dst_gt[2], dst_gt[3], dst_gt[4], dst_gt[5]);
+	RASTER_DEBUGF(3, "Raster dimensions (width x height): %d x %d",
+		_width, _height);
 
-#if POSTGIS_DEBUG_LEVEL > 2
-    wkbend = ptr + (*wkbsize);
-#endif
-    RASTER_DEBUGF(3, "Writing raster header to wkb on position %d (expected 0)",
-            d_binptr_to_pos(ptr, wkbend, *wkbsize));
+	if (FLT_EQ(_width, 0.0) || FLT_EQ(_height, 0.0)) {
+		rterror("rt_raster_gdal_warp: The width (%f) or height (%f) of the warped raster is zero", _width, _height);
 
-    /* Write endianness */
-    *ptr = littleEndian;
-    ptr += 1;
+		GDALClose(src_ds);
 
-    /* Write version(size - (end - ptr)) */
-    write_uint16(&ptr, littleEndian, 0);
+		for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
+		rtdealloc(transform_opts);
 
-    /* Copy header (from numBands up) */
-    memcpy(ptr, &(raster->numBands), sizeof (struct rt_raster_serialized_t) - 6);
-    ptr += sizeof (struct rt_raster_serialized_t) - 6;
+		return NULL;
+	}
 
-    RASTER_DEBUGF(3, "Writing bands header to wkb position %d (expected 61)",
-            d_binptr_to_pos(ptr, wkbend, *wkbsize));
+	/* load VRT driver */
+	if (!rt_util_gdal_driver_registered("VRT"))
+		GDALRegister_VRT();
+	dst_drv = GDALGetDriverByName("VRT");
+	if (NULL == dst_drv) {
+		rterror("rt_raster_gdal_warp: Unable to load the output GDAL VRT driver");
 
-    /* Serialize bands now */
-    for (i = 0; i < raster->numBands; ++i) {
-        rt_band band = raster->bands[i];
-        rt_pixtype pixtype = band->pixtype;
-        int pixbytes = rt_pixtype_size(pixtype);
+		GDALClose(src_ds);
 
-        RASTER_DEBUGF(3, "Writing WKB for band %d", i);
-        RASTER_DEBUGF(3, "Writing band pixel type to wkb position %d",
-                d_binptr_to_pos(ptr, wkbend, *wkbsize));
+		return NULL;
+	}
 
-        if (pixbytes < 1) {
-            rterror("rt_raster_to_wkb: Corrupted band: unknown pixtype");
-            return 0;
-        }
+	/* create dst dataset */
+	dst_ds = GDALCreate(dst_drv, "", _width, _height, 0, GDT_Byte, dst_options);
+	if (NULL == dst_ds) {
+		rterror("rt_raster_gdal_warp: Unable to create GDAL VRT dataset");
 
-        /* Add band type */
-        *ptr = band->pixtype;
-        if (band->offline) *ptr |= BANDTYPE_FLAG_OFFDB;
-        if (band->hasnodata) *ptr |= BANDTYPE_FLAG_HASNODATA;
-        if (band->isnodata) *ptr |= BANDTYPE_FLAG_ISNODATA;
-        ptr += 1;
+		GDALClose(src_ds);
 
-#if 0 /* no padding required for WKB */
-        /* Add padding (if needed) */
-        if (pixbytes > 1) {
-            memset(ptr, '\0', pixbytes - 1);
-            ptr += pixbytes - 1;
-        }
-        /* Consistency checking (ptr is pixbytes-aligned) */
-        assert(!(((uint64_t) ptr) % pixbytes));
-#endif
+		for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
+		rtdealloc(transform_opts);
 
-        RASTER_DEBUGF(3, "Writing band nodata to wkb position %d",
-                d_binptr_to_pos(ptr, wkbend, *wkbsize));
+		return NULL;
+	}
 
-        /* Add nodata value */
-        switch (pixtype) {
-            case PT_1BB:
-            case PT_2BUI:
-            case PT_4BUI:
-            case PT_8BUI:
-            {
-                uint8_t v = band->nodataval;
-                *ptr = v;
-                ptr += 1;
-                break;
-            }
-            case PT_8BSI:
-            {
-                int8_t v = band->nodataval;
-                *ptr = v;
-                ptr += 1;
-                break;
-            }
-            case PT_16BSI:
-            case PT_16BUI:
-            {
-                uint16_t v = band->nodataval;
-                memcpy(ptr, &v, 2);
-                ptr += 2;
-                break;
-            }
-            case PT_32BSI:
-            case PT_32BUI:
-            {
-                uint32_t v = band->nodataval;
-                memcpy(ptr, &v, 4);
-                ptr += 4;
-                break;
-            }
-            case PT_32BF:
-            {
-                float v = band->nodataval;
-                memcpy(ptr, &v, 4);
-                ptr += 4;
-                break;
-            }
-            case PT_64BF:
-            {
-                memcpy(ptr, &band->nodataval, 8);
-                ptr += 8;
-                break;
-            }
-            default:
-                rterror("rt_raster_to_wkb: Fatal error caused by unknown pixel type. Aborting.");
-                abort(); /* shoudn't happen */
-                return 0;
-        }
+	/* add bands to dst dataset */
+	numBands = rt_raster_get_num_bands(raster);
+	for (i = 0; i < numBands; i++) {
+		rtband = rt_raster_get_band(raster, i);
+		if (NULL == rtband) {
+			rterror("rt_raster_gdal_warp: Unable to get band %d for adding to VRT dataset", i);
 
-#if 0 /* no padding for WKB */
-        /* Consistency checking (ptr is pixbytes-aligned) */
-        assert(!((uint64_t) ptr % pixbytes));
-#endif
+			GDALClose(dst_ds);
+			GDALClose(src_ds);
 
-        if (band->offline) {
-            /* Write band number */
-            *ptr = band->data.offline.bandNum;
-            ptr += 1;
+			for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
+			rtdealloc(transform_opts);
 
-            /* Write path */
-            strcpy((char*) ptr, band->data.offline.path);
-            ptr += strlen(band->data.offline.path) + 1;
-        } else {
-            /* Write data */
-            {
-                uint32_t datasize = raster->width * raster->height * pixbytes;
-                RASTER_DEBUGF(4, "rt_raster_to_wkb: Copying %d bytes", datasize);
-                memcpy(ptr, band->data.mem, datasize);
-                ptr += datasize;
-            }
-        }
+			return NULL;
+		}
 
-#if 0 /* no padding for WKB */
-        /* Pad up to 8-bytes boundary */
-        while ((uint64_t) ptr % 8) {
-            *ptr = 0;
-            ++ptr;
-        }
+		pt = rt_band_get_pixtype(rtband);
+		gdal_pt = rt_util_pixtype_to_gdal_datatype(pt);
+		if (gdal_pt == GDT_Unknown)
+			rtwarn("rt_raster_gdal_warp: Unknown pixel type for band %d", i);
+
+		cplerr = GDALAddBand(dst_ds, gdal_pt, NULL);
+		if (cplerr != CE_None) {
+			rterror("rt_raster_gdal_warp: Unable to add band to VRT dataset");
 
-        /* Consistency checking (ptr is pixbytes-aligned) */
-        assert(!((uint64_t) ptr % pixbytes));
-#endif
-    }
+			GDALClose(dst_ds);
+			GDALClose(src_ds);
 
-    return wkb;
-}
+			for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
+			rtdealloc(transform_opts);
 
-char *
-rt_raster_to_hexwkb(rt_raster raster, uint32_t *hexwkbsize) {
-    uint8_t *wkb = NULL;
-    char* hexwkb = NULL;
-    uint32_t i = 0;
-    uint32_t wkbsize = 0;
+			return NULL;
+		}
 
+		/* get band to write data to */
+		band = NULL;
+		band = GDALGetRasterBand(dst_ds, i + 1);
+		if (NULL == band) {
+			rterror("rt_raster_gdal_warp: Could not get GDAL band for additional processing");
 
+			GDALClose(dst_ds);
+			GDALClose(src_ds);
 
-    assert(NULL != raster);
-    assert(NULL != hexwkbsize);
+			for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
+			rtdealloc(transform_opts);
 
-    RASTER_DEBUG(2, "rt_raster_to_hexwkb: calling rt_raster_to_wkb");
+			return NULL;
+		}
 
-    wkb = rt_raster_to_wkb(raster, &wkbsize);
+		/* set nodata */
+		if (rt_band_get_hasnodata_flag(rtband) != FALSE) {
+			nodata = rt_band_get_nodata(rtband);
+			if (GDALSetRasterNoDataValue(band, nodata) != CE_None)
+				rtwarn("rt_raster_gdal_warp: Could not set nodata value for band %d", i);
+			RASTER_DEBUGF(3, "nodata value set to %f", GDALGetRasterNoDataValue(band, NULL));
+		}
+	}
 
-    RASTER_DEBUG(3, "rt_raster_to_hexwkb: rt_raster_to_wkb returned");
+	/* set dst srs */
+	_dst_srs = rt_util_gdal_convert_sr((NULL == dst_srs ? src_srs : dst_srs), 1);
+	cplerr = GDALSetProjection(dst_ds, _dst_srs);
+	CPLFree(_dst_srs);
+	if (cplerr != CE_None) {
+		rterror("rt_raster_gdal_warp: Unable to set projection");
 
-    *hexwkbsize = wkbsize * 2; /* hex is 2 times bytes */
-    hexwkb = (char*) rtalloc((*hexwkbsize) + 1);
-    if (!hexwkb) {
-        rtdealloc(wkb);
-        rterror("rt_raster_to_hexwkb: Out of memory hexifying raster WKB");
-        return 0;
-    }
-    hexwkb[*hexwkbsize] = '\0'; /* Null-terminate */
+		GDALClose(dst_ds);
+		GDALClose(src_ds);
 
-    for (i = 0; i < wkbsize; ++i) {
-        deparse_hex(wkb[i], &(hexwkb[2 * i]));
-    }
+		for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
+		rtdealloc(transform_opts);
 
-    rtdealloc(wkb); /* we don't need this anymore */
+		return NULL;
+	}
 
-    RASTER_DEBUGF(3, "rt_raster_to_hexwkb: output wkb: %s", hexwkb);
+	/* set dst geotransform */
+	cplerr = GDALSetGeoTransform(dst_ds, dst_gt);
+	if (cplerr != CE_None) {
+		rterror("rt_raster_gdal_warp: Unable to set geotransform");
 
-    return hexwkb;
-}
+		GDALClose(dst_ds);
+		GDALClose(src_ds);
 
-/*--------- Serializer/Deserializer --------------------------------------*/
+		for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
+		rtdealloc(transform_opts);
 
-static uint32_t
-rt_raster_serialized_size(rt_raster raster) {
-    uint32_t size = sizeof (struct rt_raster_serialized_t);
-    uint16_t i = 0;
+		return NULL;
+	}
 
+	/* create transformation object */
+	transform_arg = imgproj_arg = GDALCreateGenImgProjTransformer2(src_ds, dst_ds, transform_opts);
+	if (NULL == transform_arg) {
+		rterror("rt_raster_gdal_warp: Unable to create GDAL transformation object");
 
+		GDALClose(dst_ds);
+		GDALClose(src_ds);
 
-    assert(NULL != raster);
+		for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
+		rtdealloc(transform_opts);
 
-    RASTER_DEBUGF(3, "Serialized size with just header:%d - now adding size of %d bands",
-            size, raster->numBands);
+		return NULL;
+	}
+	transform_func = GDALGenImgProjTransform;
 
-    for (i = 0; i < raster->numBands; ++i) {
-        rt_band band = raster->bands[i];
-        rt_pixtype pixtype = band->pixtype;
-        int pixbytes = rt_pixtype_size(pixtype);
+	/* use approximate transformation object */
+	if (max_err > 0.0) {
+		transform_arg = approx_arg = GDALCreateApproxTransformer(
+			GDALGenImgProjTransform,
+			imgproj_arg, max_err
+		);
+		if (NULL == transform_arg) {
+			rterror("rt_raster_gdal_warp: Unable to create GDAL approximate transformation object");
 
-        if (pixbytes < 1) {
-            rterror("rt_raster_serialized_size: Corrupted band: unknown pixtype");
-            return 0;
-        }
+			GDALClose(dst_ds);
+			GDALClose(src_ds);
 
-        /* Add space for band type, hasnodata flag and data padding */
-        size += pixbytes;
+			GDALDestroyGenImgProjTransformer(imgproj_arg);
+			for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
+			rtdealloc(transform_opts);
 
-        /* Add space for nodata value */
-        size += pixbytes;
+			return NULL;
+		}
 
-        if (band->offline) {
-            /* Add space for band number */
-            size += 1;
+		transform_func = GDALApproxTransform;
+	}
 
-            /* Add space for null-terminated path */
-            size += strlen(band->data.offline.path) + 1;
-        } else {
-            /* Add space for raster band data */
-            size += pixbytes * raster->width * raster->height;
-        }
+	/* warp options */
+	wopts = GDALCreateWarpOptions();
+	if (NULL == wopts) {
+		rterror("rt_raster_gdal_warp: Unable to create GDAL warp options object");
 
-        RASTER_DEBUGF(3, "Size before alignment is %d", size);
+		GDALClose(dst_ds);
+		GDALClose(src_ds);
 
-        /* Align size to 8-bytes boundary (trailing padding) */
-        /* XXX jorgearevalo: bug here. If the size is actually 8-bytes aligned,
-         this line will add 8 bytes trailing padding, and it's not necessary */
-        /*size += 8 - (size % 8);*/
-        if (size % 8)
-            size += 8 - (size % 8);
+		GDALDestroyGenImgProjTransformer(imgproj_arg);
+		GDALDestroyApproxTransformer(approx_arg);
+		for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
+		rtdealloc(transform_opts);
 
-        RASTER_DEBUGF(3, "Size after alignment is %d", size);
-    }
+		return NULL;
+	}
 
-    return size;
-}
+	/* set options */
+	wopts->eResampleAlg = resample_alg;
+	wopts->hSrcDS = src_ds;
+	wopts->hDstDS = dst_ds;
+	wopts->pfnTransformer = transform_func;
+	wopts->pTransformerArg = transform_arg;
+	wopts->papszWarpOptions = (char **) CPLMalloc(sizeof(char *) * 2);
+	wopts->papszWarpOptions[0] = (char *) CPLMalloc(sizeof(char) * (strlen("INIT_DEST=NO_DATA") + 1));
+	strcpy(wopts->papszWarpOptions[0], "INIT_DEST=NO_DATA");
+	wopts->papszWarpOptions[1] = NULL;
 
-void*
-rt_raster_serialize(rt_raster raster) {
-    uint32_t size = rt_raster_serialized_size(raster);
-    uint8_t* ret = NULL;
-    uint8_t* ptr = NULL;
-    uint16_t i = 0;
+	/* set band mapping */
+	wopts->nBandCount = numBands;
+	wopts->panSrcBands = (int *) CPLMalloc(sizeof(int) * wopts->nBandCount);
+	wopts->panDstBands = (int *) CPLMalloc(sizeof(int) * wopts->nBandCount);
+	for (i = 0; i < wopts->nBandCount; i++)
+		wopts->panDstBands[i] = wopts->panSrcBands[i] = i + 1;
+
+	/* set nodata mapping */
+	RASTER_DEBUG(3, "Setting nodata mapping");
+	wopts->padfSrcNoDataReal = (double *) CPLMalloc(numBands * sizeof(double));
+	wopts->padfDstNoDataReal = (double *) CPLMalloc(numBands * sizeof(double));
+	wopts->padfSrcNoDataImag = (double *) CPLMalloc(numBands * sizeof(double));
+	wopts->padfDstNoDataImag = (double *) CPLMalloc(numBands * sizeof(double));
+	if (
+		NULL == wopts->padfSrcNoDataReal ||
+		NULL == wopts->padfDstNoDataReal ||
+		NULL == wopts->padfSrcNoDataImag ||
+		NULL == wopts->padfDstNoDataImag
+	) {
+		rterror("rt_raster_gdal_warp: Out of memory allocating nodata mapping");
 
+		GDALClose(dst_ds);
+		GDALClose(src_ds);
 
-    assert(NULL != raster);
+		GDALDestroyGenImgProjTransformer(imgproj_arg);
+		GDALDestroyApproxTransformer(approx_arg);
+		GDALDestroyWarpOptions(wopts);
+		for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
+		rtdealloc(transform_opts);
 
-    ret = (uint8_t*) rtalloc(size);
-    if (!ret) {
-        rterror("rt_raster_serialize: Out of memory allocating %d bytes for serializing a raster",
-                size);
-        return 0;
-    }
-    memset(ret, '-', size);
+		return NULL;
+	}
+	for (i = 0; i < numBands; i++) {
+		band = rt_raster_get_band(raster, i);
+		if (!band) {
+			rterror("rt_raster_gdal_warp: Unable to process bands for nodata values");
 
-    ptr = ret;
+			GDALClose(dst_ds);
+			GDALClose(src_ds);
 
-    RASTER_DEBUGF(3, "sizeof(struct rt_raster_serialized_t):%u",
-            sizeof (struct rt_raster_serialized_t));
-    RASTER_DEBUGF(3, "sizeof(struct rt_raster_t):%u",
-            sizeof (struct rt_raster_t));
-    RASTER_DEBUGF(3, "serialized size:%lu", (long unsigned) size);
+			GDALDestroyGenImgProjTransformer(imgproj_arg);
+			GDALDestroyApproxTransformer(approx_arg);
+			GDALDestroyWarpOptions(wopts);
+			for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
+			rtdealloc(transform_opts);
 
-    /* Set size */
-    /* NOTE: Value of rt_raster.size may be updated in
-     * returned object, for instance, by rt_pg layer to
-     * store value calculated by SET_VARSIZE.
-     */
-    raster->size = size;
+			return NULL;
+		}
 
-    /* Set version */
-    raster->version = 0;
+		if (!rt_band_get_hasnodata_flag(band)) {
+			/*
+				based on line 1004 of gdalwarp.cpp
+				the problem is that there is a chance that this number is a legitimate value
+			*/
+			wopts->padfSrcNoDataReal[i] = -123456.789;
+		}
+		else {
+			wopts->padfSrcNoDataReal[i] = rt_band_get_nodata(band);
+		}
 
-    /* Copy header */
-    memcpy(ptr, raster, sizeof (struct rt_raster_serialized_t));
+		wopts->padfDstNoDataReal[i] = wopts->padfSrcNoDataReal[i];
+		wopts->padfDstNoDataImag[i] = wopts->padfSrcNoDataImag[i] = 0.0;
+		RASTER_DEBUGF(4, "Mapped nodata value for band %d: %f (%f) => %f (%f)",
+			i,
+			wopts->padfSrcNoDataReal[i], wopts->padfSrcNoDataImag[i],
+			wopts->padfDstNoDataReal[i], wopts->padfDstNoDataImag[i]
+		);
+	}
 
-    RASTER_DEBUG(3, "Start hex dump of raster being serialized using 0x2D to mark non-written bytes");
+	/* warp raster */
+	RASTER_DEBUG(3, "Warping raster");
+	cplerr = GDALInitializeWarpedVRT(dst_ds, wopts);
+	if (cplerr != CE_None) {
+		rterror("rt_raster_gdal_warp: Unable to warp raster");
 
-#if POSTGIS_DEBUG_LEVEL > 2
-    uint8_t* dbg_ptr = ptr;
-    d_print_binary_hex("HEADER", dbg_ptr, size);
-#endif
+		GDALClose(dst_ds);
+		GDALClose(src_ds);
 
-    ptr += sizeof (struct rt_raster_serialized_t);
+		if ((transform_func == GDALApproxTransform) && (NULL != imgproj_arg))
+			GDALDestroyGenImgProjTransformer(imgproj_arg);
+		GDALDestroyWarpOptions(wopts);
+		for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
+		rtdealloc(transform_opts);
 
-    /* Serialize bands now */
-    for (i = 0; i < raster->numBands; ++i) {
-        rt_band band = raster->bands[i];
-        assert(NULL != band);
+		return NULL;
+	}
+	GDALFlushCache(dst_ds);
+	RASTER_DEBUG(3, "Raster warped");
 
-        rt_pixtype pixtype = band->pixtype;
-        int pixbytes = rt_pixtype_size(pixtype);
-        if (pixbytes < 1) {
-            rterror("rt_raster_serialize: Corrupted band: unknown pixtype");
-            return 0;
-        }
+	/* convert gdal dataset to raster */
+	RASTER_DEBUG(3, "Converting GDAL dataset to raster");
+	rast = rt_raster_from_gdal_dataset(dst_ds);
 
-        /* Add band type */
-        *ptr = band->pixtype;
-        if (band->offline) {
-            *ptr |= BANDTYPE_FLAG_OFFDB;
-        }
-        if (band->hasnodata) {
-            *ptr |= BANDTYPE_FLAG_HASNODATA;
-        }
+	GDALClose(dst_ds);
+	GDALClose(src_ds);
 
-        if (band->isnodata) {
-            *ptr |= BANDTYPE_FLAG_ISNODATA;
-        }
+	if ((transform_func == GDALApproxTransform) && (NULL != imgproj_arg))
+		GDALDestroyGenImgProjTransformer(imgproj_arg);
+	GDALDestroyWarpOptions(wopts);
+	for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
+	rtdealloc(transform_opts);
 
-#if POSTGIS_DEBUG_LEVEL > 2
-        d_print_binary_hex("PIXTYPE", dbg_ptr, size);
-#endif
+	if (NULL == rast) {
+		rterror("rt_raster_gdal_warp: Unable to warp raster");
+		return NULL;
+	}
 
-        ptr += 1;
+	RASTER_DEBUG(3, "done");
 
-        /* Add padding (if needed) */
-        if (pixbytes > 1) {
-            memset(ptr, '\0', pixbytes - 1);
-            ptr += pixbytes - 1;
-        }
+	return rast;
+}
 
-#if POSTGIS_DEBUG_LEVEL > 2
-        d_print_binary_hex("PADDING", dbg_ptr, size);
-#endif
+/**
+ * Return a raster of the provided geometry
+ *
+ * @param wkb : WKB representation of the geometry to convert
+ * @param wkb_len : length of the WKB representation of the geometry
+ * @param srs : the geometry's coordinate system in OGC WKT
+ * @param num_bands: number of bands in the output raster
+ * @param pixtype: data type of each band
+ * @param init: array of values to initialize each band with
+ * @param value: array of values for pixels of geometry
+ * @param nodata: array of nodata values for each band
+ * @param hasnodata: array flagging the presence of nodata for each band
+ * @param width : the number of columns of the raster
+ * @param height : the number of rows of the raster
+ * @param scale_x : the pixel width of the raster
+ * @param scale_y : the pixel height of the raster
+ * @param ul_xw : the X value of upper-left corner of the raster
+ * @param ul_yw : the Y value of upper-left corner of the raster
+ * @param grid_xw : the X value of point on grid to align raster to
+ * @param grid_yw : the Y value of point on grid to align raster to
+ * @param skew_x : the X skew of the raster
+ * @param skew_y : the Y skew of the raster
+ * @param options : array of options.  only option is "ALL_TOUCHED"
+ *
+ * @return the raster of the provided geometry
+ */
+rt_raster
+rt_raster_gdal_rasterize(const unsigned char *wkb,
+	uint32_t wkb_len, const char *srs,
+	uint32_t num_bands, rt_pixtype *pixtype,
+	double *init, double *value,
+	double *nodata, uint8_t *hasnodata,
+	int *width, int *height,
+	double *scale_x, double *scale_y,
+	double *ul_xw, double *ul_yw,
+	double *grid_xw, double *grid_yw,
+	double *skew_x, double *skew_y,
+	char **options
+) {
+	rt_raster rast;
+	int i = 0;
+	int noband = 0;
+	int banderr = 0;
+	int *band_list = NULL;
 
-        /* Consistency checking (ptr is pixbytes-aligned) */
-        assert(!((ptr - ret) % pixbytes));
+	rt_pixtype *_pixtype = NULL;
+	double *_init = NULL;
+	double *_nodata = NULL;
+	uint8_t *_hasnodata = NULL;
+	double *_value = NULL;
 
-        /* Add nodata value */
-        switch (pixtype) {
-            case PT_1BB:
-            case PT_2BUI:
-            case PT_4BUI:
-            case PT_8BUI:
-            {
-                uint8_t v = band->nodataval;
-                *ptr = v;
-                ptr += 1;
-                break;
-            }
-            case PT_8BSI:
-            {
-                int8_t v = band->nodataval;
-                *ptr = v;
-                ptr += 1;
-                break;
-            }
-            case PT_16BSI:
-            case PT_16BUI:
-            {
-                uint16_t v = band->nodataval;
-                memcpy(ptr, &v, 2);
-                ptr += 2;
-                break;
-            }
-            case PT_32BSI:
-            case PT_32BUI:
-            {
-                uint32_t v = band->nodataval;
-                memcpy(ptr, &v, 4);
-                ptr += 4;
-                break;
-            }
-            case PT_32BF:
-            {
-                float v = band->nodataval;
-                memcpy(ptr, &v, 4);
-                ptr += 4;
-                break;
-            }
-            case PT_64BF:
-            {
-                memcpy(ptr, &band->nodataval, 8);
-                ptr += 8;
-                break;
-            }
-            default:
-                rterror("rt_raster_serialize: Fatal error caused by unknown pixel type. Aborting.");
-                abort(); /* shouldn't happen */
-                return 0;
-        }
+	double _scale_x = 0;
+	double _scale_y = 0;
+	int _width = 0;
+	int _height = 0;
+	double _skew_x = 0;
+	double _skew_y = 0;
 
-        /* Consistency checking (ptr is pixbytes-aligned) */
-        assert(!((ptr - ret) % pixbytes));
+	OGRErr ogrerr;
+	OGRSpatialReferenceH src_sr = NULL;
+	OGRGeometryH src_geom;
+	OGREnvelope src_env;
+	OGRwkbGeometryType wkbtype = wkbUnknown;
 
-#if POSTGIS_DEBUG_LEVEL > 2
-        d_print_binary_hex("nodata", dbg_ptr, size);
-#endif
+	int ul_user = 0;
+	double djunk = 0;
+	double grid_shift_xw = 0;
+	double grid_shift_yw = 0;
+	double grid_min_x = 0;
+	double grid_max_y = 0;
 
-        if (band->offline) {
-            /* Write band number */
-            *ptr = band->data.offline.bandNum;
-            ptr += 1;
+	CPLErr cplerr;
+	double dst_gt[6] = {0};
+	GDALDriverH dst_drv = NULL;
+	GDALDatasetH dst_ds = NULL;
+	GDALRasterBandH dst_band = NULL;
 
-            /* Write path */
-            strcpy((char*) ptr, band->data.offline.path);
-            ptr += strlen(band->data.offline.path) + 1;
-        } else {
-            /* Write data */
-            uint32_t datasize = raster->width * raster->height * pixbytes;
-            memcpy(ptr, band->data.mem, datasize);
-            ptr += datasize;
-        }
+	RASTER_DEBUG(3, "starting");
 
-#if POSTGIS_DEBUG_LEVEL > 2
-        d_print_binary_hex("BAND", dbg_ptr, size);
-#endif
+	assert(NULL != wkb);
+	assert(0 != wkb_len);
 
-        /* Pad up to 8-bytes boundary */
-        while ((uintptr_t) ptr % 8) {
-            *ptr = 0;
-            ++ptr;
+	/* internal aliases */
+	_pixtype = pixtype;
+	_init = init;
+	_nodata = nodata;
+	_hasnodata = hasnodata;
+	_value = value;
 
-            RASTER_DEBUGF(3, "PAD at %d", (uintptr_t) ptr % 8);
+	/* no bands, raster is a mask */
+	if (num_bands < 1) {
+		num_bands = 1;
+		noband = 1;
 
-        }
+		_pixtype = (rt_pixtype *) rtalloc(sizeof(rt_pixtype));
+		*_pixtype = PT_8BUI;
 
-        /* Consistency checking (ptr is pixbytes-aligned) */
-        assert(!((ptr - ret) % pixbytes));
+		_init = (double *) rtalloc(sizeof(double));
+		*_init = 0;
 
-    } /* for-loop over bands */
+		_nodata = (double *) rtalloc(sizeof(double));
+		*_nodata = 0;
 
-#if POSTGIS_DEBUG_LEVEL > 2
-    d_print_binary_hex("SERIALIZED RASTER", dbg_ptr, size);
-#endif
+		_hasnodata = (uint8_t *) rtalloc(sizeof(uint8_t));
+		*_hasnodata = 1;
 
-    return ret;
-}
+		_value = (double *) rtalloc(sizeof(double));
+		*_value = 1;
+	}
 
-rt_raster
-rt_raster_deserialize(void* serialized, int header_only) {
-    rt_raster rast = NULL;
-    const uint8_t *ptr = NULL;
-    const uint8_t *beg = NULL;
-    uint16_t i = 0;
-    uint8_t littleEndian = isMachineLittleEndian();
+	assert(NULL != _pixtype);
+	assert(NULL != _init);
+	assert(NULL != _nodata);
+	assert(NULL != _hasnodata);
 
+	/* OGR spatial reference */
+	if (NULL != srs && strlen(srs)) {
+		src_sr = OSRNewSpatialReference(NULL);
+		if (OSRSetFromUserInput(src_sr, srs) != OGRERR_NONE) {
+			rterror("rt_raster_gdal_rasterize: Unable to create OSR spatial reference");
 
+			if (noband) {
+				rtdealloc(_pixtype);
+				rtdealloc(_init);
+				rtdealloc(_nodata);
+				rtdealloc(_hasnodata);
+				rtdealloc(_value);
+			}
 
-    assert(NULL != serialized);
+			return NULL;
+		}
+	}
 
-    RASTER_DEBUG(2, "rt_raster_deserialize: Entering...");
+	/* convert WKB to OGR Geometry */
+	ogrerr = OGR_G_CreateFromWkb((unsigned char *) wkb, src_sr, &src_geom, wkb_len);
+	if (ogrerr != OGRERR_NONE) {
+		rterror("rt_raster_gdal_rasterize: Unable to create OGR Geometry from WKB");
 
-    /* NOTE: Value of rt_raster.size may be different
-     * than actual size of raster data being read.
-     * See note on SET_VARSIZE in rt_raster_serialize function above.
-     */
+		if (noband) {
+			rtdealloc(_pixtype);
+			rtdealloc(_init);
+			rtdealloc(_nodata);
+			rtdealloc(_hasnodata);
+			rtdealloc(_value);
+		}
 
-    /* Allocate memory for deserialized raster header */
+		OSRDestroySpatialReference(src_sr);
+		OGRCleanupAll();
 
-    RASTER_DEBUG(3, "rt_raster_deserialize: Allocating memory for deserialized raster header");
-    rast = (rt_raster) rtalloc(sizeof (struct rt_raster_t));
-    if (!rast) {
-        rterror("rt_raster_deserialize: Out of memory allocating raster for deserialization");
-        return 0;
-    }
+		return NULL;
+	}
 
-    /* Deserialize raster header */
-    RASTER_DEBUG(3, "rt_raster_deserialize: Deserialize raster header");
-    memcpy(rast, serialized, sizeof (struct rt_raster_serialized_t));
+	/* get extent */
+	OGR_G_GetEnvelope(src_geom, &src_env);
 
-    if (0 == rast->numBands || header_only) {
-        rast->bands = 0;
-        return rast;
-    }
-    beg = (const uint8_t*) serialized;
+	RASTER_DEBUGF(3, "Suggested extent: %f, %f, %f, %f",
+		src_env.MinX, src_env.MaxY, src_env.MaxX, src_env.MinY);
 
-    RASTER_DEBUG(3, "rt_raster_deserialize: Allocating memory for bands");
-    /* Allocate registry of raster bands */
-    rast->bands = rtalloc(rast->numBands * sizeof (rt_band));
+	/* user-defined scale */
+	if (
+		(NULL != scale_x) &&
+		(NULL != scale_y) &&
+		(FLT_NEQ(*scale_x, 0.0)) &&
+		(FLT_NEQ(*scale_y, 0.0))
+	) {
+		_scale_x = fabs(*scale_x);
+		_scale_y = fabs(*scale_y);
+	}
+	else if (
+		(NULL != width) &&
+		(NULL != height) &&
+		(FLT_NEQ(*width, 0.0)) &&
+		(FLT_NEQ(*height, 0.0))
+	) {
+		_width = fabs(*width);
+		_height = fabs(*height);
 
-    RASTER_DEBUGF(3, "rt_raster_deserialize: %d bands", rast->numBands);
+		_scale_x = (src_env.MaxX - src_env.MinX) / _width;
+		_scale_y = (src_env.MaxY - src_env.MinY) / _height;
+	}
+	else {
+		rterror("rt_raster_gdal_rasterize: Values must be provided for width and height or X and Y of scale");
 
-    /* Move to the beginning of first band */
-    ptr = beg;
-    ptr += sizeof (struct rt_raster_serialized_t);
+		if (noband) {
+			rtdealloc(_pixtype);
+			rtdealloc(_init);
+			rtdealloc(_nodata);
+			rtdealloc(_hasnodata);
+			rtdealloc(_value);
+		}
 
-    /* Deserialize bands now */
-    for (i = 0; i < rast->numBands; ++i) {
-        rt_band band = NULL;
-        uint8_t type = 0;
-        int pixbytes = 0;
+		OGR_G_DestroyGeometry(src_geom);
+		OSRDestroySpatialReference(src_sr);
+		OGRCleanupAll();
 
-        band = rtalloc(sizeof (struct rt_band_t));
-        if (!band) {
-            rterror("rt_raster_deserialize: Out of memory allocating rt_band during deserialization");
-            return 0;
-        }
+		return NULL;
+	}
+	RASTER_DEBUGF(3, "scale (x, y) = %f, %f", _scale_x, _scale_y);
+	RASTER_DEBUGF(3, "dim (x, y) = %d, %d", _width, _height);
 
-        rast->bands[i] = band;
+	/*
+	 	if geometry is a point, a linestring or set of either and bounds not set,
+		increase extent by a pixel to avoid missing points on border
 
-        type = *ptr;
-        ptr++;
-        band->pixtype = type & BANDTYPE_PIXTYPE_MASK;
+		a whole pixel is used instead of half-pixel due to backward
+		compatibility with GDAL 1.6, 1.7 and 1.8.  1.9+ works fine with half-pixel.
+	*/
+	wkbtype = wkbFlatten(OGR_G_GetGeometryType(src_geom));
+	if ((
+			(wkbtype == wkbPoint) ||
+			(wkbtype == wkbMultiPoint) ||
+			(wkbtype == wkbLineString) ||
+			(wkbtype == wkbMultiLineString)
+		) &&
+		FLT_EQ(_width, 0) &&
+		FLT_EQ(_height, 0)
+	) {
 
-        RASTER_DEBUGF(3, "rt_raster_deserialize: band %d with pixel type %s", i, rt_pixtype_name(band->pixtype));
+#if POSTGIS_GDAL_VERSION > 18
+		RASTER_DEBUG(3, "Adjusting extent for GDAL > 1.8 by half the scale");
+		src_env.MinX -= (_scale_x / 2.);
+		src_env.MaxX += (_scale_x / 2.);
+		src_env.MinY -= (_scale_y / 2.);
+		src_env.MaxY += (_scale_y / 2.);
+#else
+		RASTER_DEBUG(3, "Adjusting extent for GDAL <= 1.8 by the scale");
+		src_env.MinX -= _scale_x;
+		src_env.MaxX += _scale_x;
+		src_env.MinY -= _scale_y;
+		src_env.MaxY += _scale_y;
+#endif
 
-        band->offline = BANDTYPE_IS_OFFDB(type) ? 1 : 0;
-        band->hasnodata = BANDTYPE_HAS_NODATA(type) ? 1 : 0;
-        band->isnodata = BANDTYPE_IS_NODATA(type) ? 1 : 0;
-        band->width = rast->width;
-        band->height = rast->height;
-        band->ownsData = 0;
-				band->raster = rast;
+	}
 
-        /* Advance by data padding */
-        pixbytes = rt_pixtype_size(band->pixtype);
-        ptr += pixbytes - 1;
+	/* user-defined skew */
+	if (NULL != skew_x)
+		_skew_x = *skew_x;
+	if (NULL != skew_y)
+		_skew_y = *skew_y;
 
-        /* Read nodata value */
-        switch (band->pixtype) {
-            case PT_1BB:
-            {
-                band->nodataval = ((int) read_uint8(&ptr)) & 0x01;
-                break;
-            }
-            case PT_2BUI:
-            {
-                band->nodataval = ((int) read_uint8(&ptr)) & 0x03;
-                break;
-            }
-            case PT_4BUI:
-            {
-                band->nodataval = ((int) read_uint8(&ptr)) & 0x0F;
-                break;
-            }
-            case PT_8BSI:
-            {
-                band->nodataval = read_int8(&ptr);
-                break;
-            }
-            case PT_8BUI:
-            {
-                band->nodataval = read_uint8(&ptr);
-                break;
-            }
-            case PT_16BSI:
-            {
-                band->nodataval = read_int16(&ptr, littleEndian);
-                break;
-            }
-            case PT_16BUI:
-            {
-                band->nodataval = read_uint16(&ptr, littleEndian);
-                break;
-            }
-            case PT_32BSI:
-            {
-                band->nodataval = read_int32(&ptr, littleEndian);
-                break;
-            }
-            case PT_32BUI:
-            {
-                band->nodataval = read_uint32(&ptr, littleEndian);
-                break;
-            }
-            case PT_32BF:
-            {
-                band->nodataval = read_float32(&ptr, littleEndian);
-                break;
-            }
-            case PT_64BF:
-            {
-                band->nodataval = read_float64(&ptr, littleEndian);
-                break;
-            }
-            default:
-            {
-                rterror("rt_raster_deserialize: Unknown pixeltype %d", band->pixtype);
-                rtdealloc(band);
-                rtdealloc(rast);
-                return 0;
-            }
-        }
+	/* user-specified upper-left corner */
+	if (
+		NULL != ul_xw &&
+		NULL != ul_yw
+	) {
+		src_env.MinX = *ul_xw;
+		src_env.MaxY = *ul_yw;
+		ul_user = 1;
+	}
+	else if (
+		((NULL != ul_xw) && (NULL == ul_yw)) ||
+		((NULL == ul_xw) && (NULL != ul_yw))
+	) {
+		rterror("rt_raster_gdal_rasterize: Both X and Y upper-left corner values must be provided");
 
-        RASTER_DEBUGF(3, "rt_raster_deserialize: has nodata flag %d", band->hasnodata);
-        RASTER_DEBUGF(3, "rt_raster_deserialize: nodata value %g", band->nodataval);
+		if (noband) {
+			rtdealloc(_pixtype);
+			rtdealloc(_init);
+			rtdealloc(_nodata);
+			rtdealloc(_hasnodata);
+			rtdealloc(_value);
+		}
 
-        /* Consistency checking (ptr is pixbytes-aligned) */
-        assert(!((ptr - beg) % pixbytes));
+		OGR_G_DestroyGeometry(src_geom);
+		OSRDestroySpatialReference(src_sr);
+		OGRCleanupAll();
 
-        if (band->offline) {
-            /* Read band number */
-            band->data.offline.bandNum = *ptr;
-            ptr += 1;
+		return NULL;
+	}
 
-            /* Register path */
-            band->data.offline.path = (char*) ptr;
-            ptr += strlen(band->data.offline.path) + 1;
+	/* alignment only considered if upper-left corner not provided */
+	if (
+		!ul_user && (
+			(NULL != grid_xw) || (NULL != grid_yw)
+		)
+	) {
+		if (
+			((NULL != grid_xw) && (NULL == grid_yw)) ||
+			((NULL == grid_xw) && (NULL != grid_yw))
+		) {
+			rterror("rt_raster_gdal_rasterize: Both X and Y alignment values must be provided");
 
-						band->data.offline.mem = NULL;
-        } else {
-            /* Register data */
-            const uint32_t datasize = rast->width * rast->height * pixbytes;
-            band->data.mem = (uint8_t*) ptr;
-            ptr += datasize;
-        }
+			if (noband) {
+				rtdealloc(_pixtype);
+				rtdealloc(_init);
+				rtdealloc(_nodata);
+				rtdealloc(_hasnodata);
+				rtdealloc(_value);
+			}
 
-        /* Skip bytes of padding up to 8-bytes boundary */
-#if POSTGIS_DEBUG_LEVEL > 0
-        const uint8_t *padbeg = ptr;
-#endif
-        while (0 != ((ptr - beg) % 8)){
-            ++ptr;
-        }
+			OGR_G_DestroyGeometry(src_geom);
+			OSRDestroySpatialReference(src_sr);
+			OGRCleanupAll();
 
-        RASTER_DEBUGF(3, "rt_raster_deserialize: skip %d bytes of 8-bytes boundary padding", ptr - padbeg);
+			return NULL;
+		}
 
-        /* Consistency checking (ptr is pixbytes-aligned) */
-        assert(!((ptr - beg) % pixbytes));
-    }
+		/* grid shift of upper left to match alignment grid */
+		grid_shift_xw = _scale_x * modf(fabs(*grid_xw - src_env.MinX) / _scale_x, &djunk);
+		grid_shift_yw = _scale_y * modf(fabs(*grid_yw - src_env.MaxY) / _scale_y, &djunk);
 
-    return rast;
-}
+		/* shift along X axis for upper left */
+		if (FLT_NEQ(grid_shift_xw, 0.) && FLT_NEQ(grid_shift_xw, _scale_x)) {
+			grid_min_x = src_env.MinX - grid_shift_xw;
+			grid_min_x = modf(fabs(*grid_xw - grid_min_x) / _scale_x, &djunk);
+			if (FLT_NEQ(grid_min_x, 0.) && FLT_NEQ(grid_min_x, 1.))
+				grid_shift_xw = _scale_x - grid_shift_xw;
+			grid_min_x = src_env.MinX - grid_shift_xw;
 
-/**
- * Return TRUE if the raster is empty. i.e. is NULL, width = 0 or height = 0
- *
- * @param raster: the raster to get info from
- *
- * @return TRUE if the raster is empty, FALSE otherwise
- */
-int
-rt_raster_is_empty(rt_raster raster) {
-	return (NULL == raster || raster->height <= 0 || raster->width <= 0);
-}
+			src_env.MinX = grid_min_x;
+			ul_user = 1;
+		}
 
-/**
- * Return TRUE if the raster do not have a band of this number.
- *
- * @param raster: the raster to get info from
- * @param nband: the band number. 0-based
- *
- * @return TRUE if the raster do not have a band of this number, FALSE otherwise
- */
-int
-rt_raster_has_no_band(rt_raster raster, int nband) {
-	return (NULL == raster || nband >= raster->numBands || nband < 0);
-}
+		/* shift along Y axis for upper left */
+		if (FLT_NEQ(grid_shift_yw, 0.) && FLT_NEQ(grid_shift_yw, _scale_y)) {
+			grid_max_y = src_env.MaxY + grid_shift_yw;
+			grid_max_y = modf(fabs(*grid_yw - grid_max_y) / _scale_y, &djunk);
+			if (FLT_NEQ(grid_max_y, 0.) && FLT_NEQ(grid_max_y, 1.))
+				grid_shift_yw = _scale_y - fabs(grid_shift_yw);
+			grid_max_y = src_env.MaxY + grid_shift_yw;
 
-/**
- * Copy one band from one raster to another.  Bands are duplicated from
- * fromrast to torast using rt_band_duplicate.  The caller will need
- * to ensure that the copied band's data or path remains allocated
- * for the lifetime of the copied bands.
- *
- * @param torast: raster to copy band to
- * @param fromrast: raster to copy band from
- * @param fromindex: index of band in source raster, 0-based
- * @param toindex: index of new band in destination raster, 0-based
- *
- * @return The band index of the second raster where the new band is copied.
- */
-int32_t
-rt_raster_copy_band(
-	rt_raster torast, rt_raster fromrast,
-	int fromindex, int toindex
-) {
-	rt_band srcband = NULL;
-	rt_band dstband = NULL;
+			src_env.MaxY = grid_max_y;
+			ul_user = 1;
+		}
 
-	assert(NULL != torast);
-	assert(NULL != fromrast);
+		if (ul_user) {
+			_width = (int) fmax((fabs(src_env.MaxX - src_env.MinX) + (_scale_x / 2.)) / _scale_x, 1);
+			_height = (int) fmax((fabs(src_env.MaxY - src_env.MinY) + (_scale_y / 2.)) / _scale_y, 1);
+		}
 
-	/* Check raster dimensions */
-	if (torast->height != fromrast->height || torast->width != fromrast->width) {
-		rtwarn("rt_raster_copy_band: Attempting to add a band with different width or height");
-		return -1;
+		RASTER_DEBUGF(3, "shift is: %f, %f", grid_shift_xw, grid_shift_yw);
+		RASTER_DEBUGF(3, "new ul is: %f, %f", grid_min_x, grid_max_y);
 	}
 
-	/* Check bands limits */
-	if (fromrast->numBands < 1) {
-		rtwarn("rt_raster_copy_band: Second raster has no band");
-		return -1;
-	}
-	else if (fromindex < 0) {
-		rtwarn("rt_raster_copy_band: Band index for second raster < 0. Defaulted to 0");
-		fromindex = 0;
+	/* raster dimensions */
+	if (!_width)
+		_width = (int) fmax((fabs(src_env.MaxX - src_env.MinX) + (_scale_x / 2.)) / _scale_x, 1);
+	if (!_height)
+		_height = (int) fmax((fabs(src_env.MaxY - src_env.MinY) + (_scale_y / 2.)) / _scale_y, 1);
+
+	/* specify geotransform */
+	dst_gt[0] = src_env.MinX;
+	dst_gt[1] = _scale_x;
+	dst_gt[2] = _skew_x;
+	dst_gt[3] = src_env.MaxY;
+	dst_gt[4] = _skew_y;
+	dst_gt[5] = -1 * _scale_y;
+
+	/* user provided negative scale-x */
+	if (
+		(NULL != scale_x) &&
+		(*scale_x < 0.)
+	) {
+		dst_gt[0] = src_env.MaxX;
+		dst_gt[1] = *scale_x;
 	}
-	else if (fromindex >= fromrast->numBands) {
-		rtwarn("rt_raster_copy_band: Band index for second raster > number of bands, truncated from %u to %u", fromindex, fromrast->numBands - 1);
-		fromindex = fromrast->numBands - 1;
+	/* user provided positive scale-y */
+	if (
+		(NULL != scale_y) &&
+		(*scale_y > 0)
+	) {
+		dst_gt[3] = src_env.MinY;
+		dst_gt[5] = *scale_y;
 	}
 
-	if (toindex < 0) {
-		rtwarn("rt_raster_copy_band: Band index for first raster < 0. Defaulted to 0");
-		toindex = 0;
-	}
-	else if (toindex > torast->numBands) {
-		rtwarn("rt_raster_copy_band: Band index for first raster > number of bands, truncated from %u to %u", toindex, torast->numBands);
-		toindex = torast->numBands;
+	RASTER_DEBUGF(3, "Applied extent: %f, %f, %f, %f",
+		src_env.MinX, src_env.MaxY, src_env.MaxX, src_env.MinY);
+	RASTER_DEBUGF(3, "Applied geotransform: %f, %f, %f, %f, %f, %f",
+		dst_gt[0], dst_gt[1], dst_gt[2], dst_gt[3], dst_gt[4], dst_gt[5]);
+	RASTER_DEBUGF(3, "Raster dimensions (width x height): %d x %d",
+		_width, _height);
+
+	/* load GDAL mem */
+	if (!rt_util_gdal_driver_registered("MEM"))
+		GDALRegister_MEM();
+	dst_drv = GDALGetDriverByName("MEM");
+	if (NULL == dst_drv) {
+		rterror("rt_raster_gdal_rasterize: Unable to load the MEM GDAL driver");
+
+		if (noband) {
+			rtdealloc(_pixtype);
+			rtdealloc(_init);
+			rtdealloc(_nodata);
+			rtdealloc(_hasnodata);
+			rtdealloc(_value);
+		}
+
+		OGR_G_DestroyGeometry(src_geom);
+		OSRDestroySpatialReference(src_sr);
+		OGRCleanupAll();
+
+		return NULL;
 	}
 
-	/* Get band from source raster */
-	srcband = rt_raster_get_band(fromrast, fromindex);
+	dst_ds = GDALCreate(dst_drv, "", _width, _height, 0, GDT_Byte, NULL);
+	if (NULL == dst_ds) {
+		rterror("rt_raster_gdal_rasterize: Could not create a GDALDataset to rasterize the geometry into");
 
-	/* duplicate band */
-	dstband = rt_band_duplicate(srcband);
+		if (noband) {
+			rtdealloc(_pixtype);
+			rtdealloc(_init);
+			rtdealloc(_nodata);
+			rtdealloc(_hasnodata);
+			rtdealloc(_value);
+		}
 
-	/* Add band to the second raster */
-	return rt_raster_add_band(torast, dstband, toindex);
-}
+		OGR_G_DestroyGeometry(src_geom);
+		OSRDestroySpatialReference(src_sr);
+		OGRCleanupAll();
 
-/**
- * Construct a new rt_raster from an existing rt_raster and an array
- * of band numbers
- *
- * @param raster : the source raster
- * @param bandNums : array of band numbers to extract from source raster
- *                   and add to the new raster (0 based)
- * @param count : number of elements in bandNums
- *
- * @return a new rt_raster or 0 on error
- */
-rt_raster
-rt_raster_from_band(rt_raster raster, uint32_t *bandNums, int count) {
-	rt_raster rast = NULL;
-	int i = 0;
-	int idx;
-	int32_t flag;
-	double gt[6] = {0.};
+		return NULL;
+	}
+
+	/* set geotransform */
+	cplerr = GDALSetGeoTransform(dst_ds, dst_gt);
+	if (cplerr != CE_None) {
+		rterror("rt_raster_gdal_rasterize: Could not set geotransform on GDALDataset");
 
-	assert(NULL != raster);
-	assert(NULL != bandNums);
+		if (noband) {
+			rtdealloc(_pixtype);
+			rtdealloc(_init);
+			rtdealloc(_nodata);
+			rtdealloc(_hasnodata);
+			rtdealloc(_value);
+		}
 
-	RASTER_DEBUGF(3, "rt_raster_from_band: source raster has %d bands",
-		rt_raster_get_num_bands(raster));
+		OGR_G_DestroyGeometry(src_geom);
+		OSRDestroySpatialReference(src_sr);
+		OGRCleanupAll();
 
-	/* create new raster */
-	rast = rt_raster_new(raster->width, raster->height);
-	if (NULL == rast) {
-		rterror("rt_raster_from_band: Out of memory allocating new raster");
-		return 0;
+		GDALClose(dst_ds);
+
+		return NULL;
 	}
 
-	/* copy raster attributes */
-	rt_raster_get_geotransform_matrix(raster, gt);
-	rt_raster_set_geotransform_matrix(rast, gt);
+	/* set SRS */
+	if (NULL != src_sr) {
+		cplerr = GDALSetProjection(dst_ds, srs);
+		if (cplerr != CE_None) {
+			rterror("rt_raster_gdal_rasterize: Could not set projection on GDALDataset");
 
-	/* srid */
-	rt_raster_set_srid(rast, raster->srid);
+			if (noband) {
+				rtdealloc(_pixtype);
+				rtdealloc(_init);
+				rtdealloc(_nodata);
+				rtdealloc(_hasnodata);
+				rtdealloc(_value);
+			}
 
-	/* copy bands */
-	for (i = 0; i < count; i++) {
-		idx = bandNums[i];
-		flag = rt_raster_copy_band(rast, raster, idx, i);
+			OGR_G_DestroyGeometry(src_geom);
+			OSRDestroySpatialReference(src_sr);
+			OGRCleanupAll();
+
+			GDALClose(dst_ds);
 
-		if (flag < 0) {
-			rterror("rt_raster_from_band: Unable to copy band");
-			rt_raster_destroy(rast);
 			return NULL;
 		}
-
-		RASTER_DEBUGF(3, "rt_raster_from_band: band created at index %d",
-			flag);
 	}
 
-	RASTER_DEBUGF(3, "rt_raster_from_band: new raster has %d bands",
-		rt_raster_get_num_bands(rast));
-	return rast;
-}
+	/* set bands */
+	for (i = 0; i < num_bands; i++) {
+		banderr = 0;
 
-/**
- * Replace band at provided index with new band
- *
- * @param raster: raster of band to be replaced
- * @param band : new band to add to raster
- * @param index : index of band to replace (0-based)
- *
- * @return 0 on error or replaced band
- */
-rt_band
-rt_raster_replace_band(rt_raster raster, rt_band band, int index) {
-	rt_band oldband = NULL;
-	assert(NULL != raster);
+		do {
+			/* add band */
+			cplerr = GDALAddBand(dst_ds, rt_util_pixtype_to_gdal_datatype(_pixtype[i]), NULL);
+			if (cplerr != CE_None) {
+				rterror("rt_raster_gdal_rasterize: Unable to add band to GDALDataset");
+				banderr = 1;
+				break;
+			}
 
-	if (band->width != raster->width || band->height != raster->height) {
-		rterror("rt_raster_replace_band: Band does not match raster's dimensions: %dx%d band to %dx%d raster",
-			band->width, band->height, raster->width, raster->height);
-		return 0;
-	}
+			dst_band = GDALGetRasterBand(dst_ds, i + 1);
+			if (NULL == dst_band) {
+				rterror("rt_raster_gdal_rasterize: Unable to get band %d from GDALDataset", i + 1);
+				banderr = 1;
+				break;
+			}
 
-	if (index >= raster->numBands || index < 0) {
-		rterror("rt_raster_replace_band: Band index is not valid");
-		return 0;
-	}
+			/* nodata value */
+			if (_hasnodata[i]) {
+				cplerr = GDALSetRasterNoDataValue(dst_band, _nodata[i]);
+				if (cplerr != CE_None) {
+					rterror("rt_raster_gdal_rasterize: Unable to set nodata value");
+					banderr = 1;
+					break;
+				}
+			}
 
-	oldband = rt_raster_get_band(raster, index);
-	RASTER_DEBUGF(3, "rt_raster_replace_band: old band at %p", oldband);
-	RASTER_DEBUGF(3, "rt_raster_replace_band: new band at %p", band);
+			/* initial value */
+			cplerr = GDALFillRaster(dst_band, _init[i], 0);
+			if (cplerr != CE_None) {
+				rterror("rt_raster_gdal_rasterize: Unable to set initial value");
+				banderr = 1;
+				break;
+			}
+		}
+		while (0);
 
-	raster->bands[index] = band;
-	RASTER_DEBUGF(3, "rt_raster_replace_band: new band at %p", raster->bands[index]);
+		if (banderr) {
+			if (noband) {
+				rtdealloc(_pixtype);
+				rtdealloc(_init);
+				rtdealloc(_nodata);
+				rtdealloc(_hasnodata);
+				rtdealloc(_value);
+			}
 
-	band->raster = raster;
+			OGR_G_DestroyGeometry(src_geom);
+			OSRDestroySpatialReference(src_sr);
+			OGRCleanupAll();
 
-	return oldband;
-}
+			GDALClose(dst_ds);
 
-/**
- * Return formatted GDAL raster from raster
- *
- * @param raster : the raster to convert
- * @param srs : the raster's coordinate system in OGC WKT
- * @param format : format to convert to. GDAL driver short name
- * @param options : list of format creation options. array of strings
- * @param gdalsize : will be set to the size of returned bytea
- *
- * @return formatted GDAL raster.  the calling function is responsible
- *   for freeing the returned data using CPLFree()
- */
-uint8_t*
-rt_raster_to_gdal(rt_raster raster, const char *srs,
-	char *format, char **options, uint64_t *gdalsize) {
-	GDALDriverH src_drv = NULL;
-	GDALDatasetH src_ds = NULL;
+			return NULL;
+		}
+	}
 
-	vsi_l_offset rtn_lenvsi;
-	uint64_t rtn_len = 0;
+	band_list = (int *) rtalloc(sizeof(int) * num_bands);
+	for (i = 0; i < num_bands; i++) band_list[i] = i + 1;
 
-	GDALDriverH rtn_drv = NULL;
-	GDALDatasetH rtn_ds = NULL;
-	uint8_t *rtn = NULL;
+	/* burn geometry */
+	cplerr = GDALRasterizeGeometries(
+		dst_ds,
+		num_bands, band_list,
+		1, &src_geom,
+		NULL, NULL,
+		_value,
+		options,
+		NULL, NULL
+	);
+	rtdealloc(band_list);
+	if (cplerr != CE_None) {
+		rterror("rt_raster_gdal_rasterize: Unable to rasterize geometry");
 
-	assert(NULL != raster);
+		if (noband) {
+			rtdealloc(_pixtype);
+			rtdealloc(_init);
+			rtdealloc(_nodata);
+			rtdealloc(_hasnodata);
+			rtdealloc(_value);
+		}
 
-	/* any supported format is possible */
-	GDALAllRegister();
-	RASTER_DEBUG(3, "rt_raster_to_gdal: loaded all supported GDAL formats");
+		OGR_G_DestroyGeometry(src_geom);
+		OSRDestroySpatialReference(src_sr);
+		OGRCleanupAll();
 
-	/* output format not specified */
-	if (format == NULL || !strlen(format))
-		format = "GTiff";
-	RASTER_DEBUGF(3, "rt_raster_to_gdal: output format is %s", format);
+		GDALClose(dst_ds);
 
-	/* load raster into a GDAL MEM raster */
-	src_ds = rt_raster_to_gdal_mem(raster, srs, NULL, 0, &src_drv);
-	if (NULL == src_ds) {
-		rterror("rt_raster_to_gdal: Unable to convert raster to GDAL MEM format");
-		return 0;
+		return NULL;
 	}
 
-	/* load driver */
-	rtn_drv = GDALGetDriverByName(format);
-	if (NULL == rtn_drv) {
-		rterror("rt_raster_to_gdal: Unable to load the output GDAL driver");
-		GDALClose(src_ds);
-		return 0;
-	}
-	RASTER_DEBUG(3, "rt_raster_to_gdal: Output driver loaded");
+	/* convert gdal dataset to raster */
+	GDALFlushCache(dst_ds);
+	RASTER_DEBUG(3, "Converting GDAL dataset to raster");
+	rast = rt_raster_from_gdal_dataset(dst_ds);
 
-	/* convert GDAL MEM raster to output format */
-	RASTER_DEBUG(3, "rt_raster_to_gdal: Copying GDAL MEM raster to memory file in output format");
-	rtn_ds = GDALCreateCopy(
-		rtn_drv,
-		"/vsimem/out.dat", /* should be fine assuming this is in a process */
-		src_ds,
-		FALSE, /* should copy be strictly equivelent? */
-		options, /* format options */
-		NULL, /* progress function */
-		NULL /* progress data */
-	);
-	if (NULL == rtn_ds) {
-		rterror("rt_raster_to_gdal: Unable to create the output GDAL dataset");
-		GDALClose(src_ds);
-		return 0;
+	if (noband) {
+		rtdealloc(_pixtype);
+		rtdealloc(_init);
+		rtdealloc(_nodata);
+		rtdealloc(_hasnodata);
+		rtdealloc(_value);
 	}
 
-	/* close source dataset */
-	GDALClose(src_ds);
-	RASTER_DEBUG(3, "rt_raster_to_gdal: Closed GDAL MEM raster");
-
-	/* close dataset, this also flushes any pending writes */
-	GDALClose(rtn_ds);
-	RASTER_DEBUG(3, "rt_raster_to_gdal: Closed GDAL output raster");
-
-	RASTER_DEBUG(3, "rt_raster_to_gdal: Done copying GDAL MEM raster to memory file in output format");
+	OGR_G_DestroyGeometry(src_geom);
+	OSRDestroySpatialReference(src_sr);
+	OGRCleanupAll();
 
-	/* from memory file to buffer */
-	RASTER_DEBUG(3, "rt_raster_to_gdal: Copying GDAL memory file to buffer");
-	rtn = VSIGetMemFileBuffer("/vsimem/out.dat", &rtn_lenvsi, TRUE);
-	RASTER_DEBUG(3, "rt_raster_to_gdal: Done copying GDAL memory file to buffer");
-	if (NULL == rtn) {
-		rterror("rt_raster_to_gdal: Unable to create the output GDAL raster");
-		return 0;
+	GDALClose(dst_ds);
+
+	if (NULL == rast) {
+		rterror("rt_raster_gdal_rasterize: Unable to rasterize geometry");
+		return NULL;
 	}
 
-	rtn_len = (uint64_t) rtn_lenvsi;
-	*gdalsize = rtn_len;
+	RASTER_DEBUG(3, "done");
 
-	return rtn;
+	return rast;
 }
 
-/**
- * Returns a set of available GDAL drivers
- *
- * @param drv_count : number of GDAL drivers available
- * @param cancc : if non-zero, filter drivers to only those
- *   with support for CreateCopy and VirtualIO
- *
- * @return set of "gdaldriver" values of available GDAL drivers
- */
-rt_gdaldriver
-rt_raster_gdal_drivers(uint32_t *drv_count, uint8_t cancc) {
-	const char *state;
-	const char *txt;
-	int txt_len;
-	GDALDriverH *drv = NULL;
-	rt_gdaldriver rtn = NULL;
-	int count;
+static
+int rt_raster_intersects_algorithm(
+	rt_raster rast1, rt_raster rast2,
+	rt_band band1, rt_band band2,
+	int hasnodata1, int hasnodata2,
+	double nodata1, double nodata2
+) {
 	int i;
-	uint32_t j;
+	int byHeight = 1;
+	uint32_t dimValue;
 
-	GDALAllRegister();
-	count = GDALGetDriverCount();
-	rtn = (rt_gdaldriver) rtalloc(count * sizeof(struct rt_gdaldriver_t));
-	if (NULL == rtn) {
-		rterror("rt_raster_gdal_drivers: Unable to allocate memory for gdaldriver structure");
-		return 0;
-	}
+	uint32_t row;
+	uint32_t rowoffset;
+	uint32_t col;
+	uint32_t coloffset;
 
-	for (i = 0, j = 0; i < count; i++) {
-		drv = GDALGetDriver(i);
+	enum line_points {X1, Y1, X2, Y2};
+	enum point {pX, pY};
+	double line1[4];
+	double line2[4];
+	double P[2];
+	double Qw[2];
+	double Qr[2];
+	double gt1[6] = {0.0};
+	double gt2[6] = {0.0};
+	double igt1[6] = {0};
+	double igt2[6] = {0};
+	double d;
+	double val1;
+	int noval1;
+	double val2;
+	int noval2;
+	uint32_t adjacent[8] = {0};
 
-		if (cancc) {
-			/* CreateCopy support */
-			state = GDALGetMetadataItem(drv, GDAL_DCAP_CREATECOPY, NULL);
-			if (state == NULL) continue;
+	double xscale;
+	double yscale;
 
-			/* VirtualIO support */
-			state = GDALGetMetadataItem(drv, GDAL_DCAP_VIRTUALIO, NULL);
-			if (state == NULL) continue;
-		}
+	uint16_t width1;
+	uint16_t height1;
+	uint16_t width2;
+	uint16_t height2;
 
-		/* index of driver */
-		rtn[j].idx = i;
+	width1 = rt_raster_get_width(rast1);
+	height1 = rt_raster_get_height(rast1);
+	width2 = rt_raster_get_width(rast2);
+	height2 = rt_raster_get_height(rast2);
 
-		/* short name */
-		txt = GDALGetDriverShortName(drv);
-		txt_len = strlen(txt);
+	/* sampling scale */
+	xscale = fmin(rt_raster_get_x_scale(rast1), rt_raster_get_x_scale(rast2)) / 10.;
+	yscale = fmin(rt_raster_get_y_scale(rast1), rt_raster_get_y_scale(rast2)) / 10.;
 
-		if (cancc) {
-			RASTER_DEBUGF(3, "rt_raster_gdal_driver: driver %s (%d) supports CreateCopy() and VirtualIO()", txt, i);
-		}
+	/* see if skew made rast2's rows are parallel to rast1's cols */
+	rt_raster_cell_to_geopoint(
+		rast1,
+		0, 0,
+		&(line1[X1]), &(line1[Y1]),
+		gt1
+	);
 
-		txt_len = (txt_len + 1) * sizeof(char);
-		rtn[j].short_name = (char *) rtalloc(txt_len);
-		memcpy(rtn[j].short_name, txt, txt_len);
+	rt_raster_cell_to_geopoint(
+		rast1,
+		0, height1,
+		&(line1[X2]), &(line1[Y2]),
+		gt1
+	);
 
-		/* long name */
-		txt = GDALGetDriverLongName(drv);
-		txt_len = strlen(txt);
+	rt_raster_cell_to_geopoint(
+		rast2,
+		0, 0,
+		&(line2[X1]), &(line2[Y1]),
+		gt2
+	);
 
-		txt_len = (txt_len + 1) * sizeof(char);
-		rtn[j].long_name = (char *) rtalloc(txt_len);
-		memcpy(rtn[j].long_name, txt, txt_len);
+	rt_raster_cell_to_geopoint(
+		rast2,
+		width2, 0,
+		&(line2[X2]), &(line2[Y2]),
+		gt2
+	);
 
-		/* creation options */
-		txt = GDALGetDriverCreationOptionList(drv);
-		txt_len = strlen(txt);
+	/* parallel vertically */
+	if (FLT_EQ(line1[X2] - line1[X1], 0.) && FLT_EQ(line2[X2] - line2[X1], 0.))
+		byHeight = 0;
+	/* parallel */
+	else if (FLT_EQ(((line1[Y2] - line1[Y1]) / (line1[X2] - line1[X1])), ((line2[Y2] - line2[Y1]) / (line2[X2] - line2[X1]))))
+		byHeight = 0;
 
-		txt_len = (txt_len + 1) * sizeof(char);
-		rtn[j].create_options = (char *) rtalloc(txt_len);
-		memcpy(rtn[j].create_options, txt, txt_len);
+	if (byHeight)
+		dimValue = height2;
+	else
+		dimValue = width2;
+	RASTER_DEBUGF(4, "byHeight: %d, dimValue: %d", byHeight, dimValue);
 
-		j++;
-	}
+	/* 3 x 3 search */
+	for (coloffset = 0; coloffset < 3; coloffset++) {
+		for (rowoffset = 0; rowoffset < 3; rowoffset++) {
+			/* smaller raster */
+			for (col = coloffset; col <= width1; col += 3) {
 
-	/* free unused memory */
-	rtn = rtrealloc(rtn, j * sizeof(struct rt_gdaldriver_t));
-	*drv_count = j;
+				rt_raster_cell_to_geopoint(
+					rast1,
+					col, 0,
+					&(line1[X1]), &(line1[Y1]),
+					gt1
+				);
 
-	return rtn;
-}
+				rt_raster_cell_to_geopoint(
+					rast1,
+					col, height1,
+					&(line1[X2]), &(line1[Y2]),
+					gt1
+				);
 
-/**
- * Return GDAL dataset using GDAL MEM driver from raster
- *
- * @param raster : raster to convert to GDAL MEM
- * @param srs : the raster's coordinate system in OGC WKT
- * @param bandNums : array of band numbers to extract from raster
- *                   and include in the GDAL dataset (0 based)
- * @param count : number of elements in bandNums
- * @param rtn_drv : is set to the GDAL driver object
- *
- * @return GDAL dataset using GDAL MEM driver
- */
-GDALDatasetH
-rt_raster_to_gdal_mem(rt_raster raster, const char *srs,
-	uint32_t *bandNums, int count, GDALDriverH *rtn_drv) {
-	GDALDriverH drv = NULL;
-	GDALDatasetH ds = NULL;
-	double gt[6] = {0.0};
-	CPLErr cplerr;
-	GDALDataType gdal_pt = GDT_Unknown;
-	GDALRasterBandH band;
-	void *pVoid;
-	char *pszDataPointer;
-	char szGDALOption[50];
-	char *apszOptions[4];
-	double nodata = 0.0;
-	int allocBandNums = 0;
+				/* larger raster */
+				for (row = rowoffset; row <= dimValue; row += 3) {
 
-	int i;
-	int numBands;
-	rt_band rtband = NULL;
-	rt_pixtype pt = PT_END;
+					if (byHeight) {
+						rt_raster_cell_to_geopoint(
+							rast2,
+							0, row,
+							&(line2[X1]), &(line2[Y1]),
+							gt2
+						);
 
-	assert(NULL != raster);
+						rt_raster_cell_to_geopoint(
+							rast2,
+							width2, row,
+							&(line2[X2]), &(line2[Y2]),
+							gt2
+						);
+					}
+					else {
+						rt_raster_cell_to_geopoint(
+							rast2,
+							row, 0,
+							&(line2[X1]), &(line2[Y1]),
+							gt2
+						);
 
-	/* store raster in GDAL MEM raster */
-	if (!rt_util_gdal_driver_registered("MEM"))
-		GDALRegister_MEM();
-	drv = GDALGetDriverByName("MEM");
-	if (NULL == drv) {
-		rterror("rt_raster_to_gdal_mem: Unable to load the MEM GDAL driver");
-		return 0;
-	}
-	*rtn_drv = drv;
+						rt_raster_cell_to_geopoint(
+							rast2,
+							row, height2,
+							&(line2[X2]), &(line2[Y2]),
+							gt2
+						);
+					}
 
-	ds = GDALCreate(drv, "", rt_raster_get_width(raster),
-		rt_raster_get_height(raster), 0, GDT_Byte, NULL);
-	if (NULL == ds) {
-		rterror("rt_raster_to_gdal_mem: Could not create a GDALDataset to convert into");
-		return 0;
-	}
+					RASTER_DEBUGF(4, "(col, row) = (%d, %d)", col, row);
+					RASTER_DEBUGF(4, "line1(x1, y1, x2, y2) = (%f, %f, %f, %f)",
+						line1[X1], line1[Y1], line1[X2], line1[Y2]);
+					RASTER_DEBUGF(4, "line2(x1, y1, x2, y2) = (%f, %f, %f, %f)",
+						line2[X1], line2[Y1], line2[X2], line2[Y2]);
+
+					/* intersection */
+					/* http://en.wikipedia.org/wiki/Line-line_intersection */
+					d = ((line1[X1] - line1[X2]) * (line2[Y1] - line2[Y2])) - ((line1[Y1] - line1[Y2]) * (line2[X1] - line2[X2]));
+					/* no intersection */
+					if (FLT_EQ(d, 0.)) {
+						continue;
+					}
 
-	/* add geotransform */
-	rt_raster_get_geotransform_matrix(raster, gt);
-	cplerr = GDALSetGeoTransform(ds, gt);
-	if (cplerr != CE_None) {
-		rterror("rt_raster_to_gdal_mem: Unable to set geotransformation");
-		GDALClose(ds);
-		return 0;
-	}
+					P[pX] = (((line1[X1] * line1[Y2]) - (line1[Y1] * line1[X2])) * (line2[X1] - line2[X2])) -
+						((line1[X1] - line1[X2]) * ((line2[X1] * line2[Y2]) - (line2[Y1] * line2[X2])));
+					P[pX] = P[pX] / d;
 
-	/* set spatial reference */
-	if (NULL != srs && strlen(srs)) {
-		cplerr = GDALSetProjection(ds, srs);
-		if (cplerr != CE_None) {
-			rterror("rt_raster_to_gdal_mem: Unable to set projection");
-			GDALClose(ds);
-			return 0;
-		}
-		RASTER_DEBUGF(3, "Projection set to: %s", srs);
-	}
+					P[pY] = (((line1[X1] * line1[Y2]) - (line1[Y1] * line1[X2])) * (line2[Y1] - line2[Y2])) -
+						((line1[Y1] - line1[Y2]) * ((line2[X1] * line2[Y2]) - (line2[Y1] * line2[X2])));
+					P[pY] = P[pY] / d;
 
-	/* process bandNums */
-	numBands = rt_raster_get_num_bands(raster);
-	if (NULL != bandNums && count > 0) {
-		for (i = 0; i < count; i++) {
-			if (bandNums[i] < 0 || bandNums[i] >= numBands) {
-				rterror("rt_raster_to_gdal_mem: The band index %d is invalid", bandNums[i]);
-				GDALClose(ds);
-				return 0;
-			}
-		}
-	}
-	else {
-		count = numBands;
-		bandNums = (uint32_t *) rtalloc(sizeof(uint32_t) * count);
-		if (NULL == bandNums) {
-			rterror("rt_raster_to_gdal_mem: Unable to allocate memory for band indices");
-			GDALClose(ds);
-			return 0;
-		}
-		allocBandNums = 1;
-		for (i = 0; i < count; i++) bandNums[i] = i;
-	}
+					RASTER_DEBUGF(4, "P(x, y) = (%f, %f)", P[pX], P[pY]);
 
-	/* add band(s) */
-	for (i = 0; i < count; i++) {
-		rtband = rt_raster_get_band(raster, bandNums[i]);
-		if (NULL == rtband) {
-			rterror("rt_raster_to_gdal_mem: Unable to get requested band index %d", bandNums[i]);
-			if (allocBandNums) rtdealloc(bandNums);
-			GDALClose(ds);
-			return 0;
-		}
+					/* intersection within bounds */
+					if ((
+							(FLT_EQ(P[pX], line1[X1]) || FLT_EQ(P[pX], line1[X2])) ||
+								(P[pX] > fmin(line1[X1], line1[X2]) && (P[pX] < fmax(line1[X1], line1[X2])))
+						) && (
+							(FLT_EQ(P[pY], line1[Y1]) || FLT_EQ(P[pY], line1[Y2])) ||
+								(P[pY] > fmin(line1[Y1], line1[Y2]) && (P[pY] < fmax(line1[Y1], line1[Y2])))
+						) && (
+							(FLT_EQ(P[pX], line2[X1]) || FLT_EQ(P[pX], line2[X2])) ||
+								(P[pX] > fmin(line2[X1], line2[X2]) && (P[pX] < fmax(line2[X1], line2[X2])))
+						) && (
+							(FLT_EQ(P[pY], line2[Y1]) || FLT_EQ(P[pY], line2[Y2])) ||
+								(P[pY] > fmin(line2[Y1], line2[Y2]) && (P[pY] < fmax(line2[Y1], line2[Y2])))
+					)) {
+						RASTER_DEBUG(4, "within bounds");
 
-		pt = rt_band_get_pixtype(rtband);
-		gdal_pt = rt_util_pixtype_to_gdal_datatype(pt);
-		if (gdal_pt == GDT_Unknown)
-			rtwarn("rt_raster_to_gdal_mem: Unknown pixel type for band");
+						for (i = 0; i < 8; i++) adjacent[i] = 0;
 
-		pVoid = rt_band_get_data(rtband);
-		RASTER_DEBUGF(4, "Band data is at pos %p", pVoid);
+						/* test points around intersection */
+						for (i = 0; i < 8; i++) {
+							switch (i) {
+								case 7:
+									Qw[pX] = P[pX] - xscale;
+									Qw[pY] = P[pY] + yscale;
+									break;
+								/* 270 degrees = 09:00 */
+								case 6:
+									Qw[pX] = P[pX] - xscale;
+									Qw[pY] = P[pY];
+									break;
+								case 5:
+									Qw[pX] = P[pX] - xscale;
+									Qw[pY] = P[pY] - yscale;
+									break;
+								/* 180 degrees = 06:00 */
+								case 4:
+									Qw[pX] = P[pX];
+									Qw[pY] = P[pY] - yscale;
+									break;
+								case 3:
+									Qw[pX] = P[pX] + xscale;
+									Qw[pY] = P[pY] - yscale;
+									break;
+								/* 90 degrees = 03:00 */
+								case 2:
+									Qw[pX] = P[pX] + xscale;
+									Qw[pY] = P[pY];
+									break;
+								/* 45 degrees */
+								case 1:
+									Qw[pX] = P[pX] + xscale;
+									Qw[pY] = P[pY] + yscale;
+									break;
+								/* 0 degrees = 00:00 */
+								case 0:
+									Qw[pX] = P[pX];
+									Qw[pY] = P[pY] + yscale;
+									break;
+							}
 
-		pszDataPointer = (char *) rtalloc(20 * sizeof (char));
-		sprintf(pszDataPointer, "%p", pVoid);
-		RASTER_DEBUGF(4, "rt_raster_to_gdal_mem: szDatapointer is %p",
-			pszDataPointer);
+							/* unable to convert point to cell */
+							noval1 = 0;
+							if (!rt_raster_geopoint_to_cell(
+								rast1,
+								Qw[pX], Qw[pY],
+								&(Qr[pX]), &(Qr[pY]),
+								igt1
+							)) {
+								noval1 = 1;
+							}
+							/* cell is outside bounds of grid */
+							else if (
+								(Qr[pX] < 0 || Qr[pX] > width1 || FLT_EQ(Qr[pX], width1)) ||
+								(Qr[pY] < 0 || Qr[pY] > height1 || FLT_EQ(Qr[pY], height1))
+							) {
+								noval1 = 1;
+							}
+							else if (hasnodata1 == FALSE)
+								val1 = 1;
+							/* unable to get value at cell */
+							else if (rt_band_get_pixel(band1, Qr[pX], Qr[pY], &val1) < 0)
+								noval1 = 1;
 
-		if (strnicmp(pszDataPointer, "0x", 2) == 0)
-			sprintf(szGDALOption, "DATAPOINTER=%s", pszDataPointer);
-		else
-			sprintf(szGDALOption, "DATAPOINTER=0x%s", pszDataPointer);
+							/* unable to convert point to cell */
+							noval2 = 0;
+							if (!rt_raster_geopoint_to_cell(
+								rast2,
+								Qw[pX], Qw[pY],
+								&(Qr[pX]), &(Qr[pY]),
+								igt2
+							)) {
+								noval2 = 1;
+							}
+							/* cell is outside bounds of grid */
+							else if (
+								(Qr[pX] < 0 || Qr[pX] > width2 || FLT_EQ(Qr[pX], width2)) ||
+								(Qr[pY] < 0 || Qr[pY] > height2 || FLT_EQ(Qr[pY], height2))
+							) {
+								noval2 = 1;
+							}
+							else if (hasnodata2 == FALSE)
+								val2 = 1;
+							/* unable to get value at cell */
+							else if (rt_band_get_pixel(band2, Qr[pX], Qr[pY], &val2) < 0)
+								noval2 = 1;
 
-		RASTER_DEBUG(3, "Storing info for GDAL MEM raster band");
+							if (!noval1) {
+								RASTER_DEBUGF(4, "val1 = %f", val1);
+							}
+							if (!noval2) {
+								RASTER_DEBUGF(4, "val2 = %f", val2);
+							}
 
-		apszOptions[0] = szGDALOption;
-		apszOptions[1] = NULL; /* pixel offset, not needed */
-		apszOptions[2] = NULL; /* line offset, not needed */
-		apszOptions[3] = NULL;
+							/* pixels touch */
+							if (!noval1 && (
+								(hasnodata1 == FALSE) || (
+									(hasnodata1 != FALSE) &&
+									FLT_NEQ(val1, nodata1)
+								)
+							)) {
+								adjacent[i]++;
+							}
+							if (!noval2 && (
+								(hasnodata2 == FALSE) || (
+									(hasnodata2 != FALSE) &&
+									FLT_NEQ(val2, nodata2)
+								)
+							)) {
+								adjacent[i] += 3;
+							}
 
-		/* free */
-		rtdealloc(pszDataPointer);
+							/* two pixel values not present */
+							if (noval1 || noval2) {
+								RASTER_DEBUGF(4, "noval1 = %d, noval2 = %d", noval1, noval2);
+								continue;
+							}
 
-		if (GDALAddBand(ds, gdal_pt, apszOptions) == CE_Failure) {
-			rterror("rt_raster_to_gdal_mem: Could not add GDAL raster band");
-			if (allocBandNums) rtdealloc(bandNums);
-			GDALClose(ds);
-			return 0;
-		}
+							/* pixels valid, so intersect */
+							if ((
+									(hasnodata1 == FALSE) || (
+										(hasnodata1 != FALSE) &&
+										FLT_NEQ(val1, nodata1)
+									)
+								) && (
+									(hasnodata2 == FALSE) || (
+										(hasnodata2 != FALSE) &&
+										FLT_NEQ(val2, nodata2)
+									)
+							)) {
+								RASTER_DEBUG(3, "The two rasters do intersect");
 
-		/* check band count */
-		if (GDALGetRasterCount(ds) != i + 1) {
-			rterror("rt_raster_to_gdal_mem: Error creating GDAL MEM raster band");
-			if (allocBandNums) rtdealloc(bandNums);
-			GDALClose(ds);
-			return 0;
-		}
+								return 1;
+							}
+						}
 
-		/* get band to write data to */
-		band = NULL;
-		band = GDALGetRasterBand(ds, i + 1);
-		if (NULL == band) {
-			rterror("rt_raster_to_gdal_mem: Could not get GDAL band for additional processing");
-			if (allocBandNums) rtdealloc(bandNums);
-			GDALClose(ds);
-			return 0;
-		}
+						/* pixels touch */
+						for (i = 0; i < 4; i++) {
+							RASTER_DEBUGF(4, "adjacent[%d] = %d, adjacent[%d] = %d"
+								, i, adjacent[i], i + 4, adjacent[i + 4]);
+							if (adjacent[i] == 0) continue;
+
+							if (adjacent[i] + adjacent[i + 4] == 4) {
+								RASTER_DEBUG(3, "The two rasters touch");
 
-		/* Add nodata value for band */
-		if (rt_band_get_hasnodata_flag(rtband) != FALSE) {
-			nodata = rt_band_get_nodata(rtband);
-			if (GDALSetRasterNoDataValue(band, nodata) != CE_None)
-				rtwarn("rt_raster_to_gdal_mem: Could not set nodata value for band");
-			RASTER_DEBUGF(3, "nodata value set to %f", GDALGetRasterNoDataValue(band, NULL));
+								return 1;
+							}
+						}
+					}
+					else {
+						RASTER_DEBUG(4, "outside of bounds");
+					}
+				}
+			}
 		}
 	}
 
-	/* necessary??? */
-	GDALFlushCache(ds);
-
-	if (allocBandNums) rtdealloc(bandNums);
-
-	return ds;
+	return 0;
 }
 
 /**
- * Return a raster from a GDAL dataset
+ * Return zero if error occurred in function.
+ * Parameter intersects returns non-zero if two rasters intersect
  *
- * @param ds : the GDAL dataset to convert to a raster
+ * @param rast1 : the first raster whose band will be tested
+ * @param nband1 : the 0-based band of raster rast1 to use
+ *   if value is less than zero, bands are ignored.
+ *   if nband1 gte zero, nband2 must be gte zero
+ * @param rast2 : the second raster whose band will be tested
+ * @param nband2 : the 0-based band of raster rast2 to use
+ *   if value is less than zero, bands are ignored
+ *   if nband2 gte zero, nband1 must be gte zero
+ * @param intersects : non-zero value if the two rasters' bands intersects
  *
- * @return raster
+ * @return if zero, an error occurred in function
  */
-rt_raster
-rt_raster_from_gdal_dataset(GDALDatasetH ds) {
-	rt_raster rast = NULL;
-	double gt[6] = {0};
-	CPLErr cplerr;
-	uint32_t width = 0;
-	uint32_t height = 0;
-	uint32_t numBands = 0;
-	int i = 0;
-	int status;
-
-	const char *srs = NULL;
+int
+rt_raster_intersects(
+	rt_raster rast1, int nband1,
+	rt_raster rast2, int nband2,
+	int *intersects
+) {
+	int i;
+	int j;
+	int within = 0;
 
-	GDALRasterBandH gdband = NULL;
-	GDALDataType gdpixtype = GDT_Unknown;
-	rt_band band;
-	int32_t idx;
-	rt_pixtype pt = PT_END;
-	uint32_t ptlen = 0;
-	uint32_t hasnodata = 0;
-	double nodataval;
+	LWPOLY *hull[2] = {NULL};
+	GEOSGeometry *ghull[2] = {NULL};
 
-	int x;
-	int y;
+	uint16_t width1;
+	uint16_t height1;
+	uint16_t width2;
+	uint16_t height2;
+	double area1;
+	double area2;
+	double pixarea1;
+	double pixarea2;
+	rt_raster rastS = NULL;
+	rt_raster rastL = NULL;
+	uint16_t *widthS = NULL;
+	uint16_t *heightS = NULL;
+	uint16_t *widthL = NULL;
+	uint16_t *heightL = NULL;
+	int nbandS;
+	int nbandL;
+	rt_band bandS = NULL;
+	rt_band bandL = NULL;
+	int hasnodataS = FALSE;
+	int hasnodataL = FALSE;
+	double nodataS = 0;
+	double nodataL = 0;
+	double gtS[6] = {0};
+	double igtL[6] = {0};
 
-	int nXBlocks, nYBlocks;
-	int nXBlockSize, nYBlockSize;
-	int iXBlock, iYBlock;
-	int nXValid, nYValid;
-	int iY;
+	uint32_t row;
+	uint32_t rowoffset;
+	uint32_t col;
+	uint32_t coloffset;
 
-	void *values = NULL;
-	uint32_t valueslen = 0;
-	void *ptr = NULL;
+	enum line_points {X1, Y1, X2, Y2};
+	enum point {pX, pY};
+	double lineS[4];
+	double Qr[2];
+	double valS;
+	double valL;
 
-	assert(NULL != ds);
+	RASTER_DEBUG(3, "Starting");
 
-	/* raster size */
-	width = GDALGetRasterXSize(ds);
-	height = GDALGetRasterYSize(ds);
-	RASTER_DEBUGF(3, "Raster dimensions (width x height): %d x %d", width, height);
+	assert(NULL != rast1);
+	assert(NULL != rast2);
 
-	/* create new raster */
-	RASTER_DEBUG(3, "Creating new raster");
-	rast = rt_raster_new(width, height);
-	if (NULL == rast) {
-		rterror("rt_raster_from_gdal_dataset: Out of memory allocating new raster");
-		return NULL;
+	if (nband1 < 0 && nband2 < 0) {
+		nband1 = -1;
+		nband2 = -1;
 	}
-
-	/* get raster attributes */
-	cplerr = GDALGetGeoTransform(ds, gt);
-	if (cplerr != CE_None) {
-		rterror("rt_raster_from_gdal_dataset: Unable to get geotransformation");
-		rt_raster_destroy(rast);
-		return NULL;
+	else {
+		assert(nband1 >= 0 && nband1 < rt_raster_get_num_bands(rast1));
+		assert(nband2 >= 0 && nband2 < rt_raster_get_num_bands(rast2));
 	}
-	RASTER_DEBUGF(3, "Raster geotransform (%f, %f, %f, %f, %f, %f)",
-		gt[0], gt[1], gt[2], gt[3], gt[4], gt[5]);
-
-	/* apply raster attributes */
-	rt_raster_set_geotransform_matrix(rast, gt);
 
-	/* srid */
-	srs = GDALGetProjectionRef(ds);
-	if (srs != NULL && srs[0] != '\0') {
-		OGRSpatialReferenceH hSRS = OSRNewSpatialReference(NULL);
-		if (OSRSetFromUserInput(hSRS, srs) == OGRERR_NONE) {
-			const char* pszAuthorityName = OSRGetAuthorityName(hSRS, NULL);
-			const char* pszAuthorityCode = OSRGetAuthorityCode(hSRS, NULL);
-			if (
-				pszAuthorityName != NULL &&
-				strcmp(pszAuthorityName, "EPSG") == 0 &&
-				pszAuthorityCode != NULL
-			) {
-				rt_raster_set_srid(rast, atoi(pszAuthorityCode));
-			}
-		}
-		OSRDestroySpatialReference(hSRS);
+	/* same srid */
+	if (rt_raster_get_srid(rast1) != rt_raster_get_srid(rast2)) {
+		rterror("rt_raster_intersects: The two rasters provided have different SRIDs");
+		*intersects = 0;
+		return 0;
 	}
 
-	/* copy bands */
-	numBands = GDALGetRasterCount(ds);
-	for (i = 1; i <= numBands; i++) {
-		RASTER_DEBUGF(3, "Processing band %d of %d", i, numBands);
-		gdband = NULL;
-		gdband = GDALGetRasterBand(ds, i);
-		if (NULL == gdband) {
-			rterror("rt_raster_from_gdal_dataset: Unable to get GDAL band");
-			rt_raster_destroy(rast);
-			return NULL;
-		}
-
-		/* pixtype */
-		gdpixtype = GDALGetRasterDataType(gdband);
-		pt = rt_util_gdal_datatype_to_pixtype(gdpixtype);
-		if (pt == PT_END) {
-			rterror("rt_raster_from_gdal_dataset: Unknown pixel type for GDAL band");
-			rt_raster_destroy(rast);
-			return NULL;
-		}
-		ptlen = rt_pixtype_size(pt);
-
-		/* size: width and height */
-		width = GDALGetRasterBandXSize(gdband);
-		height = GDALGetRasterBandYSize(gdband);
-		RASTER_DEBUGF(3, "Band dimensions (width x height): %d x %d", width, height);
-
-		/* nodata */
-		nodataval = GDALGetRasterNoDataValue(gdband, &status);
-		if (!status) {
-			nodataval = 0;
-			hasnodata = 0;
-		}
-		else
-			hasnodata = 1;
-		RASTER_DEBUGF(3, "(hasnodata, nodataval) = (%d, %f)", hasnodata, nodataval);
-
-		/* create band object */
-		idx = rt_raster_generate_new_band(
-			rast, pt,
-			(hasnodata ? nodataval : 0),
-			hasnodata, nodataval, rt_raster_get_num_bands(rast)
-		);
-		if (idx < 0) {
-			rterror("rt_raster_from_gdal_dataset: Could not allocate memory for raster band");
-			rt_raster_destroy(rast);
-			return NULL;
-		}
-		band = rt_raster_get_band(rast, idx);
+	/* raster extents need to intersect */
+	do {
+		int rtn;
 
-		/* this makes use of GDAL's "natural" blocks */
-		GDALGetBlockSize(gdband, &nXBlockSize, &nYBlockSize);
-		nXBlocks = (width + nXBlockSize - 1) / nXBlockSize;
-		nYBlocks = (height + nYBlockSize - 1) / nYBlockSize;
-		RASTER_DEBUGF(4, "(nXBlockSize, nYBlockSize) = (%d, %d)", nXBlockSize, nYBlockSize);
-		RASTER_DEBUGF(4, "(nXBlocks, nYBlocks) = (%d, %d)", nXBlocks, nYBlocks);
+		initGEOS(lwnotice, lwgeom_geos_error);
 
-		/* allocate memory for values */
-		valueslen = ptlen * nXBlockSize * nYBlockSize;
-		switch (gdpixtype) {
-			case GDT_Byte:
-				values = (uint8_t *) rtalloc(valueslen);
-				break;
-			case GDT_UInt16:
-				values = (uint16_t *) rtalloc(valueslen);
-				break;
-			case GDT_Int16:
-				values = (int16_t *) rtalloc(valueslen);
-				break;
-			case GDT_UInt32:
-				values = (uint32_t *) rtalloc(valueslen);
-				break;
-			case GDT_Int32:
-				values = (int32_t *) rtalloc(valueslen);
-				break;
-			case GDT_Float32:
-				values = (float *) rtalloc(valueslen);
+		rtn = 1;
+		for (i = 0; i < 2; i++) {
+			hull[i] = rt_raster_get_convex_hull(i < 1 ? rast1 : rast2);
+			if (NULL == hull[i]) {
+				for (j = 0; j < i; j++) {
+					GEOSGeom_destroy(ghull[j]);
+					lwpoly_free(hull[j]);
+				}
+				rtn = 0;
 				break;
-			case GDT_Float64:
-				values = (double *) rtalloc(valueslen);
+			}
+			ghull[i] = (GEOSGeometry *) LWGEOM2GEOS((LWGEOM *) hull[i]);
+			if (NULL == ghull[i]) {
+				for (j = 0; j < i; j++) {
+					GEOSGeom_destroy(ghull[j]);
+					lwpoly_free(hull[j]);
+				}
+				lwpoly_free(hull[i]);
+				rtn = 0;
 				break;
-			default:
-				/* should NEVER get here */
-				rterror("rt_raster_from_gdal_dataset: Could not allocate memory for unknown pixel type");
-				rt_raster_destroy(rast);
-				return NULL;
-		}
-		if (values == NULL) {
-			rterror("rt_raster_from_gdal_dataset: Could not allocate memory for GDAL band pixel values");
-			rt_raster_destroy(rast);
-			return NULL;
+			}
 		}
+		if (!rtn) break;
 
-		for (iYBlock = 0; iYBlock < nYBlocks; iYBlock++) {
-			for (iXBlock = 0; iXBlock < nXBlocks; iXBlock++) {
-				memset(values, 0, valueslen);
+		/* test to see if raster within the other */
+		within = 0;
+		if (GEOSWithin(ghull[0], ghull[1]) == 1)
+			within = -1;
+		else if (GEOSWithin(ghull[1], ghull[0]) == 1)
+			within = 1;
 
-				x = iXBlock * nXBlockSize;
-				y = iYBlock * nYBlockSize;
-				RASTER_DEBUGF(4, "(iXBlock, iYBlock) = (%d, %d)", iXBlock, iYBlock);
-				RASTER_DEBUGF(4, "(x, y) = (%d, %d)", x, y);
+		if (within != 0)
+			rtn = 1;
+		else
+			rtn = GEOSIntersects(ghull[0], ghull[1]);
 
-				/* valid block width */
-				if ((iXBlock + 1) * nXBlockSize > width)
-					nXValid = width - (iXBlock * nXBlockSize);
-				else
-					nXValid = nXBlockSize;
+		for (i = 0; i < 2; i++) {
+			GEOSGeom_destroy(ghull[i]);
+			lwpoly_free(hull[i]);
+		}
 
-				/* valid block height */
-				if ((iYBlock + 1) * nYBlockSize > height)
-					nYValid = height - (iYBlock * nYBlockSize);
-				else
-					nYValid = nYBlockSize;
+		if (rtn != 2) {
+			RASTER_DEBUGF(4, "convex hulls of rasters do %sintersect", rtn != 1 ? "NOT " : "");
+			if (rtn != 1) {
+				*intersects = 0;
+				return 1;
+			}
+			/* band isn't specified */
+			else if (nband1 < 0) {
+				*intersects = 1;
+				return 1;
+			}
+		}
+	}
+	while (0);
 
-				RASTER_DEBUGF(4, "(nXValid, nYValid) = (%d, %d)", nXValid, nYValid);
+	/* smaller raster by area or width */
+	width1 = rt_raster_get_width(rast1);
+	height1 = rt_raster_get_height(rast1);
+	width2 = rt_raster_get_width(rast2);
+	height2 = rt_raster_get_height(rast2);
+	pixarea1 = fabs(rt_raster_get_x_scale(rast1) * rt_raster_get_y_scale(rast1));
+	pixarea2 = fabs(rt_raster_get_x_scale(rast2) * rt_raster_get_y_scale(rast2));
+	area1 = fabs(width1 * height1 * pixarea1);
+	area2 = fabs(width2 * height2 * pixarea2);
+	RASTER_DEBUGF(4, "pixarea1, pixarea2, area1, area2 = %f, %f, %f, %f",
+		pixarea1, pixarea2, area1, area2);
+	if (
+		(within <= 0) ||
+		(area1 < area2) ||
+		FLT_EQ(area1, area2) ||
+		(area1 < pixarea2) || /* area of rast1 smaller than pixel area of rast2 */
+		FLT_EQ(area1, pixarea2)
+	) {
+		rastS = rast1;
+		nbandS = nband1;
+		widthS = &width1;
+		heightS = &height1;
 
-				cplerr = GDALRasterIO(
-					gdband, GF_Read,
-					x, y,
-					nXValid, nYValid,
-					values, nXValid, nYValid,
-					gdpixtype,
-					0, 0
-				);
-				if (cplerr != CE_None) {
-					rterror("rt_raster_from_gdal_dataset: Unable to get data from transformed raster");
-					rtdealloc(values);
-					rt_raster_destroy(rast);
-					return NULL;
-				}
+		rastL = rast2;
+		nbandL = nband2;
+		widthL = &width2;
+		heightL = &height2;
+	}
+	else {
+		rastS = rast2;
+		nbandS = nband2;
+		widthS = &width2;
+		heightS = &height2;
 
-				/* if block width is same as raster width, shortcut */
-				if (nXBlocks == 1 && nYBlockSize > 1 && nXValid == width) {
-					x = 0;
-					y = nYBlockSize * iYBlock;
+		rastL = rast1;
+		nbandL = nband1;
+		widthL = &width1;
+		heightL = &height1;
+	}
 
-					RASTER_DEBUGF(4, "Setting set of pixel lines at (%d, %d) for %d pixels", x, y, nXValid * nYValid);
-					rt_band_set_pixel_line(band, x, y, values, nXValid * nYValid);
-				}
-				else {
-					ptr = values;
-					x = nXBlockSize * iXBlock;
-					for (iY = 0; iY < nYValid; iY++) {
-						y = iY + (nYBlockSize * iYBlock);
+	/* no band to use, set band to zero */
+	if (nband1 < 0) {
+		nbandS = 0;
+		nbandL = 0;
+	}
 
-						RASTER_DEBUGF(4, "Setting pixel line at (%d, %d) for %d pixels", x, y, nXValid);
-						rt_band_set_pixel_line(band, x, y, ptr, nXValid);
-						ptr += (nXValid * ptlen);
-					}
-				}
-			}
-		}
+	RASTER_DEBUGF(4, "rast1 @ %p", rast1);
+	RASTER_DEBUGF(4, "rast2 @ %p", rast2);
+	RASTER_DEBUGF(4, "rastS @ %p", rastS);
+	RASTER_DEBUGF(4, "rastL @ %p", rastL);
 
-		/* free memory */
-		rtdealloc(values);
+	/* load band of smaller raster */
+	bandS = rt_raster_get_band(rastS, nbandS);
+	if (NULL == bandS) {
+		rterror("rt_raster_intersects: Unable to get band %d of the first raster", nbandS);
+		*intersects = 0;
+		return 0;
+	}
+	if (bandS->offline) {
+		rterror("rt_raster_intersects not implemented yet for OFFDB bands");
+		*intersects = 0;
+		return 0;
 	}
 
-	return rast;
-}
+	hasnodataS = rt_band_get_hasnodata_flag(bandS);
+	if (hasnodataS != FALSE)
+		nodataS = rt_band_get_nodata(bandS);
 
-/**
- * Return a warped raster using GDAL Warp API
- *
- * @param raster : raster to transform
- * @param src_srs : the raster's coordinate system in OGC WKT
- * @param dst_srs : the warped raster's coordinate system in OGC WKT
- * @param scale_x : the x size of pixels of the warped raster's pixels in
- *   units of dst_srs
- * @param scale_y : the y size of pixels of the warped raster's pixels in
- *   units of dst_srs
- * @param width : the number of columns of the warped raster.  note that
- *   width/height CANNOT be used with scale_x/scale_y
- * @param height : the number of rows of the warped raster.  note that
- *   width/height CANNOT be used with scale_x/scale_y
- * @param ul_xw : the X value of upper-left corner of the warped raster in
- *   units of dst_srs
- * @param ul_yw : the Y value of upper-left corner of the warped raster in
- *   units of dst_srs
- * @param grid_xw : the X value of point on a grid to align warped raster
- *   to in units of dst_srs
- * @param grid_yw : the Y value of point on a grid to align warped raster
- *   to in units of dst_srs
- * @param skew_x : the X skew of the warped raster in units of dst_srs
- * @param skew_y : the Y skew of the warped raster in units of dst_srs
- * @param resample_alg : the resampling algorithm
- * @param max_err : maximum error measured in input pixels permitted
- *   (0.0 for exact calculations)
- *
- * @return the warped raster
- */
-rt_raster rt_raster_gdal_warp(
-	rt_raster raster, const char *src_srs,
-	const char *dst_srs,
-	double *scale_x, double *scale_y,
-	int *width, int *height,
-	double *ul_xw, double *ul_yw,
-	double *grid_xw, double *grid_yw,
-	double *skew_x, double *skew_y,
-	GDALResampleAlg resample_alg, double max_err
-) {
-	CPLErr cplerr;
-	GDALDriverH src_drv = NULL;
-	GDALDatasetH src_ds = NULL;
-	GDALWarpOptions *wopts = NULL;
-	GDALDriverH dst_drv = NULL;
-	GDALDatasetH dst_ds = NULL;
-	char *_src_srs = NULL;
-	char *_dst_srs = NULL;
-	char *dst_options[] = {"SUBCLASS=VRTWarpedDataset", NULL};
-	char **transform_opts = NULL;
-	int transform_opts_len = 2;
-	void *transform_arg = NULL;
-	void *imgproj_arg = NULL;
-	void *approx_arg = NULL;
-	GDALTransformerFunc transform_func = NULL;
+	/* load band of larger raster */
+	bandL = rt_raster_get_band(rastL, nbandL);
+	if (NULL == bandL) {
+		rterror("rt_raster_intersects: Unable to get band %d of the first raster", nbandL);
+		*intersects = 0;
+		return 0;
+	}
+	if (bandL->offline) {
+		rterror("rt_raster_intersects not implemented yet for OFFDB bands");
+		*intersects = 0;
+		return 0;
+	}
 
-	GDALRasterBandH band;
-	rt_band rtband = NULL;
-	rt_pixtype pt = PT_END;
-	GDALDataType gdal_pt = GDT_Unknown;
-	double nodata = 0.0;
+	hasnodataL = rt_band_get_hasnodata_flag(bandL);
+	if (hasnodataL != FALSE)
+		nodataL = rt_band_get_nodata(bandL);
+
+	/* no band to use, ignore nodata */
+	if (nband1 < 0) {
+		hasnodataS = FALSE;
+		hasnodataL = FALSE;
+	}
+
+	/* special case where a raster can fit inside another raster's pixel */
+	if (within != 0 && ((pixarea1 > area2) || (pixarea2 > area1))) {
+		RASTER_DEBUG(4, "Using special case of raster fitting into another raster's pixel");
+		/* 3 x 3 search */
+		for (coloffset = 0; coloffset < 3; coloffset++) {
+			for (rowoffset = 0; rowoffset < 3; rowoffset++) {
+				for (col = coloffset; col < *widthS; col += 3) {
+					for (row = rowoffset; row < *heightS; row += 3) {
+						if (hasnodataS == FALSE)
+							valS = 1;
+						else if (rt_band_get_pixel(bandS, col, row, &valS) < 0)
+							continue;
 
-	double dst_gt[6] = {0};
-	double dst_extent[4];
-	int _width = 0;
-	int _height = 0;
-	int ul_user = 0;
-	double min_x = 0;
-	double min_y = 0;
-	double max_x = 0;
-	double max_y = 0;
-	double pix_x = 0;
-	double pix_y = 0;
+						if ((hasnodataS == FALSE) || (
+							(hasnodataS != FALSE) &&
+							FLT_NEQ(valS, nodataS)
+						)) {
+							rt_raster_cell_to_geopoint(
+								rastS,
+								col, row,
+								&(lineS[X1]), &(lineS[Y1]),
+								gtS
+							);
 
-	double djunk = 0;
-	double grid_shift_xw = 0;
-	double grid_shift_yw = 0;
-	double grid_pix_x = 0;
-	double grid_pix_y = 0;
+							if (!rt_raster_geopoint_to_cell(
+								rastL,
+								lineS[X1], lineS[Y1],
+								&(Qr[pX]), &(Qr[pY]),
+								igtL
+							)) {
+								continue;
+							}
 
-	rt_raster rast = NULL;
-	int i = 0;
-	int j = 0;
-	int numBands = 0;
+							if (
+								(Qr[pX] < 0 || Qr[pX] > *widthL || FLT_EQ(Qr[pX], *widthL)) ||
+								(Qr[pY] < 0 || Qr[pY] > *heightL || FLT_EQ(Qr[pY], *heightL))
+							) {
+								continue;
+							}
 
-	RASTER_DEBUG(3, "starting");
+							if (hasnodataS == FALSE)
+								valL = 1;
+							else if (rt_band_get_pixel(bandL, Qr[pX], Qr[pY], &valL) < 0)
+								continue;
 
-	assert(NULL != raster);
-	assert(NULL != src_srs);
+							if ((hasnodataL == FALSE) || (
+								(hasnodataL != FALSE) &&
+								FLT_NEQ(valL, nodataL)
+							)) {
+								RASTER_DEBUG(3, "The two rasters do intersect");
+								*intersects = 1;
+								return 1;
+							}
+						}
+					}
+				}
+			}
+		}
+	}
 
-	/*
-		max_err must be gte zero
+	*intersects = rt_raster_intersects_algorithm(
+		rastS, rastL,
+		bandS, bandL,
+		hasnodataS, hasnodataL,
+		nodataS, nodataL
+	);
 
-		the value 0.125 is the default used in gdalwarp.cpp on line 283
-	*/
-	if (max_err < 0.) max_err = 0.125;
-	RASTER_DEBUGF(4, "max_err = %f", max_err);
+	if (*intersects) return 1;
 
-	_src_srs = rt_util_gdal_convert_sr(src_srs, 0);
-	/* dst_srs not provided, set to src_srs */
-	if (NULL == dst_srs)
-		_dst_srs = rt_util_gdal_convert_sr(src_srs, 0);
-	else
-		_dst_srs = rt_util_gdal_convert_sr(dst_srs, 0);
+	*intersects = rt_raster_intersects_algorithm(
+		rastL, rastS,
+		bandL, bandS,
+		hasnodataL, hasnodataS,
+		nodataL, nodataS
+	);
 
-	/* load raster into a GDAL MEM dataset */
-	src_ds = rt_raster_to_gdal_mem(raster, _src_srs, NULL, 0, &src_drv);
-	if (NULL == src_ds) {
-		rterror("rt_raster_gdal_warp: Unable to convert raster to GDAL MEM format");
+	if (*intersects) return 1;
 
-		CPLFree(_src_srs);
-		CPLFree(_dst_srs);
+	RASTER_DEBUG(3, "The two rasters do not intersect");
 
-		return NULL;
-	}
-	RASTER_DEBUG(3, "raster loaded into GDAL MEM dataset");
+	*intersects = 0;
+	return 1;
+}
 
-	/* set transform_opts */
-	transform_opts = (char **) rtalloc(sizeof(char *) * (transform_opts_len + 1));
-	if (NULL == transform_opts) {
-		rterror("rt_raster_gdal_warp: Unable to allocation memory for transform options");
+/*
+ * Return zero if error occurred in function.
+ * Paramter aligned returns non-zero if two rasters are aligned
+ *
+ * @param rast1 : the first raster for alignment test
+ * @param rast2 : the second raster for alignment test
+ * @param aligned : non-zero value if the two rasters are aligned
+ *
+ * @return if zero, an error occurred in function
+ */
+int
+rt_raster_same_alignment(
+	rt_raster rast1,
+	rt_raster rast2,
+	int *aligned
+) {
+	double xr;
+	double yr;
+	double xw;
+	double yw;
+	int err = 0;
 
-		GDALClose(src_ds);
+	assert(NULL != rast1);
+	assert(NULL != rast2);
 
-		CPLFree(_src_srs);
-		CPLFree(_dst_srs);
+	err = 0;
+	/* same srid */
+	if (rt_raster_get_srid(rast1) != rt_raster_get_srid(rast2)) {
+		RASTER_DEBUG(3, "The two rasters provided have different SRIDs");
+		err = 1;
+	}
+	/* scales must match */
+	else if (FLT_NEQ(fabs(rast1->scaleX), fabs(rast2->scaleX))) {
+		RASTER_DEBUG(3, "The two raster provided have different scales on the X axis");
+		err = 1;
+	}
+	else if (FLT_NEQ(fabs(rast1->scaleY), fabs(rast2->scaleY))) {
+		RASTER_DEBUG(3, "The two raster provided have different scales on the Y axis");
+		err = 1;
+	}
+	/* skews must match */
+	else if (FLT_NEQ(rast1->skewX, rast2->skewX)) {
+		RASTER_DEBUG(3, "The two raster provided have different skews on the X axis");
+		err = 1;
+	}
+	else if (FLT_NEQ(rast1->skewY, rast2->skewY)) {
+		RASTER_DEBUG(3, "The two raster provided have different skews on the Y axis");
+		err = 1;
+	}
 
-		return NULL;
+	if (err) {
+		*aligned = 0;
+		return 1;
 	}
-	for (i = 0; i < transform_opts_len; i++) {
-		switch (i) {
-			case 1:
-				transform_opts[i] = (char *) rtalloc(sizeof(char) * (strlen("DST_SRS=") + strlen(_dst_srs) + 1));
-				break;
-			case 0:
-				transform_opts[i] = (char *) rtalloc(sizeof(char) * (strlen("SRC_SRS=") + strlen(_src_srs) + 1));
-				break;
-		}
-		if (NULL == transform_opts[i]) {
-			rterror("rt_raster_gdal_warp: Unable to allocation memory for transform options");
 
-			for (j = 0; j < i; j++) rtdealloc(transform_opts[j]);
-			rtdealloc(transform_opts);
-			GDALClose(src_ds);
+	/* raster coordinates in context of second raster of first raster's upper-left corner */
+	if (rt_raster_geopoint_to_cell(
+			rast2,
+			rast1->ipX, rast1->ipY,
+			&xr, &yr,
+			NULL
+	) == 0) {
+		rterror("rt_raster_same_alignment: Unable to get raster coordinates of second raster from first raster's spatial coordinates");
+		*aligned = 0;
+		return 0;
+	}
 
-			CPLFree(_src_srs);
-			CPLFree(_dst_srs);
+	/* spatial coordinates of raster coordinates from above */
+	if (rt_raster_cell_to_geopoint(
+		rast2,
+		xr, yr,
+		&xw, &yw,
+		NULL
+	) == 0) {
+		rterror("rt_raster_same_alignment: Unable to get spatial coordinates of second raster from raster coordinates");
+		*aligned = 0;
+		return 0;
+	}
 
-			return NULL;
-		}
+	RASTER_DEBUGF(4, "rast1(ipX, ipxY) = (%f, %f)", rast1->ipX, rast1->ipY);
+	RASTER_DEBUGF(4, "rast2(xr, yr) = (%f, %f)", xr, yr);
+	RASTER_DEBUGF(4, "rast2(xw, yw) = (%f, %f)", xw, yw);
 
-		switch (i) {
-			case 1:
-				snprintf(
-					transform_opts[i],
-					sizeof(char) * (strlen("DST_SRS=") + strlen(_dst_srs) + 1),
-					"DST_SRS=%s",
-					_dst_srs
-				);
-				break;
-			case 0:
-				snprintf(
-					transform_opts[i],
-					sizeof(char) * (strlen("SRC_SRS=") + strlen(_src_srs) + 1),
-					"SRC_SRS=%s",
-					_src_srs
-				);
-				break;
-		}
-		RASTER_DEBUGF(4, "transform_opts[%d] = %s", i, transform_opts[i]);
+	/* spatial coordinates are identical to that of first raster's upper-left corner */
+	if (FLT_EQ(xw, rast1->ipX) && FLT_EQ(yw, rast1->ipY)) {
+		RASTER_DEBUG(3, "The two rasters are aligned");
+		*aligned = 1;
+		return 1;
 	}
-	transform_opts[transform_opts_len] = NULL;
-	CPLFree(_src_srs);
-	CPLFree(_dst_srs);
 
-	/* transformation object for building dst dataset */
-	transform_arg = GDALCreateGenImgProjTransformer2(src_ds, NULL, transform_opts);
-	if (NULL == transform_arg) {
-		rterror("rt_raster_gdal_warp: Unable to create GDAL transformation object for output dataset creation");
+	/* no alignment */
+	RASTER_DEBUG(3, "The two rasters are NOT aligned");
+	*aligned = 0;
+	return 1;
+}
+
+/*
+ * Return raster of computed extent specified extenttype applied
+ * on two input rasters.  The raster returned should be freed by
+ * the caller
+ *
+ * @param rast1 : the first raster
+ * @param rast2 : the second raster
+ * @param extenttype : type of extent for the output raster
+ * @param err : if 0, error occurred
+ * @param offset : 4-element array indicating the X,Y offsets
+ * for each raster. 0,1 for rast1 X,Y. 2,3 for rast2 X,Y.
+ *
+ * @return raster object if success, NULL otherwise
+ */
+rt_raster
+rt_raster_from_two_rasters(
+	rt_raster rast1, rt_raster rast2,
+	rt_extenttype extenttype,
+	int *err, double *offset
+) {
+	int i;
+
+	rt_raster _rast[2] = {rast1, rast2};
+	double _offset[2][4] = {{0.}};
+	uint16_t _dim[2][2] = {{0}};
 
-		GDALClose(src_ds);
+	rt_raster raster = NULL;
+	int aligned = 0;
+	int dim[2] = {0};
+	double gt[6] = {0.};
 
-		for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
-		rtdealloc(transform_opts);
+	assert(NULL != rast1);
+	assert(NULL != rast2);
 
+	/* rasters must have same srid */
+	if (rt_raster_get_srid(rast1) != rt_raster_get_srid(rast2)) {
+		rterror("rt_raster_from_two_rasters: The two rasters provided do not have the same SRID");
+		*err = 0;
 		return NULL;
 	}
 
-	/* get approximate output georeferenced bounds and resolution */
-	cplerr = GDALSuggestedWarpOutput2(src_ds, GDALGenImgProjTransform,
-		transform_arg, dst_gt, &_width, &_height, dst_extent, 0);
-	GDALDestroyGenImgProjTransformer(transform_arg);
-	if (cplerr != CE_None) {
-		rterror("rt_raster_gdal_warp: Unable to get GDAL suggested warp output for output dataset creation");
-
-		GDALClose(src_ds);
-
-		for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
-		rtdealloc(transform_opts);
-
+	/* rasters must be aligned */
+	if (!rt_raster_same_alignment(rast1, rast2, &aligned)) {
+		rterror("rt_raster_from_two_rasters: Unable to test for alignment on the two rasters");
+		*err = 0;
 		return NULL;
 	}
-
-	RASTER_DEBUGF(3, "Suggested geotransform: %f, %f, %f, %f, %f, %f",
-		dst_gt[0], dst_gt[1], dst_gt[2], dst_gt[3], dst_gt[4], dst_gt[5]);
-	RASTER_DEBUGF(3, "Suggested extent: %f, %f, %f, %f",
-		dst_extent[0], dst_extent[1], dst_extent[2], dst_extent[3]);
-
-	/* user-defined upper-left corner */
-	if (
-		NULL != ul_xw &&
-		NULL != ul_yw
-	) {
-		min_x = *ul_xw;
-		max_y = *ul_yw;
-		ul_user = 1;
-	}
-	else if (
-		((NULL != ul_xw) && (NULL == ul_yw)) ||
-		((NULL == ul_xw) && (NULL != ul_yw))
-	) {
-		rterror("rt_raster_gdal_warp: Both X and Y upper-left corner values must be provided");
-
-		GDALClose(src_ds);
-
-		for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
-		rtdealloc(transform_opts);
-
+	if (!aligned) {
+		rterror("rt_raster_from_two_rasters: The two rasters provided do not have the same alignment");
+		*err = 0;
 		return NULL;
 	}
 
-	/* skew */
-	if (NULL != skew_x)
-		dst_gt[2] = *skew_x;
-	if (NULL != skew_y)
-		dst_gt[4] = *skew_y;
-
-	/* scale and width/height are mutually exclusive */
-	if (
-		((NULL != scale_x) || (NULL != scale_y)) &&
-		((NULL != width) || (NULL != height))
-	) {
-		rterror("rt_raster_gdal_warp: Scale X/Y and width/height are mutually exclusive.  Only provide one");
-
-		GDALClose(src_ds);
-
-		for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
-		rtdealloc(transform_opts);
+	/* dimensions */
+	_dim[0][0] = rast1->width;
+	_dim[0][1] = rast1->height;
+	_dim[1][0] = rast2->width;
+	_dim[1][1] = rast2->height;
 
+	/* get raster offsets */
+	if (!rt_raster_geopoint_to_cell(
+		_rast[1],
+		_rast[0]->ipX, _rast[0]->ipY,
+		&(_offset[1][0]), &(_offset[1][1]),
+		NULL
+	)) {
+		rterror("rt_raster_from_two_rasters: Unable to compute offsets of the second raster relative to the first raster");
+		*err = 0;
 		return NULL;
 	}
+	_offset[1][0] = -1 * _offset[1][0];
+	_offset[1][1] = -1 * _offset[1][1];
+	_offset[1][2] = _offset[1][0] + _dim[1][0] - 1;
+	_offset[1][3] = _offset[1][1] + _dim[1][1] - 1;
 
-	/* user-defined width/height */
-	if ((NULL != width) && (*width > 0.)) {
-		_width = *width;
-		dst_gt[1] = (dst_extent[2] - dst_extent[0]) / ((double) _width);
-		pix_x = 0;
-	}
-	if ((NULL != height) && (*height > 0.)) {
-		_height = *height;
-		dst_gt[5] = -1 * fabs((dst_extent[3] - dst_extent[1]) / ((double) _height));
-		pix_y = 0;
-	}
+	i = -1;
+	switch (extenttype) {
+		case ET_FIRST:
+			i = 0;
+			_offset[0][0] = 0.;
+			_offset[0][1] = 0.;
+		case ET_SECOND:
+			if (i < 0) {
+				i = 1;
+				_offset[0][0] = -1 * _offset[1][0];
+				_offset[0][1] = -1 * _offset[1][1];
+				_offset[1][0] = 0.;
+				_offset[1][1] = 0.;
+			}
 
-	/* user-defined scale */
-	if (
-		((NULL != scale_x) && (FLT_NEQ(*scale_x, 0.0))) &&
-		((NULL != scale_y) && (FLT_NEQ(*scale_y, 0.0)))
-	) {
-		pix_x = fabs(*scale_x);
-		pix_y = fabs(*scale_y);
-	}
-	else if (
-		((NULL != scale_x) && (NULL == scale_y)) ||
-		((NULL == scale_x) && (NULL != scale_y))
-	) {
-		rterror("rt_raster_gdal_warp: Both X and Y scale values must be provided for scale");
+			dim[0] = _dim[i][0];
+			dim[1] = _dim[i][1];
+			raster = rt_raster_new(
+				dim[0],
+				dim[1]
+			);
+			if (raster == NULL) {
+				rterror("rt_raster_from_two_rasters: Unable to create output raster");
+				*err = 0;
+				return NULL;
+			}
+			rt_raster_set_srid(raster, _rast[i]->srid);
+			rt_raster_get_geotransform_matrix(_rast[i], gt);
+			rt_raster_set_geotransform_matrix(raster, gt);
+			break;
+		case ET_UNION: {
+			double off[4] = {0};
 
-		GDALClose(src_ds);
+			rt_raster_get_geotransform_matrix(_rast[0], gt);
+			RASTER_DEBUGF(4, "gt = (%f, %f, %f, %f, %f, %f)",
+				gt[0],
+				gt[1],
+				gt[2],
+				gt[3],
+				gt[4],
+				gt[5]
+			);
 
-		for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
-		rtdealloc(transform_opts);
+			/* new raster upper left offset */
+			off[0] = 0;
+			if (_offset[1][0] < 0)
+				off[0] = _offset[1][0];
+			off[1] = 0;
+			if (_offset[1][1] < 0)
+				off[1] = _offset[1][1];
 
-		return NULL;
-	}
+			/* new raster lower right offset */
+			off[2] = _dim[0][0] - 1;
+			if ((int) _offset[1][2] >= _dim[0][0])
+				off[2] = _offset[1][2];
+			off[3] = _dim[0][1] - 1;
+			if ((int) _offset[1][3] >= _dim[0][1])
+				off[3] = _offset[1][3];
 
-	/* alignment only considered if upper-left corner not provided */
-	if (
-		!ul_user && (
-			(NULL != grid_xw) || (NULL != grid_yw)
-		)
-	) {
-		if (
-			((NULL != grid_xw) && (NULL == grid_yw)) ||
-			((NULL == grid_xw) && (NULL != grid_yw))
-		) {
-			rterror("rt_raster_gdal_warp: Both X and Y alignment values must be provided");
+			/* upper left corner */
+			if (!rt_raster_cell_to_geopoint(
+				_rast[0],
+				off[0], off[1],
+				&(gt[0]), &(gt[3]),
+				NULL
+			)) {
+				rterror("rt_raster_from_two_rasters: Unable to get spatial coordinates of upper-left pixel of output raster");
+				*err = 0;
+				return NULL;
+			}
 
-			GDALClose(src_ds);
+			dim[0] = off[2] - off[0] + 1;
+			dim[1] = off[3] - off[1] + 1;
+			RASTER_DEBUGF(4, "off = (%f, %f, %f, %f)",
+				off[0],
+				off[1],
+				off[2],
+				off[3]
+			);
+			RASTER_DEBUGF(4, "dim = (%d, %d)", dim[0], dim[1]);
 
-			for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
-			rtdealloc(transform_opts);
+			raster = rt_raster_new(
+				dim[0],
+				dim[1]
+			);
+			if (raster == NULL) {
+				rterror("rt_raster_from_two_rasters: Unable to create output raster");
+				*err = 0;
+				return NULL;
+			}
+			rt_raster_set_srid(raster, _rast[0]->srid);
+			rt_raster_set_geotransform_matrix(raster, gt);
+			RASTER_DEBUGF(4, "gt = (%f, %f, %f, %f, %f, %f)",
+				gt[0],
+				gt[1],
+				gt[2],
+				gt[3],
+				gt[4],
+				gt[5]
+			);
+
+			/* get offsets */
+			if (!rt_raster_geopoint_to_cell(
+				_rast[0],
+				gt[0], gt[3],
+				&(_offset[0][0]), &(_offset[0][1]),
+				NULL
+			)) {
+				rterror("rt_raster_from_two_rasters: Unable to get offsets of the FIRST raster relative to the output raster");
+				rt_raster_destroy(raster);
+				*err = 0;
+				return NULL;
+			}
+			_offset[0][0] *= -1;
+			_offset[0][1] *= -1;
 
-			return NULL;
+			if (!rt_raster_geopoint_to_cell(
+				_rast[1],
+				gt[0], gt[3],
+				&(_offset[1][0]), &(_offset[1][1]),
+				NULL
+			)) {
+				rterror("rt_raster_from_two_rasters: Unable to get offsets of the SECOND raster relative to the output raster");
+				rt_raster_destroy(raster);
+				*err = 0;
+				return NULL;
+			}
+			_offset[1][0] *= -1;
+			_offset[1][1] *= -1;
+			break;
 		}
+		case ET_INTERSECTION: {
+			double off[4] = {0};
 
-		/* use scale for alignment */
-		if (FLT_NEQ(pix_x, 0.))
-			grid_pix_x = pix_x;
-		else
-			grid_pix_x = fabs(dst_gt[1]);
-		if (FLT_NEQ(pix_y, 0.))
-			grid_pix_y = pix_y;
-		else
-			grid_pix_y = fabs(dst_gt[5]);
+			/* no intersection */
+			if (
+				(_offset[1][2] < 0 || _offset[1][0] > (_dim[0][0] - 1)) ||
+				(_offset[1][3] < 0 || _offset[1][1] > (_dim[0][1] - 1))
+			) {
+				RASTER_DEBUG(3, "The two rasters provided have no intersection.  Returning no band raster");
 
-		/* grid shift of upper left to match alignment grid */
-		grid_shift_xw = grid_pix_x * modf(fabs(*grid_xw - dst_gt[0]) / grid_pix_x, &djunk);
-		grid_shift_yw = grid_pix_y * modf(fabs(*grid_yw - dst_gt[3]) / grid_pix_y, &djunk);
+				raster = rt_raster_new(0, 0);
+				if (raster == NULL) {
+					rterror("rt_raster_from_two_rasters: Unable to create output raster");
+					*err = 0;
+					return NULL;
+				}
+				rt_raster_set_srid(raster, _rast[0]->srid);
+				rt_raster_set_scale(raster, 0, 0);
 
-		/* shift along X axis for upper left */
-		if (FLT_NEQ(grid_shift_xw, 0.) && FLT_NEQ(grid_shift_xw, grid_pix_x)) {
-			min_x = dst_gt[0] - grid_shift_xw;
-			min_x = modf(fabs(*grid_xw - min_x) / grid_pix_x, &djunk);
-			if (FLT_NEQ(min_x, 0.) && FLT_NEQ(min_x, 1.))
-				grid_shift_xw = grid_pix_x - grid_shift_xw;
-			min_x = dst_gt[0] - grid_shift_xw;
+				/* set offsets if provided */
+				if (NULL != offset) {
+					for (i = 0; i < 4; i++)
+						offset[i] = _offset[i / 2][i % 2];
+				}
 
-			ul_user = 1;
-		}
-		else
-			min_x = dst_gt[0];
+				*err = 1;
+				return raster;
+			}
 
-		/* shift along Y axis for upper left */
-		if (FLT_NEQ(grid_shift_yw, 0.) && FLT_NEQ(grid_shift_yw, grid_pix_y)) {
-			max_y = dst_gt[3] + grid_shift_yw;
-			max_y = modf(fabs(*grid_yw - max_y) / grid_pix_y, &djunk);
-			if (FLT_NEQ(max_y, 0.) && FLT_NEQ(max_y, 1.))
-				grid_shift_yw = grid_pix_y - grid_shift_yw;
-			max_y = dst_gt[3] + grid_shift_yw;
+			if (_offset[1][0] > 0)
+				off[0] = _offset[1][0];
+			if (_offset[1][1] > 0)
+				off[1] = _offset[1][1];
 
-			ul_user = 1;
-		}
-		else
-			max_y = dst_gt[3];
+			off[2] = _dim[0][0] - 1;
+			if (_offset[1][2] < _dim[0][0])
+				off[2] = _offset[1][2];
+			off[3] = _dim[0][1] - 1;
+			if (_offset[1][3] < _dim[0][1])
+				off[3] = _offset[1][3];
 
-		/* adjust width and height to account new upper left */
-		if (ul_user) {
-			/* use suggested lower right corner */
-			max_x = dst_gt[0] + dst_gt[1] * _width;
-			min_y = dst_gt[3] + dst_gt[5] * _height;
+			dim[0] = off[2] - off[0] + 1;
+			dim[1] = off[3] - off[1] + 1;
+			raster = rt_raster_new(
+				dim[0],
+				dim[1]
+			);
+			if (raster == NULL) {
+				rterror("rt_raster_from_two_rasters: Unable to create output raster");
+				*err = 0;
+				return NULL;
+			}
+			rt_raster_set_srid(raster, _rast[0]->srid);
 
-			/* user defined width */
-			if ((NULL != width) && (*width > 0.))
-				grid_pix_x = fabs((max_x - min_x) / ((double) _width));
-			else
-				_width = (int) ((max_x - min_x + (grid_pix_x / 2.)) / grid_pix_x);
+			/* get upper-left corner */
+			rt_raster_get_geotransform_matrix(_rast[0], gt);
+			if (!rt_raster_cell_to_geopoint(
+				_rast[0],
+				off[0], off[1],
+				&(gt[0]), &(gt[3]),
+				gt
+			)) {
+				rterror("rt_raster_from_two_rasters: Unable to get spatial coordinates of upper-left pixel of output raster");
+				rt_raster_destroy(raster);
+				*err = 0;
+				return NULL;
+			}
 
-			/* user defined height  */
-			if ((NULL != height) && (*height > 0.))
-				grid_pix_y = fabs((max_y - min_y) / ((double) _height));
-			else
-				_height = (int) ((max_y - min_y + (grid_pix_y / 2.)) / grid_pix_y);
+			rt_raster_set_geotransform_matrix(raster, gt);
 
-			dst_gt[1] = grid_pix_x;
-			dst_gt[5] = -1 * grid_pix_y;
-			RASTER_DEBUGF(3, "new dimensions: %d x %d", _width, _height);
+			/* get offsets */
+			if (!rt_raster_geopoint_to_cell(
+				_rast[0],
+				gt[0], gt[3],
+				&(_offset[0][0]), &(_offset[0][1]),
+				NULL
+			)) {
+				rterror("rt_raster_from_two_rasters: Unable to get pixel coordinates to compute the offsets of the FIRST raster relative to the output raster");
+				rt_raster_destroy(raster);
+				*err = 0;
+				return NULL;
+			}
+			_offset[0][0] *= -1;
+			_offset[0][1] *= -1;
+
+			if (!rt_raster_geopoint_to_cell(
+				_rast[1],
+				gt[0], gt[3],
+				&(_offset[1][0]), &(_offset[1][1]),
+				NULL
+			)) {
+				rterror("rt_raster_from_two_rasters: Unable to get pixel coordinates to compute the offsets of the SECOND raster relative to the output raster");
+				rt_raster_destroy(raster);
+				*err = 0;
+				return NULL;
+			}
+			_offset[1][0] *= -1;
+			_offset[1][1] *= -1;
+			break;
 		}
+	}
 
-		RASTER_DEBUGF(3, "shift is: %f, %f", grid_shift_xw, grid_shift_yw);
-		RASTER_DEBUGF(3, "new ul is: %f, %f", min_x, max_y);
+	/* set offsets if provided */
+	if (NULL != offset) {
+		for (i = 0; i < 4; i++)
+			offset[i] = _offset[i / 2][i % 2];
 	}
 
-	/* process user-defined scale */
-	if (
-		(FLT_NEQ(pix_x, 0.0)) ||
-		(FLT_NEQ(pix_y, 0.0))
-	) {
-		/* axis scale is zero, use suggested scale for axis */
-		if (FLT_EQ(pix_x, 0.0))
-			pix_x = fabs(dst_gt[1]);
-		if (FLT_EQ(pix_y, 0.0))
-			pix_y = fabs(dst_gt[5]);
+	*err = 1;
+	return raster;
+}
 
-		/* upper-left corner not provided by user */
-		if (!ul_user) {
-			min_x = dst_gt[0];
-			max_y = dst_gt[3];
-		}
 
-		/* lower-right corner */
-		max_x = min_x + dst_gt[1] * _width;
-		min_y = max_y + dst_gt[5] * _height;
+LWPOLY*
+rt_raster_pixel_as_polygon(rt_raster rast, int x, int y)
+{
+    double scale_x, scale_y;
+    double skew_x, skew_y;
+    double ul_x, ul_y;
+    int srid;
+    POINTARRAY **points;
+    POINT4D p, p0;
+    LWPOLY *poly;
 
-		_width = (int) ((max_x - min_x + (pix_x / 2.)) / pix_x);
-		_height = (int) ((max_y - min_y + (pix_y / 2.)) / pix_y);
-		dst_gt[0] = min_x;
-		dst_gt[3] = max_y;
-		dst_gt[1] = pix_x;
-		dst_gt[5] = -1 * pix_y;
+    scale_x = rt_raster_get_x_scale(rast);
+    scale_y = rt_raster_get_y_scale(rast);
+    skew_x = rt_raster_get_x_skew(rast);
+    skew_y = rt_raster_get_y_skew(rast);
+    ul_x = rt_raster_get_x_offset(rast);
+    ul_y = rt_raster_get_y_offset(rast);
+    srid = rt_raster_get_srid(rast);
 
-		RASTER_DEBUGF(3, "new dimensions: %d x %d", _width, _height);
-	}
-	/* user-defined upper-left corner */
-	else if (ul_user) {
-		dst_gt[0] = min_x;
-		dst_gt[3] = max_y;
-	}
+    points = rtalloc(sizeof(POINTARRAY *)*1);
+    points[0] = ptarray_construct(0, 0, 5);
 
-	RASTER_DEBUGF(3, "Applied geotransform: %f, %f, %f, %f, %f, %f",
-		dst_gt[0], dst_gt[1], dst_gt[2], dst_gt[3], dst_gt[4], dst_gt[5]);
-	RASTER_DEBUGF(3, "Raster dimensions (width x height): %d x %d",
-		_width, _height);
+    p0.x = scale_x * x + skew_x * y + ul_x;
+    p0.y = scale_y * y + skew_y * x + ul_y;
+    ptarray_set_point4d(points[0], 0, &p0);
 
-	if (FLT_EQ(_width, 0.0) || FLT_EQ(_height, 0.0)) {
-		rterror("rt_raster_gdal_warp: The width (%f) or height (%f) of the warped raster is zero", _width, _height);
+    p.x = p0.x + scale_x;
+    p.y = p0.y + skew_y;
+    ptarray_set_point4d(points[0], 1, &p);
 
-		GDALClose(src_ds);
+    p.x = p0.x + scale_x + skew_x;
+    p.y = p0.y + scale_y + skew_y;
+    ptarray_set_point4d(points[0], 2, &p);
 
-		for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
-		rtdealloc(transform_opts);
+    p.x = p0.x + skew_x;
+    p.y = p0.y + scale_y;
+    ptarray_set_point4d(points[0], 3, &p);
 
-		return NULL;
-	}
+    /* close it */
+    ptarray_set_point4d(points[0], 4, &p0);
 
-	/* load VRT driver */
-	if (!rt_util_gdal_driver_registered("VRT"))
-		GDALRegister_VRT();
-	dst_drv = GDALGetDriverByName("VRT");
-	if (NULL == dst_drv) {
-		rterror("rt_raster_gdal_warp: Unable to load the output GDAL VRT driver");
+    poly = lwpoly_construct(srid, NULL, 1, points);
+
+    return poly;
+}
+
+/******************************************************************************
+ * Map algebra pixel expressions
+ *
+ * Expressions of ST_MapAlgebraExpr are compiled into a tree whose nodes
+ * evaluate a whole row of pixels at once.  Every node owns a buffer of
+ * values and a buffer of states (value, NULL or error) so that errors are
+ * only raised for the pixels that actually need the faulty value, the
+ * same way the executor would have lazily evaluated a CASE or COALESCE.
+ *
+ * Values are typed the way PostgreSQL types the equivalent SQL expression
+ * (integer, numeric or double precision) so that integer division,
+ * rounding and range errors match what SPI would have returned.  NUMERIC
+ * values are carried in double precision.
+ *****************************************************************************/
 
-		GDALClose(src_ds);
+typedef enum {
+	MAPEXPR_UNKNOWN = 0, /* NULL literal, takes the type of its context */
+	MAPEXPR_BOOL,
+	MAPEXPR_INT4,
+	MAPEXPR_NUMERIC,
+	MAPEXPR_FLOAT8
+} mapexpr_type;
+
+typedef enum {
+	MAPEXPR_CONST = 0,
+	MAPEXPR_VAR,
+	MAPEXPR_NEG,
+	MAPEXPR_ADD,
+	MAPEXPR_SUB,
+	MAPEXPR_MUL,
+	MAPEXPR_DIV,
+	MAPEXPR_MOD,
+	MAPEXPR_POW,
+	MAPEXPR_EQ,
+	MAPEXPR_NE,
+	MAPEXPR_LT,
+	MAPEXPR_LE,
+	MAPEXPR_GT,
+	MAPEXPR_GE,
+	MAPEXPR_AND,
+	MAPEXPR_OR,
+	MAPEXPR_NOT,
+	MAPEXPR_ISNULL,
+	MAPEXPR_ISNOTNULL,
+	MAPEXPR_BETWEEN, /* args: value, low, high */
+	MAPEXPR_IN, /* args: value, list... */
+	MAPEXPR_CASE, /* args: (cond, result)..., [else] */
+	MAPEXPR_SCASE, /* args: value, (match, result)..., [else] */
+	MAPEXPR_CAST,
+	MAPEXPR_FUNC
+} mapexpr_op;
+
+typedef enum {
+	MAPEXPR_FN_ABS = 0,
+	MAPEXPR_FN_SQRT,
+	MAPEXPR_FN_CBRT,
+	MAPEXPR_FN_EXP,
+	MAPEXPR_FN_LN,
+	MAPEXPR_FN_LOG,
+	MAPEXPR_FN_POWER,
+	MAPEXPR_FN_FLOOR,
+	MAPEXPR_FN_CEIL,
+	MAPEXPR_FN_ROUND,
+	MAPEXPR_FN_TRUNC,
+	MAPEXPR_FN_SIGN,
+	MAPEXPR_FN_MOD,
+	MAPEXPR_FN_SIN,
+	MAPEXPR_FN_COS,
+	MAPEXPR_FN_TAN,
+	MAPEXPR_FN_ASIN,
+	MAPEXPR_FN_ACOS,
+	MAPEXPR_FN_ATAN,
+	MAPEXPR_FN_ATAN2,
+	MAPEXPR_FN_DEGREES,
+	MAPEXPR_FN_RADIANS,
+	MAPEXPR_FN_PI,
+	MAPEXPR_FN_GREATEST,
+	MAPEXPR_FN_LEAST,
+	MAPEXPR_FN_COALESCE,
+	MAPEXPR_FN_NULLIF
+} mapexpr_fn;
+
+/* how the arguments of a function are typed */
+typedef enum {
+	MAPEXPR_FNARG_FLOAT8 = 0, /* double precision only */
+	MAPEXPR_FNARG_NUMERIC, /* double precision or numeric, prefers double */
+	MAPEXPR_FNARG_SAME, /* integer, numeric or double, result of same type */
+	MAPEXPR_FNARG_EXACT, /* integer or numeric only */
+	MAPEXPR_FNARG_ANY /* any type, result is the common type */
+} mapexpr_fnarg;
+
+static const struct {
+	const char *name;
+	mapexpr_fn fn;
+	int minargs;
+	int maxargs;
+	mapexpr_fnarg argtype;
+} mapexpr_fns[] = {
+	{"abs", MAPEXPR_FN_ABS, 1, 1, MAPEXPR_FNARG_SAME},
+	{"sqrt", MAPEXPR_FN_SQRT, 1, 1, MAPEXPR_FNARG_NUMERIC},
+	{"cbrt", MAPEXPR_FN_CBRT, 1, 1, MAPEXPR_FNARG_FLOAT8},
+	{"exp", MAPEXPR_FN_EXP, 1, 1, MAPEXPR_FNARG_NUMERIC},
+	{"ln", MAPEXPR_FN_LN, 1, 1, MAPEXPR_FNARG_NUMERIC},
+	{"log", MAPEXPR_FN_LOG, 1, 1, MAPEXPR_FNARG_NUMERIC},
+	{"power", MAPEXPR_FN_POWER, 2, 2, MAPEXPR_FNARG_NUMERIC},
+	{"pow", MAPEXPR_FN_POWER, 2, 2, MAPEXPR_FNARG_NUMERIC},
+	{"floor", MAPEXPR_FN_FLOOR, 1, 1, MAPEXPR_FNARG_NUMERIC},
+	{"ceil", MAPEXPR_FN_CEIL, 1, 1, MAPEXPR_FNARG_NUMERIC},
+	{"ceiling", MAPEXPR_FN_CEIL, 1, 1, MAPEXPR_FNARG_NUMERIC},
+	{"round", MAPEXPR_FN_ROUND, 1, 2, MAPEXPR_FNARG_NUMERIC},
+	{"trunc", MAPEXPR_FN_TRUNC, 1, 2, MAPEXPR_FNARG_NUMERIC},
+	{"sign", MAPEXPR_FN_SIGN, 1, 1, MAPEXPR_FNARG_NUMERIC},
+	{"mod", MAPEXPR_FN_MOD, 2, 2, MAPEXPR_FNARG_EXACT},
+	{"sin", MAPEXPR_FN_SIN, 1, 1, MAPEXPR_FNARG_FLOAT8},
+	{"cos", MAPEXPR_FN_COS, 1, 1, MAPEXPR_FNARG_FLOAT8},
+	{"tan", MAPEXPR_FN_TAN, 1, 1, MAPEXPR_FNARG_FLOAT8},
+	{"asin", MAPEXPR_FN_ASIN, 1, 1, MAPEXPR_FNARG_FLOAT8},
+	{"acos", MAPEXPR_FN_ACOS, 1, 1, MAPEXPR_FNARG_FLOAT8},
+	{"atan", MAPEXPR_FN_ATAN, 1, 1, MAPEXPR_FNARG_FLOAT8},
+	{"atan2", MAPEXPR_FN_ATAN2, 2, 2, MAPEXPR_FNARG_FLOAT8},
+	{"degrees", MAPEXPR_FN_DEGREES, 1, 1, MAPEXPR_FNARG_FLOAT8},
+	{"radians", MAPEXPR_FN_RADIANS, 1, 1, MAPEXPR_FNARG_FLOAT8},
+	{"pi", MAPEXPR_FN_PI, 0, 0, MAPEXPR_FNARG_FLOAT8},
+	{"greatest", MAPEXPR_FN_GREATEST, 1, 100, MAPEXPR_FNARG_ANY},
+	{"least", MAPEXPR_FN_LEAST, 1, 100, MAPEXPR_FNARG_ANY},
+	{"coalesce", MAPEXPR_FN_COALESCE, 1, 100, MAPEXPR_FNARG_ANY},
+	{"nullif", MAPEXPR_FN_NULLIF, 2, 2, MAPEXPR_FNARG_ANY},
+	{NULL, 0, 0, 0, 0}
+};
 
-		return NULL;
-	}
+/* keywords of the one and two raster map algebra */
+static const struct {
+	const char *keyword;
+	int nrast;
+	rt_mapexpr_var var;
+} mapexpr_keywords[] = {
+	{"[rast]", 1, RT_MAPEXPR_VAL1},
+	{"[rast.val]", 1, RT_MAPEXPR_VAL1},
+	{"[rast.x]", 1, RT_MAPEXPR_X1},
+	{"[rast.y]", 1, RT_MAPEXPR_Y1},
+	{"[rast1]", 2, RT_MAPEXPR_VAL1},
+	{"[rast1.val]", 2, RT_MAPEXPR_VAL1},
+	{"[rast1.x]", 2, RT_MAPEXPR_X1},
+	{"[rast1.y]", 2, RT_MAPEXPR_Y1},
+	{"[rast2]", 2, RT_MAPEXPR_VAL2},
+	{"[rast2.val]", 2, RT_MAPEXPR_VAL2},
+	{"[rast2.x]", 2, RT_MAPEXPR_X2},
+	{"[rast2.y]", 2, RT_MAPEXPR_Y2},
+	{NULL, 0, 0}
+};
 
-	/* create dst dataset */
-	dst_ds = GDALCreate(dst_drv, "", _width, _height, 0, GDT_Byte, dst_options);
-	if (NULL == dst_ds) {
-		rterror("rt_raster_gdal_warp: Unable to create GDAL VRT dataset");
+typedef struct mapexpr_node_t *mapexpr_node;
+struct mapexpr_node_t {
+	mapexpr_op op;
+	mapexpr_type type;
+	mapexpr_fn fn; /* MAPEXPR_FUNC */
+	rt_mapexpr_var var; /* MAPEXPR_VAR */
+	int negate; /* NOT BETWEEN, NOT IN */
+	int haselse; /* MAPEXPR_CASE, MAPEXPR_SCASE */
 
-		GDALClose(src_ds);
+	double constval; /* MAPEXPR_CONST */
+	uint8_t conststatus;
 
-		for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
-		rtdealloc(transform_opts);
+	int nargs;
+	mapexpr_node *args;
 
-		return NULL;
-	}
+	/* row buffers */
+	double *values;
+	uint8_t *status;
+};
 
-	/* add bands to dst dataset */
-	numBands = rt_raster_get_num_bands(raster);
-	for (i = 0; i < numBands; i++) {
-		rtband = rt_raster_get_band(raster, i);
-		if (NULL == rtband) {
-			rterror("rt_raster_gdal_warp: Unable to get band %d for adding to VRT dataset", i);
+struct rt_mapexpr_t {
+	mapexpr_node root;
+	int uses[RT_MAPEXPR_NVARS];
 
-			GDALClose(dst_ds);
-			GDALClose(src_ds);
+	uint32_t capacity; /* size of the row buffers */
+	uint8_t *nonull; /* states of variables that are never NULL */
+};
 
-			for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
-			rtdealloc(transform_opts);
+/* token of the expression lexer */
+typedef enum {
+	MAPEXPR_TK_END = 0,
+	MAPEXPR_TK_INT,
+	MAPEXPR_TK_NUMERIC,
+	MAPEXPR_TK_VAR,
+	MAPEXPR_TK_IDENT,
+	MAPEXPR_TK_OP,
+	MAPEXPR_TK_LPAREN,
+	MAPEXPR_TK_RPAREN,
+	MAPEXPR_TK_COMMA
+} mapexpr_token;
+
+typedef struct {
+	const char *input;
+	const char *pos;
+	int nrast;
+
+	mapexpr_token tk;
+	char text[64]; /* identifier (lowercase) or operator */
+	double num;
+	rt_mapexpr_var var;
+
+	int failed;
+	int uses[RT_MAPEXPR_NVARS];
+} mapexpr_parser;
+
+#define MAPEXPR_OPCHARS "+-*/<>=~!@#%^&|`?"
 
-			return NULL;
-		}
+static void
+mapexpr_next(mapexpr_parser *p) {
+	const char *s = p->pos;
+	int len = 0;
+	int i;
 
-		pt = rt_band_get_pixtype(rtband);
-		gdal_pt = rt_util_pixtype_to_gdal_datatype(pt);
-		if (gdal_pt == GDT_Unknown)
-			rtwarn("rt_raster_gdal_warp: Unknown pixel type for band %d", i);
+	if (p->failed) {
+		p->tk = MAPEXPR_TK_END;
+		return;
+	}
 
-		cplerr = GDALAddBand(dst_ds, gdal_pt, NULL);
-		if (cplerr != CE_None) {
-			rterror("rt_raster_gdal_warp: Unable to add band to VRT dataset");
+	while (*s && isspace((unsigned char) *s)) s++;
 
-			GDALClose(dst_ds);
-			GDALClose(src_ds);
+	p->text[0] = '\0';
+	if (*s == '\0') {
+		p->tk = MAPEXPR_TK_END;
+		p->pos = s;
+		return;
+	}
 
-			for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
-			rtdealloc(transform_opts);
+	/* numeric literals, integers without decimal point or exponent */
+	if (isdigit((unsigned char) *s) || (*s == '.' && isdigit((unsigned char) s[1]))) {
+		const char *start = s;
+		char *end = NULL;
+		int isint = 1;
 
-			return NULL;
+		while (isdigit((unsigned char) *s)) s++;
+		if (*s == '.') {
+			isint = 0;
+			s++;
+			while (isdigit((unsigned char) *s)) s++;
+		}
+		if (*s == 'e' || *s == 'E') {
+			const char *e = s + 1;
+			if (*e == '+' || *e == '-') e++;
+			if (isdigit((unsigned char) *e)) {
+				isint = 0;
+				s = e;
+				while (isdigit((unsigned char) *s)) s++;
+			}
+		}
+		/* a number immediately followed by a letter is not a number */
+		if (isalpha((unsigned char) *s) || *s == '_') {
+			p->failed = 1;
+			p->tk = MAPEXPR_TK_END;
+			return;
 		}
 
-		/* get band to write data to */
-		band = NULL;
-		band = GDALGetRasterBand(dst_ds, i + 1);
-		if (NULL == band) {
-			rterror("rt_raster_gdal_warp: Could not get GDAL band for additional processing");
-
-			GDALClose(dst_ds);
-			GDALClose(src_ds);
+		p->num = strtod(start, &end);
+		/* integer literals not fitting in int4 would be bigint */
+		if (isint && p->num > INT_MAX) {
+			p->failed = 1;
+			p->tk = MAPEXPR_TK_END;
+			return;
+		}
 
-			for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
-			rtdealloc(transform_opts);
+		p->tk = isint ? MAPEXPR_TK_INT : MAPEXPR_TK_NUMERIC;
+		p->pos = s;
+		return;
+	}
 
-			return NULL;
+	/* keywords */
+	if (*s == '[') {
+		const char *end = strchr(s, ']');
+		if (end != NULL) {
+			len = end - s + 1;
+			for (i = 0; mapexpr_keywords[i].keyword != NULL; i++) {
+				if (
+					mapexpr_keywords[i].nrast == p->nrast &&
+					strlen(mapexpr_keywords[i].keyword) == (size_t) len &&
+					strncmp(mapexpr_keywords[i].keyword, s, len) == 0
+				) {
+					p->tk = MAPEXPR_TK_VAR;
+					p->var = mapexpr_keywords[i].var;
+					p->uses[p->var] = 1;
+					p->pos = s + len;
+					return;
+				}
+			}
 		}
+		p->failed = 1;
+		p->tk = MAPEXPR_TK_END;
+		return;
+	}
 
-		/* set nodata */
-		if (rt_band_get_hasnodata_flag(rtband) != FALSE) {
-			nodata = rt_band_get_nodata(rtband);
-			if (GDALSetRasterNoDataValue(band, nodata) != CE_None)
-				rtwarn("rt_raster_gdal_warp: Could not set nodata value for band %d", i);
-			RASTER_DEBUGF(3, "nodata value set to %f", GDALGetRasterNoDataValue(band, NULL));
-		}
+	/* identifiers, folded to lowercase */
+	if (isalpha((unsigned char) *s) || *s == '_') {
+		while (isalnum((unsigned char) *s) || *s == '_') {
+			if (len >= (int) sizeof(p->text) - 1) {
+				p->failed = 1;
+				p->tk = MAPEXPR_TK_END;
+				return;
+			}
+			p->text[len++] = tolower((unsigned char) *s);
+			s++;
+		}
+		p->text[len] = '\0';
+		p->tk = MAPEXPR_TK_IDENT;
+		p->pos = s;
+		return;
+	}
+
+	switch (*s) {
+		case '(':
+			p->tk = MAPEXPR_TK_LPAREN;
+			p->pos = s + 1;
+			return;
+		case ')':
+			p->tk = MAPEXPR_TK_RPAREN;
+			p->pos = s + 1;
+			return;
+		case ',':
+			p->tk = MAPEXPR_TK_COMMA;
+			p->pos = s + 1;
+			return;
+		case ':':
+			if (s[1] == ':') {
+				strcpy(p->text, "::");
+				p->tk = MAPEXPR_TK_OP;
+				p->pos = s + 2;
+				return;
+			}
+			break;
 	}
 
-	/* set dst srs */
-	_dst_srs = rt_util_gdal_convert_sr((NULL == dst_srs ? src_srs : dst_srs), 1);
-	cplerr = GDALSetProjection(dst_ds, _dst_srs);
-	CPLFree(_dst_srs);
-	if (cplerr != CE_None) {
-		rterror("rt_raster_gdal_warp: Unable to set projection");
+	/*
+		operators are lexed as the backend does: the longest run of operator
+		characters, trailing + and - being left out unless the operator
+		contains one of ~ ! @ # % ^ & | ` ?
+	*/
+	if (strchr(MAPEXPR_OPCHARS, *s) != NULL) {
+		int special = 0;
 
-		GDALClose(dst_ds);
-		GDALClose(src_ds);
+		while (s[len] && strchr(MAPEXPR_OPCHARS, s[len]) != NULL) {
+			/* comments */
+			if (
+				(s[len] == '-' && s[len + 1] == '-') ||
+				(s[len] == '/' && s[len + 1] == '*')
+			) {
+				break;
+			}
+			if (strchr("~!@#%^&|`?", s[len]) != NULL) special = 1;
+			len++;
+		}
+		if (len == 0 || len >= (int) sizeof(p->text)) {
+			p->failed = 1;
+			p->tk = MAPEXPR_TK_END;
+			return;
+		}
+		while (len > 1 && !special && (s[len - 1] == '+' || s[len - 1] == '-'))
+			len--;
 
-		for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
-		rtdealloc(transform_opts);
+		strncpy(p->text, s, len);
+		p->text[len] = '\0';
+		if (strcmp(p->text, "!=") == 0)
+			strcpy(p->text, "<>");
 
-		return NULL;
+		p->tk = MAPEXPR_TK_OP;
+		p->pos = s + len;
+		return;
 	}
 
-	/* set dst geotransform */
-	cplerr = GDALSetGeoTransform(dst_ds, dst_gt);
-	if (cplerr != CE_None) {
-		rterror("rt_raster_gdal_warp: Unable to set geotransform");
+	/* strings, quoted identifiers, parameters... */
+	p->failed = 1;
+	p->tk = MAPEXPR_TK_END;
+}
 
-		GDALClose(dst_ds);
-		GDALClose(src_ds);
+static int
+mapexpr_is_ident(mapexpr_parser *p, const char *ident) {
+	return (p->tk == MAPEXPR_TK_IDENT && strcmp(p->text, ident) == 0);
+}
 
-		for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
-		rtdealloc(transform_opts);
+static int
+mapexpr_is_op(mapexpr_parser *p, const char *op) {
+	return (p->tk == MAPEXPR_TK_OP && strcmp(p->text, op) == 0);
+}
 
-		return NULL;
+static int
+mapexpr_expect_ident(mapexpr_parser *p, const char *ident) {
+	if (!mapexpr_is_ident(p, ident)) {
+		p->failed = 1;
+		return 0;
 	}
+	mapexpr_next(p);
+	return 1;
+}
 
-	/* create transformation object */
-	transform_arg = imgproj_arg = GDALCreateGenImgProjTransformer2(src_ds, dst_ds, transform_opts);
-	if (NULL == transform_arg) {
-		rterror("rt_raster_gdal_warp: Unable to create GDAL transformation object");
+static void
+mapexpr_node_destroy(mapexpr_node node) {
+	int i;
 
-		GDALClose(dst_ds);
-		GDALClose(src_ds);
+	if (node == NULL) return;
 
-		for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
-		rtdealloc(transform_opts);
+	for (i = 0; i < node->nargs; i++)
+		mapexpr_node_destroy(node->args[i]);
+	if (node->args != NULL) rtdealloc(node->args);
 
-		return NULL;
+	/* variables point to the caller's buffers */
+	if (node->op != MAPEXPR_VAR) {
+		if (node->values != NULL) rtdealloc(node->values);
+		if (node->status != NULL) rtdealloc(node->status);
 	}
-	transform_func = GDALGenImgProjTransform;
-
-	/* use approximate transformation object */
-	if (max_err > 0.0) {
-		transform_arg = approx_arg = GDALCreateApproxTransformer(
-			GDALGenImgProjTransform,
-			imgproj_arg, max_err
-		);
-		if (NULL == transform_arg) {
-			rterror("rt_raster_gdal_warp: Unable to create GDAL approximate transformation object");
-
-			GDALClose(dst_ds);
-			GDALClose(src_ds);
-
-			GDALDestroyGenImgProjTransformer(imgproj_arg);
-			for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
-			rtdealloc(transform_opts);
 
-			return NULL;
-		}
+	rtdealloc(node);
+}
 
-		transform_func = GDALApproxTransform;
+static mapexpr_node
+mapexpr_node_new(mapexpr_op op, mapexpr_type type) {
+	mapexpr_node node = rtalloc(sizeof(struct mapexpr_node_t));
+	if (node == NULL) {
+		rterror("mapexpr_node_new: Unable to allocate memory for expression node");
+		return NULL;
 	}
+	memset(node, 0, sizeof(struct mapexpr_node_t));
 
-	/* warp options */
-	wopts = GDALCreateWarpOptions();
-	if (NULL == wopts) {
-		rterror("rt_raster_gdal_warp: Unable to create GDAL warp options object");
+	node->op = op;
+	node->type = type;
 
-		GDALClose(dst_ds);
-		GDALClose(src_ds);
+	return node;
+}
 
-		GDALDestroyGenImgProjTransformer(imgproj_arg);
-		GDALDestroyApproxTransformer(approx_arg);
-		for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
-		rtdealloc(transform_opts);
+static int
+mapexpr_node_add_arg(mapexpr_node node, mapexpr_node arg) {
+	mapexpr_node *args = NULL;
 
-		return NULL;
+	if (arg == NULL) return 0;
+
+	args = rtrealloc(node->args, sizeof(mapexpr_node) * (node->nargs + 1));
+	if (args == NULL) {
+		rterror("mapexpr_node_add_arg: Unable to allocate memory for expression node arguments");
+		mapexpr_node_destroy(arg);
+		return 0;
 	}
+	node->args = args;
+	node->args[node->nargs++] = arg;
 
-	/* set options */
-	wopts->eResampleAlg = resample_alg;
-	wopts->hSrcDS = src_ds;
-	wopts->hDstDS = dst_ds;
-	wopts->pfnTransformer = transform_func;
-	wopts->pTransformerArg = transform_arg;
-	wopts->papszWarpOptions = (char **) CPLMalloc(sizeof(char *) * 2);
-	wopts->papszWarpOptions[0] = (char *) CPLMalloc(sizeof(char) * (strlen("INIT_DEST=NO_DATA") + 1));
-	strcpy(wopts->papszWarpOptions[0], "INIT_DEST=NO_DATA");
-	wopts->papszWarpOptions[1] = NULL;
+	return 1;
+}
 
-	/* set band mapping */
-	wopts->nBandCount = numBands;
-	wopts->panSrcBands = (int *) CPLMalloc(sizeof(int) * wopts->nBandCount);
-	wopts->panDstBands = (int *) CPLMalloc(sizeof(int) * wopts->nBandCount);
-	for (i = 0; i < wopts->nBandCount; i++)
-		wopts->panDstBands[i] = wopts->panSrcBands[i] = i + 1;
+static mapexpr_node
+mapexpr_node_const(mapexpr_type type, double value, uint8_t status) {
+	mapexpr_node node = mapexpr_node_new(MAPEXPR_CONST, type);
+	if (node == NULL) return NULL;
 
-	/* set nodata mapping */
-	RASTER_DEBUG(3, "Setting nodata mapping");
-	wopts->padfSrcNoDataReal = (double *) CPLMalloc(numBands * sizeof(double));
-	wopts->padfDstNoDataReal = (double *) CPLMalloc(numBands * sizeof(double));
-	wopts->padfSrcNoDataImag = (double *) CPLMalloc(numBands * sizeof(double));
-	wopts->padfDstNoDataImag = (double *) CPLMalloc(numBands * sizeof(double));
-	if (
-		NULL == wopts->padfSrcNoDataReal ||
-		NULL == wopts->padfDstNoDataReal ||
-		NULL == wopts->padfSrcNoDataImag ||
-		NULL == wopts->padfDstNoDataImag
-	) {
-		rterror("rt_raster_gdal_warp: Out of memory allocating nodata mapping");
+	node->constval = value;
+	node->conststatus = status;
 
-		GDALClose(dst_ds);
-		GDALClose(src_ds);
+	return node;
+}
 
-		GDALDestroyGenImgProjTransformer(imgproj_arg);
-		GDALDestroyApproxTransformer(approx_arg);
-		GDALDestroyWarpOptions(wopts);
-		for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
-		rtdealloc(transform_opts);
+static int
+mapexpr_is_numeric_type(mapexpr_type type) {
+	return (
+		type == MAPEXPR_UNKNOWN ||
+		type == MAPEXPR_INT4 ||
+		type == MAPEXPR_NUMERIC ||
+		type == MAPEXPR_FLOAT8
+	);
+}
 
-		return NULL;
-	}
-	for (i = 0; i < numBands; i++) {
-		band = rt_raster_get_band(raster, i);
-		if (!band) {
-			rterror("rt_raster_gdal_warp: Unable to process bands for nodata values");
+/* common type of two values, -1 if they can't be mixed */
+static int
+mapexpr_common_type(mapexpr_type a, mapexpr_type b) {
+	if (a == MAPEXPR_UNKNOWN) return b;
+	if (b == MAPEXPR_UNKNOWN) return a;
+	if (a == MAPEXPR_BOOL || b == MAPEXPR_BOOL)
+		return (a == b) ? MAPEXPR_BOOL : -1;
 
-			GDALClose(dst_ds);
-			GDALClose(src_ds);
+	/* integer < numeric < double precision */
+	return (a > b) ? a : b;
+}
 
-			GDALDestroyGenImgProjTransformer(imgproj_arg);
-			GDALDestroyApproxTransformer(approx_arg);
-			GDALDestroyWarpOptions(wopts);
-			for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
-			rtdealloc(transform_opts);
+/* ordering of double precision values, NaN being greater than anything */
+static int
+mapexpr_cmp(double a, double b) {
+	if (isnan(a)) return isnan(b) ? 0 : 1;
+	if (isnan(b)) return -1;
+	if (a > b) return 1;
+	if (a < b) return -1;
+	return 0;
+}
 
-			return NULL;
-		}
+/* result state of a function of two strict arguments */
+#define MAPEXPR_STRICT2(sa, sb) \
+	((sa) > RT_MAPEXPR_NULL ? (sa) : \
+	((sb) > RT_MAPEXPR_NULL ? (sb) : \
+	(((sa) || (sb)) ? RT_MAPEXPR_NULL : RT_MAPEXPR_OK)))
 
-		if (!rt_band_get_hasnodata_flag(band)) {
-			/*
-				based on line 1004 of gdalwarp.cpp
-				the problem is that there is a chance that this number is a legitimate value
-			*/
-			wopts->padfSrcNoDataReal[i] = -123456.789;
-		}
-		else {
-			wopts->padfSrcNoDataReal[i] = rt_band_get_nodata(band);
-		}
+/* check a double precision result as float8 operators do */
+static uint8_t
+mapexpr_check_float(double result, int inf_is_valid, int zero_is_valid) {
+	if (isinf(result) && !inf_is_valid)
+		return RT_MAPEXPR_ERR_OVERFLOW;
+	if (result == 0.0 && !zero_is_valid)
+		return RT_MAPEXPR_ERR_UNDERFLOW;
+	return RT_MAPEXPR_OK;
+}
 
-		wopts->padfDstNoDataReal[i] = wopts->padfSrcNoDataReal[i];
-		wopts->padfDstNoDataImag[i] = wopts->padfSrcNoDataImag[i] = 0.0;
-		RASTER_DEBUGF(4, "Mapped nodata value for band %d: %f (%f) => %f (%f)",
-			i,
-			wopts->padfSrcNoDataReal[i], wopts->padfSrcNoDataImag[i],
-			wopts->padfDstNoDataReal[i], wopts->padfDstNoDataImag[i]
-		);
-	}
+/* check an integer result */
+static uint8_t
+mapexpr_check_int(double result) {
+	if (isnan(result) || result < INT_MIN || result > INT_MAX)
+		return RT_MAPEXPR_ERR_INTRANGE;
+	return RT_MAPEXPR_OK;
+}
 
-	/* warp raster */
-	RASTER_DEBUG(3, "Warping raster");
-	cplerr = GDALInitializeWarpedVRT(dst_ds, wopts);
-	if (cplerr != CE_None) {
-		rterror("rt_raster_gdal_warp: Unable to warp raster");
+/* numeric representation of a double precision value (15 significant digits) */
+static double
+mapexpr_float8_to_numeric(double value) {
+	char buf[32];
 
-		GDALClose(dst_ds);
-		GDALClose(src_ds);
+	if (isnan(value)) return value;
 
-		if ((transform_func == GDALApproxTransform) && (NULL != imgproj_arg))
-			GDALDestroyGenImgProjTransformer(imgproj_arg);
-		GDALDestroyWarpOptions(wopts);
-		for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
-		rtdealloc(transform_opts);
+	snprintf(buf, sizeof(buf), "%.*g", DBL_DIG, value);
+	return strtod(buf, NULL);
+}
 
-		return NULL;
-	}
-	GDALFlushCache(dst_ds);
-	RASTER_DEBUG(3, "Raster warped");
+/* round numeric value half away from zero at the given decimal scale */
+static double
+mapexpr_numeric_round(double value, int scale, int truncate) {
+	double factor;
+	double scaled;
 
-	/* convert gdal dataset to raster */
-	RASTER_DEBUG(3, "Converting GDAL dataset to raster");
-	rast = rt_raster_from_gdal_dataset(dst_ds);
+	if (isnan(value)) return value;
 
-	GDALClose(dst_ds);
-	GDALClose(src_ds);
+	factor = pow(10, abs(scale));
+	scaled = (scale >= 0) ? value * factor : value / factor;
+	/* drop the binary noise of the scaling */
+	scaled = mapexpr_float8_to_numeric(scaled);
+	scaled = truncate ? trunc(scaled) : round(scaled);
 
-	if ((transform_func == GDALApproxTransform) && (NULL != imgproj_arg))
-		GDALDestroyGenImgProjTransformer(imgproj_arg);
-	GDALDestroyWarpOptions(wopts);
-	for (i = 0; i < transform_opts_len; i++) rtdealloc(transform_opts[i]);
-	rtdealloc(transform_opts);
+	return (scale >= 0) ? scaled / factor : scaled * factor;
+}
 
-	if (NULL == rast) {
-		rterror("rt_raster_gdal_warp: Unable to warp raster");
-		return NULL;
+/*
+	compute one value of an arithmetic operator or function of one or
+	two arguments whose states are OK
+*/
+static uint8_t
+mapexpr_compute(mapexpr_node node, double a, double b, double *result) {
+	int isfloat = (node->type == MAPEXPR_FLOAT8 || node->type == MAPEXPR_NUMERIC);
+	int64_t ia;
+	int64_t ib;
+
+	switch (node->op) {
+		case MAPEXPR_NEG:
+			*result = -a;
+			return (node->type == MAPEXPR_INT4) ? mapexpr_check_int(*result) : RT_MAPEXPR_OK;
+		case MAPEXPR_ADD:
+			*result = a + b;
+			if (!isfloat) return mapexpr_check_int(*result);
+			return mapexpr_check_float(*result, isinf(a) || isinf(b), 1);
+		case MAPEXPR_SUB:
+			*result = a - b;
+			if (!isfloat) return mapexpr_check_int(*result);
+			return mapexpr_check_float(*result, isinf(a) || isinf(b), 1);
+		case MAPEXPR_MUL:
+			*result = a * b;
+			if (!isfloat) return mapexpr_check_int(*result);
+			return mapexpr_check_float(*result, isinf(a) || isinf(b), a == 0 || b == 0);
+		case MAPEXPR_DIV:
+			if (b == 0)
+				return RT_MAPEXPR_ERR_DIVZERO;
+			if (!isfloat) {
+				ia = (int64_t) a;
+				ib = (int64_t) b;
+				*result = (double) (ia / ib);
+				return mapexpr_check_int(*result);
+			}
+			*result = a / b;
+			return mapexpr_check_float(*result, isinf(a), a == 0);
+		case MAPEXPR_MOD:
+			if (b == 0)
+				return RT_MAPEXPR_ERR_DIVZERO;
+			if (!isfloat) {
+				ia = (int64_t) a;
+				ib = (int64_t) b;
+				*result = (double) (ia % ib);
+				return RT_MAPEXPR_OK;
+			}
+			*result = fmod(a, b);
+			return RT_MAPEXPR_OK;
+		case MAPEXPR_POW:
+			if (a == 0 && b < 0)
+				return RT_MAPEXPR_ERR_POWZERO;
+			if (a < 0 && floor(b) != b)
+				return RT_MAPEXPR_ERR_POWNEG;
+			*result = pow(a, b);
+			return mapexpr_check_float(*result, isinf(a) || isinf(b), a == 0);
+		case MAPEXPR_FUNC:
+			break;
+		default:
+			return RT_MAPEXPR_OK;
+	}
+
+	switch (node->fn) {
+		case MAPEXPR_FN_ABS:
+			*result = fabs(a);
+			return (node->type == MAPEXPR_INT4) ? mapexpr_check_int(*result) : RT_MAPEXPR_OK;
+		case MAPEXPR_FN_SQRT:
+			if (a < 0)
+				return RT_MAPEXPR_ERR_SQRTNEG;
+			*result = sqrt(a);
+			return RT_MAPEXPR_OK;
+		case MAPEXPR_FN_CBRT:
+			*result = cbrt(a);
+			return RT_MAPEXPR_OK;
+		case MAPEXPR_FN_EXP:
+			*result = exp(a);
+			return mapexpr_check_float(*result, isinf(a), 1);
+		case MAPEXPR_FN_LN:
+		case MAPEXPR_FN_LOG:
+			if (a == 0)
+				return RT_MAPEXPR_ERR_LOGZERO;
+			if (a < 0)
+				return RT_MAPEXPR_ERR_LOGNEG;
+			*result = (node->fn == MAPEXPR_FN_LN) ? log(a) : log10(a);
+			return RT_MAPEXPR_OK;
+		case MAPEXPR_FN_POWER:
+			if (a == 0 && b < 0)
+				return RT_MAPEXPR_ERR_POWZERO;
+			if (a < 0 && floor(b) != b)
+				return RT_MAPEXPR_ERR_POWNEG;
+			*result = pow(a, b);
+			return mapexpr_check_float(*result, isinf(a) || isinf(b), a == 0);
+		case MAPEXPR_FN_FLOOR:
+			*result = floor(a);
+			return RT_MAPEXPR_OK;
+		case MAPEXPR_FN_CEIL:
+			*result = ceil(a);
+			return RT_MAPEXPR_OK;
+		case MAPEXPR_FN_ROUND:
+		case MAPEXPR_FN_TRUNC:
+			if (node->nargs > 1)
+				*result = mapexpr_numeric_round(a, (int) b, node->fn == MAPEXPR_FN_TRUNC);
+			else if (node->fn == MAPEXPR_FN_TRUNC)
+				*result = trunc(a);
+			/* double precision rounds half to even, numeric half away from zero */
+			else if (node->type == MAPEXPR_FLOAT8)
+				*result = rint(a);
+			else
+				*result = round(a);
+			return RT_MAPEXPR_OK;
+		case MAPEXPR_FN_SIGN:
+			*result = (a > 0) ? 1 : ((a < 0) ? -1 : 0);
+			return RT_MAPEXPR_OK;
+		case MAPEXPR_FN_MOD:
+			if (b == 0)
+				return RT_MAPEXPR_ERR_DIVZERO;
+			if (node->type == MAPEXPR_INT4) {
+				ia = (int64_t) a;
+				ib = (int64_t) b;
+				*result = (double) (ia % ib);
+			}
+			else
+				*result = fmod(a, b);
+			return RT_MAPEXPR_OK;
+		case MAPEXPR_FN_SIN:
+		case MAPEXPR_FN_COS:
+		case MAPEXPR_FN_TAN:
+			if (isinf(a))
+				return RT_MAPEXPR_ERR_RANGE;
+			if (node->fn == MAPEXPR_FN_SIN)
+				*result = sin(a);
+			else if (node->fn == MAPEXPR_FN_COS)
+				*result = cos(a);
+			else
+				*result = tan(a);
+			return RT_MAPEXPR_OK;
+		case MAPEXPR_FN_ASIN:
+		case MAPEXPR_FN_ACOS:
+			if (a < -1 || a > 1)
+				return RT_MAPEXPR_ERR_RANGE;
+			*result = (node->fn == MAPEXPR_FN_ASIN) ? asin(a) : acos(a);
+			return RT_MAPEXPR_OK;
+		case MAPEXPR_FN_ATAN:
+			*result = atan(a);
+			return RT_MAPEXPR_OK;
+		case MAPEXPR_FN_ATAN2:
+			*result = atan2(a, b);
+			return RT_MAPEXPR_OK;
+		case MAPEXPR_FN_DEGREES:
+			*result = a * (180.0 / M_PI);
+			return mapexpr_check_float(*result, isinf(a), a == 0);
+		case MAPEXPR_FN_RADIANS:
+			*result = a * (M_PI / 180.0);
+			return mapexpr_check_float(*result, isinf(a), a == 0);
+		case MAPEXPR_FN_PI:
+			*result = M_PI;
+			return RT_MAPEXPR_OK;
+		default:
+			break;
 	}
 
-	RASTER_DEBUG(3, "done");
+	return RT_MAPEXPR_OK;
+}
 
-	return rast;
+/* cast one value whose state is OK */
+static uint8_t
+mapexpr_cast(mapexpr_type from, mapexpr_type to, double value, double *result) {
+	*result = value;
+
+	if (from == to)
+		return RT_MAPEXPR_OK;
+
+	switch (to) {
+		case MAPEXPR_INT4:
+			/* double precision rounds half to even, numeric half away from zero */
+			if (from == MAPEXPR_FLOAT8)
+				*result = rint(value);
+			else if (from == MAPEXPR_NUMERIC)
+				*result = round(value);
+			return mapexpr_check_int(*result);
+		case MAPEXPR_NUMERIC:
+			if (isinf(value))
+				return RT_MAPEXPR_ERR_NUMERICINF;
+			if (from == MAPEXPR_FLOAT8)
+				*result = mapexpr_float8_to_numeric(value);
+			return RT_MAPEXPR_OK;
+		case MAPEXPR_BOOL:
+			*result = (value != 0) ? 1 : 0;
+			return RT_MAPEXPR_OK;
+		default:
+			return RT_MAPEXPR_OK;
+	}
 }
 
-/**
- * Return a raster of the provided geometry
- *
- * @param wkb : WKB representation of the geometry to convert
- * @param wkb_len : length of the WKB representation of the geometry
- * @param srs : the geometry's coordinate system in OGC WKT
- * @param num_bands: number of bands in the output raster
- * @param pixtype: data type of each band
- * @param init: array of values to initialize each band with
- * @param value: array of values for pixels of geometry
- * @param nodata: array of nodata values for each band
- * @param hasnodata: array flagging the presence of nodata for each band
- * @param width : the number of columns of the raster
- * @param height : the number of rows of the raster
- * @param scale_x : the pixel width of the raster
- * @param scale_y : the pixel height of the raster
- * @param ul_xw : the X value of upper-left corner of the raster
- * @param ul_yw : the Y value of upper-left corner of the raster
- * @param grid_xw : the X value of point on grid to align raster to
- * @param grid_yw : the Y value of point on grid to align raster to
- * @param skew_x : the X skew of the raster
- * @param skew_y : the Y skew of the raster
- * @param options : array of options.  only option is "ALL_TOUCHED"
- *
- * @return the raster of the provided geometry
- */
-rt_raster
-rt_raster_gdal_rasterize(const unsigned char *wkb,
-	uint32_t wkb_len, const char *srs,
-	uint32_t num_bands, rt_pixtype *pixtype,
-	double *init, double *value,
-	double *nodata, uint8_t *hasnodata,
-	int *width, int *height,
-	double *scale_x, double *scale_y,
-	double *ul_xw, double *ul_yw,
-	double *grid_xw, double *grid_yw,
-	double *skew_x, double *skew_y,
-	char **options
-) {
-	rt_raster rast;
-	int i = 0;
-	int noband = 0;
-	int banderr = 0;
-	int *band_list = NULL;
+/* fold a node whose arguments are all constants into a constant */
+static int mapexpr_node_eval(mapexpr_node node, uint32_t count);
+static int mapexpr_node_reserve(mapexpr_node node, uint32_t capacity, uint8_t *nonull);
 
-	rt_pixtype *_pixtype = NULL;
-	double *_init = NULL;
-	double *_nodata = NULL;
-	uint8_t *_hasnodata = NULL;
-	double *_value = NULL;
+static mapexpr_node
+mapexpr_fold(mapexpr_parser *p, mapexpr_node node) {
+	mapexpr_node folded = NULL;
+	int i;
 
-	double _scale_x = 0;
-	double _scale_y = 0;
-	int _width = 0;
-	int _height = 0;
-	double _skew_x = 0;
-	double _skew_y = 0;
+	if (node == NULL) return NULL;
+	if (node->op == MAPEXPR_CONST) return node;
 
-	OGRErr ogrerr;
-	OGRSpatialReferenceH src_sr = NULL;
-	OGRGeometryH src_geom;
-	OGREnvelope src_env;
-	OGRwkbGeometryType wkbtype = wkbUnknown;
+	for (i = 0; i < node->nargs; i++) {
+		if (node->args[i]->op != MAPEXPR_CONST)
+			return node;
+	}
 
-	int ul_user = 0;
-	double djunk = 0;
-	double grid_shift_xw = 0;
-	double grid_shift_yw = 0;
-	double grid_min_x = 0;
-	double grid_max_y = 0;
+	if (
+		!mapexpr_node_reserve(node, 1, NULL) ||
+		!mapexpr_node_eval(node, 1)
+	) {
+		mapexpr_node_destroy(node);
+		p->failed = 1;
+		return NULL;
+	}
 
-	CPLErr cplerr;
-	double dst_gt[6] = {0};
-	GDALDriverH dst_drv = NULL;
-	GDALDatasetH dst_ds = NULL;
-	GDALRasterBandH dst_band = NULL;
+	/*
+		the planner would raise the error when folding the constant
+		expression, leave it to SPI
+	*/
+	if (node->status[0] > RT_MAPEXPR_NULL) {
+		RASTER_DEBUG(3, "constant part of expression raises an error");
+		mapexpr_node_destroy(node);
+		p->failed = 1;
+		return NULL;
+	}
 
-	RASTER_DEBUG(3, "starting");
+	folded = mapexpr_node_const(node->type, node->values[0], node->status[0]);
+	mapexpr_node_destroy(node);
+	if (folded == NULL) p->failed = 1;
 
-	assert(NULL != wkb);
-	assert(0 != wkb_len);
+	return folded;
+}
 
-	/* internal aliases */
-	_pixtype = pixtype;
-	_init = init;
-	_nodata = nodata;
-	_hasnodata = hasnodata;
-	_value = value;
+static mapexpr_node mapexpr_parse_expr(mapexpr_parser *p);
 
-	/* no bands, raster is a mask */
-	if (num_bands < 1) {
-		num_bands = 1;
-		noband = 1;
+/* parse type name of a cast */
+static int
+mapexpr_parse_typename(mapexpr_parser *p, mapexpr_type *type) {
+	if (p->tk != MAPEXPR_TK_IDENT) {
+		p->failed = 1;
+		return 0;
+	}
 
-		_pixtype = (rt_pixtype *) rtalloc(sizeof(rt_pixtype));
-		*_pixtype = PT_8BUI;
+	if (
+		strcmp(p->text, "float8") == 0 ||
+		strcmp(p->text, "float") == 0
+	) {
+		*type = MAPEXPR_FLOAT8;
+	}
+	else if (strcmp(p->text, "double") == 0) {
+		mapexpr_next(p);
+		if (!mapexpr_is_ident(p, "precision")) {
+			p->failed = 1;
+			return 0;
+		}
+		*type = MAPEXPR_FLOAT8;
+	}
+	else if (
+		strcmp(p->text, "numeric") == 0 ||
+		strcmp(p->text, "decimal") == 0
+	) {
+		*type = MAPEXPR_NUMERIC;
+	}
+	else if (
+		strcmp(p->text, "int") == 0 ||
+		strcmp(p->text, "int4") == 0 ||
+		strcmp(p->text, "integer") == 0
+	) {
+		*type = MAPEXPR_INT4;
+	}
+	else if (
+		strcmp(p->text, "bool") == 0 ||
+		strcmp(p->text, "boolean") == 0
+	) {
+		*type = MAPEXPR_BOOL;
+	}
+	/* float4, bigint, typmods... are left to SPI */
+	else {
+		p->failed = 1;
+		return 0;
+	}
 
-		_init = (double *) rtalloc(sizeof(double));
-		*_init = 0;
+	mapexpr_next(p);
+	/* typmods */
+	if (p->tk == MAPEXPR_TK_LPAREN) {
+		p->failed = 1;
+		return 0;
+	}
 
-		_nodata = (double *) rtalloc(sizeof(double));
-		*_nodata = 0;
+	return 1;
+}
 
-		_hasnodata = (uint8_t *) rtalloc(sizeof(uint8_t));
-		*_hasnodata = 1;
+static mapexpr_node
+mapexpr_make_cast(mapexpr_parser *p, mapexpr_node arg, mapexpr_type type) {
+	mapexpr_node node = NULL;
 
-		_value = (double *) rtalloc(sizeof(double));
-		*_value = 1;
+	if (arg == NULL) return NULL;
+
+	/* casts allowed by the backend */
+	if (
+		(type == MAPEXPR_BOOL && arg->type != MAPEXPR_BOOL && arg->type != MAPEXPR_INT4 && arg->type != MAPEXPR_UNKNOWN) ||
+		(type != MAPEXPR_BOOL && type != MAPEXPR_INT4 && arg->type == MAPEXPR_BOOL)
+	) {
+		p->failed = 1;
+		mapexpr_node_destroy(arg);
+		return NULL;
 	}
 
-	assert(NULL != _pixtype);
-	assert(NULL != _init);
-	assert(NULL != _nodata);
-	assert(NULL != _hasnodata);
+	node = mapexpr_node_new(MAPEXPR_CAST, type);
+	if (node == NULL || !mapexpr_node_add_arg(node, arg)) {
+		p->failed = 1;
+		mapexpr_node_destroy(node);
+		return NULL;
+	}
 
-	/* OGR spatial reference */
-	if (NULL != srs && strlen(srs)) {
-		src_sr = OSRNewSpatialReference(NULL);
-		if (OSRSetFromUserInput(src_sr, srs) != OGRERR_NONE) {
-			rterror("rt_raster_gdal_rasterize: Unable to create OSR spatial reference");
+	return mapexpr_fold(p, node);
+}
 
-			if (noband) {
-				rtdealloc(_pixtype);
-				rtdealloc(_init);
-				rtdealloc(_nodata);
-				rtdealloc(_hasnodata);
-				rtdealloc(_value);
-			}
+static mapexpr_node
+mapexpr_parse_function(mapexpr_parser *p, const char *name) {
+	mapexpr_node node = NULL;
+	mapexpr_node arg = NULL;
+	int type = MAPEXPR_UNKNOWN;
+	int i;
+	int j;
 
-			return NULL;
-		}
+	for (i = 0; mapexpr_fns[i].name != NULL; i++) {
+		if (strcmp(mapexpr_fns[i].name, name) == 0)
+			break;
+	}
+	if (mapexpr_fns[i].name == NULL) {
+		RASTER_DEBUGF(3, "function %s is not supported", name);
+		p->failed = 1;
+		return NULL;
 	}
 
-	/* convert WKB to OGR Geometry */
-	ogrerr = OGR_G_CreateFromWkb((unsigned char *) wkb, src_sr, &src_geom, wkb_len);
-	if (ogrerr != OGRERR_NONE) {
-		rterror("rt_raster_gdal_rasterize: Unable to create OGR Geometry from WKB");
-
-		if (noband) {
-			rtdealloc(_pixtype);
-			rtdealloc(_init);
-			rtdealloc(_nodata);
-			rtdealloc(_hasnodata);
-			rtdealloc(_value);
-		}
+	node = mapexpr_node_new(MAPEXPR_FUNC, MAPEXPR_UNKNOWN);
+	if (node == NULL) {
+		p->failed = 1;
+		return NULL;
+	}
+	node->fn = mapexpr_fns[i].fn;
 
-		OSRDestroySpatialReference(src_sr);
-		OGRCleanupAll();
+	/* arguments */
+	mapexpr_next(p);
+	if (p->tk != MAPEXPR_TK_RPAREN) {
+		while (!p->failed) {
+			arg = mapexpr_parse_expr(p);
+			if (arg == NULL || !mapexpr_node_add_arg(node, arg)) {
+				p->failed = 1;
+				break;
+			}
 
+			if (p->tk != MAPEXPR_TK_COMMA)
+				break;
+			mapexpr_next(p);
+		}
+	}
+	if (p->failed || p->tk != MAPEXPR_TK_RPAREN) {
+		p->failed = 1;
+		mapexpr_node_destroy(node);
 		return NULL;
 	}
+	mapexpr_next(p);
 
-	/* get extent */
-	OGR_G_GetEnvelope(src_geom, &src_env);
+	if (node->nargs < mapexpr_fns[i].minargs || node->nargs > mapexpr_fns[i].maxargs) {
+		p->failed = 1;
+		mapexpr_node_destroy(node);
+		return NULL;
+	}
 
-	RASTER_DEBUGF(3, "Suggested extent: %f, %f, %f, %f",
-		src_env.MinX, src_env.MaxY, src_env.MaxX, src_env.MinY);
+	/* type the function */
+	switch (mapexpr_fns[i].argtype) {
+		case MAPEXPR_FNARG_FLOAT8:
+			for (j = 0; j < node->nargs; j++) {
+				if (!mapexpr_is_numeric_type(node->args[j]->type))
+					p->failed = 1;
+			}
+			type = MAPEXPR_FLOAT8;
+			break;
+		case MAPEXPR_FNARG_NUMERIC:
+			/* round(v, s) and trunc(v, s) only exist for numeric */
+			if (node->nargs == 2 && (node->fn == MAPEXPR_FN_ROUND || node->fn == MAPEXPR_FN_TRUNC)) {
+				if (
+					(node->args[0]->type != MAPEXPR_INT4 && node->args[0]->type != MAPEXPR_NUMERIC) ||
+					(node->args[1]->type != MAPEXPR_INT4)
+				) {
+					p->failed = 1;
+				}
+				type = MAPEXPR_NUMERIC;
+				break;
+			}
 
-	/* user-defined scale */
-	if (
-		(NULL != scale_x) &&
-		(NULL != scale_y) &&
-		(FLT_NEQ(*scale_x, 0.0)) &&
-		(FLT_NEQ(*scale_y, 0.0))
-	) {
-		_scale_x = fabs(*scale_x);
-		_scale_y = fabs(*scale_y);
+			type = MAPEXPR_UNKNOWN;
+			for (j = 0; j < node->nargs; j++) {
+				if (!mapexpr_is_numeric_type(node->args[j]->type))
+					p->failed = 1;
+				type = mapexpr_common_type(type, node->args[j]->type);
+			}
+			/* integers go to the preferred type */
+			if (type != MAPEXPR_NUMERIC)
+				type = MAPEXPR_FLOAT8;
+			break;
+		case MAPEXPR_FNARG_SAME:
+			type = node->args[0]->type;
+			if (!mapexpr_is_numeric_type(type) || type == MAPEXPR_UNKNOWN)
+				p->failed = 1;
+			break;
+		case MAPEXPR_FNARG_EXACT:
+			type = MAPEXPR_UNKNOWN;
+			for (j = 0; j < node->nargs; j++) {
+				if (
+					node->args[j]->type != MAPEXPR_INT4 &&
+					node->args[j]->type != MAPEXPR_NUMERIC
+				) {
+					p->failed = 1;
+				}
+				type = mapexpr_common_type(type, node->args[j]->type);
+			}
+			break;
+		case MAPEXPR_FNARG_ANY:
+			type = MAPEXPR_UNKNOWN;
+			for (j = 0; j < node->nargs; j++) {
+				type = mapexpr_common_type(type, node->args[j]->type);
+				if (type < 0) {
+					p->failed = 1;
+					break;
+				}
+			}
+			/* nullif returns the type of its first argument */
+			if (node->fn == MAPEXPR_FN_NULLIF && node->args[0]->type != MAPEXPR_UNKNOWN)
+				type = node->args[0]->type;
+			break;
 	}
-	else if (
-		(NULL != width) &&
-		(NULL != height) &&
-		(FLT_NEQ(*width, 0.0)) &&
-		(FLT_NEQ(*height, 0.0))
-	) {
-		_width = fabs(*width);
-		_height = fabs(*height);
 
-		_scale_x = (src_env.MaxX - src_env.MinX) / _width;
-		_scale_y = (src_env.MaxY - src_env.MinY) / _height;
+	if (p->failed || type < 0) {
+		p->failed = 1;
+		mapexpr_node_destroy(node);
+		return NULL;
+	}
+	node->type = type;
+
+	/* pi() is a constant */
+	if (node->fn == MAPEXPR_FN_PI) {
+		mapexpr_node_destroy(node);
+		node = mapexpr_node_const(MAPEXPR_FLOAT8, M_PI, RT_MAPEXPR_OK);
+		if (node == NULL) p->failed = 1;
+		return node;
 	}
-	else {
-		rterror("rt_raster_gdal_rasterize: Values must be provided for width and height or X and Y of scale");
 
-		if (noband) {
-			rtdealloc(_pixtype);
-			rtdealloc(_init);
-			rtdealloc(_nodata);
-			rtdealloc(_hasnodata);
-			rtdealloc(_value);
-		}
+	return mapexpr_fold(p, node);
+}
 
-		OGR_G_DestroyGeometry(src_geom);
-		OSRDestroySpatialReference(src_sr);
-		OGRCleanupAll();
+static mapexpr_node
+mapexpr_parse_case(mapexpr_parser *p) {
+	mapexpr_node node = NULL;
+	mapexpr_node arg = NULL;
+	int type = MAPEXPR_UNKNOWN;
+	int first = 0;
+	int i;
 
+	mapexpr_next(p);
+
+	node = mapexpr_node_new(MAPEXPR_CASE, MAPEXPR_UNKNOWN);
+	if (node == NULL) {
+		p->failed = 1;
 		return NULL;
 	}
-	RASTER_DEBUGF(3, "scale (x, y) = %f, %f", _scale_x, _scale_y);
-	RASTER_DEBUGF(3, "dim (x, y) = %d, %d", _width, _height);
 
-	/*
-	 	if geometry is a point, a linestring or set of either and bounds not set,
-		increase extent by a pixel to avoid missing points on border
+	/* simple CASE */
+	if (!mapexpr_is_ident(p, "when")) {
+		node->op = MAPEXPR_SCASE;
+		arg = mapexpr_parse_expr(p);
+		if (arg == NULL || !mapexpr_node_add_arg(node, arg)) {
+			p->failed = 1;
+			mapexpr_node_destroy(node);
+			return NULL;
+		}
+		first = 1;
+	}
 
-		a whole pixel is used instead of half-pixel due to backward
-		compatibility with GDAL 1.6, 1.7 and 1.8.  1.9+ works fine with half-pixel.
-	*/
-	wkbtype = wkbFlatten(OGR_G_GetGeometryType(src_geom));
-	if ((
-			(wkbtype == wkbPoint) ||
-			(wkbtype == wkbMultiPoint) ||
-			(wkbtype == wkbLineString) ||
-			(wkbtype == wkbMultiLineString)
-		) &&
-		FLT_EQ(_width, 0) &&
-		FLT_EQ(_height, 0)
-	) {
+	while (!p->failed && mapexpr_is_ident(p, "when")) {
+		mapexpr_next(p);
 
-#if POSTGIS_GDAL_VERSION > 18
-		RASTER_DEBUG(3, "Adjusting extent for GDAL > 1.8 by half the scale");
-		src_env.MinX -= (_scale_x / 2.);
-		src_env.MaxX += (_scale_x / 2.);
-		src_env.MinY -= (_scale_y / 2.);
-		src_env.MaxY += (_scale_y / 2.);
-#else
-		RASTER_DEBUG(3, "Adjusting extent for GDAL <= 1.8 by the scale");
-		src_env.MinX -= _scale_x;
-		src_env.MaxX += _scale_x;
-		src_env.MinY -= _scale_y;
-		src_env.MaxY += _scale_y;
-#endif
+		arg = mapexpr_parse_expr(p);
+		if (arg == NULL || !mapexpr_node_add_arg(node, arg)) break;
 
-	}
+		if (!mapexpr_expect_ident(p, "then")) break;
 
-	/* user-defined skew */
-	if (NULL != skew_x)
-		_skew_x = *skew_x;
-	if (NULL != skew_y)
-		_skew_y = *skew_y;
+		arg = mapexpr_parse_expr(p);
+		if (arg == NULL || !mapexpr_node_add_arg(node, arg)) break;
+	}
+	if (!p->failed && mapexpr_is_ident(p, "else")) {
+		mapexpr_next(p);
 
-	/* user-specified upper-left corner */
-	if (
-		NULL != ul_xw &&
-		NULL != ul_yw
-	) {
-		src_env.MinX = *ul_xw;
-		src_env.MaxY = *ul_yw;
-		ul_user = 1;
+		arg = mapexpr_parse_expr(p);
+		if (arg == NULL || !mapexpr_node_add_arg(node, arg))
+			p->failed = 1;
+		node->haselse = 1;
+	}
+	if (p->failed || node->nargs - first - node->haselse < 2 || !mapexpr_expect_ident(p, "end")) {
+		p->failed = 1;
+		mapexpr_node_destroy(node);
+		return NULL;
 	}
-	else if (
-		((NULL != ul_xw) && (NULL == ul_yw)) ||
-		((NULL == ul_xw) && (NULL != ul_yw))
-	) {
-		rterror("rt_raster_gdal_rasterize: Both X and Y upper-left corner values must be provided");
 
-		if (noband) {
-			rtdealloc(_pixtype);
-			rtdealloc(_init);
-			rtdealloc(_nodata);
-			rtdealloc(_hasnodata);
-			rtdealloc(_value);
+	/* conditions are boolean or compare to the CASE value */
+	for (i = first; i < node->nargs - node->haselse; i += 2) {
+		if (node->op == MAPEXPR_CASE) {
+			if (node->args[i]->type != MAPEXPR_BOOL && node->args[i]->type != MAPEXPR_UNKNOWN)
+				p->failed = 1;
 		}
+		else if (mapexpr_common_type(node->args[0]->type, node->args[i]->type) < 0)
+			p->failed = 1;
 
-		OGR_G_DestroyGeometry(src_geom);
-		OSRDestroySpatialReference(src_sr);
-		OGRCleanupAll();
+		type = mapexpr_common_type(type, node->args[i + 1]->type);
+		if (type < 0) p->failed = 1;
+	}
+	if (!p->failed && node->haselse)
+		type = mapexpr_common_type(type, node->args[node->nargs - 1]->type);
 
+	if (p->failed || type < 0) {
+		p->failed = 1;
+		mapexpr_node_destroy(node);
 		return NULL;
 	}
+	node->type = type;
 
-	/* alignment only considered if upper-left corner not provided */
-	if (
-		!ul_user && (
-			(NULL != grid_xw) || (NULL != grid_yw)
-		)
-	) {
-		if (
-			((NULL != grid_xw) && (NULL == grid_yw)) ||
-			((NULL == grid_xw) && (NULL != grid_yw))
-		) {
-			rterror("rt_raster_gdal_rasterize: Both X and Y alignment values must be provided");
+	return mapexpr_fold(p, node);
+}
 
-			if (noband) {
-				rtdealloc(_pixtype);
-				rtdealloc(_init);
-				rtdealloc(_nodata);
-				rtdealloc(_hasnodata);
-				rtdealloc(_value);
+static mapexpr_node
+mapexpr_parse_primary(mapexpr_parser *p) {
+	mapexpr_node node = NULL;
+	mapexpr_type type;
+	char name[64];
+
+	switch (p->tk) {
+		case MAPEXPR_TK_INT:
+		case MAPEXPR_TK_NUMERIC:
+			node = mapexpr_node_const(
+				p->tk == MAPEXPR_TK_INT ? MAPEXPR_INT4 : MAPEXPR_NUMERIC,
+				p->num, RT_MAPEXPR_OK
+			);
+			if (node == NULL) p->failed = 1;
+			mapexpr_next(p);
+			return node;
+		case MAPEXPR_TK_VAR:
+			node = mapexpr_node_new(MAPEXPR_VAR, MAPEXPR_FLOAT8);
+			if (node == NULL) {
+				p->failed = 1;
+				return NULL;
+			}
+			node->var = p->var;
+			/* positions are passed as integers to the two raster expressions */
+			if (p->nrast > 1 && p->var != RT_MAPEXPR_VAL1 && p->var != RT_MAPEXPR_VAL2)
+				node->type = MAPEXPR_INT4;
+			mapexpr_next(p);
+			return node;
+		case MAPEXPR_TK_LPAREN:
+			mapexpr_next(p);
+			node = mapexpr_parse_expr(p);
+			if (node == NULL || p->tk != MAPEXPR_TK_RPAREN) {
+				p->failed = 1;
+				mapexpr_node_destroy(node);
+				return NULL;
 			}
+			mapexpr_next(p);
+			return node;
+		case MAPEXPR_TK_IDENT:
+			break;
+		default:
+			p->failed = 1;
+			return NULL;
+	}
 
-			OGR_G_DestroyGeometry(src_geom);
-			OSRDestroySpatialReference(src_sr);
-			OGRCleanupAll();
+	if (mapexpr_is_ident(p, "null")) {
+		mapexpr_next(p);
+		node = mapexpr_node_const(MAPEXPR_UNKNOWN, 0, RT_MAPEXPR_NULL);
+	}
+	else if (mapexpr_is_ident(p, "true") || mapexpr_is_ident(p, "false")) {
+		node = mapexpr_node_const(MAPEXPR_BOOL, mapexpr_is_ident(p, "true") ? 1 : 0, RT_MAPEXPR_OK);
+		mapexpr_next(p);
+	}
+	else if (mapexpr_is_ident(p, "case")) {
+		return mapexpr_parse_case(p);
+	}
+	else if (mapexpr_is_ident(p, "cast")) {
+		mapexpr_next(p);
+		if (p->tk != MAPEXPR_TK_LPAREN) {
+			p->failed = 1;
+			return NULL;
+		}
+		mapexpr_next(p);
 
+		node = mapexpr_parse_expr(p);
+		if (
+			node == NULL ||
+			!mapexpr_expect_ident(p, "as") ||
+			!mapexpr_parse_typename(p, &type) ||
+			p->tk != MAPEXPR_TK_RPAREN
+		) {
+			p->failed = 1;
+			mapexpr_node_destroy(node);
 			return NULL;
 		}
+		mapexpr_next(p);
 
-		/* grid shift of upper left to match alignment grid */
-		grid_shift_xw = _scale_x * modf(fabs(*grid_xw - src_env.MinX) / _scale_x, &djunk);
-		grid_shift_yw = _scale_y * modf(fabs(*grid_yw - src_env.MaxY) / _scale_y, &djunk);
+		return mapexpr_make_cast(p, node, type);
+	}
+	else {
+		strncpy(name, p->text, sizeof(name));
+		name[sizeof(name) - 1] = '\0';
+
+		/* anything but a function call is a column reference */
+		mapexpr_next(p);
+		if (p->tk != MAPEXPR_TK_LPAREN) {
+			RASTER_DEBUGF(3, "identifier %s is not supported", name);
+			p->failed = 1;
+			return NULL;
+		}
 
-		/* shift along X axis for upper left */
-		if (FLT_NEQ(grid_shift_xw, 0.) && FLT_NEQ(grid_shift_xw, _scale_x)) {
-			grid_min_x = src_env.MinX - grid_shift_xw;
-			grid_min_x = modf(fabs(*grid_xw - grid_min_x) / _scale_x, &djunk);
-			if (FLT_NEQ(grid_min_x, 0.) && FLT_NEQ(grid_min_x, 1.))
-				grid_shift_xw = _scale_x - grid_shift_xw;
-			grid_min_x = src_env.MinX - grid_shift_xw;
+		return mapexpr_parse_function(p, name);
+	}
 
-			src_env.MinX = grid_min_x;
-			ul_user = 1;
-		}
+	if (node == NULL) p->failed = 1;
+	return node;
+}
 
-		/* shift along Y axis for upper left */
-		if (FLT_NEQ(grid_shift_yw, 0.) && FLT_NEQ(grid_shift_yw, _scale_y)) {
-			grid_max_y = src_env.MaxY + grid_shift_yw;
-			grid_max_y = modf(fabs(*grid_yw - grid_max_y) / _scale_y, &djunk);
-			if (FLT_NEQ(grid_max_y, 0.) && FLT_NEQ(grid_max_y, 1.))
-				grid_shift_yw = _scale_y - fabs(grid_shift_yw);
-			grid_max_y = src_env.MaxY + grid_shift_yw;
+static mapexpr_node
+mapexpr_parse_postfix(mapexpr_parser *p) {
+	mapexpr_node node = mapexpr_parse_primary(p);
+	mapexpr_type type;
 
-			src_env.MaxY = grid_max_y;
-			ul_user = 1;
+	while (node != NULL && !p->failed && mapexpr_is_op(p, "::")) {
+		mapexpr_next(p);
+		if (!mapexpr_parse_typename(p, &type)) {
+			mapexpr_node_destroy(node);
+			return NULL;
 		}
+		node = mapexpr_make_cast(p, node, type);
+	}
 
-		if (ul_user) {
-			_width = (int) fmax((fabs(src_env.MaxX - src_env.MinX) + (_scale_x / 2.)) / _scale_x, 1);
-			_height = (int) fmax((fabs(src_env.MaxY - src_env.MinY) + (_scale_y / 2.)) / _scale_y, 1);
-		}
+	return node;
+}
 
-		RASTER_DEBUGF(3, "shift is: %f, %f", grid_shift_xw, grid_shift_yw);
-		RASTER_DEBUGF(3, "new ul is: %f, %f", grid_min_x, grid_max_y);
+static mapexpr_node
+mapexpr_make_binary(mapexpr_parser *p, mapexpr_op op, mapexpr_node a, mapexpr_node b) {
+	mapexpr_node node = NULL;
+	int type = MAPEXPR_UNKNOWN;
+
+	if (a == NULL || b == NULL) {
+		p->failed = 1;
+		mapexpr_node_destroy(a);
+		mapexpr_node_destroy(b);
+		return NULL;
 	}
 
-	/* raster dimensions */
-	if (!_width)
-		_width = (int) fmax((fabs(src_env.MaxX - src_env.MinX) + (_scale_x / 2.)) / _scale_x, 1);
-	if (!_height)
-		_height = (int) fmax((fabs(src_env.MaxY - src_env.MinY) + (_scale_y / 2.)) / _scale_y, 1);
+	switch (op) {
+		case MAPEXPR_AND:
+		case MAPEXPR_OR:
+			if (
+				(a->type != MAPEXPR_BOOL && a->type != MAPEXPR_UNKNOWN) ||
+				(b->type != MAPEXPR_BOOL && b->type != MAPEXPR_UNKNOWN)
+			) {
+				type = -1;
+			}
+			else
+				type = MAPEXPR_BOOL;
+			break;
+		case MAPEXPR_EQ:
+		case MAPEXPR_NE:
+		case MAPEXPR_LT:
+		case MAPEXPR_LE:
+		case MAPEXPR_GT:
+		case MAPEXPR_GE:
+			type = mapexpr_common_type(a->type, b->type);
+			if (type >= 0)
+				type = MAPEXPR_BOOL;
+			break;
+		default:
+			if (!mapexpr_is_numeric_type(a->type) || !mapexpr_is_numeric_type(b->type)) {
+				type = -1;
+				break;
+			}
+			type = mapexpr_common_type(a->type, b->type);
+			/* NULL op NULL can't be resolved */
+			if (type == MAPEXPR_UNKNOWN)
+				type = -1;
+			/* there is no modulo of double precision */
+			else if (op == MAPEXPR_MOD && type == MAPEXPR_FLOAT8)
+				type = -1;
+			/* integer ^ integer is double precision */
+			else if (op == MAPEXPR_POW && type == MAPEXPR_INT4)
+				type = MAPEXPR_FLOAT8;
+			break;
+	}
 
-	/* specify geotransform */
-	dst_gt[0] = src_env.MinX;
-	dst_gt[1] = _scale_x;
-	dst_gt[2] = _skew_x;
-	dst_gt[3] = src_env.MaxY;
-	dst_gt[4] = _skew_y;
-	dst_gt[5] = -1 * _scale_y;
+	if (type < 0) {
+		RASTER_DEBUGF(3, "operator %d is not supported for these types", op);
+		p->failed = 1;
+		mapexpr_node_destroy(a);
+		mapexpr_node_destroy(b);
+		return NULL;
+	}
 
-	/* user provided negative scale-x */
-	if (
-		(NULL != scale_x) &&
-		(*scale_x < 0.)
-	) {
-		dst_gt[0] = src_env.MaxX;
-		dst_gt[1] = *scale_x;
+	node = mapexpr_node_new(op, type);
+	if (node == NULL) {
+		p->failed = 1;
+		mapexpr_node_destroy(a);
+		mapexpr_node_destroy(b);
+		return NULL;
 	}
-	/* user provided positive scale-y */
+	if (!mapexpr_node_add_arg(node, a)) {
+		mapexpr_node_destroy(b);
+		mapexpr_node_destroy(node);
+		p->failed = 1;
+		return NULL;
+	}
+	if (!mapexpr_node_add_arg(node, b)) {
+		mapexpr_node_destroy(node);
+		p->failed = 1;
+		return NULL;
+	}
+
+	return mapexpr_fold(p, node);
+}
+
+static mapexpr_node
+mapexpr_make_unary(mapexpr_parser *p, mapexpr_op op, mapexpr_node a) {
+	mapexpr_node node = NULL;
+	mapexpr_type type = MAPEXPR_BOOL;
+
+	if (a == NULL) {
+		p->failed = 1;
+		return NULL;
+	}
+
 	if (
-		(NULL != scale_y) &&
-		(*scale_y > 0)
+		(op == MAPEXPR_NEG && (!mapexpr_is_numeric_type(a->type) || a->type == MAPEXPR_UNKNOWN)) ||
+		(op == MAPEXPR_NOT && a->type != MAPEXPR_BOOL && a->type != MAPEXPR_UNKNOWN)
 	) {
-		dst_gt[3] = src_env.MinY;
-		dst_gt[5] = *scale_y;
+		p->failed = 1;
+		mapexpr_node_destroy(a);
+		return NULL;
 	}
+	if (op == MAPEXPR_NEG)
+		type = a->type;
 
-	RASTER_DEBUGF(3, "Applied extent: %f, %f, %f, %f",
-		src_env.MinX, src_env.MaxY, src_env.MaxX, src_env.MinY);
-	RASTER_DEBUGF(3, "Applied geotransform: %f, %f, %f, %f, %f, %f",
-		dst_gt[0], dst_gt[1], dst_gt[2], dst_gt[3], dst_gt[4], dst_gt[5]);
-	RASTER_DEBUGF(3, "Raster dimensions (width x height): %d x %d",
-		_width, _height);
+	node = mapexpr_node_new(op, type);
+	if (node == NULL || !mapexpr_node_add_arg(node, a)) {
+		p->failed = 1;
+		mapexpr_node_destroy(node);
+		return NULL;
+	}
 
-	/* load GDAL mem */
-	if (!rt_util_gdal_driver_registered("MEM"))
-		GDALRegister_MEM();
-	dst_drv = GDALGetDriverByName("MEM");
-	if (NULL == dst_drv) {
-		rterror("rt_raster_gdal_rasterize: Unable to load the MEM GDAL driver");
+	return mapexpr_fold(p, node);
+}
 
-		if (noband) {
-			rtdealloc(_pixtype);
-			rtdealloc(_init);
-			rtdealloc(_nodata);
-			rtdealloc(_hasnodata);
-			rtdealloc(_value);
-		}
+static mapexpr_node
+mapexpr_parse_unary(mapexpr_parser *p) {
+	if (mapexpr_is_op(p, "-")) {
+		mapexpr_next(p);
+		return mapexpr_make_unary(p, MAPEXPR_NEG, mapexpr_parse_unary(p));
+	}
+	else if (mapexpr_is_op(p, "+")) {
+		mapexpr_next(p);
+		return mapexpr_parse_unary(p);
+	}
 
-		OGR_G_DestroyGeometry(src_geom);
-		OSRDestroySpatialReference(src_sr);
-		OGRCleanupAll();
+	return mapexpr_parse_postfix(p);
+}
 
-		return NULL;
+static mapexpr_node
+mapexpr_parse_pow(mapexpr_parser *p) {
+	mapexpr_node node = mapexpr_parse_unary(p);
+
+	while (node != NULL && !p->failed && mapexpr_is_op(p, "^")) {
+		mapexpr_next(p);
+		node = mapexpr_make_binary(p, MAPEXPR_POW, node, mapexpr_parse_unary(p));
 	}
 
-	dst_ds = GDALCreate(dst_drv, "", _width, _height, 0, GDT_Byte, NULL);
-	if (NULL == dst_ds) {
-		rterror("rt_raster_gdal_rasterize: Could not create a GDALDataset to rasterize the geometry into");
+	return node;
+}
 
-		if (noband) {
-			rtdealloc(_pixtype);
-			rtdealloc(_init);
-			rtdealloc(_nodata);
-			rtdealloc(_hasnodata);
-			rtdealloc(_value);
-		}
+static mapexpr_node
+mapexpr_parse_mul(mapexpr_parser *p) {
+	mapexpr_node node = mapexpr_parse_pow(p);
+	mapexpr_op op;
 
-		OGR_G_DestroyGeometry(src_geom);
-		OSRDestroySpatialReference(src_sr);
-		OGRCleanupAll();
+	while (node != NULL && !p->failed) {
+		if (mapexpr_is_op(p, "*"))
+			op = MAPEXPR_MUL;
+		else if (mapexpr_is_op(p, "/"))
+			op = MAPEXPR_DIV;
+		else if (mapexpr_is_op(p, "%"))
+			op = MAPEXPR_MOD;
+		else
+			break;
 
-		return NULL;
+		mapexpr_next(p);
+		node = mapexpr_make_binary(p, op, node, mapexpr_parse_pow(p));
 	}
 
-	/* set geotransform */
-	cplerr = GDALSetGeoTransform(dst_ds, dst_gt);
-	if (cplerr != CE_None) {
-		rterror("rt_raster_gdal_rasterize: Could not set geotransform on GDALDataset");
-
-		if (noband) {
-			rtdealloc(_pixtype);
-			rtdealloc(_init);
-			rtdealloc(_nodata);
-			rtdealloc(_hasnodata);
-			rtdealloc(_value);
-		}
+	return node;
+}
 
-		OGR_G_DestroyGeometry(src_geom);
-		OSRDestroySpatialReference(src_sr);
-		OGRCleanupAll();
+static mapexpr_node
+mapexpr_parse_add(mapexpr_parser *p) {
+	mapexpr_node node = mapexpr_parse_mul(p);
+	mapexpr_op op;
 
-		GDALClose(dst_ds);
+	while (node != NULL && !p->failed) {
+		if (mapexpr_is_op(p, "+"))
+			op = MAPEXPR_ADD;
+		else if (mapexpr_is_op(p, "-"))
+			op = MAPEXPR_SUB;
+		else
+			break;
 
-		return NULL;
+		mapexpr_next(p);
+		node = mapexpr_make_binary(p, op, node, mapexpr_parse_mul(p));
 	}
 
-	/* set SRS */
-	if (NULL != src_sr) {
-		cplerr = GDALSetProjection(dst_ds, srs);
-		if (cplerr != CE_None) {
-			rterror("rt_raster_gdal_rasterize: Could not set projection on GDALDataset");
-
-			if (noband) {
-				rtdealloc(_pixtype);
-				rtdealloc(_init);
-				rtdealloc(_nodata);
-				rtdealloc(_hasnodata);
-				rtdealloc(_value);
-			}
+	return node;
+}
 
-			OGR_G_DestroyGeometry(src_geom);
-			OSRDestroySpatialReference(src_sr);
-			OGRCleanupAll();
+/* [NOT] BETWEEN and [NOT] IN */
+static mapexpr_node
+mapexpr_parse_range(mapexpr_parser *p) {
+	mapexpr_node node = mapexpr_parse_add(p);
+	mapexpr_node range = NULL;
+	mapexpr_node arg = NULL;
+	int negate = 0;
+	int type;
+	int i;
 
-			GDALClose(dst_ds);
+	if (node == NULL || p->failed)
+		return node;
 
+	if (mapexpr_is_ident(p, "not")) {
+		negate = 1;
+		mapexpr_next(p);
+		if (!mapexpr_is_ident(p, "between") && !mapexpr_is_ident(p, "in")) {
+			p->failed = 1;
+			mapexpr_node_destroy(node);
 			return NULL;
 		}
 	}
 
-	/* set bands */
-	for (i = 0; i < num_bands; i++) {
-		banderr = 0;
+	if (mapexpr_is_ident(p, "between")) {
+		mapexpr_next(p);
+		/* BETWEEN SYMMETRIC is left to SPI */
+		if (mapexpr_is_ident(p, "symmetric") || mapexpr_is_ident(p, "asymmetric")) {
+			p->failed = 1;
+			mapexpr_node_destroy(node);
+			return NULL;
+		}
 
+		range = mapexpr_node_new(MAPEXPR_BETWEEN, MAPEXPR_BOOL);
+		if (range == NULL || !mapexpr_node_add_arg(range, node)) {
+			p->failed = 1;
+			mapexpr_node_destroy(range);
+			return NULL;
+		}
+		if (!mapexpr_node_add_arg(range, mapexpr_parse_add(p)) || !mapexpr_expect_ident(p, "and")) {
+			p->failed = 1;
+			mapexpr_node_destroy(range);
+			return NULL;
+		}
+		if (!mapexpr_node_add_arg(range, mapexpr_parse_add(p))) {
+			p->failed = 1;
+			mapexpr_node_destroy(range);
+			return NULL;
+		}
+	}
+	else if (mapexpr_is_ident(p, "in")) {
+		mapexpr_next(p);
+		range = mapexpr_node_new(MAPEXPR_IN, MAPEXPR_BOOL);
+		if (range == NULL || !mapexpr_node_add_arg(range, node)) {
+			p->failed = 1;
+			mapexpr_node_destroy(range);
+			return NULL;
+		}
+		if (p->tk != MAPEXPR_TK_LPAREN) {
+			p->failed = 1;
+			mapexpr_node_destroy(range);
+			return NULL;
+		}
 		do {
-			/* add band */
-			cplerr = GDALAddBand(dst_ds, rt_util_pixtype_to_gdal_datatype(_pixtype[i]), NULL);
-			if (cplerr != CE_None) {
-				rterror("rt_raster_gdal_rasterize: Unable to add band to GDALDataset");
-				banderr = 1;
+			mapexpr_next(p);
+			arg = mapexpr_parse_expr(p);
+			if (arg == NULL || !mapexpr_node_add_arg(range, arg)) {
+				p->failed = 1;
 				break;
 			}
+		}
+		while (p->tk == MAPEXPR_TK_COMMA);
 
-			dst_band = GDALGetRasterBand(dst_ds, i + 1);
-			if (NULL == dst_band) {
-				rterror("rt_raster_gdal_rasterize: Unable to get band %d from GDALDataset", i + 1);
-				banderr = 1;
-				break;
-			}
+		if (p->failed || p->tk != MAPEXPR_TK_RPAREN) {
+			p->failed = 1;
+			mapexpr_node_destroy(range);
+			return NULL;
+		}
+		mapexpr_next(p);
+	}
+	else
+		return node;
 
-			/* nodata value */
-			if (_hasnodata[i]) {
-				cplerr = GDALSetRasterNoDataValue(dst_band, _nodata[i]);
-				if (cplerr != CE_None) {
-					rterror("rt_raster_gdal_rasterize: Unable to set nodata value");
-					banderr = 1;
-					break;
-				}
-			}
+	range->negate = negate;
 
-			/* initial value */
-			cplerr = GDALFillRaster(dst_band, _init[i], 0);
-			if (cplerr != CE_None) {
-				rterror("rt_raster_gdal_rasterize: Unable to set initial value");
-				banderr = 1;
-				break;
-			}
+	/* all values must be comparable */
+	type = range->args[0]->type;
+	for (i = 1; i < range->nargs; i++) {
+		type = mapexpr_common_type(type, range->args[i]->type);
+		if (type < 0) {
+			p->failed = 1;
+			mapexpr_node_destroy(range);
+			return NULL;
 		}
-		while (0);
+	}
 
-		if (banderr) {
-			if (noband) {
-				rtdealloc(_pixtype);
-				rtdealloc(_init);
-				rtdealloc(_nodata);
-				rtdealloc(_hasnodata);
-				rtdealloc(_value);
-			}
+	return mapexpr_fold(p, range);
+}
 
-			OGR_G_DestroyGeometry(src_geom);
-			OSRDestroySpatialReference(src_sr);
-			OGRCleanupAll();
+static mapexpr_node
+mapexpr_parse_cmp(mapexpr_parser *p) {
+	mapexpr_node node = mapexpr_parse_range(p);
+	mapexpr_op op;
 
-			GDALClose(dst_ds);
+	if (node == NULL || p->failed || p->tk != MAPEXPR_TK_OP)
+		return node;
 
-			return NULL;
-		}
+	if (mapexpr_is_op(p, "="))
+		op = MAPEXPR_EQ;
+	else if (mapexpr_is_op(p, "<>"))
+		op = MAPEXPR_NE;
+	else if (mapexpr_is_op(p, "<"))
+		op = MAPEXPR_LT;
+	else if (mapexpr_is_op(p, "<="))
+		op = MAPEXPR_LE;
+	else if (mapexpr_is_op(p, ">"))
+		op = MAPEXPR_GT;
+	else if (mapexpr_is_op(p, ">="))
+		op = MAPEXPR_GE;
+	/* unknown operator */
+	else {
+		p->failed = 1;
+		mapexpr_node_destroy(node);
+		return NULL;
 	}
 
-	band_list = (int *) rtalloc(sizeof(int) * num_bands);
-	for (i = 0; i < num_bands; i++) band_list[i] = i + 1;
+	mapexpr_next(p);
+	node = mapexpr_make_binary(p, op, node, mapexpr_parse_range(p));
 
-	/* burn geometry */
-	cplerr = GDALRasterizeGeometries(
-		dst_ds,
-		num_bands, band_list,
-		1, &src_geom,
-		NULL, NULL,
-		_value,
-		options,
-		NULL, NULL
-	);
-	rtdealloc(band_list);
-	if (cplerr != CE_None) {
-		rterror("rt_raster_gdal_rasterize: Unable to rasterize geometry");
+	/* chained comparisons are left to SPI */
+	if (node != NULL && p->tk == MAPEXPR_TK_OP) {
+		p->failed = 1;
+		mapexpr_node_destroy(node);
+		return NULL;
+	}
 
-		if (noband) {
-			rtdealloc(_pixtype);
-			rtdealloc(_init);
-			rtdealloc(_nodata);
-			rtdealloc(_hasnodata);
-			rtdealloc(_value);
-		}
+	return node;
+}
 
-		OGR_G_DestroyGeometry(src_geom);
-		OSRDestroySpatialReference(src_sr);
-		OGRCleanupAll();
+static mapexpr_node
+mapexpr_parse_is(mapexpr_parser *p) {
+	mapexpr_node node = mapexpr_parse_cmp(p);
+	mapexpr_op op;
 
-		GDALClose(dst_ds);
+	while (node != NULL && !p->failed && mapexpr_is_ident(p, "is")) {
+		mapexpr_next(p);
+		op = MAPEXPR_ISNULL;
+		if (mapexpr_is_ident(p, "not")) {
+			op = MAPEXPR_ISNOTNULL;
+			mapexpr_next(p);
+		}
+		if (!mapexpr_expect_ident(p, "null")) {
+			mapexpr_node_destroy(node);
+			return NULL;
+		}
 
-		return NULL;
+		node = mapexpr_make_unary(p, op, node);
 	}
 
-	/* convert gdal dataset to raster */
-	GDALFlushCache(dst_ds);
-	RASTER_DEBUG(3, "Converting GDAL dataset to raster");
-	rast = rt_raster_from_gdal_dataset(dst_ds);
+	return node;
+}
 
-	if (noband) {
-		rtdealloc(_pixtype);
-		rtdealloc(_init);
-		rtdealloc(_nodata);
-		rtdealloc(_hasnodata);
-		rtdealloc(_value);
+static mapexpr_node
+mapexpr_parse_not(mapexpr_parser *p) {
+	if (mapexpr_is_ident(p, "not")) {
+		mapexpr_next(p);
+		return mapexpr_make_unary(p, MAPEXPR_NOT, mapexpr_parse_not(p));
 	}
 
-	OGR_G_DestroyGeometry(src_geom);
-	OSRDestroySpatialReference(src_sr);
-	OGRCleanupAll();
+	return mapexpr_parse_is(p);
+}
 
-	GDALClose(dst_ds);
+static mapexpr_node
+mapexpr_parse_and(mapexpr_parser *p) {
+	mapexpr_node node = mapexpr_parse_not(p);
 
-	if (NULL == rast) {
-		rterror("rt_raster_gdal_rasterize: Unable to rasterize geometry");
-		return NULL;
+	while (node != NULL && !p->failed && mapexpr_is_ident(p, "and")) {
+		mapexpr_next(p);
+		node = mapexpr_make_binary(p, MAPEXPR_AND, node, mapexpr_parse_not(p));
 	}
 
-	RASTER_DEBUG(3, "done");
-
-	return rast;
+	return node;
 }
 
-static
-int rt_raster_intersects_algorithm(
-	rt_raster rast1, rt_raster rast2,
-	rt_band band1, rt_band band2,
-	int hasnodata1, int hasnodata2,
-	double nodata1, double nodata2
-) {
-	int i;
-	int byHeight = 1;
-	uint32_t dimValue;
+static mapexpr_node
+mapexpr_parse_expr(mapexpr_parser *p) {
+	mapexpr_node node = mapexpr_parse_and(p);
 
-	uint32_t row;
-	uint32_t rowoffset;
-	uint32_t col;
-	uint32_t coloffset;
+	while (node != NULL && !p->failed && mapexpr_is_ident(p, "or")) {
+		mapexpr_next(p);
+		node = mapexpr_make_binary(p, MAPEXPR_OR, node, mapexpr_parse_and(p));
+	}
 
-	enum line_points {X1, Y1, X2, Y2};
-	enum point {pX, pY};
-	double line1[4];
-	double line2[4];
-	double P[2];
-	double Qw[2];
-	double Qr[2];
-	double gt1[6] = {0.0};
-	double gt2[6] = {0.0};
-	double igt1[6] = {0};
-	double igt2[6] = {0};
-	double d;
-	double val1;
-	int noval1;
-	double val2;
-	int noval2;
-	uint32_t adjacent[8] = {0};
+	if (p->failed && node != NULL) {
+		mapexpr_node_destroy(node);
+		node = NULL;
+	}
 
-	double xscale;
-	double yscale;
+	return node;
+}
 
-	uint16_t width1;
-	uint16_t height1;
-	uint16_t width2;
-	uint16_t height2;
+/* make sure the row buffers of the nodes hold capacity values */
+static int
+mapexpr_node_reserve(mapexpr_node node, uint32_t capacity, uint8_t *nonull) {
+	uint32_t i;
 
-	width1 = rt_raster_get_width(rast1);
-	height1 = rt_raster_get_height(rast1);
-	width2 = rt_raster_get_width(rast2);
-	height2 = rt_raster_get_height(rast2);
+	for (i = 0; i < (uint32_t) node->nargs; i++) {
+		if (!mapexpr_node_reserve(node->args[i], capacity, nonull))
+			return 0;
+	}
 
-	/* sampling scale */
-	xscale = fmin(rt_raster_get_x_scale(rast1), rt_raster_get_x_scale(rast2)) / 10.;
-	yscale = fmin(rt_raster_get_y_scale(rast1), rt_raster_get_y_scale(rast2)) / 10.;
+	/* variables are bound in rt_mapexpr_eval */
+	if (node->op == MAPEXPR_VAR) {
+		node->status = nonull;
+		return 1;
+	}
 
-	/* see if skew made rast2's rows are parallel to rast1's cols */
-	rt_raster_cell_to_geopoint(
-		rast1,
-		0, 0,
-		&(line1[X1]), &(line1[Y1]),
-		gt1
-	);
+	node->values = rtrealloc(node->values, sizeof(double) * capacity);
+	node->status = rtrealloc(node->status, sizeof(uint8_t) * capacity);
+	if (node->values == NULL || node->status == NULL) {
+		rterror("mapexpr_node_reserve: Unable to allocate memory for expression buffers");
+		return 0;
+	}
 
-	rt_raster_cell_to_geopoint(
-		rast1,
-		0, height1,
-		&(line1[X2]), &(line1[Y2]),
-		gt1
-	);
+	if (node->op == MAPEXPR_CONST) {
+		for (i = 0; i < capacity; i++) {
+			node->values[i] = node->constval;
+			node->status[i] = node->conststatus;
+		}
+	}
 
-	rt_raster_cell_to_geopoint(
-		rast2,
-		0, 0,
-		&(line2[X1]), &(line2[Y1]),
-		gt2
-	);
+	return 1;
+}
 
-	rt_raster_cell_to_geopoint(
-		rast2,
-		width2, 0,
-		&(line2[X2]), &(line2[Y2]),
-		gt2
-	);
+/* evaluate count values of a node whose buffers are reserved */
+static int
+mapexpr_node_eval(mapexpr_node node, uint32_t count) {
+	mapexpr_node a = NULL;
+	mapexpr_node b = NULL;
+	double *v = node->values;
+	uint8_t *s = node->status;
+	uint32_t i;
+	int j;
+	int k;
+	int c;
+	int last;
 
-	/* parallel vertically */
-	if (FLT_EQ(line1[X2] - line1[X1], 0.) && FLT_EQ(line2[X2] - line2[X1], 0.))
-		byHeight = 0;
-	/* parallel */
-	else if (FLT_EQ(((line1[Y2] - line1[Y1]) / (line1[X2] - line1[X1])), ((line2[Y2] - line2[Y1]) / (line2[X2] - line2[X1]))))
-		byHeight = 0;
+	if (node->op == MAPEXPR_CONST || node->op == MAPEXPR_VAR)
+		return 1;
 
-	if (byHeight)
-		dimValue = height2;
-	else
-		dimValue = width2;
-	RASTER_DEBUGF(4, "byHeight: %d, dimValue: %d", byHeight, dimValue);
+	for (j = 0; j < node->nargs; j++) {
+		if (!mapexpr_node_eval(node->args[j], count))
+			return 0;
+	}
+	if (node->nargs > 0) a = node->args[0];
+	if (node->nargs > 1) b = node->args[1];
 
-	/* 3 x 3 search */
-	for (coloffset = 0; coloffset < 3; coloffset++) {
-		for (rowoffset = 0; rowoffset < 3; rowoffset++) {
-			/* smaller raster */
-			for (col = coloffset; col <= width1; col += 3) {
+	switch (node->op) {
+		case MAPEXPR_NEG:
+			for (i = 0; i < count; i++) {
+				s[i] = a->status[i];
+				if (s[i] == RT_MAPEXPR_OK)
+					s[i] = mapexpr_compute(node, a->values[i], 0, &(v[i]));
+			}
+			break;
+		case MAPEXPR_ADD:
+		case MAPEXPR_SUB:
+		case MAPEXPR_MUL:
+		case MAPEXPR_DIV:
+		case MAPEXPR_MOD:
+		case MAPEXPR_POW:
+			for (i = 0; i < count; i++) {
+				s[i] = MAPEXPR_STRICT2(a->status[i], b->status[i]);
+				if (s[i] == RT_MAPEXPR_OK)
+					s[i] = mapexpr_compute(node, a->values[i], b->values[i], &(v[i]));
+			}
+			break;
+		case MAPEXPR_EQ:
+		case MAPEXPR_NE:
+		case MAPEXPR_LT:
+		case MAPEXPR_LE:
+		case MAPEXPR_GT:
+		case MAPEXPR_GE:
+			for (i = 0; i < count; i++) {
+				s[i] = MAPEXPR_STRICT2(a->status[i], b->status[i]);
+				if (s[i] != RT_MAPEXPR_OK) continue;
+
+				c = mapexpr_cmp(a->values[i], b->values[i]);
+				switch (node->op) {
+					case MAPEXPR_EQ: v[i] = (c == 0); break;
+					case MAPEXPR_NE: v[i] = (c != 0); break;
+					case MAPEXPR_LT: v[i] = (c < 0); break;
+					case MAPEXPR_LE: v[i] = (c <= 0); break;
+					case MAPEXPR_GT: v[i] = (c > 0); break;
+					default: v[i] = (c >= 0); break;
+				}
+			}
+			break;
+		case MAPEXPR_AND:
+		case MAPEXPR_OR:
+			/* first value deciding the outcome wins, as the executor short-circuits */
+			last = (node->op == MAPEXPR_AND) ? 0 : 1;
+			for (i = 0; i < count; i++) {
+				if (a->status[i] > RT_MAPEXPR_NULL)
+					s[i] = a->status[i];
+				else if (a->status[i] == RT_MAPEXPR_OK && a->values[i] == last) {
+					s[i] = RT_MAPEXPR_OK;
+					v[i] = last;
+				}
+				else if (b->status[i] > RT_MAPEXPR_NULL)
+					s[i] = b->status[i];
+				else if (b->status[i] == RT_MAPEXPR_OK && b->values[i] == last) {
+					s[i] = RT_MAPEXPR_OK;
+					v[i] = last;
+				}
+				else if (a->status[i] == RT_MAPEXPR_NULL || b->status[i] == RT_MAPEXPR_NULL)
+					s[i] = RT_MAPEXPR_NULL;
+				else {
+					s[i] = RT_MAPEXPR_OK;
+					v[i] = !last;
+				}
+			}
+			break;
+		case MAPEXPR_NOT:
+			for (i = 0; i < count; i++) {
+				s[i] = a->status[i];
+				if (s[i] == RT_MAPEXPR_OK)
+					v[i] = !(a->values[i]);
+			}
+			break;
+		case MAPEXPR_ISNULL:
+		case MAPEXPR_ISNOTNULL:
+			for (i = 0; i < count; i++) {
+				if (a->status[i] > RT_MAPEXPR_NULL) {
+					s[i] = a->status[i];
+					continue;
+				}
+				s[i] = RT_MAPEXPR_OK;
+				v[i] = (a->status[i] == RT_MAPEXPR_NULL);
+				if (node->op == MAPEXPR_ISNOTNULL)
+					v[i] = !(v[i]);
+			}
+			break;
+		case MAPEXPR_BETWEEN:
+			/* value >= low AND value <= high */
+			for (i = 0; i < count; i++) {
+				uint8_t s1 = MAPEXPR_STRICT2(a->status[i], b->status[i]);
+				uint8_t s2;
+
+				if (s1 > RT_MAPEXPR_NULL) {
+					s[i] = s1;
+					continue;
+				}
+				if (s1 == RT_MAPEXPR_OK && mapexpr_cmp(a->values[i], b->values[i]) < 0) {
+					s[i] = RT_MAPEXPR_OK;
+					v[i] = node->negate;
+					continue;
+				}
 
-				rt_raster_cell_to_geopoint(
-					rast1,
-					col, 0,
-					&(line1[X1]), &(line1[Y1]),
-					gt1
-				);
+				s2 = MAPEXPR_STRICT2(a->status[i], node->args[2]->status[i]);
+				if (s2 > RT_MAPEXPR_NULL)
+					s[i] = s2;
+				else if (s2 == RT_MAPEXPR_OK && mapexpr_cmp(a->values[i], node->args[2]->values[i]) > 0) {
+					s[i] = RT_MAPEXPR_OK;
+					v[i] = node->negate;
+				}
+				else if (s1 == RT_MAPEXPR_NULL || s2 == RT_MAPEXPR_NULL)
+					s[i] = RT_MAPEXPR_NULL;
+				else {
+					s[i] = RT_MAPEXPR_OK;
+					v[i] = !node->negate;
+				}
+			}
+			break;
+		case MAPEXPR_IN:
+			for (i = 0; i < count; i++) {
+				int hasnull = 0;
+				int found = 0;
+
+				s[i] = a->status[i];
+				for (j = 1; j < node->nargs && s[i] <= RT_MAPEXPR_NULL; j++) {
+					if (node->args[j]->status[i] > RT_MAPEXPR_NULL)
+						s[i] = node->args[j]->status[i];
+					else if (node->args[j]->status[i] == RT_MAPEXPR_NULL)
+						hasnull = 1;
+					else if (s[i] == RT_MAPEXPR_OK && mapexpr_cmp(a->values[i], node->args[j]->values[i]) == 0)
+						found = 1;
+				}
+				if (s[i] > RT_MAPEXPR_NULL)
+					continue;
+				if (s[i] == RT_MAPEXPR_NULL || (!found && hasnull)) {
+					s[i] = RT_MAPEXPR_NULL;
+					continue;
+				}
+				v[i] = node->negate ? !found : found;
+			}
+			break;
+		case MAPEXPR_CASE:
+		case MAPEXPR_SCASE:
+			k = (node->op == MAPEXPR_SCASE) ? 1 : 0;
+			last = node->nargs - node->haselse;
+			for (i = 0; i < count; i++) {
+				/* value of simple CASE */
+				if (k && a->status[i] > RT_MAPEXPR_NULL) {
+					s[i] = a->status[i];
+					continue;
+				}
 
-				rt_raster_cell_to_geopoint(
-					rast1,
-					col, height1,
-					&(line1[X2]), &(line1[Y2]),
-					gt1
-				);
+				s[i] = RT_MAPEXPR_NULL;
+				for (j = k; j < last; j += 2) {
+					mapexpr_node cond = node->args[j];
+					mapexpr_node res = node->args[j + 1];
 
-				/* larger raster */
-				for (row = rowoffset; row <= dimValue; row += 3) {
+					if (cond->status[i] > RT_MAPEXPR_NULL) {
+						s[i] = cond->status[i];
+						break;
+					}
+					else if (cond->status[i] == RT_MAPEXPR_NULL)
+						continue;
+					else if (k && (a->status[i] != RT_MAPEXPR_OK || mapexpr_cmp(a->values[i], cond->values[i]) != 0))
+						continue;
+					else if (!k && !cond->values[i])
+						continue;
 
-					if (byHeight) {
-						rt_raster_cell_to_geopoint(
-							rast2,
-							0, row,
-							&(line2[X1]), &(line2[Y1]),
-							gt2
-						);
+					s[i] = res->status[i];
+					v[i] = res->values[i];
+					break;
+				}
 
-						rt_raster_cell_to_geopoint(
-							rast2,
-							width2, row,
-							&(line2[X2]), &(line2[Y2]),
-							gt2
-						);
+				if (j >= last && node->haselse) {
+					s[i] = node->args[last]->status[i];
+					v[i] = node->args[last]->values[i];
+				}
+			}
+			break;
+		case MAPEXPR_CAST:
+			for (i = 0; i < count; i++) {
+				s[i] = a->status[i];
+				if (s[i] == RT_MAPEXPR_OK)
+					s[i] = mapexpr_cast(a->type, node->type, a->values[i], &(v[i]));
+			}
+			break;
+		case MAPEXPR_FUNC:
+			switch (node->fn) {
+				case MAPEXPR_FN_GREATEST:
+				case MAPEXPR_FN_LEAST:
+					for (i = 0; i < count; i++) {
+						s[i] = RT_MAPEXPR_NULL;
+						for (j = 0; j < node->nargs; j++) {
+							mapexpr_node arg = node->args[j];
+
+							if (arg->status[i] > RT_MAPEXPR_NULL) {
+								s[i] = arg->status[i];
+								break;
+							}
+							else if (arg->status[i] == RT_MAPEXPR_NULL)
+								continue;
+
+							c = (s[i] == RT_MAPEXPR_OK) ? mapexpr_cmp(arg->values[i], v[i]) : 0;
+							if (
+								s[i] == RT_MAPEXPR_NULL ||
+								(node->fn == MAPEXPR_FN_GREATEST && c > 0) ||
+								(node->fn == MAPEXPR_FN_LEAST && c < 0)
+							) {
+								s[i] = RT_MAPEXPR_OK;
+								v[i] = arg->values[i];
+							}
+						}
 					}
-					else {
-						rt_raster_cell_to_geopoint(
-							rast2,
-							row, 0,
-							&(line2[X1]), &(line2[Y1]),
-							gt2
-						);
+					break;
+				case MAPEXPR_FN_COALESCE:
+					for (i = 0; i < count; i++) {
+						s[i] = RT_MAPEXPR_NULL;
+						for (j = 0; j < node->nargs; j++) {
+							if (node->args[j]->status[i] == RT_MAPEXPR_NULL)
+								continue;
 
-						rt_raster_cell_to_geopoint(
-							rast2,
-							row, height2,
-							&(line2[X2]), &(line2[Y2]),
-							gt2
-						);
+							s[i] = node->args[j]->status[i];
+							v[i] = node->args[j]->values[i];
+							break;
+						}
+					}
+					break;
+				case MAPEXPR_FN_NULLIF:
+					for (i = 0; i < count; i++) {
+						s[i] = a->status[i];
+						v[i] = a->values[i];
+						if (s[i] > RT_MAPEXPR_NULL)
+							continue;
+						if (b->status[i] > RT_MAPEXPR_NULL)
+							s[i] = b->status[i];
+						else if (
+							s[i] == RT_MAPEXPR_OK &&
+							b->status[i] == RT_MAPEXPR_OK &&
+							mapexpr_cmp(a->values[i], b->values[i]) == 0
+						) {
+							s[i] = RT_MAPEXPR_NULL;
+						}
+					}
+					break;
+				default:
+					for (i = 0; i < count; i++) {
+						if (node->nargs > 1)
+							s[i] = MAPEXPR_STRICT2(a->status[i], b->status[i]);
+						else if (node->nargs > 0)
+							s[i] = a->status[i];
+						else
+							s[i] = RT_MAPEXPR_OK;
+
+						if (s[i] == RT_MAPEXPR_OK) {
+							s[i] = mapexpr_compute(
+								node,
+								(a != NULL) ? a->values[i] : 0,
+								(b != NULL) ? b->values[i] : 0,
+								&(v[i])
+							);
+						}
 					}
+					break;
+			}
+			break;
+		default:
+			rterror("mapexpr_node_eval: Unknown expression node %d", node->op);
+			return 0;
+	}
 
-					RASTER_DEBUGF(4, "(col, row) = (%d, %d)", col, row);
-					RASTER_DEBUGF(4, "line1(x1, y1, x2, y2) = (%f, %f, %f, %f)",
-						line1[X1], line1[Y1], line1[X2], line1[Y2]);
-					RASTER_DEBUGF(4, "line2(x1, y1, x2, y2) = (%f, %f, %f, %f)",
-						line2[X1], line2[Y1], line2[X2], line2[Y2]);
+	return 1;
+}
 
-					/* intersection */
-					/* http://en.wikipedia.org/wiki/Line-line_intersection */
-					d = ((line1[X1] - line1[X2]) * (line2[Y1] - line2[Y2])) - ((line1[Y1] - line1[Y2]) * (line2[X1] - line2[X2]));
-					/* no intersection */
-					if (FLT_EQ(d, 0.)) {
-						continue;
-					}
+/* bind the caller's variables to the variable nodes */
+static void
+mapexpr_node_bind(mapexpr_node node, double **values, uint8_t **status, uint8_t *nonull) {
+	int i;
 
-					P[pX] = (((line1[X1] * line1[Y2]) - (line1[Y1] * line1[X2])) * (line2[X1] - line2[X2])) -
-						((line1[X1] - line1[X2]) * ((line2[X1] * line2[Y2]) - (line2[Y1] * line2[X2])));
-					P[pX] = P[pX] / d;
+	if (node->op == MAPEXPR_VAR) {
+		node->values = values[node->var];
+		if (status != NULL && status[node->var] != NULL)
+			node->status = status[node->var];
+		else
+			node->status = nonull;
+		return;
+	}
 
-					P[pY] = (((line1[X1] * line1[Y2]) - (line1[Y1] * line1[X2])) * (line2[Y1] - line2[Y2])) -
-						((line1[Y1] - line1[Y2]) * ((line2[X1] * line2[Y2]) - (line2[Y1] * line2[X2])));
-					P[pY] = P[pY] / d;
+	for (i = 0; i < node->nargs; i++)
+		mapexpr_node_bind(node->args[i], values, status, nonull);
+}
 
-					RASTER_DEBUGF(4, "P(x, y) = (%f, %f)", P[pX], P[pY]);
+rt_mapexpr
+rt_mapexpr_compile(const char *expression, int nrast) {
+	mapexpr_parser p;
+	mapexpr_node root = NULL;
+	rt_mapexpr expr = NULL;
 
-					/* intersection within bounds */
-					if ((
-							(FLT_EQ(P[pX], line1[X1]) || FLT_EQ(P[pX], line1[X2])) ||
-								(P[pX] > fmin(line1[X1], line1[X2]) && (P[pX] < fmax(line1[X1], line1[X2])))
-						) && (
-							(FLT_EQ(P[pY], line1[Y1]) || FLT_EQ(P[pY], line1[Y2])) ||
-								(P[pY] > fmin(line1[Y1], line1[Y2]) && (P[pY] < fmax(line1[Y1], line1[Y2])))
-						) && (
-							(FLT_EQ(P[pX], line2[X1]) || FLT_EQ(P[pX], line2[X2])) ||
-								(P[pX] > fmin(line2[X1], line2[X2]) && (P[pX] < fmax(line2[X1], line2[X2])))
-						) && (
-							(FLT_EQ(P[pY], line2[Y1]) || FLT_EQ(P[pY], line2[Y2])) ||
-								(P[pY] > fmin(line2[Y1], line2[Y2]) && (P[pY] < fmax(line2[Y1], line2[Y2])))
-					)) {
-						RASTER_DEBUG(4, "within bounds");
+	assert(NULL != expression);
 
-						for (i = 0; i < 8; i++) adjacent[i] = 0;
+	if (nrast < 1 || nrast > 2) {
+		rterror("rt_mapexpr_compile: Invalid number of rasters: %d", nrast);
+		return NULL;
+	}
 
-						/* test points around intersection */
-						for (i = 0; i < 8; i++) {
-							switch (i) {
-								case 7:
-									Qw[pX] = P[pX] - xscale;
-									Qw[pY] = P[pY] + yscale;
-									break;
-								/* 270 degrees = 09:00 */
-								case 6:
-									Qw[pX] = P[pX] - xscale;
-									Qw[pY] = P[pY];
-									break;
-								case 5:
-									Qw[pX] = P[pX] - xscale;
-									Qw[pY] = P[pY] - yscale;
-									break;
-								/* 180 degrees = 06:00 */
-								case 4:
-									Qw[pX] = P[pX];
-									Qw[pY] = P[pY] - yscale;
-									break;
-								case 3:
-									Qw[pX] = P[pX] + xscale;
-									Qw[pY] = P[pY] - yscale;
-									break;
-								/* 90 degrees = 03:00 */
-								case 2:
-									Qw[pX] = P[pX] + xscale;
-									Qw[pY] = P[pY];
-									break;
-								/* 45 degrees */
-								case 1:
-									Qw[pX] = P[pX] + xscale;
-									Qw[pY] = P[pY] + yscale;
-									break;
-								/* 0 degrees = 00:00 */
-								case 0:
-									Qw[pX] = P[pX];
-									Qw[pY] = P[pY] + yscale;
-									break;
-							}
+	memset(&p, 0, sizeof(mapexpr_parser));
+	p.input = expression;
+	p.pos = expression;
+	p.nrast = nrast;
 
-							/* unable to convert point to cell */
-							noval1 = 0;
-							if (!rt_raster_geopoint_to_cell(
-								rast1,
-								Qw[pX], Qw[pY],
-								&(Qr[pX]), &(Qr[pY]),
-								igt1
-							)) {
-								noval1 = 1;
-							}
-							/* cell is outside bounds of grid */
-							else if (
-								(Qr[pX] < 0 || Qr[pX] > width1 || FLT_EQ(Qr[pX], width1)) ||
-								(Qr[pY] < 0 || Qr[pY] > height1 || FLT_EQ(Qr[pY], height1))
-							) {
-								noval1 = 1;
-							}
-							else if (hasnodata1 == FALSE)
-								val1 = 1;
-							/* unable to get value at cell */
-							else if (rt_band_get_pixel(band1, Qr[pX], Qr[pY], &val1) < 0)
-								noval1 = 1;
+	mapexpr_next(&p);
+	root = mapexpr_parse_expr(&p);
 
-							/* unable to convert point to cell */
-							noval2 = 0;
-							if (!rt_raster_geopoint_to_cell(
-								rast2,
-								Qw[pX], Qw[pY],
-								&(Qr[pX]), &(Qr[pY]),
-								igt2
-							)) {
-								noval2 = 1;
-							}
-							/* cell is outside bounds of grid */
-							else if (
-								(Qr[pX] < 0 || Qr[pX] > width2 || FLT_EQ(Qr[pX], width2)) ||
-								(Qr[pY] < 0 || Qr[pY] > height2 || FLT_EQ(Qr[pY], height2))
-							) {
-								noval2 = 1;
-							}
-							else if (hasnodata2 == FALSE)
-								val2 = 1;
-							/* unable to get value at cell */
-							else if (rt_band_get_pixel(band2, Qr[pX], Qr[pY], &val2) < 0)
-								noval2 = 1;
+	/* trailing input or untyped/boolean result */
+	if (
+		root == NULL || p.failed || p.tk != MAPEXPR_TK_END ||
+		root->type == MAPEXPR_UNKNOWN || root->type == MAPEXPR_BOOL
+	) {
+		RASTER_DEBUGF(3, "expression \"%s\" cannot be compiled", expression);
+		mapexpr_node_destroy(root);
+		return NULL;
+	}
+
+	expr = rtalloc(sizeof(struct rt_mapexpr_t));
+	if (expr == NULL) {
+		rterror("rt_mapexpr_compile: Unable to allocate memory for compiled expression");
+		mapexpr_node_destroy(root);
+		return NULL;
+	}
+	memset(expr, 0, sizeof(struct rt_mapexpr_t));
 
-							if (!noval1) {
-								RASTER_DEBUGF(4, "val1 = %f", val1);
-							}
-							if (!noval2) {
-								RASTER_DEBUGF(4, "val2 = %f", val2);
-							}
+	expr->root = root;
+	memcpy(expr->uses, p.uses, sizeof(int) * RT_MAPEXPR_NVARS);
 
-							/* pixels touch */
-							if (!noval1 && (
-								(hasnodata1 == FALSE) || (
-									(hasnodata1 != FALSE) &&
-									FLT_NEQ(val1, nodata1)
-								)
-							)) {
-								adjacent[i]++;
-							}
-							if (!noval2 && (
-								(hasnodata2 == FALSE) || (
-									(hasnodata2 != FALSE) &&
-									FLT_NEQ(val2, nodata2)
-								)
-							)) {
-								adjacent[i] += 3;
-							}
+	RASTER_DEBUGF(3, "expression \"%s\" compiled", expression);
+	return expr;
+}
 
-							/* two pixel values not present */
-							if (noval1 || noval2) {
-								RASTER_DEBUGF(4, "noval1 = %d, noval2 = %d", noval1, noval2);
-								continue;
-							}
+int
+rt_mapexpr_has_var(rt_mapexpr expr, rt_mapexpr_var var) {
+	assert(NULL != expr);
 
-							/* pixels valid, so intersect */
-							if ((
-									(hasnodata1 == FALSE) || (
-										(hasnodata1 != FALSE) &&
-										FLT_NEQ(val1, nodata1)
-									)
-								) && (
-									(hasnodata2 == FALSE) || (
-										(hasnodata2 != FALSE) &&
-										FLT_NEQ(val2, nodata2)
-									)
-							)) {
-								RASTER_DEBUG(3, "The two rasters do intersect");
+	if (var < 0 || var >= RT_MAPEXPR_NVARS)
+		return 0;
 
-								return 1;
-							}
-						}
+	return expr->uses[var];
+}
 
-						/* pixels touch */
-						for (i = 0; i < 4; i++) {
-							RASTER_DEBUGF(4, "adjacent[%d] = %d, adjacent[%d] = %d"
-								, i, adjacent[i], i + 4, adjacent[i + 4]);
-							if (adjacent[i] == 0) continue;
+int
+rt_mapexpr_eval(rt_mapexpr expr, uint32_t count,
+	double **values, uint8_t **status,
+	double *result, uint8_t *rstatus
+) {
+	int i;
 
-							if (adjacent[i] + adjacent[i + 4] == 4) {
-								RASTER_DEBUG(3, "The two rasters touch");
+	assert(NULL != expr);
+	assert(NULL != result);
+	assert(NULL != rstatus);
 
-								return 1;
-							}
-						}
-					}
-					else {
-						RASTER_DEBUG(4, "outside of bounds");
-					}
-				}
-			}
+	if (count < 1)
+		return 1;
+
+	for (i = 0; i < RT_MAPEXPR_NVARS; i++) {
+		if (expr->uses[i] && (values == NULL || values[i] == NULL)) {
+			rterror("rt_mapexpr_eval: No values provided for variable %d of expression", i);
+			return 0;
 		}
 	}
 
-	return 0;
+	/* grow buffers */
+	if (count > expr->capacity) {
+		expr->nonull = rtrealloc(expr->nonull, sizeof(uint8_t) * count);
+		if (expr->nonull == NULL) {
+			rterror("rt_mapexpr_eval: Unable to allocate memory for expression buffers");
+			return 0;
+		}
+		memset(expr->nonull, RT_MAPEXPR_OK, sizeof(uint8_t) * count);
+
+		if (!mapexpr_node_reserve(expr->root, count, expr->nonull))
+			return 0;
+		expr->capacity = count;
+	}
+
+	mapexpr_node_bind(expr->root, values, status, expr->nonull);
+
+	if (!mapexpr_node_eval(expr->root, count))
+		return 0;
+
+	memcpy(result, expr->root->values, sizeof(double) * count);
+	memcpy(rstatus, expr->root->status, sizeof(uint8_t) * count);
+
+	return 1;
 }
 
-/**
- * Return zero if error occurred in function.
- * Parameter intersects returns non-zero if two rasters intersect
+const char *
+rt_mapexpr_status_message(uint8_t status) {
+	switch (status) {
+		case RT_MAPEXPR_OK:
+			return "no error";
+		case RT_MAPEXPR_NULL:
+			return "null value";
+		case RT_MAPEXPR_ERR_DIVZERO:
+			return "division by zero";
+		case RT_MAPEXPR_ERR_INTRANGE:
+			return "integer out of range";
+		case RT_MAPEXPR_ERR_OVERFLOW:
+			return "value out of range: overflow";
+		case RT_MAPEXPR_ERR_UNDERFLOW:
+			return "value out of range: underflow";
+		case RT_MAPEXPR_ERR_SQRTNEG:
+			return "cannot take square root of a negative number";
+		case RT_MAPEXPR_ERR_LOGZERO:
+			return "cannot take logarithm of zero";
+		case RT_MAPEXPR_ERR_LOGNEG:
+			return "cannot take logarithm of a negative number";
+		case RT_MAPEXPR_ERR_RANGE:
+			return "input is out of range";
+		case RT_MAPEXPR_ERR_POWZERO:
+			return "zero raised to a negative power is undefined";
+		case RT_MAPEXPR_ERR_POWNEG:
+			return "a negative number raised to a non-integer power yields a complex result";
+		case RT_MAPEXPR_ERR_NUMERICINF:
+			return "cannot convert infinity to numeric";
+		default:
+			return "unknown error";
+	}
+}
+
+void
+rt_mapexpr_destroy(rt_mapexpr expr) {
+	if (expr == NULL) return;
+
+	mapexpr_node_destroy(expr->root);
+	if (expr->nonull != NULL) rtdealloc(expr->nonull);
+	rtdealloc(expr);
+}
+
+/******************************************************************************
+ * Mergeable band statistics
  *
- * @param rast1 : the first raster whose band will be tested
- * @param nband1 : the 0-based band of raster rast1 to use
- *   if value is less than zero, bands are ignored.
- *   if nband1 gte zero, nband2 must be gte zero
- * @param rast2 : the second raster whose band will be tested
- * @param nband2 : the 0-based band of raster rast2 to use
- *   if value is less than zero, bands are ignored
- *   if nband2 gte zero, nband1 must be gte zero
- * @param intersects : non-zero value if the two rasters' bands intersects
+ * A rt_statsagg is filled in a single pass over one or more bands and
+ * holds everything rt_band_get_summary_stats, rt_band_get_histogram and
+ * rt_band_get_quantiles need: count, sum, min, max and the running mean
+ * and sum of squared differences of Welford's one-pass variance.  Two
+ * of them can be merged, so one can be kept per tile, per worker or per
+ * aggregate state and combined at the end.
  *
- * @return if zero, an error occurred in function
- */
-int
-rt_raster_intersects(
-	rt_raster rast1, int nband1,
-	rt_raster rast2, int nband2,
-	int *intersects
-) {
-	int i;
-	int j;
-	int within = 0;
+ * Values are kept for histograms and quantiles, either all of them or
+ * in a quantile sketch of limited size.  The sketch is a stack of levels
+ * of at most sketch_size values each, a value of level l standing for
+ * 2^l values of the band.  When a level is full, its values are sorted
+ * and every other one moves up a level, alternating between the odd
+ * and even ranks from one compaction to the next (a deterministic KLL
+ * sketch with equal capacities).  Until the first compaction, i.e. for
+ * less than sketch_size values, the results are exact.  After that,
+ * the rank of any value is off by at most about
+ * levels * count / sketch_size.
+ *****************************************************************************/
 
-	LWPOLY *hull[2] = {NULL};
-	GEOSGeometry *ghull[2] = {NULL};
+/* enough levels for 2^32 values */
+#define RT_STATSAGG_MAX_LEVELS 32
 
-	uint16_t width1;
-	uint16_t height1;
-	uint16_t width2;
-	uint16_t height2;
-	double area1;
-	double area2;
-	double pixarea1;
-	double pixarea2;
-	rt_raster rastS = NULL;
-	rt_raster rastL = NULL;
-	uint16_t *widthS = NULL;
-	uint16_t *heightS = NULL;
-	uint16_t *widthL = NULL;
-	uint16_t *heightL = NULL;
-	int nbandS;
-	int nbandL;
-	rt_band bandS = NULL;
-	rt_band bandL = NULL;
-	int hasnodataS = FALSE;
-	int hasnodataL = FALSE;
-	double nodataS = 0;
-	double nodataL = 0;
-	double gtS[6] = {0};
-	double igtL[6] = {0};
+struct rt_statsagg_level_t {
+	double *values;
+	uint32_t count;
+	uint32_t size; /* # of values allocated */
+	uint8_t offset; /* values of this rank parity move up next */
+};
 
-	uint32_t row;
-	uint32_t rowoffset;
-	uint32_t col;
-	uint32_t coloffset;
+struct rt_statsagg_t {
+	double sample;
 
-	enum line_points {X1, Y1, X2, Y2};
-	enum point {pX, pY};
-	double lineS[4];
-	double Qr[2];
-	double valS;
-	double valL;
+	uint32_t count;
+	double min;
+	double max;
+	double sum;
+	double M; /* running mean */
+	double Q; /* sum of squared differences from the mean */
 
-	RASTER_DEBUG(3, "Starting");
+	int keep_values;
+	uint32_t sketch_size; /* max # of values per level, 0 to keep all */
+	uint8_t levels_count;
+	struct rt_statsagg_level_t levels[RT_STATSAGG_MAX_LEVELS];
+};
 
-	assert(NULL != rast1);
-	assert(NULL != rast2);
+/* value and weight of a sketch item */
+struct _rti_statsagg_item_t {
+	double value;
+	uint32_t weight;
+};
 
-	if (nband1 < 0 && nband2 < 0) {
-		nband1 = -1;
-		nband2 = -1;
-	}
-	else {
-		assert(nband1 >= 0 && nband1 < rt_raster_get_num_bands(rast1));
-		assert(nband2 >= 0 && nband2 < rt_raster_get_num_bands(rast2));
-	}
+static int
+_rti_statsagg_cmp_value(const void *a, const void *b) {
+	const double *_a = a;
+	const double *_b = b;
 
-	/* same srid */
-	if (rt_raster_get_srid(rast1) != rt_raster_get_srid(rast2)) {
-		rterror("rt_raster_intersects: The two rasters provided have different SRIDs");
-		*intersects = 0;
+	if (*_a < *_b) return -1;
+	if (*_a > *_b) return 1;
+	return 0;
+}
+
+static int
+_rti_statsagg_cmp_item(const void *a, const void *b) {
+	const struct _rti_statsagg_item_t *_a = a;
+	const struct _rti_statsagg_item_t *_b = b;
+
+	if (_a->value < _b->value) return -1;
+	if (_a->value > _b->value) return 1;
+	return 0;
+}
+
+/* make room for count more values in a level */
+static int
+_rti_statsagg_level_reserve(rt_statsagg agg, int l, uint32_t count) {
+	struct rt_statsagg_level_t *level = &(agg->levels[l]);
+	uint32_t size = level->size;
+	double *values = NULL;
+
+	if (level->count + count <= level->size)
+		return 1;
+
+	if (size < 1)
+		size = (agg->sketch_size > 0) ? agg->sketch_size : 64;
+	while (size < level->count + count)
+		size *= 2;
+
+	values = rtrealloc(level->values, sizeof(double) * size);
+	if (NULL == values) {
+		rterror("rt_statsagg: Unable to allocate memory for values");
 		return 0;
 	}
+	level->values = values;
+	level->size = size;
 
-	/* raster extents need to intersect */
-	do {
-		int rtn;
+	if (l >= agg->levels_count)
+		agg->levels_count = l + 1;
 
-		initGEOS(lwnotice, lwgeom_geos_error);
+	return 1;
+}
 
-		rtn = 1;
-		for (i = 0; i < 2; i++) {
-			hull[i] = rt_raster_get_convex_hull(i < 1 ? rast1 : rast2);
-			if (NULL == hull[i]) {
-				for (j = 0; j < i; j++) {
-					GEOSGeom_destroy(ghull[j]);
-					lwpoly_free(hull[j]);
-				}
-				rtn = 0;
-				break;
-			}
-			ghull[i] = (GEOSGeometry *) LWGEOM2GEOS((LWGEOM *) hull[i]);
-			if (NULL == ghull[i]) {
-				for (j = 0; j < i; j++) {
-					GEOSGeom_destroy(ghull[j]);
-					lwpoly_free(hull[j]);
-				}
-				lwpoly_free(hull[i]);
-				rtn = 0;
-				break;
-			}
+/*
+ * move half of the values of full levels up, starting at level l.  All
+ * the levels above are checked, as a merge may have filled any of them
+ */
+static int
+_rti_statsagg_compact(rt_statsagg agg, int l) {
+	struct rt_statsagg_level_t *level = NULL;
+	struct rt_statsagg_level_t *up = NULL;
+	uint32_t even;
+	uint32_t i;
+
+	if (agg->sketch_size < 1)
+		return 1;
+
+	for (; l < agg->levels_count; l++) {
+		level = &(agg->levels[l]);
+		if (level->count < agg->sketch_size)
+			continue;
+
+		if (l + 1 >= RT_STATSAGG_MAX_LEVELS) {
+			rterror("rt_statsagg: Too many values for sketch");
+			return 0;
 		}
-		if (!rtn) break;
+		if (!_rti_statsagg_level_reserve(agg, l + 1, level->count / 2))
+			return 0;
+		up = &(agg->levels[l + 1]);
+
+		qsort(level->values, level->count, sizeof(double), _rti_statsagg_cmp_value);
+
+		/* an odd value out stays on this level */
+		even = level->count & ~((uint32_t) 1);
+		for (i = level->offset; i < even; i += 2)
+			up->values[up->count++] = level->values[i];
+
+		if (even < level->count) {
+			level->values[0] = level->values[even];
+			level->count = 1;
+		}
+		else
+			level->count = 0;
+		level->offset ^= 1;
+	}
+
+	return 1;
+}
+
+/* account for count values, ignoring nodata if asked to */
+static int
+_rti_statsagg_add_values(rt_statsagg agg, const double *values, uint32_t count,
+	int exclude_nodata_value, double nodata) {
+	struct rt_statsagg_level_t *level = &(agg->levels[0]);
+	double value;
+	uint32_t i;
+
+	for (i = 0; i < count; i++) {
+		value = values[i];
+
+		if (exclude_nodata_value && FLT_EQ(value, nodata))
+			continue;
+
+		agg->count++;
+		agg->sum += value;
+
+		/*
+			one-pass standard deviation
+			http://www.eecs.berkeley.edu/~mhoemmen/cs194/Tutorials/variance.pdf
+		*/
+		if (agg->count == 1) {
+			agg->Q = 0;
+			agg->M = value;
+			agg->min = agg->max = value;
+		}
+		else {
+			agg->Q += (((agg->count - 1) * (value - agg->M) * (value - agg->M)) / agg->count);
+			agg->M += ((value - agg->M) / agg->count);
+
+			if (value < agg->min)
+				agg->min = value;
+			if (value > agg->max)
+				agg->max = value;
+		}
+
+		if (!agg->keep_values)
+			continue;
+
+		if (!_rti_statsagg_level_reserve(agg, 0, 1))
+			return 0;
+		level->values[level->count++] = value;
+
+		if (agg->sketch_size > 0 && level->count >= agg->sketch_size) {
+			if (!_rti_statsagg_compact(agg, 0))
+				return 0;
+		}
+	}
+
+	return 1;
+}
 
-		/* test to see if raster within the other */
-		within = 0;
-		if (GEOSWithin(ghull[0], ghull[1]) == 1)
-			within = -1;
-		else if (GEOSWithin(ghull[1], ghull[0]) == 1)
-			within = 1;
+/*
+ * Gather the values of all levels.  values are sorted ascending and
+ * weights is set to NULL if all the values have the same weight of one.
+ */
+static int
+_rti_statsagg_get_values(rt_statsagg agg,
+	double **values, uint32_t **weights, uint32_t *values_count) {
+	struct _rti_statsagg_item_t *items = NULL;
+	uint32_t count = 0;
+	uint32_t i;
+	uint32_t j;
+	int l;
 
-		if (within != 0)
-			rtn = 1;
-		else
-			rtn = GEOSIntersects(ghull[0], ghull[1]);
+	*values = NULL;
+	*weights = NULL;
+	*values_count = 0;
 
-		for (i = 0; i < 2; i++) {
-			GEOSGeom_destroy(ghull[i]);
-			lwpoly_free(hull[i]);
-		}
+	for (l = 0; l < agg->levels_count; l++)
+		count += agg->levels[l].count;
 
-		if (rtn != 2) {
-			RASTER_DEBUGF(4, "convex hulls of rasters do %sintersect", rtn != 1 ? "NOT " : "");
-			if (rtn != 1) {
-				*intersects = 0;
-				return 1;
-			}
-			/* band isn't specified */
-			else if (nband1 < 0) {
-				*intersects = 1;
-				return 1;
-			}
-		}
+	if (count < 1) {
+		rterror("rt_statsagg: No values to process");
+		return 0;
 	}
-	while (0);
 
-	/* smaller raster by area or width */
-	width1 = rt_raster_get_width(rast1);
-	height1 = rt_raster_get_height(rast1);
-	width2 = rt_raster_get_width(rast2);
-	height2 = rt_raster_get_height(rast2);
-	pixarea1 = fabs(rt_raster_get_x_scale(rast1) * rt_raster_get_y_scale(rast1));
-	pixarea2 = fabs(rt_raster_get_x_scale(rast2) * rt_raster_get_y_scale(rast2));
-	area1 = fabs(width1 * height1 * pixarea1);
-	area2 = fabs(width2 * height2 * pixarea2);
-	RASTER_DEBUGF(4, "pixarea1, pixarea2, area1, area2 = %f, %f, %f, %f",
-		pixarea1, pixarea2, area1, area2);
-	if (
-		(within <= 0) ||
-		(area1 < area2) ||
-		FLT_EQ(area1, area2) ||
-		(area1 < pixarea2) || /* area of rast1 smaller than pixel area of rast2 */
-		FLT_EQ(area1, pixarea2)
-	) {
-		rastS = rast1;
-		nbandS = nband1;
-		widthS = &width1;
-		heightS = &height1;
+	*values = rtalloc(sizeof(double) * count);
+	if (NULL == *values) {
+		rterror("rt_statsagg: Unable to allocate memory for values");
+		return 0;
+	}
 
-		rastL = rast2;
-		nbandL = nband2;
-		widthL = &width2;
-		heightL = &height2;
+	/* all the values are on the first level */
+	if (count == agg->levels[0].count) {
+		memcpy(*values, agg->levels[0].values, sizeof(double) * count);
+		qsort(*values, count, sizeof(double), _rti_statsagg_cmp_value);
+		*values_count = count;
+		return 1;
 	}
-	else {
-		rastS = rast2;
-		nbandS = nband2;
-		widthS = &width2;
-		heightS = &height2;
 
-		rastL = rast1;
-		nbandL = nband1;
-		widthL = &width1;
-		heightL = &height1;
+	*weights = rtalloc(sizeof(uint32_t) * count);
+	items = rtalloc(sizeof(struct _rti_statsagg_item_t) * count);
+	if (NULL == *weights || NULL == items) {
+		rterror("rt_statsagg: Unable to allocate memory for values");
+		rtdealloc(*values);
+		*values = NULL;
+		if (NULL != *weights) rtdealloc(*weights);
+		*weights = NULL;
+		if (NULL != items) rtdealloc(items);
+		return 0;
 	}
 
-	/* no band to use, set band to zero */
-	if (nband1 < 0) {
-		nbandS = 0;
-		nbandL = 0;
+	for (l = 0, j = 0; l < agg->levels_count; l++) {
+		for (i = 0; i < agg->levels[l].count; i++, j++) {
+			items[j].value = agg->levels[l].values[i];
+			items[j].weight = ((uint32_t) 1) << l;
+		}
 	}
+	qsort(items, count, sizeof(struct _rti_statsagg_item_t), _rti_statsagg_cmp_item);
 
-	RASTER_DEBUGF(4, "rast1 @ %p", rast1);
-	RASTER_DEBUGF(4, "rast2 @ %p", rast2);
-	RASTER_DEBUGF(4, "rastS @ %p", rastS);
-	RASTER_DEBUGF(4, "rastL @ %p", rastL);
+	for (j = 0; j < count; j++) {
+		(*values)[j] = items[j].value;
+		(*weights)[j] = items[j].weight;
+	}
+	rtdealloc(items);
 
-	/* load band of smaller raster */
-	bandS = rt_raster_get_band(rastS, nbandS);
-	if (NULL == bandS) {
-		rterror("rt_raster_intersects: Unable to get band %d of the first raster", nbandS);
-		*intersects = 0;
-		return 0;
+	*values_count = count;
+	return 1;
+}
+
+/* hand the unsketched values over to the caller */
+static double *
+_rti_statsagg_steal_values(rt_statsagg agg) {
+	struct rt_statsagg_level_t *level = &(agg->levels[0]);
+	double *values = level->values;
+
+	if (NULL == values || level->count < 1)
+		return NULL;
+
+	/* free unused memory */
+	if (level->count != level->size)
+		values = rtrealloc(values, sizeof(double) * level->count);
+
+	level->values = NULL;
+	level->count = 0;
+	level->size = 0;
+
+	return values;
+}
+
+static void
+_rti_statsagg_get_moments(rt_statsagg agg, double *M, double *Q) {
+	*M = agg->M;
+	*Q = agg->Q;
+}
+
+rt_statsagg
+rt_statsagg_new(int keep_values, uint32_t sketch_size) {
+	rt_statsagg agg = NULL;
+
+	agg = rtalloc(sizeof(struct rt_statsagg_t));
+	if (NULL == agg) {
+		rterror("rt_statsagg_new: Unable to allocate memory for statistics");
+		return NULL;
 	}
-	if (bandS->offline) {
-		rterror("rt_raster_intersects not implemented yet for OFFDB bands");
-		*intersects = 0;
-		return 0;
+	memset(agg, 0, sizeof(struct rt_statsagg_t));
+
+	agg->sample = 1;
+	agg->keep_values = keep_values ? 1 : 0;
+
+	/* compaction needs pairs of values */
+	agg->sketch_size = sketch_size;
+	if (agg->sketch_size > 0 && agg->sketch_size < 2)
+		agg->sketch_size = 2;
+	agg->sketch_size += agg->sketch_size % 2;
+
+	return agg;
+}
+
+void
+rt_statsagg_destroy(rt_statsagg agg) {
+	int l;
+
+	if (NULL == agg) return;
+
+	for (l = 0; l < agg->levels_count; l++) {
+		if (NULL != agg->levels[l].values)
+			rtdealloc(agg->levels[l].values);
 	}
+	rtdealloc(agg);
+}
 
-	hasnodataS = rt_band_get_hasnodata_flag(bandS);
-	if (hasnodataS != FALSE)
-		nodataS = rt_band_get_nodata(bandS);
+int
+rt_statsagg_add_band(rt_statsagg agg, rt_band band,
+	int exclude_nodata_value, double sample) {
+	uint32_t x = 0;
+	uint32_t y = 0;
+	uint32_t z = 0;
+	uint32_t offset = 0;
+	uint32_t diff = 0;
+	uint32_t i = 0;
+	int rtn;
+	int hasnodata = FALSE;
+	double nodata = 0;
+	double value;
+	double *block = NULL;
+	uint32_t block_count = 0;
+	uint32_t block_max = 0;
+	void *line = NULL;
 
-	/* load band of larger raster */
-	bandL = rt_raster_get_band(rastL, nbandL);
-	if (NULL == bandL) {
-		rterror("rt_raster_intersects: Unable to get band %d of the first raster", nbandL);
-		*intersects = 0;
+	uint32_t do_sample = 0;
+	uint32_t sample_size = 0;
+	uint32_t sample_per = 0;
+	uint32_t sample_int = 0;
+
+	assert(NULL != agg);
+	assert(NULL != band);
+
+	if (NULL == rt_band_get_data(band)) {
+		rterror("rt_statsagg_add_band: Cannot get band data");
 		return 0;
 	}
-	if (bandL->offline) {
-		rterror("rt_raster_intersects not implemented yet for OFFDB bands");
-		*intersects = 0;
-		return 0;
+
+	hasnodata = rt_band_get_hasnodata_flag(band);
+	if (hasnodata != FALSE)
+		nodata = rt_band_get_nodata(band);
+	else
+		exclude_nodata_value = 0;
+
+	RASTER_DEBUGF(3, "nodata = %f", nodata);
+	RASTER_DEBUGF(3, "hasnodata = %d", hasnodata);
+	RASTER_DEBUGF(3, "exclude_nodata_value = %d", exclude_nodata_value);
+
+	/* clamp percentage */
+	if (
+		(sample < 0 || FLT_EQ(sample, 0.0)) ||
+		(sample > 1 || FLT_EQ(sample, 1.0))
+	) {
+		do_sample = 0;
+		sample = 1;
 	}
+	else
+		do_sample = 1;
+	RASTER_DEBUGF(3, "do_sample = %d", do_sample);
+	if (do_sample) agg->sample = sample;
 
-	hasnodataL = rt_band_get_hasnodata_flag(bandL);
-	if (hasnodataL != FALSE)
-		nodataL = rt_band_get_nodata(bandL);
+	/* entire band is nodata */
+	if (rt_band_get_isnodata_flag(band) != FALSE && exclude_nodata_value) {
+		rtwarn("All pixels of band have the NODATA value");
+		return 1;
+	}
 
-	/* no band to use, ignore nodata */
-	if (nband1 < 0) {
-		hasnodataS = FALSE;
-		hasnodataL = FALSE;
+	/* the statistics of the band are known, no need to read the pixels */
+	if (!do_sample && !agg->keep_values && band->hascachedstats) {
+		RASTER_DEBUG(3, "using cached statistics of band");
+		return rt_statsagg_add_cached_stats(agg, &(band->cachedstats), exclude_nodata_value);
 	}
 
-	/* special case where a raster can fit inside another raster's pixel */
-	if (within != 0 && ((pixarea1 > area2) || (pixarea2 > area1))) {
-		RASTER_DEBUG(4, "Using special case of raster fitting into another raster's pixel");
-		/* 3 x 3 search */
-		for (coloffset = 0; coloffset < 3; coloffset++) {
-			for (rowoffset = 0; rowoffset < 3; rowoffset++) {
-				for (col = coloffset; col < *widthS; col += 3) {
-					for (row = rowoffset; row < *heightS; row += 3) {
-						if (hasnodataS == FALSE)
-							valS = 1;
-						else if (rt_band_get_pixel(bandS, col, row, &valS) < 0)
-							continue;
+	if (rt_band_get_isnodata_flag(band) != FALSE) {
+		for (y = 0; y < band->height; y++) {
+			for (x = 0; x < band->width; x++) {
+				if (!_rti_statsagg_add_values(agg, &nodata, 1, 0, nodata))
+					return 0;
+			}
+		}
 
-						if ((hasnodataS == FALSE) || (
-							(hasnodataS != FALSE) &&
-							FLT_NEQ(valS, nodataS)
-						)) {
-							rt_raster_cell_to_geopoint(
-								rastS,
-								col, row,
-								&(lineS[X1]), &(lineS[Y1]),
-								gtS
-							);
+		return 1;
+	}
 
-							if (!rt_raster_geopoint_to_cell(
-								rastL,
-								lineS[X1], lineS[Y1],
-								&(Qr[pX]), &(Qr[pY]),
-								igtL
-							)) {
-								continue;
-							}
+	/* sample all pixels */
+	if (!do_sample) {
+		sample_size = band->width * band->height;
+		sample_per = band->height;
+	}
+	/*
+	 randomly sample a percentage of available pixels
+	 sampling method is known as
+	 	"systematic random sample without replacement"
+	*/
+	else {
+		sample_size = round((band->width * band->height) * sample);
+		sample_per = round(sample_size / band->width);
+		sample_int = round(band->height / sample_per);
+		srand(time(NULL));
+	}
 
-							if (
-								(Qr[pX] < 0 || Qr[pX] > *widthL || FLT_EQ(Qr[pX], *widthL)) ||
-								(Qr[pY] < 0 || Qr[pY] > *heightL || FLT_EQ(Qr[pY], *heightL))
-							) {
-								continue;
-							}
+	RASTER_DEBUGF(3, "sampling %d of %d available pixels w/ %d per set"
+		, sample_size, (band->width * band->height), sample_per);
 
-							if (hasnodataS == FALSE)
-								valL = 1;
-							else if (rt_band_get_pixel(bandL, Qr[pX], Qr[pY], &valL) < 0)
-								continue;
+	/* all values are kept, make room for them at once */
+	if (agg->keep_values && agg->sketch_size < 1) {
+		if (!_rti_statsagg_level_reserve(agg, 0, sample_size))
+			return 0;
+	}
 
-							if ((hasnodataL == FALSE) || (
-								(hasnodataL != FALSE) &&
-								FLT_NEQ(valL, nodataL)
-							)) {
-								RASTER_DEBUG(3, "The two rasters do intersect");
-								*intersects = 1;
-								return 1;
-							}
-						}
-					}
-				}
+	/*
+		pixels are processed a block at a time: a row when all pixels
+		are sampled, the sampled pixels of a column otherwise
+	*/
+	block_max = do_sample ? sample_per : band->width;
+	block = rtalloc(sizeof(double) * (block_max > 0 ? block_max : 1));
+	if (NULL == block) {
+		rterror("rt_statsagg_add_band: Unable to allocate memory for pixel values");
+		return 0;
+	}
+
+	for (x = 0; x < (do_sample ? band->width : band->height); x++) {
+		block_count = 0;
+
+		/* all pixels, x is the row */
+		if (!do_sample) {
+			line = rt_band_get_pixel_line(band, 0, x, band->width);
+			if (
+				NULL == line ||
+				!rt_pixtype_to_double(band->pixtype, line, band->width, block)
+			) {
+				rterror("rt_statsagg_add_band: Unable to get pixel values of row %d", x);
+				rtdealloc(block);
+				return 0;
 			}
+			block_count = band->width;
 		}
-	}
+		/* sampled pixels, x is the column */
+		else {
+			y = -1;
+			diff = 0;
 
-	*intersects = rt_raster_intersects_algorithm(
-		rastS, rastL,
-		bandS, bandL,
-		hasnodataS, hasnodataL,
-		nodataS, nodataL
-	);
+			for (i = 0, z = 0; i < sample_per; i++) {
+				offset = (rand() % sample_int) + 1;
+				y += diff + offset;
+				diff = sample_int - offset;
+				RASTER_DEBUGF(5, "(x, y, z) = (%d, %d, %d)", x, y, z);
+				if (y >= band->height || z > sample_per) break;
+				z++;
 
-	if (*intersects) return 1;
+				rtn = rt_band_get_pixel(band, x, y, &value);
+				if (rtn == -1) continue;
 
-	*intersects = rt_raster_intersects_algorithm(
-		rastL, rastS,
-		bandL, bandS,
-		hasnodataL, hasnodataS,
-		nodataL, nodataS
-	);
+				RASTER_DEBUGF(5, "(x, y, value) = (%d,%d, %f)", x, y, value);
+				block[block_count++] = value;
+			}
+		}
 
-	if (*intersects) return 1;
+		if (!_rti_statsagg_add_values(agg, block, block_count, exclude_nodata_value, nodata)) {
+			rtdealloc(block);
+			return 0;
+		}
+	}
+	rtdealloc(block);
 
-	RASTER_DEBUG(3, "The two rasters do not intersect");
+	RASTER_DEBUG(3, "sampling complete");
 
-	*intersects = 0;
 	return 1;
 }
 
-/*
- * Return zero if error occurred in function.
- * Paramter aligned returns non-zero if two rasters are aligned
- *
- * @param rast1 : the first raster for alignment test
- * @param rast2 : the second raster for alignment test
- * @param aligned : non-zero value if the two rasters are aligned
- *
- * @return if zero, an error occurred in function
- */
 int
-rt_raster_same_alignment(
-	rt_raster rast1,
-	rt_raster rast2,
-	int *aligned
-) {
-	double xr;
-	double yr;
-	double xw;
-	double yw;
-	int err = 0;
-
-	assert(NULL != rast1);
-	assert(NULL != rast2);
+rt_statsagg_merge(rt_statsagg agg, rt_statsagg other) {
+	double delta;
+	double n;
+	int l;
 
-	err = 0;
-	/* same srid */
-	if (rt_raster_get_srid(rast1) != rt_raster_get_srid(rast2)) {
-		RASTER_DEBUG(3, "The two rasters provided have different SRIDs");
-		err = 1;
-	}
-	/* scales must match */
-	else if (FLT_NEQ(fabs(rast1->scaleX), fabs(rast2->scaleX))) {
-		RASTER_DEBUG(3, "The two raster provided have different scales on the X axis");
-		err = 1;
-	}
-	else if (FLT_NEQ(fabs(rast1->scaleY), fabs(rast2->scaleY))) {
-		RASTER_DEBUG(3, "The two raster provided have different scales on the Y axis");
-		err = 1;
-	}
-	/* skews must match */
-	else if (FLT_NEQ(rast1->skewX, rast2->skewX)) {
-		RASTER_DEBUG(3, "The two raster provided have different skews on the X axis");
-		err = 1;
-	}
-	else if (FLT_NEQ(rast1->skewY, rast2->skewY)) {
-		RASTER_DEBUG(3, "The two raster provided have different skews on the Y axis");
-		err = 1;
-	}
+	assert(NULL != agg);
+	assert(NULL != other);
 
-	if (err) {
-		*aligned = 0;
+	if (other->count < 1)
 		return 1;
-	}
 
-	/* raster coordinates in context of second raster of first raster's upper-left corner */
-	if (rt_raster_geopoint_to_cell(
-			rast2,
-			rast1->ipX, rast1->ipY,
-			&xr, &yr,
-			NULL
-	) == 0) {
-		rterror("rt_raster_same_alignment: Unable to get raster coordinates of second raster from first raster's spatial coordinates");
-		*aligned = 0;
-		return 0;
-	}
+	if (other->sample < agg->sample)
+		agg->sample = other->sample;
 
-	/* spatial coordinates of raster coordinates from above */
-	if (rt_raster_cell_to_geopoint(
-		rast2,
-		xr, yr,
-		&xw, &yw,
-		NULL
-	) == 0) {
-		rterror("rt_raster_same_alignment: Unable to get spatial coordinates of second raster from raster coordinates");
-		*aligned = 0;
-		return 0;
+	if (agg->count < 1) {
+		agg->count = other->count;
+		agg->min = other->min;
+		agg->max = other->max;
+		agg->sum = other->sum;
+		agg->M = other->M;
+		agg->Q = other->Q;
 	}
+	else {
+		/* parallel variance, Chan et al. */
+		n = (double) agg->count + other->count;
+		delta = other->M - agg->M;
+		agg->M += delta * other->count / n;
+		agg->Q += other->Q + (delta * delta * agg->count * other->count / n);
 
-	RASTER_DEBUGF(4, "rast1(ipX, ipxY) = (%f, %f)", rast1->ipX, rast1->ipY);
-	RASTER_DEBUGF(4, "rast2(xr, yr) = (%f, %f)", xr, yr);
-	RASTER_DEBUGF(4, "rast2(xw, yw) = (%f, %f)", xw, yw);
+		agg->count += other->count;
+		agg->sum += other->sum;
+		if (other->min < agg->min)
+			agg->min = other->min;
+		if (other->max > agg->max)
+			agg->max = other->max;
+	}
 
-	/* spatial coordinates are identical to that of first raster's upper-left corner */
-	if (FLT_EQ(xw, rast1->ipX) && FLT_EQ(yw, rast1->ipY)) {
-		RASTER_DEBUG(3, "The two rasters are aligned");
-		*aligned = 1;
+	if (!agg->keep_values)
 		return 1;
+
+	for (l = 0; l < other->levels_count; l++) {
+		if (other->levels[l].count < 1)
+			continue;
+
+		if (!_rti_statsagg_level_reserve(agg, l, other->levels[l].count))
+			return 0;
+		memcpy(
+			agg->levels[l].values + agg->levels[l].count,
+			other->levels[l].values,
+			sizeof(double) * other->levels[l].count
+		);
+		agg->levels[l].count += other->levels[l].count;
 	}
 
-	/* no alignment */
-	RASTER_DEBUG(3, "The two rasters are NOT aligned");
-	*aligned = 0;
-	return 1;
+	return _rti_statsagg_compact(agg, 0);
 }
 
-/*
- * Return raster of computed extent specified extenttype applied
- * on two input rasters.  The raster returned should be freed by
- * the caller
- *
- * @param rast1 : the first raster
- * @param rast2 : the second raster
- * @param extenttype : type of extent for the output raster
- * @param err : if 0, error occurred
- * @param offset : 4-element array indicating the X,Y offsets
- * for each raster. 0,1 for rast1 X,Y. 2,3 for rast2 X,Y.
- *
- * @return raster object if success, NULL otherwise
- */
-rt_raster
-rt_raster_from_two_rasters(
-	rt_raster rast1, rt_raster rast2,
-	rt_extenttype extenttype,
-	int *err, double *offset
-) {
-	int i;
+int
+rt_statsagg_add_cached_stats(rt_statsagg agg, rt_cachedstats stats,
+	int exclude_nodata_value) {
+	struct rt_statsagg_t other;
 
-	rt_raster _rast[2] = {rast1, rast2};
-	double _offset[2][4] = {{0.}};
-	uint16_t _dim[2][2] = {{0}};
+	assert(NULL != agg);
+	assert(NULL != stats);
 
-	rt_raster raster = NULL;
-	int aligned = 0;
-	int dim[2] = {0};
-	double gt[6] = {0.};
+	if (agg->keep_values) {
+		rterror("rt_statsagg_add_cached_stats: Cached statistics have no pixel values to keep");
+		return 0;
+	}
 
-	assert(NULL != rast1);
-	assert(NULL != rast2);
+	memset(&other, 0, sizeof(struct rt_statsagg_t));
+	other.sample = 1;
+	other.count = stats->count;
+	other.min = stats->min;
+	other.max = stats->max;
+	other.sum = stats->mean * stats->count;
+	other.M = stats->mean;
+	other.Q = stats->Q;
 
-	/* rasters must have same srid */
-	if (rt_raster_get_srid(rast1) != rt_raster_get_srid(rast2)) {
-		rterror("rt_raster_from_two_rasters: The two rasters provided do not have the same SRID");
-		*err = 0;
-		return NULL;
-	}
+	if (!rt_statsagg_merge(agg, &other))
+		return 0;
 
-	/* rasters must be aligned */
-	if (!rt_raster_same_alignment(rast1, rast2, &aligned)) {
-		rterror("rt_raster_from_two_rasters: Unable to test for alignment on the two rasters");
-		*err = 0;
-		return NULL;
-	}
-	if (!aligned) {
-		rterror("rt_raster_from_two_rasters: The two rasters provided do not have the same alignment");
-		*err = 0;
-		return NULL;
-	}
+	if (exclude_nodata_value || stats->nodata_count < 1)
+		return 1;
 
-	/* dimensions */
-	_dim[0][0] = rast1->width;
-	_dim[0][1] = rast1->height;
-	_dim[1][0] = rast2->width;
-	_dim[1][1] = rast2->height;
+	/* nodata pixels count as pixels of the nodata value, with no spread */
+	other.count = stats->nodata_count;
+	other.min = other.max = other.M = stats->nodataval;
+	other.sum = stats->nodata_count * stats->nodataval;
+	other.Q = 0;
 
-	/* get raster offsets */
-	if (!rt_raster_geopoint_to_cell(
-		_rast[1],
-		_rast[0]->ipX, _rast[0]->ipY,
-		&(_offset[1][0]), &(_offset[1][1]),
-		NULL
-	)) {
-		rterror("rt_raster_from_two_rasters: Unable to compute offsets of the second raster relative to the first raster");
-		*err = 0;
-		return NULL;
-	}
-	_offset[1][0] = -1 * _offset[1][0];
-	_offset[1][1] = -1 * _offset[1][1];
-	_offset[1][2] = _offset[1][0] + _dim[1][0] - 1;
-	_offset[1][3] = _offset[1][1] + _dim[1][1] - 1;
+	return rt_statsagg_merge(agg, &other);
+}
 
-	i = -1;
-	switch (extenttype) {
-		case ET_FIRST:
-			i = 0;
-			_offset[0][0] = 0.;
-			_offset[0][1] = 0.;
-		case ET_SECOND:
-			if (i < 0) {
-				i = 1;
-				_offset[0][0] = -1 * _offset[1][0];
-				_offset[0][1] = -1 * _offset[1][1];
-				_offset[1][0] = 0.;
-				_offset[1][1] = 0.;
-			}
+rt_bandstats
+rt_statsagg_get_summary_stats(rt_statsagg agg) {
+	rt_bandstats stats = NULL;
 
-			dim[0] = _dim[i][0];
-			dim[1] = _dim[i][1];
-			raster = rt_raster_new(
-				dim[0],
-				dim[1]
-			);
-			if (raster == NULL) {
-				rterror("rt_raster_from_two_rasters: Unable to create output raster");
-				*err = 0;
-				return NULL;
-			}
-			rt_raster_set_srid(raster, _rast[i]->srid);
-			rt_raster_get_geotransform_matrix(_rast[i], gt);
-			rt_raster_set_geotransform_matrix(raster, gt);
-			break;
-		case ET_UNION: {
-			double off[4] = {0};
+	assert(NULL != agg);
 
-			rt_raster_get_geotransform_matrix(_rast[0], gt);
-			RASTER_DEBUGF(4, "gt = (%f, %f, %f, %f, %f, %f)",
-				gt[0],
-				gt[1],
-				gt[2],
-				gt[3],
-				gt[4],
-				gt[5]
-			);
+	stats = (rt_bandstats) rtalloc(sizeof(struct rt_bandstats_t));
+	if (NULL == stats) {
+		rterror("rt_statsagg_get_summary_stats: Unable to allocate memory for stats");
+		return NULL;
+	}
 
-			/* new raster upper left offset */
-			off[0] = 0;
-			if (_offset[1][0] < 0)
-				off[0] = _offset[1][0];
-			off[1] = 0;
-			if (_offset[1][1] < 0)
-				off[1] = _offset[1][1];
+	stats->sample = agg->sample;
+	stats->count = agg->count;
+	stats->values = NULL;
+	stats->sorted = 0;
+
+	if (agg->count < 1) {
+		stats->min = stats->max = 0;
+		stats->sum = 0;
+		stats->mean = 0;
+		stats->stddev = -1;
+		return stats;
+	}
 
-			/* new raster lower right offset */
-			off[2] = _dim[0][0] - 1;
-			if ((int) _offset[1][2] >= _dim[0][0])
-				off[2] = _offset[1][2];
-			off[3] = _dim[0][1] - 1;
-			if ((int) _offset[1][3] >= _dim[0][1])
-				off[3] = _offset[1][3];
+	stats->min = agg->min;
+	stats->max = agg->max;
+	stats->sum = agg->sum;
+	stats->mean = agg->sum / agg->count;
 
-			/* upper left corner */
-			if (!rt_raster_cell_to_geopoint(
-				_rast[0],
-				off[0], off[1],
-				&(gt[0]), &(gt[3]),
-				NULL
-			)) {
-				rterror("rt_raster_from_two_rasters: Unable to get spatial coordinates of upper-left pixel of output raster");
-				*err = 0;
-				return NULL;
-			}
+	/* standard deviation */
+	if (FLT_EQ(agg->sample, 1.0))
+		stats->stddev = sqrt(agg->Q / agg->count);
+	/* sample deviation */
+	else if (agg->count < 2)
+		stats->stddev = -1;
+	else
+		stats->stddev = sqrt(agg->Q / (agg->count - 1));
 
-			dim[0] = off[2] - off[0] + 1;
-			dim[1] = off[3] - off[1] + 1;
-			RASTER_DEBUGF(4, "off = (%f, %f, %f, %f)",
-				off[0],
-				off[1],
-				off[2],
-				off[3]
-			);
-			RASTER_DEBUGF(4, "dim = (%d, %d)", dim[0], dim[1]);
+	return stats;
+}
 
-			raster = rt_raster_new(
-				dim[0],
-				dim[1]
-			);
-			if (raster == NULL) {
-				rterror("rt_raster_from_two_rasters: Unable to create output raster");
-				*err = 0;
-				return NULL;
-			}
-			rt_raster_set_srid(raster, _rast[0]->srid);
-			rt_raster_set_geotransform_matrix(raster, gt);
-			RASTER_DEBUGF(4, "gt = (%f, %f, %f, %f, %f, %f)",
-				gt[0],
-				gt[1],
-				gt[2],
-				gt[3],
-				gt[4],
-				gt[5]
-			);
+rt_histogram
+rt_statsagg_get_histogram(rt_statsagg agg,
+	int bin_count, double *bin_width, int bin_width_count,
+	int right, double min, double max, uint32_t *rtn_count) {
+	rt_histogram bins = NULL;
+	double *values = NULL;
+	uint32_t *weights = NULL;
+	uint32_t values_count = 0;
 
-			/* get offsets */
-			if (!rt_raster_geopoint_to_cell(
-				_rast[0],
-				gt[0], gt[3],
-				&(_offset[0][0]), &(_offset[0][1]),
-				NULL
-			)) {
-				rterror("rt_raster_from_two_rasters: Unable to get offsets of the FIRST raster relative to the output raster");
-				rt_raster_destroy(raster);
-				*err = 0;
-				return NULL;
-			}
-			_offset[0][0] *= -1;
-			_offset[0][1] *= -1;
+	assert(NULL != agg);
 
-			if (!rt_raster_geopoint_to_cell(
-				_rast[1],
-				gt[0], gt[3],
-				&(_offset[1][0]), &(_offset[1][1]),
-				NULL
-			)) {
-				rterror("rt_raster_from_two_rasters: Unable to get offsets of the SECOND raster relative to the output raster");
-				rt_raster_destroy(raster);
-				*err = 0;
-				return NULL;
-			}
-			_offset[1][0] *= -1;
-			_offset[1][1] *= -1;
-			break;
-		}
-		case ET_INTERSECTION: {
-			double off[4] = {0};
+	if (agg->count < 1 || !agg->keep_values) {
+		rterror("rt_statsagg_get_histogram: rt_statsagg object has no value");
+		return NULL;
+	}
 
-			/* no intersection */
-			if (
-				(_offset[1][2] < 0 || _offset[1][0] > (_dim[0][0] - 1)) ||
-				(_offset[1][3] < 0 || _offset[1][1] > (_dim[0][1] - 1))
-			) {
-				RASTER_DEBUG(3, "The two rasters provided have no intersection.  Returning no band raster");
+	if (!_rti_statsagg_get_values(agg, &values, &weights, &values_count))
+		return NULL;
 
-				raster = rt_raster_new(0, 0);
-				if (raster == NULL) {
-					rterror("rt_raster_from_two_rasters: Unable to create output raster");
-					*err = 0;
-					return NULL;
-				}
-				rt_raster_set_srid(raster, _rast[0]->srid);
-				rt_raster_set_scale(raster, 0, 0);
+	bins = _rti_get_histogram(
+		values, weights, values_count,
+		agg->count, agg->min, agg->max,
+		bin_count, bin_width, bin_width_count,
+		right, min, max, rtn_count
+	);
 
-				/* set offsets if provided */
-				if (NULL != offset) {
-					for (i = 0; i < 4; i++)
-						offset[i] = _offset[i / 2][i % 2];
-				}
+	rtdealloc(values);
+	if (NULL != weights) rtdealloc(weights);
 
-				*err = 1;
-				return raster;
-			}
+	return bins;
+}
 
-			if (_offset[1][0] > 0)
-				off[0] = _offset[1][0];
-			if (_offset[1][1] > 0)
-				off[1] = _offset[1][1];
+rt_quantile
+rt_statsagg_get_quantiles(rt_statsagg agg,
+	double *quantiles, int quantiles_count, uint32_t *rtn_count) {
+	rt_quantile rtn = NULL;
+	double *values = NULL;
+	uint32_t *weights = NULL;
+	uint32_t values_count = 0;
+	uint32_t i;
 
-			off[2] = _dim[0][0] - 1;
-			if (_offset[1][2] < _dim[0][0])
-				off[2] = _offset[1][2];
-			off[3] = _dim[0][1] - 1;
-			if (_offset[1][3] < _dim[0][1])
-				off[3] = _offset[1][3];
+	assert(NULL != agg);
 
-			dim[0] = off[2] - off[0] + 1;
-			dim[1] = off[3] - off[1] + 1;
-			raster = rt_raster_new(
-				dim[0],
-				dim[1]
-			);
-			if (raster == NULL) {
-				rterror("rt_raster_from_two_rasters: Unable to create output raster");
-				*err = 0;
-				return NULL;
-			}
-			rt_raster_set_srid(raster, _rast[0]->srid);
+	if (agg->count < 1 || !agg->keep_values) {
+		rterror("rt_statsagg_get_quantiles: rt_statsagg object has no value");
+		return NULL;
+	}
 
-			/* get upper-left corner */
-			rt_raster_get_geotransform_matrix(_rast[0], gt);
-			if (!rt_raster_cell_to_geopoint(
-				_rast[0],
-				off[0], off[1],
-				&(gt[0]), &(gt[3]),
-				gt
-			)) {
-				rterror("rt_raster_from_two_rasters: Unable to get spatial coordinates of upper-left pixel of output raster");
-				rt_raster_destroy(raster);
-				*err = 0;
-				return NULL;
-			}
+	if (!_rti_statsagg_get_values(agg, &values, &weights, &values_count))
+		return NULL;
 
-			rt_raster_set_geotransform_matrix(raster, gt);
+	rtn = _rti_get_quantiles(
+		values, weights, values_count, agg->count,
+		quantiles, quantiles_count, rtn_count
+	);
 
-			/* get offsets */
-			if (!rt_raster_geopoint_to_cell(
-				_rast[0],
-				gt[0], gt[3],
-				&(_offset[0][0]), &(_offset[0][1]),
-				NULL
-			)) {
-				rterror("rt_raster_from_two_rasters: Unable to get pixel coordinates to compute the offsets of the FIRST raster relative to the output raster");
-				rt_raster_destroy(raster);
-				*err = 0;
-				return NULL;
-			}
-			_offset[0][0] *= -1;
-			_offset[0][1] *= -1;
+	rtdealloc(values);
+	if (NULL != weights) rtdealloc(weights);
 
-			if (!rt_raster_geopoint_to_cell(
-				_rast[1],
-				gt[0], gt[3],
-				&(_offset[1][0]), &(_offset[1][1]),
-				NULL
-			)) {
-				rterror("rt_raster_from_two_rasters: Unable to get pixel coordinates to compute the offsets of the SECOND raster relative to the output raster");
-				rt_raster_destroy(raster);
-				*err = 0;
-				return NULL;
-			}
-			_offset[1][0] *= -1;
-			_offset[1][1] *= -1;
-			break;
+	/* the extremes are known exactly even if the values are sketched */
+	if (NULL != rtn) {
+		for (i = 0; i < *rtn_count; i++) {
+			if (FLT_EQ(rtn[i].quantile, 0.0))
+				rtn[i].value = agg->min;
+			else if (FLT_EQ(rtn[i].quantile, 1.0))
+				rtn[i].value = agg->max;
 		}
 	}
 
-	/* set offsets if provided */
-	if (NULL != offset) {
-		for (i = 0; i < 4; i++)
-			offset[i] = _offset[i / 2][i % 2];
-	}
-
-	*err = 1;
-	return raster;
+	return rtn;
 }
 
+/* serialized size of the fixed part of a rt_statsagg */
+#define RT_STATSAGG_HEADER_SIZE \
+	(sizeof(double) * 6 + sizeof(uint32_t) * 2 + sizeof(uint8_t) * 2)
 
-LWPOLY*
-rt_raster_pixel_as_polygon(rt_raster rast, int x, int y)
-{
-    double scale_x, scale_y;
-    double skew_x, skew_y;
-    double ul_x, ul_y;
-    int srid;
-    POINTARRAY **points;
-    POINT4D p, p0;
-    LWPOLY *poly;
+#define RT_STATSAGG_WRITE(ptr, val) { memcpy((ptr), &(val), sizeof(val)); (ptr) += sizeof(val); }
+#define RT_STATSAGG_READ(ptr, val) { memcpy(&(val), (ptr), sizeof(val)); (ptr) += sizeof(val); }
 
-    scale_x = rt_raster_get_x_scale(rast);
-    scale_y = rt_raster_get_y_scale(rast);
-    skew_x = rt_raster_get_x_skew(rast);
-    skew_y = rt_raster_get_y_skew(rast);
-    ul_x = rt_raster_get_x_offset(rast);
-    ul_y = rt_raster_get_y_offset(rast);
-    srid = rt_raster_get_srid(rast);
+void *
+rt_statsagg_serialize(rt_statsagg agg, uint32_t *size) {
+	uint8_t *data = NULL;
+	uint8_t *ptr = NULL;
+	uint8_t keep_values;
+	int l;
 
-    points = rtalloc(sizeof(POINTARRAY *)*1);
-    points[0] = ptarray_construct(0, 0, 5);
+	assert(NULL != agg);
+	assert(NULL != size);
 
-    p0.x = scale_x * x + skew_x * y + ul_x;
-    p0.y = scale_y * y + skew_y * x + ul_y;
-    ptarray_set_point4d(points[0], 0, &p0);
+	*size = RT_STATSAGG_HEADER_SIZE;
+	for (l = 0; l < agg->levels_count; l++)
+		*size += sizeof(uint32_t) + sizeof(uint8_t) + (sizeof(double) * agg->levels[l].count);
 
-    p.x = p0.x + scale_x;
-    p.y = p0.y + skew_y;
-    ptarray_set_point4d(points[0], 1, &p);
+	data = rtalloc(*size);
+	if (NULL == data) {
+		rterror("rt_statsagg_serialize: Unable to allocate memory for serialized statistics");
+		return NULL;
+	}
 
-    p.x = p0.x + scale_x + skew_x;
-    p.y = p0.y + scale_y + skew_y;
-    ptarray_set_point4d(points[0], 2, &p);
+	ptr = data;
+	keep_values = agg->keep_values;
+	RT_STATSAGG_WRITE(ptr, agg->sample);
+	RT_STATSAGG_WRITE(ptr, agg->count);
+	RT_STATSAGG_WRITE(ptr, agg->min);
+	RT_STATSAGG_WRITE(ptr, agg->max);
+	RT_STATSAGG_WRITE(ptr, agg->sum);
+	RT_STATSAGG_WRITE(ptr, agg->M);
+	RT_STATSAGG_WRITE(ptr, agg->Q);
+	RT_STATSAGG_WRITE(ptr, agg->sketch_size);
+	RT_STATSAGG_WRITE(ptr, keep_values);
+	RT_STATSAGG_WRITE(ptr, agg->levels_count);
 
-    p.x = p0.x + skew_x;
-    p.y = p0.y + scale_y;
-    ptarray_set_point4d(points[0], 3, &p);
+	for (l = 0; l < agg->levels_count; l++) {
+		RT_STATSAGG_WRITE(ptr, agg->levels[l].count);
+		RT_STATSAGG_WRITE(ptr, agg->levels[l].offset);
+		memcpy(ptr, agg->levels[l].values, sizeof(double) * agg->levels[l].count);
+		ptr += sizeof(double) * agg->levels[l].count;
+	}
 
-    /* close it */
-    ptarray_set_point4d(points[0], 4, &p0);
+	return data;
+}
 
-    poly = lwpoly_construct(srid, NULL, 1, points);
+rt_statsagg
+rt_statsagg_deserialize(const void *data, uint32_t size) {
+	rt_statsagg agg = NULL;
+	const uint8_t *ptr = data;
+	const uint8_t *end = ptr + size;
+	uint8_t keep_values;
+	uint32_t count;
+	int l;
 
-    return poly;
+	assert(NULL != data);
+
+	if (size < RT_STATSAGG_HEADER_SIZE) {
+		rterror("rt_statsagg_deserialize: Serialized statistics are too short");
+		return NULL;
+	}
+
+	agg = rt_statsagg_new(0, 0);
+	if (NULL == agg)
+		return NULL;
+
+	RT_STATSAGG_READ(ptr, agg->sample);
+	RT_STATSAGG_READ(ptr, agg->count);
+	RT_STATSAGG_READ(ptr, agg->min);
+	RT_STATSAGG_READ(ptr, agg->max);
+	RT_STATSAGG_READ(ptr, agg->sum);
+	RT_STATSAGG_READ(ptr, agg->M);
+	RT_STATSAGG_READ(ptr, agg->Q);
+	RT_STATSAGG_READ(ptr, agg->sketch_size);
+	RT_STATSAGG_READ(ptr, keep_values);
+	RT_STATSAGG_READ(ptr, agg->levels_count);
+	agg->keep_values = keep_values;
+
+	if (agg->levels_count > RT_STATSAGG_MAX_LEVELS) {
+		rterror("rt_statsagg_deserialize: Invalid serialized statistics");
+		agg->levels_count = 0;
+		rt_statsagg_destroy(agg);
+		return NULL;
+	}
+
+	for (l = 0; l < agg->levels_count; l++) {
+		if ((size_t) (end - ptr) < sizeof(uint32_t) + sizeof(uint8_t))
+			break;
+		RT_STATSAGG_READ(ptr, count);
+		RT_STATSAGG_READ(ptr, agg->levels[l].offset);
+		if ((size_t) (end - ptr) < sizeof(double) * count)
+			break;
+
+		agg->levels[l].count = 0;
+		if (count > 0) {
+			if (!_rti_statsagg_level_reserve(agg, l, count)) {
+				rt_statsagg_destroy(agg);
+				return NULL;
+			}
+			memcpy(agg->levels[l].values, ptr, sizeof(double) * count);
+			agg->levels[l].count = count;
+			ptr += sizeof(double) * count;
+		}
+	}
+	if (l < agg->levels_count) {
+		rterror("rt_statsagg_deserialize: Serialized statistics are too short");
+		rt_statsagg_destroy(agg);
+		return NULL;
+	}
+
+	return agg;
 }
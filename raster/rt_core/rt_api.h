@@ -139,6 +139,9 @@ typedef struct rt_quantile_t* rt_quantile;
 typedef struct rt_valuecount_t* rt_valuecount;
 typedef struct rt_gdaldriver_t* rt_gdaldriver;
 typedef struct rt_reclassexpr_t* rt_reclassexpr;
+typedef struct rt_mapexpr_t* rt_mapexpr;
+typedef struct rt_statsagg_t* rt_statsagg;
+typedef struct rt_cachedstats_t* rt_cachedstats;
 
 /**
  * Enum definitions
@@ -166,6 +169,34 @@ typedef enum {
 	ET_SECOND
 } rt_extenttype;
 
+/* Variables of a map algebra pixel expression */
+typedef enum {
+	RT_MAPEXPR_VAL1 = 0, /* [rast], [rast.val], [rast1], [rast1.val] */
+	RT_MAPEXPR_X1,       /* [rast.x], [rast1.x] */
+	RT_MAPEXPR_Y1,       /* [rast.y], [rast1.y] */
+	RT_MAPEXPR_VAL2,     /* [rast2], [rast2.val] */
+	RT_MAPEXPR_X2,       /* [rast2.x] */
+	RT_MAPEXPR_Y2,       /* [rast2.y] */
+	RT_MAPEXPR_NVARS
+} rt_mapexpr_var;
+
+/* State of a value computed by a map algebra pixel expression */
+typedef enum {
+	RT_MAPEXPR_OK = 0,
+	RT_MAPEXPR_NULL,
+	RT_MAPEXPR_ERR_DIVZERO,
+	RT_MAPEXPR_ERR_INTRANGE,
+	RT_MAPEXPR_ERR_OVERFLOW,
+	RT_MAPEXPR_ERR_UNDERFLOW,
+	RT_MAPEXPR_ERR_SQRTNEG,
+	RT_MAPEXPR_ERR_LOGZERO,
+	RT_MAPEXPR_ERR_LOGNEG,
+	RT_MAPEXPR_ERR_RANGE,
+	RT_MAPEXPR_ERR_POWZERO,
+	RT_MAPEXPR_ERR_POWNEG,
+	RT_MAPEXPR_ERR_NUMERICINF
+} rt_mapexpr_status;
+
 /**
 * Global functions for memory/logging handlers.
 */
@@ -295,6 +326,34 @@ rt_pixtype rt_pixtype_index_from_name(const char* pixname);
  */
 double rt_pixtype_get_min_value(rt_pixtype pixtype);
 
+/**
+ * Convert values of the given pixel type to doubles
+ *
+ * @param pixtype : pixel type of the values in src
+ * @param src : the values, aligned as per rt_pixtype_alignment
+ * @param len : number of values in src
+ * @param dst : array of at least len doubles
+ *
+ * @return 1 on success, 0 on error
+ */
+int rt_pixtype_to_double(rt_pixtype pixtype, const void *src, uint32_t len,
+	double *dst);
+
+/**
+ * Convert doubles to values of the given pixel type, clamping
+ * them to the range of the pixel type as rt_band_set_pixel does
+ *
+ * @param pixtype : pixel type of the values in dst
+ * @param src : array of len doubles
+ * @param len : number of values in src
+ * @param dst : where to put the values, aligned as per
+ *   rt_pixtype_alignment
+ *
+ * @return 1 on success, 0 on error
+ */
+int rt_pixtype_from_double(rt_pixtype pixtype, const double *src, uint32_t len,
+	void *dst);
+
 /*- rt_band ----------------------------------------------------------*/
 
 /**
@@ -518,6 +577,26 @@ int rt_band_set_pixel(rt_band band,
 int rt_band_get_pixel(rt_band band,
                          uint16_t x, uint16_t y, double *result );
 
+/**
+ * Get values of multiple pixels.  Unlike rt_band_get_pixel, the
+ * values are not converted: the returned pointer is into the band's
+ * data and has to be read as an array of the band's pixel type,
+ * e.g. with rt_pixtype_to_double.
+ *
+ * @param band : the band to get values from
+ * @param x : X coordinate (0-based)
+ * @param y : Y coordinate (0-based)
+ * @param len : # of pixels wanted, starting at x, y and going along
+ *   the row and onto the next rows
+ *
+ * @return pointer to the values of the pixels, or NULL on error
+ */
+void *rt_band_get_pixel_line(
+	rt_band band,
+	uint16_t x, uint16_t y,
+	uint16_t len
+);
+
 
 /**
  * Returns the minimal possible value for the band according to the pixel type.
@@ -540,6 +619,27 @@ int rt_band_is_nodata(rt_band band);
  */
 int rt_band_check_is_nodata(rt_band band);
 
+/**
+ * Compute the statistics of a band kept in its serialized form, see
+ * struct rt_cachedstats_t.  They are dropped when a pixel value, the
+ * nodata value or a nodata flag of the band changes
+ *
+ * @param band: the band to compute the statistics of
+ *
+ * @return zero on error, e.g. for an out-db band
+ */
+int rt_band_compute_cached_stats(rt_band band);
+
+/**
+ * Get the statistics cached in a band
+ *
+ * @param band: the band to get the statistics of
+ * @param stats: set to the statistics
+ *
+ * @return TRUE if the band has up to date statistics, FALSE otherwise
+ */
+int rt_band_get_cached_stats(rt_band band, rt_cachedstats stats);
+
 
 /**
  * Compute summary statistics for a band
@@ -593,44 +693,6 @@ rt_histogram rt_band_get_histogram(rt_bandstats stats,
 rt_quantile rt_band_get_quantiles(rt_bandstats stats,
 	double *quantiles, int quantiles_count, uint32_t *rtn_count);
 
-struct quantile_llist;
-int quantile_llist_destroy(struct quantile_llist **list,
-	uint32_t list_count);
-
-/**
- * Compute the default set of or requested quantiles for a coverage
- *
- * This function is based upon the algorithm described in:
- *
- * A One-Pass Space-Efficient Algorithm for Finding Quantiles (1995)
- *   by Rakesh Agrawal, Arun Swami
- *   in Proc. 7th Intl. Conf. Management of Data (COMAD-95)
- *
- * http://www.almaden.ibm.com/cs/projects/iis/hdb/Publications/papers/comad95.pdf
- *
- * In the future, it may be worth exploring algorithms that don't
- *   require the size of the coverage
- *
- * @param band: the band to include in the quantile search
- * @param exclude_nodata_value: if non-zero, ignore nodata values
- * @param sample: percentage of pixels to sample
- * @param cov_count: number of values in coverage
- * @param qlls: set of quantile_llist structures
- * @param qlls_count: the number of quantile_llist structures
- * @param quantiles: the quantiles to be computed
- *   if bot qlls and quantiles provided, qlls is used
- * @param quantiles_count: the number of quantiles to be computed
- * @param rtn_count: the number of quantiles being returned
- *
- * @return the default set of or requested quantiles for a band
- */
-rt_quantile rt_band_get_quantiles_stream(rt_band band,
-	int exclude_nodata_value, double sample,
-	uint64_t cov_count,
-	struct quantile_llist **qlls, uint32_t *qlls_count,
-	double *quantiles, int quantiles_count,
-	uint32_t *rtn_count);
-
 /**
  * Count the number of times provided value(s) occur in
  * the band
@@ -744,6 +806,29 @@ int rt_raster_get_num_bands(rt_raster raster);
 /* Return Nth band, or 0 if unavailable */
 rt_band rt_raster_get_band(rt_raster raster, int bandNum);
 
+/**
+ * Compute the cached statistics of all the in-db bands of a raster,
+ * see rt_band_compute_cached_stats
+ *
+ * @param raster : the raster
+ *
+ * @return zero on error
+ */
+int rt_raster_compute_cached_stats(rt_raster raster);
+
+/**
+ * Get the statistics cached for a band of a raster.  Works for rasters
+ * deserialized with their bands or header only, in which case the
+ * statistics have to be read with rt_raster_deserialize_cached_stats
+ *
+ * @param raster : the raster
+ * @param nband : the band number, 0-based
+ * @param stats : set to the statistics
+ *
+ * @return TRUE if the band has statistics, FALSE otherwise
+ */
+int rt_raster_get_cached_stats(rt_raster raster, int nband, rt_cachedstats stats);
+
 /* Get number of rows */
 uint16_t rt_raster_get_width(rt_raster raster);
 
@@ -1079,6 +1164,29 @@ void* rt_raster_serialize(rt_raster raster);
  */
 rt_raster rt_raster_deserialize(void* serialized, int header_only);
 
+/**
+ * Return the number of bytes at the start of the serialized form of a
+ * raster holding its header and the cached statistics of its bands,
+ * i.e. what rt_raster_deserialize_cached_stats reads
+ *
+ * @param raster : the raster, possibly deserialized header only
+ *
+ * @return the size of the serialized header and statistics
+ */
+uint32_t rt_raster_serialized_header_size(rt_raster raster);
+
+/**
+ * Read the cached band statistics of a raster deserialized header only,
+ * without touching the bands
+ *
+ * @param raster : the raster deserialized header only
+ * @param serialized : at least rt_raster_serialized_header_size(raster)
+ *   bytes of the serialized raster
+ *
+ * @return TRUE if the raster has cached statistics, FALSE otherwise
+ */
+int rt_raster_deserialize_cached_stats(rt_raster raster, const void *serialized);
+
 
 /**
  * Return TRUE if the raster is empty. i.e. is NULL, width = 0 or height = 0
@@ -1330,6 +1438,196 @@ rt_raster_from_two_rasters(
 	int *err, double *offset
 );
 
+/*- rt_mapexpr ------------------------------------------------------*/
+
+/**
+ * Compile a map algebra pixel expression so that it can be evaluated
+ * natively over whole rows of pixels.
+ *
+ * The supported language is the subset of SQL scalar expressions made of
+ * numeric literals, the [rast...] keywords, arithmetic (+ - * / % ^),
+ * comparisons, AND/OR/NOT, IS [NOT] NULL, [NOT] BETWEEN, [NOT] IN,
+ * CASE, casts to integer, numeric and double precision and the common
+ * math functions (abs, sqrt, exp, ln, log, power, round, floor, ceil,
+ * trunc, sign, mod, trigonometric functions, greatest, least, coalesce,
+ * nullif...).  Typing, NULL handling and error conditions follow the
+ * rules PostgreSQL applies to the same expression.
+ *
+ * Nothing is reported if the expression cannot be compiled, the caller is
+ * expected to fall back to its own evaluator (e.g. SPI) in that case.
+ *
+ * @param expression : the pixel expression
+ * @param nrast : 1 for the keywords of the one raster map algebra
+ *   ([rast], [rast.val], [rast.x] and [rast.y] where x and y are double
+ *   precision), 2 for the keywords of the two raster map algebra
+ *   ([rast1], [rast1.val], [rast1.x], [rast1.y] and the same for rast2
+ *   where x and y are integers)
+ *
+ * @return the compiled expression or NULL if the expression is not
+ *   supported.  Release it with rt_mapexpr_destroy
+ */
+rt_mapexpr rt_mapexpr_compile(const char *expression, int nrast);
+
+/**
+ * Return non-zero if the compiled expression references the variable
+ *
+ * @param expr : the compiled expression
+ * @param var : the variable to check
+ *
+ * @return non-zero if the variable is used by the expression
+ */
+int rt_mapexpr_has_var(rt_mapexpr expr, rt_mapexpr_var var);
+
+/**
+ * Evaluate a compiled expression over count pixels at once
+ *
+ * @param expr : the compiled expression
+ * @param count : number of pixels to evaluate
+ * @param values : array of RT_MAPEXPR_NVARS arrays of count values,
+ *   indexed by rt_mapexpr_var.  Arrays of unused variables may be NULL
+ * @param status : array of RT_MAPEXPR_NVARS arrays of count states
+ *   (RT_MAPEXPR_OK or RT_MAPEXPR_NULL) of the variables.  status itself
+ *   or any of its arrays may be NULL if the variable is never NULL
+ * @param result : count computed values
+ * @param rstatus : count states of the computed values.  A state greater
+ *   than RT_MAPEXPR_NULL is an error raised while computing the pixel, see
+ *   rt_mapexpr_status_message
+ *
+ * @return zero on error
+ */
+int rt_mapexpr_eval(rt_mapexpr expr, uint32_t count,
+	double **values, uint8_t **status,
+	double *result, uint8_t *rstatus);
+
+/**
+ * Return the message of an error state returned by rt_mapexpr_eval
+ *
+ * @param status : the error state
+ *
+ * @return error message, worded as PostgreSQL does
+ */
+const char *rt_mapexpr_status_message(uint8_t status);
+
+/**
+ * Release a compiled expression
+ *
+ * @param expr : the compiled expression
+ */
+void rt_mapexpr_destroy(rt_mapexpr expr);
+
+/*- rt_statsagg -----------------------------------------------------*/
+
+/* default number of values per level of the quantile sketch */
+#define RT_STATSAGG_SKETCH_SIZE 16384
+
+/**
+ * Create an empty set of statistics, filled in one pass by
+ * rt_statsagg_add_band and combined with rt_statsagg_merge
+ *
+ * @param keep_values : if non-zero, keep the values for histograms
+ *   and quantiles.  Otherwise only the summary stats are available
+ * @param sketch_size : maximum number of values kept per level of the
+ *   quantile sketch, 0 to keep all values.  Histograms and quantiles
+ *   are exact until sketch_size values have been added
+ *
+ * @return the statistics or NULL on error.  Release them with
+ *   rt_statsagg_destroy
+ */
+rt_statsagg rt_statsagg_new(int keep_values, uint32_t sketch_size);
+
+/**
+ * Add the pixels of a band to the statistics
+ *
+ * @param agg : the statistics to update
+ * @param band : the band to read
+ * @param exclude_nodata_value : if non-zero, ignore nodata values
+ * @param sample : percentage of pixels to sample
+ *
+ * @return zero on error
+ */
+int rt_statsagg_add_band(rt_statsagg agg, rt_band band,
+	int exclude_nodata_value, double sample);
+
+/**
+ * Add the statistics of other to agg.  other is left untouched
+ *
+ * @param agg : the statistics to update
+ * @param other : the statistics to add
+ *
+ * @return zero on error
+ */
+int rt_statsagg_merge(rt_statsagg agg, rt_statsagg other);
+
+/**
+ * Add the cached statistics of a band.  Values aren't kept, only the
+ * summary stats are updated
+ *
+ * @param agg : the statistics to update
+ * @param stats : the cached statistics of a band
+ * @param exclude_nodata_value : if non-zero, ignore nodata values
+ *
+ * @return zero on error
+ */
+int rt_statsagg_add_cached_stats(rt_statsagg agg, rt_cachedstats stats,
+	int exclude_nodata_value);
+
+/**
+ * Get the summary statistics.  The values member is not set
+ *
+ * @param agg : the statistics
+ *
+ * @return the summary statistics or NULL on error
+ */
+rt_bandstats rt_statsagg_get_summary_stats(rt_statsagg agg);
+
+/**
+ * Count the distribution of the values, see rt_band_get_histogram
+ *
+ * @param agg : the statistics, with values kept
+ *
+ * @return the histogram of the values or NULL on error
+ */
+rt_histogram rt_statsagg_get_histogram(rt_statsagg agg,
+	int bin_count, double *bin_width, int bin_width_count,
+	int right, double min, double max, uint32_t *rtn_count);
+
+/**
+ * Compute quantiles of the values, see rt_band_get_quantiles
+ *
+ * @param agg : the statistics, with values kept
+ *
+ * @return the quantiles of the values or NULL on error
+ */
+rt_quantile rt_statsagg_get_quantiles(rt_statsagg agg,
+	double *quantiles, int quantiles_count, uint32_t *rtn_count);
+
+/**
+ * Flatten the statistics, e.g. to keep them as an aggregate state
+ *
+ * @param agg : the statistics
+ * @param size : set to the size of the returned buffer
+ *
+ * @return the serialized statistics or NULL on error
+ */
+void *rt_statsagg_serialize(rt_statsagg agg, uint32_t *size);
+
+/**
+ * Rebuild statistics flattened by rt_statsagg_serialize
+ *
+ * @param data : the serialized statistics
+ * @param size : the size of data
+ *
+ * @return the statistics or NULL on error
+ */
+rt_statsagg rt_statsagg_deserialize(const void *data, uint32_t size);
+
+/**
+ * Release statistics
+ *
+ * @param agg : the statistics
+ */
+void rt_statsagg_destroy(rt_statsagg agg);
+
 /*- utilities -------------------------------------------------------*/
 
 /*
@@ -1461,7 +1759,7 @@ rt_util_gdal_driver_registered(const char *drv);
 struct rt_raster_serialized_t {
     /*---[ 8 byte boundary ]---{ */
     uint32_t size; /* required by postgresql: 4 bytes */
-    uint16_t version; /* format version (this is version 0): 2 bytes */
+    uint16_t version; /* format version (0, 1 with band statistics): 2 bytes */
     uint16_t numBands; /* Number of bands: 2 bytes */
 
     /* }---[ 8 byte boundary ]---{ */
@@ -1513,6 +1811,9 @@ struct rt_raster_t {
     uint16_t height; /* pixel rows - max 65535 */
     rt_band *bands; /* actual bands */
 
+    /* cached band statistics of a raster deserialized header only */
+    rt_cachedstats cachedstats;
+
 };
 
 struct rt_extband_t {
@@ -1521,6 +1822,21 @@ struct rt_extband_t {
 		void *mem; /* loaded external band data, internally owned */
 };
 
+/*
+ * Statistics of a band, stored after the header of the serialized raster
+ * (format version 1) so that they can be read without the band data.
+ * The layout is the one of the serialized form: 48 bytes
+ */
+struct rt_cachedstats_t {
+    double min; /* of the pixels that aren't nodata */
+    double max;
+    double mean;
+    double Q; /* sum of squared differences from the mean */
+    double nodataval; /* nodata value of the band */
+    uint32_t count; /* # of pixels that aren't nodata */
+    uint32_t nodata_count; /* # of nodata pixels */
+};
+
 struct rt_band_t {
     rt_pixtype pixtype;
     int32_t offline;
@@ -1534,6 +1850,9 @@ struct rt_band_t {
 
 		rt_raster raster; /* reference to parent raster */
 
+    int32_t hascachedstats; /* a flag indicating if cachedstats is up to date */
+    struct rt_cachedstats_t cachedstats;
+
     union {
         void* mem; /* actual data, externally owned */
         struct rt_extband_t offline;
@@ -1583,37 +1902,6 @@ struct rt_quantile_t {
 	uint32_t has_value;
 };
 
-/* listed-list structures for rt_band_get_quantiles_stream */
-struct quantile_llist {
-	uint8_t algeq; /* AL-GEQ (1) or AL-GT (0) */
-	double quantile;
-	uint64_t tau; /* position in sequence */
-
-	struct quantile_llist_element *head; /* H index 0 */
-	struct quantile_llist_element *tail; /* H index last */
-	uint32_t count; /* # of elements in H */
-
-	/* faster access to elements at specific intervals */
-	struct quantile_llist_index *index;
-	uint32_t index_max; /* max # of elements in index */
-
-	uint64_t sum1; /* N1H */
-	uint64_t sum2; /* N2H */
-};
-
-struct quantile_llist_element {
-	double value;
-	uint32_t count;
-
-	struct quantile_llist_element *prev;
-	struct quantile_llist_element *next;
-};
-
-struct quantile_llist_index {
-	struct quantile_llist_element *element;
-	uint32_t index;
-};
-
 /* number of times a value occurs */
 struct rt_valuecount_t {
 	double value;
@@ -45,6 +45,7 @@
 #include <executor/spi.h>
 #include <executor/executor.h> /* for GetAttributeByName in RASTER_reclass */
 #include <funcapi.h>
+#include <lib/stringinfo.h> /* for StringInfo in RASTER_recv */
 
 #include "../../postgis_config.h"
 
@@ -53,6 +54,7 @@
 #include "pgsql_compat.h"
 
 #include <utils/lsyscache.h> /* for get_typlenbyvalalign */
+#include <utils/memutils.h> /* for MaxAllocSize */
 #include <utils/array.h> /* for ArrayType */
 #include <catalog/pg_type.h> /* for INT2OID, INT4OID, FLOAT4OID, FLOAT8OID and TEXTOID */
 
@@ -82,6 +84,7 @@ static char **rtpg_strsplit(const char *str, const char *delimiter, int *n);
 static char *rtpg_removespaces(char *str);
 static char *rtpg_trim(const char* input);
 static char *rtpg_getSR(int srid);
+static rt_raster rtpg_deserialize_header_stats(Datum datum);
 
 /***************************************************************
  * Some rules for returning NOTICE or ERROR...
@@ -147,6 +150,8 @@ Datum RASTER_minPossibleValue(PG_FUNCTION_ARGS);
 /* Input/output and format conversions */
 Datum RASTER_in(PG_FUNCTION_ARGS);
 Datum RASTER_out(PG_FUNCTION_ARGS);
+Datum RASTER_recv(PG_FUNCTION_ARGS);
+Datum RASTER_send(PG_FUNCTION_ARGS);
 
 Datum RASTER_to_bytea(PG_FUNCTION_ARGS);
 Datum RASTER_to_binary(PG_FUNCTION_ARGS);
@@ -215,6 +220,7 @@ Datum RASTER_mapAlgebraFct(PG_FUNCTION_ARGS);
 Datum RASTER_band(PG_FUNCTION_ARGS);
 
 /* Get summary stats */
+Datum RASTER_computeStats(PG_FUNCTION_ARGS);
 Datum RASTER_summaryStats(PG_FUNCTION_ARGS);
 Datum RASTER_summaryStatsCoverage(PG_FUNCTION_ARGS);
 
@@ -261,6 +267,10 @@ Datum RASTER_mapAlgebra2(PG_FUNCTION_ARGS);
 /* one-raster neighborhood MapAlgebra */
 Datum RASTER_mapAlgebraFctNgb(PG_FUNCTION_ARGS);
 
+/* union aggregate */
+Datum RASTER_union_transfn(PG_FUNCTION_ARGS);
+Datum RASTER_union_finalfn(PG_FUNCTION_ARGS);
+
 /* string replacement function taken from
  * http://ubuntuforums.org/showthread.php?s=aa6f015109fd7e4c7e30d2fd8b717497&t=141670&page=3
  */
@@ -548,6 +558,33 @@ rtpg_getSR(int srid)
 	return srs;
 }
 
+/*
+ * Deserialize the header of a raster and the band statistics cached
+ * with it, detoasting no more of the datum than that
+ */
+static rt_raster
+rtpg_deserialize_header_stats(Datum datum)
+{
+	rt_pgraster *pgraster = NULL;
+	rt_raster raster = NULL;
+	uint32_t size = 0;
+
+	pgraster = (rt_pgraster *) PG_DETOAST_DATUM_SLICE(datum, 0, sizeof(struct rt_raster_serialized_t));
+	raster = rt_raster_deserialize(pgraster, TRUE);
+	pfree(pgraster);
+	if (!raster)
+		return NULL;
+
+	size = rt_raster_serialized_header_size(raster);
+	if (size > sizeof(struct rt_raster_serialized_t)) {
+		pgraster = (rt_pgraster *) PG_DETOAST_DATUM_SLICE(datum, 0, size);
+		rt_raster_deserialize_cached_stats(raster, pgraster);
+		pfree(pgraster);
+	}
+
+	return raster;
+}
+
 PG_FUNCTION_INFO_V1(RASTER_lib_version);
 Datum RASTER_lib_version(PG_FUNCTION_ARGS)
 {
@@ -678,6 +715,72 @@ Datum RASTER_out(PG_FUNCTION_ARGS)
 	PG_RETURN_CSTRING(hexwkb);
 }
 
+/**
+ * Binary input, the raster in Well-Known-Binary form.  Used by
+ * binary COPY, so loaders can skip hex encoding the rasters.
+ */
+PG_FUNCTION_INFO_V1(RASTER_recv);
+Datum RASTER_recv(PG_FUNCTION_ARGS)
+{
+	StringInfo buf = (StringInfo) PG_GETARG_POINTER(0);
+	rt_raster raster = NULL;
+	rt_pgraster *pgraster = NULL;
+
+	raster = rt_raster_from_wkb((uint8_t *) buf->data, buf->len);
+	if (!raster) {
+		elog(ERROR, "RASTER_recv: Could not parse raster WKB");
+		PG_RETURN_NULL();
+	}
+
+	/* Set cursor to the end of buffer (so the backend is happy) */
+	buf->cursor = buf->len;
+
+	pgraster = rt_raster_serialize(raster);
+	rt_raster_destroy(raster);
+	if (!pgraster) {
+		elog(ERROR, "RASTER_recv: Could not serialize raster");
+		PG_RETURN_NULL();
+	}
+
+	SET_VARSIZE(pgraster, pgraster->size);
+	PG_RETURN_POINTER(pgraster);
+}
+
+/**
+ * Binary output, the raster in Well-Known-Binary form.
+ */
+PG_FUNCTION_INFO_V1(RASTER_send);
+Datum RASTER_send(PG_FUNCTION_ARGS)
+{
+	rt_pgraster *pgraster = NULL;
+	rt_raster raster = NULL;
+	uint8_t *wkb = NULL;
+	uint32_t wkb_size = 0;
+	bytea *result = NULL;
+
+	pgraster = (rt_pgraster *) PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
+
+	raster = rt_raster_deserialize(pgraster, FALSE);
+	if (!raster) {
+		elog(ERROR, "RASTER_send: Could not deserialize raster");
+		PG_RETURN_NULL();
+	}
+
+	wkb = rt_raster_to_wkb(raster, &wkb_size);
+	rt_raster_destroy(raster);
+	if (!wkb) {
+		elog(ERROR, "RASTER_send: Could not allocate and generate WKB data");
+		PG_RETURN_NULL();
+	}
+
+	result = (bytea *) palloc(wkb_size + VARHDRSZ);
+	SET_VARSIZE(result, wkb_size + VARHDRSZ);
+	memcpy(VARDATA(result), wkb, wkb_size);
+	rtdealloc(wkb);
+
+	PG_RETURN_BYTEA_P(result);
+}
+
 /**
  * Return bytea object with raster in Well-Known-Binary form.
  */
@@ -2613,6 +2716,17 @@ Datum RASTER_mapAlgebraExpr(PG_FUNCTION_ARGS)
     bool isnull = FALSE;
     int i = 0;
     int j = 0;
+    rt_mapexpr mapexpr = NULL;
+    double *mapvalues[RT_MAPEXPR_NVARS] = {NULL};
+    uint8_t *mapstatus[RT_MAPEXPR_NVARS] = {NULL};
+    double *rowval = NULL;
+    double *rowx = NULL;
+    double *rowy = NULL;
+    double *rowresult = NULL;
+    double *rownew = NULL;
+    void *line = NULL;
+    uint8_t *rowstatus = NULL;
+    uint8_t *rowrstatus = NULL;
 
     POSTGIS_RT_DEBUG(2, "RASTER_mapAlgebraExpr: Starting...");
 
@@ -3027,6 +3141,140 @@ Datum RASTER_mapAlgebraExpr(PG_FUNCTION_ARGS)
     POSTGIS_RT_DEBUGF(3, "RASTER_mapAlgebraExpr: Main computing loop (%d x %d)",
             width, height);
 
+    /**
+     * Optimization: If the expression can be compiled, evaluate it natively
+     * one row at a time instead of running the prepared plan for each pixel.
+     * Any expression that can't be compiled is left to SPI
+     **/
+    if (initexpr != NULL && skipcomputation == 0)
+        mapexpr = rt_mapexpr_compile(expression, 1);
+
+    if (mapexpr != NULL) {
+        POSTGIS_RT_DEBUG(3, "RASTER_mapAlgebraExpr: Expression compiled, skipping SPI");
+
+        rowval = (double *) palloc(sizeof(double) * width);
+        rowx = (double *) palloc(sizeof(double) * width);
+        rowy = (double *) palloc(sizeof(double) * width);
+        rowresult = (double *) palloc(sizeof(double) * width);
+        rownew = (double *) palloc(sizeof(double) * width);
+        rowstatus = (uint8_t *) palloc(sizeof(uint8_t) * width);
+        rowrstatus = (uint8_t *) palloc(sizeof(uint8_t) * width);
+
+        mapvalues[RT_MAPEXPR_VAL1] = rowval;
+        mapvalues[RT_MAPEXPR_X1] = rowx;
+        mapvalues[RT_MAPEXPR_Y1] = rowy;
+        mapstatus[RT_MAPEXPR_VAL1] = rowstatus;
+
+        /* x and y are 0 based indices, but SQL expects 1 based indices */
+        for (x = 0; x < width; x++)
+            rowx[x] = x + 1;
+
+        /* Rows are read and written whole, converting from and to the pixel types at once */
+        for (y = 0; y < height; y++) {
+            line = rt_band_get_pixel_line(band, 0, y, width);
+            if (NULL == line || !rt_pixtype_to_double(rt_band_get_pixtype(band), line, width, rowval)) {
+                elog(ERROR, "RASTER_mapAlgebraExpr: Could not get pixel values of row %d. Aborting", y + 1);
+
+                rt_mapexpr_destroy(mapexpr);
+                rt_raster_destroy(raster);
+                rt_raster_destroy(newrast);
+
+                PG_RETURN_NULL();
+            }
+
+            for (x = 0; x < width; x++) {
+                rowy[x] = y + 1;
+
+                /**
+                 * Nodata pixels are passed as NULL and their results are
+                 * ignored since the nodata value has already been set by the
+                 * first optimization
+                 **/
+                if (FLT_NEQ(rowval[x], newnodatavalue))
+                    rowstatus[x] = RT_MAPEXPR_OK;
+                else {
+                    rowval[x] = 0;
+                    rowstatus[x] = RT_MAPEXPR_NULL;
+                }
+            }
+
+            if (!rt_mapexpr_eval(mapexpr, width, mapvalues, mapstatus, rowresult, rowrstatus)) {
+                elog(ERROR, "RASTER_mapAlgebraExpr: Could not evaluate expression. Aborting");
+
+                rt_mapexpr_destroy(mapexpr);
+                rt_raster_destroy(raster);
+                rt_raster_destroy(newrast);
+
+                PG_RETURN_NULL();
+            }
+
+            /* Pixels that are not computed keep the value the new band has */
+            line = rt_band_get_pixel_line(newband, 0, y, width);
+            if (NULL == line) {
+                elog(ERROR, "RASTER_mapAlgebraExpr: Could not get pixel values of row %d of new raster. Aborting", y + 1);
+
+                rt_mapexpr_destroy(mapexpr);
+                rt_raster_destroy(raster);
+                rt_raster_destroy(newrast);
+
+                PG_RETURN_NULL();
+            }
+            rt_pixtype_to_double(newpixeltype, line, width, rownew);
+
+            for (x = 0; x < width; x++) {
+                if (rowstatus[x] != RT_MAPEXPR_OK)
+                    continue;
+
+                /* Report the error as the executor would have */
+                if (rowrstatus[x] > RT_MAPEXPR_NULL) {
+                    elog(ERROR, "%s", rt_mapexpr_status_message(rowrstatus[x]));
+
+                    rt_mapexpr_destroy(mapexpr);
+                    rt_raster_destroy(raster);
+                    rt_raster_destroy(newrast);
+
+                    PG_RETURN_NULL();
+                }
+                else if (rowrstatus[x] == RT_MAPEXPR_NULL) {
+                    POSTGIS_RT_DEBUGF(3, "Expression for pixel %d,%d (value %g) evaluated to NULL, skip setting", x+1,y+1,rowval[x]);
+                    newval = newinitialvalue;
+                }
+                else
+                    newval = rowresult[x];
+
+                rownew[x] = newval;
+            }
+
+            rt_pixtype_from_double(newpixeltype, rownew, width, line);
+        }
+
+        rt_mapexpr_destroy(mapexpr);
+        pfree(rowval);
+        pfree(rowx);
+        pfree(rowy);
+        pfree(rowresult);
+        pfree(rownew);
+        pfree(rowstatus);
+        pfree(rowrstatus);
+        pfree(initexpr);
+
+        /* Serialize created raster */
+        pgraster = rt_raster_serialize(newrast);
+        if (NULL == pgraster) {
+            rt_raster_destroy(raster);
+            rt_raster_destroy(newrast);
+
+            PG_RETURN_NULL();
+        }
+
+        SET_VARSIZE(pgraster, pgraster->size);
+
+        rt_raster_destroy(raster);
+        rt_raster_destroy(newrast);
+
+        PG_RETURN_POINTER(pgraster);
+    }
+
     if (initexpr != NULL) {
     	/* Convert [rast.val] to [rast] */
         newexpr = rtpg_strreplace(initexpr, "[rast.val]", "[rast]", NULL);
@@ -3791,6 +4039,40 @@ Datum RASTER_band(PG_FUNCTION_ARGS)
 	PG_RETURN_POINTER(pgraster);
 }
 
+/**
+ * Store the statistics of the in-db bands with the raster, so that
+ * summary stats of a coverage only need the start of each tile
+ */
+PG_FUNCTION_INFO_V1(RASTER_computeStats);
+Datum RASTER_computeStats(PG_FUNCTION_ARGS)
+{
+	rt_pgraster *pgraster = NULL;
+	rt_raster raster = NULL;
+
+	if (PG_ARGISNULL(0)) PG_RETURN_NULL();
+	pgraster = (rt_pgraster *) PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
+
+	raster = rt_raster_deserialize(pgraster, FALSE);
+	if (!raster) {
+		elog(ERROR, "RASTER_computeStats: Could not deserialize raster");
+		PG_RETURN_NULL();
+	}
+
+	if (!rt_raster_compute_cached_stats(raster)) {
+		elog(ERROR, "RASTER_computeStats: Could not compute band statistics of raster");
+		rt_raster_destroy(raster);
+		PG_RETURN_NULL();
+	}
+
+	pgraster = rt_raster_serialize(raster);
+	rt_raster_destroy(raster);
+	if (!pgraster) PG_RETURN_NULL();
+
+	SET_VARSIZE(pgraster, pgraster->size);
+
+	PG_RETURN_POINTER(pgraster);
+}
+
 /**
  * Get summary stats of a band
  */
@@ -3932,9 +4214,9 @@ Datum RASTER_summaryStatsCoverage(PG_FUNCTION_ARGS)
 	rt_raster raster = NULL;
 	rt_band band = NULL;
 	int num_bands = 0;
-	uint64_t cK = 0;
-	double cM = 0;
-	double cQ = 0;
+	rt_statsagg agg = NULL;
+	struct rt_cachedstats_t cachedstats;
+	int added = 0;
 	rt_bandstats stats = NULL;
 	rt_bandstats rtn = NULL;
 
@@ -4019,6 +4301,17 @@ Datum RASTER_summaryStatsCoverage(PG_FUNCTION_ARGS)
 	);
 	pfree(sql);
 
+	/* summary stats of all the rasters */
+	agg = rt_statsagg_new(0, 0);
+	if (NULL == agg) {
+		elog(ERROR, "RASTER_summaryStatsCoverage: Unable to allocate memory for summary stats of coverage\n");
+
+		SPI_cursor_close(portal);
+		SPI_finish();
+
+		PG_RETURN_NULL();
+	}
+
 	/* process resultset */
 	SPI_cursor_fetch(portal, TRUE, 1);
 	while (SPI_processed == 1 && SPI_tuptable != NULL) {
@@ -4032,9 +4325,9 @@ Datum RASTER_summaryStatsCoverage(PG_FUNCTION_ARGS)
 
 			if (SPI_tuptable) SPI_freetuptable(tuptable);
 			SPI_cursor_close(portal);
+			rt_statsagg_destroy(agg);
 			SPI_finish();
 
-			if (NULL != rtn) pfree(rtn);
 			PG_RETURN_NULL();
 		}
 		else if (isNull) {
@@ -4042,6 +4335,37 @@ Datum RASTER_summaryStatsCoverage(PG_FUNCTION_ARGS)
 			continue;
 		}
 
+		/*
+			all the pixels are asked for and the band statistics are cached
+			after the header, the band data doesn't have to be read
+		*/
+		if (FLT_EQ(sample, 1.0)) {
+			raster = rtpg_deserialize_header_stats(datum);
+			if (
+				NULL != raster &&
+				rt_raster_get_cached_stats(raster, bandindex - 1, &cachedstats) &&
+				(!exclude_nodata_value || cachedstats.count > 0)
+			) {
+				rt_raster_destroy(raster);
+
+				if (!rt_statsagg_add_cached_stats(agg, &cachedstats, (int) exclude_nodata_value)) {
+					elog(NOTICE, "Unable to compute summary statistics for band at index %d. Returning NULL", bandindex);
+
+					if (SPI_tuptable) SPI_freetuptable(tuptable);
+					SPI_cursor_close(portal);
+					rt_statsagg_destroy(agg);
+					SPI_finish();
+
+					PG_RETURN_NULL();
+				}
+
+				SPI_cursor_fetch(portal, TRUE, 1);
+				continue;
+			}
+			if (NULL != raster)
+				rt_raster_destroy(raster);
+		}
+
 		pgraster = (rt_pgraster *) PG_DETOAST_DATUM(datum);
 
 		raster = rt_raster_deserialize(pgraster, FALSE);
@@ -4050,9 +4374,9 @@ Datum RASTER_summaryStatsCoverage(PG_FUNCTION_ARGS)
 
 			if (SPI_tuptable) SPI_freetuptable(tuptable);
 			SPI_cursor_close(portal);
+			rt_statsagg_destroy(agg);
 			SPI_finish();
 
-			if (NULL != rtn) pfree(rtn);
 			PG_RETURN_NULL();
 		}
 
@@ -4063,9 +4387,9 @@ Datum RASTER_summaryStatsCoverage(PG_FUNCTION_ARGS)
 
 			if (SPI_tuptable) SPI_freetuptable(tuptable);
 			SPI_cursor_close(portal);
+			rt_statsagg_destroy(agg);
 			SPI_finish();
 
-			if (NULL != rtn) pfree(rtn);
 			PG_RETURN_NULL();
 		}
 
@@ -4076,73 +4400,44 @@ Datum RASTER_summaryStatsCoverage(PG_FUNCTION_ARGS)
 
 			if (SPI_tuptable) SPI_freetuptable(tuptable);
 			SPI_cursor_close(portal);
+			rt_statsagg_destroy(agg);
 			SPI_finish();
 
-			if (NULL != rtn) pfree(rtn);
 			PG_RETURN_NULL();
 		}
 
-		/* we don't need the raw values, hence the zero parameter */
-		stats = rt_band_get_summary_stats(band, (int) exclude_nodata_value, sample, 0, &cK, &cM, &cQ);
+		/* we don't need the raw values, the stats are created without them */
+		added = rt_statsagg_add_band(agg, band, (int) exclude_nodata_value, sample);
 
 		rt_band_destroy(band);
 		rt_raster_destroy(raster);
 
-		if (NULL == stats) {
+		if (!added) {
 			elog(NOTICE, "Unable to compute summary statistics for band at index %d. Returning NULL", bandindex);
 
 			if (SPI_tuptable) SPI_freetuptable(tuptable);
 			SPI_cursor_close(portal);
+			rt_statsagg_destroy(agg);
 			SPI_finish();
 
-			if (NULL != rtn) pfree(rtn);
 			PG_RETURN_NULL();
 		}
 
-		/* initialize rtn */
-		if (stats->count > 0) {
-			if (NULL == rtn) {
-				rtn = (rt_bandstats) SPI_palloc(sizeof(struct rt_bandstats_t));
-				if (NULL == rtn) {
-					elog(ERROR, "RASTER_summaryStatsCoverage: Unable to allocate memory for summary stats of coverage\n");
-
-					if (SPI_tuptable) SPI_freetuptable(tuptable);
-					SPI_cursor_close(portal);
-					SPI_finish();
-
-					PG_RETURN_NULL();
-				}
-
-				rtn->sample = stats->sample;
-				rtn->count = stats->count;
-				rtn->min = stats->min;
-				rtn->max = stats->max;
-				rtn->sum = stats->sum;
-				rtn->mean = stats->mean;
-				rtn->stddev = -1;
-
-				rtn->values = NULL;
-				rtn->sorted = 0;
-			}
-			else {
-				rtn->count += stats->count;
-				rtn->sum += stats->sum;
-
-				if (stats->min < rtn->min)
-					rtn->min = stats->min;
-				if (stats->max > rtn->max)
-					rtn->max = stats->max;
-			}
-		}
-
-		pfree(stats);
-
 		/* next record */
 		SPI_cursor_fetch(portal, TRUE, 1);
 	}
 
 	if (SPI_tuptable) SPI_freetuptable(tuptable);
 	SPI_cursor_close(portal);
+
+	/* coverage mean and deviation, kept out of the SPI memory */
+	stats = rt_statsagg_get_summary_stats(agg);
+	rt_statsagg_destroy(agg);
+	if (NULL != stats && stats->count > 0) {
+		rtn = (rt_bandstats) SPI_palloc(sizeof(struct rt_bandstats_t));
+		if (NULL != rtn)
+			memcpy(rtn, stats, sizeof(struct rt_bandstats_t));
+	}
 	SPI_finish();
 
 	if (NULL == rtn) {
@@ -4150,15 +4445,6 @@ Datum RASTER_summaryStatsCoverage(PG_FUNCTION_ARGS)
 		PG_RETURN_NULL();
 	}
 
-	/* coverage mean and deviation */
-	rtn->mean = rtn->sum / rtn->count;
-	/* sample deviation */
-	if (rtn->sample > 0 && rtn->sample < 1)
-		rtn->stddev = sqrt(cQ / (rtn->count - 1));
-	/* standard deviation */
-	else
-		rtn->stddev = sqrt(cQ / rtn->count);
-
 	/* Build a tuple descriptor for our result type */
 	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE) {
 		ereport(ERROR, (
@@ -4511,9 +4797,6 @@ Datum RASTER_histogramCoverage(PG_FUNCTION_ARGS)
 
 		int len = 0;
 		char *sql = NULL;
-		char *tmp = NULL;
-		double min = 0;
-		double max = 0;
 		int spi_result;
 		Portal portal;
 		SPITupleTable *tuptable = NULL;
@@ -4525,9 +4808,10 @@ Datum RASTER_histogramCoverage(PG_FUNCTION_ARGS)
 		rt_raster raster = NULL;
 		rt_band band = NULL;
 		int num_bands = 0;
+		rt_statsagg agg = NULL;
+		int added = 0;
 		rt_bandstats stats = NULL;
 		rt_histogram hist;
-		uint64_t sum = 0;
 
 		int j;
 		int n;
@@ -4680,74 +4964,6 @@ Datum RASTER_histogramCoverage(PG_FUNCTION_ARGS)
 			SRF_RETURN_DONE(funcctx);
 		}
 
-		/* coverage stats */
-		len = sizeof(char) * (strlen("SELECT min, max FROM _st_summarystats('','',,::boolean,)") + strlen(tablename) + strlen(colname) + (MAX_INT_CHARLEN * 2) + MAX_DBL_CHARLEN + 1);
-		sql = (char *) palloc(len);
-		if (NULL == sql) {
-			elog(ERROR, "RASTER_histogramCoverage: Unable to allocate memory for sql\n");
-
-			if (SPI_tuptable) SPI_freetuptable(tuptable);
-			SPI_finish();
-
-			if (bin_width_count) pfree(bin_width);
-
-			MemoryContextSwitchTo(oldcontext);
-			SRF_RETURN_DONE(funcctx);
-		}
-
-		/* get stats */
-		snprintf(sql, len, "SELECT min, max FROM _st_summarystats('%s','%s',%d,%d::boolean,%f)", tablename, colname, bandindex, (exclude_nodata_value ? 1 : 0), sample);
-		POSTGIS_RT_DEBUGF(3, "RASTER_histogramCoverage: %s", sql);
-		spi_result = SPI_execute(sql, TRUE, 0);
-		pfree(sql);
-		if (spi_result != SPI_OK_SELECT || SPI_tuptable == NULL || SPI_processed != 1) {
-			elog(ERROR, "RASTER_histogramCoverage: Could not get summary stats of coverage");
-
-			if (SPI_tuptable) SPI_freetuptable(tuptable);
-			SPI_finish();
-
-			if (bin_width_count) pfree(bin_width);
-
-			MemoryContextSwitchTo(oldcontext);
-			SRF_RETURN_DONE(funcctx);
-		}
-
-		tupdesc = SPI_tuptable->tupdesc;
-		tuptable = SPI_tuptable;
-		tuple = tuptable->vals[0];
-
-		tmp = SPI_getvalue(tuple, tupdesc, 1);
-		if (NULL == tmp || !strlen(tmp)) {
-			elog(ERROR, "RASTER_histogramCoverage: Could not get summary stats of coverage");
-
-			if (SPI_tuptable) SPI_freetuptable(tuptable);
-			SPI_finish();
-
-			if (bin_width_count) pfree(bin_width);
-
-			MemoryContextSwitchTo(oldcontext);
-			SRF_RETURN_DONE(funcctx);
-		}
-		min = strtod(tmp, NULL);
-		POSTGIS_RT_DEBUGF(3, "RASTER_histogramCoverage: min = %f", min);
-		pfree(tmp);
-
-		tmp = SPI_getvalue(tuple, tupdesc, 2);
-		if (NULL == tmp || !strlen(tmp)) {
-			elog(ERROR, "RASTER_histogramCoverage: Could not get summary stats of coverage");
-
-			if (SPI_tuptable) SPI_freetuptable(tuptable);
-			SPI_finish();
-
-			if (bin_width_count) pfree(bin_width);
-
-			MemoryContextSwitchTo(oldcontext);
-			SRF_RETURN_DONE(funcctx);
-		}
-		max = strtod(tmp, NULL);
-		POSTGIS_RT_DEBUGF(3, "RASTER_histogramCoverage: max = %f", max);
-		pfree(tmp);
-
 		/* iterate through rasters of coverage */
 		/* create sql */
 		len = sizeof(char) * (strlen("SELECT \"\" FROM \"\" WHERE \"\" IS NOT NULL") + (strlen(colname) * 2) + strlen(tablename) + 1);
@@ -4776,6 +4992,23 @@ Datum RASTER_histogramCoverage(PG_FUNCTION_ARGS)
 		);
 		pfree(sql);
 
+		/*
+			values of all the rasters, sketched once there are too many of
+			them so that memory doesn't grow with the size of the coverage
+		*/
+		agg = rt_statsagg_new(1, RT_STATSAGG_SKETCH_SIZE);
+		if (NULL == agg) {
+			elog(ERROR, "RASTER_histogramCoverage: Unable to allocate memory for stats of coverage");
+
+			SPI_cursor_close(portal);
+			SPI_finish();
+
+			if (bin_width_count) pfree(bin_width);
+
+			MemoryContextSwitchTo(oldcontext);
+			SRF_RETURN_DONE(funcctx);
+		}
+
 		/* process resultset */
 		SPI_cursor_fetch(portal, TRUE, 1);
 		while (SPI_processed == 1 && SPI_tuptable != NULL) {
@@ -4789,9 +5022,9 @@ Datum RASTER_histogramCoverage(PG_FUNCTION_ARGS)
 
 				if (SPI_tuptable) SPI_freetuptable(tuptable);
 				SPI_cursor_close(portal);
+				rt_statsagg_destroy(agg);
 				SPI_finish();
 
-				if (NULL != covhist) pfree(covhist);
 				if (bin_width_count) pfree(bin_width);
 
 				MemoryContextSwitchTo(oldcontext);
@@ -4810,9 +5043,9 @@ Datum RASTER_histogramCoverage(PG_FUNCTION_ARGS)
 
 				if (SPI_tuptable) SPI_freetuptable(tuptable);
 				SPI_cursor_close(portal);
+				rt_statsagg_destroy(agg);
 				SPI_finish();
 
-				if (NULL != covhist) pfree(covhist);
 				if (bin_width_count) pfree(bin_width);
 
 				MemoryContextSwitchTo(oldcontext);
@@ -4826,9 +5059,9 @@ Datum RASTER_histogramCoverage(PG_FUNCTION_ARGS)
 
 				if (SPI_tuptable) SPI_freetuptable(tuptable);
 				SPI_cursor_close(portal);
+				rt_statsagg_destroy(agg);
 				SPI_finish();
 
-				if (NULL != covhist) pfree(covhist);
 				if (bin_width_count) pfree(bin_width);
 
 				MemoryContextSwitchTo(oldcontext);
@@ -4842,109 +5075,79 @@ Datum RASTER_histogramCoverage(PG_FUNCTION_ARGS)
 
 				if (SPI_tuptable) SPI_freetuptable(tuptable);
 				SPI_cursor_close(portal);
+				rt_statsagg_destroy(agg);
 				SPI_finish();
 
-				if (NULL != covhist) pfree(covhist);
 				if (bin_width_count) pfree(bin_width);
 
 				MemoryContextSwitchTo(oldcontext);
 				SRF_RETURN_DONE(funcctx);
 			}
 
-			/* we need the raw values, hence the non-zero parameter */
-			stats = rt_band_get_summary_stats(band, (int) exclude_nodata_value, sample, 1, NULL, NULL, NULL);
+			added = rt_statsagg_add_band(agg, band, (int) exclude_nodata_value, sample);
 
 			rt_band_destroy(band);
 			rt_raster_destroy(raster);
 
-			if (NULL == stats) {
+			if (!added) {
 				elog(NOTICE, "Unable to compute summary statistics for band at index %d. Returning NULL", bandindex);
 
 				if (SPI_tuptable) SPI_freetuptable(tuptable);
 				SPI_cursor_close(portal);
+				rt_statsagg_destroy(agg);
 				SPI_finish();
 
-				if (NULL != covhist) pfree(covhist);
 				if (bin_width_count) pfree(bin_width);
 
 				MemoryContextSwitchTo(oldcontext);
 				SRF_RETURN_DONE(funcctx);
 			}
 
-			/* get histogram */
-			if (stats->count > 0) {
-				hist = rt_band_get_histogram(stats, bin_count, bin_width, bin_width_count, right, min, max, &count);
-				pfree(stats);
-				if (NULL == hist || !count) {
-					elog(NOTICE, "Unable to compute histogram for band at index %d", bandindex);
+			/* next record */
+			SPI_cursor_fetch(portal, TRUE, 1);
+		}
 
-					if (SPI_tuptable) SPI_freetuptable(tuptable);
-					SPI_cursor_close(portal);
-					SPI_finish();
+		if (SPI_tuptable) SPI_freetuptable(tuptable);
+		SPI_cursor_close(portal);
 
-					if (NULL != covhist) pfree(covhist);
-					if (bin_width_count) pfree(bin_width);
+		/* histogram of coverage, kept out of the SPI memory */
+		count = 0;
+		stats = rt_statsagg_get_summary_stats(agg);
+		if (NULL != stats && stats->count > 0) {
+			hist = rt_statsagg_get_histogram(agg, bin_count, bin_width, bin_width_count, right, 0, 0, &count);
+			if (NULL == hist || !count) {
+				elog(NOTICE, "Unable to compute histogram for band at index %d", bandindex);
 
-					MemoryContextSwitchTo(oldcontext);
-					SRF_RETURN_DONE(funcctx);
-				}
-
-				POSTGIS_RT_DEBUGF(3, "%d bins returned", count);
+				rt_statsagg_destroy(agg);
+				SPI_finish();
 
-				/* coverage histogram */
-				if (NULL == covhist) {
-					covhist = (rt_histogram) SPI_palloc(sizeof(struct rt_histogram_t) * count);
-					if (NULL == covhist) {
-						elog(ERROR, "RASTER_histogramCoverage: Unable to allocate memory for histogram of coverage");
+				if (bin_width_count) pfree(bin_width);
 
-						pfree(hist);
-						if (SPI_tuptable) SPI_freetuptable(tuptable);
-						SPI_cursor_close(portal);
-						SPI_finish();
+				MemoryContextSwitchTo(oldcontext);
+				SRF_RETURN_DONE(funcctx);
+			}
 
-						if (bin_width_count) pfree(bin_width);
+			POSTGIS_RT_DEBUGF(3, "%d bins returned", count);
 
-						MemoryContextSwitchTo(oldcontext);
-						SRF_RETURN_DONE(funcctx);
-					}
+			covhist = (rt_histogram) SPI_palloc(sizeof(struct rt_histogram_t) * count);
+			if (NULL == covhist) {
+				elog(ERROR, "RASTER_histogramCoverage: Unable to allocate memory for histogram of coverage");
 
-					for (i = 0; i < count; i++) {
-						sum += hist[i].count;
-						covhist[i].count = hist[i].count;
-						covhist[i].percent = 0;
-						covhist[i].min = hist[i].min;
-						covhist[i].max = hist[i].max;
-					}
-				}
-				else {
-					for (i = 0; i < count; i++) {
-						sum += hist[i].count;
-						covhist[i].count += hist[i].count;
-					}
-				}
+				rt_statsagg_destroy(agg);
+				SPI_finish();
 
-				pfree(hist);
+				if (bin_width_count) pfree(bin_width);
 
-				/* assuming bin_count wasn't set, force consistency */
-				if (bin_count <= 0) bin_count = count;
+				MemoryContextSwitchTo(oldcontext);
+				SRF_RETURN_DONE(funcctx);
 			}
-
-			/* next record */
-			SPI_cursor_fetch(portal, TRUE, 1);
+			memcpy(covhist, hist, sizeof(struct rt_histogram_t) * count);
 		}
-
-		if (SPI_tuptable) SPI_freetuptable(tuptable);
-		SPI_cursor_close(portal);
+		rt_statsagg_destroy(agg);
 		SPI_finish();
 
 		if (bin_width_count) pfree(bin_width);
 
-		/* finish percent of histogram */
-		if (sum > 0) {
-			for (i = 0; i < count; i++)
-				covhist[i].percent = covhist[i].count / (double) sum;
-		}
-
 		/* Store needed information */
 		funcctx->user_fctx = covhist;
 
@@ -5302,8 +5505,6 @@ Datum RASTER_quantileCoverage(PG_FUNCTION_ARGS)
 
 		int len = 0;
 		char *sql = NULL;
-		char *tmp = NULL;
-		uint64_t cov_count = 0;
 		int spi_result;
 		Portal portal;
 		SPITupleTable *tuptable = NULL;
@@ -5315,8 +5516,9 @@ Datum RASTER_quantileCoverage(PG_FUNCTION_ARGS)
 		rt_raster raster = NULL;
 		rt_band band = NULL;
 		int num_bands = 0;
-		struct quantile_llist *qlls = NULL;
-		uint32_t qlls_count;
+		rt_statsagg agg = NULL;
+		int added = 0;
+		rt_bandstats stats = NULL;
 
 		int j;
 		int n;
@@ -5448,7 +5650,6 @@ Datum RASTER_quantileCoverage(PG_FUNCTION_ARGS)
 			}
 		}
 
-		/* coverage stats */
 		/* connect to database */
 		spi_result = SPI_connect();
 		if (spi_result != SPI_OK_CONNECT) {
@@ -5457,51 +5658,6 @@ Datum RASTER_quantileCoverage(PG_FUNCTION_ARGS)
 			SRF_RETURN_DONE(funcctx);
 		}
 
-		len = sizeof(char) * (strlen("SELECT count FROM _st_summarystats('','',,::boolean,)") + strlen(tablename) + strlen(colname) + (MAX_INT_CHARLEN * 2) + MAX_DBL_CHARLEN + 1);
-		sql = (char *) palloc(len);
-		if (NULL == sql) {
-			elog(ERROR, "RASTER_quantileCoverage: Unable to allocate memory for sql\n");
-
-			if (SPI_tuptable) SPI_freetuptable(tuptable);
-			SPI_finish();
-
-			MemoryContextSwitchTo(oldcontext);
-			SRF_RETURN_DONE(funcctx);
-		}
-
-		/* get stats */
-		snprintf(sql, len, "SELECT count FROM _st_summarystats('%s','%s',%d,%d::boolean,%f)", tablename, colname, bandindex, (exclude_nodata_value ? 1 : 0), sample);
-		POSTGIS_RT_DEBUGF(3, "stats sql:  %s", sql);
-		spi_result = SPI_execute(sql, TRUE, 0);
-		pfree(sql);
-		if (spi_result != SPI_OK_SELECT || SPI_tuptable == NULL || SPI_processed != 1) {
-			elog(ERROR, "RASTER_quantileCoverage: Could not get summary stats of coverage");
-
-			if (SPI_tuptable) SPI_freetuptable(tuptable);
-			SPI_finish();
-
-			MemoryContextSwitchTo(oldcontext);
-			SRF_RETURN_DONE(funcctx);
-		}
-
-		tupdesc = SPI_tuptable->tupdesc;
-		tuptable = SPI_tuptable;
-		tuple = tuptable->vals[0];
-
-		tmp = SPI_getvalue(tuple, tupdesc, 1);
-		if (NULL == tmp || !strlen(tmp)) {
-			elog(ERROR, "RASTER_quantileCoverage: Could not get summary stats of coverage");
-
-			if (SPI_tuptable) SPI_freetuptable(tuptable);
-			SPI_finish();
-
-			MemoryContextSwitchTo(oldcontext);
-			SRF_RETURN_DONE(funcctx);
-		}
-		cov_count = strtol(tmp, NULL, 10);
-		POSTGIS_RT_DEBUGF(3, "covcount = %d", (int) cov_count);
-		pfree(tmp);
-
 		/* iterate through rasters of coverage */
 		/* create sql */
 		len = sizeof(char) * (strlen("SELECT \"\" FROM \"\" WHERE \"\" IS NOT NULL") + (strlen(colname) * 2) + strlen(tablename) + 1);
@@ -5528,11 +5684,24 @@ Datum RASTER_quantileCoverage(PG_FUNCTION_ARGS)
 		);
 		pfree(sql);
 
+		/*
+			values of all the rasters, sketched once there are too many of
+			them so that memory doesn't grow with the size of the coverage
+		*/
+		agg = rt_statsagg_new(1, RT_STATSAGG_SKETCH_SIZE);
+		if (NULL == agg) {
+			elog(ERROR, "RASTER_quantileCoverage: Unable to allocate memory for stats of coverage");
+
+			SPI_cursor_close(portal);
+			SPI_finish();
+
+			MemoryContextSwitchTo(oldcontext);
+			SRF_RETURN_DONE(funcctx);
+		}
+
 		/* process resultset */
 		SPI_cursor_fetch(portal, TRUE, 1);
 		while (SPI_processed == 1 && SPI_tuptable != NULL) {
-			if (NULL != covquant) pfree(covquant);
-
 			tupdesc = SPI_tuptable->tupdesc;
 			tuptable = SPI_tuptable;
 			tuple = tuptable->vals[0];
@@ -5543,6 +5712,7 @@ Datum RASTER_quantileCoverage(PG_FUNCTION_ARGS)
 
 				if (SPI_tuptable) SPI_freetuptable(tuptable);
 				SPI_cursor_close(portal);
+				rt_statsagg_destroy(agg);
 				SPI_finish();
 
 				MemoryContextSwitchTo(oldcontext);
@@ -5561,6 +5731,7 @@ Datum RASTER_quantileCoverage(PG_FUNCTION_ARGS)
 
 				if (SPI_tuptable) SPI_freetuptable(tuptable);
 				SPI_cursor_close(portal);
+				rt_statsagg_destroy(agg);
 				SPI_finish();
 
 				MemoryContextSwitchTo(oldcontext);
@@ -5574,6 +5745,7 @@ Datum RASTER_quantileCoverage(PG_FUNCTION_ARGS)
 
 				if (SPI_tuptable) SPI_freetuptable(tuptable);
 				SPI_cursor_close(portal);
+				rt_statsagg_destroy(agg);
 				SPI_finish();
 
 				MemoryContextSwitchTo(oldcontext);
@@ -5587,28 +5759,24 @@ Datum RASTER_quantileCoverage(PG_FUNCTION_ARGS)
 
 				if (SPI_tuptable) SPI_freetuptable(tuptable);
 				SPI_cursor_close(portal);
+				rt_statsagg_destroy(agg);
 				SPI_finish();
 
 				MemoryContextSwitchTo(oldcontext);
 				SRF_RETURN_DONE(funcctx);
 			}
 
-			covquant = rt_band_get_quantiles_stream(
-				band,
-				exclude_nodata_value, sample, cov_count,
-				&qlls, &qlls_count,
-				quantiles, quantiles_count,
-				&count
-			);
+			added = rt_statsagg_add_band(agg, band, (int) exclude_nodata_value, sample);
 
 			rt_band_destroy(band);
 			rt_raster_destroy(raster);
 
-			if (NULL == covquant || !count) {
-				elog(NOTICE, "Unable to compute quantiles for band at index %d", bandindex);
+			if (!added) {
+				elog(NOTICE, "Unable to compute summary statistics for band at index %d. Returning NULL", bandindex);
 
 				if (SPI_tuptable) SPI_freetuptable(tuptable);
 				SPI_cursor_close(portal);
+				rt_statsagg_destroy(agg);
 				SPI_finish();
 
 				MemoryContextSwitchTo(oldcontext);
@@ -5619,19 +5787,36 @@ Datum RASTER_quantileCoverage(PG_FUNCTION_ARGS)
 			SPI_cursor_fetch(portal, TRUE, 1);
 		}
 
-		covquant2 = SPI_palloc(sizeof(struct rt_quantile_t) * count);
-		for (i = 0; i < count; i++) {
-			covquant2[i].quantile = covquant[i].quantile;
-			covquant2[i].has_value = covquant[i].has_value;
-			if (covquant2[i].has_value)
-				covquant2[i].value = covquant[i].value;
-		}
-
-		if (NULL != covquant) pfree(covquant);
-		quantile_llist_destroy(&qlls, qlls_count);
-
 		if (SPI_tuptable) SPI_freetuptable(tuptable);
 		SPI_cursor_close(portal);
+
+		/* quantiles of coverage, kept out of the SPI memory */
+		count = 0;
+		covquant2 = NULL;
+		stats = rt_statsagg_get_summary_stats(agg);
+		if (NULL != stats && stats->count > 0) {
+			covquant = rt_statsagg_get_quantiles(agg, quantiles, quantiles_count, &count);
+			if (NULL == covquant || !count) {
+				elog(NOTICE, "Unable to compute quantiles for band at index %d", bandindex);
+
+				rt_statsagg_destroy(agg);
+				SPI_finish();
+
+				if (quantiles_count) pfree(quantiles);
+
+				MemoryContextSwitchTo(oldcontext);
+				SRF_RETURN_DONE(funcctx);
+			}
+
+			covquant2 = SPI_palloc(sizeof(struct rt_quantile_t) * count);
+			for (i = 0; i < count; i++) {
+				covquant2[i].quantile = covquant[i].quantile;
+				covquant2[i].has_value = covquant[i].has_value;
+				if (covquant2[i].has_value)
+					covquant2[i].value = covquant[i].value;
+			}
+		}
+		rt_statsagg_destroy(agg);
 		SPI_finish();
 
 		if (quantiles_count) pfree(quantiles);
@@ -8634,6 +8819,17 @@ Datum RASTER_mapAlgebra2(PG_FUNCTION_ARGS)
 	int hasnodatanodataval = 0;
 	double nodatanodataval = 0;
 
+	rt_mapexpr mapexpr[3] = {NULL};
+	int mapexprcount = 0;
+	double *mapvalues[RT_MAPEXPR_NVARS] = {NULL};
+	uint8_t *mapstatus[RT_MAPEXPR_NVARS] = {NULL};
+	double *_colpixel[2] = {NULL};
+	uint8_t *_colhaspixel[2] = {NULL};
+	uint8_t *_colstatus[2] = {NULL};
+	double *_colpos[2][2] = {{NULL}};
+	double *mapresult[3] = {NULL};
+	uint8_t *maprstatus[3] = {NULL};
+
 	Oid ufc_noid = InvalidOid;
 	FmgrInfo ufl_info;
 	FunctionCallInfoData ufc_info;
@@ -9044,6 +9240,30 @@ Datum RASTER_mapAlgebra2(PG_FUNCTION_ARGS)
 					expr = text_to_cstring(PG_GETARG_TEXT_P(spi_exprpos[i]));
 					POSTGIS_RT_DEBUGF(3, "raw expr #%d: %s", i, expr);
 
+					/*
+						expressions with keywords that can be compiled are
+						evaluated natively a column at a time instead of
+						running a prepared plan for each pixel
+					*/
+					mapexpr[i] = rt_mapexpr_compile(expr, 2);
+					if (mapexpr[i] != NULL) {
+						for (j = 0; j < RT_MAPEXPR_NVARS; j++) {
+							if (rt_mapexpr_has_var(mapexpr[i], j)) break;
+						}
+
+						/* constant expression, evaluated once below */
+						if (j == RT_MAPEXPR_NVARS) {
+							rt_mapexpr_destroy(mapexpr[i]);
+							mapexpr[i] = NULL;
+						}
+						else {
+							POSTGIS_RT_DEBUGF(3, "expr #%d compiled", i);
+							mapexprcount++;
+							pfree(expr);
+							continue;
+						}
+					}
+
 					for (j = 0, k = 1; j < argkwcount; j++) {
 						/* attempt to replace keyword with placeholder */
 						len = 0;
@@ -9271,6 +9491,29 @@ Datum RASTER_mapAlgebra2(PG_FUNCTION_ARGS)
 	) || (
 		(calltype == REGPROCEDUREOID) && (ufc_noid != InvalidOid)
 	)) {
+		/* pixels of a column are read first so that compiled expressions are evaluated at once */
+		for (i = 0; i < set_count; i++) {
+			_colpixel[i] = (double *) palloc(sizeof(double) * dim[1]);
+			_colhaspixel[i] = (uint8_t *) palloc(sizeof(uint8_t) * dim[1]);
+			_colstatus[i] = (uint8_t *) palloc(sizeof(uint8_t) * dim[1]);
+			_colpos[i][0] = (double *) palloc(sizeof(double) * dim[1]);
+			_colpos[i][1] = (double *) palloc(sizeof(double) * dim[1]);
+		}
+		for (i = 0; i < spi_count; i++) {
+			if (mapexpr[i] == NULL) continue;
+			mapresult[i] = (double *) palloc(sizeof(double) * dim[1]);
+			maprstatus[i] = (uint8_t *) palloc(sizeof(uint8_t) * dim[1]);
+		}
+
+		mapvalues[RT_MAPEXPR_VAL1] = _colpixel[0];
+		mapvalues[RT_MAPEXPR_X1] = _colpos[0][0];
+		mapvalues[RT_MAPEXPR_Y1] = _colpos[0][1];
+		mapvalues[RT_MAPEXPR_VAL2] = _colpixel[1];
+		mapvalues[RT_MAPEXPR_X2] = _colpos[1][0];
+		mapvalues[RT_MAPEXPR_Y2] = _colpos[1][1];
+		mapstatus[RT_MAPEXPR_VAL1] = _colstatus[0];
+		mapstatus[RT_MAPEXPR_VAL2] = _colstatus[1];
+
 		for (x = 0; x < dim[0]; x++) {
 			for (y = 0; y < dim[1]; y++) {
 
@@ -9325,6 +9568,40 @@ Datum RASTER_mapAlgebra2(PG_FUNCTION_ARGS)
 						_haspixel[i],
 						_pixel[i]
 					);
+
+					_colpixel[i][y] = _pixel[i];
+					_colhaspixel[i][y] = _haspixel[i];
+					/* values are NULL for compiled expressions if there is no pixel */
+					_colstatus[i][y] = (_isempty[i] || !_haspixel[i]) ? RT_MAPEXPR_NULL : RT_MAPEXPR_OK;
+					_colpos[i][0][y] = _pos[i][0];
+					_colpos[i][1][y] = _pos[i][1];
+				}
+			}
+
+			/* evaluate compiled expressions for the column */
+			for (i = 0; i < spi_count; i++) {
+				if (mapexpr[i] == NULL) continue;
+
+				if (!rt_mapexpr_eval(mapexpr[i], dim[1], mapvalues, mapstatus, mapresult[i], maprstatus[i])) {
+					elog(ERROR, "RASTER_mapAlgebra2: Unable to evaluate compiled expression %d", i);
+
+					for (k = 0; k < spi_count; k++) rt_mapexpr_destroy(mapexpr[k]);
+					for (k = 0; k < spi_count; k++) SPI_freeplan(spi_plan[k]);
+					SPI_finish();
+
+					for (k = 0; k < set_count; k++) rt_raster_destroy(_rast[k]);
+					rt_raster_destroy(raster);
+
+					PG_RETURN_NULL();
+				}
+			}
+
+			for (y = 0; y < dim[1]; y++) {
+				for (i = 0; i < set_count; i++) {
+					_pixel[i] = _colpixel[i][y];
+					_haspixel[i] = _colhaspixel[i][y];
+					_pos[i][0] = (int) _colpos[i][0][y];
+					_pos[i][1] = (int) _colpos[i][1][y];
 				}
 
 				haspixel = 0;
@@ -9361,6 +9638,26 @@ Datum RASTER_mapAlgebra2(PG_FUNCTION_ARGS)
 							haspixel = 1;
 							pixel = argval[i];
 						}
+						/* compiled expression */
+						else if (mapexpr[i] != NULL) {
+							/* report the error as the executor would have */
+							if (maprstatus[i][y] > RT_MAPEXPR_NULL) {
+								elog(ERROR, "%s", rt_mapexpr_status_message(maprstatus[i][y]));
+
+								for (k = 0; k < spi_count; k++) rt_mapexpr_destroy(mapexpr[k]);
+								for (k = 0; k < spi_count; k++) SPI_freeplan(spi_plan[k]);
+								SPI_finish();
+
+								for (k = 0; k < set_count; k++) rt_raster_destroy(_rast[k]);
+								rt_raster_destroy(raster);
+
+								PG_RETURN_NULL();
+							}
+							else if (maprstatus[i][y] == RT_MAPEXPR_OK) {
+								haspixel = 1;
+								pixel = mapresult[i][y];
+							}
+						}
 						/* prepared plan exists */
 						else if (spi_plan[i] != NULL) {
 							POSTGIS_RT_DEBUGF(4, "Using prepared plan: %d", i);
@@ -9526,11 +9823,26 @@ Datum RASTER_mapAlgebra2(PG_FUNCTION_ARGS)
 
 			} /* y: height */
 		} /* x: width */
+
+		for (i = 0; i < set_count; i++) {
+			pfree(_colpixel[i]);
+			pfree(_colhaspixel[i]);
+			pfree(_colstatus[i]);
+			pfree(_colpos[i][0]);
+			pfree(_colpos[i][1]);
+		}
+		for (i = 0; i < spi_count; i++) {
+			if (mapexpr[i] == NULL) continue;
+			pfree(mapresult[i]);
+			pfree(maprstatus[i]);
+		}
 	}
 
 	/* CLEANUP */
 	if (calltype == TEXTOID) {
+		/* compiled expressions were allocated in the SPI context */
 		for (i = 0; i < spi_count; i++) {
+			if (mapexpr[i] != NULL) rt_mapexpr_destroy(mapexpr[i]);
 			if (spi_plan[i] != NULL) SPI_freeplan(spi_plan[i]);
 		}
 		SPI_finish();
@@ -10142,6 +10454,824 @@ Datum RASTER_mapAlgebraFctNgb(PG_FUNCTION_ARGS)
     PG_RETURN_POINTER(pgraster);
 }
 
+/* ---------------------------------------------------------------- */
+/*  Union aggregate                                                 */
+/* ---------------------------------------------------------------- */
+
+typedef enum {
+	UT_LAST = 0,
+	UT_FIRST,
+	UT_MIN,
+	UT_MAX,
+	UT_COUNT,
+	UT_SUM,
+	UT_MEAN,
+	UT_RANGE,
+	UT_EXPRESSION
+} rtpg_uniontype;
+
+/* pixels of the canvas are stored in square chunks of this dimension */
+#define RTPG_UNION_CHUNKDIM 256
+#define RTPG_UNION_CHUNKSIZE (RTPG_UNION_CHUNKDIM * RTPG_UNION_CHUNKDIM)
+
+/* most chunks added on a side of the grid of chunks when it grows */
+#define RTPG_UNION_GRIDSLACK 16
+
+/*
+	most memory taken by the chunks with double precision values. past
+	that, values are kept at the pixel type of the band as the former
+	plpgsql aggregate did, unless they are accumulated (COUNT, SUM and
+	MEAN) and could overflow the pixel type before the final function
+*/
+#define RTPG_UNION_MAXBYTES MaxAllocSize
+
+/* largest dimension of a raster */
+#define RTPG_UNION_MAXDIM 65535
+
+typedef struct rtpg_union_chunk_t *rtpg_union_chunk;
+struct rtpg_union_chunk_t {
+	uint8_t *values; /* value, sum for MEAN or maximum for RANGE */
+	uint8_t *values2; /* count for MEAN or minimum for RANGE */
+	uint8_t hasvalue[RTPG_UNION_CHUNKSIZE];
+};
+
+/*
+	state of the union aggregate
+
+	the tiles are burned into a canvas allocated in the aggregate memory
+	context. The canvas is a grid of chunks, a chunk being only allocated
+	once a tile falls on it, so that growing the canvas only moves the
+	pointers of the grid. The raster is only built and serialized in the
+	final function
+*/
+typedef struct rtpg_union_arg_t *rtpg_union_arg;
+struct rtpg_union_arg_t {
+	int nband; /* 1-based index of the band of the tiles */
+	rtpg_uniontype uniontype;
+	rt_mapexpr expr; /* UT_EXPRESSION */
+	MemoryContext mcxt; /* aggregate memory context */
+
+	/* georeference of the canvas, has no band */
+	rt_raster canvas;
+
+	/* grid of chunks, NULL until a tile falls on them */
+	int gridwidth;
+	int gridheight;
+	rtpg_union_chunk *chunks;
+
+	/* extent covered by the tiles, in pixels of the canvas (max is exclusive) */
+	int extent[4];
+
+	/* type of the values of the chunks, PT_64BF or the pixel type of the band */
+	rt_pixtype valtype;
+	int valsize;
+	int hasvalues2; /* MEAN and RANGE */
+	Size size; /* bytes taken by the chunks */
+
+	/* band of the output raster */
+	rt_pixtype pixtype;
+	double nodataval;
+};
+
+static double
+rtpg_union_get_value(rtpg_union_arg arg, uint8_t *values, int idx) {
+	double val = 0;
+
+	if (arg->valtype == PT_64BF)
+		return ((double *) values)[idx];
+
+	rt_pixtype_to_double(arg->valtype, values + (idx * arg->valsize), 1, &val);
+	return val;
+}
+
+/* value is clamped to the pixel type of the band once the canvas is compacted */
+static void
+rtpg_union_set_value(rtpg_union_arg arg, uint8_t *values, int idx, double val) {
+	if (arg->valtype == PT_64BF) {
+		((double *) values)[idx] = val;
+		return;
+	}
+
+	rt_pixtype_from_double(arg->valtype, &val, 1, values + (idx * arg->valsize));
+}
+
+/*
+	values of COUNT, SUM and MEAN are running totals that only fit the
+	pixel type of the band once the final function is done with them, so
+	they stay in double precision whatever the size of the canvas
+*/
+static int
+rtpg_union_can_compact(rtpg_union_arg arg) {
+	switch (arg->uniontype) {
+		case UT_COUNT:
+		case UT_SUM:
+		case UT_MEAN:
+			return 0;
+		default:
+			return (arg->valtype == PT_64BF && rt_pixtype_size(arg->pixtype) < arg->valsize);
+	}
+}
+
+/* bytes of a chunk with the current type of values */
+static Size
+rtpg_union_chunk_size(rtpg_union_arg arg) {
+	return sizeof(struct rtpg_union_chunk_t) +
+		(Size) arg->valsize * RTPG_UNION_CHUNKSIZE * (arg->hasvalues2 ? 2 : 1);
+}
+
+/* store the values of all the chunks at the pixel type of the band */
+static void
+rtpg_union_compact(rtpg_union_arg arg) {
+	rtpg_union_chunk chunk = NULL;
+	uint8_t *values = NULL;
+	int valsize = rt_pixtype_size(arg->pixtype);
+	int i = 0;
+	int j = 0;
+
+	POSTGIS_RT_DEBUGF(3, "canvas of %lu bytes is too large, storing values as %s",
+		(unsigned long) arg->size, rt_pixtype_name(arg->pixtype));
+
+	for (i = 0; i < arg->gridwidth * arg->gridheight; i++) {
+		chunk = arg->chunks[i];
+		if (chunk == NULL)
+			continue;
+
+		for (j = 0; j < (arg->hasvalues2 ? 2 : 1); j++) {
+			values = (uint8_t *) MemoryContextAlloc(arg->mcxt, (Size) valsize * RTPG_UNION_CHUNKSIZE);
+			rt_pixtype_from_double(
+				arg->pixtype,
+				(double *) (j ? chunk->values2 : chunk->values),
+				RTPG_UNION_CHUNKSIZE,
+				values
+			);
+
+			if (j) {
+				pfree(chunk->values2);
+				chunk->values2 = values;
+			}
+			else {
+				pfree(chunk->values);
+				chunk->values = values;
+			}
+		}
+	}
+
+	arg->valtype = arg->pixtype;
+	arg->valsize = valsize;
+	arg->size = 0;
+	for (i = 0; i < arg->gridwidth * arg->gridheight; i++) {
+		if (arg->chunks[i] != NULL)
+			arg->size += rtpg_union_chunk_size(arg);
+	}
+}
+
+/*
+	chunk holding pixel (x, y) of the canvas, allocated if create is set.
+	idx is set to the index of the pixel in the chunk
+*/
+static rtpg_union_chunk
+rtpg_union_get_chunk(rtpg_union_arg arg, int x, int y, int create, int *idx) {
+	rtpg_union_chunk *chunk = NULL;
+	Size size = 0;
+
+	chunk = &(arg->chunks[(y / RTPG_UNION_CHUNKDIM) * arg->gridwidth + (x / RTPG_UNION_CHUNKDIM)]);
+	*idx = (y % RTPG_UNION_CHUNKDIM) * RTPG_UNION_CHUNKDIM + (x % RTPG_UNION_CHUNKDIM);
+
+	if (*chunk != NULL || !create)
+		return *chunk;
+
+	/* too large with double precision values */
+	size = rtpg_union_chunk_size(arg);
+	if (
+		arg->size + size > RTPG_UNION_MAXBYTES &&
+		rtpg_union_can_compact(arg)
+	) {
+		rtpg_union_compact(arg);
+		size = rtpg_union_chunk_size(arg);
+	}
+
+	*chunk = (rtpg_union_chunk) MemoryContextAllocZero(arg->mcxt, sizeof(struct rtpg_union_chunk_t));
+	(*chunk)->values = (uint8_t *) MemoryContextAllocZero(arg->mcxt, (Size) arg->valsize * RTPG_UNION_CHUNKSIZE);
+	if (arg->hasvalues2)
+		(*chunk)->values2 = (uint8_t *) MemoryContextAllocZero(arg->mcxt, (Size) arg->valsize * RTPG_UNION_CHUNKSIZE);
+	arg->size += size;
+
+	return *chunk;
+}
+
+/*
+	grow the grid of chunks to hold the extent ext given in pixels of the
+	canvas. ext is updated to be relative to the new canvas. must be
+	called in the aggregate memory context
+*/
+static int
+rtpg_union_grow(rtpg_union_arg arg, int *ext) {
+	int cext[4];
+	int newext[4];
+	int pad[2];
+	int dim[2];
+	double gt[6] = {0.};
+	rt_raster canvas = NULL;
+	rtpg_union_chunk *chunks = NULL;
+	int x = 0;
+	int y = 0;
+
+	/* extent in chunks, rounded outwards */
+	for (x = 0; x < 4; x++) {
+		if (x < 2)
+			cext[x] = (ext[x] >= 0) ? ext[x] / RTPG_UNION_CHUNKDIM : -((RTPG_UNION_CHUNKDIM - 1 - ext[x]) / RTPG_UNION_CHUNKDIM);
+		else
+			cext[x] = (ext[x] + RTPG_UNION_CHUNKDIM - 1) / RTPG_UNION_CHUNKDIM;
+	}
+
+	/* grow by half of the grid in each direction needed, but not by more than the slack */
+	pad[0] = Min(arg->gridwidth / 2, RTPG_UNION_GRIDSLACK);
+	pad[1] = Min(arg->gridheight / 2, RTPG_UNION_GRIDSLACK);
+
+	newext[0] = (cext[0] < 0) ? cext[0] - pad[0] : 0;
+	newext[1] = (cext[1] < 0) ? cext[1] - pad[1] : 0;
+	newext[2] = (cext[2] > arg->gridwidth) ? cext[2] + pad[0] : arg->gridwidth;
+	newext[3] = (cext[3] > arg->gridheight) ? cext[3] + pad[1] : arg->gridheight;
+
+	dim[0] = newext[2] - newext[0];
+	dim[1] = newext[3] - newext[1];
+	POSTGIS_RT_DEBUGF(3, "growing grid of chunks from %d x %d to %d x %d",
+		arg->gridwidth, arg->gridheight, dim[0], dim[1]);
+
+	/* the chunks stay where they are, only the grid is copied */
+	chunks = (rtpg_union_chunk *) palloc0(sizeof(rtpg_union_chunk) * dim[0] * dim[1]);
+	for (y = 0; y < arg->gridheight; y++) {
+		memcpy(
+			chunks + ((y - newext[1]) * dim[0]) - newext[0],
+			arg->chunks + (y * arg->gridwidth),
+			sizeof(rtpg_union_chunk) * arg->gridwidth
+		);
+	}
+
+	/* georeference of new canvas */
+	canvas = rt_raster_new(0, 0);
+	if (canvas == NULL) {
+		elog(ERROR, "RASTER_union_transfn: Unable to create the canvas of the union");
+		return 0;
+	}
+	rt_raster_get_geotransform_matrix(arg->canvas, gt);
+	if (!rt_raster_cell_to_geopoint(
+		arg->canvas,
+		newext[0] * RTPG_UNION_CHUNKDIM, newext[1] * RTPG_UNION_CHUNKDIM,
+		&(gt[0]), &(gt[3]),
+		NULL
+	)) {
+		elog(ERROR, "RASTER_union_transfn: Unable to compute the upper-left corner of the canvas of the union");
+		rt_raster_destroy(canvas);
+		return 0;
+	}
+	rt_raster_set_geotransform_matrix(canvas, gt);
+	rt_raster_set_srid(canvas, rt_raster_get_srid(arg->canvas));
+
+	rt_raster_destroy(arg->canvas);
+	pfree(arg->chunks);
+
+	arg->canvas = canvas;
+	arg->gridwidth = dim[0];
+	arg->gridheight = dim[1];
+	arg->chunks = chunks;
+
+	for (y = 0; y < 4; y++) {
+		arg->extent[y] -= newext[y % 2] * RTPG_UNION_CHUNKDIM;
+		ext[y] -= newext[y % 2] * RTPG_UNION_CHUNKDIM;
+	}
+
+	return 1;
+}
+
+PG_FUNCTION_INFO_V1(RASTER_union_transfn);
+Datum RASTER_union_transfn(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggcontext;
+	MemoryContext oldcontext;
+	rtpg_union_arg arg = NULL;
+	rt_pgraster *pgraster = NULL;
+	rt_raster raster = NULL;
+	rt_band band = NULL;
+	int nargs = PG_NARGS();
+	int nband = 1;
+	char *utypename = NULL;
+	char *expression = NULL;
+	rtpg_uniontype utype = UT_LAST;
+
+	int hasnodata = 0;
+	double nodataval = 0;
+	int width = 0;
+	int height = 0;
+	int ext[4] = {0};
+	double offset[2] = {0};
+	int aligned = 0;
+	double val = 0;
+	rtpg_union_chunk chunk = NULL;
+	int idx = 0;
+	int x = 0;
+	int y = 0;
+	int i = 0;
+
+	/* compiled expression */
+	double *mapvalues[RT_MAPEXPR_NVARS] = {NULL};
+	uint8_t *mapstatus[RT_MAPEXPR_NVARS] = {NULL};
+	double *rowval[2] = {NULL};
+	uint8_t *rowstatus[2] = {NULL};
+	double *rowpos[2][2] = {{NULL}};
+	double *rowresult = NULL;
+	uint8_t *rowrstatus = NULL;
+
+	POSTGIS_RT_DEBUG(3, "Starting RASTER_union_transfn");
+
+	if (fcinfo->context && IsA(fcinfo->context, AggState))
+		aggcontext = ((AggState *) fcinfo->context)->aggcontext;
+#if POSTGIS_PGSQL_VERSION == 84
+	else if (fcinfo->context && IsA(fcinfo->context, WindowAggState))
+		aggcontext = ((WindowAggState *) fcinfo->context)->wincontext;
+#endif
+#if POSTGIS_PGSQL_VERSION > 84
+	else if (fcinfo->context && IsA(fcinfo->context, WindowAggState))
+		aggcontext = ((WindowAggState *) fcinfo->context)->aggcontext;
+#endif
+	else {
+		elog(ERROR, "RASTER_union_transfn: Cannot be called in a non-aggregate context");
+		aggcontext = NULL; /* keep compiler quiet */
+		PG_RETURN_NULL();
+	}
+
+	if (!PG_ARGISNULL(0))
+		arg = (rtpg_union_arg) PG_GETARG_POINTER(0);
+
+	/* NULL tiles are skipped */
+	if (PG_ARGISNULL(1)) {
+		if (arg == NULL)
+			PG_RETURN_NULL();
+		PG_RETURN_POINTER(arg);
+	}
+
+	pgraster = (rt_pgraster *) PG_DETOAST_DATUM(PG_GETARG_DATUM(1));
+	raster = rt_raster_deserialize(pgraster, FALSE);
+	if (raster == NULL) {
+		elog(ERROR, "RASTER_union_transfn: Could not deserialize raster");
+		PG_RETURN_NULL();
+	}
+
+	/* band index and union type are only read for the first tile */
+	if (arg != NULL)
+		nband = arg->nband;
+	else {
+		for (i = 2; i < nargs; i++) {
+			if (PG_ARGISNULL(i)) continue;
+
+			if (get_fn_expr_argtype(fcinfo->flinfo, i) == INT4OID)
+				nband = PG_GETARG_INT32(i);
+			else
+				expression = text_to_cstring(PG_GETARG_TEXT_P(i));
+		}
+
+		if (nband < 1) {
+			elog(ERROR, "RASTER_union_transfn: Invalid band index (must use 1-based)");
+			rt_raster_destroy(raster);
+			PG_RETURN_NULL();
+		}
+
+		if (expression != NULL && strlen(expression)) {
+			utypename = rtpg_strtoupper(rtpg_trim(expression));
+			if (strcmp(utypename, "LAST") == 0)
+				utype = UT_LAST;
+			else if (strcmp(utypename, "FIRST") == 0)
+				utype = UT_FIRST;
+			else if (strcmp(utypename, "MIN") == 0)
+				utype = UT_MIN;
+			else if (strcmp(utypename, "MAX") == 0)
+				utype = UT_MAX;
+			else if (strcmp(utypename, "COUNT") == 0)
+				utype = UT_COUNT;
+			else if (strcmp(utypename, "SUM") == 0)
+				utype = UT_SUM;
+			else if (strcmp(utypename, "MEAN") == 0)
+				utype = UT_MEAN;
+			else if (strcmp(utypename, "RANGE") == 0)
+				utype = UT_RANGE;
+			else
+				utype = UT_EXPRESSION;
+		}
+	}
+
+	/* empty tiles and tiles without the band are skipped */
+	if (
+		rt_raster_is_empty(raster) ||
+		rt_raster_has_no_band(raster, nband - 1)
+	) {
+		POSTGIS_RT_DEBUGF(3, "tile is empty or does not have band %d, skipping", nband);
+		rt_raster_destroy(raster);
+		if (arg == NULL)
+			PG_RETURN_NULL();
+		PG_RETURN_POINTER(arg);
+	}
+
+	band = rt_raster_get_band(raster, nband - 1);
+	if (band == NULL) {
+		elog(ERROR, "RASTER_union_transfn: Could not get band at index %d", nband);
+		rt_raster_destroy(raster);
+		PG_RETURN_NULL();
+	}
+	hasnodata = rt_band_get_hasnodata_flag(band);
+	if (hasnodata)
+		nodataval = rt_band_get_nodata(band);
+
+	width = rt_raster_get_width(raster);
+	height = rt_raster_get_height(raster);
+
+	/* first tile, create canvas */
+	if (arg == NULL) {
+		double gt[6] = {0.};
+
+		oldcontext = MemoryContextSwitchTo(aggcontext);
+
+		arg = (rtpg_union_arg) palloc0(sizeof(struct rtpg_union_arg_t));
+		arg->nband = nband;
+		arg->uniontype = utype;
+		arg->mcxt = aggcontext;
+
+		if (utype == UT_EXPRESSION) {
+			/* [rast1] is the union so far and [rast2] the tile */
+			arg->expr = rt_mapexpr_compile(expression, 2);
+			if (arg->expr == NULL) {
+				MemoryContextSwitchTo(oldcontext);
+				elog(ERROR, "RASTER_union_transfn: Invalid union type or unsupported expression: %s", expression);
+				rt_raster_destroy(raster);
+				PG_RETURN_NULL();
+			}
+		}
+
+		arg->canvas = rt_raster_new(0, 0);
+		if (arg->canvas == NULL) {
+			MemoryContextSwitchTo(oldcontext);
+			elog(ERROR, "RASTER_union_transfn: Unable to create the canvas of the union");
+			rt_raster_destroy(raster);
+			PG_RETURN_NULL();
+		}
+		rt_raster_get_geotransform_matrix(raster, gt);
+		rt_raster_set_geotransform_matrix(arg->canvas, gt);
+		rt_raster_set_srid(arg->canvas, rt_raster_get_srid(raster));
+
+		arg->gridwidth = (width + RTPG_UNION_CHUNKDIM - 1) / RTPG_UNION_CHUNKDIM;
+		arg->gridheight = (height + RTPG_UNION_CHUNKDIM - 1) / RTPG_UNION_CHUNKDIM;
+		arg->chunks = (rtpg_union_chunk *) palloc0(sizeof(rtpg_union_chunk) * arg->gridwidth * arg->gridheight);
+
+		arg->valtype = PT_64BF;
+		arg->valsize = rt_pixtype_size(PT_64BF);
+		arg->hasvalues2 = (utype == UT_MEAN || utype == UT_RANGE);
+
+		MemoryContextSwitchTo(oldcontext);
+
+		/* the output band is like the band of the first tile */
+		arg->pixtype = rt_band_get_pixtype(band);
+		if (hasnodata)
+			arg->nodataval = nodataval;
+		else {
+			elog(NOTICE, "Raster provided has no NODATA value for the specified band index.  NODATA value set to minimum possible for %s", rt_pixtype_name(arg->pixtype));
+			arg->nodataval = rt_pixtype_get_min_value(arg->pixtype);
+		}
+
+		arg->extent[0] = 0;
+		arg->extent[1] = 0;
+		arg->extent[2] = width;
+		arg->extent[3] = height;
+		memcpy(ext, arg->extent, sizeof(int) * 4);
+	}
+	else {
+		if (rt_raster_get_srid(arg->canvas) != rt_raster_get_srid(raster)) {
+			elog(ERROR, "RASTER_union_transfn: The rasters provided have different SRIDs");
+			rt_raster_destroy(raster);
+			PG_RETURN_NULL();
+		}
+
+		if (!rt_raster_same_alignment(arg->canvas, raster, &aligned)) {
+			elog(ERROR, "RASTER_union_transfn: Unable to test for alignment of the rasters");
+			rt_raster_destroy(raster);
+			PG_RETURN_NULL();
+		}
+		if (!aligned) {
+			elog(ERROR, "RASTER_union_transfn: The rasters provided do not have the same alignment");
+			rt_raster_destroy(raster);
+			PG_RETURN_NULL();
+		}
+
+		/* position of tile on canvas */
+		if (!rt_raster_geopoint_to_cell(
+			arg->canvas,
+			rt_raster_get_x_offset(raster), rt_raster_get_y_offset(raster),
+			&(offset[0]), &(offset[1]),
+			NULL
+		)) {
+			elog(ERROR, "RASTER_union_transfn: Unable to compute the position of the raster in the union");
+			rt_raster_destroy(raster);
+			PG_RETURN_NULL();
+		}
+
+		ext[0] = (int) offset[0];
+		ext[1] = (int) offset[1];
+		ext[2] = ext[0] + width;
+		ext[3] = ext[1] + height;
+
+		if (
+			Max(ext[2], arg->extent[2]) - Min(ext[0], arg->extent[0]) > RTPG_UNION_MAXDIM ||
+			Max(ext[3], arg->extent[3]) - Min(ext[1], arg->extent[1]) > RTPG_UNION_MAXDIM
+		) {
+			elog(ERROR, "RASTER_union_transfn: The union of the rasters would exceed the maximum dimensions of a raster (%d x %d)",
+				RTPG_UNION_MAXDIM, RTPG_UNION_MAXDIM);
+			rt_raster_destroy(raster);
+			PG_RETURN_NULL();
+		}
+
+		if (
+			ext[0] < 0 || ext[1] < 0 ||
+			ext[2] > arg->gridwidth * RTPG_UNION_CHUNKDIM ||
+			ext[3] > arg->gridheight * RTPG_UNION_CHUNKDIM
+		) {
+			oldcontext = MemoryContextSwitchTo(aggcontext);
+			i = rtpg_union_grow(arg, ext);
+			MemoryContextSwitchTo(oldcontext);
+
+			if (!i) {
+				rt_raster_destroy(raster);
+				PG_RETURN_NULL();
+			}
+		}
+
+		/* extent covered by the tiles */
+		for (i = 0; i < 2; i++) {
+			if (ext[i] < arg->extent[i]) arg->extent[i] = ext[i];
+			if (ext[i + 2] > arg->extent[i + 2]) arg->extent[i + 2] = ext[i + 2];
+		}
+	}
+
+	if (rt_band_get_isnodata_flag(band)) {
+		POSTGIS_RT_DEBUG(3, "band of tile is NODATA, skipping values");
+		rt_raster_destroy(raster);
+		PG_RETURN_POINTER(arg);
+	}
+
+	if (arg->uniontype == UT_EXPRESSION) {
+		for (i = 0; i < 2; i++) {
+			rowval[i] = (double *) palloc(sizeof(double) * width);
+			rowstatus[i] = (uint8_t *) palloc(sizeof(uint8_t) * width);
+			rowpos[i][0] = (double *) palloc(sizeof(double) * width);
+			rowpos[i][1] = (double *) palloc(sizeof(double) * width);
+		}
+		rowresult = (double *) palloc(sizeof(double) * width);
+		rowrstatus = (uint8_t *) palloc(sizeof(uint8_t) * width);
+
+		mapvalues[RT_MAPEXPR_VAL1] = rowval[0];
+		mapvalues[RT_MAPEXPR_X1] = rowpos[0][0];
+		mapvalues[RT_MAPEXPR_Y1] = rowpos[0][1];
+		mapvalues[RT_MAPEXPR_VAL2] = rowval[1];
+		mapvalues[RT_MAPEXPR_X2] = rowpos[1][0];
+		mapvalues[RT_MAPEXPR_Y2] = rowpos[1][1];
+		mapstatus[RT_MAPEXPR_VAL1] = rowstatus[0];
+		mapstatus[RT_MAPEXPR_VAL2] = rowstatus[1];
+	}
+
+	/* burn tile */
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++) {
+			if (rt_band_get_pixel(band, x, y, &val) < 0) {
+				elog(ERROR, "RASTER_union_transfn: Unable to get pixel value of raster");
+				rt_raster_destroy(raster);
+				PG_RETURN_NULL();
+			}
+
+			if (hasnodata && FLT_EQ(val, nodataval)) {
+				if (rowstatus[1] != NULL)
+					rowstatus[1][x] = RT_MAPEXPR_NULL;
+				continue;
+			}
+
+			chunk = rtpg_union_get_chunk(arg, ext[0] + x, ext[1] + y, TRUE, &idx);
+
+			switch (arg->uniontype) {
+				case UT_LAST:
+					rtpg_union_set_value(arg, chunk->values, idx, val);
+					break;
+				case UT_FIRST:
+					if (!chunk->hasvalue[idx])
+						rtpg_union_set_value(arg, chunk->values, idx, val);
+					break;
+				case UT_MIN:
+					if (!chunk->hasvalue[idx] || val < rtpg_union_get_value(arg, chunk->values, idx))
+						rtpg_union_set_value(arg, chunk->values, idx, val);
+					break;
+				case UT_MAX:
+					if (!chunk->hasvalue[idx] || val > rtpg_union_get_value(arg, chunk->values, idx))
+						rtpg_union_set_value(arg, chunk->values, idx, val);
+					break;
+				case UT_COUNT:
+					rtpg_union_set_value(arg, chunk->values, idx, rtpg_union_get_value(arg, chunk->values, idx) + 1);
+					break;
+				case UT_SUM:
+					rtpg_union_set_value(arg, chunk->values, idx, rtpg_union_get_value(arg, chunk->values, idx) + val);
+					break;
+				case UT_MEAN:
+					rtpg_union_set_value(arg, chunk->values, idx, rtpg_union_get_value(arg, chunk->values, idx) + val);
+					rtpg_union_set_value(arg, chunk->values2, idx, rtpg_union_get_value(arg, chunk->values2, idx) + 1);
+					break;
+				case UT_RANGE:
+					if (!chunk->hasvalue[idx] || val > rtpg_union_get_value(arg, chunk->values, idx))
+						rtpg_union_set_value(arg, chunk->values, idx, val);
+					if (!chunk->hasvalue[idx] || val < rtpg_union_get_value(arg, chunk->values2, idx))
+						rtpg_union_set_value(arg, chunk->values2, idx, val);
+					break;
+				case UT_EXPRESSION:
+					/* positions are relative to the union so far */
+					rowval[0][x] = rtpg_union_get_value(arg, chunk->values, idx);
+					rowstatus[0][x] = chunk->hasvalue[idx] ? RT_MAPEXPR_OK : RT_MAPEXPR_NULL;
+					rowpos[0][0][x] = ext[0] + x - arg->extent[0] + 1;
+					rowpos[0][1][x] = ext[1] + y - arg->extent[1] + 1;
+					rowval[1][x] = val;
+					rowstatus[1][x] = RT_MAPEXPR_OK;
+					rowpos[1][0][x] = x + 1;
+					rowpos[1][1][x] = y + 1;
+
+					/* no value so far, take the tile's */
+					if (!chunk->hasvalue[idx])
+						rtpg_union_set_value(arg, chunk->values, idx, val);
+					/* evaluated for the whole row below */
+					else
+						continue;
+					break;
+			}
+
+			chunk->hasvalue[idx] = 1;
+		}
+
+		if (arg->uniontype != UT_EXPRESSION)
+			continue;
+
+		/* pixels with a value in both the union and the tile */
+		for (x = 0; x < width; x++) {
+			if (rowstatus[1][x] != RT_MAPEXPR_OK || rowstatus[0][x] != RT_MAPEXPR_OK) {
+				rowstatus[0][x] = RT_MAPEXPR_NULL;
+				rowval[0][x] = 0;
+				rowval[1][x] = 0;
+				rowpos[0][0][x] = ext[0] + x - arg->extent[0] + 1;
+				rowpos[0][1][x] = ext[1] + y - arg->extent[1] + 1;
+				rowpos[1][0][x] = x + 1;
+				rowpos[1][1][x] = y + 1;
+				rowstatus[1][x] = RT_MAPEXPR_NULL;
+			}
+		}
+
+		/* buffers of the expression must live as long as the aggregate */
+		oldcontext = MemoryContextSwitchTo(aggcontext);
+		i = rt_mapexpr_eval(arg->expr, width, mapvalues, mapstatus, rowresult, rowrstatus);
+		MemoryContextSwitchTo(oldcontext);
+		if (!i) {
+			elog(ERROR, "RASTER_union_transfn: Unable to evaluate expression");
+			rt_raster_destroy(raster);
+			PG_RETURN_NULL();
+		}
+
+		for (x = 0; x < width; x++) {
+			if (rowstatus[1][x] != RT_MAPEXPR_OK)
+				continue;
+
+			/* report the error as the executor would have */
+			if (rowrstatus[x] > RT_MAPEXPR_NULL) {
+				elog(ERROR, "%s", rt_mapexpr_status_message(rowrstatus[x]));
+				rt_raster_destroy(raster);
+				PG_RETURN_NULL();
+			}
+
+			chunk = rtpg_union_get_chunk(arg, ext[0] + x, ext[1] + y, TRUE, &idx);
+			if (rowrstatus[x] == RT_MAPEXPR_NULL)
+				chunk->hasvalue[idx] = 0;
+			else
+				rtpg_union_set_value(arg, chunk->values, idx, rowresult[x]);
+		}
+	}
+
+	if (arg->uniontype == UT_EXPRESSION) {
+		for (i = 0; i < 2; i++) {
+			pfree(rowval[i]);
+			pfree(rowstatus[i]);
+			pfree(rowpos[i][0]);
+			pfree(rowpos[i][1]);
+		}
+		pfree(rowresult);
+		pfree(rowrstatus);
+	}
+
+	rt_raster_destroy(raster);
+
+	POSTGIS_RT_DEBUG(3, "Finished RASTER_union_transfn");
+
+	PG_RETURN_POINTER(arg);
+}
+
+PG_FUNCTION_INFO_V1(RASTER_union_finalfn);
+Datum RASTER_union_finalfn(PG_FUNCTION_ARGS)
+{
+	rtpg_union_arg arg = NULL;
+	rt_raster raster = NULL;
+	rt_band band = NULL;
+	rt_pgraster *pgraster = NULL;
+	double gt[6] = {0.};
+	int width = 0;
+	int height = 0;
+	double val = 0;
+	rtpg_union_chunk chunk = NULL;
+	int idx = 0;
+	int x = 0;
+	int y = 0;
+
+	POSTGIS_RT_DEBUG(3, "Starting RASTER_union_finalfn");
+
+	/* no tile */
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	arg = (rtpg_union_arg) PG_GETARG_POINTER(0);
+
+	width = arg->extent[2] - arg->extent[0];
+	height = arg->extent[3] - arg->extent[1];
+
+	raster = rt_raster_new(width, height);
+	if (raster == NULL) {
+		elog(ERROR, "RASTER_union_finalfn: Unable to create the union raster");
+		PG_RETURN_NULL();
+	}
+
+	/* trim the canvas to the extent of the tiles */
+	rt_raster_get_geotransform_matrix(arg->canvas, gt);
+	if (!rt_raster_cell_to_geopoint(
+		arg->canvas,
+		arg->extent[0], arg->extent[1],
+		&(gt[0]), &(gt[3]),
+		NULL
+	)) {
+		elog(ERROR, "RASTER_union_finalfn: Unable to compute the upper-left corner of the union raster");
+		rt_raster_destroy(raster);
+		PG_RETURN_NULL();
+	}
+	rt_raster_set_geotransform_matrix(raster, gt);
+	rt_raster_set_srid(raster, rt_raster_get_srid(arg->canvas));
+
+	if (rt_raster_generate_new_band(
+		raster,
+		arg->pixtype, arg->nodataval,
+		1, arg->nodataval,
+		0
+	) < 0) {
+		elog(ERROR, "RASTER_union_finalfn: Unable to add band to the union raster");
+		rt_raster_destroy(raster);
+		PG_RETURN_NULL();
+	}
+
+	band = rt_raster_get_band(raster, 0);
+	if (band == NULL) {
+		elog(ERROR, "RASTER_union_finalfn: Unable to get band of the union raster");
+		rt_raster_destroy(raster);
+		PG_RETURN_NULL();
+	}
+
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++) {
+			chunk = rtpg_union_get_chunk(arg, arg->extent[0] + x, arg->extent[1] + y, FALSE, &idx);
+
+			/* pixels not covered by any tile have a count of zero */
+			if (chunk == NULL || !chunk->hasvalue[idx]) {
+				if (arg->uniontype != UT_COUNT)
+					continue;
+				val = 0;
+			}
+			else if (arg->uniontype == UT_MEAN)
+				val = rtpg_union_get_value(arg, chunk->values, idx) / rtpg_union_get_value(arg, chunk->values2, idx);
+			else if (arg->uniontype == UT_RANGE)
+				val = rtpg_union_get_value(arg, chunk->values, idx) - rtpg_union_get_value(arg, chunk->values2, idx);
+			else
+				val = rtpg_union_get_value(arg, chunk->values, idx);
+
+			if (rt_band_set_pixel(band, x, y, val) < 0) {
+				elog(ERROR, "RASTER_union_finalfn: Unable to set pixel value of the union raster");
+				rt_raster_destroy(raster);
+				PG_RETURN_NULL();
+			}
+		}
+	}
+
+	pgraster = rt_raster_serialize(raster);
+	rt_raster_destroy(raster);
+	if (!pgraster) PG_RETURN_NULL();
+
+	POSTGIS_RT_DEBUG(3, "Finished RASTER_union_finalfn");
+
+	SET_VARSIZE(pgraster, pgraster->size);
+	PG_RETURN_POINTER(pgraster);
+}
+
 /* ---------------------------------------------------------------- */
 /*  Memory allocation / error reporting hooks                       */
 /* ---------------------------------------------------------------- */
@@ -182,6 +182,14 @@ DROP FUNCTION IF EXISTS st_bandpixeltype(raster, integer);
 DROP AGGREGATE IF EXISTS ST_Union(raster);
 DROP AGGREGATE IF EXISTS ST_Union(raster, integer, text); 
 
+-- state and final functions replaced by C functions
+DROP FUNCTION IF EXISTS _ST_MapAlgebra4UnionState(raster, raster, text, text, text, double precision, text, text, text, double precision);
+DROP FUNCTION IF EXISTS _ST_MapAlgebra4UnionState(raster, raster, integer, text);
+DROP FUNCTION IF EXISTS _ST_MapAlgebra4UnionState(raster, raster, integer);
+DROP FUNCTION IF EXISTS _ST_MapAlgebra4UnionState(raster, raster);
+DROP FUNCTION IF EXISTS _ST_MapAlgebra4UnionState(raster, raster, text);
+DROP FUNCTION IF EXISTS _ST_MapAlgebra4UnionFinal1(raster);
+
 -- function no longer exists
 DROP FUNCTION IF EXISTS st_value(raster, integer, integer, integer);
 DROP FUNCTION IF EXISTS st_value(raster, integer, integer);
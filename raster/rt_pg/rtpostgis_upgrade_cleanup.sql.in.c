@@ -98,3 +98,18 @@ CREATE OR REPLACE FUNCTION box3d(raster)
 CREATE CAST (raster AS box3d)
     WITH FUNCTION box3d(raster) AS IMPLICIT;
 #endif
+
+-- add binary input/output to the raster type, CREATE TYPE cannot be rerun
+-- and ALTER TYPE cannot set them, so the catalog is updated directly
+CREATE OR REPLACE FUNCTION raster_recv(internal)
+    RETURNS raster
+    AS 'MODULE_PATHNAME','RASTER_recv'
+    LANGUAGE 'C' IMMUTABLE STRICT;
+CREATE OR REPLACE FUNCTION raster_send(raster)
+    RETURNS bytea
+    AS 'MODULE_PATHNAME','RASTER_send'
+    LANGUAGE 'C' IMMUTABLE STRICT;
+UPDATE pg_type SET
+	typreceive = 'raster_recv'::regproc,
+	typsend = 'raster_send'::regproc
+	WHERE typname = 'raster' AND typreceive = 0;
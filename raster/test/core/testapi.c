@@ -1023,8 +1023,12 @@ static void testBandStats() {
 	int rtn;
 
 	uint32_t values[] = {0, 91, 55, 86, 76, 41, 36, 97, 25, 63, 68, 2, 78, 15, 82, 47};
-	struct quantile_llist *qlls = NULL;
-	uint32_t qlls_count;
+	rt_statsagg agg = NULL;
+	rt_statsagg agg2 = NULL;
+	rt_bandstats stats2 = NULL;
+	rt_quantile quantile2 = NULL;
+	void *serialized = NULL;
+	uint32_t serialized_size;
 
 	raster = rt_raster_new(xmax, ymax);
 	assert(raster);
@@ -1139,19 +1143,70 @@ static void testBandStats() {
 	nodata = rt_band_get_nodata(band);
 	CHECK_EQUALS(nodata, 0);
 
-	quantile = (rt_quantile) rt_band_get_quantiles_stream(
-		band, 1, 1, 15,
-		&qlls, &qlls_count,
-		quantiles2, 1,
-		&count);
+	agg = rt_statsagg_new(1, 0);
+	CHECK(agg);
+	rtn = rt_statsagg_add_band(agg, band, 1, 1);
+	CHECK(rtn);
+
+	quantile = (rt_quantile) rt_statsagg_get_quantiles(agg, quantiles2, 1, &count);
+	CHECK(quantile);
+	CHECK((count == 1));
+	CHECK((fabs(quantile[0].value - 76.667) < 0.001));
+	rtdealloc(quantile);
+
+	/* same band twice, same quantiles */
+	agg2 = rt_statsagg_new(1, 0);
+	CHECK(agg2);
+	rtn = rt_statsagg_add_band(agg2, band, 1, 1);
+	CHECK(rtn);
+	rtn = rt_statsagg_merge(agg2, agg);
+	CHECK(rtn);
+
+	stats = rt_statsagg_get_summary_stats(agg);
+	CHECK(stats);
+	CHECK((stats->count == 15));
+	CHECK_EQUALS(stats->min, 2);
+	CHECK_EQUALS(stats->max, 97);
+
+	stats2 = rt_statsagg_get_summary_stats(agg2);
+	CHECK(stats2);
+	CHECK((stats2->count == 30));
+	CHECK_EQUALS(stats2->sum, stats->sum * 2);
+	CHECK((fabs(stats2->mean - stats->mean) < 0.000001));
+	CHECK((fabs(stats2->stddev - stats->stddev) < 0.000001));
+	rtdealloc(stats2);
+
+	quantile = (rt_quantile) rt_statsagg_get_quantiles(agg2, NULL, 0, &count);
+	CHECK(quantile);
+	CHECK((count == 5));
+	CHECK_EQUALS(quantile[0].value, 2);
+	CHECK_EQUALS(quantile[2].value, 63);
+	CHECK_EQUALS(quantile[4].value, 97);
+	rtdealloc(quantile);
+
+	/* serialize round-trip */
+	serialized = rt_statsagg_serialize(agg2, &serialized_size);
+	CHECK(serialized);
+	rt_statsagg_destroy(agg2);
+	agg2 = rt_statsagg_deserialize(serialized, serialized_size);
+	CHECK(agg2);
+	rtdealloc(serialized);
+
+	stats2 = rt_statsagg_get_summary_stats(agg2);
+	CHECK(stats2);
+	CHECK((stats2->count == 30));
+	CHECK((fabs(stats2->mean - stats->mean) < 0.000001));
+	rtdealloc(stats2);
+
+	quantile = (rt_quantile) rt_statsagg_get_quantiles(agg2, quantiles2, 1, &count);
 	CHECK(quantile);
-	CHECK(count);
-	CHECK((qlls_count > 0));
-	CHECK(FLT_EQ(quantile[0].value, 78));
+	CHECK((count == 1));
+	CHECK((fabs(quantile[0].value - 76.667) < 0.001));
 	rtdealloc(quantile);
-	quantile_llist_destroy(&qlls, qlls_count);
-	qlls = NULL;
-	qlls_count = 0;
+
+	rtdealloc(stats);
+	rt_statsagg_destroy(agg2);
+	rt_statsagg_destroy(agg);
 
 	deepRelease(raster);
 
@@ -1173,22 +1228,53 @@ static void testBandStats() {
 	nodata = rt_band_get_nodata(band);
 	CHECK_EQUALS(nodata, 0);
 
+	/* exact values against a small sketch */
+	agg = rt_statsagg_new(1, 0);
+	CHECK(agg);
+	agg2 = rt_statsagg_new(1, 256);
+	CHECK(agg2);
+
 	max_run = 5;
 	for (x = 0; x < max_run; x++) {
-		quantile = (rt_quantile) rt_band_get_quantiles_stream(
-			band, 1, 1, xmax * ymax * max_run,
-			&qlls, &qlls_count,
-			quantiles2, 1,
-			&count);
-		CHECK(quantile);
-		CHECK(count);
-		CHECK((qlls_count > 0));
-		rtdealloc(quantile);
+		rtn = rt_statsagg_add_band(agg, band, 1, 1);
+		CHECK(rtn);
+		rtn = rt_statsagg_add_band(agg2, band, 1, 1);
+		CHECK(rtn);
 	}
 
-	quantile_llist_destroy(&qlls, qlls_count);
-	qlls = NULL;
-	qlls_count = 0;
+	stats = rt_statsagg_get_summary_stats(agg);
+	CHECK(stats);
+	stats2 = rt_statsagg_get_summary_stats(agg2);
+	CHECK(stats2);
+	CHECK((stats->count == (xmax * ymax - 1) * max_run));
+	CHECK((stats2->count == stats->count));
+	CHECK_EQUALS(stats2->min, stats->min);
+	CHECK_EQUALS(stats2->max, stats->max);
+	CHECK((fabs(stats2->mean - stats->mean) < 0.000001));
+
+	quantile = (rt_quantile) rt_statsagg_get_quantiles(agg, quantiles, 5, &count);
+	CHECK(quantile);
+	CHECK((count == 5));
+	quantile2 = (rt_quantile) rt_statsagg_get_quantiles(agg2, quantiles, 5, &count);
+	CHECK(quantile2);
+	CHECK((count == 5));
+	for (x = 0; x < count; x++)
+		CHECK((fabs(quantile2[x].value - quantile[x].value) < (stats->max - stats->min) * 0.05));
+	rtdealloc(quantile2);
+	rtdealloc(quantile);
+
+	histogram = (rt_histogram) rt_statsagg_get_histogram(agg2, 10, NULL, 0, 0, 0, 0, &count);
+	CHECK(histogram);
+	CHECK((count == 10));
+	for (x = 0, y = 0; x < count; x++)
+		y += histogram[x].count;
+	CHECK((y == stats->count));
+	rtdealloc(histogram);
+
+	rtdealloc(stats2);
+	rtdealloc(stats);
+	rt_statsagg_destroy(agg2);
+	rt_statsagg_destroy(agg);
 
 	deepRelease(raster);
 }
@@ -2269,6 +2355,289 @@ static void testLoadOfflineBand() {
 	deepRelease(rast);
 }
 
+static void testPixelLine() {
+	rt_raster rast;
+	rt_band band;
+	const int maxX = 5;
+	const int maxY = 4;
+	int16_t *line;
+	double vals[5];
+	double in[5] = {-40000, -1.7, 0, 12.9, 40000};
+	int16_t out[5];
+	uint8_t out8[5];
+	float outf[5];
+	int rtn;
+	int x;
+	int y;
+	double val;
+
+	rast = rt_raster_new(maxX, maxY);
+	assert(rast);
+	band = addBand(rast, PT_16BSI, 0, 0);
+	CHECK(band);
+
+	for (y = 0; y < maxY; y++) {
+		for (x = 0; x < maxX; x++)
+			rt_band_set_pixel(band, x, y, (y * 10) - x);
+	}
+
+	/* a row is the band's data as is */
+	line = rt_band_get_pixel_line(band, 0, 2, maxX);
+	CHECK(line);
+	for (x = 0; x < maxX; x++)
+		CHECK_EQUALS(line[x], 20 - x);
+
+	/* a line may go on to the next rows */
+	line = rt_band_get_pixel_line(band, 3, 1, 4);
+	CHECK(line);
+	rtn = rt_pixtype_to_double(PT_16BSI, line, 4, vals);
+	CHECK(rtn);
+	for (x = 0; x < 4; x++) {
+		rt_band_get_pixel(band, (3 + x) % maxX, 1 + (3 + x) / maxX, &val);
+		CHECK(FLT_EQ(vals[x], val));
+	}
+
+	/* values are clamped as rt_band_set_pixel does */
+	rtn = rt_pixtype_from_double(PT_16BSI, in, 5, out);
+	CHECK(rtn);
+	CHECK_EQUALS(out[0], -32768);
+	CHECK_EQUALS(out[1], -1);
+	CHECK_EQUALS(out[2], 0);
+	CHECK_EQUALS(out[3], 12);
+	CHECK_EQUALS(out[4], 32767);
+
+	rtn = rt_pixtype_from_double(PT_8BUI, in, 5, out8);
+	CHECK(rtn);
+	CHECK_EQUALS(out8[0], 0);
+	CHECK_EQUALS(out8[1], 0);
+	CHECK_EQUALS(out8[3], 12);
+	CHECK_EQUALS(out8[4], 255);
+
+	rtn = rt_pixtype_from_double(PT_32BF, in, 5, outf);
+	CHECK(rtn);
+	rtn = rt_pixtype_to_double(PT_32BF, outf, 5, vals);
+	CHECK(rtn);
+	CHECK(FLT_EQ(vals[1], -1.7));
+	CHECK(FLT_EQ(vals[4], 40000));
+
+	/* round trip through rt_band_set_pixel_line */
+	rtn = rt_band_set_pixel_line(band, 0, 3, out, maxX);
+	CHECK(rtn);
+	for (x = 0; x < maxX; x++) {
+		rt_band_get_pixel(band, x, 3, &val);
+		CHECK(FLT_EQ(val, out[x]));
+	}
+
+	deepRelease(rast);
+}
+
+static void testCachedStats() {
+	rt_raster rast;
+	rt_raster rast2;
+	rt_band band;
+	struct rt_cachedstats_t cached;
+	rt_statsagg agg;
+	rt_statsagg agg2;
+	rt_bandstats stats;
+	rt_bandstats stats2;
+	void *serialized;
+	const int maxX = 5;
+	const int maxY = 4;
+	int exclude;
+	int rtn;
+	int x;
+	int y;
+
+	rast = rt_raster_new(maxX, maxY);
+	assert(rast);
+	band = addBand(rast, PT_16BSI, 1, -1);
+	CHECK(band);
+
+	/* one pixel is nodata */
+	for (y = 0; y < maxY; y++) {
+		for (x = 0; x < maxX; x++)
+			rt_band_set_pixel(band, x, y, (y * 10) - x);
+	}
+	CHECK(!rt_band_get_cached_stats(band, &cached));
+
+	rtn = rt_raster_compute_cached_stats(rast);
+	CHECK(rtn);
+	rtn = rt_band_get_cached_stats(band, &cached);
+	CHECK(rtn);
+	CHECK_EQUALS(cached.count, 19);
+	CHECK_EQUALS(cached.nodata_count, 1);
+	CHECK(FLT_EQ(cached.min, -4));
+	CHECK(FLT_EQ(cached.max, 30));
+	CHECK(FLT_EQ(cached.mean, 261. / 19));
+	CHECK(FLT_EQ(cached.nodataval, -1));
+
+	/* the statistics go with the serialized raster */
+	serialized = rt_raster_serialize(rast);
+	CHECK(serialized);
+
+	rast2 = rt_raster_deserialize(serialized, FALSE);
+	CHECK(rast2);
+	rtn = rt_raster_get_cached_stats(rast2, 0, &cached);
+	CHECK(rtn);
+	CHECK_EQUALS(cached.count, 19);
+	CHECK(FLT_EQ(cached.mean, 261. / 19));
+	rt_band_destroy(rt_raster_get_band(rast2, 0));
+	rt_raster_destroy(rast2);
+
+	/* and can be read without the bands */
+	rast2 = rt_raster_deserialize(serialized, TRUE);
+	CHECK(rast2);
+	CHECK(!rt_raster_get_cached_stats(rast2, 0, &cached));
+	CHECK_EQUALS(
+		rt_raster_serialized_header_size(rast2),
+		sizeof(struct rt_raster_serialized_t) + sizeof(struct rt_cachedstats_t)
+	);
+	rtn = rt_raster_deserialize_cached_stats(rast2, serialized);
+	CHECK(rtn);
+	rtn = rt_raster_get_cached_stats(rast2, 0, &cached);
+	CHECK(rtn);
+	CHECK_EQUALS(cached.nodata_count, 1);
+	CHECK(FLT_EQ(cached.max, 30));
+	CHECK(!rt_raster_get_cached_stats(rast2, 1, &cached));
+	rt_raster_destroy(rast2);
+	rtdealloc(serialized);
+
+	/* same summary statistics with and without the cache */
+	for (exclude = 0; exclude < 2; exclude++) {
+		agg = rt_statsagg_new(0, 0);
+		CHECK(agg);
+		rtn = rt_statsagg_add_cached_stats(agg, &cached, exclude);
+		CHECK(rtn);
+		agg2 = rt_statsagg_new(1, 0);
+		CHECK(agg2);
+		rtn = rt_statsagg_add_band(agg2, band, exclude, 1);
+		CHECK(rtn);
+
+		stats = rt_statsagg_get_summary_stats(agg);
+		CHECK(stats);
+		stats2 = rt_statsagg_get_summary_stats(agg2);
+		CHECK(stats2);
+		CHECK_EQUALS(stats->count, stats2->count);
+		CHECK(FLT_EQ(stats->min, stats2->min));
+		CHECK(FLT_EQ(stats->max, stats2->max));
+		CHECK(FLT_EQ(stats->mean, stats2->mean));
+		CHECK(FLT_EQ(stats->stddev, stats2->stddev));
+
+		rtdealloc(stats2);
+		rtdealloc(stats);
+		rt_statsagg_destroy(agg2);
+		rt_statsagg_destroy(agg);
+	}
+
+	/* changing a pixel drops the statistics */
+	rt_band_set_pixel(band, 0, 0, 100);
+	CHECK(!rt_band_get_cached_stats(band, &cached));
+	serialized = rt_raster_serialize(rast);
+	CHECK(serialized);
+	rast2 = rt_raster_deserialize(serialized, TRUE);
+	CHECK(rast2);
+	CHECK_EQUALS(
+		rt_raster_serialized_header_size(rast2),
+		sizeof(struct rt_raster_serialized_t)
+	);
+	CHECK(!rt_raster_deserialize_cached_stats(rast2, serialized));
+	rt_raster_destroy(rast2);
+	rtdealloc(serialized);
+
+	deepRelease(rast);
+}
+
+static void testMapExpr() {
+	rt_mapexpr expr;
+	double val[3] = {5, 0, -2};
+	double pos[3] = {1, 2, 3};
+	double val2[3] = {2, 4, 0};
+	uint8_t valstatus[3] = {RT_MAPEXPR_OK, RT_MAPEXPR_OK, RT_MAPEXPR_NULL};
+	double *values[RT_MAPEXPR_NVARS] = {NULL};
+	uint8_t *status[RT_MAPEXPR_NVARS] = {NULL};
+	double result[3];
+	uint8_t rstatus[3];
+	int rtn;
+
+	values[RT_MAPEXPR_VAL1] = val;
+	values[RT_MAPEXPR_X1] = pos;
+	values[RT_MAPEXPR_Y1] = pos;
+	values[RT_MAPEXPR_VAL2] = val2;
+	values[RT_MAPEXPR_X2] = pos;
+	values[RT_MAPEXPR_Y2] = pos;
+
+	/* unsupported expressions are left to the caller */
+	CHECK(!rt_mapexpr_compile("g from (select NULL as g) as foo", 1));
+	CHECK(!rt_mapexpr_compile("[rast] > 0", 1));
+	CHECK(!rt_mapexpr_compile("random() * [rast]", 1));
+	CHECK(!rt_mapexpr_compile("[rast1]", 1));
+	CHECK(!rt_mapexpr_compile("[rast] -- comment", 1));
+	CHECK(!rt_mapexpr_compile("1 / 0 + [rast]", 1));
+
+	/* rounding of double precision */
+	expr = rt_mapexpr_compile("round([rast] * [rast.x] / [rast.y] + [rast.val])", 1);
+	CHECK(expr);
+	CHECK(rt_mapexpr_has_var(expr, RT_MAPEXPR_VAL1));
+	CHECK(rt_mapexpr_has_var(expr, RT_MAPEXPR_X1));
+	CHECK(!rt_mapexpr_has_var(expr, RT_MAPEXPR_VAL2));
+	rtn = rt_mapexpr_eval(expr, 3, values, status, result, rstatus);
+	CHECK(rtn);
+	CHECK((rstatus[0] == RT_MAPEXPR_OK));
+	CHECK(FLT_EQ(result[0], 10.));
+	CHECK(FLT_EQ(result[1], 0.));
+	CHECK(FLT_EQ(result[2], -4.));
+	rt_mapexpr_destroy(expr);
+
+	/* errors and NULLs only for the pixels using them */
+	status[RT_MAPEXPR_VAL1] = valstatus;
+	expr = rt_mapexpr_compile("CASE WHEN [rast] IS NULL THEN -1 ELSE 10 / [rast] END", 1);
+	CHECK(expr);
+	rtn = rt_mapexpr_eval(expr, 3, values, status, result, rstatus);
+	CHECK(rtn);
+	CHECK((rstatus[0] == RT_MAPEXPR_OK));
+	CHECK(FLT_EQ(result[0], 2.));
+	CHECK((rstatus[1] == RT_MAPEXPR_ERR_DIVZERO));
+	CHECK(!strcmp(rt_mapexpr_status_message(rstatus[1]), "division by zero"));
+	CHECK((rstatus[2] == RT_MAPEXPR_OK));
+	CHECK(FLT_EQ(result[2], -1.));
+	rt_mapexpr_destroy(expr);
+
+	expr = rt_mapexpr_compile("[rast] + 1", 1);
+	CHECK(expr);
+	rtn = rt_mapexpr_eval(expr, 3, values, status, result, rstatus);
+	CHECK(rtn);
+	CHECK((rstatus[2] == RT_MAPEXPR_NULL));
+	rt_mapexpr_destroy(expr);
+	status[RT_MAPEXPR_VAL1] = NULL;
+
+	/* positions are integers with two rasters */
+	expr = rt_mapexpr_compile("[rast1.x] / 2 + [rast2.val]::integer % 3", 2);
+	CHECK(expr);
+	rtn = rt_mapexpr_eval(expr, 3, values, status, result, rstatus);
+	CHECK(rtn);
+	CHECK(FLT_EQ(result[0], 2.));
+	CHECK(FLT_EQ(result[1], 2.));
+	CHECK(FLT_EQ(result[2], 1.));
+	rt_mapexpr_destroy(expr);
+
+	expr = rt_mapexpr_compile("LEAST([rast1.val], [rast2.val]) + power(2, 3) - mod(7, 4)", 2);
+	CHECK(expr);
+	rtn = rt_mapexpr_eval(expr, 3, values, status, result, rstatus);
+	CHECK(rtn);
+	CHECK(FLT_EQ(result[0], 7.));
+	CHECK(FLT_EQ(result[1], 5.));
+	CHECK(FLT_EQ(result[2], 3.));
+	rt_mapexpr_destroy(expr);
+
+	/* integer overflow */
+	expr = rt_mapexpr_compile("2147483647 + [rast1.x]", 2);
+	CHECK(expr);
+	rtn = rt_mapexpr_eval(expr, 3, values, status, result, rstatus);
+	CHECK(rtn);
+	CHECK((rstatus[0] == RT_MAPEXPR_ERR_INTRANGE));
+	rt_mapexpr_destroy(expr);
+}
+
 int
 main()
 {
@@ -2722,6 +3091,18 @@ main()
 		testLoadOfflineBand();
 		printf("Successfully tested rt_raster_load_offline_band\n");
 
+		printf("Testing rt_mapexpr\n");
+		testMapExpr();
+		printf("Successfully tested rt_mapexpr\n");
+
+		printf("Testing rt_band_get_pixel_line\n");
+		testPixelLine();
+		printf("Successfully tested rt_band_get_pixel_line\n");
+
+		printf("Testing band cached stats\n");
+		testCachedStats();
+		printf("Successfully tested band cached stats\n");
+
     deepRelease(raster);
 
     return EXIT_SUCCESS;
@@ -0,0 +1,107 @@
+BEGIN;
+CREATE TEMP TABLE test_computestats
+	ON COMMIT DROP AS
+	SELECT
+		id,
+		rast.rast AS orig,
+		rast.rast
+	FROM (
+		SELECT ST_SetValue(
+			ST_SetValue(
+				ST_SetValue(
+					ST_AddBand(
+						ST_MakeEmptyRaster(10, 10, 10, 10, 2, 2, 0, 0,0)
+						, 1, '64BF', 0, 0
+					)
+					, 1, 1, 1, -10
+				)
+				, 1, 5, 4, 0
+			)
+			, 1, 5, 5, 3.14159
+		) AS rast
+	) AS rast
+	FULL JOIN (
+		SELECT generate_series(1, 10) AS id
+	) AS id
+		ON 1 = 1;
+-- coverage without cached statistics
+SELECT
+	count,
+	round(sum::numeric, 3),
+	round(mean::numeric, 3),
+	round(stddev::numeric, 3),
+	round(min::numeric, 3),
+	round(max::numeric, 3)
+FROM ST_SummaryStats('test_computestats', 'rast', 1, TRUE);
+SELECT
+	count,
+	round(sum::numeric, 3),
+	round(mean::numeric, 3),
+	round(stddev::numeric, 3),
+	round(min::numeric, 3),
+	round(max::numeric, 3)
+FROM ST_SummaryStats('test_computestats', 'rast', 1, FALSE);
+-- statistics of the single band take 48 bytes after the header
+SELECT pg_column_size(ST_ComputeStats(orig)) - pg_column_size(orig) FROM test_computestats WHERE id = 1;
+UPDATE test_computestats SET rast = ST_ComputeStats(rast);
+-- stored and read back with the statistics
+SELECT
+	pg_column_size(rast) - pg_column_size(orig),
+	pg_column_size(ST_ComputeStats(rast)) - pg_column_size(rast),
+	ST_AsBinary(rast) = ST_AsBinary(orig),
+	round(ST_Value(rast, 1, 5, 5)::numeric, 3),
+	ST_Value(rast, 1, 5, 4) IS NULL
+FROM test_computestats WHERE id = 1;
+SELECT
+	count,
+	round(sum::numeric, 3),
+	round(mean::numeric, 3),
+	round(stddev::numeric, 3),
+	round(min::numeric, 3),
+	round(max::numeric, 3)
+FROM ST_SummaryStats((SELECT rast FROM test_computestats WHERE id = 1), 1, TRUE);
+-- changing a value or the nodata value drops the statistics
+SELECT
+	pg_column_size(ST_SetValue(rast, 1, 2, 2, 5)) - pg_column_size(orig),
+	pg_column_size(ST_SetBandNoDataValue(rast, 1, -10)) - pg_column_size(orig)
+FROM test_computestats WHERE id = 1;
+SELECT
+	count,
+	round(sum::numeric, 3),
+	round(min::numeric, 3),
+	round(max::numeric, 3)
+FROM ST_SummaryStats((SELECT ST_SetValue(rast, 1, 2, 2, 5) FROM test_computestats WHERE id = 1), 1, TRUE);
+SELECT
+	count,
+	round(sum::numeric, 3),
+	round(min::numeric, 3),
+	round(max::numeric, 3)
+FROM ST_SummaryStats((SELECT ST_SetBandNoDataValue(rast, 1, -10) FROM test_computestats WHERE id = 1), 1, TRUE);
+-- coverage read from the statistics only, same results as above
+SELECT
+	count,
+	round(sum::numeric, 3),
+	round(mean::numeric, 3),
+	round(stddev::numeric, 3),
+	round(min::numeric, 3),
+	round(max::numeric, 3)
+FROM ST_SummaryStats('test_computestats', 'rast', 1, TRUE);
+SELECT
+	count,
+	round(sum::numeric, 3),
+	round(mean::numeric, 3),
+	round(stddev::numeric, 3),
+	round(min::numeric, 3),
+	round(max::numeric, 3)
+FROM ST_SummaryStats('test_computestats', 'rast', 1, FALSE);
+-- some tiles with statistics, some without
+UPDATE test_computestats SET rast = orig WHERE id > 5;
+SELECT
+	count,
+	round(sum::numeric, 3),
+	round(mean::numeric, 3),
+	round(stddev::numeric, 3),
+	round(min::numeric, 3),
+	round(max::numeric, 3)
+FROM ST_SummaryStats('test_computestats', 'rast', 1, FALSE);
+ROLLBACK;
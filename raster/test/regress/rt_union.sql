@@ -14,3 +14,33 @@ SELECT '#2 ' As run, ST_AsText((gval).geom), (gval).val::text
 						'8BUI'::text, 10*i, 0)  As rast
                            FROM generate_series(0,10) As i ) As foo ) As foofoo
                        ORDER BY (gval).val LIMIT 2;
+
+CREATE TEMP TABLE raster_union_tiles AS
+	SELECT i As rid, ST_AddBand(
+		ST_MakeEmptyRaster(10, 10, 10*i, 10*i, 2, 2, 0, 0, ST_SRID(ST_Point(0,0) )),
+		'8BUI'::text, 10*i, 255) As rast
+	FROM generate_series(1,3) As i;
+
+SELECT '#3 ' As run, uniontype, ST_Width(rast), ST_Height(rast),
+	ST_Value(rast, 1, 1), ST_Value(rast, 6, 6), ST_Value(rast, 11, 11), ST_Value(rast, 16, 16), ST_Value(rast, 1, 20)
+	FROM (
+		SELECT 'LAST'::text As uniontype, ST_Union(rast, 'LAST') As rast FROM raster_union_tiles
+		UNION ALL
+		SELECT 'FIRST'::text, ST_Union(rast, 'FIRST') FROM raster_union_tiles
+		UNION ALL
+		SELECT 'MIN'::text, ST_Union(rast, 'MIN') FROM raster_union_tiles
+		UNION ALL
+		SELECT 'MAX'::text, ST_Union(rast, 1, 'MAX') FROM raster_union_tiles
+		UNION ALL
+		SELECT 'COUNT'::text, ST_Union(rast, 'COUNT') FROM raster_union_tiles
+		UNION ALL
+		SELECT 'SUM'::text, ST_Union(rast, 'sum') FROM raster_union_tiles
+		UNION ALL
+		SELECT 'MEAN'::text, ST_Union(rast, 'MEAN') FROM raster_union_tiles
+		UNION ALL
+		SELECT 'RANGE'::text, ST_Union(rast, 'RANGE') FROM raster_union_tiles
+		UNION ALL
+		SELECT 'EXPRESSION'::text, ST_Union(rast, '[rast1.val] * 2 + [rast2.val]') FROM raster_union_tiles
+	) As foo;
+
+DROP TABLE raster_union_tiles;
@@ -19,6 +19,28 @@ select 'ST_MakeLine_agg1', ST_AsText(ST_MakeLine(g)) from (
         ('POINT(40 4)')
 ) as foo(g);
 
+select 'ST_MakeLine_agg2', ST_AsText(ST_MakeLine(g::geometry)) from (
+ values ('POINT(0 0)'),
+        (NULL),
+        ('POINT(1 1 1)'),
+        ('POINT(2 2)')
+) as foo(g);
+
+select 'ST_Collect_agg1', ST_AsText(ST_Collect(g::geometry)) from (
+ values ('POINT(0 0)'),
+        (NULL),
+        ('POINT(1 1)')
+) as foo(g);
+
+select 'ST_Collect_agg2', ST_AsText(ST_Collect(g::geometry)) from (
+ values ('POINT(0 0)'),
+        ('LINESTRING(1 1, 2 2)')
+) as foo(g);
+
+select 'ST_Collect_agg3', ST_Collect(g) IS NULL from (
+ values (NULL::geometry)
+) as foo(g);
+
 -- postgis-users/2006-July/012788.html
 select ST_makebox2d('SRID=3;POINT(0 0)', 'SRID=3;POINT(1 1)');
 select ST_makebox2d('POINT(0 0)', 'SRID=3;POINT(1 1)');
@@ -0,0 +1,34 @@
+-- Exact nearest neighbours with ST_KNearest
+
+CREATE TABLE knn_lines (id integer, g geometry);
+INSERT INTO knn_lines SELECT i, ST_MakeLine(ST_MakePoint(i, 0), ST_MakePoint(i, 2 * i)) FROM generate_series(0, 99) i;
+INSERT INTO knn_lines VALUES (100, NULL);
+INSERT INTO knn_lines VALUES (101, 'LINESTRING EMPTY');
+
+-- Same distances, in the same order, as a full sort on ST_Distance
+SELECT 'knn1', (SELECT array_agg(round(ST_Distance(g, 'POINT(0 200)')::numeric, 6)) FROM ST_KNearest(NULL::knn_lines, 'g', 'POINT(0 200)', 5)) =
+               (SELECT array_agg(d) FROM (SELECT round(ST_Distance(g, 'POINT(0 200)')::numeric, 6) AS d FROM knn_lines WHERE g IS NOT NULL ORDER BY d LIMIT 5) s);
+
+CREATE INDEX knn_lines_gist ON knn_lines USING GIST (g);
+
+SELECT 'knn2', (SELECT array_agg(round(ST_Distance(g, 'POINT(0 200)')::numeric, 6)) FROM ST_KNearest(NULL::knn_lines, 'g', 'POINT(0 200)', 5)) =
+               (SELECT array_agg(d) FROM (SELECT round(ST_Distance(g, 'POINT(0 200)')::numeric, 6) AS d FROM knn_lines WHERE g IS NOT NULL ORDER BY d LIMIT 5) s);
+
+-- NULL and empty geometries are never returned
+SELECT 'knn3', count(*) FROM ST_KNearest(NULL::knn_lines, 'g', 'POINT(0 200)', 1000);
+
+SELECT 'knn4', count(*) FROM ST_KNearest(NULL::knn_lines, 'g', 'POINT(0 200)', 0);
+
+-- The first argument names the table
+SELECT 'knn5', count(*) FROM ST_KNearest(NULL::integer, 'g', 'POINT(0 200)', 5);
+
+-- k is bounded
+SELECT 'knn6', count(*) FROM ST_KNearest(NULL::knn_lines, 'g', 'POINT(0 200)', 1000000);
+
+DROP TABLE knn_lines;
+
+-- Long quoted column names
+CREATE TABLE knn_quoted (id integer, "A ""quoted"" geometry column with a name as long as names can go" geometry);
+INSERT INTO knn_quoted VALUES (1, 'POINT(0 0)'), (2, 'POINT(5 5)');
+SELECT 'knn7', id FROM ST_KNearest(NULL::knn_quoted, 'A "quoted" geometry column with a name as long as names can go', 'POINT(4 4)', 1);
+DROP TABLE knn_quoted;
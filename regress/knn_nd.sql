@@ -0,0 +1,30 @@
+-- N-D and geography box distances, and the index scans ordered by them
+
+SELECT 'ndist1', 'POINT(0 0 0)'::geometry <<->> 'POINT(3 4 12)'::geometry;
+SELECT 'ndist2', 'POINT(0 0)'::geometry <<->> 'POINT(3 4 12)'::geometry;
+SELECT 'ndist3', 'LINESTRING(0 0 0,1 1 1)'::geometry <<->> 'POINT(1 1 3)'::geometry;
+SELECT 'ndist4', 'LINESTRING(0 0 0,2 2 2)'::geometry <<->> 'POINT(1 1 1)'::geometry;
+
+SELECT 'gdist1', round(('POINT(0 0)'::geography <-> 'POINT(0 1)'::geography)::numeric / 1000);
+SELECT 'gdist2', round(('POINT(0 0)'::geography <-> 'POINT(180 0)'::geography)::numeric / 1000);
+SELECT 'gdist3', 'POINT(0 0)'::geography <-> 'LINESTRING(-1 0,1 0)'::geography;
+
+-- A column of points that only differ in Z
+CREATE TABLE knn_nd_points (id integer, g geometry);
+INSERT INTO knn_nd_points SELECT i, ST_MakePoint(0, 0, i) FROM generate_series(1, 1000) i;
+CREATE INDEX knn_nd_points_gist ON knn_nd_points USING GIST (g gist_geometry_ops_nd);
+
+SELECT 'ndknn1', array_agg(id) FROM (SELECT id FROM knn_nd_points ORDER BY g <<->> 'POINT(0 0 500.2)'::geometry LIMIT 3) s;
+
+DROP TABLE knn_nd_points;
+
+-- Points along the equator, and one north of them
+CREATE TABLE knn_geog_points (id integer, g geography);
+INSERT INTO knn_geog_points SELECT i, ST_MakePoint(i / 10.0, 0) FROM generate_series(-900, 900) i;
+INSERT INTO knn_geog_points VALUES (10000, 'POINT(10.04 0.01)');
+CREATE INDEX knn_geog_points_gist ON knn_geog_points USING GIST (g);
+
+SELECT 'gknn1', array_agg(id) FROM (SELECT id FROM knn_geog_points ORDER BY g <-> 'POINT(10.04 0)'::geography LIMIT 3) s;
+SELECT 'gknn2', array_agg(id) FROM (SELECT id FROM knn_geog_points ORDER BY g <-> 'POINT(10.04 0.005)'::geography LIMIT 2) s;
+
+DROP TABLE knn_geog_points;
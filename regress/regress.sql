@@ -280,6 +280,24 @@ select '179', ST_AsText('MULTICURVE EMPTY');
 select '180', ST_AsText('GEOMETRYCOLLECTION EMPTY');
 select '181', ST_AsText('GEOMETRYCOLLECTION(TRIANGLE EMPTY,TIN EMPTY)');
 
+--- Hilbert curve btree operator class
+-- The default = keeps its tolerance, #= compares the boxes exactly
+select '182', 'POINT(0 0)'::geometry = 'POINT(0 0.0000001)'::geometry, 'POINT(0 0)'::geometry #= 'POINT(0 0.0000001)'::geometry;
+select '183', 'LINESTRING(0 0,1 1)'::geometry #= 'LINESTRING(0 1,1 0)'::geometry, 'POINT(0 0)'::geometry #< 'POINT(1 0)'::geometry, 'POINT(0 1)'::geometry #> 'POINT(1 1)'::geometry;
+-- Default ordering is by box corners, #< follows the curve (empties first)
+select '184', array_to_string(array(select ST_AsText(g) from (values ('POINT(0 0)'::geometry),('POINT(1 1)'),('POINT(1 0)'),('POINT(0 1)'),('POINT(2 0)'),('POINT(0 2)'),('POINT(-1 1)'),('POINT(1 -1)')) as t(g) order by g), ',');
+select '185', array_to_string(array(select ST_AsText(g) from (values ('POINT(0 0)'::geometry),('POINT(1 1)'),('POINT(1 0)'),('POINT(0 1)'),('POINT(2 0)'),('POINT(0 2)'),('POINT(-1 1)'),('POINT(1 -1)'),('POINT EMPTY')) as t(g) order by g using #<), ',');
+select '186', array_to_string(array(select ST_AsText(g) from (values ('POINT(0 0)'::geometry),('POINT(1 1)'),('POINT(1 0)'),('POINT(0 1)'),('POINT(2 0)'),('POINT(0 2)'),('POINT(-1 1)'),('POINT(1 -1)')) as t(g) order by ST_HilbertKey(g)), ',');
+create table test_hilbert (g geometry);
+insert into test_hilbert select ST_MakePoint(x, y) from generate_series(0, 9) x, generate_series(0, 9) y;
+create index test_hilbert_idx on test_hilbert (g btree_geometry_hilbert_ops);
+set enable_seqscan = off;
+select '187', count(*) from test_hilbert where g #= 'POINT(3 4)';
+select '188', count(*) from test_hilbert where g #< 'POINT(3 4)';
+set enable_seqscan = on;
+select '189', count(*) from test_hilbert where g #< 'POINT(3 4)';
+drop table test_hilbert;
+
 
 -- Drop test table
 DROP table test;
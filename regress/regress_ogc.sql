@@ -134,6 +134,12 @@ select 'intersects', ST_intersects(
 select 'ST_GeometryN', ST_asewkt(ST_GeometryN('LINESTRING(0 0, 1 1)'::geometry, 1));
 select 'ST_NumGeometries', ST_NumGeometries('LINESTRING(0 0, 1 1)'::geometry);
 select 'ST_Union1', ST_AsText(ST_Union(ARRAY['POLYGON((0 0, 0 1, 1 1, 1 0, 0 0))'::geometry, 'POLYGON((0.5 0.5, 1.5 0.5, 1.5 1.5, 0.5 1.5, 0.5 0.5))'::geometry]));
+-- small work_mem, so the aggregate unions in several batches
+SET work_mem = 64;
+select 'ST_Union_agg1', ST_AsText(ST_Envelope(u)), ST_Area(u), ST_NumGeometries(u) from (
+  select ST_Union(ST_MakeEnvelope(i, 0, i + 2, 1)) as u from generate_series(0, 2999) i
+) as foo;
+SET work_mem TO DEFAULT;
 select 'ST_StartPoint1',ST_AsText(ST_StartPoint('LINESTRING(0 0, 1 1, 2 2)'));
 select 'ST_EndPoint1', ST_AsText(ST_Endpoint('LINESTRING(0 0, 1 1, 2 2)'));
 select 'ST_PointN1', ST_AsText(ST_PointN('LINESTRING(0 0, 1 1, 2 2)',2));
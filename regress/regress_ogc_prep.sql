@@ -296,3 +296,14 @@ SELECT 'covers311', ST_Covers('POLYGON((0 0, 0 10, 10 10, 10 0, 0 0))', p) FROM
 ('LINESTRING(1 10, 10 10, 10 8)'),('LINESTRING(1 10, 10 10, 10 8)'),('LINESTRING(1 10, 10 10, 10 8)')
 ) AS v(p);
 
+-- Arguments cycling through more geometries than the cache holds
+SET postgis.geometry_cache_size = 2;
+SELECT 'cache1', count(*) FROM ( SELECT ST_MakeEnvelope((i%3)*10, 0, (i%3)*10+5, 5) AS p, (i%3)*10 + CASE WHEN i%2 = 0 THEN 1 ELSE 7 END AS x FROM generate_series(0,29) i ) AS v
+WHERE ST_Intersects(p, ST_MakeLine(ST_MakePoint(x, 1), ST_MakePoint(x+0.5, 1)));
+SELECT 'cache2', count(*) FROM ( SELECT ST_MakeEnvelope((i%3)*10, 0, (i%3)*10+5, 5) AS p, (i%3)*10 + CASE WHEN i%2 = 0 THEN 1 ELSE 7 END AS x FROM generate_series(0,29) i ) AS v
+WHERE ST_Contains(p, ST_MakePoint(x, 1));
+SET postgis.geometry_cache_size TO DEFAULT;
+SELECT 'cache3', count(*) FROM ( SELECT ST_MakeEnvelope((i%3)*10, 0, (i%3)*10+5, 5) AS p, (i%3)*10 + CASE WHEN i%2 = 0 THEN 1 ELSE 7 END AS x FROM generate_series(0,29) i ) AS v
+WHERE ST_Intersects(p, ST_MakeLine(ST_MakePoint(x, 1), ST_MakePoint(x+0.5, 1)));
+SELECT 'cache4', count(*) FROM ( SELECT ST_MakeEnvelope((i%3)*10, 0, (i%3)*10+5, 5) AS p, (i%3)*10 + CASE WHEN i%2 = 0 THEN 1 ELSE 7 END AS x FROM generate_series(0,29) i ) AS v
+WHERE ST_Covers(p, ST_MakePoint(x, 1));
@@ -36,5 +36,12 @@ SELECT ST_transform(ST_GeomFromEWKT('SRID=0;POINT(0 0)'),100002);
 --- test #8: Transforming to same SRID
 SELECT 8,ST_AsEWKT(ST_transform(ST_GeomFromEWKT('SRID=100002;POINT(0 0)'),100002));
 
+--- test #9: MULTIPOINT projection, 2 points
+SELECT 9,ST_AsEWKT(ST_SnapToGrid(ST_transform(ST_GeomFromEWKT('SRID=100002;MULTIPOINT(16 48, 16 49)'),100001),10));
+
+--- test #10: cached projections follow changes to spatial_ref_sys
+UPDATE spatial_ref_sys SET proj4text = (SELECT proj4text FROM spatial_ref_sys WHERE srid = 100002) WHERE srid = 100001;
+SELECT 10,ST_AsEWKT(ST_SnapToGrid(ST_transform(ST_GeomFromEWKT('SRID=100002;POINT(16 48)'),100001),0.0001));
+
 DELETE FROM spatial_ref_sys WHERE srid >= 1000000;
 
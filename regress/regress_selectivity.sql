@@ -0,0 +1,84 @@
+-- Row estimates of the && and &&& operators on skewed data, from the
+-- plans of the queries, must be within a factor 2 of the counts
+
+CREATE FUNCTION _estimated_rows(q text) RETURNS integer AS $$
+DECLARE
+  r text;
+BEGIN
+  FOR r IN EXECUTE 'EXPLAIN ' || q LOOP
+    RETURN substring(r from ' rows=([0-9]+)')::integer;
+  END LOOP;
+END;
+$$ LANGUAGE 'plpgsql';
+
+CREATE FUNCTION _estimate_is_close(q text) RETURNS boolean AS $$
+DECLARE
+  actual integer;
+  estimated integer;
+BEGIN
+  EXECUTE 'SELECT count(*) FROM (' || q || ') s' INTO actual;
+  estimated := _estimated_rows(q);
+  RETURN estimated BETWEEN actual / 2 AND actual * 2;
+END;
+$$ LANGUAGE 'plpgsql';
+
+-- Nine tenths of the points in three dense clusters, the rest spread out
+CREATE TABLE sel_points (g geometry);
+INSERT INTO sel_points SELECT ST_MakePoint(cx + (i % 50) * 0.2, cy + (i / 50) * 0.2)
+  FROM (VALUES (100, 100), (500, 800), (900, 300)) c(cx, cy), generate_series(0, 2999) i;
+INSERT INTO sel_points SELECT ST_MakePoint((i * 37) % 1000, (i * 91) % 1000) FROM generate_series(0, 999) i;
+
+-- Small squares over the clusters and around
+CREATE TABLE sel_squares (g geometry);
+INSERT INTO sel_squares SELECT ST_MakeEnvelope(x, y, x + 1, y + 1)
+  FROM (SELECT cx + 0.1 + (i % 10) * 1.2 AS x, cy + 0.1 + (i / 10) * 1.2 AS y
+        FROM (VALUES (100, 100), (500, 800), (900, 300)) c(cx, cy), generate_series(0, 99) i) s;
+INSERT INTO sel_squares SELECT ST_MakeEnvelope(x, y, x + 1, y + 1)
+  FROM (SELECT (i * 53) % 1000 AS x, (i * 29) % 1000 AS y FROM generate_series(0, 99) i) s;
+
+ANALYZE sel_points;
+ANALYZE sel_squares;
+
+-- Inside a cluster
+SELECT 'sel1', _estimate_is_close('SELECT * FROM sel_points WHERE g && ST_MakeEnvelope(100, 100, 105, 105)');
+-- Between the clusters
+SELECT 'sel2', _estimate_is_close('SELECT * FROM sel_points WHERE g && ST_MakeEnvelope(200, 400, 400, 600)');
+-- Everything
+SELECT 'sel3', _estimate_is_close('SELECT * FROM sel_points WHERE g && ST_MakeEnvelope(0, 0, 1000, 1000)');
+-- Nothing
+SELECT 'sel4', _estimated_rows('SELECT * FROM sel_points WHERE g && ST_MakeEnvelope(2000, 2000, 3000, 3000)');
+
+SELECT 'join1', _estimate_is_close('SELECT * FROM sel_points p, sel_squares s WHERE p.g && s.g');
+
+-- Same with &&& on 3D points in two layers far apart in Z
+CREATE TABLE sel_points3d (g geometry);
+INSERT INTO sel_points3d SELECT ST_MakePoint((i * 37) % 97, (i * 91) % 89,
+    CASE WHEN i % 2 = 0 THEN (i * 7) % 11 ELSE 1000 + (i * 7) % 11 END)
+  FROM generate_series(0, 3999) i;
+
+-- Small cubes over the lower layer
+CREATE TABLE sel_cubes (g geometry);
+INSERT INTO sel_cubes SELECT ST_MakeLine(ST_MakePoint(x, y, z), ST_MakePoint(x + 5, y + 5, z + 5))
+  FROM (SELECT (i * 53) % 97 + 0.25 AS x, (i * 29) % 89 + 0.25 AS y, (i * 3) % 11 + 0.25 AS z
+        FROM generate_series(0, 199) i) s;
+
+ANALYZE sel_points3d;
+ANALYZE sel_cubes;
+
+-- Lower layer only
+SELECT 'sel5', _estimate_is_close('SELECT * FROM sel_points3d WHERE g &&& ''LINESTRING(0 0 0, 50 50 20)''::geometry');
+-- Upper layer only
+SELECT 'sel6', _estimate_is_close('SELECT * FROM sel_points3d WHERE g &&& ''LINESTRING(10 10 1000, 40 40 1005)''::geometry');
+-- Between the layers
+SELECT 'sel7', _estimated_rows('SELECT * FROM sel_points3d WHERE g &&& ''LINESTRING(0 0 100, 100 100 900)''::geometry');
+-- 2D box, both layers
+SELECT 'sel8', _estimate_is_close('SELECT * FROM sel_points3d WHERE g &&& ST_MakeEnvelope(0, 0, 50, 50)');
+
+SELECT 'join2', _estimate_is_close('SELECT * FROM sel_points3d p, sel_cubes c WHERE p.g &&& c.g');
+
+DROP TABLE sel_points;
+DROP TABLE sel_squares;
+DROP TABLE sel_points3d;
+DROP TABLE sel_cubes;
+DROP FUNCTION _estimate_is_close(text);
+DROP FUNCTION _estimated_rows(text);
@@ -64,6 +64,18 @@ my $objs = {
 			"geography" => 1,
 			"gidx" => 1
 		}
+	},
+ 	"200" => { 
+		"operators" => {
+			"geometry #<" => 1,
+			"geometry #<=" => 1,
+			"geometry #=" => 1,
+			"geometry #>=" => 1,
+			"geometry #>" => 1
+		},
+		"opclasses" => {
+			"btree_geometry_hilbert_ops" => 1
+		}
 	}
 };
 
@@ -205,6 +217,22 @@ while(<INPUT>)
 		print $def;
 	}
 
+	# This code handles triggers by dropping and recreating them.
+	if ( /^create trigger\s+(\w+)/i )
+	{
+		my $trigname = $1;
+		my $trigtable = 'unknown';
+		my $def = $_;
+		while(<INPUT>)
+		{
+			$def .= $_;
+			$trigtable = $1 if ( /\bon\s+(\w+)/i );
+			last if /\;/;
+		}
+		print "DROP TRIGGER IF EXISTS $trigname ON $trigtable;\n";
+		print $def;
+	}
+
 	# This code handles aggregates by dropping and recreating them.
 	if ( /^create aggregate\s+(\S+)\s*\(/i )
 	{
@@ -1444,6 +1444,7 @@ FUNCTION forcerhr(geometry)
 FUNCTION geography_analyze(internal)
 FUNCTION geography(bytea)
 FUNCTION geography_cmp(geography, geography)
+FUNCTION geography_distance_box(geography, geography)
 FUNCTION geography_eq(geography, geography)
 FUNCTION geography_ge(geography, geography)
 FUNCTION geography(geography, integer, boolean)
@@ -1452,6 +1453,7 @@ FUNCTION geography_gist_compress(internal)
 FUNCTION geography_gist_consistent(internal, geography, integer)
 FUNCTION geography_gist_consistent(internal, geometry, integer)
 FUNCTION geography_gist_decompress(internal)
+FUNCTION geography_gist_distance(internal, geography, integer)
 FUNCTION geography_gist_join_selectivity(internal, oid, internal, smallint)
 FUNCTION geography_gist_penalty(internal, internal, internal)
 FUNCTION geography_gist_picksplit(internal, internal)
@@ -1485,6 +1487,7 @@ FUNCTION geometry_contain(geometry, geometry)
 FUNCTION geometry_contains(geometry, geometry)
 FUNCTION geometry_distance_box(geometry, geometry)
 FUNCTION geometry_distance_centroid(geometry, geometry)
+FUNCTION geometry_distance_nd(geometry, geometry)
 FUNCTION geometry_eq(geometry, geometry)
 FUNCTION geometryfromtext(text)
 FUNCTION geometryfromtext(text, integer)
@@ -1498,7 +1501,9 @@ FUNCTION geometry_gist_consistent_nd(internal, geometry, integer)
 FUNCTION geometry_gist_decompress_2d(internal)
 FUNCTION geometry_gist_decompress_nd(internal)
 FUNCTION geometry_gist_distance_2d(internal, geometry, integer)
+FUNCTION geometry_gist_distance_nd(internal, geometry, integer)
 FUNCTION geometry_gist_joinsel_2d(internal, oid, internal, smallint)
+FUNCTION geometry_gist_joinsel_nd(internal, oid, internal, smallint)
 FUNCTION geometry_gist_joinsel(internal, oid, internal, smallint)
 FUNCTION geometry_gist_penalty_2d(internal, internal, internal)
 FUNCTION geometry_gist_penalty_nd(internal, internal, internal)
@@ -1507,10 +1512,17 @@ FUNCTION geometry_gist_picksplit_nd(internal, internal)
 FUNCTION geometry_gist_same_2d(geometry, geometry, internal)
 FUNCTION geometry_gist_same_nd(geometry, geometry, internal)
 FUNCTION geometry_gist_sel_2d(internal, oid, internal, integer)
+FUNCTION geometry_gist_sel_nd(internal, oid, internal, integer)
 FUNCTION geometry_gist_sel(internal, oid, internal, integer)
 FUNCTION geometry_gist_union_2d(bytea, internal)
 FUNCTION geometry_gist_union_nd(bytea, internal)
 FUNCTION geometry_gt(geometry, geometry)
+FUNCTION geometry_hilbert_cmp(geometry, geometry)
+FUNCTION geometry_hilbert_eq(geometry, geometry)
+FUNCTION geometry_hilbert_ge(geometry, geometry)
+FUNCTION geometry_hilbert_gt(geometry, geometry)
+FUNCTION geometry_hilbert_le(geometry, geometry)
+FUNCTION geometry_hilbert_lt(geometry, geometry)
 FUNCTION geometry_in(cstring)
 FUNCTION geometry_left(geometry, geometry)
 FUNCTION geometry_le(geometry, geometry)
@@ -1675,9 +1687,12 @@ FUNCTION pgis_abs_out(pgis_abs)
 FUNCTION pgis_geometry_accum_finalfn(pgis_abs)
 FUNCTION pgis_geometry_accum_transfn(pgis_abs, geometry)
 FUNCTION pgis_geometry_collect_finalfn(pgis_abs)
+FUNCTION pgis_geometry_collect_transfn(pgis_abs, geometry)
 FUNCTION pgis_geometry_makeline_finalfn(pgis_abs)
+FUNCTION pgis_geometry_makeline_transfn(pgis_abs, geometry)
 FUNCTION pgis_geometry_polygonize_finalfn(pgis_abs)
 FUNCTION pgis_geometry_union_finalfn(pgis_abs)
+FUNCTION pgis_geometry_union_transfn(pgis_abs, geometry)
 FUNCTION pointfromtext(text)
 FUNCTION pointfromtext(text, integer)
 FUNCTION pointfromwkb(bytea)
@@ -1723,6 +1738,7 @@ FUNCTION postgis_raster_lib_version()
 FUNCTION postgis_scripts_build_date()
 FUNCTION postgis_scripts_installed()
 FUNCTION postgis_scripts_released()
+FUNCTION postgis_srs_cache_invalidate()
 FUNCTION postgis_transform_geometry(geometry, text, text, integer)
 FUNCTION postgis_type_name(character varying, integer, boolean)
 FUNCTION postgis_typmod_dims(integer)
@@ -1756,8 +1772,10 @@ FUNCTION raster_overbelow(raster, raster)
 FUNCTION raster_overlap(raster, raster)
 FUNCTION raster_overleft(raster, raster)
 FUNCTION raster_overright(raster, raster)
+FUNCTION raster_recv(internal)
 FUNCTION raster_right(raster, raster)
 FUNCTION raster_same(raster, raster)
+FUNCTION raster_send(raster)
 FUNCTION relate(geometry, geometry)
 FUNCTION relate(geometry, geometry, text)
 FUNCTION relationtrigger()
@@ -2058,6 +2076,7 @@ FUNCTION st_combine_bbox(box2d, geometry)
 FUNCTION st_combine_bbox(box3d_extent, geometry)
 FUNCTION st_combine_bbox(box3d, geometry)
 FUNCTION st_compression(chip)
+FUNCTION st_computestats(raster)
 FUNCTION _st_concavehull(geometry)
 FUNCTION st_concavehull(geometry, double precision, boolean)
 FUNCTION _st_concvehull(geometry)
@@ -2215,6 +2234,7 @@ FUNCTION st_height(chip)
 FUNCTION st_height(raster)
 FUNCTION _st_hillshade4ma(double precision[], text, text[])
 FUNCTION st_hillshade(raster, integer, text, double precision, double precision, double precision, double precision)
+FUNCTION st_hilbertkey(geometry)
 FUNCTION st_histogram2d_in(cstring)
 FUNCTION st_histogram2d_out(histogram2d)
 FUNCTION _st_histogram(raster, integer, boolean, double precision, integer, double precision[], boolean, double precision, double precision)
@@ -2687,6 +2707,7 @@ FUNCTION zmax(box3d)
 FUNCTION zmflag(geometry)
 FUNCTION zmin(box3d)
 OPERATOR CLASS btree_geography_ops
+OPERATOR CLASS btree_geometry_hilbert_ops
 OPERATOR CLASS btree_geometry_ops
 OPERATOR CLASS gist_geography_ops
 OPERATOR CLASS gist_geometry_ops
@@ -2710,6 +2731,11 @@ OPERATOR &<(geography, geography)
 OPERATOR &>(geography, geography)
 OPERATOR &&(geography, geography)
 OPERATOR &&&(geography, geography)
+OPERATOR #<=(geometry, geometry)
+OPERATOR #<(geometry, geometry)
+OPERATOR #=(geometry, geometry)
+OPERATOR #>=(geometry, geometry)
+OPERATOR #>(geometry, geometry)
 OPERATOR ~=(geometry, geometry)
 OPERATOR ~(geometry, geometry)
 OPERATOR <<|(geometry, geometry)
@@ -2769,6 +2795,7 @@ TABLE raster_overviews
 TABLE spatial_ref_sys
 TABLE topology
 TRIGGER layer_integrity_checks
+TRIGGER spatial_ref_sys_cache_invalidate
 TYPE box2d
 TYPE box2df
 TYPE box3d